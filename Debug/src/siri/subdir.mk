@@ -8,7 +8,9 @@ C_SRCS += \
 ../src/siri/evars.c \
 ../src/siri/health.c \
 ../src/siri/heartbeat.c \
+../src/siri/metrics.c \
 ../src/siri/optimize.c \
+../src/siri/prof.c \
 ../src/siri/siri.c \
 ../src/siri/version.c
 
@@ -21,7 +23,9 @@ OBJS += \
 ./src/siri/evars.o \
 ./src/siri/health.o \
 ./src/siri/heartbeat.o \
+./src/siri/metrics.o \
 ./src/siri/optimize.o \
+./src/siri/prof.o \
 ./src/siri/siri.o \
 ./src/siri/version.o
 
@@ -34,7 +38,9 @@ C_DEPS += \
 ./src/siri/evars.d \
 ./src/siri/health.d \
 ./src/siri/heartbeat.d \
+./src/siri/metrics.d \
 ./src/siri/optimize.d \
+./src/siri/prof.d \
 ./src/siri/siri.d \
 ./src/siri/version.d
 
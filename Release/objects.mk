@@ -1,4 +1,4 @@
 USER_OBJS :=
 
-LIBS := -luv -lm -lpcre2-8 -lcleri -lyajl
+LIBS := -luv -lm -lpcre2-8 -lcleri -lyajl -lpthread
 
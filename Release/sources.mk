@@ -17,6 +17,9 @@ src/cfgparser \
 src/ctree \
 src/expr \
 src/imap \
+src/hist \
+src/slab \
+src/rbits \
 src/iso8601 \
 src/lib \
 src/llist \
@@ -0,0 +1,20 @@
+# Add inputs and outputs from these tool invocations to the build variables
+C_SRCS += \
+../src/rbits/rbits.c
+
+OBJS += \
+./src/rbits/rbits.o
+
+C_DEPS += \
+./src/rbits/rbits.d
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/rbits/%.o: ../src/rbits/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: GCC C Compiler'
+	$(CC) -DNDEBUG -I../include -O3 -Wall -Wextra $(CPPFLAGS) $(CFLAGS) -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+
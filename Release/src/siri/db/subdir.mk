@@ -1,5 +1,6 @@
 # Add inputs and outputs from these tool invocations to the build variables
 C_SRCS += \
+../src/siri/db/acache.c \
 ../src/siri/db/access.c \
 ../src/siri/db/aggregate.c \
 ../src/siri/db/auth.c \
@@ -10,12 +11,16 @@ C_SRCS += \
 ../src/siri/db/forward.c \
 ../src/siri/db/group.c \
 ../src/siri/db/groups.c \
+../src/siri/db/ibatch.c \
+../src/siri/db/ijson.c \
 ../src/siri/db/initsync.c \
 ../src/siri/db/insert.c \
+../src/siri/db/itext.c \
 ../src/siri/db/listener.c \
 ../src/siri/db/lookup.c \
 ../src/siri/db/median.c \
 ../src/siri/db/misc.c \
+../src/siri/db/ngram.c \
 ../src/siri/db/nodes.c \
 ../src/siri/db/pcache.c \
 ../src/siri/db/points.c \
@@ -23,11 +28,14 @@ C_SRCS += \
 ../src/siri/db/pools.c \
 ../src/siri/db/presuf.c \
 ../src/siri/db/props.c \
+../src/siri/db/qcache.c \
 ../src/siri/db/queries.c \
 ../src/siri/db/query.c \
 ../src/siri/db/re.c \
 ../src/siri/db/reindex.c \
 ../src/siri/db/replicate.c \
+../src/siri/db/rollup.c \
+../src/siri/db/sbatch.c \
 ../src/siri/db/series.c \
 ../src/siri/db/server.c \
 ../src/siri/db/servers.c \
@@ -37,14 +45,17 @@ C_SRCS += \
 ../src/siri/db/tag.c \
 ../src/siri/db/tags.c \
 ../src/siri/db/tasks.c \
+../src/siri/db/tdigest.c \
 ../src/siri/db/tee.c \
 ../src/siri/db/time.c \
 ../src/siri/db/user.c \
 ../src/siri/db/users.c \
 ../src/siri/db/variance.c \
-../src/siri/db/walker.c
+../src/siri/db/walker.c \
+../src/siri/db/zdict.c
 
 OBJS += \
+./src/siri/db/acache.o \
 ./src/siri/db/access.o \
 ./src/siri/db/aggregate.o \
 ./src/siri/db/auth.o \
@@ -55,12 +66,16 @@ OBJS += \
 ./src/siri/db/forward.o \
 ./src/siri/db/group.o \
 ./src/siri/db/groups.o \
+./src/siri/db/ibatch.o \
+./src/siri/db/ijson.o \
 ./src/siri/db/initsync.o \
 ./src/siri/db/insert.o \
+./src/siri/db/itext.o \
 ./src/siri/db/listener.o \
 ./src/siri/db/lookup.o \
 ./src/siri/db/median.o \
 ./src/siri/db/misc.o \
+./src/siri/db/ngram.o \
 ./src/siri/db/nodes.o \
 ./src/siri/db/pcache.o \
 ./src/siri/db/points.o \
@@ -68,11 +83,14 @@ OBJS += \
 ./src/siri/db/pools.o \
 ./src/siri/db/presuf.o \
 ./src/siri/db/props.o \
+./src/siri/db/qcache.o \
 ./src/siri/db/queries.o \
 ./src/siri/db/query.o \
 ./src/siri/db/re.o \
 ./src/siri/db/reindex.o \
 ./src/siri/db/replicate.o \
+./src/siri/db/rollup.o \
+./src/siri/db/sbatch.o \
 ./src/siri/db/series.o \
 ./src/siri/db/server.o \
 ./src/siri/db/servers.o \
@@ -82,14 +100,17 @@ OBJS += \
 ./src/siri/db/tag.o \
 ./src/siri/db/tags.o \
 ./src/siri/db/tasks.o \
+./src/siri/db/tdigest.o \
 ./src/siri/db/tee.o \
 ./src/siri/db/time.o \
 ./src/siri/db/user.o \
 ./src/siri/db/users.o \
 ./src/siri/db/variance.o \
-./src/siri/db/walker.o
+./src/siri/db/walker.o \
+./src/siri/db/zdict.o
 
 C_DEPS += \
+./src/siri/db/acache.d \
 ./src/siri/db/access.d \
 ./src/siri/db/aggregate.d \
 ./src/siri/db/auth.d \
@@ -100,12 +121,16 @@ C_DEPS += \
 ./src/siri/db/forward.d \
 ./src/siri/db/group.d \
 ./src/siri/db/groups.d \
+./src/siri/db/ibatch.d \
+./src/siri/db/ijson.d \
 ./src/siri/db/initsync.d \
 ./src/siri/db/insert.d \
+./src/siri/db/itext.d \
 ./src/siri/db/listener.d \
 ./src/siri/db/lookup.d \
 ./src/siri/db/median.d \
 ./src/siri/db/misc.d \
+./src/siri/db/ngram.d \
 ./src/siri/db/nodes.d \
 ./src/siri/db/pcache.d \
 ./src/siri/db/points.d \
@@ -113,11 +138,14 @@ C_DEPS += \
 ./src/siri/db/pools.d \
 ./src/siri/db/presuf.d \
 ./src/siri/db/props.d \
+./src/siri/db/qcache.d \
 ./src/siri/db/queries.d \
 ./src/siri/db/query.d \
 ./src/siri/db/re.d \
 ./src/siri/db/reindex.d \
 ./src/siri/db/replicate.d \
+./src/siri/db/rollup.d \
+./src/siri/db/sbatch.d \
 ./src/siri/db/series.d \
 ./src/siri/db/server.d \
 ./src/siri/db/servers.d \
@@ -127,12 +155,14 @@ C_DEPS += \
 ./src/siri/db/tag.d \
 ./src/siri/db/tags.d \
 ./src/siri/db/tasks.d \
+./src/siri/db/tdigest.d \
 ./src/siri/db/tee.d \
 ./src/siri/db/time.d \
 ./src/siri/db/user.d \
 ./src/siri/db/users.d \
 ./src/siri/db/variance.d \
-./src/siri/db/walker.d
+./src/siri/db/walker.d \
+./src/siri/db/zdict.d
 
 
 # Each subdirectory must supply rules for building sources it contributes
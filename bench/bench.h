@@ -0,0 +1,87 @@
+#ifndef SIRIDB_BENCH_H_
+#define SIRIDB_BENCH_H_
+
+/*
+ * Each benchmark prints a single tab separated line which can be compared
+ * between commits:
+ *
+ *      bench   <name>  <ops>  <ns/op>  <points/s>
+ *
+ * The points/s column is 0 for benchmarks which do not process points.
+ * A benchmark runs for at least BENCH_TIME_MS milliseconds. (environment
+ * variable, defaults to 200)
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_TIME_MS 200
+
+/* results are written to this sink so the compiler keeps the work */
+static volatile uint64_t bench_sink;
+
+/* xorshift, the same sequence is generated on each run */
+static uint64_t bench__seed = 88172645463325252ULL;
+
+static inline uint64_t bench_rand(void)
+{
+    bench__seed ^= bench__seed << 13;
+    bench__seed ^= bench__seed >> 7;
+    bench__seed ^= bench__seed << 17;
+    return bench__seed;
+}
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t bench_min_ns(void)
+{
+    const char * env = getenv("BENCH_TIME_MS");
+    uint64_t ms = env ? strtoull(env, NULL, 10) : 0;
+    return (ms ? ms : BENCH_DEFAULT_TIME_MS) * 1000000ULL;
+}
+
+static void bench_report(
+        const char * name,
+        uint64_t ops,
+        uint64_t ns,
+        uint64_t points_per_op)
+{
+    double ns_op = (double) ns / (double) ops;
+    double points_s = points_per_op
+            ? (double) points_per_op * 1e9 / ns_op
+            : 0.0;
+
+    printf("bench\t%s\t%" PRIu64 "\t%.1f\t%.0f\n",
+            name, ops, ns_op, points_s);
+    fflush(stdout);
+}
+
+/*
+ * Run the code in batches which double in size until the minimum time has
+ * passed. The time is only read between batches so fast operations are not
+ * dominated by the clock.
+ */
+#define BENCH_RUN(__name, __points_per_op, ...)                             \
+do {                                                                        \
+    uint64_t __ops = 0, __batch = 1, __i, __ns;                             \
+    uint64_t __min = bench_min_ns(), __start = bench_now();                 \
+    do {                                                                    \
+        for (__i = 0; __i < __batch; __i++)                                 \
+        {                                                                   \
+            __VA_ARGS__;                                                    \
+        }                                                                   \
+        __ops += __batch;                                                   \
+        __batch <<= 1;                                                      \
+    } while ((__ns = bench_now() - __start) < __min);                       \
+    bench_report(__name, __ops, __ns, __points_per_op);                     \
+} while (0)
+
+#endif  /* SIRIDB_BENCH_H_ */
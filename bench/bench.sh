@@ -0,0 +1,43 @@
+#!/bin/bash
+# Build and run the micro benchmarks. Each bench_<name> directory contains
+# bench_<name>.c and a `sources` file, like the tests in ../test.
+#
+#   ./bench.sh              run all benchmarks
+#   ./bench.sh points       run bench_points only
+#
+# Use BENCH_TIME_MS to change the minimum time for each benchmark.
+RET=0
+
+if [[ "$OSTYPE" == "darwin" ]]; then
+    LCRYPT=
+else
+    LCRYPT=-lcrypt
+fi
+
+run () {
+    if [ ! -f $1/sources ]; then
+       return;
+    fi
+    C_SRC=$(cat $1/sources)
+
+    SOURCE=$1/$1.c
+    OUT=$1.out
+    rm "$OUT" 2> /dev/null
+
+    gcc -I"../include" -O2 -DNDEBUG -Wall -Wextra -std=gnu99 $SOURCE $C_SRC -lm -lpcre2-8 -lcleri -luuid -luv -lyajl -lpthread $LCRYPT -o "$OUT"
+    ./$OUT
+    rc=$?; if [[ $rc != 0 ]]; then RET=$((RET+1)); fi
+    rm "$OUT" 2> /dev/null
+    rm -r "$OUT.dSYM" 2> /dev/null
+}
+
+if [ $# -eq 0 ]; then
+    for d in bench_*/ ; do
+        run "${d%?}"
+    done
+else
+    name=`echo $1 | sed 's/\(bench_\)\?\(.*\?\)$/\2/g' | sed 's/\(.*\)\/$/\1/g'`
+    run "bench_$name"
+fi
+
+exit $RET
@@ -0,0 +1,75 @@
+#include "../bench.h"
+#include <siri/db/aggregate.h>
+#include <siri/db/points.h>
+
+#define NPOINTS 100000
+#define GROUP_BY 600        /* about 60 points for each group */
+
+#define SIRIDB_MAX_SIZE_ERR_MSG 1024
+
+static char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+
+static siridb_points_t * gen_points(size_t n)
+{
+    siridb_points_t * points = siridb_points_new(n, TP_INT);
+    uint64_t ts = 0;
+    qp_via_t val = {.int64 = 0};
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        ts += 10;
+        val.int64 += (int64_t) (bench_rand() % 21) - 10;
+        siridb_points_add_point(points, &ts, &val);
+    }
+    return points;
+}
+
+static void bench_aggr(
+        siridb_points_t * points,
+        const char * name,
+        uint32_t gid,
+        uint64_t group_by)
+{
+    char buf[64];
+    siridb_aggr_t aggr;
+    siridb_points_t * aggrp;
+
+    memset(&aggr, 0, sizeof(siridb_aggr_t));
+    aggr.gid = gid;
+    aggr.group_by = group_by;
+    aggr.timespan = 1.0;
+
+    snprintf(buf, sizeof(buf), "aggregate_%s", name);
+    BENCH_RUN(buf, points->len, {
+        aggrp = siridb_aggregate_run(points, &aggr, err_msg);
+        bench_sink += aggrp->len;
+        siridb_points_free(aggrp);
+    });
+}
+
+int main()
+{
+    siridb_points_t * points = gen_points(NPOINTS);
+
+    siridb_init_aggregates();
+
+    bench_aggr(points, "count", CLERI_GID_F_COUNT, GROUP_BY);
+    bench_aggr(points, "first", CLERI_GID_F_FIRST, GROUP_BY);
+    bench_aggr(points, "last", CLERI_GID_F_LAST, GROUP_BY);
+    bench_aggr(points, "max", CLERI_GID_F_MAX, GROUP_BY);
+    bench_aggr(points, "min", CLERI_GID_F_MIN, GROUP_BY);
+    bench_aggr(points, "mean", CLERI_GID_F_MEAN, GROUP_BY);
+    bench_aggr(points, "median", CLERI_GID_F_MEDIAN, GROUP_BY);
+    bench_aggr(points, "median_high", CLERI_GID_F_MEDIAN_HIGH, GROUP_BY);
+    bench_aggr(points, "median_low", CLERI_GID_F_MEDIAN_LOW, GROUP_BY);
+    bench_aggr(points, "sum", CLERI_GID_F_SUM, GROUP_BY);
+    bench_aggr(points, "variance", CLERI_GID_F_VARIANCE, GROUP_BY);
+    bench_aggr(points, "pvariance", CLERI_GID_F_PVARIANCE, GROUP_BY);
+    bench_aggr(points, "stddev", CLERI_GID_F_STDDEV, GROUP_BY);
+    bench_aggr(points, "derivative", CLERI_GID_F_DERIVATIVE, 0);
+    bench_aggr(points, "difference", CLERI_GID_F_DIFFERENCE, 0);
+
+    siridb_points_free(points);
+    return 0;
+}
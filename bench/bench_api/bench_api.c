@@ -0,0 +1,223 @@
+#include "../bench.h"
+#include <llist/llist.h>
+#include <logger/logger.h>
+#include <siri/api.h>
+#include <siri/cfg/cfg.h>
+#include <siri/net/tcp.h>
+#include <siri/siri.h>
+#include <uv.h>
+
+#define BENCH_API_PORT 19021
+#define BENCH_API_MAX_DEPTH 64
+
+/* the API responds with 404 Not Found so only the HTTP layer is measured */
+static const char * request =
+        "GET /bench HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "User-Agent: bench_api\r\n\r\n";
+
+static const char * request_close =
+        "GET /bench HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "User-Agent: bench_api\r\n"
+        "Connection: close\r\n\r\n";
+
+static const char * response =
+        "HTTP/1.1 404 Not Found\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 11\r\n\r\n"
+        "NOT FOUND\r\n";
+
+/*
+ * A keep-alive client on the same loop as the HTTP API. Only the number of
+ * received bytes is counted since all responses are equal.
+ */
+static uv_tcp_t client;
+static uv_connect_t connect_req;
+static uv_tcp_t conn;
+static int connected;
+static int written;
+static int closed;
+static size_t nread;
+static char rbuf[65536];
+
+static void bench_alloc_cb(
+        uv_handle_t * handle __attribute__((unused)),
+        size_t sugsz __attribute__((unused)),
+        uv_buf_t * buf)
+{
+    buf->base = rbuf;
+    buf->len = sizeof(rbuf);
+}
+
+static void bench_read_cb(
+        uv_stream_t * stream __attribute__((unused)),
+        ssize_t n,
+        const uv_buf_t * buf __attribute__((unused)))
+{
+    if (n < 0)
+    {
+        fprintf(stderr, "HTTP API connection lost: %s\n", uv_strerror(n));
+        exit(1);
+    }
+    nread += (size_t) n;
+}
+
+static void bench_write_cb(
+        uv_write_t * req __attribute__((unused)),
+        int status __attribute__((unused)))
+{
+    written = 1;
+}
+
+static void bench_close_cb(uv_handle_t * handle __attribute__((unused)))
+{
+    closed = 1;
+}
+
+static void bench_conn_read_cb(
+        uv_stream_t * stream,
+        ssize_t n,
+        const uv_buf_t * buf __attribute__((unused)))
+{
+    if (n < 0)
+    {
+        uv_close((uv_handle_t *) stream, bench_close_cb);
+        return;
+    }
+    nread += (size_t) n;
+}
+
+static void bench_conn_connect_cb(uv_connect_t * req, int status)
+{
+    static uv_write_t w;
+    uv_buf_t uvbuf = uv_buf_init(
+            (char *) request_close,
+            strlen(request_close));
+
+    if (status)
+    {
+        fprintf(stderr, "cannot connect: %s\n", uv_strerror(status));
+        exit(1);
+    }
+    (void) uv_write(&w, req->handle, &uvbuf, 1, NULL);
+    (void) uv_read_start(req->handle, bench_alloc_cb, bench_conn_read_cb);
+}
+
+static void bench_connect_cb(uv_connect_t * req, int status)
+{
+    if (status)
+    {
+        fprintf(stderr, "cannot connect: %s\n", uv_strerror(status));
+        exit(1);
+    }
+    (void) uv_read_start(req->handle, bench_alloc_cb, bench_read_cb);
+    connected = 1;
+}
+
+/*
+ * Send `depth` requests with a single write and wait for all responses.
+ * With a depth of one this is a plain keep-alive request/response cycle.
+ */
+static void bench_api(const char * name, size_t depth)
+{
+    char buf[BENCH_API_MAX_DEPTH * 128];
+    size_t i, n = strlen(request), expect = depth * strlen(response);
+    uint64_t ops = 0, ns, min = bench_min_ns(), start;
+    uv_write_t w;
+    uv_buf_t uvbuf;
+
+    for (i = 0; i < depth; i++)
+    {
+        memcpy(buf + i * n, request, n);
+    }
+    uvbuf = uv_buf_init(buf, depth * n);
+
+    start = bench_now();
+    do
+    {
+        nread = 0;
+        written = 0;
+        (void) uv_write(&w, (uv_stream_t *) &client, &uvbuf, 1,
+                bench_write_cb);
+        while (nread < expect || !written)
+        {
+            (void) uv_run(siri.loop, UV_RUN_ONCE);
+        }
+        ops += depth;
+    }
+    while ((ns = bench_now() - start) < min);
+
+    bench_report(name, ops, ns, 0);
+}
+
+/*
+ * A new connection for each request, the server closes the connection.
+ */
+static void bench_api_connect(const char * name, struct sockaddr_in * addr)
+{
+    uv_connect_t req;
+
+    BENCH_RUN(name, 0, {
+        nread = 0;
+        closed = 0;
+        (void) uv_tcp_init(siri.loop, &conn);
+        (void) uv_tcp_connect(
+                &req,
+                &conn,
+                (const struct sockaddr *) addr,
+                bench_conn_connect_cb);
+        while (!closed)
+        {
+            (void) uv_run(siri.loop, UV_RUN_ONCE);
+        }
+        if (nread < strlen(response))
+        {
+            fprintf(stderr, "unexpected response\n");
+            exit(1);
+        }
+    });
+}
+
+int main()
+{
+    static uv_loop_t loop;  /* the API server is never closed */
+    struct sockaddr_in addr;
+    siri_cfg_t cfg;
+
+    logger_init(stderr, LOGGER_CRITICAL);
+
+    memset(&cfg, 0, sizeof(siri_cfg_t));
+    cfg.http_api_port = BENCH_API_PORT;
+    cfg.ip_support = IP_SUPPORT_IPV4ONLY;
+
+    (void) uv_loop_init(&loop);
+    siri.loop = &loop;
+    siri.cfg = &cfg;
+    siri.siridb_list = llist_new();
+
+    if (siri_api_init())
+        return 1;
+
+    (void) uv_ip4_addr("127.0.0.1", BENCH_API_PORT, &addr);
+
+    bench_api_connect("api_connection_close", &addr);
+
+    (void) uv_tcp_init(siri.loop, &client);
+    (void) uv_tcp_connect(
+            &connect_req,
+            &client,
+            (const struct sockaddr *) &addr,
+            bench_connect_cb);
+
+    while (!connected)
+    {
+        (void) uv_run(siri.loop, UV_RUN_ONCE);
+    }
+
+    bench_api("api_keepalive", 1);
+    bench_api("api_pipelined_x16", 16);
+    bench_api("api_pipelined_x64", 64);
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "../bench.h"
+#include <qpack/qpack.h>
+#include <qpjson/qpjson.h>
+#include <siri/db/itext.h>
+#include <siri/db/ibatch.h>
+
+#define NSERIES 100
+#define NPOINTS 100
+#define DATA_SZ (1 << 21)
+#define BATCH_POINTS 100000
+
+/*
+ * Compare the cost of reading an insert body as line protocol, CSV or JSON.
+ * The text formats are read by the tokenizer which is used for inserts. The
+ * JSON body is converted to qpack and walked, like for JSON bodies which
+ * cannot be parsed while they are received.
+ *
+ * The batch benchmarks measure the points which are collected for the local
+ * insert while the points are assigned to pools.
+ */
+
+enum
+{
+    GEN_LINE,
+    GEN_CSV,
+    GEN_JSON
+};
+
+static char src[DATA_SZ];
+static char data[DATA_SZ];
+static size_t src_n;
+
+static int count_cb(
+        siridb_itext_t * itext __attribute__((unused)),
+        int64_t ts,
+        qp_obj_t * qp_val __attribute__((unused)),
+        void * arg)
+{
+    *((size_t *) arg) += (size_t) ts;
+    return 0;
+}
+
+static void gen(int fmt)
+{
+    size_t i, j;
+    int64_t ts, val;
+
+    src_n = 0;
+
+    if (fmt == GEN_JSON)
+    {
+        src[src_n++] = '{';
+    }
+
+    for (i = 0; i < NSERIES; i++)
+    {
+        if (fmt == GEN_JSON)
+        {
+            src_n += sprintf(src + src_n, "%s\"cpu,host=%zu usage\":[",
+                    i ? "," : "", i);
+        }
+        for (j = 0; j < NPOINTS; j++)
+        {
+            ts = 1500000000 + (int64_t) j * 10;
+            val = (int64_t) (bench_rand() % 10000);
+
+            if (fmt == GEN_LINE)
+                src_n += sprintf(src + src_n,
+                        "cpu,host=%zu usage=%" PRId64 "i %" PRId64 "\n",
+                        i, val, ts);
+            else if (fmt == GEN_CSV)
+                src_n += sprintf(src + src_n,
+                        "\"cpu,host=%zu usage\",%" PRId64 ",%" PRId64 "\n",
+                        i, ts, val);
+            else
+                src_n += sprintf(src + src_n,
+                        "%s[%" PRId64 ",%" PRId64 "]",
+                        j ? "," : "", ts, val);
+        }
+        if (fmt == GEN_JSON)
+        {
+            src[src_n++] = ']';
+        }
+    }
+
+    if (fmt == GEN_JSON)
+    {
+        src[src_n++] = '}';
+    }
+}
+
+static void bench_text(const char * name, int fmt)
+{
+    siridb_itext_t itext;
+    size_t sum = 0;
+
+    itext.now = 0;
+    gen(fmt == ITEXT_FMT_LINE ? GEN_LINE : GEN_CSV);
+
+    /* the tokenizer may change the data so a copy is parsed */
+    BENCH_RUN(name, NSERIES * NPOINTS, {
+        memcpy(data, src, src_n);
+        (void) siridb_itext_parse(&itext, fmt, data, src_n, count_cb, &sum);
+        bench_sink += sum;
+    });
+}
+
+static void bench_json(void)
+{
+    char * dst;
+    size_t dst_n;
+    qp_unpacker_t unpacker;
+    qp_obj_t obj;
+
+    gen(GEN_JSON);
+
+    BENCH_RUN("insert_json", NSERIES * NPOINTS, {
+        if (qpjson_json_to_qp(src, src_n, &dst, &dst_n) == yajl_status_ok)
+        {
+            qp_unpacker_init(&unpacker, (unsigned char *) dst, dst_n);
+            while (qp_next(&unpacker, &obj) != QP_END);
+            bench_sink += dst_n;
+            free(dst);
+        }
+    });
+}
+
+static void bench_batch(const char * name, size_t nseries)
+{
+    size_t i, j, npoints = BATCH_POINTS / nseries;
+    char series_name[32];
+    qp_packer_t * packer = qp_packer_new(DATA_SZ);
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_name, qp_ts, qp_val;
+    siridb_ibatch_t * ibatch;
+    siridb_ibatch_series_t * bseries;
+
+    qp_add_type(packer, QP_MAP_OPEN);
+    for (i = 0; i < nseries; i++)
+    {
+        sprintf(series_name, "series-%06zu", i);
+        qp_add_raw_term(packer,
+                (unsigned char *) series_name,
+                strlen(series_name));
+        qp_add_type(packer, QP_ARRAY_OPEN);
+        for (j = 0; j < npoints; j++)
+        {
+            qp_add_type(packer, QP_ARRAY2);
+            qp_add_int64(packer, 1500000000 + (int64_t) j * 10);
+            qp_add_double(packer, (double) (bench_rand() % 10000));
+        }
+        qp_add_type(packer, QP_ARRAY_CLOSE);
+    }
+
+    BENCH_RUN(name, BATCH_POINTS, {
+        ibatch = siridb_ibatch_new();
+        qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+        (void) qp_next(&unpacker, NULL);
+        (void) qp_next(&unpacker, &qp_name);
+        while (qp_name.tp == QP_RAW)
+        {
+            bseries = siridb_ibatch_add_series(
+                    ibatch,
+                    (const char *) qp_name.via.raw,
+                    qp_name.len,
+                    0);
+            (void) qp_next(&unpacker, NULL);
+            while (qp_next(&unpacker, NULL) == QP_ARRAY2)
+            {
+                (void) qp_next(&unpacker, &qp_ts);
+                (void) qp_next(&unpacker, &qp_val);
+                if (bseries != NULL)
+                {
+                    (void) siridb_ibatch_add_point(
+                            ibatch,
+                            bseries,
+                            qp_ts.via.int64,
+                            &qp_val);
+                }
+            }
+            (void) qp_next(&unpacker, &qp_name);
+        }
+        bench_sink += ibatch->points_len;
+        siridb_ibatch_free(ibatch);
+    });
+
+    qp_packer_free(packer);
+}
+
+int main()
+{
+    bench_text("insert_line", ITEXT_FMT_LINE);
+    bench_text("insert_csv", ITEXT_FMT_CSV);
+    bench_json();
+    bench_batch("insert_batch_10", BATCH_POINTS / 10);
+    bench_batch("insert_batch_1000", BATCH_POINTS / 1000);
+    return 0;
+}
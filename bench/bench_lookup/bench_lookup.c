@@ -0,0 +1,50 @@
+#include "../bench.h"
+#include <siri/db/lookup.h>
+
+#define NNAMES 10000
+#define NAME_SZ 64
+#define NPOOLS 16
+
+static char names[NNAMES][NAME_SZ];
+static size_t lens[NNAMES];
+
+static void bench_mode(uint8_t mode)
+{
+    char buf[64];
+    size_t j = 0;
+    siridb_lookup_t * lookup = siridb_lookup_new(NPOOLS, mode);
+
+    snprintf(buf, sizeof(buf), "lookup_sn_raw_%s",
+            siridb_lookup_mode_str(mode));
+
+    BENCH_RUN(buf, 0, {
+        bench_sink += siridb_lookup_sn_raw(lookup, names[j], lens[j]);
+        if (++j == NNAMES)
+            j = 0;
+    });
+
+    siridb_lookup_free(lookup);
+}
+
+int main()
+{
+    size_t i;
+    uint8_t mode;
+
+    for (i = 0; i < NNAMES; i++)
+    {
+        lens[i] = (size_t) snprintf(
+                names[i],
+                NAME_SZ,
+                "measurement,host=server%03u,region=eu-%u value",
+                (unsigned) (bench_rand() % 1000),
+                (unsigned) (i % 8));
+    }
+
+    for (mode = 0; mode < SIRIDB_LOOKUP_MODE_END; mode++)
+    {
+        bench_mode(mode);
+    }
+
+    return 0;
+}
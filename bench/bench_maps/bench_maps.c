@@ -0,0 +1,111 @@
+#include "../bench.h"
+#include <ctree/ctree.h>
+#include <imap/imap.h>
+
+#define NKEYS 100000
+#define NAME_SZ 48
+
+static char names[NKEYS][NAME_SZ];
+static uint64_t ids[NKEYS];
+
+static void bench_ctree(void)
+{
+    ct_t * ct = ct_new();
+    size_t i, j = 0;
+
+    for (i = 0; i < NKEYS; i++)
+    {
+        /* series names often share a long prefix */
+        snprintf(names[i], NAME_SZ, "cpu.host%03u.core%02u.%016" PRIx64,
+                (unsigned) (i % 997),
+                (unsigned) (i % 16),
+                bench_rand());
+        (void) ct_add(ct, names[i], names[i]);
+    }
+
+    BENCH_RUN("ct_get", 0, {
+        bench_sink += (uintptr_t) ct_get(ct, names[j]);
+        if (++j == NKEYS)
+            j = 0;
+    });
+
+    BENCH_RUN("ct_get_miss", 0, {
+        bench_sink += (uintptr_t) ct_get(ct, "cpu.host001.core01.missing");
+    });
+
+    ct_free(ct, NULL);
+}
+
+static int bench_cmp_name(const void * a, const void * b)
+{
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+/* series were added in the order of their id, the snapshot is now sorted by
+ * name so the c-tree is built at once */
+static void bench_ctree_load(void)
+{
+    static const char * keys[NKEYS];
+    size_t i;
+
+    for (i = 0; i < NKEYS; i++)
+    {
+        keys[i] = names[i];
+    }
+    qsort(keys, NKEYS, sizeof(const char *), bench_cmp_name);
+
+    BENCH_RUN("ct_add_100k", 0, {
+        ct_t * ct = ct_new();
+        for (i = 0; i < NKEYS; i++)
+        {
+            (void) ct_add(ct, names[i], names[i]);
+        }
+        bench_sink += ct->len;
+        ct_free(ct, NULL);
+    });
+
+    BENCH_RUN("ct_build_100k", 0, {
+        ct_t * ct = ct_new();
+        (void) ct_build(ct, keys, (void **) keys, NKEYS);
+        bench_sink += ct->len;
+        ct_free(ct, NULL);
+    });
+}
+
+static void bench_imap(void)
+{
+    imap_t * imap = imap_new();
+    size_t i, j = 0;
+
+    for (i = 0; i < NKEYS; i++)
+    {
+        /* series id's are mostly sequential */
+        ids[i] = i * 2 + (bench_rand() & 1);
+        (void) imap_add(imap, ids[i], &ids[i]);
+    }
+
+    /* look up in random order */
+    for (i = NKEYS - 1; i > 0; i--)
+    {
+        size_t k = bench_rand() % (i + 1);
+        uint64_t tmp = ids[i];
+        ids[i] = ids[k];
+        ids[k] = tmp;
+    }
+
+    BENCH_RUN("imap_get", 0, {
+        bench_sink += (uintptr_t) imap_get(imap, ids[j]);
+        if (++j == NKEYS)
+            j = 0;
+    });
+
+    imap_free(imap, NULL);
+}
+
+int main()
+{
+    bench_ctree();
+    bench_ctree_load();
+    bench_imap();
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "../bench.h"
+#include <siri/db/points.h>
+#include <vec/vec.h>
+
+#define NPOINTS 800         /* about the size of a chunk in a shard */
+#define NMERGE 8            /* number of series to merge */
+
+static siridb_points_t * gen_points(size_t n, points_tp tp, uint64_t ts)
+{
+    siridb_points_t * points = siridb_points_new(n, tp);
+    qp_via_t val;
+    int64_t i64 = 0;
+    double d = 0.0;
+    char * strs[4] = {"GET /", "POST /insert", "GET /query", "error"};
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        /* regular interval with some jitter, like real measurements */
+        ts += 10 + bench_rand() % 3;
+        switch (tp)
+        {
+        case TP_INT:
+            i64 += (int64_t) (bench_rand() % 21) - 10;
+            val.int64 = i64;
+            break;
+        case TP_DOUBLE:
+            d += (double) ((int64_t) (bench_rand() % 2001) - 1000) / 100.0;
+            val.real = d;
+            break;
+        case TP_STRING:
+            val.str = strdup(strs[bench_rand() % 4]);
+            break;
+        }
+        siridb_points_add_point(points, &ts, &val);
+    }
+    return points;
+}
+
+static void bench_zip(const char * name, points_tp tp)
+{
+    char buf[64];
+    uint16_t cinfo;
+    size_t size;
+    unsigned char * bits;
+    uint64_t start_ts, end_ts;
+    siridb_points_t * points = gen_points(NPOINTS, tp, 0);
+    siridb_points_t * dest = siridb_points_new(NPOINTS, tp);
+
+    snprintf(buf, sizeof(buf), "points_zip_%s", name);
+    BENCH_RUN(buf, NPOINTS, {
+        bits = siridb_points_zip(points, 0, NPOINTS, &cinfo, &size, NULL);
+        bench_sink += size;
+        free(bits);
+    });
+
+    bits = siridb_points_zip(points, 0, NPOINTS, &cinfo, &size, NULL);
+    start_ts = points->data[0].ts;
+    end_ts = points->data[NPOINTS - 1].ts + 1;
+
+    snprintf(buf, sizeof(buf), "points_unzip_%s", name);
+    BENCH_RUN(buf, NPOINTS, {
+        if (tp == TP_STRING)
+        {
+            (void) siridb_points_unzip_string(
+                    dest, bits, NPOINTS, &start_ts, &end_ts, 0, NULL);
+            while (dest->len)
+            {
+                free(dest->data[--dest->len].val.str);
+            }
+        }
+        else
+        {
+            if (tp == TP_INT)
+                siridb_points_unzip_int(
+                        dest, bits, NPOINTS, cinfo, &start_ts, &end_ts, 0);
+            else
+                siridb_points_unzip_double(
+                        dest, bits, NPOINTS, cinfo, &start_ts, &end_ts, 0);
+            bench_sink += dest->len;
+            dest->len = 0;
+        }
+    });
+
+    free(bits);
+    siridb_points_free(dest);
+    siridb_points_free(points);
+}
+
+static void bench_merge(void)
+{
+    char err_msg[1024];
+    siridb_points_t * series[NMERGE];
+    siridb_points_t * points;
+    vec_t * plist = vec_new(NMERGE);
+    size_t i;
+
+    for (i = 0; i < NMERGE; i++)
+    {
+        series[i] = gen_points(NPOINTS, TP_INT, i);
+    }
+
+    /* the merge consumes the points so the copies are included */
+    BENCH_RUN("points_merge", NPOINTS * NMERGE, {
+        plist->len = 0;
+        for (i = 0; i < NMERGE; i++)
+        {
+            vec_append(plist, siridb_points_copy(series[i]));
+        }
+        points = siridb_points_merge(plist, err_msg);
+        bench_sink += points->len;
+        siridb_points_free(points);
+    });
+
+    for (i = 0; i < NMERGE; i++)
+    {
+        siridb_points_free(series[i]);
+    }
+    vec_free(plist);
+}
+
+int main()
+{
+    bench_zip("int", TP_INT);
+    bench_zip("double", TP_DOUBLE);
+    bench_zip("string", TP_STRING);
+    bench_merge();
+    return 0;
+}
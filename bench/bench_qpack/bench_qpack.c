@@ -0,0 +1,45 @@
+#include "../bench.h"
+#include <qpack/qpack.h>
+
+#define NSERIES 100
+#define NPOINTS 100
+
+/*
+ * Walk an insert like document: {"series": [[ts, value], ...], ...}
+ */
+int main()
+{
+    qp_packer_t * packer = qp_packer_new(1 << 20);
+    qp_unpacker_t unpacker;
+    qp_obj_t obj;
+    char name[32];
+    size_t i, j;
+
+    qp_add_type(packer, QP_MAP_OPEN);
+    for (i = 0; i < NSERIES; i++)
+    {
+        snprintf(name, sizeof(name), "series-%zu", i);
+        qp_add_string(packer, name);
+        qp_add_type(packer, QP_ARRAY_OPEN);
+        for (j = 0; j < NPOINTS; j++)
+        {
+            qp_add_type(packer, QP_ARRAY2);
+            qp_add_int64(packer, 1500000000 + (int64_t) j * 10);
+            if (i % 2)
+                qp_add_double(packer, (double) (bench_rand() % 10000) / 7.0);
+            else
+                qp_add_int64(packer, (int64_t) (bench_rand() % 10000));
+        }
+        qp_add_type(packer, QP_ARRAY_CLOSE);
+    }
+    qp_add_type(packer, QP_MAP_CLOSE);
+
+    BENCH_RUN("qp_next", NSERIES * NPOINTS, {
+        qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+        while (qp_next(&unpacker, &obj) != QP_END);
+        bench_sink += (uintptr_t) unpacker.pt;
+    });
+
+    qp_packer_free(packer);
+    return 0;
+}
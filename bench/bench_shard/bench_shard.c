@@ -0,0 +1,121 @@
+#include "../bench.h"
+#include <siri/db/points.h>
+#include <siri/db/series.h>
+#include <siri/db/shard.h>
+#include <siri/db/time.h>
+#include <siri/file/handler.h>
+#include <siri/file/pointer.h>
+#include <siri/siri.h>
+#include <unistd.h>
+
+#define NPOINTS 800         /* about the size of a chunk in a shard */
+
+static siridb_points_t * gen_points(size_t n)
+{
+    siridb_points_t * points = siridb_points_new(n, TP_INT);
+    uint64_t ts = 1500000000000;
+    qp_via_t val = {.int64 = 0};
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        ts += 10000 + bench_rand() % 3;
+        val.int64 += (int64_t) (bench_rand() % 21) - 10;
+        siridb_points_add_point(points, &ts, &val);
+    }
+    return points;
+}
+
+/*
+ * Write and read a chunk of points using a shard file in /tmp. The shard
+ * length is reset after each write so the same part of the file is written
+ * and the file does not grow while benchmarking.
+ */
+static void bench_shard(const char * name, uint8_t flags)
+{
+    char buf[64];
+    char fn[] = "/tmp/siridb-bench-shard-XXXXXX";
+    int fd = mkstemp(fn);
+    siridb_t siridb;
+    siridb_series_t series;
+    siridb_shard_t shard;
+    siridb_shard_get_points_cb get_points_cb;
+    siridb_points_t * points = gen_points(NPOINTS);
+    siridb_points_t * dest = siridb_points_new(NPOINTS, TP_INT);
+    uint16_t cinfo = 0;
+    idx_t idx;
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "cannot create shard file: %s\n", fn);
+        exit(1);
+    }
+    close(fd);
+
+    memset(&siridb, 0, sizeof(siridb_t));
+    memset(&series, 0, sizeof(siridb_series_t));
+    memset(&shard, 0, sizeof(siridb_shard_t));
+
+    siridb.time = siridb_time_new(SIRIDB_TIME_MILLISECONDS);
+    series.id = 1;
+    series.tp = TP_INT;
+    shard.tp = SIRIDB_SHARD_TP_NUMBER;
+    shard.flags = flags;
+    shard.fp = siri_fp_new();
+    shard.fn = fn;
+
+    snprintf(buf, sizeof(buf), "shard_write_points_%s", name);
+    BENCH_RUN(buf, NPOINTS, {
+        shard.len = 0;
+        bench_sink += siridb_shard_write_points(
+                &siridb,
+                &series,
+                &shard,
+                points,
+                0,
+                NPOINTS,
+                NULL,
+                &cinfo);
+    });
+
+    idx.shard = &shard;
+    idx.pos = (uint32_t) siridb_shard_write_points(
+            &siridb,
+            &series,
+            &shard,
+            points,
+            0,
+            NPOINTS,
+            NULL,
+            &cinfo);
+    idx.len = NPOINTS;
+    idx.cinfo = cinfo;
+    idx.start_ts = points->data[0].ts;
+    idx.end_ts = points->data[NPOINTS - 1].ts;
+
+    get_points_cb = siridb_shard_get_points_callback(flags, &series);
+
+    snprintf(buf, sizeof(buf), "shard_get_points_%s", name);
+    BENCH_RUN(buf, NPOINTS, {
+        dest->len = 0;
+        (void) get_points_cb(dest, &idx, NULL, NULL, 0);
+        bench_sink += dest->len;
+    });
+
+    siri_fp_decref(shard.fp);
+    (void) unlink(fn);
+    free(siridb.time);
+    siridb_points_free(dest);
+    siridb_points_free(points);
+}
+
+int main()
+{
+    siri.fh = siri_fh_new(8);
+
+    bench_shard("num64", 0);
+    bench_shard("num_compressed", SIRIDB_SHARD_IS_COMPRESSED);
+
+    siri_fh_free(siri.fh);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "../bench.h"
+#include <siri/db/points.h>
+#include <siri/db/zdict.h>
+
+#define NPOINTS 128         /* default max chunk size for log shards */
+#define NSAMPLE 4096        /* points used to train the dictionary */
+
+static siridb_points_t * gen_logs(size_t n)
+{
+    siridb_points_t * points = siridb_points_new(n, TP_STRING);
+    const char * levels[] = {"INFO", "DEBUG", "WARNING", "ERROR"};
+    const char * paths[] = {"/query", "/insert", "/status", "/health"};
+    char buf[256];
+    uint64_t ts = 0;
+    qp_via_t val;
+    uint64_t r;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        r = bench_rand();
+        ts += 10 + r % 3;
+        snprintf(buf, sizeof(buf),
+                "[%s] request %s from 10.0.%u.%u took %u ms (user=u%u)",
+                levels[r % 4],
+                paths[(r >> 2) % 4],
+                (unsigned) ((r >> 4) % 4),
+                (unsigned) ((r >> 8) % 256),
+                (unsigned) ((r >> 16) % 1000),
+                (unsigned) ((r >> 26) % 50));
+        val.str = strdup(buf);
+        siridb_points_add_point(points, &ts, &val);
+    }
+    return points;
+}
+
+/*
+ * Besides the bench lines, a ratio line is printed for each scheme:
+ *
+ *      ratio   <name>  <raw bytes>  <zipped bytes>  <raw/zipped>
+ */
+static void bench_zdict(
+        const char * name,
+        siridb_points_t * points,
+        siridb_zdict_t * zdict)
+{
+    char buf[64];
+    uint16_t cinfo;
+    size_t i, size, raw = 0;
+    unsigned char * bits;
+    siridb_points_t * dest = siridb_points_new(NPOINTS, TP_STRING);
+
+    for (i = 0; i < NPOINTS; i++)
+    {
+        raw += strlen(points->data[i].val.str) + 1 + sizeof(uint64_t);
+    }
+
+    snprintf(buf, sizeof(buf), "zdict_zip_%s", name);
+    BENCH_RUN(buf, NPOINTS, {
+        bits = siridb_points_zip_string(
+                points, 0, NPOINTS, &cinfo, &size, zdict);
+        bench_sink += size;
+        free(bits);
+    });
+
+    bits = siridb_points_zip_string(points, 0, NPOINTS, &cinfo, &size, zdict);
+
+    snprintf(buf, sizeof(buf), "zdict_unzip_%s", name);
+    BENCH_RUN(buf, NPOINTS, {
+        (void) siridb_points_unzip_string(
+                dest, bits, NPOINTS, NULL, NULL, 0, zdict);
+        while (dest->len)
+        {
+            free(dest->data[--dest->len].val.str);
+        }
+    });
+
+    printf("ratio\t%s\t%zu\t%zu\t%.2f\n",
+            name, raw, size, (double) raw / (double) size);
+
+    free(bits);
+    siridb_points_free(dest);
+}
+
+int main()
+{
+    siridb_points_t * sample = gen_logs(NSAMPLE);
+    siridb_points_t * points = gen_logs(NPOINTS);
+    siridb_zdict_t * zdict;
+
+    BENCH_RUN("zdict_train", NSAMPLE, {
+        zdict = siridb_zdict_train(sample);
+        bench_sink += zdict->len;
+        siridb_zdict_free(zdict);
+    });
+
+    zdict = siridb_zdict_train(sample);
+
+    bench_zdict("none", points, NULL);
+    bench_zdict("trained", points, zdict);
+
+    siridb_zdict_free(zdict);
+    siridb_points_free(points);
+    siridb_points_free(sample);
+    return 0;
+}
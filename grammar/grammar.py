@@ -131,6 +131,7 @@ class SiriGrammar(Grammar):
     k_open_files = Keyword('open_files')
     k_or = Keyword('or')
     k_password = Keyword('password')
+    k_percentile = Keyword('percentile')
     k_points = Keyword('points')
     k_pool = Keyword('pool')
     k_pools = Keyword('pools')
@@ -522,6 +523,9 @@ class SiriGrammar(Grammar):
     f_stddev = Sequence(
         k_stddev,
         '(', Optional(time_expr), ')')
+    f_percentile = Sequence(
+        k_percentile,
+        '(', r_float, Optional(Sequence(',', time_expr)), ')')
     f_first = Sequence(
         k_first,
         '(', Optional(time_expr), ')')
@@ -583,6 +587,7 @@ class SiriGrammar(Grammar):
         f_median,
         f_median_low,
         f_median_high,
+        f_percentile,
         f_min,
         f_max,
         f_count,
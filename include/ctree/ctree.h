@@ -18,6 +18,7 @@ typedef struct ct_node_s * ct_nodes_t[32];
 #include <inttypes.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <slab/slab.h>
 
 typedef int (*ct_item_cb)(
         const char * key,
@@ -30,6 +31,7 @@ typedef void (*ct_free_cb)(void * data);
 ct_t * ct_new(void);
 void ct_free(ct_t * ct, ct_free_cb cb);
 int ct_add(ct_t * ct, const char * key, void * data);
+int ct_build(ct_t * ct, const char ** keys, void ** data, size_t n);
 void * ct_get(ct_t * node, const char * key);
 void ** ct_getaddr(ct_t * ct, const char * key);
 void * ct_getn(ct_t * ct, const char * key, size_t n);
@@ -57,6 +59,8 @@ struct ct_s
     uint16_t pad0;
     uint32_t len;
     ct_nodes_t * nodes;
+    slab_t * node_slab;     /* nodes */
+    slab_t * nodes_slab;    /* single blocks of BLOCKSZ nodes */
 };
 
 #endif  /* CTREE_H_ */
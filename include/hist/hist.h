@@ -0,0 +1,62 @@
+/*
+ * hist.h - Lock free latency histogram with exponential buckets.
+ *
+ * Bucket k counts durations up to HIST_BASE_NS * 4^k nano seconds, the last
+ * bucket counts everything else. Each thread writes to its own shard so
+ * observing a duration is only a few relaxed atomic increments on a cache
+ * line which is not shared with other writers. A snapshot sums all shards.
+ */
+#ifndef HIST_H_
+#define HIST_H_
+
+typedef struct hist_s hist_t;
+typedef struct hist_shard_s hist_shard_t;
+typedef struct hist_snapshot_s hist_snapshot_t;
+
+#include <inttypes.h>
+#include <time.h>
+
+#define HIST_BASE_NS 1000       /* first bucket, one micro second */
+#define HIST_BUCKETS 14         /* 1us .. ~16.8s plus +Inf */
+#define HIST_SHARDS 16          /* threads above this number share shards */
+
+void hist_init(hist_t * hist);
+void hist_observe(hist_t * hist, uint64_t ns);
+void hist_snapshot(hist_t * hist, hist_snapshot_t * snapshot);
+double hist_bound(int bucket);
+static inline uint64_t hist_now(void);
+
+struct hist_shard_s
+{
+    uint64_t buckets[HIST_BUCKETS];
+    uint64_t sum;               /* total nano seconds */
+} __attribute__((aligned(64)));
+
+struct hist_s
+{
+    hist_shard_t shards[HIST_SHARDS];
+};
+
+struct hist_snapshot_s
+{
+    uint64_t buckets[HIST_BUCKETS];     /* not cumulative */
+    uint64_t count;
+    uint64_t sum;
+};
+
+/*
+ * Returns a monotonic time stamp in nano seconds.
+ */
+static inline uint64_t hist_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * Observe the time past since a time stamp returned by hist_now().
+ */
+#define hist_since(hist__, start__) hist_observe(hist__, hist_now() - (start__))
+
+#endif  /* HIST_H_ */
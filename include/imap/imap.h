@@ -10,6 +10,7 @@ typedef struct imap_s imap_t;
 #include <inttypes.h>
 #include <stddef.h>
 #include <vec/vec.h>
+#include <slab/slab.h>
 
 typedef int (*imap_cb)(void * data, void * args);
 typedef void (*imap_free_cb)(void * data);
@@ -63,6 +64,8 @@ struct imap_s
 {
     size_t len;
     vec_t * vec;
+    slab_t * node_slab;     /* single nodes */
+    slab_t * nodes_slab;    /* arrays of IMAP_NODE_SZ nodes */
     imap_node_t nodes[];
 };
 
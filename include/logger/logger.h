@@ -1,5 +1,12 @@
 /*
  * logger.h - Logging module.
+ *
+ * Lines are written synchronously until logger_start() is called. After that
+ * the calling thread only formats the message into a lock-free ring buffer
+ * and a writer thread adds the time-stamp and writes the lines. A message
+ * which is repeated is written once per LOGGER_REPEAT_INTERVAL seconds with
+ * the number of times it was repeated. Lines are dropped (and counted) when
+ * the ring buffer is full.
  */
 #ifndef LOGGER_H_
 #define LOGGER_H_
@@ -21,11 +28,17 @@ typedef struct _IO_FILE LOGGER_IO_FILE;
 
 #define LOGGER_FLAG_COLORED 1
 
+#define LOGGER_RING_SZ 512          /* must be a power of 2 */
+#define LOGGER_LINE_SZ 1024         /* longer messages are truncated */
+#define LOGGER_REPEAT_INTERVAL 10   /* seconds */
+
 typedef struct logger_s logger_t;
 
 void logger_init(LOGGER_IO_FILE * ostream, int log_level);
 void logger_set_level(int log_level);
 const char * logger_level_name(int log_level);
+int logger_start(void);
+void logger_stop(void);
 
 void log__debug(const char * fmt, ...);
 void log__info(const char * fmt, ...);
@@ -56,8 +69,7 @@ extern logger_t Logger;
         log__critical(fmt, ##__VA_ARGS__)   \
 
 #define LOGC(fmt, ...) \
-    fprintf(Logger.ostream, "%s:%d ", __FILE__, __LINE__); \
-    log_critical(fmt, ##__VA_ARGS__)
+    log_critical("%s:%d " fmt, __FILE__, __LINE__, ##__VA_ARGS__)
 
 struct logger_s
 {
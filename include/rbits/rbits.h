@@ -0,0 +1,65 @@
+/*
+ * rbits.h - Compressed (roaring-style) bitmap for uint32_t integer ids with
+ *           set operation support.
+ *
+ * Ids are split in a 16 bit container key and a 16 bit value. Containers
+ * with at most RBITS_ARRAY_MAX values are stored as a sorted array, larger
+ * containers are stored as a plain bitset. Set operations are performed on
+ * the containers directly.
+ */
+#ifndef RBITS_H_
+#define RBITS_H_
+
+typedef struct rbits_s rbits_t;
+typedef struct rbits_container_s rbits_container_t;
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define RBITS_ARRAY_MAX 4096
+#define RBITS_WORDS 1024  /* 65536 bits */
+
+enum
+{
+    RBITS_TP_ARRAY,
+    RBITS_TP_BITSET,
+};
+
+typedef int (*rbits_cb)(uint32_t id, void * args);
+
+rbits_t * rbits_new(void);
+void rbits_free(rbits_t * rbits);
+int rbits_add(rbits_t * rbits, uint32_t id);
+int rbits_remove(rbits_t * rbits, uint32_t id);
+int rbits_has(rbits_t * rbits, uint32_t id);
+void rbits_clear(rbits_t * rbits);
+int rbits_walk(rbits_t * rbits, rbits_cb cb, void * args);
+size_t rbits_size(rbits_t * rbits);
+int rbits_union(rbits_t * dest, rbits_t * rbits);
+int rbits_intersection(rbits_t * dest, rbits_t * rbits);
+int rbits_difference(rbits_t * dest, rbits_t * rbits);
+int rbits_symmetric_difference(rbits_t * dest, rbits_t * rbits);
+
+struct rbits_container_s
+{
+    uint16_t key;
+    uint16_t tp;
+    uint32_t card;      /* number of values in the container */
+    uint32_t sz;        /* allocated values, only used by array containers */
+    uint32_t pad0;
+    union
+    {
+        uint16_t * array;
+        uint64_t * words;
+    } via;
+};
+
+struct rbits_s
+{
+    size_t len;         /* total number of ids */
+    uint32_t n;         /* number of containers in use */
+    uint32_t sz;        /* allocated containers */
+    rbits_container_t * containers;
+};
+
+#endif  /* RBITS_H_ */
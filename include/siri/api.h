@@ -6,6 +6,7 @@
 
 #include <lib/http_parser.h>
 #include <siri/db/db.h>
+#include <siri/db/ijson.h>
 #include <siri/service/request.h>
 #include <stdbool.h>
 #include <uv.h>
@@ -15,6 +16,8 @@ typedef enum
     SIRI_API_CT_TEXT,
     SIRI_API_CT_JSON,
     SIRI_API_CT_QPACK,
+    SIRI_API_CT_CSV,
+    SIRI_API_CT_LINE,       /* text/plain, line protocol */
 } siri_api_content_t;
 
 typedef enum
@@ -40,6 +43,7 @@ typedef enum
 } siri_api_header_t;
 
 typedef struct siri_api_request_s siri_api_request_t;
+typedef struct siri_api_write_s siri_api_write_t;
 
 typedef int (*on_state_cb_t)(siri_api_request_t * ar, const char * at, size_t n);
 
@@ -49,6 +53,7 @@ int siri_api_send(
         siri_api_header_t ht,
         unsigned char * src,
         size_t n);
+void siri_api_free(siri_api_request_t * ar);
 
 struct siri_api_request_s
 {
@@ -61,12 +66,20 @@ struct siri_api_request_s
     size_t len;
     size_t size;
     uv_stream_t * stream;
+    siridb_ijson_t * ijson;     /* streaming JSON insert, may be NULL */
+    char * rbuf;                /* read buffer, re-used for each read */
+    size_t rpos;                /* start of the unparsed data in rbuf */
+    size_t rlen;                /* length of the unparsed data in rbuf */
+    siri_api_write_t * wfree;   /* written responses, re-used for writing */
     siri_api_content_t content_type;
     siri_api_req_t request_type;
     service_request_t service_type;
     bool service_authenticated;
+    bool busy;                  /* a request is handled, parser is paused */
+    bool in_parser;             /* the parser is running */
+    bool keep_alive;            /* keep the connection after the response */
+    bool closed;                /* the connection will be closed */
     http_parser parser;
-    uv_write_t req;
 };
 
 #endif /* SIRI_API_H_ */
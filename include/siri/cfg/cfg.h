@@ -27,6 +27,8 @@ struct siri_cfg_s
 {
     uint32_t optimize_interval;
     uint32_t buffer_sync_interval;
+    uint32_t aggregate_cache_size;  /* in MB, 0 is disabled */
+    uint32_t slow_query_threshold;  /* in milliseconds, 0 is disabled */
 
     uint16_t listen_client_port;
     uint16_t listen_backend_port;
@@ -0,0 +1,111 @@
+/*
+ * acache.h - Cache for aggregated points in closed time windows.
+ *
+ * Group-by aggregations put a point with timestamp `ts` in the group
+ * `ceil(ts / group_by)`, so a select window can be split at multiples of
+ * group_by without changing the result. The cache stores the output of the
+ * first aggregate for the aligned part of a window, the head and tail of the
+ * window are still read and aggregated for each select.
+ *
+ * Entries are dropped when points are added to a series inside a cached
+ * window, or when a shard is dropped. The cache is bounded by a memory budget
+ * and the least recently used entries are removed first.
+ *
+ * The cache may only be used from the main thread, with the exception of
+ * siridb_acache_expire() which is thread safe.
+ */
+#ifndef SIRIDB_ACACHE_H_
+#define SIRIDB_ACACHE_H_
+
+typedef struct siridb_acache_s siridb_acache_t;
+typedef struct siridb_acache_entry_s siridb_acache_entry_t;
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <siri/db/aggregate.h>
+#include <siri/db/points.h>
+#include <stddef.h>
+
+siridb_acache_t * siridb_acache_new(size_t max_size);
+void siridb_acache_free(siridb_acache_t * acache);
+int siridb_acache_window(
+        siridb_aggr_t * aggr,
+        uint64_t start_ts,
+        uint64_t end_ts,
+        uint64_t * a,
+        uint64_t * b);
+siridb_points_t * siridb_acache_get(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t a,
+        uint64_t b);
+int siridb_acache_put(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t a,
+        uint64_t b,
+        siridb_points_t * points,
+        uint32_t generation);
+void siridb_acache_invalidate(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        uint64_t first_ts,
+        uint64_t last_ts);
+
+/*
+ * Mark all entries as expired. (thread safe, used when shards are dropped)
+ */
+#define siridb_acache_expire(acache__) \
+    __atomic_add_fetch(&(acache__)->generation, 1, __ATOMIC_SEQ_CST)
+
+/*
+ * Returns the current generation, this must be read before reading the
+ * points which are added to the cache.
+ */
+#define siridb_acache_generation(acache__) \
+    __atomic_load_n(&(acache__)->generation, __ATOMIC_SEQ_CST)
+
+/*
+ * Drop cached windows of a series which contain the time range.
+ */
+#define siridb_acache_touch(acache__, series_id__, first__, last__)     \
+do{                                                                     \
+    if ((acache__) != NULL && (acache__)->series->len)                  \
+        siridb_acache_invalidate(acache__, series_id__, first__, last__);\
+}while(0)
+
+struct siridb_acache_entry_s
+{
+    uint32_t series_id;
+    uint32_t gid;
+    uint32_t generation;
+    uint32_t pad0;
+    uint64_t group_by;
+    double timespan;
+    double percentile;
+    uint64_t a;                     /* window start (exclusive) */
+    uint64_t b;                     /* window end (inclusive) */
+    size_t size;                    /* memory used by this entry */
+    siridb_points_t * points;
+    siridb_acache_entry_t * sprev;  /* entries for the same series */
+    siridb_acache_entry_t * snext;
+    siridb_acache_entry_t * prev;   /* towards most recently used */
+    siridb_acache_entry_t * next;   /* towards least recently used */
+};
+
+struct siridb_acache_s
+{
+    uint32_t generation;
+    uint32_t pad0;
+    size_t size;
+    size_t max_size;
+    uint64_t hits;
+    uint64_t misses;
+    imap_t * series;                /* series id -> first entry */
+    siridb_acache_entry_t * head;
+    siridb_acache_entry_t * tail;
+};
+
+#endif  /* SIRIDB_ACACHE_H_ */
@@ -4,8 +4,12 @@
 #ifndef SIRIDB_AGGREGATE_H_
 #define SIRIDB_AGGREGATE_H_
 
+#define AGGREGATE_STREAM_SZ 1024    /* initial size for stream points */
+
 typedef struct siridb_aggr_s siridb_aggr_t;
+typedef struct siridb_aggr_stream_s siridb_aggr_stream_t;
 
+#include <siri/db/ngram.h>
 #include <siri/db/points.h>
 #include <siri/grammar/gramp.h>
 #include <vec/vec.h>
@@ -21,6 +25,31 @@ void siridb_init_aggregates(void);
 vec_t * siridb_aggregate_list(cleri_children_t * children, char * err_msg);
 void siridb_aggregate_list_free(vec_t * alist);
 int siridb_aggregate_can_skip(cleri_children_t * children);
+int siridb_aggregate_can_stream(siridb_aggr_t * aggr);
+int siridb_aggregate_stream_init(
+        siridb_aggr_stream_t * stream,
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        char * err_msg);
+int siridb_aggregate_stream_feed(
+        siridb_aggr_stream_t * stream,
+        siridb_points_t * points);
+siridb_points_t * siridb_aggregate_stream_finish(siridb_aggr_stream_t * stream);
+void siridb_aggregate_stream_destroy(siridb_aggr_stream_t * stream);
+int siridb_aggregate_use_tdigest(vec_t * alist);
+int siridb_aggregate_tdigests(
+        vec_t ** tdigests,
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+int siridb_aggregate_tdigests_reduce(
+        vec_t * tdigests,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+siridb_points_t * siridb_aggregate_tdigests_points(
+        vec_t * tdigests,
+        siridb_aggr_t * aggr,
+        char * err_msg);
 
 struct siridb_aggr_s
 {
@@ -31,9 +60,27 @@ struct siridb_aggr_s
     uint64_t limit;
     uint64_t offset;
     double timespan;  /* used for derivative        */
+    double percentile;  /* used for percentile      */
     pcre2_code * regex;             \
     pcre2_match_data * match_data;
+    siridb_ngram_query_t * ngram;   /* used to skip chunks in log shards */
     qp_via_t filter_via;
 };
 
+/*
+ * Aggregate points with a group by while the points are read. Only the points
+ * of the group which is not complete are kept.
+ */
+struct siridb_aggr_stream_s
+{
+    siridb_aggr_t * aggr;
+    siridb_points_t * points;   /* aggregated points */
+    siridb_points_t * group;    /* points of the last group */
+    uint64_t group_ts;
+    size_t size;                /* allocated size for points */
+    size_t group_size;          /* allocated size for group */
+    size_t n;                   /* number of points which are fed */
+    char * err_msg;
+};
+
 #endif  /* SIRIDB_AGGREGATE_H_ */
@@ -9,8 +9,11 @@ typedef struct siridb_buffer_s siridb_buffer_t;
 #include <siri/db/db.h>
 #include <siri/db/series.h>
 #include <siri/db/points.h>
+#include <siri/metrics.h>
+#include <slab/slab.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <uv.h>
 
 #define MAX_BUFFER_SZ 1048576
 
@@ -33,6 +36,12 @@ int siridb_buffer_write_point(
         siridb_series_t * series,
         uint64_t * ts,
         qp_via_t * val);
+siridb_points_t * siridb_buffer_points_new(
+        siridb_buffer_t * buffer,
+        points_tp tp);
+void siridb_buffer_points_free(
+        siridb_buffer_t * buffer,
+        siridb_points_t * points);
 
 struct siridb_buffer_s
 {
@@ -44,11 +53,24 @@ struct siridb_buffer_s
     vec_t * empty;        /* list with empty buffer spaces */
     FILE * fp;              /* buffer file pointer */
     int fd;                 /* buffer file descriptor */
+    slab_t * slab;          /* points for all series, 'len' points each */
+    uv_mutex_t slab_mutex;  /* series might be destroyed by other threads */
 };
 
 static inline int siridb_buffer_fsync(siridb_buffer_t * buffer)
 {
-    return (buffer->fp == NULL) ? 0 : fsync(buffer->fd);
+    uint64_t start;
+    int rc;
+
+    if (buffer->fp == NULL)
+    {
+        return 0;
+    }
+
+    start = hist_now();
+    rc = fsync(buffer->fd);
+    siri_metrics_since(SIRI_METRICS_BUFFER_FLUSH, start);
+    return rc;
 }
 
 #endif  /* SIRIDB_BUFFER_H_ */
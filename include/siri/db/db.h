@@ -8,7 +8,7 @@ typedef struct siridb_s siridb_t;
 
 #define SIRIDB_MAX_SIZE_ERR_MSG 1024
 #define SIRIDB_MAX_DBNAME_LEN 256  /*    255 + NULL     */
-#define SIRIDB_SCHEMA 7
+#define SIRIDB_SCHEMA 8
 #define SIRIDB_FLAG_REINDEXING 1
 #define SIRIDB_FLAG_DROPPED 2
 
@@ -28,11 +28,15 @@ typedef struct siridb_s siridb_t;
 #include <siri/db/time.h>
 #include <siri/db/user.h>
 #include <siri/db/server.h>
+#include <siri/db/acache.h>
 #include <siri/db/pools.h>
+#include <siri/db/qcache.h>
 #include <siri/db/fifo.h>
 #include <siri/db/replicate.h>
 #include <siri/db/reindex.h>
+#include <siri/db/rollup.h>
 #include <siri/db/groups.h>
+#include <siri/db/ngram.h>
 #include <siri/db/tasks.h>
 #include <siri/db/time.h>
 #include <siri/db/buffer.h>
@@ -64,11 +68,13 @@ struct siridb_s
 {
     uint16_t ref;
     uint8_t flags;
-    uint8_t pad0;
+    uint8_t lookup_mode;            /* lookup mode for series to pools      */
     uint32_t max_series_id;
     uint16_t insert_tasks;
     uint16_t shard_mask_num;
     uint16_t shard_mask_log;
+    uint8_t prev_lookup_mode;       /* lookup mode before re-indexing       */
+    uint8_t pad0;
     uint32_t select_points_limit;
     uint32_t list_limit;
     uuid_t uuid;
@@ -107,6 +113,10 @@ struct siridb_s
     siridb_tags_t * tags;
     siridb_buffer_t * buffer;
     siridb_tee_t * tee;
+    siridb_qcache_t * qcache;
+    siridb_acache_t * acache;       /* NULL when disabled */
+    siridb_rollup_t * rollup;       /* NULL when disabled */
+    siridb_ngram_index_t * ngram_index;  /* NULL when disabled */
     siridb_tasks_t tasks;
 };
 
@@ -0,0 +1,67 @@
+/*
+ * ibatch.h - Pre-validated batch with points for a local insert.
+ *
+ * While assigning points to pools, the points for 'this' pool are collected
+ * per series in a batch so the local insert does not have to walk the qpack
+ * data again. Each series keeps the position of the series in the qpack data
+ * so the insert can always fall back to the qpack data.
+ */
+#ifndef SIRIDB_IBATCH_H_
+#define SIRIDB_IBATCH_H_
+
+#define IBATCH_FLAG_INVALID 1   /* the batch cannot be used */
+
+typedef struct siridb_ibatch_s siridb_ibatch_t;
+typedef struct siridb_ibatch_series_s siridb_ibatch_series_t;
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <qpack/qpack.h>
+#include <siri/db/pcache.h>
+
+siridb_ibatch_t * siridb_ibatch_new(void);
+void siridb_ibatch_free(siridb_ibatch_t * ibatch);
+siridb_ibatch_series_t * siridb_ibatch_add_series(
+        siridb_ibatch_t * ibatch,
+        const char * name,
+        size_t len,
+        size_t pos);
+int siridb_ibatch_add_point(
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries,
+        int64_t ts,
+        qp_obj_t * qp_val);
+void siridb_ibatch_skip(siridb_ibatch_t * ibatch);
+int siridb_ibatch_pcache(
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries,
+        siridb_pcache_t ** pcache);
+
+#define siridb_ibatch_name(ibatch__, bseries__) \
+    ((ibatch__)->names + (bseries__)->name_offset)
+
+struct siridb_ibatch_series_s
+{
+    size_t name_offset;         /* offset in ibatch->names */
+    size_t pos;                 /* position of the series in the qpack data */
+    size_t offset;              /* offset of the first point */
+    size_t len;                 /* number of points */
+    points_tp tp;               /* set by the first point */
+};
+
+struct siridb_ibatch_s
+{
+    uint8_t flags;
+    size_t pos;                 /* next series to process */
+    size_t len;                 /* number of series */
+    size_t size;                /* allocated series */
+    size_t names_len;
+    size_t names_size;
+    size_t points_len;
+    size_t points_size;
+    char * names;               /* null terminated series names */
+    siridb_point_t * points;    /* sorted points, contiguous per series */
+    siridb_ibatch_series_t * series;
+};
+
+#endif  /* SIRIDB_IBATCH_H_ */
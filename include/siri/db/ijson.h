@@ -0,0 +1,58 @@
+/*
+ * ijson.h - Streaming JSON parser for inserts.
+ *
+ * The parser is fed with chunks of JSON data as they arrive and writes the
+ * points directly to the pool packers of an insert, so no intermediate JSON
+ * or qpack document is created. Both the map format:
+ *
+ *      {"series": [[ts, value], ...], ...}
+ *
+ * and the array format are supported:
+ *
+ *      [{"name": "series", "points": [[ts, value], ...]}, ...]
+ *
+ * Since the data is received in multiple loop iterations, the parser stops
+ * with IJSON_FLAG_CHANGED when the pools or re-index state change while
+ * parsing.
+ */
+#ifndef SIRIDB_IJSON_H_
+#define SIRIDB_IJSON_H_
+
+#define IJSON_FLAG_ARRAY 1      /* data is in the array format */
+#define IJSON_FLAG_NAME 2       /* current object has a name */
+#define IJSON_FLAG_POINTS 4     /* current object has points */
+#define IJSON_FLAG_INVALID 8    /* invalid JSON data */
+#define IJSON_FLAG_CHANGED 16   /* pools have changed while parsing */
+
+typedef struct siridb_ijson_s siridb_ijson_t;
+
+#include <qpack/qpack.h>
+#include <siri/db/db.h>
+#include <siri/db/ibatch.h>
+#include <siri/db/insert.h>
+#include <siri/net/stream.h>
+#include <yajl/yajl_parse.h>
+
+siridb_ijson_t * siridb_ijson_new(siridb_t * siridb, sirinet_stream_t * client);
+void siridb_ijson_free(siridb_ijson_t * ijson);
+int siridb_ijson_parse(siridb_ijson_t * ijson, const char * data, size_t n);
+ssize_t siridb_ijson_complete(siridb_ijson_t * ijson);
+
+struct siridb_ijson_s
+{
+    uint8_t state;
+    uint8_t flags;
+    uint16_t pool;              /* pool for the current series */
+    int err;                    /* siridb_insert_err_t or 0 */
+    int64_t ts;                 /* time-stamp of the current point */
+    size_t n;                   /* number of points for the current series */
+    ssize_t npoints;            /* total number of points */
+    yajl_handle hand;
+    siridb_t * siridb;
+    siridb_insert_t * insert;   /* owned by the parser until taken */
+    qp_packer_t * packer;       /* packer for the current points */
+    qp_packer_t * tmp_packer;   /* for points which are read before a name */
+    siridb_ibatch_series_t * bseries;
+};
+
+#endif  /* SIRIDB_IJSON_H_ */
@@ -10,8 +10,10 @@ typedef struct siridb_initsync_s siridb_initsync_t;
 #include <uv.h>
 #include <inttypes.h>
 #include <siri/db/db.h>
+#include <siri/db/sbatch.h>
 #include <siri/db/series.h>
 #include <siri/net/pkg.h>
+#include <timeit/timeit.h>
 
 siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new);
 void siridb_initsync_free(siridb_initsync_t ** initsync);
@@ -24,10 +26,13 @@ struct siridb_initsync_s
     FILE * fp;
     char * fn;
     int fd;
-    long int size;
-    uint32_t * next_series_id;
-    sirinet_pkg_t * pkg_points;
-    sirinet_pkg_t * pkg_tags;
+    long int size;                  /* committed size of the sync file */
+    long int pos;                   /* series before pos are not yet sent */
+    size_t window;                  /* allowed number of batches in flight */
+    size_t nbatches;                /* number of batches in flight */
+    siridb_sbatch_t * batches[SIRIDB_SBATCH_MAX_WINDOW];  /* oldest first */
+    uint64_t npoints;               /* points synchronized since open */
+    struct timespec start;          /* used for the throughput */
 };
 
 #endif  /* SIRIDB_INITSYNC_H_ */
@@ -11,7 +11,8 @@
 
 typedef enum
 {
-    ERR_EXPECTING_ARRAY=-10,
+    ERR_INVALID_TEXT_LINE=-11,
+    ERR_EXPECTING_ARRAY,
     ERR_EXPECTING_SERIES_NAME,
     ERR_EXPECTING_MAP_OR_ARRAY,
     ERR_EXPECTING_INTEGER_TS,
@@ -38,11 +39,21 @@ typedef struct siridb_insert_local_s siridb_insert_local_t;
 #include <siri/db/forward.h>
 #include <uv.h>
 #include <siri/db/pcache.h>
+#include <siri/db/ibatch.h>
 
 ssize_t siridb_insert_assign_pools(
         siridb_t * siridb,
         qp_unpacker_t * unpacker,
-        qp_packer_t * packer[]);
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch);
+ssize_t siridb_insert_assign_text(
+        siridb_t * siridb,
+        int fmt,
+        char * data,
+        size_t n,
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch,
+        size_t * line);
 const char * siridb_insert_err_msg(siridb_insert_err_t err);
 siridb_insert_t * siridb_insert_new(
         siridb_t * siridb,
@@ -50,6 +61,7 @@ siridb_insert_t * siridb_insert_new(
         sirinet_stream_t * client);
 void siridb_insert_free(siridb_insert_t * insert);
 int siridb_insert_points_to_pools(siridb_insert_t * insert, size_t npoints);
+uint16_t siridb_insert_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name);
 int insert_init_backend_local(
         siridb_t * siridb,
         sirinet_stream_t * client,
@@ -65,6 +77,7 @@ struct siridb_insert_s
     uint16_t packer_size; /* number of packers (one for each pool) */
     sirinet_stream_t * client;
     size_t npoints;        /* number of points */
+    siridb_ibatch_t * ibatch;  /* points for 'this' pool, may be NULL */
     qp_packer_t * packer[];
 };
 
@@ -80,6 +93,8 @@ struct siridb_insert_local_s
     sirinet_promise_t * promise;
     siridb_forward_t * forward;
     siridb_pcache_t * pcache;
+    siridb_ibatch_t * ibatch;
+    sirinet_spkg_t * spkg;  /* shared with the tee, NULL if not shared */
 };
 
 #endif  /* SIRIDB_INSERT_H_ */
@@ -0,0 +1,75 @@
+/*
+ * itext.h - Tokenizer for text inserts. (line protocol and CSV)
+ *
+ * The tokenizer reads the data in place and does not allocate memory. Quoted
+ * strings are unescaped in the data itself so the data must be writable.
+ * Each point is passed to a call-back function while the series name is
+ * available in the tokenizer.
+ *
+ * Line protocol:
+ *
+ *      measurement[,tag=value...] field=value[,field=value...] [timestamp]
+ *
+ *   Each field is a series with name `measurement[,tag=value...] field`.
+ *   Values with an `i` or `u` suffix are integers, quoted values are strings,
+ *   `t`, `true`, `f` and `false` are converted to 1 and 0 and other values
+ *   are floats. The current time is used when the timestamp is omitted.
+ *   A comma, equal sign, space or backslash in the measurement, tags or
+ *   field keys is escaped with a backslash, which is not part of the name.
+ *
+ * CSV, with one point on each row:
+ *
+ *      series,timestamp,value
+ *
+ *   or a table with the series names in the header, which starts with an
+ *   empty cell. Empty cells in the table are skipped:
+ *
+ *      ,series1,series2
+ *      timestamp,value1,value2
+ *
+ *   Quoted values are strings, unquoted values are integers or floats when
+ *   possible and strings otherwise. A quoted value cannot span multiple lines.
+ *
+ * Time-stamps are expected in the precision of the database.
+ */
+#ifndef SIRIDB_ITEXT_H_
+#define SIRIDB_ITEXT_H_
+
+#define ITEXT_FMT_LINE 0
+#define ITEXT_FMT_CSV 1
+
+typedef struct siridb_itext_s siridb_itext_t;
+
+#include <inttypes.h>
+#include <qpack/qpack.h>
+#include <siri/db/insert.h>
+#include <siri/db/series.h>
+#include <stddef.h>
+
+/*
+ * Call-back for each point, the series name is in itext->name. Should return
+ * 0 to continue or a negative siridb_insert_err_t to stop.
+ */
+typedef int (*siridb_itext_cb)(
+        siridb_itext_t * itext,
+        int64_t ts,
+        qp_obj_t * qp_val,
+        void * arg);
+
+int siridb_itext_parse(
+        siridb_itext_t * itext,
+        int fmt,
+        char * data,
+        size_t n,
+        siridb_itext_cb cb,
+        void * arg);
+
+struct siridb_itext_s
+{
+    int64_t now;                /* used when a time-stamp is omitted */
+    size_t line;                /* current line, starting at 1 */
+    size_t len;                 /* length of the name */
+    char name[SIRIDB_SERIES_NAME_LEN_MAX];  /* null terminated series name */
+};
+
+#endif  /* SIRIDB_ITEXT_H_ */
@@ -11,5 +11,6 @@ void siridb_init_listener(void);
 
 uv_async_cb siridb_node_get_enter(enum cleri_grammar_ids gid);
 uv_async_cb siridb_node_get_exit(enum cleri_grammar_ids gid);
+void siridb_node_run(uv_async_t * handle);
 
 #endif  /* SIRIDB_LISTENER_H_ */
@@ -1,22 +1,68 @@
 /*
  * lookup.h - Find and assign to which pool series belong.
+ *
+ * A series name is mapped to one of SIRIDB_LOOKUP_SZ slots and each slot is
+ * assigned to a pool. The way a name is mapped to a slot is selected by the
+ * lookup mode which is stored with the database so existing databases keep
+ * using the legacy mode until they are migrated by a re-index.
  */
 #ifndef SIRIDB_LOOKUP_H_
 #define SIRIDB_LOOKUP_H_
 
+typedef struct siridb_lookup_s siridb_lookup_t;
+typedef struct siridb_lookup_stats_s siridb_lookup_stats_t;
+
 #include <inttypes.h>
 #include <stddef.h>
 
 #define SIRIDB_LOOKUP_SZ 8192
 
-typedef uint_fast16_t siridb_lookup_t[SIRIDB_LOOKUP_SZ];
+enum
+{
+    SIRIDB_LOOKUP_MODE_SUM,     /* legacy, sum of the name bytes            */
+    SIRIDB_LOOKUP_MODE_XXH64,   /* 64 bit xxHash of the name (seed 0)       */
+    SIRIDB_LOOKUP_MODE_END
+};
+
+/* mode for new databases */
+#define SIRIDB_LOOKUP_MODE_DEFAULT SIRIDB_LOOKUP_MODE_XXH64
 
 uint16_t siridb_lookup_sn(siridb_lookup_t * lookup, const char * sn);
 uint16_t siridb_lookup_sn_raw(
         siridb_lookup_t * lookup,
         const char * sn,
         size_t len);
-siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools);
+uint16_t siridb_lookup_slot(uint8_t mode, const char * sn, size_t len);
+uint64_t siridb_lookup_xxh64(const char * sn, size_t len);
+siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools, uint8_t mode);
 void siridb_lookup_free(siridb_lookup_t * lookup);
+const char * siridb_lookup_mode_str(uint8_t mode);
+int siridb_lookup_mode_by_name(const char * name, size_t len);
+siridb_lookup_stats_t * siridb_lookup_stats_new(
+        siridb_lookup_t * lookup,
+        uint_fast16_t num_pools);
+void siridb_lookup_stats_add(
+        siridb_lookup_stats_t * stats,
+        const char * sn,
+        size_t len);
+double siridb_lookup_stats_imbalance(siridb_lookup_stats_t * stats);
+void siridb_lookup_stats_free(siridb_lookup_stats_t * stats);
+
+struct siridb_lookup_s
+{
+    uint8_t mode;
+    uint_fast16_t pool[SIRIDB_LOOKUP_SZ];
+};
+
+struct siridb_lookup_stats_s
+{
+    siridb_lookup_t * lookup;
+    uint_fast16_t num_pools;
+    size_t n;                       /* number of series added               */
+    size_t slots_used;              /* slots with at least one series       */
+    size_t slot_max;                /* most series in a single slot         */
+    uint32_t slots[SIRIDB_LOOKUP_SZ];
+    size_t pools[];                 /* series per pool                      */
+};
 
 #endif  /* SIRIDB_LOOKUP_H_ */
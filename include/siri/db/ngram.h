@@ -0,0 +1,82 @@
+/*
+ * ngram.h - Trigram bloom filters for chunks in log shards.
+ *
+ * A filter is created for each chunk of string points which is written to a
+ * log shard. A string filter with 'equal' or 'contains' and a regular
+ * expression with 'equal' are converted to a query with the trigrams which
+ * every matching value must have, so chunks without one of these trigrams
+ * are skipped instead of read. Trigrams are case insensitive (ASCII only)
+ * so a query with the 'i' flag can use the same filters.
+ *
+ * Filters are only created when the database has an index, which is
+ * enabled in database.conf. The index keeps track of the memory used by all
+ * filters of the database and no new filters are created above its limit.
+ */
+#ifndef SIRIDB_NGRAM_H_
+#define SIRIDB_NGRAM_H_
+
+#define SIRIDB_NGRAM_MIN_BITS 512
+#define SIRIDB_NGRAM_MAX_BITS 32768
+#define SIRIDB_NGRAM_DEFAULT_MAX_MEMORY 67108864
+
+typedef struct siridb_ngram_s siridb_ngram_t;
+typedef struct siridb_ngram_query_s siridb_ngram_query_t;
+typedef struct siridb_ngram_index_s siridb_ngram_index_t;
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <siri/db/points.h>
+#include <stddef.h>
+
+siridb_ngram_t * siridb_ngram_new(
+        siridb_points_t * points,
+        size_t start,
+        size_t end);
+siridb_ngram_query_t * siridb_ngram_query_str(const char * str);
+siridb_ngram_query_t * siridb_ngram_query_regex(
+        const char * source,
+        size_t len);
+int siridb_ngram_match(
+        siridb_ngram_t * ngram,
+        siridb_ngram_query_t * query);
+siridb_ngram_index_t * siridb_ngram_index_new(size_t max_memory);
+void siridb_ngram_set(
+        siridb_ngram_index_t * index,
+        imap_t ** ngrams,
+        uint64_t pos,
+        siridb_ngram_t * ngram);
+void siridb_ngram_free_map(siridb_ngram_index_t * index, imap_t * ngrams);
+
+#define siridb_ngram_free free
+#define siridb_ngram_query_free free
+#define siridb_ngram_index_free free
+
+/* size in bytes of a filter */
+#define siridb_ngram_size(ngram__) \
+    (sizeof(siridb_ngram_t) + ((size_t) (ngram__)->mask + 1) / 8)
+
+/* no new filters can be added when the index is full */
+#define siridb_ngram_index_full(index__) \
+    (__atomic_load_n(&(index__)->memory, __ATOMIC_RELAXED) >= \
+            (index__)->max_memory)
+
+struct siridb_ngram_s
+{
+    uint32_t len;           /* number of points in the chunk */
+    uint32_t mask;          /* number of bits - 1 */
+    uint64_t bits[];
+};
+
+struct siridb_ngram_index_s
+{
+    size_t memory;          /* bytes used by all filters */
+    size_t max_memory;      /* limit for the memory used by filters */
+};
+
+struct siridb_ngram_query_s
+{
+    size_t n;               /* number of required trigrams */
+    uint32_t hashes[];
+};
+
+#endif  /* SIRIDB_NGRAM_H_ */
@@ -20,8 +20,8 @@ typedef struct siridb_points_s siridb_points_t;
 #include <inttypes.h>
 #include <qpack/qpack.h>
 #include <vec/vec.h>
+#include <siri/db/zdict.h>
 
-void siridb_points_init(void);
 siridb_points_t * siridb_points_new(size_t size, points_tp tp);
 void siridb_points_free(siridb_points_t * points);
 int siridb_points_resize(siridb_points_t * points, size_t n);
@@ -53,7 +53,8 @@ unsigned char * siridb_points_zip_string(
         uint_fast32_t start,
         uint_fast32_t end,
         uint16_t * cinfo,
-        size_t * size);
+        size_t * size,
+        siridb_zdict_t * zdict);
 unsigned char * siridb_points_raw_string(
         siridb_points_t * points,
         uint_fast32_t start,
@@ -82,7 +83,8 @@ int siridb_points_unzip_string(
         uint16_t len,
         uint64_t * start_ts,
         uint64_t * end_ts,
-        uint8_t has_overlap);
+        uint8_t has_overlap,
+        siridb_zdict_t * zdict);
 int siridb_points_unzip_string_raw(
         siridb_points_t * points,
         uint8_t * bits,
@@ -90,12 +92,13 @@ int siridb_points_unzip_string_raw(
 size_t siridb_points_get_size_zipped(uint16_t cinfo, uint16_t len);
 uint64_t siridb_points_get_interval(siridb_points_t * points);
 
-#define siridb_points_zip(p__, s__, e__, c__, z__) \
+/* the dictionary (d__) is only used for strings and may be NULL */
+#define siridb_points_zip(p__, s__, e__, c__, z__, d__) \
 ((p__)->tp == TP_INT) ? \
 siridb_points_zip_int(p__, s__, e__, c__, z__) : \
 ((p__)->tp == TP_DOUBLE) ? \
 siridb_points_zip_double(p__, s__, e__, c__, z__) : \
-siridb_points_zip_string(p__, s__, e__, c__, z__)
+siridb_points_zip_string(p__, s__, e__, c__, z__, d__)
 
 struct siridb_point_s
 {
@@ -20,8 +20,10 @@ void siridb_pools_init(siridb_t * siridb);
 void siridb_pools_free(siridb_pools_t * pools);
 siridb_pool_t * siridb_pools_append(
         siridb_pools_t * pools,
-        siridb_server_t * server);
+        siridb_server_t * server,
+        uint8_t lookup_mode);
 siridb_lookup_t * siridb_pools_gen_lookup(uint_fast16_t num_pools);
+void siridb_pools_log_balance(siridb_t * siridb);
 int siridb_pools_online(siridb_t * siridb);
 int siridb_pools_available(siridb_t * siridb);
 int siridb_pools_accessible(siridb_t * siridb);
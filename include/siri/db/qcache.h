@@ -0,0 +1,99 @@
+/*
+ * qcache.h - Bounded LRU cache for parsed queries.
+ *
+ * An entry holds the parse result of a query together with the walker
+ * output (the enter/exit node callbacks) and the expression nodes which
+ * must be re-evaluated for each run. Expressions like `now - 1h` are stored
+ * as part of the tree and get their value when the entry is used, so equal
+ * query strings share an entry, independent of the time they are executed.
+ *
+ * Integer, time and quoted date literals are replaced with a placeholder in
+ * the cache key. Literals which are part of an expression are bound to the
+ * literals of the query on a hit, so `between 1700000000s and ...` with other
+ * timestamps uses the same entry. Other literals must be equal, entries with
+ * the same key are chained.
+ *
+ * Entries are taken exclusive by a query and must be released when the query
+ * is finished. The cache is only used from the main thread.
+ */
+#ifndef SIRIDB_QCACHE_H_
+#define SIRIDB_QCACHE_H_
+
+typedef struct siridb_qcache_s siridb_qcache_t;
+typedef struct siridb_qentry_s siridb_qentry_t;
+typedef struct siridb_qnode_s siridb_qnode_t;
+typedef struct siridb_qlit_s siridb_qlit_t;
+
+#define SIRIDB_QCACHE_SIZE 256          /* maximum number of entries        */
+#define SIRIDB_QCACHE_MAX_QUERY 1024    /* longer queries are not cached    */
+
+#include <cleri/cleri.h>
+#include <ctree/ctree.h>
+#include <iso8601/iso8601.h>
+#include <siri/db/nodes.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <uv.h>
+#include <vec/vec.h>
+
+siridb_qcache_t * siridb_qcache_new(void);
+void siridb_qcache_free(siridb_qcache_t * qcache);
+void siridb_qcache_clear(siridb_qcache_t * qcache);
+siridb_qentry_t * siridb_qcache_get(
+        siridb_qcache_t * qcache,
+        const char * q,
+        iso8601_tz_t tz,
+        uint8_t precision);
+int siridb_qcache_put(siridb_qcache_t * qcache, siridb_qentry_t * qentry);
+void siridb_qcache_release(siridb_qentry_t * qentry);
+int siridb_qcache_is_cachable(const char * q);
+
+siridb_qentry_t * siridb_qentry_new(const char * q);
+int siridb_qentry_set_nodes(siridb_qentry_t * qentry, siridb_nodes_t * nodes);
+siridb_nodes_t * siridb_qentry_get_nodes(siridb_qentry_t * qentry);
+
+struct siridb_qnode_s
+{
+    cleri_node_t * node;
+    uv_async_cb cb;
+};
+
+struct siridb_qlit_s
+{
+    uint16_t pos;           /* literal position in the query                */
+    uint16_t len;
+    uint32_t pad0;
+    cleri_node_t * node;    /* bound on a hit, NULL when it must be equal   */
+};
+
+struct siridb_qentry_s
+{
+    uint8_t in_use;         /* taken by a query                             */
+    uint8_t cached;         /* linked in the cache                          */
+    uint16_t nlits;         /* number of literals                           */
+    uint32_t n;             /* number of walker nodes                       */
+    char * q;               /* the parse tree points to this string         */
+    char * key;             /* query with placeholders for the literals     */
+    siridb_qlit_t * lits;   /* literals in the order of the placeholders    */
+    cleri_parse_t * pr;
+    siridb_qnode_t * nodes; /* walker output, in order of execution         */
+    vec_t * exprs;          /* expression nodes which need evaluation       */
+    siridb_qentry_t * prev; /* towards most recently used                   */
+    siridb_qentry_t * next; /* towards least recently used                  */
+    siridb_qentry_t * same; /* next entry with the same key                 */
+};
+
+struct siridb_qcache_s
+{
+    iso8601_tz_t tz;        /* entries are valid for this time-zone         */
+    uint8_t precision;      /* and time precision                           */
+    uint8_t pad0;
+    uint32_t n;
+    uint64_t hits;
+    uint64_t misses;
+    ct_t * entries;
+    siridb_qentry_t * head;
+    siridb_qentry_t * tail;
+};
+
+#endif  /* SIRIDB_QCACHE_H_ */
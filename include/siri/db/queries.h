@@ -7,6 +7,7 @@
 #include <uv.h>
 #include <inttypes.h>
 #include <imap/imap.h>
+#include <rbits/rbits.h>
 #include <vec/vec.h>
 #include <cexpr/cexpr.h>
 #include <cleri/cleri.h>
@@ -46,7 +47,7 @@ typedef enum
 uint8_t tp;                     \
 uint8_t flags;                  \
 imap_t * series_map;            \
-imap_t * series_tmp;            \
+rbits_t * series_bits;          \
 imap_t * pmap;                  \
 vec_t * sset_vec;               \
 vec_t * vec;                    \
@@ -115,6 +116,7 @@ struct query_drop_s
     QUERY_DEF
     size_t n;  /* keep a counter for number of drops.   */
     vec_t * shards_list;
+    siridb_shard_drop_t * drop;  /* pending drop of the shards list */
 };
 
 struct query_list_s
@@ -138,6 +140,10 @@ struct query_select_s
     imap_t * points_map;    /* points_map for caching                       */
     vec_t * alist;        /* aggregation list (can be used multiple times)*/
     vec_t * mlist;        /* merge aggregation list                       */
+    ct_t * tdigests;      /* t-digests from pools for percentile()        */
+    uint64_t resolve_start; /* hist_now() at start, 0 when resolved        */
+    uint64_t read_ns;       /* time reading points for a select function   */
+    uint64_t aggr_ns;       /* time aggregating for a select function      */
 };
 
 #endif  /* SIRIDB_QUERIES_H_ */
@@ -33,6 +33,8 @@ typedef enum siridb_err_tp
 } siridb_err_t;
 
 typedef struct siridb_query_s siridb_query_t;
+typedef struct siridb_query_stat_s siridb_query_stat_t;
+typedef struct siridb_query_rtt_s siridb_query_rtt_t;
 
 #include <uv.h>
 #include <inttypes.h>
@@ -41,10 +43,12 @@ typedef struct siridb_query_s siridb_query_t;
 #include <qpack/qpack.h>
 #include <siri/db/time.h>
 #include <siri/db/nodes.h>
+#include <siri/db/qcache.h>
 #include <siri/db/series.h>
 #include <siri/db/db.h>
 #include <siri/net/protocol.h>
 #include <siri/inc.h>
+#include <vec/vec.h>
 
 #if SIRIDB_EXPR_ALLOC
 #include <llist/llist.h>
@@ -71,6 +75,10 @@ void siridb_query_timeit_from_unpacker(
         siridb_query_t * query,
         qp_unpacker_t * unpacker);
 int siridb_query_err_from_pkg(siridb_query_t * query, sirinet_pkg_t * pkg);
+void siridb_query_stat_read(
+        siridb_query_stat_t * stat,
+        size_t n_read,
+        size_t n_result);
 
 struct siridb_query_s
 {
@@ -87,11 +95,35 @@ struct siridb_query_s
     qp_packer_t * packer;
     qp_packer_t * timeit;
     cleri_parse_t * pr;
+    siridb_qentry_t * qentry;   /* owns the parse result when not NULL  */
     siridb_nodes_t * nodes;
     struct timespec start;
+    uint64_t parse_ns;          /* CPU time used for parsing the query  */
+    uv_async_cb async_cb;       /* continues the work of the node       */
+    siridb_query_stat_t * stat; /* NULL when the slow query log is off  */
 #if SIRIDB_EXPR_ALLOC
     llist_t * expr_cache;
 #endif
 };
 
+/*
+ * Statistics for the slow query log, only collected by the server which
+ * received the query.
+ */
+struct siridb_query_stat_s
+{
+    uint64_t points;            /* number of points read                */
+    uint64_t series;            /* number of series read                */
+    size_t mem;                 /* size of the points in the result     */
+    size_t mem_peak;            /* estimated peak size of points        */
+    vec_t * rtt;                /* siridb_query_rtt_t for each response */
+    sirinet_promises_cb fwd_cb; /* call-back for the forwarded query    */
+};
+
+struct siridb_query_rtt_s
+{
+    char * server;              /* server name                          */
+    uint64_t ns;                /* response time in nano seconds        */
+};
+
 #endif  /* SIRIDB_QUERY_H_ */
@@ -25,6 +25,7 @@ typedef struct siridb_reindex_s siridb_reindex_t;
 #include <inttypes.h>
 #include <uv.h>
 #include <siri/db/db.h>
+#include <siri/db/sbatch.h>
 #include <siri/db/series.h>
 
 siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new);
@@ -40,13 +41,13 @@ struct siridb_reindex_s
     FILE * fp;
     char * fn;
     int fd;
-    long int size;
-    uint32_t * next_series_id;
-    sirinet_pkg_t * pkg_points;
-    sirinet_pkg_t * pkg_tags;
-    siridb_series_t * series;
+    long int size;                  /* committed size of the re-index file */
+    long int pos;                   /* series before pos are not yet sent */
     siridb_server_t * server;
     uv_timer_t * timer;
+    size_t window;                  /* allowed number of batches in flight */
+    size_t nbatches;                /* number of batches in flight */
+    siridb_sbatch_t * batches[SIRIDB_SBATCH_MAX_WINDOW];  /* oldest first */
 };
 
 #endif  /* SIRIDB_REINDEX_H_ */
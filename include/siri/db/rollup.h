@@ -0,0 +1,117 @@
+/*
+ * rollup.h - Downsampled rollup tiers for numeric series.
+ *
+ * Tiers are configured in the [rollup] section of database.conf, for example
+ * `tiers = 5m,1h`. When a shard is optimized, the points of each numeric
+ * series are summarized in buckets for every tier. A bucket `ts` contains the
+ * count, sum, min and max of the points in `(ts - interval, ts]`, and since
+ * a group-by puts points in groups the same way, a bucket never crosses a
+ * group when the group-by is a multiple of the interval.
+ *
+ * The buckets are stored in a rollup file next to the shard file, which has
+ * the same name with extension .rdb. A record in this file is only used as
+ * long as the number of points of the series in the shard is equal to the
+ * number of points which was summarized, so adding points to a shard after
+ * the optimize automatically falls back to reading the points.
+ */
+#ifndef SIRIDB_ROLLUP_H_
+#define SIRIDB_ROLLUP_H_
+
+#define SIRIDB_ROLLUP_MAX_TIERS 4
+
+typedef struct siridb_rollup_s siridb_rollup_t;
+typedef struct siridb_rollup_bucket_s siridb_rollup_bucket_t;
+typedef struct siridb_rollup_entry_s siridb_rollup_entry_t;
+typedef struct siridb_rollup_select_s siridb_rollup_select_t;
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <qpack/qpack.h>
+#include <siri/db/aggregate.h>
+#include <siri/db/points.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+siridb_rollup_t * siridb_rollup_new(const char * tiers, uint64_t factor);
+int siridb_rollup_build(
+        siridb_rollup_t * rollup,
+        imap_t ** rollups,
+        const char * fn,
+        uint32_t series_id,
+        siridb_points_t * points);
+int siridb_rollup_load(imap_t ** rollups, const char * fn);
+int siridb_rollup_rename(const char * from_fn, const char * to_fn);
+void siridb_rollup_remove(const char * fn);
+int siridb_rollup_select_init(
+        siridb_rollup_select_t * select,
+        siridb_rollup_t * rollup,
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        uint64_t start_ts,
+        uint64_t end_ts,
+        char * err_msg);
+int siridb_rollup_select_feed(
+        siridb_rollup_select_t * select,
+        siridb_points_t * points);
+int siridb_rollup_select_read(
+        siridb_rollup_select_t * select,
+        FILE * fp,
+        const char * fn,
+        siridb_rollup_entry_t * entry);
+siridb_points_t * siridb_rollup_select_finish(
+        siridb_rollup_select_t * select);
+void siridb_rollup_select_destroy(siridb_rollup_select_t * select);
+
+#define siridb_rollup_free free
+
+/*
+ * Create a rollup file name from a shard file name.
+ */
+#define siridb_rollup_file(Name__, Fn__)            \
+        size_t Name__##_len = strlen(Fn__);         \
+        char Name__[Name__##_len + 1];              \
+        memcpy(Name__, Fn__, Name__##_len - 3);     \
+        memcpy(Name__ + Name__##_len - 3, "rdb", 4)
+
+struct siridb_rollup_s
+{
+    size_t n;                       /* number of tiers */
+    uint64_t intervals[SIRIDB_ROLLUP_MAX_TIERS];    /* in ascending order */
+};
+
+struct siridb_rollup_bucket_s
+{
+    uint64_t ts;                    /* contains points in (ts - interval, ts] */
+    uint64_t count;
+    qp_via_t sum;
+    qp_via_t min;
+    qp_via_t max;
+};
+
+struct siridb_rollup_entry_s
+{
+    uint32_t npoints;               /* points of the series in the shard */
+    uint32_t pad0;
+    off_t pos;                      /* position of the record in the file */
+};
+
+/*
+ * Buckets in the window (a, b] can be read from rollup files, the points
+ * outside this window are fed to the select.
+ */
+struct siridb_rollup_select_s
+{
+    siridb_aggr_t * aggr;
+    points_tp tp;
+    uint64_t interval;
+    uint64_t a;
+    uint64_t b;
+    siridb_rollup_bucket_t * buckets;
+    size_t len;
+    size_t size;
+    size_t n;                       /* number of points and buckets read */
+    char * err_msg;
+};
+
+#endif  /* SIRIDB_ROLLUP_H_ */
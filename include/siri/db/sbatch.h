@@ -0,0 +1,56 @@
+/*
+ * sbatch.h - Batches of series which are sent to another server.
+ *
+ * Re-indexing and the initial replica synchronization both take series ids
+ * from the end of a file and send the points of these series in batches.
+ * The file is only truncated when a batch and all batches which are sent
+ * before are done, so a restart never skips a series.
+ */
+#ifndef SIRIDB_SBATCH_H_
+#define SIRIDB_SBATCH_H_
+
+#define SIRIDB_SBATCH_MAX_WINDOW 4      /* batches in flight */
+#define SIRIDB_SBATCH_MAX_SERIES 256    /* series in one package */
+#define SIRIDB_SBATCH_MAX_PKG_SIZE 4194304  /* 4 MB, close the batch */
+#define SIRIDB_SBATCH_SLOW_RTT 2000000000   /* 2 seconds in nanoseconds */
+
+typedef struct siridb_sbatch_s siridb_sbatch_t;
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <siri/db/db.h>
+#include <siri/db/series.h>
+#include <siri/net/pkg.h>
+
+/* returns 1 when the series must not be added to the batch, 0 if not */
+typedef int (*siridb_sbatch_skip_cb)(
+        siridb_t * siridb,
+        siridb_series_t * series);
+
+siridb_sbatch_t * siridb_sbatch_new(
+        siridb_t * siridb,
+        FILE * fp,
+        long int pos,
+        uint8_t tp,
+        siridb_sbatch_skip_cb skip_cb);
+void siridb_sbatch_free(siridb_sbatch_t * batch);
+long int siridb_sbatch_shift(
+        siridb_sbatch_t ** batches,
+        size_t * nbatches,
+        long int size);
+void siridb_sbatch_adapt(size_t * window, siridb_t * siridb, uint64_t rtt);
+
+struct siridb_sbatch_s
+{
+    siridb_t * siridb;
+    long int pos;                   /* file size when this batch is done */
+    size_t len;                     /* number of series in the batch */
+    size_t npoints;                 /* number of points in the batch */
+    int sent;                       /* package is sent */
+    int done;                       /* response is handled */
+    siridb_series_t ** series;      /* not referenced */
+    sirinet_pkg_t * pkg_points;     /* NULL when the batch has no series */
+    sirinet_pkg_t ** pkg_tags;      /* NULL values if no tags are required */
+};
+
+#endif  /* SIRIDB_SBATCH_H_ */
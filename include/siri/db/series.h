@@ -38,17 +38,22 @@ extern const char series_type_map[3][8];
 
 typedef struct idx_s idx_t;
 typedef struct siridb_series_s siridb_series_t;
+typedef struct siridb_series_mem_s siridb_series_mem_t;
 
 #include <inttypes.h>
 
 #include <siri/db/points.h>
 typedef points_tp series_tp;
 
+#include <siri/db/aggregate.h>
 #include <siri/db/db.h>
+#include <siri/db/ngram.h>
 #include <siri/db/pcache.h>
+#include <siri/db/rollup.h>
 #include <siri/db/buffer.h>
 #include <qpack/qpack.h>
 #include <cexpr/cexpr.h>
+#include <vec/vec.h>
 
 /* order here matters since shard.h is using a full series definition */
 struct siridb_series_s
@@ -66,9 +71,9 @@ struct siridb_series_s
     uint32_t idx_len;
     long int bf_offset;
     siridb_points_t * buffer;
-    char * name;
     idx_t * idx;
     siridb_t * siridb;
+    char name[];    /* allocated together with the series */
 };
 
 #include <siri/db/shard.h>
@@ -100,16 +105,31 @@ siridb_points_t * siridb_series_get_points(
         siridb_series_t *__restrict series,
         uint64_t *__restrict start_ts,
         uint64_t *__restrict end_ts);
+siridb_points_t * siridb_series_get_points_ngram(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_ngram_query_t *__restrict query);
+int siridb_series_stream_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_aggr_stream_t *__restrict stream);
+int siridb_series_rollup_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_rollup_select_t *__restrict select);
 siridb_points_t * siridb_series_get_points_tail(
         siridb_series_t *__restrict series,
         size_t tail);
 siridb_points_t * siridb_series_get_points_head(
         siridb_series_t *__restrict series,
         size_t head);
-void siridb_series_remove_shard(
+int siridb_series_remove_shards(
         siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
-        siridb_shard_t *__restrict shard);
+        vec_t *__restrict shards);
 int siridb_series_optimize_shard(
         siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
@@ -131,6 +151,7 @@ siridb_points_t * siridb_series_get_last(
         siridb_series_t * series, int * required_shard);
 siridb_points_t * siridb_series_get_count(siridb_series_t * series);
 void siridb_series_ensure_type(siridb_series_t * series, qp_obj_t * qp_obj);
+void siridb_series_mem(siridb_t * siridb, siridb_series_mem_t * mem);
 /*
  * Increment the series reference counter.
  */
@@ -146,6 +167,15 @@ void siridb_series_ensure_type(siridb_series_t * series, qp_obj_t * qp_obj);
 #define siridb_series_server_id(series) \
 ((series->flags & SIRIDB_SERIES_IS_SERVER_ONE) == SIRIDB_SERIES_IS_SERVER_ONE)
 
+struct siridb_series_mem_s
+{
+    size_t n;           /* number of series */
+    size_t headers;     /* series including names */
+    size_t idx;         /* shard index arrays */
+    size_t buffers;     /* buffer points */
+    size_t lookup;      /* series map and series tree */
+};
+
 struct idx_s
 {
     siridb_shard_t * shard;
@@ -82,6 +82,7 @@ typedef struct siridb_server_async_s siridb_server_async_t;
 #include <siri/db/db.h>
 #include <omap/omap.h>
 #include <cexpr/cexpr.h>
+#include <hist/hist.h>
 #include <uv.h>
 #include <siri/net/promise.h>
 #include <siri/net/pkg.h>
@@ -162,6 +163,7 @@ struct siridb_server_s
     char * buffer_path;
     size_t buffer_size;
     uuid_t uuid;
+    hist_t * rtt;   /* promise round-trip times */
 };
 
 struct siridb_server_walker_s
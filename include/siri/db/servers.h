@@ -29,7 +29,10 @@ int siridb_servers_available(siridb_t * siridb);
 int siridb_servers_list(siridb_server_t * server, uv_async_t * handle);
 int siridb_servers_check_version(siridb_t * siridb, char * version);
 int siridb_servers_save(siridb_t * siridb);
-int siridb_servers_register(siridb_t * siridb, siridb_server_t * server);
+int siridb_servers_register(
+        siridb_t * siridb,
+        siridb_server_t * server,
+        uint8_t lookup_mode);
 vec_t * siridb_servers_other2vec(siridb_t * siridb);
 
 #endif  /* SIRIDB_SERVERS_H_ */
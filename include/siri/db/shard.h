@@ -31,13 +31,18 @@ extern const char shard_type_map[2][7];
 typedef struct siridb_shard_flags_repr_s siridb_shard_flags_repr_t;
 typedef struct siridb_shard_s siridb_shard_t;
 typedef struct siridb_shard_view_s siridb_shard_view_t;
+typedef struct siridb_shard_drop_s siridb_shard_drop_t;
 
 #include <stdio.h>
 #include <siri/db/db.h>
 #include <siri/db/points.h>
 #include <siri/db/series.h>
 #include <siri/file/handler.h>
+#include <imap/imap.h>
 #include <omap/omap.h>
+#include <vec/vec.h>
+#include <siri/db/zdict.h>
+#include <siri/db/ngram.h>
 
 siridb_shard_t * siridb_shard_create(
         siridb_t * siridb,
@@ -45,7 +50,8 @@ siridb_shard_t * siridb_shard_create(
         uint64_t id,
         uint64_t duration,
         uint8_t tp,
-        siridb_shard_t * replacing);
+        siridb_shard_t * replacing,
+        siridb_zdict_t * zdict);
 uint64_t siridb_shard_duration_from_interval(siridb_t * siridb, uint64_t interval);
 int siridb_shard_cexpr_cb(
         siridb_shard_view_t * vshard,
@@ -53,6 +59,10 @@ int siridb_shard_cexpr_cb(
 int siridb_shard_status(char * str, siridb_shard_t * shard);
 int siridb_shard_load(siridb_t * siridb, uint64_t id, uint64_t duration);
 void siridb_shard_drop(siridb_shard_t * shard, siridb_t * siridb);
+void siridb_shard_drop_vec(vec_t * shards, siridb_t * siridb);
+siridb_shard_drop_t * siridb_shard_drop_new(vec_t * shards, siridb_t * siridb);
+int siridb_shard_drop_work(siridb_shard_drop_t * drop);
+void siridb_shard_drop_free(siridb_shard_drop_t * drop);
 size_t siridb_shard_write_points(
         siridb_t * siridb,
         siridb_series_t * series,
@@ -104,6 +114,12 @@ int siridb_shard_get_points_log_compressed(
         uint64_t * start_ts,
         uint64_t * end_ts,
         uint8_t has_overlap);
+int siridb_shard_get_points_removed(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap);
 int siridb_shard_migrate(
         siridb_t * siridb,
         uint64_t shard_id,
@@ -112,6 +128,17 @@ int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb);
 void siridb__shard_free(siridb_shard_t * shard);
 void siridb__shard_decref(siridb_shard_t * shard);
 
+struct siridb_shard_drop_s
+{
+    siridb_t * siridb;
+    size_t pos;         /* position in the series list */
+    int dropped;        /* set when at least one series is dropped */
+    vec_t * series;     /* referenced series, may be NULL */
+    vec_t * popped;     /* shards removed from the shards map */
+    vec_t * remove;     /* shards to remove, sorted by address */
+    uint64_t * masks;
+};
+
 struct siridb_shard_flags_repr_s
 {
     const char * repr;
@@ -131,6 +158,11 @@ struct siridb_shard_s
     siri_fp_t * fp;
     char * fn;
     siridb_shard_t * replacing;
+    imap_t * ngrams;    /* trigram filters by chunk position (log only) */
+    siridb_ngram_index_t * ngram_index;  /* NULL when disabled */
+    siridb_zdict_t * zdict;  /* string dictionary (compressed log only) */
+    imap_t * rollups;   /* rollup entries by series id (number only) */
+    siri_fp_t * rollup_fp;  /* rollup file, NULL when rollups are disabled */
 };
 
 struct siridb_shard_view_s
@@ -145,7 +177,9 @@ static inline siridb_shard_get_points_cb siridb_shard_get_points_callback(
         uint8_t shard_flags,
         siridb_series_t * series)
 {
-    return shard_flags & SIRIDB_SHARD_IS_COMPRESSED ?
+    return shard_flags & SIRIDB_SHARD_IS_REMOVED ?
+            siridb_shard_get_points_removed :
+            shard_flags & SIRIDB_SHARD_IS_COMPRESSED ?
             (series->tp == TP_STRING ?
                     siridb_shard_get_points_log_compressed :
                     siridb_shard_get_points_num_compressed) :
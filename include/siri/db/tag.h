@@ -13,7 +13,7 @@ enum
 };
 
 #include <inttypes.h>
-#include <imap/imap.h>
+#include <rbits/rbits.h>
 #include <siri/db/db.h>
 
 siridb_tag_t * siridb_tag_new(siridb_tags_t * tags, uint64_t id);
@@ -45,7 +45,7 @@ struct siridb_tag_s
     uint64_t id;
     char * name;
     siridb_tags_t * tags;
-    imap_t * series;
+    rbits_t * series;   /* series ids */
 };
 
 
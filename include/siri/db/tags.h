@@ -9,6 +9,7 @@ typedef struct siridb_tags_s siridb_tags_t;
 #include <inttypes.h>
 #include <ctree/ctree.h>
 #include <vec/vec.h>
+#include <rbits/rbits.h>
 #include <uv.h>
 #include <siri/db/db.h>
 #include <siri/db/tag.h>
@@ -29,6 +30,7 @@ struct siridb_tags_s
     uint64_t next_id;
     char * path;
     ct_t * tags;
+    rbits_t * dropped;  /* dropped series ids, not yet removed from tags */
     uv_mutex_t mutex;
 };
 
@@ -43,6 +45,7 @@ siridb_tag_t * siridb_tags_add_n(
         size_t name_len);
 siridb_tag_t * siridb_tags_add(siridb_tags_t * tags, const char * name);
 void siridb_tags_dropped_series(siridb_tags_t * tags);
+void siridb_tags_add_dropped(siridb_tags_t * tags, uint32_t series_id);
 void siridb_tags_save(siridb_tags_t * tags);
 void siridb_tags_init_nseries(siridb_tags_t * tags);
 sirinet_pkg_t * siridb_tags_pkg(siridb_tags_t * tags, uint16_t pid);
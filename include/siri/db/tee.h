@@ -7,12 +7,24 @@
 typedef struct siridb_tee_s siridb_tee_t;
 
 #define SIRIDB_TEE_DEFAULT_TCP_PORT 9104
+#define SIRIDB_TEE_DEFAULT_MAX_QUEUE 67108864   /* 64 MB */
 
 enum
 {
     SIRIDB_TEE_FLAG = 1<<31,
 };
 
+/*
+ * Policy when a package does not fit in the queue. Either the new package
+ * is dropped, or queued packages which are not written yet are dropped,
+ * oldest first, to make room for the new package.
+ */
+enum siridb_tee_policy_t
+{
+    SIRIDB_TEE_DROP_NEW,
+    SIRIDB_TEE_DROP_OLD,
+};
+
 enum siridb_tee_e_t
 {
     SIRIDB_TEE_E_OK=0,
@@ -25,6 +37,7 @@ enum siridb_tee_e_t
 #include <uv.h>
 #include <stdbool.h>
 #include <siri/net/pkg.h>
+#include <vec/vec.h>
 
 siridb_tee_t * siridb_tee_new(void);
 void siridb_tee_close(siridb_tee_t * tee);
@@ -32,7 +45,7 @@ int siridb_tee_set_address_port(
         siridb_tee_t * tee,
         const char * address,
         uint16_t port);
-void siridb_tee_write(siridb_tee_t * tee, sirinet_pkg_t * pkg);
+sirinet_spkg_t * siridb_tee_write(siridb_tee_t * tee, sirinet_pkg_t * pkg);
 void siridb_tee_free(siridb_tee_t * tee);
 const char * siridb_tee_str(siridb_tee_t * tee);
 
@@ -47,6 +60,14 @@ struct siridb_tee_s
     char * address;
     uv_tcp_t * tcp;
     uv_mutex_t lock_;
+    uint8_t policy;         /* enum siridb_tee_policy_t */
+    size_t writing;         /* bytes in the pending write, 0 if none */
+    uv_write_t * req;       /* pending write request, NULL if none */
+    size_t max_queue;       /* maximum queued bytes, 0 for no limit */
+    size_t queued;          /* bytes queued or being written */
+    uint64_t written;       /* number of packages written */
+    uint64_t dropped;       /* number of packages dropped */
+    vec_t * queue;          /* shared packages waiting for a write */
 };
 
 
@@ -9,6 +9,7 @@ typedef struct siridb_walker_s siridb_walker_t;
 #include <cleri/cleri.h>
 #include <siri/db/nodes.h>
 #include <uv.h>
+#include <vec/vec.h>
 
 siridb_walker_t * siridb_walker_new(
         siridb_t * siridb,
@@ -38,6 +39,7 @@ struct siridb_walker_s
     siridb_nodes_t * start;
     siridb_nodes_t * enter_nodes;
     siridb_nodes_t * exit_nodes;
+    vec_t ** exprs;     /* collects expression nodes when not NULL */
 };
 
 #endif  /* SIRIDB_WALKER_H_ */
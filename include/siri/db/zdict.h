@@ -0,0 +1,31 @@
+/*
+ * zdict.h - Trained dictionaries for string compression in log shards.
+ *
+ * A dictionary is trained from a sample of string points while a compressed
+ * log shard is optimized and is stored in the header of the new shard. The
+ * dictionary is used as if the bytes precede the strings of each chunk, so
+ * matches in a chunk can refer to content which is common to the shard.
+ */
+#ifndef SIRIDB_ZDICT_H_
+#define SIRIDB_ZDICT_H_
+
+#define SIRIDB_ZDICT_MAX_SZ 4096
+#define SIRIDB_ZDICT_SAMPLE_SZ 131072
+
+typedef struct siridb_zdict_s siridb_zdict_t;
+
+#include <inttypes.h>
+#include <siri/db/points.h>
+
+siridb_zdict_t * siridb_zdict_new(uint16_t len);
+siridb_zdict_t * siridb_zdict_train(siridb_points_t * points);
+
+#define siridb_zdict_free free
+
+struct siridb_zdict_s
+{
+    uint16_t len;           /* size of the dictionary in bytes */
+    uint8_t data[];
+};
+
+#endif  /* SIRIDB_ZDICT_H_ */
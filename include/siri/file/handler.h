@@ -18,6 +18,7 @@ int siri_fopen(
         siri_fp_t * fp,
         const char * fn,
         const char * modes);
+uint16_t siri_fh_count(siri_fh_t * fh);
 
 struct siri_fh_s
 {
@@ -71,6 +71,7 @@ enum cleri_grammar_ids {
     CLERI_GID_F_MEDIAN_LOW,
     CLERI_GID_F_MIN,
     CLERI_GID_F_OFFSET,
+    CLERI_GID_F_PERCENTILE,
     CLERI_GID_F_POINTS,
     CLERI_GID_F_PVARIANCE,
     CLERI_GID_F_STDDEV,
@@ -207,6 +208,7 @@ enum cleri_grammar_ids {
     CLERI_GID_K_OPEN_FILES,
     CLERI_GID_K_OR,
     CLERI_GID_K_PASSWORD,
+    CLERI_GID_K_PERCENTILE,
     CLERI_GID_K_POINTS,
     CLERI_GID_K_POOL,
     CLERI_GID_K_POOLS,
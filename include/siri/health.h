@@ -21,10 +21,12 @@ struct siri_health_request_s
     uint32_t flags;  /* maps to sirnet_stream_t tp for cleanup */
     uint32_t pad0_;
     bool is_closed;
+    bool is_written;
     uv_write_t req;
     uv_stream_t uvstream;
     http_parser parser;
     uv_buf_t * response;
+    uv_buf_t metrics;   /* allocated response for /metrics */
 };
 
 static inline bool siri_health_is_handle(uv_handle_t * handle)
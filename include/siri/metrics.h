@@ -0,0 +1,28 @@
+/*
+ * metrics.h - Run-time metrics exported in the Prometheus text format.
+ */
+#ifndef SIRI_METRICS_H_
+#define SIRI_METRICS_H_
+
+#include <hist/hist.h>
+#include <stddef.h>
+
+typedef enum
+{
+    SIRI_METRICS_INSERT_APPLY,      /* apply points to local series         */
+    SIRI_METRICS_SELECT_RESOLVE,    /* find the series for a select query   */
+    SIRI_METRICS_SELECT_READ,       /* read points from shards and buffer   */
+    SIRI_METRICS_SELECT_AGGREGATE,  /* run aggregate functions              */
+    SIRI_METRICS_SELECT_PACK,       /* pack the select result               */
+    SIRI_METRICS_OPTIMIZE_SHARD,    /* optimize a single shard              */
+    SIRI_METRICS_BUFFER_FLUSH,      /* fsync() the buffer file              */
+    SIRI_METRICS_END
+} siri_metrics_tp;
+
+extern hist_t siri_metrics[SIRI_METRICS_END];
+
+char * siri_metrics_text(size_t * size);
+
+#define siri_metrics_since(tp__, start__) hist_since(&siri_metrics[tp__], start__)
+
+#endif  /* SIRI_METRICS_H_ */
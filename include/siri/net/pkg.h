@@ -5,6 +5,7 @@
 #define SIRINET_PKG_H_
 
 typedef struct sirinet_pkg_s sirinet_pkg_t;
+typedef struct sirinet_spkg_s sirinet_spkg_t;
 
 #include <inttypes.h>
 #include <qpack/qpack.h>
@@ -29,6 +30,10 @@ sirinet_pkg_t * sirinet_pkg_err(
 
 int sirinet_pkg_send(sirinet_stream_t * client, sirinet_pkg_t * pkg);
 sirinet_pkg_t * sirinet_pkg_dup(sirinet_pkg_t * pkg);
+sirinet_spkg_t * sirinet_spkg_new(sirinet_pkg_t * pkg);
+void sirinet_spkg_decref(sirinet_spkg_t * spkg);
+
+#define sirinet_spkg_incref(spkg__) (spkg__)->ref++
 
 /* Shortcut to print an packer object */
 #define sn_packer_print(packer)             \
@@ -43,4 +48,14 @@ struct sirinet_pkg_s
     unsigned char data[];
 };
 
+/*
+ * Shared package, the package is destroyed together with the last
+ * reference. (main thread only)
+ */
+struct sirinet_spkg_s
+{
+    uint32_t ref;
+    sirinet_pkg_t * pkg;
+};
+
 #endif  /* SIRINET_PKG_H_ */
@@ -42,6 +42,8 @@ struct sirinet_promise_s
     siridb_server_t * server;
     sirinet_pkg_t * pkg;
     void * data;
+    uint64_t start;     /* time stamp (hist_now) when the package is sent */
+    uint64_t rtt;       /* response time in nano seconds, 0 if unknown */
 };
 
 #endif  /* SIRINET_PROMISE_H_ */
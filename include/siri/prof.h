@@ -0,0 +1,37 @@
+/*
+ * prof.h - Sampling profiler which counts CPU time per query stage.
+ *
+ * When the profiler is running, a SIGPROF timer interrupts the process at a
+ * fixed rate and the signal handler counts a sample for the stage which is
+ * tagged by the interrupted thread. Listener node call-backs tag the stage
+ * with their function name. Samples from untagged code are counted as other.
+ */
+#ifndef SIRI_PROF_H_
+#define SIRI_PROF_H_
+
+#define SIRI_PROF_HZ_DEFAULT 100
+#define SIRI_PROF_HZ_MAX 10000
+#define SIRI_PROF_STAGES 256    /* max number of distinct stages */
+
+#include <inttypes.h>
+#include <qpack/qpack.h>
+#include <stdbool.h>
+
+extern __thread const char * siri_prof_stage;
+
+int siri_prof_start(uint32_t hz);
+void siri_prof_stop(void);
+int siri_prof_to_packer(qp_packer_t * packer);
+
+/*
+ * Set the stage for the current thread and returns the previous stage which
+ * should be restored with siri_prof_tag() when the stage is finished.
+ */
+static inline const char * siri_prof_tag(const char * stage)
+{
+    const char * prev = siri_prof_stage;
+    siri_prof_stage = stage;
+    return prev;
+}
+
+#endif  /* SIRI_PROF_H_ */
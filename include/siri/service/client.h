@@ -16,6 +16,7 @@ int siri_service_client_request(
         uint16_t pid,
         uint16_t port,
         int pool,
+        int lookup_mode,
         uuid_t * uuid,
         qp_obj_t * host,
         qp_obj_t * username,
@@ -34,7 +35,8 @@ struct siri_service_client_s
     uint16_t pid;
     uint16_t port;
     uuid_t uuid;
-    int pool;  /*       -1 for a new pool       */
+    int pool;           /*  -1 for a new pool                   */
+    int lookup_mode;    /*  -1 for the mode of the database     */
     char * host;
     char * username;
     char * password;
@@ -13,9 +13,11 @@ typedef enum
     SERVICE_NEW_POOL,
     SERVICE_NEW_REPLICA,
     SERVICE_DROP_DATABASE,
+    SERVICE_SET_PROFILER,
     SERVICE_GET_VERSION=64,
     SERVICE_GET_ACCOUNTS,
-    SERVICE_GET_DATABASES
+    SERVICE_GET_DATABASES,
+    SERVICE_GET_PROFILER
 } service_request_t;
 
 #include <qpack/qpack.h>
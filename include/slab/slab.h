@@ -0,0 +1,45 @@
+/*
+ * slab.h - Slab allocator for fixed size items.
+ *
+ * Items are allocated from chunks which grow in size up to SLAB_CHUNK_MAX
+ * bytes. Released items are re-used and all chunks are freed at once when
+ * the slab is destroyed. A slab is not thread safe, it is meant to be owned
+ * by a single container.
+ */
+#ifndef SLAB_H_
+#define SLAB_H_
+
+typedef struct slab_s slab_t;
+typedef struct slab_chunk_s slab_chunk_t;
+
+#include <stddef.h>
+
+#define SLAB_CHUNK_MIN 8        /* minimal number of items in a chunk */
+#define SLAB_CHUNK_MAX 65536    /* maximum chunk size in bytes */
+
+slab_t * slab_new(size_t item_sz);
+void slab_free(slab_t * slab);
+void * slab_alloc(slab_t * slab);
+void * slab_calloc(slab_t * slab);
+void slab_release(slab_t * slab, void * item);
+void slab_merge(slab_t * dest, slab_t * slab);
+size_t slab_size(slab_t * slab);
+
+struct slab_chunk_s
+{
+    slab_chunk_t * next;
+    size_t n;               /* number of items in this chunk */
+    char data[];
+};
+
+struct slab_s
+{
+    size_t item_sz;
+    size_t len;             /* number of items in use */
+    size_t pos;             /* next unused item in the current chunk */
+    size_t nchunks;
+    slab_chunk_t * chunk;   /* current chunk, linked to older chunks */
+    void * free_list;       /* released items */
+};
+
+#endif  /* SLAB_H_ */
@@ -151,6 +151,13 @@ class TestSelect(TestBase):
                 .format(now)),
             {'median_high': [[now, -3.0]]})
 
+        self.assertEqual(
+            await self.client0.query(
+                'select * from /series-001.*/ '
+                'merge as "percentile" using percentile(50, {})'
+                .format(now)),
+            {'percentile': [[now, -3.25]]})
+
         self.assertEqual(
             await self.client0.query(
                 'select * from /series.*/ '
@@ -187,6 +194,13 @@ class TestSelect(TestBase):
                 [1447254000, 530.5],
                 [1447257600, 533.0]]})
 
+        self.assertEqual(
+            await self.client0.query('select percentile(50, 1h) from "aggr"'),
+            {'aggr': [
+                [1447250400, 532.0],
+                [1447254000, 530.5],
+                [1447257600, 533.0]]})
+
         self.assertEqual(
             await self.client0.query('select median_low(1h) from "aggr"'),
             {'aggr': [
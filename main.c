@@ -45,6 +45,13 @@ int main(int argc, char * argv[])
     /* setup logger, this must be done before logging the first line */
     siri_setup_logger();
 
+    /* from here lines are written by the logger thread */
+    if (logger_start())
+    {
+        log_warning("Cannot start the logger thread, lines are written "
+                "synchronously");
+    }
+
     /* initialize random */
     seed = 0;
     fd = open("/dev/urandom", O_RDONLY);
@@ -57,9 +64,6 @@ int main(int argc, char * argv[])
     (void) close(fd);
     srand(seed);
 
-    /* initialize points dictionary */
-    siridb_points_init();
-
     /* start server */
     log_info("Starting SiriDB Server (version: %s)", SIRIDB_VERSION);
 
@@ -106,5 +110,8 @@ int main(int argc, char * argv[])
 
     log_info("Bye! (%d)\n", siri_err);
 
+    /* write the queued lines */
+    logger_stop();
+
     return siri_err;
 }
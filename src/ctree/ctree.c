@@ -14,15 +14,34 @@
 #define CT_BUF_SIZE 128
 #define BLOCKSZ 32
 
-static ct_node_t * CT_node_new(const char * key, size_t len, void * data);
-static int CT_node_resize(ct_node_t * node, uint8_t pos);
+static ct_node_t * CT_node_new(
+        ct_t * ct,
+        const char * key,
+        size_t len,
+        void * data);
+static int CT_node_resize(ct_t * ct, ct_node_t * node, uint8_t pos);
+static int CT_build(
+        ct_t * ct,
+        ct_nodes_t ** nodes,
+        uint8_t * offset,
+        uint8_t * n,
+        const char ** keys,
+        void ** data,
+        size_t len,
+        size_t depth);
+static void CT_nodes_release(ct_t * ct, ct_node_t * node);
 static int CT_add(
+        ct_t * ct,
         ct_node_t * node,
         const char * key,
         void * data);
-static void * CT_pop(ct_node_t * parent, ct_node_t ** nd, const char * key);
-static void CT_dec_node(ct_node_t * node);
-static void CT_merge_node(ct_node_t * node);
+static void * CT_pop(
+        ct_t * ct,
+        ct_node_t * parent,
+        ct_node_t ** nd,
+        const char * key);
+static void CT_dec_node(ct_t * ct, ct_node_t * node);
+static void CT_merge_node(ct_t * ct, ct_node_t * node);
 static int CT_items(
         ct_node_t * node,
         size_t len,
@@ -39,7 +58,8 @@ static void CT_valuesn(
         size_t * n,
         ct_val_cb cb,
         void * args);
-static void CT_free(ct_node_t * node, ct_free_cb cb);
+static void CT_free(ct_t * ct, ct_node_t * node, ct_free_cb cb);
+static void CT_free_cb(ct_node_t * node, ct_free_cb cb);
 
 /*
  * Returns NULL in case an error has occurred.
@@ -56,6 +76,16 @@ ct_t * ct_new(void)
     ct->nodes = NULL;
     ct->offset = UINT8_MAX;
     ct->n = 0;
+    ct->node_slab = slab_new(sizeof(ct_node_t));
+    ct->nodes_slab = slab_new(sizeof(ct_nodes_t));
+
+    if (ct->node_slab == NULL || ct->nodes_slab == NULL)
+    {
+        slab_free(ct->node_slab);
+        slab_free(ct->nodes_slab);
+        free(ct);
+        return NULL;
+    }
 
     return ct;
 }
@@ -63,6 +93,8 @@ ct_t * ct_new(void)
 /*
  * Destroy ct-tree. Parsing NULL is NOT allowed.
  * Call-back function will be called on each item in the tree.
+ *
+ * Nodes are not released one by one, the slabs are destroyed at once.
  */
 void ct_free(ct_t * ct, ct_free_cb cb)
 {
@@ -73,11 +105,16 @@ void ct_free(ct_t * ct, ct_free_cb cb)
         {
             if ((*ct->nodes)[i] != NULL)
             {
-                CT_free((*ct->nodes)[i], cb);
+                CT_free_cb((*ct->nodes)[i], cb);
             }
         }
-        free(ct->nodes);
+        if (ct->n > 1)
+        {
+            free(ct->nodes);
+        }
     }
+    slab_free(ct->node_slab);
+    slab_free(ct->nodes_slab);
     free(ct);
 }
 
@@ -98,7 +135,7 @@ int ct_add(ct_t * ct, const char * key, void * data)
         return CT_EXISTS;
     }
 
-    if (CT_node_resize((ct_node_t *) ct, k / BLOCKSZ))
+    if (CT_node_resize(ct, (ct_node_t *) ct, k / BLOCKSZ))
     {
         return CT_ERR;
     }
@@ -108,7 +145,7 @@ int ct_add(ct_t * ct, const char * key, void * data)
 
     if (*nd != NULL)
     {
-        rc = CT_add(*nd, key, data);
+        rc = CT_add(ct, *nd, key, data);
         if (rc == CT_OK)
         {
             ct->len++;
@@ -116,7 +153,7 @@ int ct_add(ct_t * ct, const char * key, void * data)
     }
     else
     {
-        *nd = CT_node_new(key, strlen(key), data);
+        *nd = CT_node_new(ct, key, strlen(key), data);
         if (*nd == NULL)
         {
             rc = CT_ERR;
@@ -130,6 +167,35 @@ int ct_add(ct_t * ct, const char * key, void * data)
     return rc;
 }
 
+/*
+ * Add keys to an empty tree. The keys must be unique, not empty and sorted
+ * using strcmp(). This is faster than adding the keys one by one since the
+ * nodes are created with their final key.
+ *
+ * Returns CT_OK if successful or CT_ERR in case of an error. The tree must be
+ * destroyed in case of an error.
+ */
+int ct_build(ct_t * ct, const char ** keys, void ** data, size_t n)
+{
+    int rc;
+
+    assert (ct->len == 0 && ct->nodes == NULL);
+
+    if (n == 0)
+    {
+        return CT_OK;
+    }
+
+    rc = CT_build(ct, &ct->nodes, &ct->offset, &ct->n, keys, data, n, 0);
+    if (rc < 0)
+    {
+        return CT_ERR;
+    }
+
+    ct->len = n;
+    return CT_OK;
+}
+
 /*
  * Returns an item or NULL if the key does not exist.
  */
@@ -254,7 +320,7 @@ void * ct_pop(ct_t * ct, const char * key)
         }
         else
         {
-            data = CT_pop(NULL, nd, key + 1);
+            data = CT_pop(ct, NULL, nd, key + 1);
             if (data != NULL)
             {
                 ct->len--;
@@ -467,12 +533,103 @@ static void CT_valuesn(
     }
 }
 
+/*
+ * Build the children for keys which are equal up to depth. Keys are grouped
+ * by the character at depth and each group gets a node with the common prefix
+ * of the group, so nodes never have to be split like with CT_add().
+ *
+ * Returns the number of children or -1 in case of an error.
+ */
+static int CT_build(
+        ct_t * ct,
+        ct_nodes_t ** nodes,
+        uint8_t * offset,
+        uint8_t * n,
+        const char ** keys,
+        void ** data,
+        size_t len,
+        size_t depth)
+{
+    uint8_t lo = (uint8_t) keys[0][depth] / BLOCKSZ;
+    uint8_t hi = (uint8_t) keys[len - 1][depth] / BLOCKSZ;
+    size_t i, j, l, s;
+    int size = 0, rc;
+    ct_node_t * nd;
+
+    *nodes = (hi == lo)
+            ? (ct_nodes_t *) slab_calloc(ct->nodes_slab)
+            : (ct_nodes_t *) calloc(hi - lo + 1, sizeof(ct_nodes_t));
+    if (*nodes == NULL)
+    {
+        return -1;
+    }
+    *offset = lo;
+    *n = hi - lo + 1;
+
+    for (i = 0; i < len; i = j, size++)
+    {
+        const char * first = keys[i] + depth;
+        const char * last;
+        uint8_t k = (uint8_t) *first;
+
+        j = i + 1;
+        while (j < len && (uint8_t) keys[j][depth] == k)
+        {
+            j++;
+        }
+
+        /* sorted keys, so the common prefix of the group is the common
+         * prefix of the first and last key */
+        last = keys[j - 1] + depth;
+        l = 1;
+        while (first[l] && first[l] == last[l])
+        {
+            l++;
+        }
+
+        nd = CT_node_new(ct, first + 1, l - 1, NULL);
+        if (nd == NULL)
+        {
+            return -1;
+        }
+        (**nodes)[k - lo * BLOCKSZ] = nd;
+
+        /* the first key is the shortest and might end at this node */
+        s = i;
+        if (!first[l])
+        {
+            nd->data = data[s++];
+        }
+
+        if (s < j)
+        {
+            rc = CT_build(
+                    ct,
+                    &nd->nodes,
+                    &nd->offset,
+                    &nd->n,
+                    keys + s,
+                    data + s,
+                    j - s,
+                    depth + l);
+            if (rc < 0)
+            {
+                return -1;
+            }
+            nd->size = rc;
+        }
+    }
+
+    return size;
+}
+
 /*
  * Returns CT_OK when the item is added, CT_EXISTS if the item already exists,
  * or CT_ERR in case or an error.
  * In case of CT_EXISTS the existing item is not overwritten.
  */
 static int CT_add(
+        ct_t * ct,
         ct_node_t * node,
         const char * key,
         void * data)
@@ -489,7 +646,7 @@ static int CT_add(
 
             /* create new nodes */
             ct_nodes_t * new_nodes =
-                    (ct_nodes_t *) calloc(1, sizeof(ct_nodes_t));
+                    (ct_nodes_t *) slab_calloc(ct->nodes_slab);
             if (new_nodes == NULL)
             {
                 return CT_ERR;
@@ -497,7 +654,7 @@ static int CT_add(
 
             /* create new nodes with rest of node pt */
             nd = (*new_nodes)[k % BLOCKSZ] =
-                    CT_node_new(pt + 1, node->len - n - 1, node->data);
+                    CT_node_new(ct, pt + 1, node->len - n - 1, node->data);
             if (nd == NULL)
             {
                 return CT_ERR;
@@ -527,12 +684,12 @@ static int CT_add(
                  */
                 k = (uint8_t) *key;
 
-                if (CT_node_resize(node, k / BLOCKSZ))
+                if (CT_node_resize(ct, node, k / BLOCKSZ))
                 {
                     return CT_ERR;
                 }
                 key++;
-                nd = CT_node_new(key, strlen(key), data);
+                nd = CT_node_new(ct, key, strlen(key), data);
                 if (nd == NULL)
                 {
                     return CT_ERR;
@@ -569,12 +726,12 @@ static int CT_add(
 
         if (node->nodes == NULL)
         {
-            if (CT_node_resize(node, k / BLOCKSZ))
+            if (CT_node_resize(ct, node, k / BLOCKSZ))
             {
                 return CT_ERR;
             }
             key++;
-            ct_node_t * nd = CT_node_new(key, strlen(key), data);
+            ct_node_t * nd = CT_node_new(ct, key, strlen(key), data);
             if (nd == NULL)
             {
                 return CT_ERR;
@@ -586,7 +743,7 @@ static int CT_add(
             return CT_OK;
         }
 
-        if (CT_node_resize(node, k / BLOCKSZ))
+        if (CT_node_resize(ct, node, k / BLOCKSZ))
         {
             return CT_ERR;
         }
@@ -596,10 +753,10 @@ static int CT_add(
 
         if (*nd != NULL)
         {
-            return CT_add(*nd, key, data);
+            return CT_add(ct, *nd, key, data);
         }
 
-        *nd = CT_node_new(key, strlen(key), data);
+        *nd = CT_node_new(ct, key, strlen(key), data);
         if (*nd == NULL)
         {
             return CT_ERR;
@@ -627,7 +784,7 @@ static int CT_add(
  * In case re-allocation fails the tree remains unchanged and therefore
  * can still be used.
  */
-static void CT_merge_node(ct_node_t * node)
+static void CT_merge_node(ct_t * ct, ct_node_t * node)
 {
     assert(node->size == 1 && node->data == NULL);
     ct_node_t * child_node;
@@ -662,7 +819,7 @@ static void CT_merge_node(ct_node_t * node)
 
     /* free nodes (has only the child node left so nothing else
      * needs cleaning */
-    free(node->nodes);
+    CT_nodes_release(ct, node);
 
     /* bind child nodes properties to the current node */
     node->nodes = child_node->nodes;
@@ -675,13 +832,13 @@ static void CT_merge_node(ct_node_t * node)
     free(child_node->key);
 
     /* free child node */
-    free(child_node);
+    slab_release(ct->node_slab, child_node);
 }
 
 /*
  * This function can fail but in that case the tree is still usable.
  */
-static void CT_dec_node(ct_node_t * node)
+static void CT_dec_node(ct_t * ct, ct_node_t * node)
 {
     if (node == NULL)
     {
@@ -694,21 +851,25 @@ static void CT_dec_node(ct_node_t * node)
     if (node->size == 0)
     {
         /* we can free nodes since they are no longer used */
-        free(node->nodes);
+        CT_nodes_release(ct, node);
 
         /* make sure to set nodes to NULL */
         node->nodes = NULL;
     }
     else if (node->size == 1 && node->data == NULL)
     {
-        CT_merge_node(node);
+        CT_merge_node(ct, node);
     }
 }
 
 /*
  * Removes and returns an item from the tree or NULL when not found.
  */
-static void * CT_pop(ct_node_t * parent, ct_node_t ** nd, const char * key)
+static void * CT_pop(
+        ct_t * ct,
+        ct_node_t * parent,
+        ct_node_t ** nd,
+        const char * key)
 {
     ct_node_t * node = *nd;
     if (strncmp(node->key, key, node->len))
@@ -724,14 +885,14 @@ static void * CT_pop(ct_node_t * parent, ct_node_t ** nd, const char * key)
         if (node->size == 0)
         {
             /* no child nodes, lets clean up this node */
-            CT_free(node, NULL);
+            CT_free(ct, node, NULL);
 
             /* make sure to set the node to NULL so the parent
              * can do its cleanup correctly */
             *nd = NULL;
 
             /* size of parent should be minus one */
-            CT_dec_node(parent);
+            CT_dec_node(ct, parent);
 
             return data;
         }
@@ -742,7 +903,7 @@ static void * CT_pop(ct_node_t * parent, ct_node_t ** nd, const char * key)
         {
             /* we have only one child, we can merge this
              * child with this one */
-            CT_merge_node(node);
+            CT_merge_node(ct, node);
         }
 
         return data;
@@ -760,7 +921,7 @@ static void * CT_pop(ct_node_t * parent, ct_node_t ** nd, const char * key)
 
         ct_node_t ** next = &(*node->nodes)[k - node->offset * BLOCKSZ];
 
-        return (*next == NULL) ? NULL : CT_pop(node, next, key + 1);
+        return (*next == NULL) ? NULL : CT_pop(ct, node, next, key + 1);
     }
     return NULL;
 }
@@ -768,9 +929,13 @@ static void * CT_pop(ct_node_t * parent, ct_node_t ** nd, const char * key)
 /*
  * Returns NULL in case an error has occurred.
  */
-static ct_node_t * CT_node_new(const char * key, size_t len, void * data)
+static ct_node_t * CT_node_new(
+        ct_t * ct,
+        const char * key,
+        size_t len,
+        void * data)
 {
-    ct_node_t * node = malloc(sizeof(ct_node_t));
+    ct_node_t * node = (ct_node_t *) slab_alloc(ct->node_slab);
     if (node == NULL)
     {
         return NULL;
@@ -786,7 +951,7 @@ static ct_node_t * CT_node_new(const char * key, size_t len, void * data)
         node->key = malloc(len);
         if (node->key == NULL)
         {
-            free(node);
+            slab_release(ct->node_slab, node);
             return NULL;
         }
         memcpy(node->key, key, len);
@@ -801,78 +966,96 @@ static ct_node_t * CT_node_new(const char * key, size_t len, void * data)
 /*
  * Returns 0 is successful or -1 in case of an error.
  *
+ * A single block of nodes is allocated from the slab, more blocks are
+ * allocated using malloc() since they can grow in size.
+ *
  * In case of an error, 'ct' remains unchanged.
  */
-static int CT_node_resize(ct_node_t * node, uint8_t pos)
+static int CT_node_resize(ct_t * ct, ct_node_t * node, uint8_t pos)
 {
-    int rc = 0;
+    ct_nodes_t * tmp;
+    uint8_t diff, oldn = node->n;
 
     if (node->nodes == NULL)
     {
-        node->nodes = (ct_nodes_t *) calloc(1, sizeof(ct_nodes_t));
+        node->nodes = (ct_nodes_t *) slab_calloc(ct->nodes_slab);
         if (node->nodes == NULL)
         {
-            rc = -1;
+            return -1;
         }
-        else
+        node->offset = pos;
+        node->n = 1;
+        return 0;
+    }
+
+    if (pos >= node->offset && pos < node->offset + node->n)
+    {
+        return 0;
+    }
+
+    diff = (pos < node->offset) ?
+            node->offset - pos : pos - node->offset - node->n + 1;
+
+    if (oldn == 1)
+    {
+        tmp = (ct_nodes_t *) malloc((oldn + diff) * sizeof(ct_nodes_t));
+        if (tmp != NULL)
         {
-            node->offset = pos;
-            node->n = 1;
+            memcpy(tmp, node->nodes, sizeof(ct_nodes_t));
+            slab_release(ct->nodes_slab, node->nodes);
         }
     }
-    else if (pos < node->offset)
+    else
     {
-        ct_nodes_t * tmp;
-        uint8_t diff = node->offset - pos;
-        uint8_t oldn = node->n;
-        node->n += diff;
         tmp = (ct_nodes_t *) realloc(
                 node->nodes,
-                node->n * sizeof(ct_nodes_t));
-        if (tmp == NULL && node->n)
-        {
-            node->n -= diff;
-            rc = -1;
-        }
-        else
-        {
-            node->nodes = tmp;
-            node->offset = pos;
-            memmove(node->nodes + diff,
-                    node->nodes,
-                    oldn * sizeof(ct_nodes_t));
-            memset(node->nodes, 0, diff * sizeof(ct_nodes_t));
-        }
+                (oldn + diff) * sizeof(ct_nodes_t));
     }
-    else if (pos >= node->offset + node->n)
+
+    if (tmp == NULL)
     {
-        ct_nodes_t * tmp;
-        uint8_t diff = pos - node->offset - node->n + 1;
-        uint8_t oldn = node->n;
-        node->n += diff;  /* assert node->n > 0 */
-        tmp = (ct_nodes_t *) realloc(
+        return -1;
+    }
+
+    node->nodes = tmp;
+    node->n += diff;
+
+    if (pos < node->offset)
+    {
+        node->offset = pos;
+        memmove(node->nodes + diff,
                 node->nodes,
-                node->n * sizeof(ct_nodes_t));
-        if (tmp == NULL)
-        {
-            node->n -= diff;
-            rc = -1;
-        }
-        else
-        {
-            node->nodes = tmp;
-            memset(node->nodes + oldn, 0, diff * sizeof(ct_nodes_t));
-        }
+                oldn * sizeof(ct_nodes_t));
+        memset(node->nodes, 0, diff * sizeof(ct_nodes_t));
+    }
+    else
+    {
+        memset(node->nodes + oldn, 0, diff * sizeof(ct_nodes_t));
     }
 
-    return rc;
+    return 0;
+}
+
+/*
+ * Release the nodes of a node, either to the slab or using free().
+ */
+static void CT_nodes_release(ct_t * ct, ct_node_t * node)
+{
+    if (node->n == 1)
+    {
+        slab_release(ct->nodes_slab, node->nodes);
+    }
+    else
+    {
+        free(node->nodes);
+    }
 }
 
 /*
  * Destroy ct_tree. (parsing NULL is NOT allowed)
  * Call-back function will be called on each item in the tree.
  */
-static void CT_free(ct_node_t * node, ct_free_cb cb)
+static void CT_free(ct_t * ct, ct_node_t * node, ct_free_cb cb)
 {
     if (node->nodes != NULL)
     {
@@ -881,16 +1064,44 @@ static void CT_free(ct_node_t * node, ct_free_cb cb)
         {
             if ((*node->nodes)[i] != NULL)
             {
-                CT_free((*node->nodes)[i], cb);
+                CT_free(ct, (*node->nodes)[i], cb);
             }
         }
-        free(node->nodes);
+        CT_nodes_release(ct, node);
+    }
+    if (cb != NULL && node->data != NULL)
+    {
+        (*cb)(node->data);
+    }
+    free(node->key);
+    slab_release(ct->node_slab, node);
+}
+
+/*
+ * Used by ct_free() to call the call-back function on each item and to free
+ * the keys. The nodes themselves are destroyed together with the slabs.
+ */
+static void CT_free_cb(ct_node_t * node, ct_free_cb cb)
+{
+    if (node->nodes != NULL)
+    {
+        uint_fast16_t i, end;
+        for (i = 0, end = node->n * BLOCKSZ; i < end; i++)
+        {
+            if ((*node->nodes)[i] != NULL)
+            {
+                CT_free_cb((*node->nodes)[i], cb);
+            }
+        }
+        if (node->n > 1)
+        {
+            free(node->nodes);
+        }
     }
     if (cb != NULL && node->data != NULL)
     {
         (*cb)(node->data);
     }
     free(node->key);
-    free(node);
 }
 
@@ -0,0 +1,86 @@
+/*
+ * hist.c - Lock free latency histogram with exponential buckets.
+ */
+#include <hist/hist.h>
+#include <string.h>
+
+static unsigned int hist__next_shard = 0;
+static __thread int hist__shard = -1;
+
+/*
+ * Initialize a histogram. (all buckets are set to zero)
+ */
+void hist_init(hist_t * hist)
+{
+    memset(hist, 0, sizeof(hist_t));
+}
+
+/*
+ * Observe a duration in nano seconds.
+ */
+void hist_observe(hist_t * hist, uint64_t ns)
+{
+    hist_shard_t * shard;
+    int bucket;
+
+    if (hist__shard < 0)
+    {
+        hist__shard = __atomic_fetch_add(
+                &hist__next_shard,
+                1,
+                __ATOMIC_RELAXED) % HIST_SHARDS;
+    }
+
+    if (ns <= HIST_BASE_NS)
+    {
+        bucket = 0;
+    }
+    else
+    {
+        /* smallest k with ns <= HIST_BASE_NS * 4^k */
+        uint64_t x = (ns - 1) / HIST_BASE_NS;
+        bucket = (63 - __builtin_clzll(x)) / 2 + 1;
+        if (bucket >= HIST_BUCKETS)
+        {
+            bucket = HIST_BUCKETS - 1;
+        }
+    }
+
+    shard = hist->shards + hist__shard;
+    __atomic_fetch_add(shard->buckets + bucket, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard->sum, ns, __ATOMIC_RELAXED);
+}
+
+/*
+ * Sum all shards in a snapshot. Writers are not blocked so the snapshot
+ * might include an observed count without its duration or the other way
+ * around.
+ */
+void hist_snapshot(hist_t * hist, hist_snapshot_t * snapshot)
+{
+    int i, b;
+
+    memset(snapshot, 0, sizeof(hist_snapshot_t));
+
+    for (i = 0; i < HIST_SHARDS; i++)
+    {
+        hist_shard_t * shard = hist->shards + i;
+        for (b = 0; b < HIST_BUCKETS; b++)
+        {
+            uint64_t n = __atomic_load_n(shard->buckets + b, __ATOMIC_RELAXED);
+            snapshot->buckets[b] += n;
+            snapshot->count += n;
+        }
+        snapshot->sum += __atomic_load_n(&shard->sum, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Returns the upper bound in seconds for a bucket. The last bucket has no
+ * upper bound and returns 0.0.
+ */
+double hist_bound(int bucket)
+{
+    return (bucket >= HIST_BUCKETS - 1) ?
+            0.0 : (HIST_BASE_NS * (double) (1ULL << (2 * bucket))) / 1e9;
+}
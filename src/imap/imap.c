@@ -4,34 +4,56 @@
 #include <assert.h>
 #include <imap/imap.h>
 #include <logger/logger.h>
+#include <slab/slab.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define IMAP_NODE_SZ 32
 
-static void IMAP_node_free(imap_node_t * node);
-static void IMAP_node_free_cb(imap_node_t * node, imap_free_cb cb);
-static int IMAP_set(imap_node_t * node, uint64_t id, void * data);
-static int IMAP_add(imap_node_t * node, uint64_t id, void * data);
-static void * IMAP_pop(imap_node_t * node, uint64_t id);
+static void IMAP_node_free(imap_t * imap, imap_node_t * node);
+static void IMAP_node_free_cb(
+        imap_t * imap,
+        imap_node_t * node,
+        imap_free_cb cb);
+static void IMAP_free_cb(imap_node_t * node, imap_free_cb cb);
+static int IMAP_set(
+        imap_t * imap,
+        imap_node_t * node,
+        uint64_t id,
+        void * data);
+static int IMAP_add(
+        imap_t * imap,
+        imap_node_t * node,
+        uint64_t id,
+        void * data);
+static void * IMAP_pop(imap_t * imap, imap_node_t * node, uint64_t id);
 static void IMAP_walk(imap_node_t * node, imap_cb cb, void * data, int * rc);
 static void IMAP_walkn(imap_node_t * node, imap_cb cb, void * data, size_t * n);
 static void IMAP_2vec(imap_node_t * node, vec_t * vec);
 static void IMAP_2vec_ref(imap_node_t * node, vec_t * vec);
-static void IMAP_union_ref(imap_node_t * dest, imap_node_t * node);
+static void IMAP_union_ref(
+        imap_t * imap,
+        imap_node_t * dest,
+        imap_node_t * node);
 static void IMAP_intersection_ref(
+        imap_t * dest_imap,
         imap_node_t * dest,
+        imap_t * imap,
         imap_node_t * node,
         imap_free_cb decref_cb);
 static void IMAP_difference_ref(
+        imap_t * dest_imap,
         imap_node_t * dest,
+        imap_t * imap,
         imap_node_t * node,
         imap_free_cb decref_cb);
 static void IMAP_symmetric_difference_ref(
+        imap_t * imap,
         imap_node_t * dest,
         imap_node_t * node,
         imap_free_cb decref_cb);
+static void IMAP_merge_slabs(imap_t * dest, imap_t * imap);
 
 static imap_node_t IMAP_empty_node = {
         .data = NULL,
@@ -65,15 +87,26 @@ static inline imap_node_t * IMAP_ensure_node(imap_node_t * node, uint8_t key)
             : node->key == key ? node->nodes : &IMAP_empty_node;
 }
 
-static inline int IMAP_node_grow(imap_node_t * node)
+/*
+ * Node arrays are allocated from the slab of the map; either a single node
+ * or a full array of IMAP_NODE_SZ nodes.
+ */
+static inline void IMAP_nodes_release(imap_t * imap, imap_node_t * node)
+{
+    slab_release(
+            node->key == IMAP_NODE_SZ ? imap->nodes_slab : imap->node_slab,
+            node->nodes);
+}
+
+static inline int IMAP_node_grow(imap_t * imap, imap_node_t * node)
 {
-    imap_node_t * tmp = calloc(IMAP_NODE_SZ, sizeof(imap_node_t));
+    imap_node_t * tmp = slab_calloc(imap->nodes_slab);
     if (!tmp)
     {
         return -1;
     }
     memcpy(tmp + node->key, node->nodes, sizeof(imap_node_t));
-    free(node->nodes);
+    slab_release(imap->node_slab, node->nodes);
     node->nodes = tmp;
     node->key = IMAP_NODE_SZ;
     return 0;
@@ -94,51 +127,51 @@ imap_t * imap_new(void)
 
     imap->len = 0;
     imap->vec = NULL;
+    imap->node_slab = slab_new(sizeof(imap_node_t));
+    imap->nodes_slab = slab_new(IMAP_NODE_SZ * sizeof(imap_node_t));
+
+    if (imap->node_slab == NULL || imap->nodes_slab == NULL)
+    {
+        slab_free(imap->node_slab);
+        slab_free(imap->nodes_slab);
+        free(imap);
+        return NULL;
+    }
 
     return imap;
 }
 
 /*
  * Destroy imap with optional call-back function.
+ *
+ * All nodes are owned by the slabs of the map so they are released at once;
+ * the nodes only need to be visited when a call-back function is given.
  */
 void imap_free(imap_t * imap, imap_free_cb cb)
 {
-    if (imap->len)
+    if (imap->len && cb != NULL)
     {
         imap_node_t * nd;
         uint_fast8_t i;
 
-        if (cb == NULL)
+        for (i = 0; i < IMAP_NODE_SZ; i++)
         {
-            for (i = 0; i < IMAP_NODE_SZ; i++)
-            {
-                nd = imap->nodes + i;
+            nd = imap->nodes + i;
 
-                if (nd->nodes != NULL)
-                {
-                    IMAP_node_free(nd);
-                }
-            }
-        }
-        else
-        {
-            for (i = 0; i < IMAP_NODE_SZ; i++)
+            if (nd->data != NULL)
             {
-                nd = imap->nodes + i;
-
-                if (nd->data != NULL)
-                {
-                    (*cb)(nd->data);
-                }
+                (*cb)(nd->data);
+            }
 
-                if (nd->nodes != NULL)
-                {
-                    IMAP_node_free_cb(nd, cb);
-                }
+            if (nd->nodes != NULL)
+            {
+                IMAP_free_cb(nd, cb);
             }
         }
     }
 
+    slab_free(imap->node_slab);
+    slab_free(imap->nodes_slab);
     vec_free(imap->vec);
     free(imap);
 }
@@ -167,7 +200,7 @@ int imap_set(imap_t * imap, uint64_t id, void * data)
     }
     else
     {
-        rc = IMAP_set(nd, id - 1, data);
+        rc = IMAP_set(imap, nd, id - 1, data);
 
         if (rc > 0)
         {
@@ -213,7 +246,7 @@ int imap_add(imap_t * imap, uint64_t id, void * data)
     }
     else
     {
-        int rc = IMAP_add(nd, id - 1, data);
+        int rc = IMAP_add(imap, nd, id - 1, data);
         if (rc)
         {
             return rc;
@@ -261,7 +294,7 @@ void * imap_pop(imap_t * imap, uint64_t id)
 
     if (id)
     {
-        data = (nd->nodes == NULL) ? NULL : IMAP_pop(nd, id - 1);
+        data = (nd->nodes == NULL) ? NULL : IMAP_pop(imap, nd, id - 1);
     }
     else if ((data = nd->data) != NULL)
     {
@@ -482,6 +515,9 @@ void imap_union_ref(
         dest->vec = NULL;
     }
 
+    /* nodes from 'imap' are moved to 'dest' so 'dest' takes the slabs */
+    IMAP_merge_slabs(dest, imap);
+
     if (imap->len)
     {
         imap_node_t * dest_nd;
@@ -514,7 +550,7 @@ void imap_union_ref(
                 if (dest_nd->nodes != NULL)
                 {
                     size_t tmp = dest_nd->size;
-                    IMAP_union_ref(dest_nd, imap_nd);
+                    IMAP_union_ref(dest, dest_nd, imap_nd);
                     dest->len += dest_nd->size - tmp;
                 }
                 else
@@ -529,6 +565,8 @@ void imap_union_ref(
     }
 
     /* cleanup source imap */
+    slab_free(imap->node_slab);
+    slab_free(imap->nodes_slab);
     vec_free(imap->vec);
     free(imap);
 }
@@ -577,24 +615,31 @@ void imap_intersection_ref(
             if (dest_nd->nodes != NULL)
             {
                 size_t tmp = dest_nd->size;
-                IMAP_intersection_ref(dest_nd, imap_nd, decref_cb);
+                IMAP_intersection_ref(
+                        dest,
+                        dest_nd,
+                        imap,
+                        imap_nd,
+                        decref_cb);
                 dest->len -= tmp - dest_nd->size;
             }
             else
             {
-                IMAP_node_free_cb(imap_nd, decref_cb);
+                IMAP_node_free_cb(imap, imap_nd, decref_cb);
             }
         }
         else if (dest_nd->nodes != NULL)
         {
             dest->len -= dest_nd->size;
-            IMAP_node_free_cb(dest_nd, decref_cb);
+            IMAP_node_free_cb(dest, dest_nd, decref_cb);
             dest_nd->nodes = NULL;
             dest_nd->size = 0;
         }
     }
 
     /* cleanup source imap */
+    slab_free(imap->node_slab);
+    slab_free(imap->nodes_slab);
     vec_free(imap->vec);
     free(imap);
 }
@@ -652,18 +697,25 @@ void imap_difference_ref(
                 if (dest_nd->nodes != NULL)
                 {
                     size_t tmp = dest_nd->size;
-                    IMAP_difference_ref(dest_nd, imap_nd, decref_cb);
+                    IMAP_difference_ref(
+                            dest,
+                            dest_nd,
+                            imap,
+                            imap_nd,
+                            decref_cb);
                     dest->len -= tmp - dest_nd->size;
                 }
                 else
                 {
-                    IMAP_node_free_cb(imap_nd, decref_cb);
+                    IMAP_node_free_cb(imap, imap_nd, decref_cb);
                 }
             }
         }
     }
 
     /* cleanup source imap */
+    slab_free(imap->node_slab);
+    slab_free(imap->nodes_slab);
     vec_free(imap->vec);
     free(imap);
 }
@@ -688,6 +740,9 @@ void imap_symmetric_difference_ref(
         dest->vec = NULL;
     }
 
+    /* nodes from 'imap' are moved to 'dest' so 'dest' takes the slabs */
+    IMAP_merge_slabs(dest, imap);
+
     if (imap->len)
     {
         imap_node_t * dest_nd;
@@ -728,6 +783,7 @@ void imap_symmetric_difference_ref(
                 {
                     size_t tmp = dest_nd->size;
                     IMAP_symmetric_difference_ref(
+                            dest,
                             dest_nd,
                             imap_nd,
                             decref_cb);
@@ -745,26 +801,55 @@ void imap_symmetric_difference_ref(
     }
 
     /* cleanup source imap */
+    slab_free(imap->node_slab);
+    slab_free(imap->nodes_slab);
     vec_free(imap->vec);
     free(imap);
 }
 
-static void IMAP_node_free(imap_node_t * node)
+static void IMAP_node_free(imap_t * imap, imap_node_t * node)
 {
     imap_node_t * nd = node->nodes, * end = nd + IMAP_node_size(node);
     do
     {
         if (nd->nodes)
         {
-            IMAP_node_free(nd);
+            IMAP_node_free(imap, nd);
+        }
+    }
+    while (++nd < end);
+
+    IMAP_nodes_release(imap, node);
+}
+
+static void IMAP_node_free_cb(
+        imap_t * imap,
+        imap_node_t * node,
+        imap_free_cb cb)
+{
+    imap_node_t * nd = node->nodes, * end = nd + IMAP_node_size(node);
+    do
+    {
+        if (nd->data)
+        {
+            (*cb)(nd->data);
+        }
+
+        if (nd->nodes)
+        {
+            IMAP_node_free_cb(imap, nd, cb);
         }
     }
     while (++nd < end);
 
-    free(node->nodes);
+    IMAP_nodes_release(imap, node);
 }
 
-static void IMAP_node_free_cb(imap_node_t * node, imap_free_cb cb)
+/*
+ * Call-back on all data, nodes are not released since this is only used
+ * when the slabs of the map are destroyed.
+ */
+static void IMAP_free_cb(imap_node_t * node, imap_free_cb cb)
 {
     imap_node_t * nd = node->nodes, * end = nd + IMAP_node_size(node);
     do
@@ -776,12 +861,22 @@ static void IMAP_node_free_cb(imap_node_t * node, imap_free_cb cb)
 
         if (nd->nodes)
         {
-            IMAP_node_free_cb(nd, cb);
+            IMAP_free_cb(nd, cb);
         }
     }
     while (++nd < end);
+}
 
-    free(node->nodes);
+/*
+ * Move the slabs of 'imap' to 'dest'. This is required before nodes are
+ * moved from one map to another.
+ */
+static void IMAP_merge_slabs(imap_t * dest, imap_t * imap)
+{
+    slab_merge(dest->node_slab, imap->node_slab);
+    slab_merge(dest->nodes_slab, imap->nodes_slab);
+    imap->node_slab = NULL;
+    imap->nodes_slab = NULL;
 }
 
 /*
@@ -791,7 +886,11 @@ static void IMAP_node_free_cb(imap_node_t * node, imap_free_cb cb)
  *
  * In case of an error we return -1.
  */
-static int IMAP_set(imap_node_t * node, uint64_t id, void * data)
+static int IMAP_set(
+        imap_t * imap,
+        imap_node_t * node,
+        uint64_t id,
+        void * data)
 {
     int rc;
     uint8_t key = id % IMAP_NODE_SZ;
@@ -799,7 +898,7 @@ static int IMAP_set(imap_node_t * node, uint64_t id, void * data)
 
     if (!node->size)
     {
-        node->nodes = calloc(1, sizeof(imap_node_t));
+        node->nodes = slab_calloc(imap->node_slab);
         if (!node->nodes)
         {
             return -1;
@@ -808,7 +907,7 @@ static int IMAP_set(imap_node_t * node, uint64_t id, void * data)
     }
     else if (node->key != key &&
              node->key != IMAP_NODE_SZ &&
-             IMAP_node_grow(node))
+             IMAP_node_grow(imap, node))
     {
         return -1;
     }
@@ -826,7 +925,7 @@ static int IMAP_set(imap_node_t * node, uint64_t id, void * data)
         return rc;
     }
 
-    rc = IMAP_set(nd, id - 1, data);
+    rc = IMAP_set(imap, nd, id - 1, data);
 
     if (rc > 0)
     {
@@ -844,7 +943,11 @@ static int IMAP_set(imap_node_t * node, uint64_t id, void * data)
  * In case of a memory error we return -1. If the id
  * already exists -2 will be returned.
  */
-static int IMAP_add(imap_node_t * node, uint64_t id, void * data)
+static int IMAP_add(
+        imap_t * imap,
+        imap_node_t * node,
+        uint64_t id,
+        void * data)
 {
     int rc;
     uint8_t key = id % IMAP_NODE_SZ;
@@ -852,7 +955,7 @@ static int IMAP_add(imap_node_t * node, uint64_t id, void * data)
 
     if (!node->size)
     {
-        node->nodes = calloc(1, sizeof(imap_node_t));
+        node->nodes = slab_calloc(imap->node_slab);
         if (!node->nodes)
         {
             return -1;
@@ -861,7 +964,7 @@ static int IMAP_add(imap_node_t * node, uint64_t id, void * data)
     }
     else if (node->key != key &&
              node->key != IMAP_NODE_SZ &&
-             IMAP_node_grow(node))
+             IMAP_node_grow(imap, node))
     {
         return -1;
     }
@@ -882,7 +985,7 @@ static int IMAP_add(imap_node_t * node, uint64_t id, void * data)
         return 0;
     }
 
-    rc = IMAP_add(nd, id - 1, data);
+    rc = IMAP_add(imap, nd, id - 1, data);
 
     if (rc == 0)
     {
@@ -892,7 +995,7 @@ static int IMAP_add(imap_node_t * node, uint64_t id, void * data)
     return rc;
 }
 
-static void * IMAP_pop(imap_node_t * node, uint64_t id)
+static void * IMAP_pop(imap_t * imap, imap_node_t * node, uint64_t id)
 {
     void * data;
     imap_node_t * nd = IMAP_get_node(node, id % IMAP_NODE_SZ);
@@ -913,7 +1016,7 @@ static void * IMAP_pop(imap_node_t * node, uint64_t id)
             }
             else
             {
-                free(node->nodes);
+                IMAP_nodes_release(imap, node);
                 node->nodes = NULL;
             }
         }
@@ -921,11 +1024,11 @@ static void * IMAP_pop(imap_node_t * node, uint64_t id)
         return data;
     }
 
-    data = (nd->nodes == NULL) ? NULL : IMAP_pop(nd, id - 1);
+    data = (nd->nodes == NULL) ? NULL : IMAP_pop(imap, nd, id - 1);
 
     if (data != NULL && !--node->size)
     {
-        free(node->nodes);
+        IMAP_nodes_release(imap, node);
         node->nodes = NULL;
     }
 
@@ -1008,7 +1111,10 @@ static void IMAP_2vec_ref(imap_node_t * node, vec_t * vec)
     while (++nd < end);
 }
 
-static void IMAP_union_ref(imap_node_t * dest, imap_node_t * node)
+static void IMAP_union_ref(
+        imap_t * imap,
+        imap_node_t * dest,
+        imap_node_t * node)
 {
     imap_node_t * dest_nd;
     imap_node_t * node_nd;
@@ -1016,7 +1122,7 @@ static void IMAP_union_ref(imap_node_t * dest, imap_node_t * node)
 
     if (dest->key != IMAP_NODE_SZ &&
         node->key != dest->key &&
-        IMAP_node_grow(dest))
+        IMAP_node_grow(imap, dest))
     {
         abort();
     }
@@ -1047,7 +1153,7 @@ static void IMAP_union_ref(imap_node_t * dest, imap_node_t * node)
             if (dest_nd->nodes != NULL)
             {
                 size_t tmp = dest_nd->size;
-                IMAP_union_ref(dest_nd, node_nd);
+                IMAP_union_ref(imap, dest_nd, node_nd);
                 dest->size += dest_nd->size - tmp;
             }
             else
@@ -1059,11 +1165,13 @@ static void IMAP_union_ref(imap_node_t * dest, imap_node_t * node)
             }
         }
     }
-    free(node->nodes);
+    IMAP_nodes_release(imap, node);
 }
 
 static void IMAP_intersection_ref(
+        imap_t * dest_imap,
         imap_node_t * dest,
+        imap_t * imap,
         imap_node_t * node,
         imap_free_cb decref_cb)
 {
@@ -1092,18 +1200,23 @@ static void IMAP_intersection_ref(
             if (dest_nd->nodes != NULL)
             {
                 size_t tmp = dest_nd->size;
-                IMAP_intersection_ref(dest_nd, node_nd, decref_cb);
+                IMAP_intersection_ref(
+                        dest_imap,
+                        dest_nd,
+                        imap,
+                        node_nd,
+                        decref_cb);
                 dest->size -= tmp - dest_nd->size;
             }
             else
             {
-                IMAP_node_free_cb(node_nd, decref_cb);
+                IMAP_node_free_cb(imap, node_nd, decref_cb);
             }
         }
         else if (dest_nd->nodes != NULL)
         {
             dest->size -= dest_nd->size;
-            IMAP_node_free_cb(dest_nd, decref_cb);
+            IMAP_node_free_cb(dest_imap, dest_nd, decref_cb);
             dest_nd->nodes = NULL;
             dest_nd->size = 0;
         }
@@ -1112,15 +1225,17 @@ static void IMAP_intersection_ref(
 
     if (!dest->size)
     {
-        IMAP_node_free(dest);
+        IMAP_node_free(dest_imap, dest);
         dest->nodes = NULL;
     }
 
-    free(node->nodes);
+    IMAP_nodes_release(imap, node);
 }
 
 static void IMAP_difference_ref(
+        imap_t * dest_imap,
         imap_node_t * dest,
+        imap_t * imap,
         imap_node_t * node,
         imap_free_cb decref_cb)
 {
@@ -1154,31 +1269,37 @@ static void IMAP_difference_ref(
             if (dest_nd->nodes != NULL)
             {
                 size_t tmp = dest_nd->size;
-                IMAP_difference_ref(dest_nd, node_nd, decref_cb);
+                IMAP_difference_ref(
+                        dest_imap,
+                        dest_nd,
+                        imap,
+                        node_nd,
+                        decref_cb);
                 dest->size -= tmp - dest_nd->size;
                 if (!dest_nd->size)
                 {
-                    free(dest_nd->nodes);
+                    IMAP_nodes_release(dest_imap, dest_nd);
                     dest_nd->nodes = NULL;
                 }
             }
             else
             {
-                IMAP_node_free_cb(node_nd, decref_cb);
+                IMAP_node_free_cb(imap, node_nd, decref_cb);
             }
         }
     }
 
     if (!dest->size)
     {
-        IMAP_node_free(dest);
+        IMAP_node_free(dest_imap, dest);
         dest->nodes = NULL;
     }
 
-    free(node->nodes);
+    IMAP_nodes_release(imap, node);
 }
 
 static void IMAP_symmetric_difference_ref(
+        imap_t * imap,
         imap_node_t * dest,
         imap_node_t * node,
         imap_free_cb decref_cb)
@@ -1189,7 +1310,7 @@ static void IMAP_symmetric_difference_ref(
 
     if (dest->key != IMAP_NODE_SZ &&
         node->key != dest->key &&
-        IMAP_node_grow(dest))
+        IMAP_node_grow(imap, dest))
     {
         abort();
     }
@@ -1228,6 +1349,7 @@ static void IMAP_symmetric_difference_ref(
             {
                 size_t tmp = dest_nd->size;
                 IMAP_symmetric_difference_ref(
+                        imap,
                         dest_nd,
                         node_nd,
                         decref_cb);
@@ -1245,9 +1367,9 @@ static void IMAP_symmetric_difference_ref(
 
     if (!dest->size)
     {
-        IMAP_node_free(dest);
+        IMAP_node_free(imap, dest);
         dest->nodes = NULL;
     }
 
-    free(node->nodes);
+    IMAP_nodes_release(imap, node);
 }
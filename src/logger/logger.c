@@ -1,10 +1,22 @@
 /*
  * logger.h - Logging module.
+ *
+ * The ring buffer is a bounded multi-producer single-consumer queue. Each
+ * slot has a sequence number: a producer claims a slot by moving the tail
+ * when the sequence is equal to the position and publishes the message by
+ * setting the sequence to the position + 1. The writer thread releases the
+ * slot for the next round by setting the sequence to the position +
+ * LOGGER_RING_SZ.
  */
+#include <inttypes.h>
 #include <logger/logger.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
 
 logger_t Logger = {
@@ -15,6 +27,8 @@ logger_t Logger = {
 };
 
 #define LOGGER_CHR_MAP "DIWECU"
+#define LOGGER_STAMP_SZ 80
+#define LOGGER_MASK (LOGGER_RING_SZ - 1)
 
 #define KNRM  "\x1B[0m"     /* normal           */
 #define KRED  "\x1B[31m"    /* error            */
@@ -31,44 +45,48 @@ const char * LOGGER_LEVEL_NAMES[LOGGER_NUM_LEVELS] =
 const char * LOGGER_COLOR_MAP[LOGGER_NUM_LEVELS] =
     {KCYN, KGRN, KYEL, KRED, KMAG};
 
-#define LOGGER_LOG_STUFF(LEVEL)                                 \
-{                                                               \
-    time_t t = time(NULL);                                      \
-    struct tm tm = *localtime(&t);                              \
-    if (Logger.flags & LOGGER_FLAG_COLORED)                     \
-    {                                                           \
-        fprintf(Logger.ostream,                                 \
-            "%s[%c %d-%0*d-%0*d %0*d:%0*d:%0*d]" KNRM " ",      \
-            LOGGER_COLOR_MAP[LEVEL],                            \
-            LOGGER_CHR_MAP[LEVEL],                              \
-            tm.tm_year + 1900,                                  \
-            2, tm.tm_mon + 1,                                   \
-            2, tm.tm_mday,                                      \
-            2, tm.tm_hour,                                      \
-            2, tm.tm_min,                                       \
-            2, tm.tm_sec);                                      \
-    }                                                           \
-    else                                                        \
-    {                                                           \
-        fprintf(Logger.ostream,                                 \
-        "[%c %d-%0*d-%0*d %0*d:%0*d:%0*d] ",                    \
-            LOGGER_CHR_MAP[LEVEL],                              \
-            tm.tm_year + 1900,                                  \
-            2, tm.tm_mon + 1,                                   \
-            2, tm.tm_mday,                                      \
-            2, tm.tm_hour,                                      \
-            2, tm.tm_min,                                       \
-            2, tm.tm_sec);                                      \
-    }                                                           \
-    /* print the actual log line */                             \
-    va_list args;                                               \
-    va_start(args, fmt);                                        \
-    vfprintf(Logger.ostream, fmt, args);                        \
-    va_end(args);                                               \
-    /* write end of line and flush the stream */                \
-    fputc('\n', Logger.ostream);                                \
-    fflush(Logger.ostream);                                     \
-}
+typedef struct
+{
+    uint64_t seq;
+    time_t t;
+    int level;
+    size_t len;
+    char msg[LOGGER_LINE_SZ];
+} logger_slot_t;
+
+/* state which is only used by the writer thread */
+typedef struct
+{
+    uint64_t head;
+    time_t stamp_t;
+    char stamp[LOGGER_STAMP_SZ];
+    int level;                  /* level of the last message */
+    size_t len;                 /* length of the last message */
+    size_t repeated;            /* times the last message is suppressed */
+    time_t written;             /* last time the last message is written */
+    char msg[LOGGER_LINE_SZ];
+} logger_writer_t;
+
+static logger_slot_t logger__ring[LOGGER_RING_SZ];
+static logger_writer_t logger__writer;
+static uint64_t logger__tail;
+static uint64_t logger__dropped;
+static int logger__running;
+static sem_t logger__sem;
+static pthread_t logger__thread;
+
+static void LOGGER_log(int level, const char * fmt, va_list args);
+static size_t LOGGER_format(char * msg, const char * fmt, va_list args);
+static const char * LOGGER_stamp(time_t t, time_t * stamp_t, char * stamp);
+static void LOGGER_print(
+        int level,
+        const char * stamp,
+        const char * msg,
+        size_t len);
+static void * LOGGER_work(void * arg);
+static int LOGGER_drain(void);
+static void LOGGER_write(int level, time_t t, const char * msg, size_t len);
+static void LOGGER_repeated(time_t t, int force);
 
 /*
  * Initialize the Logger.
@@ -96,18 +114,390 @@ const char * logger_level_name(int log_level)
     return LOGGER_LEVEL_NAMES[log_level];
 }
 
+/*
+ * Start the writer thread. Queued lines are written at exit or when
+ * logger_stop() is called.
+ *
+ * Returns 0 if successful or -1 in case of an error. (lines are written
+ * synchronously in that case)
+ */
+int logger_start(void)
+{
+    static int registered = 0;
+    uint64_t pos;
+
+    if (__atomic_load_n(&logger__running, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    /* the writer continues at head when the thread is started again */
+    for (pos = logger__writer.head;
+         pos < logger__writer.head + LOGGER_RING_SZ;
+         pos++)
+    {
+        logger__ring[pos & LOGGER_MASK].seq = pos;
+    }
+    logger__tail = logger__writer.head;
+
+    if (sem_init(&logger__sem, 0, 0))
+    {
+        return -1;
+    }
+
+    __atomic_store_n(&logger__running, 1, __ATOMIC_RELEASE);
+
+    if (pthread_create(&logger__thread, NULL, LOGGER_work, NULL))
+    {
+        __atomic_store_n(&logger__running, 0, __ATOMIC_RELEASE);
+        (void) sem_destroy(&logger__sem);
+        return -1;
+    }
+
+    if (!registered)
+    {
+        registered = !atexit(logger_stop);
+    }
+
+    return 0;
+}
+
+/*
+ * Stop the writer thread after the queued lines are written. Lines are
+ * written synchronously after this call.
+ */
+void logger_stop(void)
+{
+    if (!__atomic_exchange_n(&logger__running, 0, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+
+    (void) sem_post(&logger__sem);
+    (void) pthread_join(logger__thread, NULL);
+
+    /* lines which are queued while the writer was stopping */
+    if (LOGGER_drain() && Logger.ostream != NULL)
+    {
+        fflush(Logger.ostream);
+    }
+
+    (void) sem_destroy(&logger__sem);
+}
+
 void log__debug(const char * fmt, ...)
-    LOGGER_LOG_STUFF(LOGGER_DEBUG)
+{
+    va_list args;
+    va_start(args, fmt);
+    LOGGER_log(LOGGER_DEBUG, fmt, args);
+    va_end(args);
+}
 
 void log__info(const char * fmt, ...)
-    LOGGER_LOG_STUFF(LOGGER_INFO)
+{
+    va_list args;
+    va_start(args, fmt);
+    LOGGER_log(LOGGER_INFO, fmt, args);
+    va_end(args);
+}
 
 void log__warning(const char * fmt, ...)
-    LOGGER_LOG_STUFF(LOGGER_WARNING)
+{
+    va_list args;
+    va_start(args, fmt);
+    LOGGER_log(LOGGER_WARNING, fmt, args);
+    va_end(args);
+}
 
 void log__error(const char * fmt, ...)
-    LOGGER_LOG_STUFF(LOGGER_ERROR)
+{
+    va_list args;
+    va_start(args, fmt);
+    LOGGER_log(LOGGER_ERROR, fmt, args);
+    va_end(args);
+}
 
 void log__critical(const char * fmt, ...)
-    LOGGER_LOG_STUFF(LOGGER_CRITICAL)
+{
+    va_list args;
+    va_start(args, fmt);
+    LOGGER_log(LOGGER_CRITICAL, fmt, args);
+    va_end(args);
+}
+
+static void LOGGER_log(int level, const char * fmt, va_list args)
+{
+    logger_slot_t * slot;
+    uint64_t pos, seq;
+
+    if (Logger.ostream == NULL)
+    {
+        return;
+    }
+
+    if (!__atomic_load_n(&logger__running, __ATOMIC_ACQUIRE))
+    {
+        char msg[LOGGER_LINE_SZ];
+        char stamp[LOGGER_STAMP_SZ];
+        time_t stamp_t = 0;
+        size_t len = LOGGER_format(msg, fmt, args);
+
+        LOGGER_print(
+                level,
+                LOGGER_stamp(time(NULL), &stamp_t, stamp),
+                msg,
+                len);
+        fflush(Logger.ostream);
+        return;
+    }
+
+    pos = __atomic_load_n(&logger__tail, __ATOMIC_RELAXED);
+    while (1)
+    {
+        slot = &logger__ring[pos & LOGGER_MASK];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos)
+        {
+            /* pos is updated when another producer has claimed the slot */
+            if (__atomic_compare_exchange_n(
+                    &logger__tail,
+                    &pos,
+                    pos + 1,
+                    1,
+                    __ATOMIC_RELAXED,
+                    __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if ((int64_t) (seq - pos) < 0)
+        {
+            /* the ring buffer is full */
+            __atomic_add_fetch(&logger__dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&logger__tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->t = time(NULL);
+    slot->level = level;
+    slot->len = LOGGER_format(slot->msg, fmt, args);
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    (void) sem_post(&logger__sem);
+}
+
+/*
+ * Format a message with at most LOGGER_LINE_SZ - 1 characters and returns
+ * the length. A truncated message ends with "...".
+ */
+static size_t LOGGER_format(char * msg, const char * fmt, va_list args)
+{
+    int n = vsnprintf(msg, LOGGER_LINE_SZ, fmt, args);
+
+    if (n < 0)
+    {
+        return 0;
+    }
+
+    if (n >= LOGGER_LINE_SZ)
+    {
+        memcpy(msg + LOGGER_LINE_SZ - 4, "...", 4);
+        return LOGGER_LINE_SZ - 1;
+    }
+
+    return (size_t) n;
+}
 
+/*
+ * Returns the formatted time, which is only formatted again when the time
+ * is different from the cached time. (stamp_t must be 0 at first)
+ */
+static const char * LOGGER_stamp(time_t t, time_t * stamp_t, char * stamp)
+{
+    struct tm tm;
+
+    if (t == *stamp_t)
+    {
+        return stamp;
+    }
+
+    (void) localtime_r(&t, &tm);
+    (void) snprintf(stamp, LOGGER_STAMP_SZ, "%d-%02d-%02d %02d:%02d:%02d",
+            tm.tm_year + 1900,
+            tm.tm_mon + 1,
+            tm.tm_mday,
+            tm.tm_hour,
+            tm.tm_min,
+            tm.tm_sec);
+
+    *stamp_t = t;
+    return stamp;
+}
+
+/*
+ * Write one line with a single call so lines are never interleaved. The
+ * stream is not flushed.
+ */
+static void LOGGER_print(
+        int level,
+        const char * stamp,
+        const char * msg,
+        size_t len)
+{
+    char line[LOGGER_LINE_SZ + LOGGER_STAMP_SZ + 32];
+    int n = (Logger.flags & LOGGER_FLAG_COLORED) ?
+            sprintf(line, "%s[%c %s]" KNRM " ",
+                    LOGGER_COLOR_MAP[level],
+                    LOGGER_CHR_MAP[level],
+                    stamp) :
+            sprintf(line, "[%c %s] ", LOGGER_CHR_MAP[level], stamp);
+
+    memcpy(line + n, msg, len);
+    line[n + len] = '\n';
+
+    (void) fwrite(line, 1, n + len + 1, Logger.ostream);
+}
+
+static void * LOGGER_work(void * arg __attribute__((unused)))
+{
+    struct timespec ts;
+    int running;
+
+    while (1)
+    {
+        running = __atomic_load_n(&logger__running, __ATOMIC_ACQUIRE);
+
+        if (LOGGER_drain())
+        {
+            fflush(Logger.ostream);
+        }
+
+        if (!running)
+        {
+            break;
+        }
+
+        /* wake up each second to write suppressed messages */
+        (void) clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec++;
+        (void) sem_timedwait(&logger__sem, &ts);
+    }
+
+    LOGGER_repeated(time(NULL), 1);
+    fflush(Logger.ostream);
+
+    return NULL;
+}
+
+/*
+ * Write the queued lines and returns the number of lines.
+ */
+static int LOGGER_drain(void)
+{
+    logger_writer_t * writer = &logger__writer;
+    logger_slot_t * slot;
+    uint64_t dropped;
+    int n = 0;
+
+    while (1)
+    {
+        slot = &logger__ring[writer->head & LOGGER_MASK];
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != writer->head + 1)
+        {
+            break;
+        }
+
+        LOGGER_write(slot->level, slot->t, slot->msg, slot->len);
+
+        __atomic_store_n(
+                &slot->seq,
+                writer->head + LOGGER_RING_SZ,
+                __ATOMIC_RELEASE);
+        writer->head++;
+        n++;
+    }
+
+    dropped = __atomic_exchange_n(&logger__dropped, 0, __ATOMIC_RELAXED);
+    if (dropped)
+    {
+        char msg[64];
+        size_t len = (size_t) sprintf(msg,
+                "%"PRIu64" log lines are dropped (queue full)",
+                dropped);
+        LOGGER_write(LOGGER_WARNING, time(NULL), msg, len);
+        n++;
+    }
+
+    LOGGER_repeated(time(NULL), 0);
+
+    return n;
+}
+
+/*
+ * Write a line unless it is equal to the last line which is written less
+ * than LOGGER_REPEAT_INTERVAL seconds ago.
+ */
+static void LOGGER_write(int level, time_t t, const char * msg, size_t len)
+{
+    logger_writer_t * writer = &logger__writer;
+
+    if (    level == writer->level &&
+            len == writer->len &&
+            t - writer->written < LOGGER_REPEAT_INTERVAL &&
+            memcmp(msg, writer->msg, len) == 0)
+    {
+        writer->repeated++;
+        return;
+    }
+
+    LOGGER_repeated(t, 1);
+
+    LOGGER_print(
+            level,
+            LOGGER_stamp(t, &writer->stamp_t, writer->stamp),
+            msg,
+            len);
+
+    writer->level = level;
+    writer->len = len;
+    writer->written = t;
+    memcpy(writer->msg, msg, len);
+}
+
+/*
+ * Write the number of times the last message is suppressed when forced or
+ * after LOGGER_REPEAT_INTERVAL seconds.
+ */
+static void LOGGER_repeated(time_t t, int force)
+{
+    logger_writer_t * writer = &logger__writer;
+    char msg[LOGGER_LINE_SZ];
+    int n;
+
+    if (!writer->repeated ||
+        (!force && t - writer->written < LOGGER_REPEAT_INTERVAL))
+    {
+        return;
+    }
+
+    n = snprintf(msg, LOGGER_LINE_SZ,
+            "last message repeated %zu times: %.*s",
+            writer->repeated,
+            (int) writer->len,
+            writer->msg);
+
+    LOGGER_print(
+            writer->level,
+            LOGGER_stamp(t, &writer->stamp_t, writer->stamp),
+            msg,
+            (n < LOGGER_LINE_SZ) ? (size_t) n : LOGGER_LINE_SZ - 1);
+
+    writer->repeated = 0;
+    writer->written = t;
+}
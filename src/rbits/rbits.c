@@ -0,0 +1,965 @@
+/*
+ * rbits.c - Compressed (roaring-style) bitmap for uint32_t integer ids with
+ *           set operation support.
+ */
+#include <assert.h>
+#include <rbits/rbits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RBITS_KEY(id__) ((uint16_t) ((id__) >> 16))
+#define RBITS_LOW(id__) ((uint16_t) ((id__) & 0xffff))
+#define RBITS_ID(key__, low__) ((((uint32_t) (key__)) << 16) | (low__))
+
+#define RBITS_BIT_GET(words__, low__) \
+    (((words__)[(low__) >> 6] >> ((low__) & 63)) & 1)
+#define RBITS_BIT_SET(words__, low__) \
+    (words__)[(low__) >> 6] |= (uint64_t) 1 << ((low__) & 63)
+#define RBITS_BIT_CLR(words__, low__) \
+    (words__)[(low__) >> 6] &= ~((uint64_t) 1 << ((low__) & 63))
+#define RBITS_BIT_FLIP(words__, low__) \
+    (words__)[(low__) >> 6] ^= (uint64_t) 1 << ((low__) & 63)
+
+static rbits_container_t * RBITS_find(
+        rbits_t * rbits,
+        uint16_t key,
+        uint32_t * pos);
+static rbits_container_t * RBITS_insert_at(
+        rbits_t * rbits,
+        uint32_t pos,
+        uint16_t key);
+static void RBITS_remove_at(rbits_t * rbits, uint32_t pos);
+static int RBITS_c_has(rbits_container_t * c, uint16_t low);
+static int RBITS_c_add(rbits_container_t * c, uint16_t low);
+static int RBITS_c_remove(rbits_container_t * c, uint16_t low);
+static int RBITS_c_copy(rbits_container_t * dest, rbits_container_t * c);
+static int RBITS_c_union(rbits_container_t * dest, rbits_container_t * c);
+static int RBITS_c_intersection(
+        rbits_container_t * dest,
+        rbits_container_t * c);
+static void RBITS_c_difference(
+        rbits_container_t * dest,
+        rbits_container_t * c);
+static int RBITS_c_symmetric_difference(
+        rbits_container_t * dest,
+        rbits_container_t * c);
+static int RBITS_to_bitset(rbits_container_t * c);
+static int RBITS_to_array(rbits_container_t * c);
+static void RBITS_normalize(rbits_container_t * c);
+
+static inline uint32_t RBITS_popcount(uint64_t * words)
+{
+    uint32_t card = 0;
+    uint_fast16_t i;
+    for (i = 0; i < RBITS_WORDS; i++)
+    {
+        card += __builtin_popcountll(words[i]);
+    }
+    return card;
+}
+
+static inline void RBITS_c_free(rbits_container_t * c)
+{
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        free(c->via.array);
+    }
+    else
+    {
+        free(c->via.words);
+    }
+}
+
+/*
+ * Returns NULL in case an error has occurred.
+ */
+rbits_t * rbits_new(void)
+{
+    rbits_t * rbits = (rbits_t *) malloc(sizeof(rbits_t));
+    if (rbits == NULL)
+    {
+        return NULL;
+    }
+
+    rbits->len = 0;
+    rbits->n = 0;
+    rbits->sz = 0;
+    rbits->containers = NULL;
+
+    return rbits;
+}
+
+/*
+ * Destroy the bitmap. Parsing NULL is allowed.
+ */
+void rbits_free(rbits_t * rbits)
+{
+    if (rbits != NULL)
+    {
+        rbits_clear(rbits);
+        free(rbits->containers);
+        free(rbits);
+    }
+}
+
+/*
+ * Remove all ids from the bitmap.
+ */
+void rbits_clear(rbits_t * rbits)
+{
+    uint32_t i;
+    for (i = 0; i < rbits->n; i++)
+    {
+        RBITS_c_free(rbits->containers + i);
+    }
+    rbits->n = 0;
+    rbits->len = 0;
+}
+
+/*
+ * Add an id to the bitmap.
+ *
+ * Returns 1 if the id is added, 0 if the id was already in the bitmap or -1
+ * in case of a memory allocation error.
+ */
+int rbits_add(rbits_t * rbits, uint32_t id)
+{
+    int rc;
+    uint32_t pos;
+    rbits_container_t * c = RBITS_find(rbits, RBITS_KEY(id), &pos);
+
+    if (c == NULL && (c = RBITS_insert_at(rbits, pos, RBITS_KEY(id))) == NULL)
+    {
+        return -1;
+    }
+
+    rc = RBITS_c_add(c, RBITS_LOW(id));
+    if (rc > 0)
+    {
+        rbits->len++;
+    }
+    else if (rc < 0 && c->card == 0)
+    {
+        RBITS_remove_at(rbits, pos);
+    }
+
+    return rc;
+}
+
+/*
+ * Remove an id from the bitmap.
+ *
+ * Returns 1 if the id is removed or 0 if the id was not found.
+ */
+int rbits_remove(rbits_t * rbits, uint32_t id)
+{
+    uint32_t pos;
+    rbits_container_t * c = RBITS_find(rbits, RBITS_KEY(id), &pos);
+
+    if (c == NULL || !RBITS_c_remove(c, RBITS_LOW(id)))
+    {
+        return 0;
+    }
+
+    rbits->len--;
+
+    if (c->card == 0)
+    {
+        RBITS_remove_at(rbits, pos);
+    }
+
+    return 1;
+}
+
+/*
+ * Returns 1 (true) if the id is in the bitmap or 0 (false) if not.
+ */
+int rbits_has(rbits_t * rbits, uint32_t id)
+{
+    uint32_t pos;
+    rbits_container_t * c = RBITS_find(rbits, RBITS_KEY(id), &pos);
+    return c != NULL && RBITS_c_has(c, RBITS_LOW(id));
+}
+
+/*
+ * Run the call-back function on all ids in the bitmap, ordered by id.
+ *
+ * All the results are added together and are returned as the result of
+ * this function.
+ */
+int rbits_walk(rbits_t * rbits, rbits_cb cb, void * args)
+{
+    int rc = 0;
+    uint32_t i, j;
+    rbits_container_t * c;
+
+    for (i = 0; i < rbits->n; i++)
+    {
+        c = rbits->containers + i;
+        if (c->tp == RBITS_TP_ARRAY)
+        {
+            for (j = 0; j < c->card; j++)
+            {
+                rc += (*cb)(RBITS_ID(c->key, c->via.array[j]), args);
+            }
+        }
+        else
+        {
+            for (j = 0; j < RBITS_WORDS; j++)
+            {
+                uint64_t w = c->via.words[j];
+                while (w)
+                {
+                    uint32_t low = (j << 6) | __builtin_ctzll(w);
+                    rc += (*cb)(RBITS_ID(c->key, low), args);
+                    w &= w - 1;
+                }
+            }
+        }
+    }
+
+    return rc;
+}
+
+/*
+ * Returns the number of bytes allocated by the bitmap.
+ */
+size_t rbits_size(rbits_t * rbits)
+{
+    size_t size = sizeof(rbits_t) + rbits->sz * sizeof(rbits_container_t);
+    uint32_t i;
+
+    for (i = 0; i < rbits->n; i++)
+    {
+        rbits_container_t * c = rbits->containers + i;
+        size += (c->tp == RBITS_TP_ARRAY)
+                ? c->sz * sizeof(uint16_t)
+                : RBITS_WORDS * sizeof(uint64_t);
+    }
+
+    return size;
+}
+
+/*
+ * Bitmap 'dest' will be the union between the two bitmaps. Bitmap 'rbits'
+ * is not changed.
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error. In
+ * case of an error, 'dest' is still valid but the result is undefined.
+ */
+int rbits_union(rbits_t * dest, rbits_t * rbits)
+{
+    uint32_t i, pos;
+    rbits_container_t * c, * s;
+
+    for (i = 0; i < rbits->n; i++)
+    {
+        s = rbits->containers + i;
+        c = RBITS_find(dest, s->key, &pos);
+
+        if (c == NULL)
+        {
+            if ((c = RBITS_insert_at(dest, pos, s->key)) == NULL ||
+                RBITS_c_copy(c, s))
+            {
+                return -1;
+            }
+            dest->len += c->card;
+        }
+        else
+        {
+            uint32_t card = c->card;
+            if (RBITS_c_union(c, s))
+            {
+                return -1;
+            }
+            dest->len += c->card - card;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Bitmap 'dest' will be the intersection between the two bitmaps. Bitmap
+ * 'rbits' is not changed.
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error. In
+ * case of an error, 'dest' is still valid but the result is undefined.
+ */
+int rbits_intersection(rbits_t * dest, rbits_t * rbits)
+{
+    int rc = 0;
+    uint32_t i = 0, pos;
+    rbits_container_t * c, * s;
+
+    while (i < dest->n)
+    {
+        c = dest->containers + i;
+        s = RBITS_find(rbits, c->key, &pos);
+
+        dest->len -= c->card;
+
+        if (s != NULL)
+        {
+            rc = RBITS_c_intersection(c, s) || rc;
+            dest->len += c->card;
+        }
+
+        if (s == NULL || c->card == 0)
+        {
+            RBITS_remove_at(dest, i);
+            continue;
+        }
+        i++;
+    }
+    return rc ? -1 : 0;
+}
+
+/*
+ * Bitmap 'dest' will be the difference between the two bitmaps. Bitmap
+ * 'rbits' is not changed.
+ *
+ * This function never fails and always returns 0.
+ */
+int rbits_difference(rbits_t * dest, rbits_t * rbits)
+{
+    uint32_t i = 0, pos;
+    rbits_container_t * c, * s;
+
+    while (i < dest->n)
+    {
+        c = dest->containers + i;
+        s = RBITS_find(rbits, c->key, &pos);
+
+        if (s != NULL)
+        {
+            dest->len -= c->card;
+            RBITS_c_difference(c, s);
+            dest->len += c->card;
+
+            if (c->card == 0)
+            {
+                RBITS_remove_at(dest, i);
+                continue;
+            }
+        }
+        i++;
+    }
+    return 0;
+}
+
+/*
+ * Bitmap 'dest' will be the symmetric difference between the two bitmaps.
+ * Bitmap 'rbits' is not changed.
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error. In
+ * case of an error, 'dest' is still valid but the result is undefined.
+ */
+int rbits_symmetric_difference(rbits_t * dest, rbits_t * rbits)
+{
+    uint32_t i, pos;
+    rbits_container_t * c, * s;
+
+    for (i = 0; i < rbits->n; i++)
+    {
+        s = rbits->containers + i;
+        c = RBITS_find(dest, s->key, &pos);
+
+        if (c == NULL)
+        {
+            if ((c = RBITS_insert_at(dest, pos, s->key)) == NULL ||
+                RBITS_c_copy(c, s))
+            {
+                return -1;
+            }
+            dest->len += c->card;
+        }
+        else
+        {
+            dest->len -= c->card;
+            if (RBITS_c_symmetric_difference(c, s))
+            {
+                return -1;
+            }
+            dest->len += c->card;
+
+            if (c->card == 0)
+            {
+                RBITS_remove_at(dest, pos);
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the container for 'key' or NULL when not found. Argument 'pos' is
+ * set to the position of the container, or to the position where the
+ * container should be inserted.
+ */
+static rbits_container_t * RBITS_find(
+        rbits_t * rbits,
+        uint16_t key,
+        uint32_t * pos)
+{
+    uint32_t lo = 0, hi = rbits->n;
+
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) >> 1;
+        uint16_t k = rbits->containers[mid].key;
+
+        if (k == key)
+        {
+            *pos = mid;
+            return rbits->containers + mid;
+        }
+
+        if (k < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    *pos = lo;
+    return NULL;
+}
+
+/*
+ * Returns a new and empty container or NULL in case of an error.
+ */
+static rbits_container_t * RBITS_insert_at(
+        rbits_t * rbits,
+        uint32_t pos,
+        uint16_t key)
+{
+    rbits_container_t * c;
+
+    if (rbits->n == rbits->sz)
+    {
+        uint32_t sz = rbits->sz ? rbits->sz * 2 : 4;
+        rbits_container_t * tmp = (rbits_container_t *) realloc(
+                rbits->containers,
+                sz * sizeof(rbits_container_t));
+        if (tmp == NULL)
+        {
+            return NULL;
+        }
+        rbits->containers = tmp;
+        rbits->sz = sz;
+    }
+
+    c = rbits->containers + pos;
+
+    memmove(c + 1, c, (rbits->n - pos) * sizeof(rbits_container_t));
+    rbits->n++;
+
+    c->key = key;
+    c->tp = RBITS_TP_ARRAY;
+    c->card = 0;
+    c->sz = 0;
+    c->pad0 = 0;
+    c->via.array = NULL;
+
+    return c;
+}
+
+static void RBITS_remove_at(rbits_t * rbits, uint32_t pos)
+{
+    rbits_container_t * c = rbits->containers + pos;
+
+    RBITS_c_free(c);
+
+    rbits->n--;
+    memmove(c, c + 1, (rbits->n - pos) * sizeof(rbits_container_t));
+}
+
+/*
+ * Returns the position of 'low' in the array or the position where 'low'
+ * should be inserted.
+ */
+static inline uint32_t RBITS_array_pos(rbits_container_t * c, uint16_t low)
+{
+    uint32_t lo = 0, hi = c->card;
+
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) >> 1;
+        if (c->via.array[mid] < low)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static int RBITS_c_has(rbits_container_t * c, uint16_t low)
+{
+    uint32_t pos;
+
+    if (c->tp == RBITS_TP_BITSET)
+    {
+        return RBITS_BIT_GET(c->via.words, low);
+    }
+
+    pos = RBITS_array_pos(c, low);
+    return pos < c->card && c->via.array[pos] == low;
+}
+
+static int RBITS_c_add(rbits_container_t * c, uint16_t low)
+{
+    uint32_t pos;
+
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        pos = RBITS_array_pos(c, low);
+        if (pos < c->card && c->via.array[pos] == low)
+        {
+            return 0;
+        }
+
+        if (c->card < RBITS_ARRAY_MAX)
+        {
+            if (c->card == c->sz)
+            {
+                uint32_t sz = c->sz ? c->sz * 2 : 4;
+                uint16_t * tmp;
+
+                if (sz > RBITS_ARRAY_MAX)
+                {
+                    sz = RBITS_ARRAY_MAX;
+                }
+
+                tmp = (uint16_t *) realloc(c->via.array, sz * sizeof(uint16_t));
+                if (tmp == NULL)
+                {
+                    return -1;
+                }
+                c->via.array = tmp;
+                c->sz = sz;
+            }
+
+            memmove(c->via.array + pos + 1,
+                    c->via.array + pos,
+                    (c->card - pos) * sizeof(uint16_t));
+            c->via.array[pos] = low;
+            c->card++;
+            return 1;
+        }
+
+        if (RBITS_to_bitset(c))
+        {
+            return -1;
+        }
+    }
+
+    if (RBITS_BIT_GET(c->via.words, low))
+    {
+        return 0;
+    }
+
+    RBITS_BIT_SET(c->via.words, low);
+    c->card++;
+    return 1;
+}
+
+static int RBITS_c_remove(rbits_container_t * c, uint16_t low)
+{
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        uint32_t pos = RBITS_array_pos(c, low);
+        if (pos == c->card || c->via.array[pos] != low)
+        {
+            return 0;
+        }
+        c->card--;
+        memmove(c->via.array + pos,
+                c->via.array + pos + 1,
+                (c->card - pos) * sizeof(uint16_t));
+        return 1;
+    }
+
+    if (!RBITS_BIT_GET(c->via.words, low))
+    {
+        return 0;
+    }
+
+    RBITS_BIT_CLR(c->via.words, low);
+    c->card--;
+    RBITS_normalize(c);
+    return 1;
+}
+
+/*
+ * Copy container 'c' into the empty container 'dest'.
+ */
+static int RBITS_c_copy(rbits_container_t * dest, rbits_container_t * c)
+{
+    assert (dest->card == 0 && dest->tp == RBITS_TP_ARRAY);
+
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        dest->via.array = (uint16_t *) malloc(c->card * sizeof(uint16_t));
+        if (dest->via.array == NULL)
+        {
+            return -1;
+        }
+        memcpy(dest->via.array, c->via.array, c->card * sizeof(uint16_t));
+        dest->sz = c->card;
+    }
+    else
+    {
+        dest->via.words = (uint64_t *) malloc(RBITS_WORDS * sizeof(uint64_t));
+        if (dest->via.words == NULL)
+        {
+            return -1;
+        }
+        memcpy(dest->via.words, c->via.words, RBITS_WORDS * sizeof(uint64_t));
+        dest->tp = RBITS_TP_BITSET;
+        dest->sz = 0;
+    }
+
+    dest->card = c->card;
+    return 0;
+}
+
+static int RBITS_c_union(rbits_container_t * dest, rbits_container_t * c)
+{
+    uint32_t i, j, n;
+
+    if (dest->tp == RBITS_TP_ARRAY && c->tp == RBITS_TP_ARRAY)
+    {
+        uint16_t * array;
+
+        if (dest->card + c->card > RBITS_ARRAY_MAX)
+        {
+            if (RBITS_to_bitset(dest))
+            {
+                return -1;
+            }
+            return RBITS_c_union(dest, c);
+        }
+
+        array = (uint16_t *) malloc(
+                (dest->card + c->card) * sizeof(uint16_t));
+        if (array == NULL)
+        {
+            return -1;
+        }
+
+        for (i = j = n = 0; i < dest->card && j < c->card;)
+        {
+            uint16_t a = dest->via.array[i], b = c->via.array[j];
+            array[n++] = a < b ? a : b;
+            i += a <= b;
+            j += b <= a;
+        }
+        for (; i < dest->card; i++)
+        {
+            array[n++] = dest->via.array[i];
+        }
+        for (; j < c->card; j++)
+        {
+            array[n++] = c->via.array[j];
+        }
+
+        free(dest->via.array);
+        dest->via.array = array;
+        dest->sz = dest->card + c->card;
+        dest->card = n;
+        return 0;
+    }
+
+    if (dest->tp == RBITS_TP_ARRAY && RBITS_to_bitset(dest))
+    {
+        return -1;
+    }
+
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        for (j = 0; j < c->card; j++)
+        {
+            uint16_t low = c->via.array[j];
+            dest->card += !RBITS_BIT_GET(dest->via.words, low);
+            RBITS_BIT_SET(dest->via.words, low);
+        }
+    }
+    else
+    {
+        for (i = 0; i < RBITS_WORDS; i++)
+        {
+            dest->via.words[i] |= c->via.words[i];
+        }
+        dest->card = RBITS_popcount(dest->via.words);
+    }
+    return 0;
+}
+
+static int RBITS_c_intersection(
+        rbits_container_t * dest,
+        rbits_container_t * c)
+{
+    uint32_t i, j, n;
+
+    if (dest->tp == RBITS_TP_ARRAY)
+    {
+        if (c->tp == RBITS_TP_ARRAY)
+        {
+            for (i = j = n = 0; i < dest->card && j < c->card;)
+            {
+                uint16_t a = dest->via.array[i], b = c->via.array[j];
+                if (a == b)
+                {
+                    dest->via.array[n++] = a;
+                }
+                i += a <= b;
+                j += b <= a;
+            }
+        }
+        else
+        {
+            for (i = n = 0; i < dest->card; i++)
+            {
+                uint16_t low = dest->via.array[i];
+                if (RBITS_BIT_GET(c->via.words, low))
+                {
+                    dest->via.array[n++] = low;
+                }
+            }
+        }
+        dest->card = n;
+        return 0;
+    }
+
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        uint16_t * array = (uint16_t *) malloc(c->card * sizeof(uint16_t));
+        if (array == NULL)
+        {
+            return -1;
+        }
+
+        for (j = n = 0; j < c->card; j++)
+        {
+            uint16_t low = c->via.array[j];
+            if (RBITS_BIT_GET(dest->via.words, low))
+            {
+                array[n++] = low;
+            }
+        }
+
+        free(dest->via.words);
+        dest->tp = RBITS_TP_ARRAY;
+        dest->via.array = array;
+        dest->sz = c->card;
+        dest->card = n;
+        return 0;
+    }
+
+    for (i = 0; i < RBITS_WORDS; i++)
+    {
+        dest->via.words[i] &= c->via.words[i];
+    }
+    dest->card = RBITS_popcount(dest->via.words);
+    RBITS_normalize(dest);
+    return 0;
+}
+
+static void RBITS_c_difference(
+        rbits_container_t * dest,
+        rbits_container_t * c)
+{
+    uint32_t i, j, n;
+
+    if (dest->tp == RBITS_TP_ARRAY)
+    {
+        if (c->tp == RBITS_TP_ARRAY)
+        {
+            for (i = j = n = 0; i < dest->card;)
+            {
+                uint16_t a = dest->via.array[i];
+                while (j < c->card && c->via.array[j] < a)
+                {
+                    j++;
+                }
+                if (j == c->card || c->via.array[j] != a)
+                {
+                    dest->via.array[n++] = a;
+                }
+                i++;
+            }
+        }
+        else
+        {
+            for (i = n = 0; i < dest->card; i++)
+            {
+                uint16_t low = dest->via.array[i];
+                if (!RBITS_BIT_GET(c->via.words, low))
+                {
+                    dest->via.array[n++] = low;
+                }
+            }
+        }
+        dest->card = n;
+        return;
+    }
+
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        for (j = 0; j < c->card; j++)
+        {
+            uint16_t low = c->via.array[j];
+            dest->card -= RBITS_BIT_GET(dest->via.words, low);
+            RBITS_BIT_CLR(dest->via.words, low);
+        }
+    }
+    else
+    {
+        for (i = 0; i < RBITS_WORDS; i++)
+        {
+            dest->via.words[i] &= ~c->via.words[i];
+        }
+        dest->card = RBITS_popcount(dest->via.words);
+    }
+    RBITS_normalize(dest);
+}
+
+static int RBITS_c_symmetric_difference(
+        rbits_container_t * dest,
+        rbits_container_t * c)
+{
+    uint32_t i, j, n;
+
+    if (dest->tp == RBITS_TP_ARRAY &&
+        c->tp == RBITS_TP_ARRAY &&
+        dest->card + c->card <= RBITS_ARRAY_MAX)
+    {
+        uint16_t * array = (uint16_t *) malloc(
+                (dest->card + c->card) * sizeof(uint16_t));
+        if (array == NULL)
+        {
+            return -1;
+        }
+
+        for (i = j = n = 0; i < dest->card && j < c->card;)
+        {
+            uint16_t a = dest->via.array[i], b = c->via.array[j];
+            if (a != b)
+            {
+                array[n++] = a < b ? a : b;
+            }
+            i += a <= b;
+            j += b <= a;
+        }
+        for (; i < dest->card; i++)
+        {
+            array[n++] = dest->via.array[i];
+        }
+        for (; j < c->card; j++)
+        {
+            array[n++] = c->via.array[j];
+        }
+
+        free(dest->via.array);
+        dest->via.array = array;
+        dest->sz = dest->card + c->card;
+        dest->card = n;
+        return 0;
+    }
+
+    if (dest->tp == RBITS_TP_ARRAY && RBITS_to_bitset(dest))
+    {
+        return -1;
+    }
+
+    if (c->tp == RBITS_TP_ARRAY)
+    {
+        for (j = 0; j < c->card; j++)
+        {
+            RBITS_BIT_FLIP(dest->via.words, c->via.array[j]);
+        }
+    }
+    else
+    {
+        for (i = 0; i < RBITS_WORDS; i++)
+        {
+            dest->via.words[i] ^= c->via.words[i];
+        }
+    }
+
+    dest->card = RBITS_popcount(dest->via.words);
+    RBITS_normalize(dest);
+    return 0;
+}
+
+static int RBITS_to_bitset(rbits_container_t * c)
+{
+    uint32_t i;
+    uint64_t * words = (uint64_t *) calloc(RBITS_WORDS, sizeof(uint64_t));
+    if (words == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < c->card; i++)
+    {
+        RBITS_BIT_SET(words, c->via.array[i]);
+    }
+
+    free(c->via.array);
+    c->tp = RBITS_TP_BITSET;
+    c->via.words = words;
+    c->sz = 0;
+    return 0;
+}
+
+static int RBITS_to_array(rbits_container_t * c)
+{
+    uint32_t i, n = 0;
+    uint16_t * array = (uint16_t *) malloc(
+            (c->card ? c->card : 1) * sizeof(uint16_t));
+    if (array == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < RBITS_WORDS; i++)
+    {
+        uint64_t w = c->via.words[i];
+        while (w)
+        {
+            array[n++] = (uint16_t) ((i << 6) | __builtin_ctzll(w));
+            w &= w - 1;
+        }
+    }
+
+    assert (n == c->card);
+
+    free(c->via.words);
+    c->tp = RBITS_TP_ARRAY;
+    c->via.array = array;
+    c->sz = c->card ? c->card : 1;
+    return 0;
+}
+
+/*
+ * Convert a bitset container back to an array when it became small enough.
+ * A failed conversion is not critical since a bitset container is still
+ * valid, only less compact.
+ */
+static void RBITS_normalize(rbits_container_t * c)
+{
+    if (c->tp == RBITS_TP_BITSET && c->card <= RBITS_ARRAY_MAX / 2)
+    {
+        (void) RBITS_to_array(c);
+    }
+}
@@ -10,7 +10,9 @@
 #include <siri/db/users.h>
 #include <qpjson/qpjson.h>
 #include <siri/db/query.h>
+#include <siri/db/ijson.h>
 #include <siri/db/insert.h>
+#include <siri/db/itext.h>
 #include <siri/service/account.h>
 #include <siri/net/tcp.h>
 
@@ -19,6 +21,14 @@
 static uv_tcp_t api__uv_server;
 static http_parser_settings api__settings;
 
+struct siri_api_write_s
+{
+    uv_write_t req;
+    void * data;                /* response body, freed when written */
+    siri_api_write_t * next;    /* next in the free list */
+    char header[API__HEADER_MAX_SZ];
+};
+
 typedef struct
 {
     char * query;
@@ -32,10 +42,12 @@ typedef struct
 #define API__CMP_WITH(__s, __n, __w) \
     (__n == strlen(__w) && strncmp(__s, __w, __n) == 0)
 
-static const char api__content_type[3][20] = {
+static const char api__content_type[5][20] = {
         "text/plain",
         "application/json",
         "application/qpack",
+        "text/csv",
+        "text/plain",
 };
 
 static const char api__html_header[10][32] = {
@@ -69,17 +81,20 @@ inline static int api__header(
         char * ptr,
         const siri_api_header_t ht,
         const siri_api_content_t ct,
-        size_t content_length)
+        size_t content_length,
+        bool keep_alive)
 {
     int len = sprintf(
         ptr,
         "HTTP/1.1 %s\r\n" \
         "Content-Type: %s\r\n" \
         "Content-Length: %zu\r\n" \
+        "%s" \
         "\r\n",
         api__html_header[ht],
         api__content_type[ct],
-        content_length);
+        content_length,
+        keep_alive ? "" : "Connection: close\r\n");
     return len;
 }
 
@@ -114,12 +129,31 @@ static inline bool api__starts_with(
 }
 
 static void api__alloc_cb(
-        uv_handle_t * UNUSED_handle __attribute__((unused)),
+        uv_handle_t * handle,
         size_t UNUSED_sugsz __attribute__((unused)),
         uv_buf_t * buf)
 {
-    buf->base = malloc(HTTP_MAX_HEADER_SIZE);
-    buf->len = buf->base ? HTTP_MAX_HEADER_SIZE-1 : 0;
+    siri_api_request_t * ar = handle->data;
+
+    /* reading is stopped while unparsed data is left in the buffer */
+    assert (ar->rlen == 0);
+
+    if (ar->rbuf == NULL)
+    {
+        ar->rbuf = malloc(HTTP_MAX_HEADER_SIZE);
+    }
+
+    buf->base = ar->rbuf;
+    buf->len = ar->rbuf ? HTTP_MAX_HEADER_SIZE-1 : 0;
+}
+
+static void api__free_ijson(siri_api_request_t * ar)
+{
+    if (ar->ijson)
+    {
+        siridb_ijson_free(ar->ijson);
+        ar->ijson = NULL;
+    }
 }
 
 static void api__reset(siri_api_request_t * ar)
@@ -139,6 +173,8 @@ static void api__reset(siri_api_request_t * ar)
         ar->origin = NULL;
     }
 
+    api__free_ijson(ar);
+
     ar->buf = NULL;
     ar->len = 0;
     ar->size = 0;
@@ -148,46 +184,160 @@ static void api__reset(siri_api_request_t * ar)
     ar->content_type = SIRI_API_CT_TEXT;
 }
 
+/*
+ * Release the connection reference. The connection is closed when all
+ * pending responses are written.
+ */
+static void api__close(siri_api_request_t * ar)
+{
+    if (ar->closed)
+        return;
+
+    ar->closed = true;
+    (void) uv_read_stop(ar->stream);
+    sirinet_stream_decref(ar);
+}
+
+/*
+ * Parse the data in the read buffer. Requests are handled one at a time;
+ * when a request is handled asynchronously, the parser is paused and the
+ * remaining (pipelined) data is kept in the buffer while reading is stopped.
+ * Parsing continues as soon as the response is queued so responses are
+ * always written in the order of the requests.
+ */
+static void api__parse(siri_api_request_t * ar)
+{
+    size_t parsed;
+
+    ar->in_parser = true;
+
+    while (ar->rlen && !ar->busy && !ar->closed)
+    {
+        parsed = http_parser_execute(
+                &ar->parser,
+                &api__settings,
+                ar->rbuf + ar->rpos,
+                ar->rlen);
+
+        ar->rpos += parsed;
+        ar->rlen -= parsed;
+
+        if (ar->busy || ar->closed)
+            break;
+
+        if (ar->parser.upgrade)
+        {
+            log_debug("upgrade to a new protocol is not supported");
+            api__close(ar);
+        }
+        else if (ar->rlen || HTTP_PARSER_ERRNO(&ar->parser) != HPE_OK)
+        {
+            log_warning("error parsing HTTP API request");
+            api__close(ar);
+        }
+    }
+
+    ar->in_parser = false;
+
+    if (ar->busy && !ar->closed)
+    {
+        (void) uv_read_stop(ar->stream);
+    }
+}
+
+static void api__data_cb(
+        uv_stream_t * uvstream,
+        ssize_t n,
+        const uv_buf_t * buf);
+
+/*
+ * Called when the response for the current request is queued.
+ */
+static void api__resume(siri_api_request_t * ar)
+{
+    int rc;
+
+    /* reset the API to support multiple request on the same connection */
+    api__reset(ar);
+    ar->busy = false;
+
+    if (!ar->keep_alive)
+    {
+        /* the parser stays paused so pipelined data is ignored */
+        api__close(ar);
+        return;
+    }
+
+    http_parser_pause(&ar->parser, 0);
+
+    /* the parser continues when the response is queued from a call-back */
+    if (ar->in_parser)
+        return;
+
+    api__parse(ar);
+
+    if (!ar->busy && !ar->closed)
+    {
+        rc = uv_read_start(ar->stream, api__alloc_cb, api__data_cb);
+        if (rc)
+        {
+            log_error("cannot read HTTP API request: `%s`", uv_strerror(rc));
+            api__close(ar);
+        }
+    }
+}
+
 static void api__data_cb(
         uv_stream_t * uvstream,
         ssize_t n,
         const uv_buf_t * buf)
 {
-    size_t parsed;
     siri_api_request_t * ar = uvstream->data;
 
-    if (!ar->ref)
-        goto done;
+    if (!ar->ref || ar->closed)
+        return;
 
     if (n < 0)
     {
         if (n != UV_EOF)
             log_error(uv_strerror(n));
 
-        sirinet_stream_decref(ar);
-        goto done;
+        api__close(ar);
+        return;
     }
 
     buf->base[HTTP_MAX_HEADER_SIZE-1] = '\0';
 
-    parsed = http_parser_execute(
-            &ar->parser,
-            &api__settings,
-            buf->base, n);
+    ar->rpos = 0;
+    ar->rlen = (size_t) n;
 
-    if (ar->parser.upgrade)
-    {
-        /* TODO: do we need to do something? */
-        log_debug("upgrade to a new protocol");
-    }
-    else if (parsed != (size_t) n)
-    {
-        log_warning("error parsing HTTP API request");
-        sirinet_stream_decref(ar);
-    }
+    api__parse(ar);
+}
+
+static siri_api_header_t api__insert_check(
+        http_parser * parser,
+        siri_api_request_t * ar)
+{
+    if (parser->method != HTTP_POST)
+        return E405_METHOD_NOT_ALLOWED;
 
-done:
-     free(buf->base);
+    if (!ar->siridb)
+        return E404_NOT_FOUND;
+
+    if (!ar->origin)
+        return E401_UNAUTHORIZED;
+
+    if (!(((siridb_user_t *) ar->origin)->access_bit & SIRIDB_ACCESS_INSERT))
+        return E403_FORBIDDEN;
+
+    if ((
+            ar->siridb->server->flags != SERVER_FLAG_RUNNING &&
+            ar->siridb->server->flags != SERVER_FLAG_RUNNING + SERVER_FLAG_REINDEXING
+        ) ||
+        !siridb_pools_accessible(ar->siridb))
+        return E503_SERVICE_UNAVAILABLE;
+
+    return E200_OK;
 }
 
 static int api__headers_complete_cb(http_parser * parser)
@@ -195,6 +345,19 @@ static int api__headers_complete_cb(http_parser * parser)
     siri_api_request_t * ar = parser->data;
 
     assert (!ar->buf);
+    assert (!ar->ijson);
+
+    /*
+     * JSON inserts are parsed while the body is received so the body does
+     * not need to be buffered. A failed allocation falls back to buffering.
+     */
+    if (ar->request_type == SIRI_API_RT_INSERT &&
+        ar->content_type == SIRI_API_CT_JSON &&
+        api__insert_check(parser, ar) == E200_OK &&
+        (ar->ijson = siridb_ijson_new(
+                ar->siridb,
+                (sirinet_stream_t *) ar)) != NULL)
+        return 0;
 
     if (parser->content_length != ULLONG_MAX)
     {
@@ -290,6 +453,16 @@ static int api__url_cb(http_parser * parser, const char * at, size_t n)
         ar->request_type = SIRI_APT_RT_SERVICE;
         ar->service_type = SERVICE_GET_DATABASES;
     }
+    else if (API__CMP_WITH(at, n, "/set-profiler"))
+    {
+        ar->request_type = SIRI_APT_RT_SERVICE;
+        ar->service_type = SERVICE_SET_PROFILER;
+    }
+    else if (API__CMP_WITH(at, n, "/get-profiler"))
+    {
+        ar->request_type = SIRI_APT_RT_SERVICE;
+        ar->service_type = SERVICE_GET_PROFILER;
+    }
     return 0;
 }
 
@@ -337,6 +510,10 @@ static void api__connection_cb(uv_stream_t * server, int status)
         return;
     }
 
+    /* pipelined responses are small writes which should not wait for the
+     * acknowledgement of the previous response (Nagle) */
+    (void) uv_tcp_nodelay((uv_tcp_t *) ar->stream, 1);
+
     http_parser_init(&ar->parser, HTTP_REQUEST);
 
     rc = uv_read_start(ar->stream, api__alloc_cb, api__data_cb);
@@ -364,6 +541,29 @@ static int api__on_content_type(siri_api_request_t * ar, const char * at, size_t
         return 0;
     }
 
+    /* allow a charset, for example `text/csv; charset=utf-8` */
+    if (api__istarts_with(
+            &at,
+            &n,
+            api__content_type[SIRI_API_CT_CSV],
+            strlen(api__content_type[SIRI_API_CT_CSV])) &&
+        (n == 0 || *at == ';'))
+    {
+        ar->content_type = SIRI_API_CT_CSV;
+        return 0;
+    }
+
+    if (api__istarts_with(
+            &at,
+            &n,
+            api__content_type[SIRI_API_CT_LINE],
+            strlen(api__content_type[SIRI_API_CT_LINE])) &&
+        (n == 0 || *at == ';'))
+    {
+        ar->content_type = SIRI_API_CT_LINE;
+        return 0;
+    }
+
     /* invalid content type */
     log_debug("unsupported content-type: %.*s", (int) n, at);
     return 0;
@@ -424,6 +624,13 @@ static int api__body_cb(http_parser * parser, const char * at, size_t n)
     size_t offset;
     siri_api_request_t * ar = parser->data;
 
+    if (ar->ijson)
+    {
+        /* errors are handled when the message is complete */
+        (void) siridb_ijson_parse(ar->ijson, at, n);
+        return 0;
+    }
+
     if (!n || !ar->len)
         return 0;
 
@@ -436,6 +643,7 @@ static int api__body_cb(http_parser * parser, const char * at, size_t n)
 
 static void api__write_cb(uv_write_t * req, int status)
 {
+    siri_api_write_t * w = (siri_api_write_t *) req;
     siri_api_request_t * ar = req->handle->data;
 
     if (status)
@@ -443,44 +651,81 @@ static void api__write_cb(uv_write_t * req, int status)
                 "error writing HTTP API response: `%s`",
                 uv_strerror(status));
 
-    /* reset the API to support multiple request on the same connection */
-    api__reset(ar);
+    free(w->data);
+    w->data = NULL;
 
-    /* Resume parsing */
-    http_parser_pause(&ar->parser, 0);
+    /* keep the write request for the next response */
+    w->next = ar->wfree;
+    ar->wfree = w;
 
+    /* release the reference of the request */
     sirinet_stream_decref(ar);
 }
 
-static int api__plain_response(
+/*
+ * Queue the response for the current request. The response is written from
+ * `body` and `data` is freed when written. (data may be NULL)
+ *
+ * Returns 0 if successful or -1 when the connection is closed.
+ */
+static int api__write(
         siri_api_request_t * ar,
-        const siri_api_header_t ht)
+        const siri_api_header_t ht,
+        const siri_api_content_t ct,
+        const char * body,
+        size_t size,
+        void * data)
 {
-    const char * body = api__default_body[ht];
-    char header[API__HEADER_MAX_SZ];
-    size_t body_size;
-    int header_size;
+    int rc, header_size;
+    siri_api_write_t * w = ar->wfree;
 
-    body_size = strlen(body);
-    header_size = api__header(header, ht, SIRI_API_CT_TEXT, body_size);
-
-    if (header_size > 0)
+    if (w != NULL)
+    {
+        ar->wfree = w->next;
+    }
+    else if ((w = malloc(sizeof(siri_api_write_t))) == NULL)
     {
-        uv_buf_t uvbufs[2] = {
-                uv_buf_init(header, (size_t) header_size),
-                uv_buf_init((char *) body, body_size),
-        };
+        ERR_ALLOC
+        free(data);
+        api__close(ar);
+        sirinet_stream_decref(ar);
+        return -1;
+    }
 
-        (void) uv_write(&ar->req, ar->stream, uvbufs, 2, api__write_cb);
-        return 0;
+    w->data = data;
+    header_size = api__header(w->header, ht, ct, size, ar->keep_alive);
+
+    uv_buf_t uvbufs[2] = {
+            uv_buf_init(w->header, (unsigned int) header_size),
+            uv_buf_init((char *) body, size),
+    };
+
+    rc = uv_write(&w->req, ar->stream, uvbufs, 2, api__write_cb);
+    if (rc)
+    {
+        log_error("cannot write HTTP API response: `%s`", uv_strerror(rc));
+        free(data);
+        w->next = ar->wfree;
+        ar->wfree = w;
+        api__close(ar);
+        sirinet_stream_decref(ar);
+        return -1;
     }
-    return -1;
+
+    api__resume(ar);
+    return 0;
 }
 
-static int api__query(siri_api_request_t * ar, api__query_t * q)
+static int api__plain_response(
+        siri_api_request_t * ar,
+        const siri_api_header_t ht)
 {
-    sirinet_stream_incref(ar);
+    const char * body = api__default_body[ht];
+    return api__write(ar, ht, SIRI_API_CT_TEXT, body, strlen(body), NULL);
+}
 
+static int api__query(siri_api_request_t * ar, api__query_t * q)
+{
     siridb_query_run(
                     0,
                     (sirinet_stream_t *) ar,
@@ -572,28 +817,14 @@ static int api__query_from_qp(api__query_t * q, siri_api_request_t * ar)
             : api__query(ar, q);
 }
 
-static int api__insert_from_qp(siri_api_request_t * ar)
+static int api__insert_assigned(
+        siri_api_request_t * ar,
+        siridb_insert_t * insert,
+        ssize_t rc)
 {
-    qp_unpacker_t unpacker;
-    qp_unpacker_init(&unpacker, (unsigned char *) ar->buf, ar->len);
-
-    siridb_insert_t * insert = siridb_insert_new(
-            ar->siridb,
-            0,
-            (sirinet_stream_t *) ar);
-
-    if (insert == NULL)
-    {
-        return api__plain_response(ar, E500_INTERNAL_SERVER_ERROR);
-    }
-
-    ssize_t rc = siridb_insert_assign_pools(
-            ar->siridb,
-            &unpacker,
-            insert->packer);
-
     switch ((siridb_insert_err_t) rc)
     {
+    case ERR_INVALID_TEXT_LINE:
     case ERR_EXPECTING_ARRAY:
     case ERR_EXPECTING_SERIES_NAME:
     case ERR_EXPECTING_MAP_OR_ARRAY:
@@ -608,9 +839,6 @@ static int api__insert_from_qp(siri_api_request_t * ar)
             /* something went wrong, get correct err message */
             const char * err_msg = siridb_insert_err_msg(rc);
 
-            log_error("Insert error: '%s' at position %lu",
-                    err_msg, unpacker.pt -  (unsigned char *) ar->buf);
-
             /* create and send package */
             sirinet_pkg_t * package = sirinet_pkg_err(
                     0,
@@ -623,6 +851,10 @@ static int api__insert_from_qp(siri_api_request_t * ar)
                 /* ignore result code, signal can be raised */
                 sirinet_pkg_send((sirinet_stream_t *) ar, package);
             }
+            else
+            {
+                (void) api__plain_response(ar, E500_INTERNAL_SERVER_ERROR);
+            }
         }
 
         /* error, free insert */
@@ -634,47 +866,128 @@ static int api__insert_from_qp(siri_api_request_t * ar)
         {
             siridb_insert_free(insert);  /* signal is raised */
         }
-        else
-        {
-            /* extra increment for the insert task */
-            sirinet_stream_incref(ar);
-        }
         break;
     }
     return 0;
 }
 
-static int api__insert_cb(http_parser * parser)
+static int api__insert_from_qp(siri_api_request_t * ar)
 {
-    siri_api_request_t * ar = parser->data;
+    qp_unpacker_t unpacker;
+    qp_unpacker_init(&unpacker, (unsigned char *) ar->buf, ar->len);
 
-    if (parser->method != HTTP_POST)
-        return api__plain_response(ar, E405_METHOD_NOT_ALLOWED);
+    siridb_insert_t * insert = siridb_insert_new(
+            ar->siridb,
+            0,
+            (sirinet_stream_t *) ar);
 
-    if (!ar->siridb)
-        return api__plain_response(ar, E404_NOT_FOUND);
+    if (insert == NULL)
+    {
+        return api__plain_response(ar, E500_INTERNAL_SERVER_ERROR);
+    }
 
-    if (!ar->origin)
-        return api__plain_response(ar, E401_UNAUTHORIZED);
+    ssize_t rc = siridb_insert_assign_pools(
+            ar->siridb,
+            &unpacker,
+            insert->packer,
+            insert->ibatch);
+
+    if (rc < 0)
+    {
+        log_error("Insert error: '%s' at position %lu",
+                siridb_insert_err_msg(rc),
+                unpacker.pt -  (unsigned char *) ar->buf);
+    }
 
+    return api__insert_assigned(ar, insert, rc);
+}
 
-    if (!(((siridb_user_t *) ar->origin)->access_bit & SIRIDB_ACCESS_INSERT))
-        return api__plain_response(ar, E403_FORBIDDEN);
+static int api__insert_from_text(siri_api_request_t * ar, int fmt)
+{
+    size_t line = 0;
+    ssize_t rc;
+    siridb_insert_t * insert;
 
-    if ((
-            ar->siridb->server->flags != SERVER_FLAG_RUNNING &&
-            ar->siridb->server->flags != SERVER_FLAG_RUNNING + SERVER_FLAG_REINDEXING
-        ) ||
-        !siridb_pools_accessible(ar->siridb))
+    /* the response for a text insert is written in JSON */
+    ar->content_type = SIRI_API_CT_JSON;
+
+    insert = siridb_insert_new(ar->siridb, 0, (sirinet_stream_t *) ar);
+    if (insert == NULL)
+    {
+        return api__plain_response(ar, E500_INTERNAL_SERVER_ERROR);
+    }
+
+    rc = siridb_insert_assign_text(
+            ar->siridb,
+            fmt,
+            ar->buf,
+            ar->len,
+            insert->packer,
+            insert->ibatch,
+            &line);
+
+    if (rc < 0)
+    {
+        log_error("Insert error: '%s' at line %zu",
+                siridb_insert_err_msg(rc),
+                line);
+    }
+
+    return api__insert_assigned(ar, insert, rc);
+}
+
+static int api__insert_from_ijson(siri_api_request_t * ar)
+{
+    siridb_ijson_t * ijson = ar->ijson;
+    siridb_insert_t * insert;
+    ssize_t rc = siridb_ijson_complete(ijson);
+
+    if (ijson->flags & IJSON_FLAG_INVALID)
+    {
+        api__free_ijson(ar);
+        return api__plain_response(ar, E400_BAD_REQUEST);
+    }
+
+    if (ijson->flags & IJSON_FLAG_CHANGED)
+    {
+        api__free_ijson(ar);
         return api__plain_response(ar, E503_SERVICE_UNAVAILABLE);
+    }
+
+    if (rc < 0)
+    {
+        log_error("Insert error: '%s'", siridb_insert_err_msg(rc));
+    }
+
+    /* take the insert from the parser */
+    insert = ijson->insert;
+    ijson->insert = NULL;
+    api__free_ijson(ar);
+
+    return api__insert_assigned(ar, insert, rc);
+}
+
+static int api__insert_cb(http_parser * parser)
+{
+    siri_api_request_t * ar = parser->data;
+    siri_api_header_t ht = api__insert_check(parser, ar);
+
+    if (ht != E200_OK)
+        return api__plain_response(ar, ht);
 
     switch (ar->content_type)
     {
     case SIRI_API_CT_TEXT:
-        /* Or, shall we allow text and return we some sort of CSV format? */
         break;
+    case SIRI_API_CT_LINE:
+        return api__insert_from_text(ar, ITEXT_FMT_LINE);
+    case SIRI_API_CT_CSV:
+        return api__insert_from_text(ar, ITEXT_FMT_CSV);
     case SIRI_API_CT_JSON:
     {
+        if (ar->ijson)
+            return api__insert_from_ijson(ar);
+
         char * dst;
         size_t dst_n;
         if (qpjson_json_to_qp(ar->buf, ar->len, &dst, &dst_n))
@@ -708,6 +1021,8 @@ static int api__query_cb(http_parser * parser)
     switch (ar->content_type)
     {
     case SIRI_API_CT_TEXT:
+    case SIRI_API_CT_CSV:
+    case SIRI_API_CT_LINE:
         /* Or, shall we allow text and return we some sort of CSV format? */
         break;
     case SIRI_API_CT_JSON:
@@ -746,6 +1061,7 @@ static int api__service_cb(http_parser * parser)
     case SERVICE_NEW_POOL:
     case SERVICE_NEW_REPLICA:
     case SERVICE_DROP_DATABASE:
+    case SERVICE_SET_PROFILER:
         if (parser->method != HTTP_POST)
             return api__plain_response(ar, E405_METHOD_NOT_ALLOWED);
         break;
@@ -753,6 +1069,7 @@ static int api__service_cb(http_parser * parser)
     case SERVICE_GET_VERSION:
     case SERVICE_GET_ACCOUNTS:
     case SERVICE_GET_DATABASES:
+    case SERVICE_GET_PROFILER:
         if (parser->method != HTTP_GET)
             return api__plain_response(ar, E405_METHOD_NOT_ALLOWED);
         break;
@@ -764,6 +1081,8 @@ static int api__service_cb(http_parser * parser)
     switch (ar->content_type)
     {
     case SIRI_API_CT_TEXT:
+    case SIRI_API_CT_CSV:
+    case SIRI_API_CT_LINE:
         if (ar->len)
             return api__plain_response(ar, E415_UNSUPPORTED_MEDIA_TYPE);
         ar->content_type = SIRI_API_CT_JSON;
@@ -795,12 +1114,9 @@ static int api__service_cb(http_parser * parser)
             err_msg);
 
     if (res == CPROTO_DEFERRED)
-    {
-        sirinet_stream_incref(ar);
-    }
+        return 0;
 
     package =
-            (res == CPROTO_DEFERRED) ? NULL :
             (res == CPROTO_ERR_SERVICE) ? sirinet_pkg_err(
                     0,
                     strlen(err_msg),
@@ -811,7 +1127,9 @@ static int api__service_cb(http_parser * parser)
                     0,
                     res) : sirinet_pkg_new(0, 0, res, NULL);
 
-    return package ? sirinet_pkg_send((sirinet_stream_t *) ar, package) : 0;
+    return package
+            ? sirinet_pkg_send((sirinet_stream_t *) ar, package)
+            : api__plain_response(ar, E500_INTERNAL_SERVER_ERROR);
 }
 
 static int api__message_complete_cb(http_parser * parser)
@@ -822,9 +1140,16 @@ static int api__message_complete_cb(http_parser * parser)
      * This is required since SiriDB will handle queries and inserts
      * asynchronously and SiriDB must be sure that the request does not
      * change during this time. It is also important to write the responses
-     * in order and this solves both issues. */
+     * in order and this solves both issues. The parser resumes with the
+     * next pipelined request when the response is queued. */
     http_parser_pause(&ar->parser, 1);
 
+    ar->busy = true;
+    ar->keep_alive = http_should_keep_alive(parser);
+
+    /* the request holds a reference until the response is written */
+    sirinet_stream_incref(ar);
+
     switch(ar->request_type)
     {
     case SIRI_API_RT_NONE:
@@ -840,33 +1165,13 @@ static int api__message_complete_cb(http_parser * parser)
     return api__plain_response(ar, E500_INTERNAL_SERVER_ERROR);
 }
 
-static void api__write_free_cb(uv_write_t * req, int status)
-{
-    free(req->data);
-    api__write_cb(req, status);
-}
-
 static int api__close_resp(
         siri_api_request_t * ar,
         const siri_api_header_t ht,
         void * data,
         size_t size)
 {
-    char header[API__HEADER_MAX_SZ];
-    int header_size = 0;
-
-    header_size = api__header(header, ht, ar->content_type, size);
-
-    uv_buf_t uvbufs[2] = {
-            uv_buf_init(header, (unsigned int) header_size),
-            uv_buf_init(data, size),
-    };
-
-    /* bind response to request to we can free in the callback */
-    ar->req.data = data;
-
-    uv_write(&ar->req, ar->stream, uvbufs, 2, api__write_free_cb);
-    return 0;
+    return api__write(ar, ht, ar->content_type, data, size, data);
 }
 
 int siri_api_init(void)
@@ -1012,3 +1317,21 @@ int siri_api_send(
 
     return api__close_resp(ar, ht, data, n);
 }
+
+/*
+ * Destroy the API specific data of a connection. This is called when the
+ * connection is closed.
+ */
+void siri_api_free(siri_api_request_t * ar)
+{
+    siri_api_write_t * w;
+
+    api__free_ijson(ar);
+    free(ar->rbuf);
+
+    while ((w = ar->wfree) != NULL)
+    {
+        ar->wfree = w->next;
+        free(w);
+    }
+}
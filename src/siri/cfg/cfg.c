@@ -32,6 +32,8 @@ static siri_cfg_t siri_cfg = {
         .pipe_support=0,
         .pipe_client_name="siridb_client.sock",
         .buffer_sync_interval=0,
+        .aggregate_cache_size=0,
+        .slow_query_threshold=0,
         .ignore_broken_data=0
 };
 
@@ -162,6 +164,20 @@ void siri_cfg_init(siri_t * siri)
             &tmp);
     siri_cfg.buffer_sync_interval = (uint32_t) tmp;
 
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "aggregate_cache_size",
+            0,
+            65536,
+            &siri_cfg.aggregate_cache_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "slow_query_threshold",
+            0,
+            3600000,
+            &siri_cfg.slow_query_threshold);
+
     SIRI_CFG_ignore_broken_data(cfgparser);
 
     cfgparser_free(cfgparser);
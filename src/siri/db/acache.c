@@ -0,0 +1,365 @@
+/*
+ * acache.c - Cache for aggregated points in closed time windows.
+ */
+#include <assert.h>
+#include <logger/logger.h>
+#include <siri/db/acache.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+static siridb_acache_entry_t * ACACHE_find(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t a,
+        uint64_t b);
+static void ACACHE_drop(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry);
+static void ACACHE_unlink(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry);
+static void ACACHE_push(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_acache_t * siridb_acache_new(size_t max_size)
+{
+    siridb_acache_t * acache = malloc(sizeof(siridb_acache_t));
+    if (acache == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    acache->series = imap_new();
+    if (acache->series == NULL)
+    {
+        ERR_ALLOC
+        free(acache);
+        return NULL;
+    }
+
+    acache->generation = 0;
+    acache->size = 0;
+    acache->max_size = max_size;
+    acache->hits = 0;
+    acache->misses = 0;
+    acache->head = NULL;
+    acache->tail = NULL;
+
+    return acache;
+}
+
+/*
+ * Destroy the aggregate cache. (parsing NULL is not allowed)
+ */
+void siridb_acache_free(siridb_acache_t * acache)
+{
+    siridb_acache_entry_t * entry = acache->head;
+    siridb_acache_entry_t * next;
+
+    while (entry != NULL)
+    {
+        next = entry->next;
+        siridb_points_free(entry->points);
+        free(entry);
+        entry = next;
+    }
+
+    imap_free(acache->series, NULL);
+    free(acache);
+}
+
+/*
+ * Calculate the aligned window (a, b] for a select window [start_ts, end_ts)
+ * and a group-by aggregate. The points in [start_ts, a] and (b, end_ts) each
+ * fall in a single group.
+ *
+ * Returns 0 when the aligned window contains at least one complete group or
+ * -1 if not. An aggregate with an offset is not supported since the groups
+ * then depend on the first point in the window.
+ */
+int siridb_acache_window(
+        siridb_aggr_t * aggr,
+        uint64_t start_ts,
+        uint64_t end_ts,
+        uint64_t * a,
+        uint64_t * b)
+{
+    uint64_t group_by = aggr->group_by;
+
+    assert (group_by);
+
+    if (    aggr->offset ||
+            end_ts <= start_ts ||
+            start_ts > UINT64_MAX - group_by)
+    {
+        return -1;
+    }
+
+    *a = (start_ts + group_by - 1) / group_by * group_by;
+    *b = (end_ts - 1) / group_by * group_by;
+
+    return (*b > *a) ? 0 : -1;
+}
+
+/*
+ * Returns the cached points for window (a, b] or NULL when not found. The
+ * points are owned by the cache and are valid until the next cache call.
+ */
+siridb_points_t * siridb_acache_get(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t a,
+        uint64_t b)
+{
+    siridb_acache_entry_t * entry;
+
+    entry = ACACHE_find(acache, series_id, aggr, a, b);
+    if (entry == NULL)
+    {
+        acache->misses++;
+        return NULL;
+    }
+
+    if (entry->generation != siridb_acache_generation(acache))
+    {
+        /* a shard was dropped after the entry was created */
+        ACACHE_drop(acache, entry);
+        acache->misses++;
+        return NULL;
+    }
+
+    acache->hits++;
+
+    ACACHE_unlink(acache, entry);
+    ACACHE_push(acache, entry);
+
+    return entry->points;
+}
+
+/*
+ * Add a copy of the aggregated points in window (a, b] to the cache. The
+ * given points may contain points outside the window, these are ignored.
+ * Only integer and double points are supported.
+ *
+ * The generation must be read using siridb_acache_generation() before the
+ * points were read so points from a dropped shard are never cached.
+ *
+ * Returns 0 if the points are added or -1 if not. (no signal is raised since
+ * the cache is not critical)
+ */
+int siridb_acache_put(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t a,
+        uint64_t b,
+        siridb_points_t * points,
+        uint32_t generation)
+{
+    siridb_acache_entry_t * entry;
+    siridb_point_t * first = points->data;
+    siridb_point_t * last = points->data + points->len;
+    size_t len, size;
+
+    if (    points->tp == TP_STRING ||
+            ACACHE_find(acache, series_id, aggr, a, b) != NULL)
+    {
+        return -1;
+    }
+
+    /* the time-stamp of an aggregated point is the end of the group */
+    for (; first < last && first->ts <= a; first++);
+    for (; last > first && (last - 1)->ts > b; last--);
+
+    len = last - first;
+    size =  sizeof(siridb_acache_entry_t) +
+            sizeof(siridb_points_t) +
+            sizeof(siridb_point_t) * len;
+
+    if (size > acache->max_size)
+    {
+        return -1;
+    }
+
+    entry = malloc(sizeof(siridb_acache_entry_t));
+    if (entry == NULL)
+    {
+        return -1;
+    }
+
+    entry->points = siridb_points_new(len, points->tp);
+    if (entry->points == NULL)
+    {
+        free(entry);
+        return -1;
+    }
+
+    if (len)
+    {
+        memcpy(entry->points->data, first, sizeof(siridb_point_t) * len);
+    }
+    entry->points->len = len;
+
+    entry->series_id = series_id;
+    entry->gid = aggr->gid;
+    entry->generation = generation;
+    entry->group_by = aggr->group_by;
+    entry->timespan = aggr->timespan;
+    entry->percentile = aggr->percentile;
+    entry->a = a;
+    entry->b = b;
+    entry->size = size;
+    entry->sprev = NULL;
+    entry->snext = imap_get(acache->series, series_id);
+
+    if (imap_set(acache->series, series_id, entry) < 0)
+    {
+        siridb_points_free(entry->points);
+        free(entry);
+        return -1;
+    }
+
+    if (entry->snext != NULL)
+    {
+        entry->snext->sprev = entry;
+    }
+
+    ACACHE_push(acache, entry);
+    acache->size += size;
+
+    while (acache->size > acache->max_size)
+    {
+        ACACHE_drop(acache, acache->tail);
+    }
+
+    return 0;
+}
+
+/*
+ * Drop all entries for a series where the window overlaps with
+ * [first_ts, last_ts].
+ */
+void siridb_acache_invalidate(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        uint64_t first_ts,
+        uint64_t last_ts)
+{
+    siridb_acache_entry_t * entry = imap_get(acache->series, series_id);
+    siridb_acache_entry_t * next;
+
+    for (; entry != NULL; entry = next)
+    {
+        next = entry->snext;
+        if (first_ts <= entry->b && last_ts > entry->a)
+        {
+            ACACHE_drop(acache, entry);
+        }
+    }
+}
+
+static siridb_acache_entry_t * ACACHE_find(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t a,
+        uint64_t b)
+{
+    siridb_acache_entry_t * entry = imap_get(acache->series, series_id);
+
+    for (; entry != NULL; entry = entry->snext)
+    {
+        if (    entry->a == a &&
+                entry->b == b &&
+                entry->gid == aggr->gid &&
+                entry->group_by == aggr->group_by &&
+                entry->timespan == aggr->timespan &&
+                entry->percentile == aggr->percentile)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Remove and destroy an entry.
+ */
+static void ACACHE_drop(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry)
+{
+    if (entry->sprev != NULL)
+    {
+        entry->sprev->snext = entry->snext;
+    }
+    else if (entry->snext != NULL)
+    {
+        (void) imap_set(acache->series, entry->series_id, entry->snext);
+    }
+    else
+    {
+        (void) imap_pop(acache->series, entry->series_id);
+    }
+
+    if (entry->snext != NULL)
+    {
+        entry->snext->sprev = entry->sprev;
+    }
+
+    ACACHE_unlink(acache, entry);
+    acache->size -= entry->size;
+
+    siridb_points_free(entry->points);
+    free(entry);
+}
+
+static void ACACHE_unlink(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry)
+{
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        acache->head = entry->next;
+    }
+
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        acache->tail = entry->prev;
+    }
+}
+
+static void ACACHE_push(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry)
+{
+    entry->prev = NULL;
+    entry->next = acache->head;
+
+    if (acache->head != NULL)
+    {
+        acache->head->prev = entry;
+    }
+    else
+    {
+        acache->tail = entry;
+    }
+
+    acache->head = entry;
+}
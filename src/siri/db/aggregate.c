@@ -6,12 +6,15 @@
 #include <logger/logger.h>
 #include <siri/db/aggregate.h>
 #include <siri/db/median.h>
+#include <siri/db/ngram.h>
 #include <siri/db/variance.h>
 #include <siri/grammar/grammar.h>
 #include <siri/grammar/gramp.h>
 #include <siri/db/re.h>
+#include <siri/db/tdigest.h>
 #include <vec/vec.h>
 #include <stddef.h>
+#include <string.h>
 #include <xstr/xstr.h>
 #include <math.h>
 
@@ -80,6 +83,15 @@ static siridb_points_t * AGGREGATE_group_by(
         siridb_points_t * source,
         siridb_aggr_t * aggr,
         char * err_msg);
+static int AGGREGATE_group_tp(uint32_t gid, points_tp tp);
+static int AGGREGATE_stream_group(
+        siridb_aggr_stream_t * stream,
+        siridb_points_t * group);
+static int AGGREGATE_stream_keep(
+        siridb_aggr_stream_t * stream,
+        siridb_point_t * data,
+        size_t n);
+static int AGGREGATE_tdigest_cmp(const void * a, const void * b);
 
 static int aggr_count(
         siridb_point_t * point,
@@ -135,6 +147,12 @@ static int aggr_min(
         siridb_aggr_t * aggr,
         char * err_msg);
 
+static int aggr_percentile(
+        siridb_point_t * point,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+
 static int aggr_pvariance(
         siridb_point_t * point,
         siridb_points_t * points,
@@ -192,6 +210,7 @@ void siridb_init_aggregates(void)
     AGGREGATES[CLERI_GID_F_MEDIAN_HIGH - F_OFFSET] = aggr_median_high;
     AGGREGATES[CLERI_GID_F_MEDIAN_LOW - F_OFFSET] = aggr_median_low;
     AGGREGATES[CLERI_GID_F_MIN - F_OFFSET] = aggr_min;
+    AGGREGATES[CLERI_GID_F_PERCENTILE - F_OFFSET] = aggr_percentile;
     AGGREGATES[CLERI_GID_F_PVARIANCE - F_OFFSET] = aggr_pvariance;
     AGGREGATES[CLERI_GID_F_SUM - F_OFFSET] = aggr_sum;
     AGGREGATES[CLERI_GID_F_VARIANCE - F_OFFSET] = aggr_variance;
@@ -414,6 +433,46 @@ vec_t * siridb_aggregate_list(cleri_children_t * children, char * err_msg)
 
             break;
 
+        case CLERI_GID_F_PERCENTILE:
+            AGGR_NEW
+            {
+                cleri_node_t * pnode = cleri_gn(cleri_gn(children)->children);
+
+                aggr->percentile = xstr_to_double(
+                        cleri_gn(pnode->children->next->next)->str);
+
+                if (aggr->percentile < 0.0 || aggr->percentile > 100.0)
+                {
+                    sprintf(err_msg,
+                            "Percentile must be a value between 0 and 100.");
+                    AGGREGATE_free(aggr);
+                    siridb_aggregate_list_free(vec);
+                    return NULL;
+                }
+
+                if (pnode->children->next->next->next->next != NULL)
+                {
+                    /* result is always positive, checked earlier */
+                    aggr->group_by = CLERI_NODE_DATA(cleri_gn(cleri_gn(
+                            cleri_gn(pnode->children->next->next->next)
+                            ->children)->children->next));
+
+                    if (!aggr->group_by)
+                    {
+                        sprintf(err_msg,
+                                "Group by time must be an integer value "
+                                "larger than zero.");
+                        AGGREGATE_free(aggr);
+                        siridb_aggregate_list_free(vec);
+                        return NULL;
+                    }
+                }
+            }
+
+            VEC_APPEND
+
+            break;
+
         case CLERI_GID_F_DIFFERENCE:
         case CLERI_GID_F_COUNT:
         case CLERI_GID_F_MAX:
@@ -553,6 +612,324 @@ siridb_points_t * siridb_aggregate_run(
     return NULL;
 }
 
+/*
+ * Returns 1 when the aggregate can be used with a stream, which is the case
+ * for aggregates with a group by and without a limit. Such an aggregate only
+ * needs the points of one group at a time.
+ */
+int siridb_aggregate_can_stream(siridb_aggr_t * aggr)
+{
+    return aggr->group_by && !aggr->limit &&
+            AGGREGATE_group_tp(aggr->gid, TP_INT) != -1;
+}
+
+/*
+ * Initialize a stream which aggregates numeric points which are fed in order
+ * of time.
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error.
+ */
+int siridb_aggregate_stream_init(
+        siridb_aggr_stream_t * stream,
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        char * err_msg)
+{
+    assert (tp != TP_STRING);
+    assert (siridb_aggregate_can_stream(aggr));
+
+    stream->aggr = aggr;
+    stream->err_msg = err_msg;
+    stream->n = 0;
+    stream->size = AGGREGATE_STREAM_SZ;
+    stream->group_size = AGGREGATE_STREAM_SZ;
+    stream->points = siridb_points_new(
+            stream->size,
+            (points_tp) AGGREGATE_group_tp(aggr->gid, tp));
+    stream->group = siridb_points_new(stream->group_size, tp);
+
+    if (stream->points == NULL || stream->group == NULL)
+    {
+        siridb_aggregate_stream_destroy(stream);
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Feed the next points to a stream. The points must be newer than points
+ * which are fed before. Complete groups are aggregated and the points of the
+ * last group are kept until the group is complete, so the points can be
+ * re-used after this call. (the points might be re-ordered by an aggregate)
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+int siridb_aggregate_stream_feed(
+        siridb_aggr_stream_t * stream,
+        siridb_points_t * points)
+{
+    siridb_aggr_t * aggr = stream->aggr;
+    siridb_points_t group;
+    size_t start, end;
+
+    if (!points->len)
+    {
+        return 0;
+    }
+
+    stream->n += points->len;
+    group.tp = points->tp;
+
+    if (!stream->group->len)
+    {
+        stream->group_ts = GROUP_TS(points->data);
+    }
+
+    for (start = end = 0; end < points->len; end++)
+    {
+        if ((points->data + end)->ts > stream->group_ts)
+        {
+            if (stream->group->len)
+            {
+                if (AGGREGATE_stream_keep(
+                        stream,
+                        points->data + start,
+                        end - start) ||
+                    AGGREGATE_stream_group(stream, stream->group))
+                {
+                    return -1;
+                }
+                stream->group->len = 0;
+            }
+            else
+            {
+                group.data = points->data + start;
+                group.len = end - start;
+                if (AGGREGATE_stream_group(stream, &group))
+                {
+                    return -1;
+                }
+            }
+            start = end;
+            stream->group_ts = GROUP_TS((points->data + end));
+        }
+    }
+
+    return AGGREGATE_stream_keep(stream, points->data + start, end - start);
+}
+
+/*
+ * Aggregate the last group and returns the aggregated points. The stream is
+ * destroyed, also when an error has occurred.
+ *
+ * Returns NULL in case of an error. (err_msg is set)
+ */
+siridb_points_t * siridb_aggregate_stream_finish(siridb_aggr_stream_t * stream)
+{
+    siridb_points_t * points;
+
+    if (stream->group->len &&
+        AGGREGATE_stream_group(stream, stream->group))
+    {
+        siridb_aggregate_stream_destroy(stream);
+        return NULL;
+    }
+
+    points = stream->points;
+    if (points->len < stream->size &&
+        siridb_points_resize(points, points->len))
+    {
+        /* not critical */
+        log_error("Re-allocation points failed.");
+    }
+
+    stream->points = NULL;
+    siridb_aggregate_stream_destroy(stream);
+
+    return points;
+}
+
+/*
+ * Destroy a stream without aggregating the last group.
+ */
+void siridb_aggregate_stream_destroy(siridb_aggr_stream_t * stream)
+{
+    if (stream->points != NULL)
+    {
+        siridb_points_free(stream->points);
+        stream->points = NULL;
+    }
+    if (stream->group != NULL)
+    {
+        siridb_points_free(stream->group);
+        stream->group = NULL;
+    }
+}
+
+/*
+ * Returns 1 (true) if the merge aggregation list starts with percentile(). In
+ * that case pools send t-digests instead of points.
+ */
+int siridb_aggregate_use_tdigest(vec_t * alist)
+{
+    return alist != NULL && alist->len &&
+            ((siridb_aggr_t *) alist->data[0])->gid == CLERI_GID_F_PERCENTILE;
+}
+
+/*
+ * Append a t-digest for each group of the percentile aggregation to a list.
+ * Without a group by, one digest is appended with the last time-stamp.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+int siridb_aggregate_tdigests(
+        vec_t ** tdigests,
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_tdigest_t * tdigest;
+    siridb_points_t group;
+    uint64_t goup_ts;
+    size_t start, end;
+
+    assert (aggr->gid == CLERI_GID_F_PERCENTILE);
+
+    if (source->tp == TP_STRING)
+    {
+        sprintf(err_msg, "Cannot use percentile() on string type.");
+        return -1;
+    }
+
+    group.tp = source->tp;
+
+    for (start = end = 0; start < source->len; start = end)
+    {
+        if (aggr->group_by)
+        {
+            goup_ts = GROUP_TS((source->data + start));
+            end = start + 1;
+            while (end < source->len && source->data[end].ts <= goup_ts)
+            {
+                end++;
+            }
+        }
+        else
+        {
+            end = source->len;
+            goup_ts = source->data[end - 1].ts;
+        }
+
+        group.data = source->data + start;
+        group.len = end - start;
+
+        tdigest = siridb_tdigest_from_points(&group, goup_ts);
+        if (tdigest == NULL || vec_append_safe(tdigests, tdigest))
+        {
+            siridb_tdigest_free(tdigest);
+            sprintf(err_msg, "Memory allocation error.");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Merge the t-digests with equal time-stamps, or all t-digests without a
+ * group by. The list is sorted by time-stamp and the merged t-digests are
+ * freed.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+int siridb_aggregate_tdigests_reduce(
+        vec_t * tdigests,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_tdigest_t * tdigest, * next;
+    size_t i, n = 0;
+
+    qsort(tdigests->data,
+            tdigests->len,
+            sizeof(void *),
+            AGGREGATE_tdigest_cmp);
+
+    for (i = 0; i < tdigests->len; i++)
+    {
+        next = tdigests->data[i];
+
+        if (n && (!aggr->group_by ||
+                ((siridb_tdigest_t *) tdigests->data[n - 1])->ts == next->ts))
+        {
+            tdigest = siridb_tdigest_merge(tdigests->data[n - 1], next);
+            if (tdigest == NULL)
+            {
+                /* keep the list valid so the caller can free the digests */
+                memmove(tdigests->data + n,
+                        tdigests->data + i,
+                        (tdigests->len - i) * sizeof(void *));
+                tdigests->len = n + tdigests->len - i;
+                sprintf(err_msg, "Memory allocation error.");
+                return -1;
+            }
+            siridb_tdigest_free(tdigests->data[n - 1]);
+            siridb_tdigest_free(next);
+            tdigests->data[n - 1] = tdigest;
+        }
+        else
+        {
+            tdigests->data[n++] = next;
+        }
+    }
+
+    tdigests->len = n;
+
+    return 0;
+}
+
+/*
+ * Returns the percentiles of the reduced t-digests as new points or NULL in
+ * case of an error. (err_msg is set)
+ */
+siridb_points_t * siridb_aggregate_tdigests_points(
+        vec_t * tdigests,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_tdigest_t * tdigest;
+    siridb_points_t * points;
+    siridb_point_t * point;
+    size_t i;
+
+    if (siridb_aggregate_tdigests_reduce(tdigests, aggr, err_msg))
+    {
+        return NULL;
+    }
+
+    points = siridb_points_new(tdigests->len, TP_DOUBLE);
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;
+    }
+
+    for (i = 0; i < tdigests->len; i++)
+    {
+        tdigest = tdigests->data[i];
+        point = points->data + i;
+        point->ts = tdigest->ts;
+        point->val.real = siridb_tdigest_quantile(
+                tdigest,
+                aggr->percentile / 100.0);
+    }
+    points->len = tdigests->len;
+
+    return points;
+}
+
 /*
  * Returns NULL in case an error has occurred.
  */
@@ -568,8 +945,10 @@ static siridb_aggr_t * AGGREGATE_new(uint32_t gid)
     aggr->limit = 0;
     aggr->offset = 0;
     aggr->timespan = 1.0;
+    aggr->percentile = 0.0;
     aggr->regex = NULL;
     aggr->match_data = NULL;
+    aggr->ngram = NULL;
     aggr->filter_via.raw = NULL;
     aggr->filter_tp = TP_INT;  /* when string we must cleanup more */
     return aggr;
@@ -585,6 +964,7 @@ static void AGGREGATE_free(siridb_aggr_t * aggr)
         free(aggr->filter_via.raw);
         pcre2_code_free(aggr->regex);
         pcre2_match_data_free(aggr->match_data);
+        siridb_ngram_query_free(aggr->ngram);
     }
     free(aggr);
 }
@@ -635,6 +1015,12 @@ static int AGGREGATE_init_filter(
         }
         xstr_extract_string(
                 (char *) aggr->filter_via.raw, node->str, node->len);
+
+        /* chunks without the trigrams of the string can be skipped */
+        if (aggr->filter_opr == CEXPR_EQ || aggr->filter_opr == CEXPR_IN)
+        {
+            aggr->ngram = siridb_ngram_query_str(aggr->filter_via.str);
+        }
         return 0;
 
     case CLERI_GID_R_REGEX:
@@ -656,6 +1042,10 @@ static int AGGREGATE_init_filter(
         {
             return -1;  /* error_msg is set */
         }
+        if (aggr->filter_opr == CEXPR_EQ)
+        {
+            aggr->ngram = siridb_ngram_query_regex(node->str, node->len);
+        }
         return 0;
 
     default:
@@ -1071,6 +1461,7 @@ static siridb_points_t * AGGREGATE_to_one(
     {
     case CLERI_GID_F_MEAN:
     case CLERI_GID_F_MEDIAN:
+    case CLERI_GID_F_PERCENTILE:
     case CLERI_GID_F_PVARIANCE:
     case CLERI_GID_F_VARIANCE:
     case CLERI_GID_F_STDDEV:
@@ -1126,6 +1517,7 @@ static siridb_points_t * AGGREGATE_group_by(
     uint64_t max_sz;
     uint64_t goup_ts;
     size_t start, end;
+    int tp;
 
     group.tp = source->tp;
 
@@ -1141,35 +1533,9 @@ static siridb_points_t * AGGREGATE_group_by(
     AGGR_cb aggr_cb = AGGREGATES[aggr->gid - F_OFFSET];
 
     /* create new points with max possible size after re-indexing */
-    switch(aggr->gid)
-    {
-    case CLERI_GID_F_MEAN:
-    case CLERI_GID_F_MEDIAN:
-    case CLERI_GID_F_PVARIANCE:
-    case CLERI_GID_F_VARIANCE:
-    case CLERI_GID_F_STDDEV:
-    case CLERI_GID_F_DERIVATIVE:
-        points = siridb_points_new(max_sz, TP_DOUBLE);
-        break;
-    case CLERI_GID_F_COUNT:
-    case CLERI_GID_F_TIMEVAL:
-    case CLERI_GID_F_INTERVAL:
-        points = siridb_points_new(max_sz, TP_INT);
-        break;
-    case CLERI_GID_F_MEDIAN_HIGH:
-    case CLERI_GID_F_MAX:
-    case CLERI_GID_F_MEDIAN_LOW:
-    case CLERI_GID_F_MIN:
-    case CLERI_GID_F_SUM:
-    case CLERI_GID_F_DIFFERENCE:
-    case CLERI_GID_F_FIRST:
-    case CLERI_GID_F_LAST:
-        points = siridb_points_new(max_sz, group.tp);
-        break;
-    default:
-        assert (0);
-        points = NULL;
-    }
+    tp = AGGREGATE_group_tp(aggr->gid, group.tp);
+    assert (tp != -1);
+    points = siridb_points_new(max_sz, (points_tp) tp);
 
     if (points == NULL)
     {
@@ -1230,6 +1596,115 @@ static siridb_points_t * AGGREGATE_group_by(
     return points;
 }
 
+/*
+ * Returns the type of the points returned by an aggregate with a group by,
+ * or -1 when the aggregate cannot be used with a group by.
+ */
+static int AGGREGATE_group_tp(uint32_t gid, points_tp tp)
+{
+    switch(gid)
+    {
+    case CLERI_GID_F_MEAN:
+    case CLERI_GID_F_MEDIAN:
+    case CLERI_GID_F_PERCENTILE:
+    case CLERI_GID_F_PVARIANCE:
+    case CLERI_GID_F_VARIANCE:
+    case CLERI_GID_F_STDDEV:
+    case CLERI_GID_F_DERIVATIVE:
+        return TP_DOUBLE;
+    case CLERI_GID_F_COUNT:
+    case CLERI_GID_F_TIMEVAL:
+    case CLERI_GID_F_INTERVAL:
+        return TP_INT;
+    case CLERI_GID_F_MEDIAN_HIGH:
+    case CLERI_GID_F_MAX:
+    case CLERI_GID_F_MEDIAN_LOW:
+    case CLERI_GID_F_MIN:
+    case CLERI_GID_F_SUM:
+    case CLERI_GID_F_DIFFERENCE:
+    case CLERI_GID_F_FIRST:
+    case CLERI_GID_F_LAST:
+        return tp;
+    }
+    return -1;
+}
+
+/*
+ * Add the aggregate of a group to the stream points.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+static int AGGREGATE_stream_group(
+        siridb_aggr_stream_t * stream,
+        siridb_points_t * group)
+{
+    siridb_point_t * point;
+
+    if (stream->points->len == stream->size)
+    {
+        if (siridb_points_resize(stream->points, stream->size * 2))
+        {
+            sprintf(stream->err_msg, "Memory allocation error.");
+            return -1;
+        }
+        stream->size *= 2;
+    }
+
+    point = stream->points->data + stream->points->len;
+    point->ts = stream->group_ts;
+
+    if (AGGREGATES[stream->aggr->gid - F_OFFSET](
+            point,
+            group,
+            stream->aggr,
+            stream->err_msg))
+    {
+        return -1;
+    }
+
+    stream->points->len++;
+    return 0;
+}
+
+/*
+ * Keep points of a group which is not complete.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+static int AGGREGATE_stream_keep(
+        siridb_aggr_stream_t * stream,
+        siridb_point_t * data,
+        size_t n)
+{
+    siridb_points_t * group = stream->group;
+
+    if (group->len + n > stream->group_size)
+    {
+        size_t size = stream->group_size * 2;
+        while (size < group->len + n)
+        {
+            size *= 2;
+        }
+        if (siridb_points_resize(group, size))
+        {
+            sprintf(stream->err_msg, "Memory allocation error.");
+            return -1;
+        }
+        stream->group_size = size;
+    }
+
+    memcpy(group->data + group->len, data, n * sizeof(siridb_point_t));
+    group->len += n;
+    return 0;
+}
+
+static int AGGREGATE_tdigest_cmp(const void * a, const void * b)
+{
+    uint64_t ta = (*((siridb_tdigest_t * const *) a))->ts;
+    uint64_t tb = (*((siridb_tdigest_t * const *) b))->ts;
+    return (ta > tb) - (ta < tb);
+}
+
 static int aggr_count(
         siridb_point_t * point,
         siridb_points_t * points,
@@ -1579,6 +2054,38 @@ static int aggr_min(
     return 0;
 }
 
+static int aggr_percentile(
+        siridb_point_t * point,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_tdigest_t * tdigest;
+
+    assert (points->len);
+
+    if (points->tp == TP_STRING)
+    {
+        sprintf(err_msg, "Cannot use percentile() on string type.");
+        return -1;
+    }
+
+    tdigest = siridb_tdigest_from_points(points, 0);
+    if (tdigest == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error in percentile.");
+        return -1;
+    }
+
+    point->val.real = siridb_tdigest_quantile(
+            tdigest,
+            aggr->percentile / 100.0);
+
+    siridb_tdigest_free(tdigest);
+
+    return 0;
+}
+
 static int aggr_pvariance(
         siridb_point_t * point,
         siridb_points_t * points,
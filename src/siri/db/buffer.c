@@ -13,6 +13,8 @@
 #include <siri/siri.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <xpath/xpath.h>
 #include <assert.h>
@@ -29,6 +31,13 @@ static int buffer__create_new(
 static int buffer__use_empty(
         siridb_buffer_t * buffer,
         siridb_series_t * series);
+static int buffer__load_in_place(siridb_t * siridb, FILE * fp);
+static int buffer__compact(
+        siridb_t * siridb,
+        FILE * fp,
+        size_t cur_size,
+        const char * fn,
+        const char * fn_temp);
 static void buffer__migrate_to_new(char * pt, size_t sz);
 static void buffer__init_template(char * template, size_t size);
 
@@ -58,6 +67,9 @@ siridb_buffer_t * siridb_buffer_new(void)
     buffer->path = NULL;
     buffer->size = 0;
     buffer->template = NULL;
+    buffer->slab = NULL;
+
+    uv_mutex_init(&buffer->slab_mutex);
 
     return buffer;
 }
@@ -71,6 +83,8 @@ void siridb_buffer_free(siridb_buffer_t * buffer)
     free(buffer->template);
     free(buffer->path);
     vec_free(buffer->empty);
+    slab_free(buffer->slab);
+    uv_mutex_destroy(&buffer->slab_mutex);
     free(buffer);
 }
 
@@ -186,7 +200,7 @@ int siridb_buffer_new_series(
         siridb_series_t * series)
 {
     /* allocate new buffer */
-    series->buffer = siridb_points_new(buffer->len, series->tp);
+    series->buffer = siridb_buffer_points_new(buffer, series->tp);
     if (series->buffer == NULL)
     {
         /* TODO: maybe we can remove the ERR_ALLOC */
@@ -199,6 +213,43 @@ int siridb_buffer_new_series(
             buffer__create_new(buffer, series);
 }
 
+/*
+ * Returns points with room for 'buffer->len' points, allocated from the
+ * buffer slab, or NULL in case of an error.
+ *
+ * The points must be destroyed using siridb_buffer_points_free().
+ */
+siridb_points_t * siridb_buffer_points_new(
+        siridb_buffer_t * buffer,
+        points_tp tp)
+{
+    siridb_points_t * points;
+
+    uv_mutex_lock(&buffer->slab_mutex);
+    points = (siridb_points_t *) slab_alloc(buffer->slab);
+    uv_mutex_unlock(&buffer->slab_mutex);
+
+    if (points != NULL)
+    {
+        points->len = 0;
+        points->tp = tp;
+        points->data = (siridb_point_t *) (points + 1);
+    }
+    return points;
+}
+
+/*
+ * Destroy points created with siridb_buffer_points_new().
+ */
+void siridb_buffer_points_free(
+        siridb_buffer_t * buffer,
+        siridb_points_t * points)
+{
+    uv_mutex_lock(&buffer->slab_mutex);
+    slab_release(buffer->slab, points);
+    uv_mutex_unlock(&buffer->slab_mutex);
+}
+
 /*
  * Returns 0 if successful or -1 in case of an error.
  */
@@ -238,6 +289,10 @@ int siridb_buffer_open(siridb_buffer_t * buffer)
 }
 
 /*
+ * Load the buffer. The buffer file is used in place when the buffer size is
+ * unchanged and the file is not too fragmented. Otherwise a compacted copy
+ * of the file is written which replaces the original file.
+ *
  * Returns 0 if successful or -1 in case of an error.
  * (signal might be raised)
  */
@@ -245,21 +300,12 @@ int siridb_buffer_load(siridb_t * siridb)
 {
     siridb_buffer_t * buffer = siridb->buffer;
     FILE * fp;
-    FILE * fp_temp;
     size_t cur_size = buffer->size;
-    size_t cur_len = cur_size / sizeof(siridb_point_t);
     size_t new_size =  buffer->_to_size ? buffer->_to_size : cur_size;
     size_t new_len = new_size / sizeof(siridb_point_t);
-    size_t read_at_once = (size_t) (MAX_BUFFER_SZ / cur_size);
-    size_t max_len = cur_len > new_len ? cur_len : new_len;
-    size_t num, i;
-    char * buf, * pt;
-    long int offset = 0;
-    siridb_series_t * series;
-    bool log_migrate = true;
-    uint32_t buf_start, series_id;
-    uint64_t * ts;
+    uint64_t start = hist_now();
     uint8_t ignore_broken_data = siri.cfg->ignore_broken_data;
+    int rc;
 
     log_info("Loading and cleanup buffer");
 
@@ -267,11 +313,14 @@ int siridb_buffer_load(siridb_t * siridb)
     buffer->size = new_size;
     buffer->len = new_len;
 
-    buf = malloc(read_at_once * cur_size);
+    assert (buffer->slab == NULL);
+    buffer->slab = slab_new(
+            sizeof(siridb_points_t) + new_len * sizeof(siridb_point_t));
+
     buffer->template = malloc(new_size);
-    if (buf == NULL || buffer->template == NULL)
+    if (buffer->template == NULL || buffer->slab == NULL)
     {
-        free(buf);  /* buffer->template will be cleaned */
+        /* buffer->template will be cleaned */
         log_critical("Allocation error while loading buffer");
         return -1;
     }
@@ -294,13 +343,11 @@ int siridb_buffer_load(siridb_t * siridb)
             log_error("Temporary buffer file found: '%s'. Removing...", fn_temp);
             if (unlink(fn_temp))
             {
-                free(buf);
                 log_error("Failed to remove temporary buffer: %s", fn_temp);
                 return -1;
             }
         } else
         {
-            free(buf);
             log_error(
                 "Temporary buffer file found: '%s'. "
                 "Check if something went wrong or remove this file", fn_temp);
@@ -310,7 +357,6 @@ int siridb_buffer_load(siridb_t * siridb)
 
     if ((fp = fopen(fn, "r")) == NULL)
     {
-        free(buf);
         log_info("Buffer file '%s' not found, create a new one.", fn);
         if ((fp = fopen(fn, "w")) == NULL)
         {
@@ -320,6 +366,209 @@ int siridb_buffer_load(siridb_t * siridb)
         return fclose(fp);
     }
 
+    rc = (new_size == cur_size) ? buffer__load_in_place(siridb, fp) : 1;
+    if (rc == 1)
+    {
+        rc = buffer__compact(siridb, fp, cur_size, fn, fn_temp);
+        if (rc == 0)
+        {
+            log_info(
+                    "Buffer loaded and compacted in %.3f seconds",
+                    (hist_now() - start) / 1e9);
+        }
+    }
+    else
+    {
+        if (rc == 0)
+        {
+            log_info(
+                    "Buffer loaded in place in %.3f seconds "
+                    "(%zu empty slots, no rewrite required)",
+                    (hist_now() - start) / 1e9,
+                    buffer->empty->len);
+        }
+        if (fclose(fp))
+        {
+            log_critical("Cannot close buffer file: '%s'", fn);
+            rc = -1;
+        }
+    }
+
+    return rc;
+}
+
+/*
+ * Load the buffer without rewriting the buffer file. The file is scanned
+ * using a read-only memory map, each series gets the offset of its slot and
+ * slots without a series are added to the empty list.
+ *
+ * A compaction is required when the buffer needs to be migrated, when the
+ * file has a partial slot or when more than half of the slots are empty.
+ *
+ * Returns 0 if successful, 1 when the buffer must be compacted or -1 in case
+ * of an error. Nothing is changed when 1 is returned.
+ */
+static int buffer__load_in_place(siridb_t * siridb, FILE * fp)
+{
+    siridb_buffer_t * buffer = siridb->buffer;
+    size_t size = buffer->size;
+    size_t nslots, nused = 0, i;
+    siridb_series_t * series;
+    struct stat st;
+    char * map, * pt, * end;
+    int rc = 0;
+
+    if (fstat(fileno(fp), &st))
+    {
+        return 1;
+    }
+
+    if (st.st_size == 0)
+    {
+        return 0;
+    }
+
+    if (st.st_size % size)
+    {
+        log_warning("Buffer file has a partial slot and will be compacted");
+        return 1;
+    }
+
+    nslots = st.st_size / size;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED)
+    {
+        log_warning("Cannot map the buffer file, the buffer will be compacted");
+        return 1;
+    }
+
+    (void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    /* first check if the file can be used without changes */
+    for (i = 0; i < nslots; i++)
+    {
+        pt = map + i * size;
+
+        if (*((uint32_t *) pt) != buffer__start)
+        {
+            log_warning("Buffer will be migrated");
+            rc = 1;
+            goto done;
+        }
+
+        series = imap_get(siridb->series_map, *((uint32_t *) (pt + 4)));
+        if (series != NULL && series->tp != TP_STRING)
+        {
+            nused++;
+        }
+    }
+
+    if (nslots - nused > nused && nslots - nused > SIRIDB_BUFFER_CACHE)
+    {
+        log_info(
+                "Buffer has %zu empty slots for %zu series and will be "
+                "compacted", nslots - nused, nused);
+        rc = 1;
+        goto done;
+    }
+
+    for (i = 0; i < nslots; i++)
+    {
+        pt = map + i * size;
+        end = pt + size - sizeof(uint64_t);
+
+        series = imap_get(siridb->series_map, *((uint32_t *) (pt + 4)));
+
+        if (series != NULL && series->tp == TP_STRING)
+        {
+            log_error("Unexpected buffer found for string series '%s'",
+                    series->name);
+            series = NULL;
+        }
+        else if (series != NULL && series->buffer != NULL)
+        {
+            log_error("Duplicated buffer found for series '%s'",
+                    series->name);
+            series = NULL;
+        }
+
+        if (series == NULL)
+        {
+            if (vec_append_safe(&buffer->empty, (void *) (i * size)))
+            {
+                log_critical("Allocation error while loading buffer");
+                rc = -1;
+                goto done;
+            }
+            continue;
+        }
+
+        series->buffer = siridb_buffer_points_new(buffer, series->tp);
+        if (series->buffer == NULL)
+        {
+            log_critical("Cannot allocate a buffer for series id %u",
+                    series->id);
+            rc = -1;
+            goto done;
+        }
+
+        series->bf_offset = i * size;
+
+        for (pt += 8; pt < end && *((uint64_t *) pt) != buffer__end; pt += 16)
+        {
+            siridb_points_add_point(
+                    series->buffer,
+                    (uint64_t *) pt,
+                    (qp_via_t *) (pt + 8));
+        }
+
+        series->length += series->buffer->len;
+    }
+
+done:
+    munmap(map, st.st_size);
+    return rc;
+}
+
+/*
+ * Load the buffer and write a compacted copy of the buffer file. The copy
+ * uses the new buffer size and replaces the original file.
+ *
+ * Returns 0 if successful or -1 in case of an error. The file pointer is
+ * closed by this function.
+ */
+static int buffer__compact(
+        siridb_t * siridb,
+        FILE * fp,
+        size_t cur_size,
+        const char * fn,
+        const char * fn_temp)
+{
+    siridb_buffer_t * buffer = siridb->buffer;
+    FILE * fp_temp;
+    size_t cur_len = cur_size / sizeof(siridb_point_t);
+    size_t new_size = buffer->size;
+    size_t new_len = buffer->len;
+    size_t read_at_once = (size_t) (MAX_BUFFER_SZ / cur_size);
+    size_t max_len = cur_len > new_len ? cur_len : new_len;
+    size_t num, i;
+    char * buf, * pt;
+    long int offset = 0;
+    siridb_series_t * series;
+    siridb_points_t * unslabbed = NULL;
+    bool log_migrate = true;
+    uint32_t buf_start, series_id;
+    uint64_t * ts;
+
+    buf = malloc(read_at_once * cur_size);
+    if (buf == NULL)
+    {
+        log_critical("Allocation error while loading buffer");
+        fclose(fp);
+        return -1;
+    }
+
     if ((fp_temp = fopen(fn_temp, "w")) == NULL)
     {
         log_critical("Cannot open '%s' for writing", fn_temp);
@@ -362,7 +611,11 @@ int siridb_buffer_load(siridb_t * siridb)
                 continue;
             }
 
-            series->buffer = siridb_points_new(max_len, series->tp);
+            /* when the buffer shrinks, the points are copied to the slab
+             * after sharding */
+            series->buffer = (max_len == new_len) ?
+                    siridb_buffer_points_new(buffer, series->tp) :
+                    (unslabbed = siridb_points_new(max_len, series->tp));
             if (series->buffer == NULL)
             {
                 log_critical("Cannot allocate a buffer for series id %u",
@@ -407,11 +660,20 @@ int siridb_buffer_load(siridb_t * siridb)
                     pt = buffer->template;
                 }
 
-                if (siridb_points_resize(series->buffer, new_len))
+                siridb_points_t * points =
+                        siridb_buffer_points_new(buffer, series->tp);
+                if (points == NULL)
                 {
                     log_critical("Allocation error while resizing points");
                     goto failed;
                 }
+                points->len = series->buffer->len;
+                memcpy(points->data,
+                       series->buffer->data,
+                       points->len * sizeof(siridb_point_t));
+                siridb_points_free(series->buffer);
+                series->buffer = points;
+                unslabbed = NULL;
             }
 
             /* write to output file and check if write was successful */
@@ -446,6 +708,12 @@ int siridb_buffer_load(siridb_t * siridb)
     return 0;
 
 failed:
+    /* a buffer which is not copied to the slab is not released to it */
+    if (unslabbed != NULL)
+    {
+        siridb_points_free(unslabbed);
+        series->buffer = NULL;
+    }
     fclose(fp);
     fclose(fp_temp);
     free(buf);
@@ -13,6 +13,7 @@
 #include <procinfo/procinfo.h>
 #include <siri/db/db.h>
 #include <siri/db/misc.h>
+#include <siri/db/rollup.h>
 #include <siri/db/series.h>
 #include <siri/db/servers.h>
 #include <siri/db/shard.h>
@@ -48,6 +49,7 @@ static int siridb__from_unpacker(
 static siridb_t * siridb__from_dat(const char * dbpath);
 static int siridb__read_conf(siridb_t * siridb);
 static int siridb__lock(const char * dbpath, int lock_flags);
+static void siridb__log_series_mem(siridb_t * siridb);
 
 #define READ_DB_EXIT_WITH_ERROR(ERROR_MSG)  \
     strcpy(err_msg, ERROR_MSG);             \
@@ -246,10 +248,17 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
 
     vec_free(vec);
 
+    siridb__log_series_mem(siridb);
+
     /* generate pools, this can raise a signal */
     log_info("Initialize pools");
     siridb_pools_init(siridb);
 
+    if (!siri_err)
+    {
+        siridb_pools_log_balance(siridb);
+    }
+
     if (!siri_err)
     {
         siridb->reindex = siridb_reindex_open(siridb, 0);
@@ -314,7 +323,8 @@ static int siridb__from_unpacker(
             qp_schema.via.int64 == 3 ||
             qp_schema.via.int64 == 4 ||
             qp_schema.via.int64 == 5 ||
-            qp_schema.via.int64 == 6)
+            qp_schema.via.int64 == 6 ||
+            qp_schema.via.int64 == 7)
     {
         log_info(
                 "Found an old database schema (v%d), "
@@ -530,6 +540,26 @@ static int siridb__from_unpacker(
         (*siridb)->tee->port = qp_obj.via.int64;
     }
 
+    /* for older schemas we keep the default legacy lookup mode */
+    if (qp_schema.via.int64 >= 8)
+    {
+        if (qp_next(unpacker, &qp_obj) != QP_INT64 ||
+            qp_obj.via.int64 < 0 ||
+            qp_obj.via.int64 >= SIRIDB_LOOKUP_MODE_END)
+        {
+            READ_DB_EXIT_WITH_ERROR("Cannot read lookup mode.")
+        }
+        (*siridb)->lookup_mode = qp_obj.via.int64;
+
+        if (qp_next(unpacker, &qp_obj) != QP_INT64 ||
+            qp_obj.via.int64 < 0 ||
+            qp_obj.via.int64 >= SIRIDB_LOOKUP_MODE_END)
+        {
+            READ_DB_EXIT_WITH_ERROR("Cannot read previous lookup mode.")
+        }
+        (*siridb)->prev_lookup_mode = qp_obj.via.int64;
+    }
+
     if ((*siridb)->tee->address == NULL)
     {
         log_debug(
@@ -693,6 +723,8 @@ int siridb_save(siridb_t * siridb)
                 ? qp_fadd_type(fpacker, QP_NULL)
                 : qp_fadd_string(fpacker, siridb->tee->address)) ||
             qp_fadd_int64(fpacker, siridb->tee->port) ||
+            qp_fadd_int64(fpacker, siridb->lookup_mode) ||
+            qp_fadd_int64(fpacker, siridb->prev_lookup_mode) ||
             qp_fadd_type(fpacker, QP_ARRAY_CLOSE) ||
             qp_close(fpacker));
 }
@@ -802,6 +834,24 @@ void siridb__free(siridb_t * siridb)
         siridb_tee_free(siridb->tee);
     }
 
+    if (siridb->qcache != NULL)
+    {
+        siridb_qcache_free(siridb->qcache);
+    }
+
+    if (siridb->acache != NULL)
+    {
+        siridb_acache_free(siridb->acache);
+    }
+
+    siridb_rollup_free(siridb->rollup);
+
+    /* the trigram index is used by the shards so it is freed after them */
+    if (siridb->ngram_index != NULL)
+    {
+        siridb_ngram_index_free(siridb->ngram_index);
+    }
+
     /* unlock the database in case no siri_err occurred */
     if (!siri_err)
     {
@@ -897,6 +947,8 @@ static siridb_t * siridb__new(void)
     siridb->ref = 1;
     siridb->insert_tasks = 0;
     siridb->flags = 0;
+    siridb->lookup_mode = SIRIDB_LOOKUP_MODE_SUM;
+    siridb->prev_lookup_mode = SIRIDB_LOOKUP_MODE_SUM;
     siridb->time = NULL;
     siridb->users = NULL;
     siridb->servers = NULL;
@@ -953,12 +1005,39 @@ static siridb_t * siridb__new(void)
         goto fail4;
     }
 
+    /* allocate parsed query cache */
+    siridb->qcache = siridb_qcache_new();
+    if (siridb->qcache == NULL)
+    {
+        goto fail5;
+    }
+
+    /* rollup tiers and the trigram index are read from database.conf */
+    siridb->rollup = NULL;
+    siridb->ngram_index = NULL;
+
+    /* allocate aggregate cache (optional) */
+    siridb->acache = NULL;
+    if (siri.cfg->aggregate_cache_size)
+    {
+        siridb->acache = siridb_acache_new(
+                (size_t) siri.cfg->aggregate_cache_size * 1024 * 1024);
+        if (siridb->acache == NULL)
+        {
+            goto fail6;
+        }
+    }
+
     uv_mutex_init(&siridb->series_mutex);
     uv_mutex_init(&siridb->shards_mutex);
     uv_mutex_init(&siridb->values_mutex);
 
     return siridb;
 
+fail6:
+    siridb_qcache_free(siridb->qcache);
+fail5:
+    siridb_tee_free(siridb->tee);
 fail4:
     siridb_buffer_free(siridb->buffer);
 fail3:
@@ -1086,6 +1165,100 @@ static int siridb__read_conf(siridb_t * siridb)
             (void) fclose(fp);
         }
     }
+
+    /* read rollup tiers from database.conf */
+    rc = cfgparser_get_option(&option, cfgparser, "rollup", "tiers");
+
+    if (rc == CFGPARSER_SUCCESS && option->tp == CFGPARSER_TP_STRING)
+    {
+        siridb->rollup = siridb_rollup_new(
+                option->val->string,
+                siridb->time->factor);
+        if (siridb->rollup == NULL)
+        {
+            log_warning(
+                "Invalid rollup tiers: '%s' (expecting at most %d intervals "
+                "like '5m,1h')",
+                option->val->string,
+                SIRIDB_ROLLUP_MAX_TIERS);
+        }
+    }
+    else if (rc == CFGPARSER_SUCCESS)
+    {
+        log_warning("Invalid rollup tiers, expecting intervals like '5m,1h'");
+    }
+
+    /* read tee queue size and policy from database.conf */
+    rc = cfgparser_get_option(&option, cfgparser, "tee", "max_queue");
+
+    if (    rc == CFGPARSER_SUCCESS &&
+            option->tp == CFGPARSER_TP_INTEGER &&
+            option->val->integer >= 0)
+    {
+        siridb->tee->max_queue = (size_t) option->val->integer;
+    }
+    else if (rc == CFGPARSER_SUCCESS)
+    {
+        log_warning(
+                "Invalid tee max_queue, expecting a number of bytes "
+                "(0 for no limit)");
+    }
+
+    rc = cfgparser_get_option(&option, cfgparser, "tee", "policy");
+
+    if (    rc == CFGPARSER_SUCCESS &&
+            option->tp == CFGPARSER_TP_STRING &&
+            strcmp(option->val->string, "drop_old") == 0)
+    {
+        siridb->tee->policy = SIRIDB_TEE_DROP_OLD;
+    }
+    else if (
+            rc == CFGPARSER_SUCCESS && (
+            option->tp != CFGPARSER_TP_STRING ||
+            strcmp(option->val->string, "drop_new") != 0))
+    {
+        log_warning(
+                "Invalid tee policy, expecting 'drop_new' or 'drop_old'");
+    }
+
+    /* read trigram index options from database.conf */
+    rc = cfgparser_get_option(&option, cfgparser, "ngram", "enabled");
+
+    if (    rc == CFGPARSER_SUCCESS &&
+            option->tp == CFGPARSER_TP_INTEGER &&
+            option->val->integer == 1)
+    {
+        size_t max_memory = SIRIDB_NGRAM_DEFAULT_MAX_MEMORY;
+
+        rc = cfgparser_get_option(&option, cfgparser, "ngram", "max_memory");
+
+        if (    rc == CFGPARSER_SUCCESS &&
+                option->tp == CFGPARSER_TP_INTEGER &&
+                option->val->integer > 0)
+        {
+            max_memory = (size_t) option->val->integer;
+        }
+        else if (rc == CFGPARSER_SUCCESS)
+        {
+            log_warning(
+                    "Invalid ngram max_memory, expecting a positive number "
+                    "of bytes");
+        }
+
+        siridb->ngram_index = siridb_ngram_index_new(max_memory);
+        if (siridb->ngram_index == NULL)
+        {
+            log_error("Cannot create trigram index");
+        }
+    }
+    else if (
+            rc == CFGPARSER_SUCCESS && (
+            option->tp != CFGPARSER_TP_INTEGER ||
+            option->val->integer != 0))
+    {
+        log_warning("Invalid ngram enabled, expecting 0 or 1");
+    }
+
     cfgparser_free(cfgparser);
 
     return (buffer->path == NULL) ? -1 : 0;
@@ -1116,3 +1289,23 @@ static int siridb__lock(const char * dbpath, int lock_flags)
     }
     return 0;
 }
+
+/*
+ * Log the memory used by series, split in headers (including names), shard
+ * indexes, buffers and the lookup structures.
+ */
+static void siridb__log_series_mem(siridb_t * siridb)
+{
+    siridb_series_mem_t mem;
+    size_t total;
+
+    siridb_series_mem(siridb, &mem);
+
+    total = mem.headers + mem.idx + mem.buffers + mem.lookup;
+
+    log_info(
+            "Memory used by %zu series: %zu bytes (headers: %zu, "
+            "indexes: %zu, buffers: %zu, lookup: %zu, per series: %zu)",
+            mem.n, total, mem.headers, mem.idx, mem.buffers, mem.lookup,
+            mem.n ? total / mem.n : 0);
+}
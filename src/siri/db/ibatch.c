@@ -0,0 +1,287 @@
+/*
+ * ibatch.c - Pre-validated batch with points for a local insert.
+ */
+#include <siri/db/ibatch.h>
+#include <siri/db/series.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IBATCH_DEFAULT_SIZE 64
+#define IBATCH_NAMES_SIZE 4096
+#define IBATCH_POINTS_SIZE 1024
+
+/*
+ * Many series with only a few points are faster inserted using the qpack
+ * data. The batch is checked after IBATCH_CHECK_SERIES series and becomes
+ * invalid when the series have less than IBATCH_MIN_POINTS points on average.
+ */
+#define IBATCH_CHECK_SERIES 64
+#define IBATCH_MIN_POINTS 16
+
+static void IBATCH_free_strings(
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_ibatch_t * siridb_ibatch_new(void)
+{
+    siridb_ibatch_t * ibatch = malloc(sizeof(siridb_ibatch_t));
+    if (ibatch == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    ibatch->flags = 0;
+    ibatch->pos = 0;
+    ibatch->len = 0;
+    ibatch->size = IBATCH_DEFAULT_SIZE;
+    ibatch->names_len = 0;
+    ibatch->names_size = IBATCH_NAMES_SIZE;
+    ibatch->points_len = 0;
+    ibatch->points_size = IBATCH_POINTS_SIZE;
+    ibatch->names = malloc(IBATCH_NAMES_SIZE);
+    ibatch->points = malloc(IBATCH_POINTS_SIZE * sizeof(siridb_point_t));
+    ibatch->series = malloc(
+            IBATCH_DEFAULT_SIZE * sizeof(siridb_ibatch_series_t));
+
+    if (ibatch->names == NULL ||
+        ibatch->points == NULL ||
+        ibatch->series == NULL)
+    {
+        ERR_ALLOC
+        siridb_ibatch_free(ibatch);
+        return NULL;
+    }
+
+    return ibatch;
+}
+
+/*
+ * Destroy a batch including points which are not processed.
+ */
+void siridb_ibatch_free(siridb_ibatch_t * ibatch)
+{
+    if (ibatch->series != NULL && ibatch->points != NULL)
+    {
+        size_t i;
+        for (i = ibatch->pos; i < ibatch->len; i++)
+        {
+            IBATCH_free_strings(ibatch, ibatch->series + i);
+        }
+    }
+    free(ibatch->series);
+    free(ibatch->points);
+    free(ibatch->names);
+    free(ibatch);
+}
+
+/*
+ * Add a new series to the batch. Argument 'pos' is the position of the series
+ * name in the qpack data.
+ *
+ * Returns NULL when the batch is invalid, points for the series should not be
+ * added in this case. In case of an error NULL is returned too and a SIGNAL
+ * is raised.
+ */
+siridb_ibatch_series_t * siridb_ibatch_add_series(
+        siridb_ibatch_t * ibatch,
+        const char * name,
+        size_t len,
+        size_t pos)
+{
+    siridb_ibatch_series_t * bseries;
+
+    if (ibatch->len >= IBATCH_CHECK_SERIES &&
+        ibatch->points_len < ibatch->len * IBATCH_MIN_POINTS)
+    {
+        ibatch->flags |= IBATCH_FLAG_INVALID;
+    }
+
+    if (ibatch->flags & IBATCH_FLAG_INVALID)
+    {
+        return NULL;
+    }
+
+    if (ibatch->len == ibatch->size)
+    {
+        size_t size = ibatch->size * 2;
+        siridb_ibatch_series_t * tmp = realloc(
+                ibatch->series,
+                size * sizeof(siridb_ibatch_series_t));
+        if (tmp == NULL)
+        {
+            ERR_ALLOC
+            return NULL;
+        }
+        ibatch->series = tmp;
+        ibatch->size = size;
+    }
+
+    if (ibatch->names_len + len + 1 > ibatch->names_size)
+    {
+        size_t size = ibatch->names_size * 2 + len + 1;
+        char * tmp = realloc(ibatch->names, size);
+        if (tmp == NULL)
+        {
+            ERR_ALLOC
+            return NULL;
+        }
+        ibatch->names = tmp;
+        ibatch->names_size = size;
+    }
+
+    bseries = ibatch->series + ibatch->len;
+    bseries->name_offset = ibatch->names_len;
+    bseries->pos = pos;
+    bseries->offset = ibatch->points_len;
+    bseries->len = 0;
+    bseries->tp = TP_INT;  /* the type will be set by the first point */
+
+    memcpy(ibatch->names + ibatch->names_len, name, len);
+    ibatch->names_len += len;
+    ibatch->names[ibatch->names_len++] = '\0';
+    ibatch->len++;
+
+    return bseries;
+}
+
+/*
+ * Add a point to the last series in the batch. The first point sets the type
+ * for the series. Values with another type make the batch invalid since the
+ * conversion depends on the type of an existing series.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_ibatch_add_point(
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries,
+        int64_t ts,
+        qp_obj_t * qp_val)
+{
+    siridb_points_t points;
+    points_tp tp = SIRIDB_QP_MAP2_TP(qp_val->tp);
+    qp_via_t val;
+
+    if (bseries->len == 0)
+    {
+        bseries->tp = tp;
+    }
+    else if (bseries->tp != tp)
+    {
+        ibatch->flags |= IBATCH_FLAG_INVALID;
+        return 0;
+    }
+
+    if (ibatch->points_len == ibatch->points_size)
+    {
+        size_t size = ibatch->points_size * 2;
+        siridb_point_t * tmp = realloc(
+                ibatch->points,
+                size * sizeof(siridb_point_t));
+        if (tmp == NULL)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+        ibatch->points = tmp;
+        ibatch->points_size = size;
+    }
+
+    if (tp == TP_STRING)
+    {
+        val.str = strndup(qp_val->via.str, qp_val->len);
+        if (val.str == NULL)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+    }
+    else
+    {
+        val = qp_val->via;
+    }
+
+    /* the series is the last one so the points can be added in place */
+    points.len = bseries->len;
+    points.tp = tp;
+    points.data = ibatch->points + bseries->offset;
+
+    siridb_points_add_point(&points, (uint64_t *) &ts, &val);
+
+    bseries->len++;
+    ibatch->points_len++;
+
+    return 0;
+}
+
+/*
+ * Skip the next series in the batch without processing the points.
+ */
+void siridb_ibatch_skip(siridb_ibatch_t * ibatch)
+{
+    IBATCH_free_strings(ibatch, ibatch->series + ibatch->pos);
+    ibatch->pos++;
+}
+
+/*
+ * Copy the points of a series to a pcache. The pcache is created when
+ * '*pcache' is NULL. String values are owned by the pcache when this function
+ * returns so the series must be processed (ibatch->pos) already.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_ibatch_pcache(
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries,
+        siridb_pcache_t ** pcache)
+{
+    if (*pcache == NULL && (*pcache = siridb_pcache_new(bseries->tp)) == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    if ((*pcache)->size < bseries->len)
+    {
+        siridb_point_t * tmp = realloc(
+                (*pcache)->data,
+                bseries->len * sizeof(siridb_point_t));
+        if (tmp == NULL)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+        (*pcache)->data = tmp;
+        (*pcache)->size = bseries->len;
+    }
+
+    (*pcache)->tp = bseries->tp;
+    (*pcache)->len = bseries->len;
+
+    memcpy((*pcache)->data,
+           ibatch->points + bseries->offset,
+           bseries->len * sizeof(siridb_point_t));
+
+    return 0;
+}
+
+/*
+ * Free string values for a series which is not processed.
+ */
+static void IBATCH_free_strings(
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries)
+{
+    if (bseries->tp == TP_STRING)
+    {
+        size_t i;
+        siridb_point_t * point = ibatch->points + bseries->offset;
+        for (i = 0; i < bseries->len; i++, point++)
+        {
+            free(point->val.str);
+        }
+    }
+}
@@ -0,0 +1,557 @@
+/*
+ * ijson.c - Streaming JSON parser for inserts.
+ */
+#include <assert.h>
+#include <logger/logger.h>
+#include <siri/db/ijson.h>
+#include <siri/db/series.h>
+#include <siri/db/servers.h>
+#include <siri/db/time.h>
+#include <siri/err.h>
+#include <siri/net/pkg.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum
+{
+    IJSON_STATE_ROOT,           /* expecting a map or array */
+    IJSON_STATE_SERIES,         /* expecting a series name (map format) */
+    IJSON_STATE_OBJECT,         /* expecting an object (array format) */
+    IJSON_STATE_KEY,            /* expecting "name" or "points" */
+    IJSON_STATE_NAME,           /* expecting a series name (array format) */
+    IJSON_STATE_POINTS,         /* expecting an array with points */
+    IJSON_STATE_POINT,          /* expecting a point */
+    IJSON_STATE_TS,             /* expecting a time-stamp */
+    IJSON_STATE_VALUE,          /* expecting a value */
+    IJSON_STATE_CLOSE,          /* expecting the end of a point */
+    IJSON_STATE_DONE,
+} ijson_state_t;
+
+#define IJSON_STOPPED(ijson__)                                          \
+    ((ijson__)->err ||                                                  \
+    ((ijson__)->flags & (IJSON_FLAG_INVALID|IJSON_FLAG_CHANGED)))
+
+#define IJSON_CHECK_ALLOC                                   \
+    if (siri_err)                                           \
+        return IJSON_fail(ijson, ERR_MEM_ALLOC);
+
+static int IJSON_fail(siridb_ijson_t * ijson, siridb_insert_err_t err);
+static int IJSON_unexpected(siridb_ijson_t * ijson);
+static int IJSON_changed(siridb_ijson_t * ijson);
+static int IJSON_series(
+        siridb_ijson_t * ijson,
+        const unsigned char * name,
+        size_t n);
+static int IJSON_value(siridb_ijson_t * ijson, qp_obj_t * qp_val);
+static int IJSON_null(void * ctx);
+static int IJSON_boolean(void * ctx, int boolean);
+static int IJSON_integer(void * ctx, long long i);
+static int IJSON_double(void * ctx, double d);
+static int IJSON_string(void * ctx, const unsigned char * s, size_t n);
+static int IJSON_start_map(void * ctx);
+static int IJSON_map_key(void * ctx, const unsigned char * s, size_t n);
+static int IJSON_end_map(void * ctx);
+static int IJSON_start_array(void * ctx);
+static int IJSON_end_array(void * ctx);
+
+static yajl_callbacks ijson__callbacks = {
+    IJSON_null,
+    IJSON_boolean,
+    IJSON_integer,
+    IJSON_double,
+    NULL,
+    IJSON_string,
+    IJSON_start_map,
+    IJSON_map_key,
+    IJSON_end_map,
+    IJSON_start_array,
+    IJSON_end_array
+};
+
+/*
+ * Returns a new parser with a new insert for the given client.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_ijson_t * siridb_ijson_new(siridb_t * siridb, sirinet_stream_t * client)
+{
+    siridb_ijson_t * ijson = malloc(sizeof(siridb_ijson_t));
+    if (ijson == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    ijson->state = IJSON_STATE_ROOT;
+    ijson->flags = 0;
+    ijson->pool = 0;
+    ijson->err = 0;
+    ijson->ts = 0;
+    ijson->n = 0;
+    ijson->npoints = 0;
+    ijson->siridb = siridb;
+    ijson->packer = NULL;
+    ijson->tmp_packer = NULL;
+    ijson->bseries = NULL;
+    ijson->hand = NULL;
+    ijson->insert = siridb_insert_new(siridb, 0, client);
+
+    if (ijson->insert == NULL)
+    {
+        siridb_ijson_free(ijson);
+        return NULL;  /* signal is raised */
+    }
+
+    ijson->hand = yajl_alloc(&ijson__callbacks, NULL, ijson);
+    if (ijson->hand == NULL)
+    {
+        ERR_ALLOC
+        siridb_ijson_free(ijson);
+        return NULL;
+    }
+
+    return ijson;
+}
+
+/*
+ * Destroy the parser. The insert is destroyed too, unless it is taken.
+ */
+void siridb_ijson_free(siridb_ijson_t * ijson)
+{
+    if (ijson->hand != NULL)
+    {
+        yajl_free(ijson->hand);
+    }
+    if (ijson->tmp_packer != NULL)
+    {
+        qp_packer_free(ijson->tmp_packer);
+    }
+    if (ijson->insert != NULL)
+    {
+        siridb_insert_free(ijson->insert);
+    }
+    free(ijson);
+}
+
+/*
+ * Parse a chunk of JSON data. Parsing stops at the first error and the next
+ * calls will be ignored.
+ *
+ * Returns 0 if successful or -1 in case of an error. In case of an error,
+ * either ijson->err is set or IJSON_FLAG_INVALID or IJSON_FLAG_CHANGED is
+ * set in ijson->flags.
+ */
+int siridb_ijson_parse(siridb_ijson_t * ijson, const char * data, size_t n)
+{
+    if (IJSON_STOPPED(ijson))
+    {
+        return -1;
+    }
+
+    if (yajl_parse(ijson->hand, (const unsigned char *) data, n) !=
+            yajl_status_ok)
+    {
+        if (!ijson->err && (~ijson->flags & IJSON_FLAG_CHANGED))
+        {
+            ijson->flags |= IJSON_FLAG_INVALID;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Finish parsing, should be called when all data is parsed.
+ *
+ * Returns a negative value in case of an error or a value equal to zero or
+ * higher representing the number of points processed. Be aware that the
+ * flags IJSON_FLAG_INVALID and IJSON_FLAG_CHANGED must be checked first.
+ */
+ssize_t siridb_ijson_complete(siridb_ijson_t * ijson)
+{
+    if (!IJSON_STOPPED(ijson))
+    {
+        if (yajl_complete_parse(ijson->hand) != yajl_status_ok)
+        {
+            /* a callback may fail on the last value, like while parsing */
+            if (!ijson->err && (~ijson->flags & IJSON_FLAG_CHANGED))
+            {
+                ijson->flags |= IJSON_FLAG_INVALID;
+            }
+        }
+        else if (ijson->state != IJSON_STATE_DONE)
+        {
+            (void) IJSON_unexpected(ijson);
+        }
+        else if (IJSON_changed(ijson))
+        {
+            ijson->flags |= IJSON_FLAG_CHANGED;
+        }
+    }
+
+    return ijson->err ? ijson->err : ijson->npoints;
+}
+
+static int IJSON_fail(siridb_ijson_t * ijson, siridb_insert_err_t err)
+{
+    ijson->err = err;
+    return 0;
+}
+
+/*
+ * Set the correct error for an unexpected value in the current state.
+ */
+static int IJSON_unexpected(siridb_ijson_t * ijson)
+{
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_ROOT:
+        return IJSON_fail(ijson, ERR_EXPECTING_MAP_OR_ARRAY);
+    case IJSON_STATE_SERIES:
+    case IJSON_STATE_OBJECT:
+    case IJSON_STATE_DONE:
+        return IJSON_fail(ijson, ERR_EXPECTING_SERIES_NAME);
+    case IJSON_STATE_KEY:
+    case IJSON_STATE_NAME:
+        return IJSON_fail(ijson, ERR_EXPECTING_NAME_AND_POINTS);
+    case IJSON_STATE_POINTS:
+        return IJSON_fail(ijson, ERR_EXPECTING_ARRAY);
+    case IJSON_STATE_POINT:
+        return IJSON_fail(ijson, ijson->n
+                ? ERR_EXPECTING_ARRAY
+                : ERR_EXPECTING_AT_LEAST_ONE_POINT);
+    case IJSON_STATE_TS:
+        return IJSON_fail(ijson, ERR_EXPECTING_INTEGER_TS);
+    case IJSON_STATE_VALUE:
+    case IJSON_STATE_CLOSE:
+        return IJSON_fail(ijson, ERR_UNSUPPORTED_VALUE);
+    }
+    return IJSON_fail(ijson, ERR_UNSUPPORTED_VALUE);
+}
+
+/*
+ * Returns 1 when the pools or re-index state have changed since the insert
+ * was created, or 0 if not. The packers are created for the pools at that
+ * time so the insert cannot continue.
+ */
+static int IJSON_changed(siridb_ijson_t * ijson)
+{
+    siridb_t * siridb = ijson->siridb;
+    siridb_insert_t * insert = ijson->insert;
+
+    return (
+        insert->packer_size != siridb->pools->len ||
+        !(siridb->flags & SIRIDB_FLAG_REINDEXING) !=
+        !(insert->flags & INSERT_FLAG_TEST));
+}
+
+/*
+ * Select the pool for a series and write the series name to the packer.
+ * The packer for the pool becomes the packer for the points, unless the
+ * points are already read.
+ */
+static int IJSON_series(
+        siridb_ijson_t * ijson,
+        const unsigned char * name,
+        size_t n)
+{
+    siridb_t * siridb = ijson->siridb;
+    siridb_insert_t * insert = ijson->insert;
+    qp_packer_t * packer;
+    qp_obj_t qp_series_name;
+
+    if (IJSON_changed(ijson))
+    {
+        ijson->flags |= IJSON_FLAG_CHANGED;
+        return 0;
+    }
+
+    qp_series_name.tp = QP_RAW;
+    qp_series_name.len = n;
+    qp_series_name.via.raw = (unsigned char *) name;
+
+    ijson->pool = siridb_insert_get_pool(siridb, &qp_series_name);
+    packer = insert->packer[ijson->pool];
+
+    ijson->bseries = (
+            insert->ibatch == NULL ||
+            ijson->pool != siridb->server->pool) ? NULL :
+                siridb_ibatch_add_series(
+                    insert->ibatch,
+                    (const char *) name,
+                    n,
+                    packer->len - sizeof(sirinet_pkg_t));
+
+    IJSON_CHECK_ALLOC
+
+    qp_add_raw_term(packer, name, n);
+
+    if (ijson->flags & IJSON_FLAG_POINTS)
+    {
+        if (ijson->bseries != NULL)
+        {
+            /* points are read before the series name */
+            insert->ibatch->flags |= IBATCH_FLAG_INVALID;
+        }
+        qp_packer_extend(packer, ijson->tmp_packer);
+        ijson->tmp_packer->len = 0;
+    }
+
+    IJSON_CHECK_ALLOC
+
+    ijson->packer = packer;
+    return 1;
+}
+
+static int IJSON_value(siridb_ijson_t * ijson, qp_obj_t * qp_val)
+{
+    if (ijson->bseries != NULL && siridb_ibatch_add_point(
+            ijson->insert->ibatch,
+            ijson->bseries,
+            ijson->ts,
+            qp_val))
+    {
+        return IJSON_fail(ijson, ERR_MEM_ALLOC);  /* signal is raised */
+    }
+
+    IJSON_CHECK_ALLOC
+
+    ijson->state = IJSON_STATE_CLOSE;
+    return 1;
+}
+
+static int IJSON_null(void * ctx)
+{
+    return IJSON_unexpected((siridb_ijson_t *) ctx);
+}
+
+static int IJSON_boolean(void * ctx, int UNUSED_boolean __attribute__((unused)))
+{
+    return IJSON_unexpected((siridb_ijson_t *) ctx);
+}
+
+static int IJSON_integer(void * ctx, long long i)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+    qp_obj_t qp_val;
+
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_TS:
+        if (!siridb_int64_valid_ts(ijson->siridb->time, i))
+        {
+            return IJSON_fail(ijson, ERR_TIMESTAMP_OUT_OF_RANGE);
+        }
+        ijson->ts = i;
+        qp_add_int64(ijson->packer, i);
+        ijson->state = IJSON_STATE_VALUE;
+        IJSON_CHECK_ALLOC
+        return 1;
+    case IJSON_STATE_VALUE:
+        qp_val.tp = QP_INT64;
+        qp_val.via.int64 = i;
+        qp_add_int64(ijson->packer, i);
+        return IJSON_value(ijson, &qp_val);
+    default:
+        return IJSON_unexpected(ijson);
+    }
+}
+
+static int IJSON_double(void * ctx, double d)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+    qp_obj_t qp_val;
+
+    if (ijson->state != IJSON_STATE_VALUE)
+    {
+        return IJSON_unexpected(ijson);
+    }
+
+    qp_val.tp = QP_DOUBLE;
+    qp_val.via.real = d;
+    qp_add_double(ijson->packer, d);
+    return IJSON_value(ijson, &qp_val);
+}
+
+static int IJSON_string(void * ctx, const unsigned char * s, size_t n)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+    qp_obj_t qp_val;
+
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_NAME:
+        if (!n || n >= SIRIDB_SERIES_NAME_LEN_MAX)
+        {
+            return IJSON_fail(ijson, ERR_EXPECTING_NAME_AND_POINTS);
+        }
+        if (!IJSON_series(ijson, s, n))
+        {
+            return 0;
+        }
+        ijson->flags |= IJSON_FLAG_NAME;
+        ijson->state = IJSON_STATE_KEY;
+        return 1;
+    case IJSON_STATE_VALUE:
+        if (siridb_servers_check_version(ijson->siridb, "2.0.27") > 0)
+        {
+            return IJSON_fail(ijson, ERR_INCOMPATIBLE_SERVER_VERSION);
+        }
+        qp_val.tp = QP_RAW;
+        qp_val.len = n;
+        qp_val.via.raw = (unsigned char *) s;
+        qp_add_raw(ijson->packer, s, n);
+        return IJSON_value(ijson, &qp_val);
+    default:
+        return IJSON_unexpected(ijson);
+    }
+}
+
+static int IJSON_start_map(void * ctx)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_ROOT:
+        ijson->state = IJSON_STATE_SERIES;
+        return 1;
+    case IJSON_STATE_OBJECT:
+        ijson->flags &= ~(IJSON_FLAG_NAME|IJSON_FLAG_POINTS);
+        ijson->state = IJSON_STATE_KEY;
+        return 1;
+    default:
+        return IJSON_unexpected(ijson);
+    }
+}
+
+static int IJSON_map_key(void * ctx, const unsigned char * s, size_t n)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_SERIES:
+        if (!n || n >= SIRIDB_SERIES_NAME_LEN_MAX)
+        {
+            return IJSON_fail(ijson, ERR_EXPECTING_SERIES_NAME);
+        }
+        if (!IJSON_series(ijson, s, n))
+        {
+            return 0;
+        }
+        ijson->state = IJSON_STATE_POINTS;
+        return 1;
+    case IJSON_STATE_KEY:
+        if (n == 4 && memcmp(s, "name", 4) == 0 &&
+            (~ijson->flags & IJSON_FLAG_NAME))
+        {
+            ijson->state = IJSON_STATE_NAME;
+            return 1;
+        }
+        if (n == 6 && memcmp(s, "points", 6) == 0 &&
+            (~ijson->flags & IJSON_FLAG_POINTS))
+        {
+            if (ijson->flags & IJSON_FLAG_NAME)
+            {
+                ijson->flags |= IJSON_FLAG_POINTS;
+                ijson->state = IJSON_STATE_POINTS;
+                return 1;
+            }
+            if (ijson->tmp_packer == NULL &&
+                (ijson->tmp_packer = qp_packer_new(QP_SUGGESTED_SIZE)) == NULL)
+            {
+                return IJSON_fail(ijson, ERR_MEM_ALLOC);  /* signal is raised */
+            }
+            /* points are read before the name */
+            ijson->packer = ijson->tmp_packer;
+            ijson->bseries = NULL;
+            ijson->flags |= IJSON_FLAG_POINTS;
+            ijson->state = IJSON_STATE_POINTS;
+            return 1;
+        }
+        return IJSON_fail(ijson, ERR_EXPECTING_NAME_AND_POINTS);
+    default:
+        return IJSON_unexpected(ijson);
+    }
+}
+
+static int IJSON_end_map(void * ctx)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_SERIES:
+        ijson->state = IJSON_STATE_DONE;
+        return 1;
+    case IJSON_STATE_KEY:
+        if ((ijson->flags & (IJSON_FLAG_NAME|IJSON_FLAG_POINTS)) !=
+                (IJSON_FLAG_NAME|IJSON_FLAG_POINTS))
+        {
+            return IJSON_fail(ijson, ERR_EXPECTING_NAME_AND_POINTS);
+        }
+        ijson->state = IJSON_STATE_OBJECT;
+        return 1;
+    default:
+        return IJSON_unexpected(ijson);
+    }
+}
+
+static int IJSON_start_array(void * ctx)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_ROOT:
+        ijson->flags |= IJSON_FLAG_ARRAY;
+        ijson->state = IJSON_STATE_OBJECT;
+        return 1;
+    case IJSON_STATE_POINTS:
+        qp_add_type(ijson->packer, QP_ARRAY_OPEN);
+        ijson->n = 0;
+        ijson->state = IJSON_STATE_POINT;
+        break;
+    case IJSON_STATE_POINT:
+        qp_add_type(ijson->packer, QP_ARRAY2);
+        ijson->state = IJSON_STATE_TS;
+        break;
+    default:
+        return IJSON_unexpected(ijson);
+    }
+
+    IJSON_CHECK_ALLOC
+    return 1;
+}
+
+static int IJSON_end_array(void * ctx)
+{
+    siridb_ijson_t * ijson = (siridb_ijson_t *) ctx;
+
+    switch ((ijson_state_t) ijson->state)
+    {
+    case IJSON_STATE_OBJECT:
+        ijson->state = IJSON_STATE_DONE;
+        return 1;
+    case IJSON_STATE_POINT:
+        if (!ijson->n)
+        {
+            return IJSON_fail(ijson, ERR_EXPECTING_AT_LEAST_ONE_POINT);
+        }
+        qp_add_type(ijson->packer, QP_ARRAY_CLOSE);
+        ijson->state = (ijson->flags & IJSON_FLAG_ARRAY)
+                ? IJSON_STATE_KEY
+                : IJSON_STATE_SERIES;
+        IJSON_CHECK_ALLOC
+        return 1;
+    case IJSON_STATE_CLOSE:
+        ijson->n++;
+        ijson->npoints++;
+        ijson->state = IJSON_STATE_POINT;
+        return 1;
+    default:
+        return IJSON_unexpected(ijson);
+    }
+}
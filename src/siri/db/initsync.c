@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <siri/net/protocol.h>
 #include <stdio.h>
+#include <string.h>
 #include <siri/siri.h>
 #include <siri/optimize.h>
 #include <qpack/qpack.h>
@@ -25,18 +26,16 @@
 void siridb_initsync_fopen(siridb_initsync_t * initsync, const char * opentype);
 static int INITSYNC_create_cb(siridb_series_t * series, FILE * fp);
 static void INITSYNC_work(uv_timer_t * timer);
-static void INITSYNC_next_series_id(siridb_t * siridb);
+static void INITSYNC_next(siridb_t * siridb);
 static int INITSYNC_unlink(siridb_initsync_t * initsync);
 static inline int INITSYNC_fn(siridb_t * siridb, siridb_initsync_t * initsync);
 static void INITSYNC_pause(siridb_replicate_t * replicate);
-static void INITSYNC_send(uv_timer_t * timer);
 static void INITSYNC_on_insert_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
         int status);
 
-static const long int SIZE2 = 2 * sizeof(uint32_t);
-static char sync_progress[30];
+static char sync_progress[64];
 
 
 /*
@@ -56,9 +55,11 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
     {
         initsync->fn = NULL;
         initsync->fp = NULL;
-        initsync->next_series_id = NULL;
-        initsync->pkg_points = NULL;
-        initsync->pkg_tags = NULL;
+        initsync->pos = 0;
+        initsync->window = 1;
+        initsync->nbatches = 0;
+        initsync->npoints = 0;
+        timeit_start(&initsync->start);
 
         if (INITSYNC_fn(siridb, initsync) < 0)
         {
@@ -74,13 +75,7 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
             }
             else
             {
-                initsync->next_series_id = malloc(sizeof(uint32_t));
-                if (initsync->next_series_id == NULL)
-                {
-                    ERR_ALLOC
-                    siridb_initsync_free(&initsync);
-                }
-                else if (create_new)
+                if (create_new)
                 {
                     if (imap_walk(
                                 siridb->series_map,
@@ -127,19 +122,8 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
                     }
                     else
                     {
-                        if (fseeko(initsync->fp, -sizeof(uint32_t), SEEK_END) ||
-                            fread(  initsync->next_series_id,
-                                    sizeof(uint32_t),
-                                    1,
-                                    initsync->fp) != 1)
-                        {
-                            ERR_FILE
-                            siridb_initsync_free(&initsync);
-                        }
-                        else
-                        {
-                            siri_optimize_pause();
-                        }
+                        initsync->pos = initsync->size;
+                        siri_optimize_pause();
                     }
                 }
             }
@@ -156,14 +140,17 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
  */
 void siridb_initsync_free(siridb_initsync_t ** initsync)
 {
+    size_t i;
+
     if ((*initsync)->fp != NULL && fclose((*initsync)->fp))
     {
         ERR_FILE
     }
     free((*initsync)->fn);
-    free((*initsync)->next_series_id);
-    free((*initsync)->pkg_points);
-    free((*initsync)->pkg_tags);
+    for (i = 0; i < (*initsync)->nbatches; i++)
+    {
+        siridb_sbatch_free((*initsync)->batches[i]);
+    }
     free(*initsync);
     *initsync = NULL;
 }
@@ -176,14 +163,15 @@ void siridb_initsync_run(uv_timer_t * timer)
     siridb_t * siridb = (siridb_t *) timer->data;
     uv_timer_start(
             timer,
-            (siridb->replicate->initsync->pkg_points == NULL) ?
-                    INITSYNC_work : INITSYNC_send,
+            INITSYNC_work,
             INITSYNC_SLEEP * siridb->tasks.active,
             0);
 }
 
 /*
- * Returns a human readable synchronization progress status
+ * Returns a human readable synchronization progress status including the
+ * number of points per second which are synchronized since the file was
+ * opened.
  */
 const char * siridb_initsync_sync_progress(siridb_t * siridb)
 {
@@ -193,13 +181,16 @@ const char * siridb_initsync_sync_progress(siridb_t * siridb)
     }
     else
     {
-        size_t num = siridb->replicate->initsync->size / sizeof(uint32_t);
+        siridb_initsync_t * initsync = siridb->replicate->initsync;
+        size_t num = initsync->size / sizeof(uint32_t);
         size_t total = siridb->series_map->len;
         double percent = 100 * (double) (total - num) / total;
+        double seconds = timeit_get(&initsync->start) / 1000;
 
         sprintf(sync_progress,
-                "approximately at %0.2f%%",
-                (0 > percent) ? 0 : percent);
+                "approximately at %0.2f%% (%" PRIu64 " points/s)",
+                (0 > percent) ? 0 : percent,
+                (seconds > 0) ? (uint64_t) (initsync->npoints / seconds) : 0);
     }
     return sync_progress;
 }
@@ -246,13 +237,77 @@ static void INITSYNC_on_empty_tags_response(
 }
 
 /*
- * Read the next series id and truncate the synchronization file to remove
- * the last synchronization id.
+ * Returns 1 when a batch is sent and waiting for a response, 0 if not.
+ */
+static int INITSYNC_is_waiting(siridb_initsync_t * initsync)
+{
+    size_t i;
+
+    for (i = 0; i < initsync->nbatches; i++)
+    {
+        if (initsync->batches[i]->sent && !initsync->batches[i]->done)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns 1 when a batch must be sent again after a write error, 0 if not.
+ */
+static int INITSYNC_has_unsent(siridb_initsync_t * initsync)
+{
+    size_t i;
+
+    for (i = 0; i < initsync->nbatches; i++)
+    {
+        if (!initsync->batches[i]->sent && !initsync->batches[i]->done)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Remove finished batches in the order they are sent and truncate the
+ * synchronization file.
+ *
+ * Returns 0 if successful or -1 in case of an error and a SIGNAL is raised.
+ */
+static int INITSYNC_truncate(siridb_t * siridb)
+{
+    siridb_initsync_t * initsync = siridb->replicate->initsync;
+    long int size = siridb_sbatch_shift(
+            initsync->batches,
+            &initsync->nbatches,
+            initsync->size);
+
+    if (size != initsync->size)
+    {
+        if (ftruncate(initsync->fd, size))
+        {
+            ERR_FILE
+            log_critical(
+                    "Truncating the synchronization file has failed "
+                    "(replicate status: %d)",
+                    siridb->replicate->status);
+            return -1;
+        }
+        initsync->size = size;
+    }
+    return 0;
+}
+
+/*
+ * Truncate the synchronization file for finished batches and schedule the
+ * next batch when the window allows another batch in flight.
  *
  * This function might destroy 'replicate->initsync' when initial
  * synchronization is finished.
  */
-static void INITSYNC_next_series_id(siridb_t * siridb)
+static void INITSYNC_next(siridb_t * siridb)
 {
     assert (siridb->replicate != NULL);
     assert (siridb->replicate->status == REPLICATE_RUNNING ||
@@ -260,34 +315,30 @@ static void INITSYNC_next_series_id(siridb_t * siridb)
 
     siridb_initsync_t * initsync = siridb->replicate->initsync;
 
-    /* free the current package (can be NULL already) */
-    free(initsync->pkg_points);
-    free(initsync->pkg_tags);
-    initsync->pkg_points = NULL;
-    initsync->pkg_tags = NULL;
+    if (INITSYNC_truncate(siridb))
+    {
+        return;  /* signal is raised */
+    }
 
-    if (initsync->size >= SIZE2)
+    if (initsync->size)
     {
-        initsync->size -= sizeof(uint32_t);
-        if (fseeko(initsync->fp, -SIZE2, SEEK_END) ||
-            fread(  initsync->next_series_id,
-                    sizeof(uint32_t),
-                    1,
-                    initsync->fp) != 1 ||
-            ftruncate(initsync->fd, initsync->size))
+        if (siridb->replicate->status == REPLICATE_STOPPING)
         {
-            ERR_FILE
-            log_critical(
-                    "Reading next series id has failed "
-                    "(replicate status: %d)",
-                    siridb->replicate->status);
-        }
-        else if (siridb->replicate->status == REPLICATE_STOPPING)
-        {
-            INITSYNC_pause(siridb->replicate);
+            /* the file is required until all responses are received */
+            if (!INITSYNC_is_waiting(initsync))
+            {
+                INITSYNC_pause(siridb->replicate);
+            }
         }
-        else
+        else if (
+            (initsync->pos && initsync->nbatches < initsync->window) ||
+            (INITSYNC_has_unsent(initsync) &&
+             !uv_is_active((uv_handle_t *) siridb->replicate->timer)))
         {
+            /*
+             * A batch which failed to write while stopping is not sent
+             * again by a retry, so it is sent by the next work.
+             */
             siridb_initsync_run(siridb->replicate->timer);
         }
     }
@@ -330,6 +381,10 @@ static void INITSYNC_next_series_id(siridb_t * siridb)
 static void INITSYNC_pause(siridb_replicate_t * replicate)
 {
     assert (replicate->status == REPLICATE_STOPPING);
+
+    /* a retry might be scheduled which must not run while paused */
+    uv_timer_stop(replicate->timer);
+
     if (fclose(replicate->initsync->fp))
     {
         log_critical("Error occurred while closing file: '%s'",
@@ -340,122 +395,141 @@ static void INITSYNC_pause(siridb_replicate_t * replicate)
 }
 
 /*
- * Type: uv_timer_cb
- *
- * This function sends a packed series to the replica server.
+ * Returns 0 when the package is sent or -1 when a retry is scheduled or a
+ * signal is raised.
  */
-static void INITSYNC_send(uv_timer_t * timer)
+static int INITSYNC_send(siridb_sbatch_t * batch)
 {
-    siridb_t * siridb = (siridb_t *) timer->data;
-    assert (siridb->replicate->initsync->pkg_points != NULL);
+    siridb_t * siridb = batch->siridb;
 
-    if (siridb->replicate->status == REPLICATE_STOPPING)
+    assert (batch->pkg_points != NULL);
+
+    if (!siridb_server_is_synchronizing(siridb->replica))
     {
-        INITSYNC_pause(siridb->replicate);
+        log_info("Cannot send initial replica package to '%s' "
+                "(try again in %d seconds)",
+                siridb->replica->name,
+                INITSYNC_RETRY / 1000);
+        siridb->replicate->initsync->window = 1;
+        uv_timer_start(
+                siridb->replicate->timer,
+                INITSYNC_work,
+                INITSYNC_RETRY,
+                0);
+        return -1;
     }
-    else
+
+    if (siridb_server_send_pkg(
+            siridb->replica,
+            batch->pkg_points,
+            INITSYNC_TIMEOUT,
+            (sirinet_promise_cb) INITSYNC_on_insert_response,
+            batch,
+            FLAG_KEEP_PKG))
     {
-        if (siridb_server_is_synchronizing(siridb->replica))
-        {
-            siridb_server_send_pkg(
-                    siridb->replica,
-                    siridb->replicate->initsync->pkg_points,
-                    INITSYNC_TIMEOUT,
-                    (sirinet_promise_cb) INITSYNC_on_insert_response,
-                    siridb,
-                    FLAG_KEEP_PKG);
-        }
-        else
-        {
-            log_info("Cannot send initial replica package to '%s' "
-                    "(try again in %d seconds)",
-                    siridb->replica->name,
-                    INITSYNC_RETRY / 1000);
-            uv_timer_start(
-                    siridb->replicate->timer,
-                    INITSYNC_send,
-                    INITSYNC_RETRY,
-                    0);
-        }
+        return -1;  /* signal is raised */
     }
+
+    batch->sent = 1;
+    return 0;
 }
 
-static void INITSYNC_work(uv_timer_t * timer)
+/*
+ * Returns a new batch with series from the end of the synchronization file
+ * and moves initsync->pos to the start of the batch.
+ *
+ * In case of an error NULL is returned and a SIGNAL is raised.
+ */
+static siridb_sbatch_t * INITSYNC_batch_new(siridb_t * siridb)
 {
-    siridb_t * siridb = (siridb_t *) timer->data;
-
-    assert (siridb->replicate->status == REPLICATE_RUNNING ||
-            siridb->replicate->status == REPLICATE_STOPPING);
-    assert (siridb->replicate->initsync != NULL);
-    assert (siridb->replicate->initsync->fp != NULL);
-    assert (siridb->replicate->initsync->pkg_points == NULL);
-    assert (siridb->replicate->initsync->pkg_tags == NULL);
+    siridb_initsync_t * initsync = siridb->replicate->initsync;
+    siridb_sbatch_t * batch;
+    size_t i;
+
+    batch = siridb_sbatch_new(
+            siridb,
+            initsync->fp,
+            initsync->pos,
+            BPROTO_INSERT_SERVER,
+            NULL);
+    if (batch == NULL)
+    {
+        log_critical(
+                "Cannot create a synchronization batch "
+                "(replicate status: %d)",
+                siridb->replicate->status);
+        return NULL;  /* signal is raised */
+    }
 
-    if (siridb->insert_tasks)
+    for (i = 0; i < batch->len; i++)
     {
-        siridb_initsync_run(timer);
-        return;
+        batch->series[i]->flags &= ~SIRIDB_SERIES_INIT_REPL;
     }
 
-    siridb_initsync_t * initsync = siridb->replicate->initsync;
-    siridb_series_t * series;
+    initsync->pos = batch->pos;
+    return batch;
+}
 
-    series = imap_get(siridb->series_map, *initsync->next_series_id);
+/*
+ * Type: uv_timer_cb
+ *
+ * Sends batches which could not be sent before and a new batch when the
+ * window allows.
+ */
+static void INITSYNC_work(uv_timer_t * timer)
+{
+    siridb_t * siridb = (siridb_t *) timer->data;
+    siridb_initsync_t * initsync = siridb->replicate->initsync;
+    siridb_sbatch_t * batch;
+    size_t i;
 
-    if (series != NULL)
+    if ((   siridb->replicate->status != REPLICATE_RUNNING &&
+            siridb->replicate->status != REPLICATE_STOPPING) ||
+            initsync == NULL ||
+            initsync->fp == NULL)
     {
-        uv_mutex_lock(&siridb->series_mutex);
-
-        siridb_points_t * points = siridb_series_get_points(
-                series,
-                NULL,
-                NULL);
-
-        uv_mutex_unlock(&siridb->series_mutex);
+        return;  /* initial synchronization is paused or finished */
+    }
 
-        if (points != NULL)
+    if (siridb->replicate->status == REPLICATE_RUNNING)
+    {
+        for (i = 0; i < initsync->nbatches; i++)
         {
-            qp_packer_t * packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
-            if (packer != NULL)
+            batch = initsync->batches[i];
+            if (!batch->done && !batch->sent && INITSYNC_send(batch))
             {
-                qp_add_type(packer, QP_MAP1);
-
-                /* add name including string terminator */
-                qp_add_raw(
-                        packer,
-                        (const unsigned char *) series->name,
-                        series->name_len + 1);
-
-                if (siridb_points_pack(points, packer) == 0)
-                {
-                    series->flags &= ~SIRIDB_SERIES_INIT_REPL;
+                return;  /* retry is scheduled or signal is raised */
+            }
+        }
 
-                    initsync->pkg_points = sirinet_packer2pkg(
-                            packer,
-                            0,
-                            BPROTO_INSERT_SERVER);
+        if (initsync->pos && initsync->nbatches < initsync->window)
+        {
+            if (siridb->insert_tasks)
+            {
+                siridb_initsync_run(timer);
+                return;
+            }
 
-                    initsync->pkg_tags = siridb_tags_series(series);
+            batch = INITSYNC_batch_new(siridb);
+            if (batch == NULL)
+            {
+                return;  /* signal is raised */
+            }
 
-                    uv_timer_start(
-                            siridb->replicate->timer,
-                            INITSYNC_send,
-                            0,
-                            0);
+            initsync->batches[initsync->nbatches++] = batch;
 
-                }
-                else
-                {
-                    qp_packer_free(packer);  /* signal is raised */
-                }
+            if (batch->pkg_points == NULL)
+            {
+                batch->done = 1;  /* none of the series exist */
+            }
+            else if (INITSYNC_send(batch))
+            {
+                return;  /* retry is scheduled or signal is raised */
             }
-            siridb_points_free(points);
         }
     }
-    else
-    {
-        INITSYNC_next_series_id(siridb);
-    }
+
+    INITSYNC_next(siridb);
 }
 
 /*
@@ -488,7 +562,10 @@ static void INITSYNC_on_insert_response(
         sirinet_pkg_t * pkg,
         int status)
 {
-    siridb_t * siridb = (siridb_t *) promise->data;
+    siridb_sbatch_t * batch = (siridb_sbatch_t *) promise->data;
+    siridb_t * siridb = batch->siridb;
+    siridb_initsync_t * initsync = siridb->replicate->initsync;
+    size_t i;
 
     switch ((sirinet_promise_status_t) status)
     {
@@ -496,11 +573,21 @@ static void INITSYNC_on_insert_response(
         /*
          * Write to socket error, data is not send so we should not commit.
          */
-        uv_timer_start(
-                siridb->replicate->timer,
-                INITSYNC_send,
-                INITSYNC_RETRY,
-                0);
+        batch->sent = 0;
+        initsync->window = 1;
+        if (siridb->replicate->status == REPLICATE_STOPPING)
+        {
+            /* no retry, the batch is sent again when replication resumes */
+            INITSYNC_next(siridb);
+        }
+        else
+        {
+            uv_timer_start(
+                    siridb->replicate->timer,
+                    INITSYNC_work,
+                    INITSYNC_RETRY,
+                    0);
+        }
         break;
     case PROMISE_TIMEOUT_ERROR:
         /*
@@ -520,7 +607,9 @@ static void INITSYNC_on_insert_response(
         log_error("Error occurred while sending series to the replica (%d)",
                 status);
         /* TODO: maybe write pkg to an error queue ? */
-        INITSYNC_next_series_id(siridb);
+        initsync->window = 1;
+        batch->done = 1;
+        INITSYNC_next(siridb);
         break;
     case PROMISE_SUCCESS:
         if (sirinet_protocol_is_error(pkg->tp))
@@ -530,17 +619,24 @@ static void INITSYNC_on_insert_response(
                     "(response type: %u)", pkg->tp);
             /* TODO: maybe write pkg to an error queue ? */
         }
-        if (siridb->replicate->initsync->pkg_tags)
+        for (i = 0; i < batch->len; i++)
         {
-            siridb_server_send_pkg(
+            if (batch->pkg_tags[i] != NULL && siridb_server_send_pkg(
                     siridb->replica,
-                    siridb->replicate->initsync->pkg_tags,
+                    batch->pkg_tags[i],
                     INITSYNC_TIMEOUT,
                     (sirinet_promise_cb) INITSYNC_on_tag_response,
                     NULL,
-                    FLAG_KEEP_PKG);
+                    0))
+            {
+                free(batch->pkg_tags[i]);
+            }
+            batch->pkg_tags[i] = NULL;
         }
-        INITSYNC_next_series_id(siridb);
+        siridb_sbatch_adapt(&initsync->window, siridb, promise->rtt);
+        initsync->npoints += batch->npoints;
+        batch->done = 1;
+        INITSYNC_next(siridb);
         break;
     default:
         assert (0);
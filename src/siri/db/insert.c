@@ -8,11 +8,13 @@
 #include <siri/db/buffer.h>
 #include <siri/db/forward.h>
 #include <siri/db/insert.h>
+#include <siri/db/itext.h>
 #include <siri/db/points.h>
 #include <siri/db/replicate.h>
 #include <siri/db/series.h>
 #include <siri/db/servers.h>
 #include <siri/err.h>
+#include <siri/metrics.h>
 #include <siri/net/promises.h>
 #include <siri/net/protocol.h>
 #include <siri/net/clserver.h>
@@ -40,9 +42,12 @@ if (*ts > series->end)              \
 static void INSERT_free(uv_handle_t * handle);
 static void INSERT_points_to_pools(uv_async_t * handle);
 static void INSERT_on_response(vec_t * promises, uv_async_t * handle);
-static uint16_t INSERT_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name);
 
 static void INSERT_local_free_cb(uv_async_t * handle);
+static void INSERT_local_fallback(siridb_insert_local_t * ilocal);
+static int8_t INSERT_local_work_batch(
+        siridb_t * siridb,
+        siridb_insert_local_t * ilocal);
 static int8_t INSERT_local_work(
         siridb_t * siridb,
         qp_unpacker_t * unpacker,
@@ -67,17 +72,20 @@ static int INSERT_init_local(
         siridb_t * siridb,
         sirinet_promises_t * promises,
         sirinet_pkg_t * pkg,
+        siridb_ibatch_t * ibatch,
         uint8_t flags);
 
 static ssize_t INSERT_assign_by_map(
         siridb_t * siridb,
         qp_unpacker_t * unpacker,
-        qp_packer_t * packer[]);
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch);
 
 static ssize_t INSERT_assign_by_array(
         siridb_t * siridb,
         qp_unpacker_t * unpacker,
         qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch,
         qp_packer_t * tmp_packer);
 
 static int INSERT_read_points(
@@ -85,7 +93,42 @@ static int INSERT_read_points(
         qp_packer_t * packer,
         qp_unpacker_t * unpacker,
         qp_obj_t * qp_obj,
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries,
         ssize_t * count);
+static siridb_ibatch_series_t * INSERT_batch_series(
+        siridb_t * siridb,
+        siridb_ibatch_t * ibatch,
+        uint16_t pool,
+        qp_packer_t * packer,
+        qp_obj_t * qp_series_name);
+
+typedef struct
+{
+    qp_packer_t * packer;       /* points for the series */
+    size_t len;
+    char name[];
+} INSERT_text_series_t;
+
+typedef struct
+{
+    siridb_t * siridb;
+    ct_t * lookup;              /* series name -> INSERT_text_series_t */
+    vec_t * series;             /* in order of appearance */
+    ssize_t count;
+    int strings;                /* -1 when not yet checked */
+} INSERT_text_t;
+
+static int INSERT_text_point(
+        siridb_itext_t * itext,
+        int64_t ts,
+        qp_obj_t * qp_val,
+        INSERT_text_t * itxt);
+static ssize_t INSERT_text_to_pools(
+        INSERT_text_t * itxt,
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch);
+static void INSERT_text_series_free(INSERT_text_series_t * tseries);
 
 /*
  * Return an error message for an insert err.
@@ -94,6 +137,8 @@ const char * siridb_insert_err_msg(siridb_insert_err_t err)
 {
     switch (err)
     {
+    case ERR_INVALID_TEXT_LINE:
+        return  "Invalid line in text data, expecting line protocol or CSV.";
     case ERR_EXPECTING_ARRAY:
         return  "Expecting an array with points.";
     case ERR_EXPECTING_SERIES_NAME:
@@ -141,6 +186,11 @@ void siridb_insert_free(siridb_insert_t * insert)
         }
     }
 
+    if (insert->ibatch != NULL)
+    {
+        siridb_ibatch_free(insert->ibatch);
+    }
+
     /* free insert */
     free(insert);
 }
@@ -149,6 +199,9 @@ void siridb_insert_free(siridb_insert_t * insert)
  * Returns a negative value in case of an error or a value equal to zero or
  * higher representing the number of points processed.
  *
+ * When 'ibatch' is not NULL, points for 'this' pool are collected in the
+ * batch as well so the local insert does not need to read them again.
+ *
  * This function can set a SIGNAL when not enough space in the packer can be
  * allocated for the points and ERR_MEM_ALLOC will be the return value if this
  * is the case.
@@ -156,7 +209,8 @@ void siridb_insert_free(siridb_insert_t * insert)
 ssize_t siridb_insert_assign_pools(
         siridb_t * siridb,
         qp_unpacker_t * unpacker,
-        qp_packer_t * packer[])
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch)
 {
     ssize_t rc = 0;
     qp_types_t tp;
@@ -164,7 +218,7 @@ ssize_t siridb_insert_assign_pools(
 
     if (qp_is_map(tp))
     {
-        rc = INSERT_assign_by_map(siridb, unpacker, packer);
+        rc = INSERT_assign_by_map(siridb, unpacker, packer, ibatch);
     }
     else if (qp_is_array(tp))
     {
@@ -179,6 +233,7 @@ ssize_t siridb_insert_assign_pools(
                     siridb,
                     unpacker,
                     packer,
+                    ibatch,
                     tmp_packer);
             qp_packer_free(tmp_packer);
         }
@@ -191,6 +246,74 @@ ssize_t siridb_insert_assign_pools(
     return (siri_err) ? ERR_MEM_ALLOC : rc;
 }
 
+/*
+ * Same as siridb_insert_assign_pools() but for line protocol or CSV data.
+ * The data is changed while reading. Points are first grouped by series so
+ * each series is written only once to a pool packer.
+ *
+ * Argument 'line' is set to the line number in case of an error.
+ */
+ssize_t siridb_insert_assign_text(
+        siridb_t * siridb,
+        int fmt,
+        char * data,
+        size_t n,
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch,
+        size_t * line)
+{
+    ssize_t rc;
+    struct timespec now;
+    INSERT_text_t itxt;
+    siridb_itext_t * itext = malloc(sizeof(siridb_itext_t));
+
+    itxt.siridb = siridb;
+    itxt.lookup = ct_new();
+    itxt.series = vec_new(VEC_DEFAULT_SIZE);
+    itxt.count = 0;
+    itxt.strings = -1;
+
+    if (itext == NULL || itxt.lookup == NULL || itxt.series == NULL)
+    {
+        ERR_ALLOC
+        rc = ERR_MEM_ALLOC;
+        goto done;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    itext->now = (int64_t) siridb_time_now(siridb, now);
+
+    rc = siridb_itext_parse(
+            itext,
+            fmt,
+            data,
+            n,
+            (siridb_itext_cb) INSERT_text_point,
+            &itxt);
+
+    *line = itext->line;
+
+    if (rc == 0)
+    {
+        rc = itxt.count
+                ? INSERT_text_to_pools(&itxt, packer, ibatch)
+                : ERR_EXPECTING_AT_LEAST_ONE_POINT;
+    }
+
+done:
+    if (itxt.series != NULL)
+    {
+        vec_destroy(itxt.series, (vec_destroy_cb) INSERT_text_series_free);
+    }
+    if (itxt.lookup != NULL)
+    {
+        ct_free(itxt.lookup, NULL);
+    }
+    free(itext);
+
+    return (siri_err) ? ERR_MEM_ALLOC : rc;
+}
+
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  */
@@ -221,6 +344,15 @@ siridb_insert_t * siridb_insert_new(
         /* n-points will be set later to the correct value */
         insert->npoints = 0;
 
+        /* a batch is only useful when the points are not tested */
+        insert->ibatch = NULL;
+        if ((~insert->flags & INSERT_FLAG_TEST) &&
+            (insert->ibatch = siridb_ibatch_new()) == NULL)
+        {
+            free(insert);
+            return NULL;  /* a signal is raised */
+        }
+
         /* save PID and client so we can respond to the client */
         insert->pid = pid;
         insert->client = client;
@@ -278,6 +410,61 @@ int siridb_insert_points_to_pools(siridb_insert_t * insert, size_t npoints)
     return 0;
 }
 
+/*
+ * Returns the correct pool for a series name.
+ */
+uint16_t siridb_insert_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name)
+{
+    uint16_t pool;
+
+    if (~siridb->flags & SIRIDB_FLAG_REINDEXING)
+    {
+        /* when not re-indexing, select the correct pool */
+        pool = siridb_lookup_sn_raw(
+                siridb->pools->lookup,
+                (const char *) qp_series_name->via.raw,
+                qp_series_name->len);
+    }
+    else
+    {
+        if (ct_getn(
+                siridb->series,
+                (const char *) qp_series_name->via.raw,
+                qp_series_name->len) != NULL)
+        {
+            /*
+             * we are re-indexing and at least at this moment still own the
+             * series
+             */
+            pool = siridb->server->pool;
+        }
+        else
+        {
+            /*
+             * We are re-indexing and do not have the series.
+             * Select the correct pool BEFORE re-indexing was
+             * started or the new correct pool if this pool is
+             * the previous correct pool. (we can do this now
+             * because we known we don't have the series)
+             */
+            assert (siridb->pools->prev_lookup != NULL);
+            pool = siridb_lookup_sn_raw(
+                    siridb->pools->prev_lookup,
+                    (const char *) qp_series_name->via.raw,
+                    qp_series_name->len);
+
+            if (pool == siridb->server->pool)
+            {
+                pool = siridb_lookup_sn_raw(
+                        siridb->pools->lookup,
+                        (const char *) qp_series_name->via.raw,
+                        qp_series_name->len);
+            }
+        }
+    }
+    return pool;
+}
+
 int insert_init_backend_local(
         siridb_t * siridb,
         sirinet_stream_t * client,
@@ -316,6 +503,8 @@ int insert_init_backend_local(
     ilocal->status = INSERT_LOCAL_CANCELLED;
     ilocal->forward = NULL;
     ilocal->pcache = NULL;
+    ilocal->ibatch = NULL;
+    ilocal->spkg = NULL;
 
     promise->pkg = sirinet_pkg_dup(pkg);
     if (promise->pkg == NULL)
@@ -347,7 +536,7 @@ int insert_init_backend_local(
 
     if (siridb_tee_is_configured(siridb->tee) && (flags & INSERT_FLAG_POOL))
     {
-        siridb_tee_write(siridb->tee, pkg);
+        ilocal->spkg = siridb_tee_write(siridb->tee, promise->pkg);
     }
 
     uv_async_init(siri.loop, handle, INSERT_local_task);
@@ -452,7 +641,14 @@ static void INSERT_local_free_cb(uv_async_t * handle)
     siridb_insert_local_t * ilocal = (siridb_insert_local_t *) handle->data;
 
     /* this destroys the pkg and unpacker */
-    free(ilocal->promise->pkg);
+    if (ilocal->spkg != NULL)
+    {
+        sirinet_spkg_decref(ilocal->spkg);
+    }
+    else
+    {
+        free(ilocal->promise->pkg);
+    }
 
     if (ilocal->forward != NULL)
     {
@@ -482,10 +678,150 @@ static void INSERT_local_free_cb(uv_async_t * handle)
     {
         siridb_pcache_free(ilocal->pcache);
     }
+    if (ilocal->ibatch != NULL)
+    {
+        siridb_ibatch_free(ilocal->ibatch);
+    }
     free(ilocal);
     free(handle);
 }
 
+/*
+ * Stop using the batch and continue with the qpack data, starting at the
+ * first series which is not processed. Must only be called when at least
+ * one series in the batch is left.
+ */
+static void INSERT_local_fallback(siridb_insert_local_t * ilocal)
+{
+    siridb_ibatch_t * ibatch = ilocal->ibatch;
+    qp_unpacker_t * unpacker = &ilocal->unpacker;
+
+    siridb_ibatch_series_t * bseries = ibatch->series + ibatch->pos;
+
+    assert (ibatch->pos < ibatch->len);
+
+    unpacker->pt = ilocal->promise->pkg->data + bseries->pos;
+    qp_next(unpacker, &ilocal->qp_series_name);
+
+    siridb_ibatch_free(ibatch);
+    ilocal->ibatch = NULL;
+}
+
+/*
+ * Returns insert->status
+ *
+ * Same as INSERT_local_work() but uses the points which are collected while
+ * assigning the points to pools. One lookup is required for each series and
+ * the points are added at once.
+ */
+static int8_t INSERT_local_work_batch(
+        siridb_t * siridb,
+        siridb_insert_local_t * ilocal)
+{
+    siridb_ibatch_t * ibatch = ilocal->ibatch;
+    siridb_ibatch_series_t * bseries;
+    siridb_series_t * series;
+    siridb_pcache_t * pcache;
+    siridb_point_t * point;
+    const char * series_name;
+    uint64_t * ts;
+    int n = INSERT_AT_ONCE;
+
+    /*
+     * we check for siri_err because siridb_series_add_point()
+     * should never be called twice on the same series after an
+     * error has occurred.
+     */
+    while ( !siri_err &&
+            ibatch->pos < ibatch->len &&
+            (n -= WEIGHT_SERIES) > 0)
+    {
+        bseries = ibatch->series + ibatch->pos;
+        series_name = siridb_ibatch_name(ibatch, bseries);
+        point = ibatch->points + bseries->offset;
+
+        if (*series_name == '\0')
+        {
+            siridb_ibatch_skip(ibatch);
+            continue;
+        }
+
+        series = (siridb_series_t *) ct_get(siridb->series, series_name);
+
+        if (series == NULL)
+        {
+            series = siridb_series_new(siridb, series_name, bseries->tp);
+            if (series == NULL)
+            {
+                log_critical("Error creating series: '%s'", series_name);
+                return INSERT_LOCAL_ERROR;  /* signal is raised */
+            }
+
+            n -= WEIGHT_NEW_SERIES;
+        }
+        else if (series->tp != bseries->tp)
+        {
+            /* values must be converted to the series type */
+            INSERT_local_fallback(ilocal);
+            return siri_err;
+        }
+
+        /* points are sorted so only the first and last are required */
+        ts = &point->ts;
+        SERIES_UPDATE_TS(series)
+        ts = &point[bseries->len - 1].ts;
+        SERIES_UPDATE_TS(series)
+
+        if (bseries->len == 1 && series->buffer != NULL)
+        {
+            ibatch->pos++;
+
+            if (siridb_series_add_point(
+                    siridb,
+                    series,
+                    &point->ts,
+                    &point->val))
+            {
+                return INSERT_LOCAL_ERROR;  /* signal is raised */
+            }
+        }
+        else
+        {
+            if (siridb_ibatch_pcache(ibatch, bseries, &ilocal->pcache))
+            {
+                return INSERT_LOCAL_ERROR;  /* signal is raised */
+            }
+
+            /* string values are now owned by the pcache */
+            ibatch->pos++;
+            pcache = ilocal->pcache;
+
+            if (siridb_series_add_pcache(siridb, series, pcache))
+            {
+                return INSERT_LOCAL_ERROR;  /* signal is raised */
+            }
+
+            if (pcache->tp == TP_STRING)
+            {
+                siridb_pcache_free(pcache);
+                ilocal->pcache = NULL;
+            }
+
+            n -= bseries->len;
+        }
+
+        if (series->length == 0)
+        {
+            if (siridb_series_drop(siridb, series))
+            {
+                siridb_series_flush_dropped(siridb);
+            }
+        }
+    }
+
+    return siri_err;  /* expected to be 0 */
+}
+
 /*
  * Returns insert->status
  */
@@ -886,6 +1222,7 @@ static void INSERT_local_task(uv_async_t * handle)
     siridb_insert_local_t * ilocal = (siridb_insert_local_t *) handle->data;
     qp_unpacker_t * unpacker = &ilocal->unpacker;
     siridb_t * siridb;
+    uint64_t start;
 
     /*
      * we check for siri_err because siridb_series_add_point()
@@ -898,7 +1235,9 @@ static void INSERT_local_task(uv_async_t * handle)
         return;
     }
 
-    if (!qp_is_raw_term(&ilocal->qp_series_name))
+    if ((ilocal->ibatch != NULL) ?
+            ilocal->ibatch->pos == ilocal->ibatch->len :
+            !qp_is_raw_term(&ilocal->qp_series_name))
     {
         ilocal->status = INSERT_LOCAL_SUCESS;
         uv_close((uv_handle_t *) handle, siri_async_close);
@@ -926,10 +1265,18 @@ static void INSERT_local_task(uv_async_t * handle)
     uv_mutex_lock(&siridb->series_mutex);
     uv_mutex_lock(&siridb->shards_mutex);
 
+    start = hist_now();
+
     if ((ilocal->flags & INSERT_FLAG_TEST) || (
             (siridb->flags & SIRIDB_FLAG_REINDEXING) &&
             (~ilocal->flags & INSERT_FLAG_TESTED)))
     {
+        if (ilocal->ibatch != NULL)
+        {
+            /* re-indexing has started, the points must be tested */
+            INSERT_local_fallback(ilocal);
+        }
+
         /*
          * We can use INSERT_local_work_test even if 'this' server has not set
          * the REINDEXING flag yet, since this does not depend on 'prev_lookup'
@@ -944,6 +1291,14 @@ static void INSERT_local_task(uv_async_t * handle)
             ilocal->status = INSERT_LOCAL_ERROR;
         }
     }
+    else if (ilocal->ibatch != NULL)
+    {
+        /* siri_err is raised in case of an error */
+        if (INSERT_local_work_batch(siridb, ilocal))
+        {
+            ilocal->status = INSERT_LOCAL_ERROR;
+        }
+    }
     else
     {
         /* siri_err is raised in case of an error */
@@ -957,6 +1312,8 @@ static void INSERT_local_task(uv_async_t * handle)
         }
     }
 
+    siri_metrics_since(SIRI_METRICS_INSERT_APPLY, start);
+
     if (siri.buffersync == NULL)
     {
         if (siridb_buffer_fsync(siridb->buffer))
@@ -1020,8 +1377,15 @@ static int INSERT_init_local(
         siridb_t * siridb,
         sirinet_promises_t * promises,
         sirinet_pkg_t * pkg,
+        siridb_ibatch_t * ibatch,
         uint8_t flags)
 {
+    if (ibatch != NULL && (ibatch->flags & IBATCH_FLAG_INVALID))
+    {
+        siridb_ibatch_free(ibatch);
+        ibatch = NULL;
+    }
+
     sirinet_promise_t * promise = malloc(sizeof(sirinet_promise_t));
     if (promise == NULL)
     {
@@ -1057,6 +1421,8 @@ static int INSERT_init_local(
     ilocal->status = INSERT_LOCAL_CANCELLED;
     ilocal->forward = NULL;
     ilocal->pcache = NULL;
+    ilocal->ibatch = ibatch;
+    ilocal->spkg = NULL;
 
     promise->pkg = pkg;
     promise->data = promises;
@@ -1077,7 +1443,7 @@ static int INSERT_init_local(
 
     if (siridb_tee_is_configured(siridb->tee))
     {
-        siridb_tee_write(siridb->tee, pkg);
+        ilocal->spkg = siridb_tee_write(siridb->tee, pkg);
     }
 
     uv_async_init(siri.loop, handle, INSERT_local_task);
@@ -1160,10 +1526,14 @@ static void INSERT_points_to_pools(uv_async_t * handle)
                     siridb,
                     promises,
                     pkg,
+                    insert->ibatch,
                     insert->flags) == 0)
             {
                 pool_count++;
             }
+
+            /* the batch is now owned by the local insert */
+            insert->ibatch = NULL;
         }
         else
         {
@@ -1201,61 +1571,6 @@ static void INSERT_points_to_pools(uv_async_t * handle)
     SIRINET_PROMISES_CHECK(promises)
 }
 
-/*
- * Returns the correct pool.
- */
-static uint16_t INSERT_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name)
-{
-    uint16_t pool;
-
-    if (~siridb->flags & SIRIDB_FLAG_REINDEXING)
-    {
-        /* when not re-indexing, select the correct pool */
-        pool = siridb_lookup_sn_raw(
-                siridb->pools->lookup,
-                (const char *) qp_series_name->via.raw,
-                qp_series_name->len);
-    }
-    else
-    {
-        if (ct_getn(
-                siridb->series,
-                (const char *) qp_series_name->via.raw,
-                qp_series_name->len) != NULL)
-        {
-            /*
-             * we are re-indexing and at least at this moment still own the
-             * series
-             */
-            pool = siridb->server->pool;
-        }
-        else
-        {
-            /*
-             * We are re-indexing and do not have the series.
-             * Select the correct pool BEFORE re-indexing was
-             * started or the new correct pool if this pool is
-             * the previous correct pool. (we can do this now
-             * because we known we don't have the series)
-             */
-            assert (siridb->pools->prev_lookup != NULL);
-            pool = siridb_lookup_sn_raw(
-                    siridb->pools->prev_lookup,
-                    (const char *) qp_series_name->via.raw,
-                    qp_series_name->len);
-
-            if (pool == siridb->server->pool)
-            {
-                pool = siridb_lookup_sn_raw(
-                        siridb->pools->lookup,
-                        (const char *) qp_series_name->via.raw,
-                        qp_series_name->len);
-            }
-        }
-    }
-    return pool;
-}
-
 /*
  * Returns a negative value in case of an error or a value equal to zero or
  * higher representing the number of points processed.
@@ -1266,12 +1581,14 @@ static uint16_t INSERT_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name)
 static ssize_t INSERT_assign_by_map(
         siridb_t * siridb,
         qp_unpacker_t * unpacker,
-        qp_packer_t * packer[])
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch)
 {
     int tp;  /* use int instead of qp_types_t for negative values */
     uint16_t pool;
     ssize_t count = 0;
     qp_obj_t qp_obj;
+    siridb_ibatch_series_t * bseries;
 
     tp = qp_next(unpacker, &qp_obj);
 
@@ -1279,7 +1596,19 @@ static ssize_t INSERT_assign_by_map(
             qp_obj.len &&
             qp_obj.len < SIRIDB_SERIES_NAME_LEN_MAX)
     {
-        pool = INSERT_get_pool(siridb, &qp_obj);
+        pool = siridb_insert_get_pool(siridb, &qp_obj);
+
+        bseries = INSERT_batch_series(
+                siridb,
+                ibatch,
+                pool,
+                packer[pool],
+                &qp_obj);
+
+        if (siri_err)
+        {
+            return ERR_MEM_ALLOC;
+        }
 
         qp_add_raw_term(packer[pool],
                 qp_obj.via.raw,
@@ -1290,6 +1619,8 @@ static ssize_t INSERT_assign_by_map(
                 packer[pool],
                 unpacker,
                 &qp_obj,
+                ibatch,
+                bseries,
                 &count)) < 0)
         {
             return tp;
@@ -1315,12 +1646,14 @@ static ssize_t INSERT_assign_by_array(
         siridb_t * siridb,
         qp_unpacker_t * unpacker,
         qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch,
         qp_packer_t * tmp_packer)
 {
     int tp;  /* use int instead of qp_types_t for negative values */
     uint16_t pool;
     ssize_t count = 0;
     qp_obj_t qp_obj;
+    siridb_ibatch_series_t * bseries;
     tp = qp_next(unpacker, &qp_obj);
 
     while (tp == QP_MAP2)
@@ -1337,6 +1670,8 @@ static ssize_t INSERT_assign_by_array(
                     tmp_packer,
                     unpacker,
                     &qp_obj,
+                    NULL,
+                    NULL,
                     &count)) < 0 || tp != QP_RAW)
             {
                 return (tp < 0) ? tp : ERR_EXPECTING_NAME_AND_POINTS;
@@ -1352,7 +1687,19 @@ static ssize_t INSERT_assign_by_array(
                 return ERR_EXPECTING_NAME_AND_POINTS;
             }
 
-            pool = INSERT_get_pool(siridb, &qp_obj);
+            pool = siridb_insert_get_pool(siridb, &qp_obj);
+
+            bseries = INSERT_batch_series(
+                    siridb,
+                    ibatch,
+                    pool,
+                    packer[pool],
+                    &qp_obj);
+
+            if (siri_err)
+            {
+                return ERR_MEM_ALLOC;
+            }
 
             qp_add_raw_term(packer[pool],
                     qp_obj.via.raw,
@@ -1365,6 +1712,11 @@ static ssize_t INSERT_assign_by_array(
 
         if (tmp_packer->len)
         {
+            if (bseries != NULL)
+            {
+                /* points are read before the series name */
+                ibatch->flags |= IBATCH_FLAG_INVALID;
+            }
             qp_packer_extend(packer[pool], tmp_packer);
             tmp_packer->len = 0;
             tp = qp_next(unpacker, &qp_obj);
@@ -1383,6 +1735,8 @@ static ssize_t INSERT_assign_by_array(
                     packer[pool],
                     unpacker,
                     &qp_obj,
+                    ibatch,
+                    bseries,
                     &count)) < 0)
             {
                 return tp;
@@ -1410,9 +1764,12 @@ static int INSERT_read_points(
         qp_packer_t * packer,
         qp_unpacker_t * unpacker,
         qp_obj_t * qp_obj,
+        siridb_ibatch_t * ibatch,
+        siridb_ibatch_series_t * bseries,
         ssize_t * count)
 {
     qp_types_t tp;
+    int64_t ts;
 
     if (!qp_is_array(qp_next(unpacker, NULL)))
     {
@@ -1442,7 +1799,8 @@ static int INSERT_read_points(
             return ERR_TIMESTAMP_OUT_OF_RANGE;
         }
 
-        qp_add_int64(packer, qp_obj->via.int64);
+        ts = qp_obj->via.int64;
+        qp_add_int64(packer, ts);
 
         switch (qp_next(unpacker, qp_obj))
         {
@@ -1466,6 +1824,12 @@ static int INSERT_read_points(
             return ERR_UNSUPPORTED_VALUE;
         }
 
+        if (bseries != NULL &&
+            siridb_ibatch_add_point(ibatch, bseries, ts, qp_obj))
+        {
+            return ERR_MEM_ALLOC;  /* signal is raised */
+        }
+
         if (tp == QP_ARRAY_OPEN && qp_next(unpacker, NULL) != QP_ARRAY_CLOSE)
             break;
     }
@@ -1480,6 +1844,27 @@ static int INSERT_read_points(
     return tp;
 }
 
+/*
+ * Returns a series in the batch when the series is for 'this' pool or NULL
+ * if not. (or when no batch is used)
+ *
+ * A SIGNAL is raised in case of an error.
+ */
+static siridb_ibatch_series_t * INSERT_batch_series(
+        siridb_t * siridb,
+        siridb_ibatch_t * ibatch,
+        uint16_t pool,
+        qp_packer_t * packer,
+        qp_obj_t * qp_series_name)
+{
+    return (ibatch == NULL || pool != siridb->server->pool) ?
+            NULL : siridb_ibatch_add_series(
+                    ibatch,
+                    (const char *) qp_series_name->via.raw,
+                    qp_series_name->len,
+                    packer->len - sizeof(sirinet_pkg_t));
+}
+
 /*
  * Used as uv_close_cb.
  */
@@ -1497,3 +1882,166 @@ static void INSERT_free(uv_handle_t * handle)
     free((uv_async_t *) handle);
 
 }
+
+/*
+ * Call-back for siridb_itext_parse(), adds a point to the series packer.
+ */
+static int INSERT_text_point(
+        siridb_itext_t * itext,
+        int64_t ts,
+        qp_obj_t * qp_val,
+        INSERT_text_t * itxt)
+{
+    INSERT_text_series_t * tseries;
+
+    if (!siridb_int64_valid_ts(itxt->siridb->time, ts))
+    {
+        return ERR_TIMESTAMP_OUT_OF_RANGE;
+    }
+
+    if (qp_val->tp == QP_RAW)
+    {
+        if (itxt->strings == -1)
+        {
+            itxt->strings =
+                    siridb_servers_check_version(itxt->siridb, "2.0.27") <= 0;
+        }
+        if (!itxt->strings)
+        {
+            return ERR_INCOMPATIBLE_SERVER_VERSION;
+        }
+    }
+
+    tseries = ct_get(itxt->lookup, itext->name);
+    if (tseries == NULL)
+    {
+        tseries = malloc(sizeof(INSERT_text_series_t) + itext->len + 1);
+        if (tseries == NULL)
+        {
+            ERR_ALLOC
+            return ERR_MEM_ALLOC;
+        }
+
+        tseries->len = itext->len;
+        memcpy(tseries->name, itext->name, itext->len + 1);
+        tseries->packer = qp_packer_new(QP_SUGGESTED_SIZE / 64);
+
+        if (tseries->packer == NULL ||
+            vec_append_safe(&itxt->series, tseries))
+        {
+            INSERT_text_series_free(tseries);
+            ERR_ALLOC
+            return ERR_MEM_ALLOC;
+        }
+
+        if (ct_add(itxt->lookup, tseries->name, tseries) != CT_OK)
+        {
+            ERR_ALLOC
+            return ERR_MEM_ALLOC;
+        }
+    }
+
+    qp_add_type(tseries->packer, QP_ARRAY2);
+    qp_add_int64(tseries->packer, ts);
+
+    switch (qp_val->tp)
+    {
+    case QP_INT64:
+        qp_add_int64(tseries->packer, qp_val->via.int64);
+        break;
+    case QP_DOUBLE:
+        qp_add_double(tseries->packer, qp_val->via.real);
+        break;
+    default:
+        qp_add_raw(tseries->packer, qp_val->via.raw, qp_val->len);
+        break;
+    }
+
+    itxt->count++;
+
+    return (siri_err) ? ERR_MEM_ALLOC : 0;
+}
+
+/*
+ * Write the grouped series to the pool packers.
+ *
+ * Returns the number of points or ERR_MEM_ALLOC and a SIGNAL is raised in
+ * case of an error.
+ */
+static ssize_t INSERT_text_to_pools(
+        INSERT_text_t * itxt,
+        qp_packer_t * packer[],
+        siridb_ibatch_t * ibatch)
+{
+    siridb_t * siridb = itxt->siridb;
+    INSERT_text_series_t * tseries;
+    siridb_ibatch_series_t * bseries;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_name, qp_ts, qp_val;
+    uint16_t pool;
+    size_t i;
+
+    for (i = 0; i < itxt->series->len; i++)
+    {
+        tseries = (INSERT_text_series_t *) itxt->series->data[i];
+
+        qp_name.tp = QP_RAW;
+        qp_name.len = tseries->len;
+        qp_name.via.raw = (unsigned char *) tseries->name;
+
+        pool = siridb_insert_get_pool(siridb, &qp_name);
+
+        bseries = INSERT_batch_series(
+                siridb,
+                ibatch,
+                pool,
+                packer[pool],
+                &qp_name);
+
+        if (siri_err)
+        {
+            return ERR_MEM_ALLOC;
+        }
+
+        qp_add_raw_term(packer[pool], qp_name.via.raw, qp_name.len);
+        qp_add_type(packer[pool], QP_ARRAY_OPEN);
+        qp_packer_extend(packer[pool], tseries->packer);
+        qp_add_type(packer[pool], QP_ARRAY_CLOSE);
+
+        if (bseries == NULL)
+        {
+            continue;
+        }
+
+        qp_unpacker_init(
+                &unpacker,
+                tseries->packer->buffer,
+                tseries->packer->len);
+
+        while (qp_next(&unpacker, NULL) == QP_ARRAY2)
+        {
+            (void) qp_next(&unpacker, &qp_ts);
+            (void) qp_next(&unpacker, &qp_val);
+
+            if (siridb_ibatch_add_point(
+                    ibatch,
+                    bseries,
+                    qp_ts.via.int64,
+                    &qp_val))
+            {
+                return ERR_MEM_ALLOC;  /* signal is raised */
+            }
+        }
+    }
+
+    return (siri_err) ? ERR_MEM_ALLOC : itxt->count;
+}
+
+static void INSERT_text_series_free(INSERT_text_series_t * tseries)
+{
+    if (tseries->packer != NULL)
+    {
+        qp_packer_free(tseries->packer);
+    }
+    free(tseries);
+}
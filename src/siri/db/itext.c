@@ -0,0 +1,726 @@
+/*
+ * itext.c - Tokenizer for text inserts. (line protocol and CSV)
+ */
+#include <assert.h>
+#include <siri/db/itext.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ITEXT_NUM_MAX 64    /* longer values are no numbers */
+
+#define ITEXT_CMP(s__, n__, w__) \
+    (n__ == strlen(w__) && memcmp(s__, w__, n__) == 0)
+
+static int ITEXT_line_protocol(
+        siridb_itext_t * itext,
+        char * pt,
+        char * end,
+        siridb_itext_cb cb,
+        void * arg);
+static int ITEXT_fields(
+        siridb_itext_t * itext,
+        char * key,
+        size_t key_len,
+        char ** pt_,
+        char * end,
+        int64_t ts,
+        siridb_itext_cb cb,
+        void * arg);
+static int ITEXT_lp_value(char * val, size_t n, qp_obj_t * qp_val);
+static int ITEXT_csv_row(
+        siridb_itext_t * itext,
+        char * pt,
+        char * end,
+        siridb_itext_cb cb,
+        void * arg);
+static int ITEXT_csv_table(
+        siridb_itext_t * itext,
+        char * header,
+        char * header_end,
+        char * pt,
+        char * end,
+        siridb_itext_cb cb,
+        void * arg);
+static int ITEXT_csv_cell(
+        char ** pt_,
+        char * end,
+        char * dst,
+        char ** cell,
+        size_t * len,
+        bool * quoted);
+static int ITEXT_csv_name(
+        siridb_itext_t * itext,
+        char ** pt,
+        char * end);
+static void ITEXT_csv_value(
+        char * cell,
+        size_t len,
+        bool quoted,
+        qp_obj_t * qp_val);
+static char * ITEXT_scan(char * pt, char * end, const char * stop);
+static size_t ITEXT_unescape(char * dst, const char * src, size_t n);
+static int ITEXT_int(const char * s, size_t n, int64_t * i);
+static int ITEXT_double(const char * s, size_t n, double * d);
+
+/*
+ * Tokenize text data and call 'cb' for each point.
+ *
+ * Returns 0 if successful or a negative siridb_insert_err_t in case of an
+ * error, in which case itext->line contains the line with the error.
+ */
+int siridb_itext_parse(
+        siridb_itext_t * itext,
+        int fmt,
+        char * data,
+        size_t n,
+        siridb_itext_cb cb,
+        void * arg)
+{
+    char * pt = data;
+    char * end = data + n;
+    char * eol;
+    char * line_end;
+    char * header = NULL;
+    char * header_end = NULL;
+    int rc;
+
+    for (itext->line = 1; pt < end; pt = eol + 1, itext->line++)
+    {
+        eol = memchr(pt, '\n', end - pt);
+        if (eol == NULL)
+        {
+            eol = end;
+        }
+
+        /* the line without white-space at the start and end */
+        line_end = eol;
+        for (; pt < line_end && (*pt == ' ' || *pt == '\t'); pt++);
+        for (;  line_end > pt && (
+                    line_end[-1] == '\r' ||
+                    line_end[-1] == ' ' ||
+                    line_end[-1] == '\t');
+                line_end--);
+
+        if (pt == line_end)
+        {
+            continue;
+        }
+
+        if (fmt == ITEXT_FMT_LINE)
+        {
+            rc = (*pt == '#') ? 0 : ITEXT_line_protocol(
+                    itext,
+                    pt,
+                    line_end,
+                    cb,
+                    arg);
+        }
+        else if (header != NULL)
+        {
+            rc = ITEXT_csv_table(
+                    itext,
+                    header,
+                    header_end,
+                    pt,
+                    line_end,
+                    cb,
+                    arg);
+        }
+        else if (*pt == ',')
+        {
+            /* the first line is a header with the series names */
+            header = pt + 1;
+            header_end = line_end;
+            rc = 0;
+        }
+        else
+        {
+            rc = ITEXT_csv_row(itext, pt, line_end, cb, arg);
+        }
+
+        if (rc)
+        {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+static int ITEXT_line_protocol(
+        siridb_itext_t * itext,
+        char * pt,
+        char * end,
+        siridb_itext_cb cb,
+        void * arg)
+{
+    char * key = pt;
+    char * fields;
+    size_t key_len;
+    int64_t ts;
+    int rc;
+
+    pt = ITEXT_scan(pt, end, " ");
+    if (pt == key)
+    {
+        return ERR_EXPECTING_SERIES_NAME;
+    }
+
+    key_len = pt - key;
+
+    for (; pt < end && *pt == ' '; pt++);
+    fields = pt;
+
+    /* first find the time-stamp which is written after the fields */
+    if ((rc = ITEXT_fields(itext, key, key_len, &pt, end, 0, NULL, NULL)))
+    {
+        return rc;
+    }
+
+    for (; pt < end && *pt == ' '; pt++);
+
+    if (pt == end)
+    {
+        ts = itext->now;
+    }
+    else if (ITEXT_int(pt, end - pt, &ts))
+    {
+        return ERR_EXPECTING_INTEGER_TS;
+    }
+
+    return ITEXT_fields(itext, key, key_len, &fields, end, ts, cb, arg);
+}
+
+/*
+ * Read the fields for a line. When no call-back is given, the fields are
+ * only skipped and 'pt_' is set to the end of the fields.
+ */
+static int ITEXT_fields(
+        siridb_itext_t * itext,
+        char * key,
+        size_t key_len,
+        char ** pt_,
+        char * end,
+        int64_t ts,
+        siridb_itext_cb cb,
+        void * arg)
+{
+    char * pt = *pt_;
+    char * field;
+    char * val;
+    size_t field_len, val_len;
+    qp_obj_t qp_val;
+    int rc;
+
+    while (1)
+    {
+        field = pt;
+        pt = ITEXT_scan(pt, end, "=, ");
+        if (pt == field || pt == end || *pt != '=')
+        {
+            return ERR_INVALID_TEXT_LINE;
+        }
+
+        field_len = pt - field;
+        val = ++pt;
+
+        if (pt < end && *pt == '"')
+        {
+            /* string value, unescape while reading */
+            char * dst = ++val;
+
+            for (++pt; pt < end && *pt != '"'; pt++)
+            {
+                if (*pt == '\\' && pt + 1 < end &&
+                    (pt[1] == '"' || pt[1] == '\\'))
+                {
+                    pt++;
+                }
+                if (cb != NULL)
+                {
+                    *dst = *pt;
+                }
+                dst++;
+            }
+
+            if (pt == end)
+            {
+                return ERR_INVALID_TEXT_LINE;
+            }
+
+            val_len = dst - val;
+            pt++;
+
+            qp_val.tp = QP_RAW;
+            qp_val.len = val_len;
+            qp_val.via.raw = (unsigned char *) val;
+        }
+        else
+        {
+            for (; pt < end && *pt != ',' && *pt != ' '; pt++);
+
+            val_len = pt - val;
+            if (!val_len || ITEXT_lp_value(val, val_len, &qp_val))
+            {
+                return ERR_UNSUPPORTED_VALUE;
+            }
+        }
+
+        if (cb != NULL)
+        {
+            if (key_len + 1 + field_len >= SIRIDB_SERIES_NAME_LEN_MAX)
+            {
+                return ERR_EXPECTING_SERIES_NAME;
+            }
+
+            itext->len = ITEXT_unescape(itext->name, key, key_len);
+            itext->name[itext->len++] = ' ';
+            itext->len += ITEXT_unescape(
+                    itext->name + itext->len,
+                    field,
+                    field_len);
+            itext->name[itext->len] = '\0';
+
+            if ((rc = cb(itext, ts, &qp_val, arg)))
+            {
+                return rc;
+            }
+        }
+
+        if (pt == end || *pt == ' ')
+        {
+            break;
+        }
+
+        if (*pt != ',')
+        {
+            return ERR_INVALID_TEXT_LINE;
+        }
+        pt++;
+    }
+
+    *pt_ = pt;
+    return 0;
+}
+
+/*
+ * Read an unquoted line protocol value.
+ *
+ * Returns 0 if successful or -1 if the value is not valid.
+ */
+static int ITEXT_lp_value(char * val, size_t n, qp_obj_t * qp_val)
+{
+    int64_t i;
+    double d;
+
+    switch (val[n - 1])
+    {
+    case 'i':
+        if (ITEXT_int(val, n - 1, &i))
+        {
+            return -1;
+        }
+        qp_val->tp = QP_INT64;
+        qp_val->via.int64 = i;
+        return 0;
+    case 'u':
+        if (*val == '-' || ITEXT_int(val, n - 1, &i))
+        {
+            return -1;
+        }
+        qp_val->tp = QP_INT64;
+        qp_val->via.int64 = i;
+        return 0;
+    }
+
+    if (    ITEXT_CMP(val, n, "t") ||
+            ITEXT_CMP(val, n, "T") ||
+            ITEXT_CMP(val, n, "true") ||
+            ITEXT_CMP(val, n, "True") ||
+            ITEXT_CMP(val, n, "TRUE"))
+    {
+        qp_val->tp = QP_INT64;
+        qp_val->via.int64 = 1;
+        return 0;
+    }
+
+    if (    ITEXT_CMP(val, n, "f") ||
+            ITEXT_CMP(val, n, "F") ||
+            ITEXT_CMP(val, n, "false") ||
+            ITEXT_CMP(val, n, "False") ||
+            ITEXT_CMP(val, n, "FALSE"))
+    {
+        qp_val->tp = QP_INT64;
+        qp_val->via.int64 = 0;
+        return 0;
+    }
+
+    if (ITEXT_double(val, n, &d))
+    {
+        return -1;
+    }
+
+    qp_val->tp = QP_DOUBLE;
+    qp_val->via.real = d;
+    return 0;
+}
+
+/*
+ * Read a CSV row with a series name, time-stamp and value.
+ */
+static int ITEXT_csv_row(
+        siridb_itext_t * itext,
+        char * pt,
+        char * end,
+        siridb_itext_cb cb,
+        void * arg)
+{
+    char * cell;
+    size_t len;
+    bool quoted;
+    int64_t ts;
+    qp_obj_t qp_val;
+    int rc;
+
+    if ((rc = ITEXT_csv_name(itext, &pt, end)))
+    {
+        return rc;
+    }
+
+    if (pt == end)
+    {
+        return ERR_INVALID_TEXT_LINE;
+    }
+
+    if (ITEXT_csv_cell(&pt, end, NULL, &cell, &len, &quoted) != 1)
+    {
+        return ERR_INVALID_TEXT_LINE;
+    }
+
+    if (quoted || ITEXT_int(cell, len, &ts))
+    {
+        return ERR_EXPECTING_INTEGER_TS;
+    }
+
+    if (ITEXT_csv_cell(&pt, end, NULL, &cell, &len, &quoted) != 0)
+    {
+        return ERR_INVALID_TEXT_LINE;
+    }
+
+    if (!len && !quoted)
+    {
+        return ERR_UNSUPPORTED_VALUE;
+    }
+
+    ITEXT_csv_value(cell, len, quoted, &qp_val);
+
+    return cb(itext, ts, &qp_val, arg);
+}
+
+/*
+ * Read a CSV table row with a time-stamp and a value for each series in the
+ * header. The header is read again for each row, so no memory is required
+ * for storing the series names.
+ */
+static int ITEXT_csv_table(
+        siridb_itext_t * itext,
+        char * header,
+        char * header_end,
+        char * pt,
+        char * end,
+        siridb_itext_cb cb,
+        void * arg)
+{
+    char * cell;
+    size_t len;
+    bool quoted;
+    int64_t ts;
+    qp_obj_t qp_val;
+    int more, rc;
+
+    more = ITEXT_csv_cell(&pt, end, NULL, &cell, &len, &quoted);
+    if (more < 0)
+    {
+        return ERR_INVALID_TEXT_LINE;
+    }
+
+    if (quoted || ITEXT_int(cell, len, &ts))
+    {
+        return ERR_EXPECTING_INTEGER_TS;
+    }
+
+    while (more)
+    {
+        if (header == header_end)
+        {
+            /* more values than series */
+            return ERR_INVALID_TEXT_LINE;
+        }
+
+        if ((rc = ITEXT_csv_name(itext, &header, header_end)))
+        {
+            return rc;
+        }
+
+        more = ITEXT_csv_cell(&pt, end, NULL, &cell, &len, &quoted);
+        if (more < 0)
+        {
+            return ERR_INVALID_TEXT_LINE;
+        }
+
+        if (!len && !quoted)
+        {
+            continue;
+        }
+
+        ITEXT_csv_value(cell, len, quoted, &qp_val);
+
+        if ((rc = cb(itext, ts, &qp_val, arg)))
+        {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read a CSV cell. A quoted cell is unescaped to 'dst', or in place when
+ * 'dst' is NULL. Argument 'pt_' is set to the start of the next cell.
+ *
+ * Returns 1 when more cells follow, 0 for the last cell or -1 in case of an
+ * error. ('dst' must be able to hold SIRIDB_SERIES_NAME_LEN_MAX characters)
+ */
+static int ITEXT_csv_cell(
+        char ** pt_,
+        char * end,
+        char * dst,
+        char ** cell,
+        size_t * len,
+        bool * quoted)
+{
+    char * pt = *pt_;
+    char * d;
+
+    *quoted = pt < end && *pt == '"';
+
+    if (*quoted)
+    {
+        d = *cell = dst ? dst : pt + 1;
+
+        for (pt++; pt < end; pt++)
+        {
+            if (*pt == '"')
+            {
+                if (pt + 1 == end || pt[1] != '"')
+                {
+                    break;
+                }
+                pt++;
+            }
+            if (dst && d - dst == SIRIDB_SERIES_NAME_LEN_MAX - 1)
+            {
+                return -1;
+            }
+            *d++ = *pt;
+        }
+
+        if (pt == end)
+        {
+            return -1;
+        }
+
+        *len = d - *cell;
+        pt++;
+    }
+    else
+    {
+        *cell = pt;
+        for (; pt < end && *pt != ','; pt++);
+        *len = pt - *cell;
+
+        if (dst)
+        {
+            if (*len >= SIRIDB_SERIES_NAME_LEN_MAX)
+            {
+                return -1;
+            }
+            memcpy(dst, *cell, *len);
+            *cell = dst;
+        }
+    }
+
+    if (pt == end)
+    {
+        *pt_ = pt;
+        return 0;
+    }
+
+    if (*pt != ',')
+    {
+        return -1;
+    }
+
+    *pt_ = pt + 1;
+    return 1;
+}
+
+/*
+ * Read a CSV cell with a series name to itext->name.
+ */
+static int ITEXT_csv_name(
+        siridb_itext_t * itext,
+        char ** pt,
+        char * end)
+{
+    char * cell;
+    bool quoted;
+
+    if (ITEXT_csv_cell(pt, end, itext->name, &cell, &itext->len, &quoted) < 0)
+    {
+        return ERR_INVALID_TEXT_LINE;
+    }
+
+    if (!itext->len)
+    {
+        return ERR_EXPECTING_SERIES_NAME;
+    }
+
+    itext->name[itext->len] = '\0';
+    return 0;
+}
+
+static void ITEXT_csv_value(
+        char * cell,
+        size_t len,
+        bool quoted,
+        qp_obj_t * qp_val)
+{
+    if (!quoted)
+    {
+        if (ITEXT_int(cell, len, &qp_val->via.int64) == 0)
+        {
+            qp_val->tp = QP_INT64;
+            return;
+        }
+        if (ITEXT_double(cell, len, &qp_val->via.real) == 0)
+        {
+            qp_val->tp = QP_DOUBLE;
+            return;
+        }
+    }
+
+    qp_val->tp = QP_RAW;
+    qp_val->len = len;
+    qp_val->via.raw = (unsigned char *) cell;
+}
+
+/*
+ * Returns a pointer to the first character in 'stop' which is not escaped
+ * with a backslash, or 'end' when not found.
+ */
+static char * ITEXT_scan(char * pt, char * end, const char * stop)
+{
+    for (; pt < end; pt++)
+    {
+        if (*pt == '\\')
+        {
+            if (++pt == end)
+            {
+                break;
+            }
+            continue;
+        }
+        if (strchr(stop, *pt) != NULL)
+        {
+            break;
+        }
+    }
+    return pt;
+}
+
+/*
+ * Copy a line protocol key to 'dst' without the backslash before an escaped
+ * comma, equal sign, space or backslash.
+ *
+ * Returns the number of characters written to 'dst'.
+ */
+static size_t ITEXT_unescape(char * dst, const char * src, size_t n)
+{
+    const char * end = src + n;
+    char * pt = dst;
+
+    for (; src < end; src++)
+    {
+        if (*src == '\\' && src + 1 < end && (
+                src[1] == ',' ||
+                src[1] == '=' ||
+                src[1] == ' ' ||
+                src[1] == '\\'))
+        {
+            src++;
+        }
+        *pt++ = *src;
+    }
+    return pt - dst;
+}
+
+/*
+ * Returns 0 if the string is a valid 64 bit integer or -1 if not.
+ */
+static int ITEXT_int(const char * s, size_t n, int64_t * i)
+{
+    const char * end = s + n;
+    bool negative = false;
+    uint64_t u = 0;
+    uint64_t max = INT64_MAX;
+
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = *s == '-';
+        s++;
+    }
+
+    if (s == end)
+    {
+        return -1;
+    }
+
+    if (negative)
+    {
+        max++;
+    }
+
+    for (; s < end; s++)
+    {
+        if (*s < '0' || *s > '9' || u > (max - (*s - '0')) / 10)
+        {
+            return -1;
+        }
+        u = u * 10 + (*s - '0');
+    }
+
+    *i = negative ? (int64_t) (0 - u) : (int64_t) u;
+    return 0;
+}
+
+/*
+ * Returns 0 if the string is a valid float or -1 if not.
+ */
+static int ITEXT_double(const char * s, size_t n, double * d)
+{
+    char buf[ITEXT_NUM_MAX];
+    char * end;
+
+    if (!n || n >= ITEXT_NUM_MAX || s[0] == ' ' || s[n - 1] == ' ')
+    {
+        return -1;
+    }
+
+    memcpy(buf, s, n);
+    buf[n] = '\0';
+
+    *d = strtod(buf, &end);
+
+    return (end == buf + n) ? 0 : -1;
+}
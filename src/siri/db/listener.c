@@ -16,12 +16,14 @@
 #include <siri/db/props.h>
 #include <siri/db/query.h>
 #include <siri/db/re.h>
+#include <siri/db/rollup.h>
 #include <siri/db/series.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
 #include <siri/db/tags.h>
+#include <siri/db/tdigest.h>
 #include <siri/db/user.h>
 #include <siri/db/users.h>
 #include <siri/db/listener.h>
@@ -30,10 +32,12 @@
 #include <siri/err.h>
 #include <siri/grammar/gramp.h>
 #include <siri/help/help.h>
+#include <siri/metrics.h>
 #include <siri/net/promises.h>
 #include <siri/net/protocol.h>
 #include <siri/net/clserver.h>
 #include <siri/net/tcp.h>
+#include <siri/prof.h>
 #include <siri/siri.h>
 #include <xstr/xstr.h>
 #include <sys/time.h>
@@ -42,6 +46,27 @@
 static uv_async_cb SIRIDB_NODE_ENTER[CLERI_END];
 static uv_async_cb SIRIDB_NODE_EXIT[CLERI_END];
 
+/* call-back names, used as profiler stages */
+static const char * LISTENER_ENTER_NAME[CLERI_END];
+static const char * LISTENER_EXIT_NAME[CLERI_END];
+
+#define LISTENER_ENTER(gid__, cb__)                 \
+do                                                  \
+{                                                   \
+    SIRIDB_NODE_ENTER[gid__] = cb__;                \
+    LISTENER_ENTER_NAME[gid__] = #cb__;             \
+} while (0)
+
+#define LISTENER_EXIT(gid__, cb__)                  \
+do                                                  \
+{                                                   \
+    SIRIDB_NODE_EXIT[gid__] = cb__;                 \
+    LISTENER_EXIT_NAME[gid__] = #cb__;              \
+} while (0)
+
+static const char * LISTENER_stage(siridb_nodes_t * nodes);
+static void LISTENER_continue(uv_async_t * handle);
+
 uv_async_cb siridb_node_get_enter(enum cleri_grammar_ids gid)
 {
     return SIRIDB_NODE_ENTER[gid];
@@ -52,6 +77,34 @@ uv_async_cb siridb_node_get_exit(enum cleri_grammar_ids gid)
     return SIRIDB_NODE_EXIT[gid];
 }
 
+/*
+ * Run the call-back of the current node. While the call-back is running, the
+ * profiler stage is set to the name of the call-back.
+ */
+void siridb_node_run(uv_async_t * handle)
+{
+    siridb_query_t * query = handle->data;
+    const char * prev = siri_prof_tag(LISTENER_stage(query->nodes));
+
+    query->nodes->cb(handle);
+
+    siri_prof_tag(prev);
+}
+
+/*
+ * Run the asynchronous call-back which continues the work of the current
+ * node. (see LISTENER_ASYNC_INIT)
+ */
+static void LISTENER_continue(uv_async_t * handle)
+{
+    siridb_query_t * query = handle->data;
+    const char * prev = siri_prof_tag(LISTENER_stage(query->nodes));
+
+    query->async_cb(handle);
+
+    siri_prof_tag(prev);
+}
+
 
 #define MAX_ITERATE_COUNT 10000       /* ten-thousand  */
 #define MAX_BATCH_REQUIRE_SHARD 100   /* after reading 100 shards, iterate  */
@@ -325,6 +378,22 @@ static void on_update_xxx_response(vec_t * promises, uv_async_t * handle);
 static void on_tag_response(vec_t * promises, uv_async_t * handle);
 
 /* helper functions */
+static int select_acache_points(
+        siridb_query_t * query,
+        siridb_series_t * series,
+        siridb_points_t ** points,
+        size_t * n_read);
+static siridb_points_t * select_acache_aggregate(
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+static siridb_points_t * select_aggregate_points(
+        siridb_series_t * series,
+        siridb_aggr_t * aggr,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        size_t * n_read,
+        char * err_msg);
 static void master_select_work(uv_work_t * handle);
 static void master_select_work_finish(uv_work_t * work, int status);
 static int items_select_master(
@@ -363,6 +432,19 @@ static void on_select_unpack_merged_points(
         qp_obj_t * qp_len,
         qp_obj_t * qp_points,
         uint32_t select_points_limit);
+static int select_pack_tdigests(
+        query_select_t * q_select,
+        vec_t * plist,
+        qp_packer_t * packer);
+static void select_unpack_tdigests(
+        query_select_t * q_select,
+        const char * name,
+        qp_obj_t * qp_points);
+static siridb_points_t * select_merge_tdigests(
+        query_select_t * q_select,
+        const char * name,
+        siridb_points_t * points,
+        char * err_msg);
 
 static int values_list_groups(siridb_group_t * group, uv_async_t * handle);
 static int values_count_groups(siridb_group_t * group, uv_async_t * handle);
@@ -407,11 +489,22 @@ else                                                                        \
     else                                                                    \
     {                                                                       \
         handle->data = query;                                               \
-        uv_async_init(siri.loop, handle, (uv_async_cb) query->nodes->cb);   \
+        uv_async_init(siri.loop, handle, siridb_node_run);                  \
         uv_async_send(handle);                                              \
     }                                                                       \
 }
 
+/*
+ * Initialize a handle which continues the work of the current node with an
+ * asynchronous call-back. The handle data must be set to the query.
+ */
+#define LISTENER_ASYNC_INIT(handle__, cb__)                                 \
+do                                                                          \
+{                                                                           \
+    ((siridb_query_t *) (handle__)->data)->async_cb = (uv_async_cb) (cb__); \
+    uv_async_init(siri.loop, handle__, LISTENER_continue);                  \
+} while (0)
+
 #define SIRIPARSER_NEXT_NODE            \
 siridb_nodes_next(&query->nodes);       \
 if (query->nodes == NULL)               \
@@ -421,7 +514,7 @@ if (query->nodes == NULL)               \
 else                                    \
 {                                       \
     handle->data = query;               \
-    query->nodes->cb(handle);           \
+    siridb_node_run(handle);            \
 }
 
 
@@ -447,120 +540,135 @@ void siridb_init_listener(void)
     {
         SIRIDB_NODE_ENTER[i] = NULL;
         SIRIDB_NODE_EXIT[i] = NULL;
-    }
-
-    SIRIDB_NODE_ENTER[CLERI_GID_ACCESS_EXPR] = enter_access_expr;
-    SIRIDB_NODE_ENTER[CLERI_GID_ALTER_GROUP] = enter_alter_group;
-    SIRIDB_NODE_ENTER[CLERI_GID_ALTER_SERIES] = enter_alter_series;
-    SIRIDB_NODE_ENTER[CLERI_GID_ALTER_SERVER] = enter_alter_server;
-    SIRIDB_NODE_ENTER[CLERI_GID_ALTER_SERVERS] = enter_alter_servers;
-    SIRIDB_NODE_ENTER[CLERI_GID_ALTER_STMT] = enter_alter_stmt;
-    SIRIDB_NODE_ENTER[CLERI_GID_ALTER_TAG] = enter_alter_tag;
-    SIRIDB_NODE_ENTER[CLERI_GID_ALTER_USER] = enter_alter_user;
-    SIRIDB_NODE_ENTER[CLERI_GID_COUNT_STMT] = enter_count_stmt;
-    SIRIDB_NODE_ENTER[CLERI_GID_CREATE_STMT] = enter_create_stmt;
-    SIRIDB_NODE_ENTER[CLERI_GID_CREATE_USER] = enter_create_user;
-    SIRIDB_NODE_ENTER[CLERI_GID_DROP_STMT] = enter_drop_stmt;
-    SIRIDB_NODE_ENTER[CLERI_GID_GRANT_USER] = enter_grant_user;
-    SIRIDB_NODE_ENTER[CLERI_GID_GROUP_COLUMNS] = enter_xxx_columns;
-    SIRIDB_NODE_ENTER[CLERI_GID_GROUP_TAG_MATCH] = enter_group_tag_match;
-    SIRIDB_NODE_ENTER[CLERI_GID_HELP_STMT] = enter_help;
-    SIRIDB_NODE_ENTER[CLERI_GID_LIMIT_EXPR] = enter_limit_expr;
-    SIRIDB_NODE_ENTER[CLERI_GID_LIST_STMT] = enter_list_stmt;
-    SIRIDB_NODE_ENTER[CLERI_GID_MERGE_AS] = enter_merge_as;
-    SIRIDB_NODE_ENTER[CLERI_GID_POOL_COLUMNS] = enter_xxx_columns;
-    SIRIDB_NODE_ENTER[CLERI_GID_REVOKE_USER] = enter_revoke_user;
-    SIRIDB_NODE_ENTER[CLERI_GID_SELECT_STMT] = enter_select_stmt;
-    SIRIDB_NODE_ENTER[CLERI_GID_SET_EXPRESSION] = enter_set_expression;
-    SIRIDB_NODE_ENTER[CLERI_GID_SET_IGNORE_THRESHOLD] = enter_set_ignore_threshold;
-    SIRIDB_NODE_ENTER[CLERI_GID_SET_NAME] = enter_set_name;
-    SIRIDB_NODE_ENTER[CLERI_GID_SET_PASSWORD] = enter_set_password;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERIES_COLUMNS] = enter_xxx_columns;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERVER_COLUMNS] = enter_xxx_columns;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERIES_ALL] = enter_series_all;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERIES_NAME] = enter_series_name;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERIES_MATCH] = enter_series_match;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERIES_PARENTHESES] = enter_series_parentheses;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERIES_RE] = enter_series_re;
-    SIRIDB_NODE_ENTER[CLERI_GID_SERIES_SETOPR] = enter_series_setopr;
-    SIRIDB_NODE_ENTER[CLERI_GID_SHARD_COLUMNS] = enter_xxx_columns;
-    SIRIDB_NODE_ENTER[CLERI_GID_TAG_COLUMNS] = enter_xxx_columns;
-    SIRIDB_NODE_ENTER[CLERI_GID_TAG_SERIES] = enter_tag_series;
-    SIRIDB_NODE_ENTER[CLERI_GID_TIMEIT_STMT] = enter_timeit_stmt;
-    SIRIDB_NODE_ENTER[CLERI_GID_UNTAG_SERIES] = enter_untag_series;
-    SIRIDB_NODE_ENTER[CLERI_GID_USER_COLUMNS] = enter_xxx_columns;
-    SIRIDB_NODE_ENTER[CLERI_GID_WHERE_GROUP] = enter_where_xxx;
-    SIRIDB_NODE_ENTER[CLERI_GID_WHERE_POOL] = enter_where_xxx;
-    SIRIDB_NODE_ENTER[CLERI_GID_WHERE_SERIES] = enter_where_xxx;
-    SIRIDB_NODE_ENTER[CLERI_GID_WHERE_SERVER] = enter_where_xxx;
-    SIRIDB_NODE_ENTER[CLERI_GID_WHERE_SHARD] = enter_where_xxx;
-    SIRIDB_NODE_ENTER[CLERI_GID_WHERE_TAG] = enter_where_xxx;
-    SIRIDB_NODE_ENTER[CLERI_GID_WHERE_USER] = enter_where_xxx;
-
-
-    SIRIDB_NODE_EXIT[CLERI_GID_AFTER_EXPR] = exit_after_expr;
-    SIRIDB_NODE_EXIT[CLERI_GID_ALTER_GROUP] = exit_alter_group;
-    SIRIDB_NODE_EXIT[CLERI_GID_ALTER_TAG] = exit_alter_tag;
-    SIRIDB_NODE_EXIT[CLERI_GID_ALTER_USER] = exit_alter_user;
-    SIRIDB_NODE_EXIT[CLERI_GID_BEFORE_EXPR] = exit_before_expr;
-    SIRIDB_NODE_EXIT[CLERI_GID_BETWEEN_EXPR] = exit_between_expr;
-    SIRIDB_NODE_EXIT[CLERI_GID_CALC_STMT] = exit_calc_stmt;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_GROUPS] = exit_count_groups;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_POOLS] = exit_count_pools;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_SERIES_LENGTH] = exit_count_series_length;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_SERIES] = exit_count_series;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_SERVERS_RECEIVED] = exit_count_servers_received;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_SERVERS_SELECTED] = exit_count_servers_selected;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_SERVERS] = exit_count_servers;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_SHARDS_SIZE] = exit_count_shards_size;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_SHARDS] = exit_count_shards;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_TAGS] = exit_count_tags;
-    SIRIDB_NODE_EXIT[CLERI_GID_COUNT_USERS] = exit_count_users;
-    SIRIDB_NODE_EXIT[CLERI_GID_CREATE_GROUP] = exit_create_group;
-    SIRIDB_NODE_EXIT[CLERI_GID_CREATE_USER] = exit_create_user;
-    SIRIDB_NODE_EXIT[CLERI_GID_DROP_GROUP] = exit_drop_group;
-    SIRIDB_NODE_EXIT[CLERI_GID_DROP_SERIES] = exit_drop_series;
-    SIRIDB_NODE_EXIT[CLERI_GID_DROP_SERVER] = exit_drop_server;
-    SIRIDB_NODE_EXIT[CLERI_GID_DROP_SHARDS] = exit_drop_shards;
-    SIRIDB_NODE_EXIT[CLERI_GID_DROP_TAG] = exit_drop_tag;
-    SIRIDB_NODE_EXIT[CLERI_GID_DROP_USER] = exit_drop_user;
-    SIRIDB_NODE_EXIT[CLERI_GID_GRANT_USER] = exit_grant_user;
-    SIRIDB_NODE_EXIT[CLERI_GID_HEAD_EXPR] = exit_head_expr;
-    SIRIDB_NODE_EXIT[CLERI_GID_LIST_GROUPS] = exit_list_groups;
-    SIRIDB_NODE_EXIT[CLERI_GID_LIST_POOLS] = exit_list_pools;
-    SIRIDB_NODE_EXIT[CLERI_GID_LIST_SERIES] = exit_list_series;
-    SIRIDB_NODE_EXIT[CLERI_GID_LIST_SERVERS] = exit_list_servers;
-    SIRIDB_NODE_EXIT[CLERI_GID_LIST_SHARDS] = exit_list_shards;
-    SIRIDB_NODE_EXIT[CLERI_GID_LIST_TAGS] = exit_list_tags;
-    SIRIDB_NODE_EXIT[CLERI_GID_LIST_USERS] = exit_list_users;
-    SIRIDB_NODE_EXIT[CLERI_GID_REVOKE_USER] = exit_revoke_user;
-    SIRIDB_NODE_EXIT[CLERI_GID_SELECT_AGGREGATE] = exit_select_aggregate;
-    SIRIDB_NODE_EXIT[CLERI_GID_SELECT_STMT] = exit_select_stmt;
-    SIRIDB_NODE_EXIT[CLERI_GID_SERIES_MATCH] = exit_series_match;
-    SIRIDB_NODE_EXIT[CLERI_GID_SERIES_PARENTHESES] = exit_series_parentheses;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_ADDRESS] = exit_set_address;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_BACKUP_MODE] = exit_set_backup_mode;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_DROP_THRESHOLD] = exit_set_drop_threshold;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_EXPIRATION_LOG] = exit_set_expiration_log;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_EXPIRATION_NUM] = exit_set_expiration_num;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_LIST_LIMIT] = exit_set_list_limit;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_LOG_LEVEL] = exit_set_log_level;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_PORT] = exit_set_port;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_SELECT_POINTS_LIMIT] = exit_set_select_points_limit;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_TEE] = exit_set_tee;
-    SIRIDB_NODE_EXIT[CLERI_GID_SET_TIMEZONE] = exit_set_timezone;
-    SIRIDB_NODE_EXIT[CLERI_GID_SHOW_STMT] = exit_show_stmt;
-    SIRIDB_NODE_EXIT[CLERI_GID_TAG_SERIES] = exit_tag_series;
-    SIRIDB_NODE_EXIT[CLERI_GID_TAIL_EXPR] = exit_tail_expr;
-    SIRIDB_NODE_EXIT[CLERI_GID_TIMEIT_STMT] = exit_timeit_stmt;
-    SIRIDB_NODE_EXIT[CLERI_GID_UNTAG_SERIES] = exit_untag_series;
+        LISTENER_ENTER_NAME[i] = NULL;
+        LISTENER_EXIT_NAME[i] = NULL;
+    }
+
+    LISTENER_ENTER(CLERI_GID_ACCESS_EXPR, enter_access_expr);
+    LISTENER_ENTER(CLERI_GID_ALTER_GROUP, enter_alter_group);
+    LISTENER_ENTER(CLERI_GID_ALTER_SERIES, enter_alter_series);
+    LISTENER_ENTER(CLERI_GID_ALTER_SERVER, enter_alter_server);
+    LISTENER_ENTER(CLERI_GID_ALTER_SERVERS, enter_alter_servers);
+    LISTENER_ENTER(CLERI_GID_ALTER_STMT, enter_alter_stmt);
+    LISTENER_ENTER(CLERI_GID_ALTER_TAG, enter_alter_tag);
+    LISTENER_ENTER(CLERI_GID_ALTER_USER, enter_alter_user);
+    LISTENER_ENTER(CLERI_GID_COUNT_STMT, enter_count_stmt);
+    LISTENER_ENTER(CLERI_GID_CREATE_STMT, enter_create_stmt);
+    LISTENER_ENTER(CLERI_GID_CREATE_USER, enter_create_user);
+    LISTENER_ENTER(CLERI_GID_DROP_STMT, enter_drop_stmt);
+    LISTENER_ENTER(CLERI_GID_GRANT_USER, enter_grant_user);
+    LISTENER_ENTER(CLERI_GID_GROUP_COLUMNS, enter_xxx_columns);
+    LISTENER_ENTER(CLERI_GID_GROUP_TAG_MATCH, enter_group_tag_match);
+    LISTENER_ENTER(CLERI_GID_HELP_STMT, enter_help);
+    LISTENER_ENTER(CLERI_GID_LIMIT_EXPR, enter_limit_expr);
+    LISTENER_ENTER(CLERI_GID_LIST_STMT, enter_list_stmt);
+    LISTENER_ENTER(CLERI_GID_MERGE_AS, enter_merge_as);
+    LISTENER_ENTER(CLERI_GID_POOL_COLUMNS, enter_xxx_columns);
+    LISTENER_ENTER(CLERI_GID_REVOKE_USER, enter_revoke_user);
+    LISTENER_ENTER(CLERI_GID_SELECT_STMT, enter_select_stmt);
+    LISTENER_ENTER(CLERI_GID_SET_EXPRESSION, enter_set_expression);
+    LISTENER_ENTER(CLERI_GID_SET_IGNORE_THRESHOLD, enter_set_ignore_threshold);
+    LISTENER_ENTER(CLERI_GID_SET_NAME, enter_set_name);
+    LISTENER_ENTER(CLERI_GID_SET_PASSWORD, enter_set_password);
+    LISTENER_ENTER(CLERI_GID_SERIES_COLUMNS, enter_xxx_columns);
+    LISTENER_ENTER(CLERI_GID_SERVER_COLUMNS, enter_xxx_columns);
+    LISTENER_ENTER(CLERI_GID_SERIES_ALL, enter_series_all);
+    LISTENER_ENTER(CLERI_GID_SERIES_NAME, enter_series_name);
+    LISTENER_ENTER(CLERI_GID_SERIES_MATCH, enter_series_match);
+    LISTENER_ENTER(CLERI_GID_SERIES_PARENTHESES, enter_series_parentheses);
+    LISTENER_ENTER(CLERI_GID_SERIES_RE, enter_series_re);
+    LISTENER_ENTER(CLERI_GID_SERIES_SETOPR, enter_series_setopr);
+    LISTENER_ENTER(CLERI_GID_SHARD_COLUMNS, enter_xxx_columns);
+    LISTENER_ENTER(CLERI_GID_TAG_COLUMNS, enter_xxx_columns);
+    LISTENER_ENTER(CLERI_GID_TAG_SERIES, enter_tag_series);
+    LISTENER_ENTER(CLERI_GID_TIMEIT_STMT, enter_timeit_stmt);
+    LISTENER_ENTER(CLERI_GID_UNTAG_SERIES, enter_untag_series);
+    LISTENER_ENTER(CLERI_GID_USER_COLUMNS, enter_xxx_columns);
+    LISTENER_ENTER(CLERI_GID_WHERE_GROUP, enter_where_xxx);
+    LISTENER_ENTER(CLERI_GID_WHERE_POOL, enter_where_xxx);
+    LISTENER_ENTER(CLERI_GID_WHERE_SERIES, enter_where_xxx);
+    LISTENER_ENTER(CLERI_GID_WHERE_SERVER, enter_where_xxx);
+    LISTENER_ENTER(CLERI_GID_WHERE_SHARD, enter_where_xxx);
+    LISTENER_ENTER(CLERI_GID_WHERE_TAG, enter_where_xxx);
+    LISTENER_ENTER(CLERI_GID_WHERE_USER, enter_where_xxx);
+
+
+    LISTENER_EXIT(CLERI_GID_AFTER_EXPR, exit_after_expr);
+    LISTENER_EXIT(CLERI_GID_ALTER_GROUP, exit_alter_group);
+    LISTENER_EXIT(CLERI_GID_ALTER_TAG, exit_alter_tag);
+    LISTENER_EXIT(CLERI_GID_ALTER_USER, exit_alter_user);
+    LISTENER_EXIT(CLERI_GID_BEFORE_EXPR, exit_before_expr);
+    LISTENER_EXIT(CLERI_GID_BETWEEN_EXPR, exit_between_expr);
+    LISTENER_EXIT(CLERI_GID_CALC_STMT, exit_calc_stmt);
+    LISTENER_EXIT(CLERI_GID_COUNT_GROUPS, exit_count_groups);
+    LISTENER_EXIT(CLERI_GID_COUNT_POOLS, exit_count_pools);
+    LISTENER_EXIT(CLERI_GID_COUNT_SERIES_LENGTH, exit_count_series_length);
+    LISTENER_EXIT(CLERI_GID_COUNT_SERIES, exit_count_series);
+    LISTENER_EXIT(CLERI_GID_COUNT_SERVERS_RECEIVED, exit_count_servers_received);
+    LISTENER_EXIT(CLERI_GID_COUNT_SERVERS_SELECTED, exit_count_servers_selected);
+    LISTENER_EXIT(CLERI_GID_COUNT_SERVERS, exit_count_servers);
+    LISTENER_EXIT(CLERI_GID_COUNT_SHARDS_SIZE, exit_count_shards_size);
+    LISTENER_EXIT(CLERI_GID_COUNT_SHARDS, exit_count_shards);
+    LISTENER_EXIT(CLERI_GID_COUNT_TAGS, exit_count_tags);
+    LISTENER_EXIT(CLERI_GID_COUNT_USERS, exit_count_users);
+    LISTENER_EXIT(CLERI_GID_CREATE_GROUP, exit_create_group);
+    LISTENER_EXIT(CLERI_GID_CREATE_USER, exit_create_user);
+    LISTENER_EXIT(CLERI_GID_DROP_GROUP, exit_drop_group);
+    LISTENER_EXIT(CLERI_GID_DROP_SERIES, exit_drop_series);
+    LISTENER_EXIT(CLERI_GID_DROP_SERVER, exit_drop_server);
+    LISTENER_EXIT(CLERI_GID_DROP_SHARDS, exit_drop_shards);
+    LISTENER_EXIT(CLERI_GID_DROP_TAG, exit_drop_tag);
+    LISTENER_EXIT(CLERI_GID_DROP_USER, exit_drop_user);
+    LISTENER_EXIT(CLERI_GID_GRANT_USER, exit_grant_user);
+    LISTENER_EXIT(CLERI_GID_HEAD_EXPR, exit_head_expr);
+    LISTENER_EXIT(CLERI_GID_LIST_GROUPS, exit_list_groups);
+    LISTENER_EXIT(CLERI_GID_LIST_POOLS, exit_list_pools);
+    LISTENER_EXIT(CLERI_GID_LIST_SERIES, exit_list_series);
+    LISTENER_EXIT(CLERI_GID_LIST_SERVERS, exit_list_servers);
+    LISTENER_EXIT(CLERI_GID_LIST_SHARDS, exit_list_shards);
+    LISTENER_EXIT(CLERI_GID_LIST_TAGS, exit_list_tags);
+    LISTENER_EXIT(CLERI_GID_LIST_USERS, exit_list_users);
+    LISTENER_EXIT(CLERI_GID_REVOKE_USER, exit_revoke_user);
+    LISTENER_EXIT(CLERI_GID_SELECT_AGGREGATE, exit_select_aggregate);
+    LISTENER_EXIT(CLERI_GID_SELECT_STMT, exit_select_stmt);
+    LISTENER_EXIT(CLERI_GID_SERIES_MATCH, exit_series_match);
+    LISTENER_EXIT(CLERI_GID_SERIES_PARENTHESES, exit_series_parentheses);
+    LISTENER_EXIT(CLERI_GID_SET_ADDRESS, exit_set_address);
+    LISTENER_EXIT(CLERI_GID_SET_BACKUP_MODE, exit_set_backup_mode);
+    LISTENER_EXIT(CLERI_GID_SET_DROP_THRESHOLD, exit_set_drop_threshold);
+    LISTENER_EXIT(CLERI_GID_SET_EXPIRATION_LOG, exit_set_expiration_log);
+    LISTENER_EXIT(CLERI_GID_SET_EXPIRATION_NUM, exit_set_expiration_num);
+    LISTENER_EXIT(CLERI_GID_SET_LIST_LIMIT, exit_set_list_limit);
+    LISTENER_EXIT(CLERI_GID_SET_LOG_LEVEL, exit_set_log_level);
+    LISTENER_EXIT(CLERI_GID_SET_PORT, exit_set_port);
+    LISTENER_EXIT(CLERI_GID_SET_SELECT_POINTS_LIMIT, exit_set_select_points_limit);
+    LISTENER_EXIT(CLERI_GID_SET_TEE, exit_set_tee);
+    LISTENER_EXIT(CLERI_GID_SET_TIMEZONE, exit_set_timezone);
+    LISTENER_EXIT(CLERI_GID_SHOW_STMT, exit_show_stmt);
+    LISTENER_EXIT(CLERI_GID_TAG_SERIES, exit_tag_series);
+    LISTENER_EXIT(CLERI_GID_TAIL_EXPR, exit_tail_expr);
+    LISTENER_EXIT(CLERI_GID_TIMEIT_STMT, exit_timeit_stmt);
+    LISTENER_EXIT(CLERI_GID_UNTAG_SERIES, exit_untag_series);
 
     for (i = HELP_OFFSET; i < HELP_OFFSET + HELP_COUNT; i++)
     {
-        SIRIDB_NODE_EXIT[i] = exit_help_xxx;
+        LISTENER_EXIT(i, exit_help_xxx);
     }
 }
 
+/*
+ * Returns the profiler stage for a node. Call-backs which are not found in
+ * the enter and exit tables are set by a listener function while running.
+ */
+static const char * LISTENER_stage(siridb_nodes_t * nodes)
+{
+    uint32_t gid = nodes->node->cl_obj->gid;
+
+    return (nodes->cb == SIRIDB_NODE_ENTER[gid]) ? LISTENER_ENTER_NAME[gid] :
+           (nodes->cb == SIRIDB_NODE_EXIT[gid]) ? LISTENER_EXIT_NAME[gid] :
+           "listener";
+}
+
 /******************************************************************************
  * Enter functions
  *****************************************************************************/
@@ -881,6 +989,187 @@ static void enter_grant_user(uv_async_t * handle)
         SIRIPARSER_NEXT_NODE
     }
 }
+typedef struct
+{
+    imap_t * series_map;    /* global series map */
+    imap_t * dest;          /* query series map */
+} LISTENER_bits_match_t;
+
+static int LISTENER_bits_union__cb(uint32_t id, LISTENER_bits_match_t * w)
+{
+    siridb_series_t * series = imap_get(w->series_map, id);
+
+    if (series != NULL && imap_add(w->dest, id, series) == 0)
+    {
+        siridb_series_incref(series);
+    }
+    return 0;
+}
+
+static int LISTENER_bits_symmetric_difference__cb(
+        uint32_t id,
+        LISTENER_bits_match_t * w)
+{
+    siridb_series_t * series = imap_get(w->series_map, id);
+
+    if (series == NULL)
+    {
+        return 0;
+    }
+
+    if (imap_pop(w->dest, id) != NULL)
+    {
+        /* we are sure the global series map has a reference left */
+        siridb_series_decref(series);
+    }
+    else if (imap_add(w->dest, id, series) == 0)
+    {
+        siridb_series_incref(series);
+    }
+    return 0;
+}
+
+/*
+ * Main thread.
+ *
+ * Update the query series map with a bitmap of series ids, for example the
+ * series of a tag. Series are resolved using the global series map only
+ * when they need to be added to the query series map.
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error.
+ */
+static int LISTENER_bits_match(
+        siridb_t * siridb,
+        query_wrapper_t * q_wrapper,
+        rbits_t * bits)
+{
+    LISTENER_bits_match_t w = {
+            .series_map = siridb->series_map,
+            .dest = q_wrapper->series_map,
+    };
+
+    if (    q_wrapper->update_cb == NULL ||
+            q_wrapper->update_cb == &imap_union_ref)
+    {
+        rbits_walk(bits, (rbits_cb) LISTENER_bits_union__cb, &w);
+    }
+    else if (q_wrapper->update_cb == &imap_symmetric_difference_ref)
+    {
+        rbits_walk(
+                bits,
+                (rbits_cb) LISTENER_bits_symmetric_difference__cb,
+                &w);
+    }
+    else
+    {
+        /* intersection or difference, we only need to remove series */
+        int keep = q_wrapper->update_cb == &imap_intersection_ref;
+        siridb_series_t * series;
+        vec_t * vec = imap_vec_pop(q_wrapper->series_map);
+        size_t i;
+
+        if (vec == NULL)
+        {
+            return -1;
+        }
+
+        for (i = 0; i < vec->len; i++)
+        {
+            series = (siridb_series_t *) vec->data[i];
+            if (rbits_has(bits, series->id) != keep &&
+                imap_pop(q_wrapper->series_map, series->id) != NULL)
+            {
+                siridb_series_decref(series);
+            }
+        }
+
+        vec_free(vec);
+    }
+
+    return 0;
+}
+
+/*
+ * Main thread.
+ *
+ * Start an operand of a series expression. The first operand is added to
+ * the query series map directly; other operands only collect series ids
+ * which are combined with the query series map by LISTENER_operand_done().
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error.
+ */
+static int LISTENER_operand_init(query_wrapper_t * q_wrapper)
+{
+    assert (q_wrapper->series_bits == NULL);
+
+    if (q_wrapper->update_cb != NULL)
+    {
+        q_wrapper->series_bits = rbits_new();
+        if (q_wrapper->series_bits == NULL)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Main thread.
+ *
+ * Add a series to the current operand. The reference to the series is
+ * consumed by this function.
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error.
+ */
+static int LISTENER_operand_add(
+        query_wrapper_t * q_wrapper,
+        siridb_series_t * series)
+{
+    int rc;
+
+    if (q_wrapper->series_bits == NULL)
+    {
+        rc = imap_add(q_wrapper->series_map, series->id, series);
+        if (rc == 0)
+        {
+            return 0;  /* the reference is moved to the series map */
+        }
+    }
+    else
+    {
+        rc = rbits_add(q_wrapper->series_bits, series->id);
+    }
+
+    siridb_series_decref(series);
+    return rc == -1 ? -1 : 0;
+}
+
+/*
+ * Main thread.
+ *
+ * Combine the current operand with the query series map.
+ *
+ * Returns 0 if successful or -1 in case of a memory allocation error.
+ */
+static int LISTENER_operand_done(
+        siridb_t * siridb,
+        query_wrapper_t * q_wrapper)
+{
+    int rc;
+
+    if (q_wrapper->series_bits == NULL)
+    {
+        return 0;
+    }
+
+    rc = LISTENER_bits_match(siridb, q_wrapper, q_wrapper->series_bits);
+
+    rbits_free(q_wrapper->series_bits);
+    q_wrapper->series_bits = NULL;
+
+    return rc;
+}
+
 static void enter_group_tag_match(uv_async_t * handle)
 {
     siridb_query_t * query = handle->data;
@@ -912,73 +1201,54 @@ static void enter_group_tag_match(uv_async_t * handle)
                 group_or_tag_name);
         siridb_query_send_error(handle, CPROTO_ERR_QUERY);
     }
-    else
+    else if (group == NULL)
     {
-        siridb_series_t * series;
-        size_t i;
+        int rc;
 
-        q_wrapper->series_tmp = (q_wrapper->update_cb == NULL) ?
-                q_wrapper->series_map : imap_new();
+        assert (tag != NULL);
 
-        if (q_wrapper->series_tmp == NULL)
-        {
-            MEM_ERR_RET
-        }
+        uv_mutex_lock(&siridb->tags->mutex);
 
-        if (group)
-        {
-            uv_mutex_lock(&siridb->groups->mutex);
+        rc = LISTENER_bits_match(siridb, q_wrapper, tag->series);
 
-            for (i = 0; i < group->series->len; i++)
-            {
-                series = (siridb_series_t *) group->series->data[i];
-                siridb_series_incref(series);
-                if (imap_add(q_wrapper->series_tmp, series->id, series))
-                {
-                    log_critical("Cannot add series to temporary map.");
-                    siridb_series_decref(series);
-                }
-            }
+        uv_mutex_unlock(&siridb->tags->mutex);
 
-            uv_mutex_unlock(&siridb->groups->mutex);
-        }
-        else if (tag)  /* check to prevent compile warning */
+        if (rc)
         {
-            vec_t * tag_series;
+            MEM_ERR_RET
+        }
 
-            assert (tag != NULL);
+        SIRIPARSER_ASYNC_NEXT_NODE
+    }
+    else
+    {
+        siridb_series_t * series;
+        size_t i;
 
-            uv_mutex_lock(&siridb->tags->mutex);
+        if (LISTENER_operand_init(q_wrapper))
+        {
+            MEM_ERR_RET
+        }
 
-            tag_series = imap_vec(tag->series);
+        uv_mutex_lock(&siridb->groups->mutex);
 
-            if (tag_series != NULL)
+        for (i = 0; i < group->series->len; i++)
+        {
+            series = (siridb_series_t *) group->series->data[i];
+            siridb_series_incref(series);
+            if (LISTENER_operand_add(q_wrapper, series))
             {
-                for (i = 0; i < tag_series->len; i++)
-                {
-                    series = (siridb_series_t *) tag_series->data[i];
-                    siridb_series_incref(series);
-                    if (imap_add(q_wrapper->series_tmp, series->id, series))
-                    {
-                        log_critical("Cannot add series to temporary map.");
-                        siridb_series_decref(series);
-                    }
-                }
+                log_critical("Cannot add series to temporary map.");
             }
-
-            uv_mutex_unlock(&siridb->tags->mutex);
         }
 
-        if (q_wrapper->update_cb != NULL)
+        uv_mutex_unlock(&siridb->groups->mutex);
+
+        if (LISTENER_operand_done(siridb, q_wrapper))
         {
-            (*q_wrapper->update_cb)(
-                    q_wrapper->series_map,
-                    q_wrapper->series_tmp,
-                    (imap_free_cb) &siridb__series_decref);
+            MEM_ERR_RET
         }
 
-        q_wrapper->series_tmp = NULL;
-
         SIRIPARSER_ASYNC_NEXT_NODE
     }
 }
@@ -1074,7 +1344,8 @@ static void enter_merge_as(uv_async_t * handle)
 
     xstr_extract_string(q_select->merge_as, node->str, node->len);
 
-    if (IS_MASTER && query->nodes->node->children->next->next->next != NULL)
+    /* pools use the list to send t-digests for percentile() */
+    if (query->nodes->node->children->next->next->next != NULL)
     {
         q_select->mlist = siridb_aggregate_list(
                 cleri_gn(cleri_gn(cleri_gn(
@@ -1533,20 +1804,15 @@ static void enter_series_all(uv_async_t * handle)
 
     uv_mutex_unlock(&siridb->series_mutex);
 
-    q_wrapper->series_tmp = (q_wrapper->update_cb == NULL) ?
-            q_wrapper->series_map : imap_new();
-
-    if (q_wrapper->vec == NULL || q_wrapper->series_tmp == NULL)
+    if (q_wrapper->vec == NULL || LISTENER_operand_init(q_wrapper))
     {
         MEM_ERR_RET
     }
 
-    for (q_wrapper->vec_index = 0;
-         q_wrapper->vec_index < q_wrapper->vec->len;
-         ++q_wrapper->vec_index)
+    while (q_wrapper->vec_index < q_wrapper->vec->len)
     {
-        series = q_wrapper->vec->data[q_wrapper->vec_index];
-        if (imap_add(q_wrapper->series_tmp, series->id, series))
+        series = q_wrapper->vec->data[q_wrapper->vec_index++];
+        if (LISTENER_operand_add(q_wrapper, series))
         {
             MEM_ERR_RET
         }
@@ -1556,15 +1822,11 @@ static void enter_series_all(uv_async_t * handle)
     q_wrapper->vec = NULL;
     q_wrapper->vec_index = 0;
 
-    if (q_wrapper->update_cb != NULL)
+    if (LISTENER_operand_done(siridb, q_wrapper))
     {
-        (*q_wrapper->update_cb)(
-                q_wrapper->series_map,
-                q_wrapper->series_tmp,
-                (imap_free_cb) &siridb__series_decref);
+        MEM_ERR_RET
     }
 
-    q_wrapper->series_tmp = NULL;
     SIRIPARSER_ASYNC_NEXT_NODE
 }
 
@@ -1604,10 +1866,7 @@ static void enter_series_re(uv_async_t * handle)
 
         uv_mutex_unlock(&siridb->series_mutex);
 
-        q_wrapper->series_tmp = (q_wrapper->update_cb == NULL) ?
-                q_wrapper->series_map : imap_new();
-
-        if (q_wrapper->vec == NULL || q_wrapper->series_tmp == NULL)
+        if (q_wrapper->vec == NULL || LISTENER_operand_init(q_wrapper))
         {
             MEM_ERR_RET
         }
@@ -1621,10 +1880,7 @@ static void enter_series_re(uv_async_t * handle)
 
         next->data = handle->data;
 
-        uv_async_init(
-                siri.loop,
-                next,
-                (uv_async_cb) async_series_re);
+        LISTENER_ASYNC_INIT(next, async_series_re);
         uv_async_send(next);
 
         uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -1668,28 +1924,30 @@ typedef struct
 
 static int LISTENER_tag__cb(siridb_series_t * series, LISTENER_tag_t * w)
 {
-    int rc = cexpr_run(
+    int rc = w->where_expr == NULL || cexpr_run(
         w->where_expr,
         (cexpr_cb_t) siridb_series_cexpr_cb,
         series);
 
-    if (rc == 0 || imap_add(w->tag->series, series->id, series) != 0)
+    if (rc == 1 && rbits_add(w->tag->series, series->id) < 0)
     {
-        siridb_series_decref(series);
+        log_critical("Cannot add series '%s' to tag.", series->name);
     }
+
+    siridb_series_decref(series);
     return rc;
 }
 
 static int LISTENER_untag__cb(siridb_series_t * series, LISTENER_tag_t * w)
 {
-    int rc = cexpr_run(
+    int rc = w->where_expr == NULL || cexpr_run(
         w->where_expr,
         (cexpr_cb_t) siridb_series_cexpr_cb,
         series);
 
-    if (rc == 1 && imap_pop(w->tag->series, series->id) == series)
+    if (rc == 1)
     {
-        siridb_series_decref(series);
+        rbits_remove(w->tag->series, series->id);
     }
 
     siridb_series_decref(series);
@@ -1752,27 +2010,14 @@ static void enter_tag_series(uv_async_t * handle)
         uv_mutex_lock(&siridb->tags->mutex);
     }
 
-    if (q_alter->where_expr == NULL)
-    {
-        q_alter->n = q_alter->series_map->len;
-
-        imap_union_ref(
-                tag->series,
-                q_alter->series_map,
-                (imap_free_cb) &siridb__series_decref);
-    }
-    else
-    {
-        LISTENER_tag_t w = {
-                .where_expr = q_alter->where_expr,
-                .tag = tag,
-        };
+    LISTENER_tag_t w = {
+            .where_expr = q_alter->where_expr,
+            .tag = tag,
+    };
 
-        q_alter->n = imap_walk(
-                q_alter->series_map, (imap_cb) LISTENER_tag__cb, &w);
+    q_alter->n = imap_walk(q_alter->series_map, (imap_cb) LISTENER_tag__cb, &w);
 
-        imap_free(q_alter->series_map, NULL);
-    }
+    imap_free(q_alter->series_map, NULL);
 
     siridb_tags_set_require_save(siridb->tags, tag);
 
@@ -1846,27 +2091,14 @@ static void enter_untag_series(uv_async_t * handle)
 
     uv_mutex_lock(&siridb->tags->mutex);
 
-    if (q_alter->where_expr == NULL)
-    {
-        q_alter->n = q_alter->series_map->len;
-
-        imap_difference_ref(
-                tag->series,
-                q_alter->series_map,
-                (imap_free_cb) &siridb__series_decref);
-    }
-    else
-    {
-        LISTENER_tag_t w = {
-                .where_expr = q_alter->where_expr,
-                .tag = tag,
-        };
+    LISTENER_tag_t w = {
+            .where_expr = q_alter->where_expr,
+            .tag = tag,
+    };
 
-        q_alter->n = imap_walk(
-                q_alter->series_map, (imap_cb) LISTENER_untag__cb, &w);
+    q_alter->n = imap_walk(q_alter->series_map, (imap_cb) LISTENER_untag__cb, &w);
 
-        imap_free(q_alter->series_map, NULL);
-    }
+    imap_free(q_alter->series_map, NULL);
 
 
     siridb_tags_set_require_save(siridb->tags, tag);
@@ -2291,10 +2523,7 @@ static void exit_count_series(uv_async_t * handle)
 
         next->data = handle->data;
 
-        uv_async_init(
-                siri.loop,
-                next,
-                (uv_async_cb) async_count_series);
+        LISTENER_ASYNC_INIT(next, async_count_series);
         uv_async_send(next);
 
         uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -2378,10 +2607,7 @@ static void exit_count_series_length(uv_async_t * handle)
 
         next->data = handle->data;
 
-        uv_async_init(
-                siri.loop,
-                next,
-                (uv_async_cb) async_count_series_length);
+        LISTENER_ASYNC_INIT(next, async_count_series_length);
         uv_async_send(next);
 
         uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -2924,10 +3150,7 @@ static void exit_drop_series(uv_async_t * handle)
 
         next->data = handle->data;
 
-        uv_async_init(
-                siri.loop,
-                next,
-                (uv_async_cb) async_filter_series);
+        LISTENER_ASYNC_INIT(next, async_filter_series);
         uv_async_send(next);
 
         uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -2969,10 +3192,7 @@ static void exit_drop_series(uv_async_t * handle)
 
             next->data = handle->data;
 
-            uv_async_init(
-                    siri.loop,
-                    next,
-                    (uv_async_cb) async_drop_series);
+            LISTENER_ASYNC_INIT(next, async_drop_series);
             uv_async_send(next);
 
             uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -3141,10 +3361,7 @@ static void exit_drop_shards(uv_async_t * handle)
 
         next->data = handle->data;
 
-        uv_async_init(
-                siri.loop,
-                next,
-                (uv_async_cb) async_drop_shards);
+        LISTENER_ASYNC_INIT(next, async_drop_shards);
         uv_async_send(next);
 
         uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -3492,10 +3709,7 @@ static void exit_list_series(uv_async_t * handle)
 
     next->data = handle->data;
 
-    uv_async_init(
-            siri.loop,
-            next,
-            (uv_async_cb) async_list_series);
+    LISTENER_ASYNC_INIT(next, async_list_series);
     uv_async_send(next);
 
     uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -3942,6 +4156,14 @@ static void exit_select_aggregate(uv_async_t * handle)
     siridb_query_t * query = handle->data;
     query_select_t * q_select = query->data;
 
+    if (q_select->resolve_start)
+    {
+        siri_metrics_since(
+                SIRI_METRICS_SELECT_RESOLVE,
+                q_select->resolve_start);
+        q_select->resolve_start = 0;
+    }
+
     if (q_select->where_expr != NULL)
     {
         /* we transform the references from imap to vec */
@@ -3972,10 +4194,7 @@ static void exit_select_aggregate(uv_async_t * handle)
 
         next->data = handle->data;
 
-        uv_async_init(
-                siri.loop,
-                next,
-                (uv_async_cb) async_filter_series);
+        LISTENER_ASYNC_INIT(next, async_filter_series);
         uv_async_send(next);
 
         uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -4046,13 +4265,11 @@ static void exit_select_aggregate(uv_async_t * handle)
 
                 next->data = handle->data;
 
-                uv_async_init(
-                        siri.loop,
+                LISTENER_ASYNC_INIT(
                         next,
-                        (uv_async_cb) (
-                                (q_select->flags & QUERIES_SKIP_GET_POINTS) ?
-                                        async_no_points_aggregate :
-                                        async_select_aggregate));
+                        (q_select->flags & QUERIES_SKIP_GET_POINTS) ?
+                                async_no_points_aggregate :
+                                async_select_aggregate);
                 uv_async_send(next);
 
                 uv_close((uv_handle_t *) handle, (uv_close_cb) free);
@@ -4109,7 +4326,7 @@ static void exit_select_stmt(uv_async_t * handle)
                     handle,
                     (query->nodes == NULL) ?
                             (uv_async_cb) siridb_send_query_result :
-                            (uv_async_cb) query->nodes->cb);
+                            siridb_node_run);
 
             siri_async_incref(handle);
             work->data = handle;
@@ -4122,6 +4339,7 @@ static void exit_select_stmt(uv_async_t * handle)
     }
     else
     {
+        uint64_t start = hist_now();
         if (qp_add_raw(query->packer, (const unsigned char *) "select", 6) ||
             qp_add_type(query->packer, QP_MAP_OPEN) ||
             ct_items(
@@ -4137,6 +4355,7 @@ static void exit_select_stmt(uv_async_t * handle)
         }
         else
         {
+            siri_metrics_since(SIRI_METRICS_SELECT_PACK, start);
             SIRIPARSER_ASYNC_NEXT_NODE
         }
     }
@@ -5032,13 +5251,15 @@ static void exit_timeit_stmt(uv_async_t * handle)
     char * name = siridb->server->name;
     clock_gettime(CLOCK_REALTIME, &end);
 
-    qp_add_type(query->timeit, QP_MAP2);
+    qp_add_type(query->timeit, QP_MAP3);
     qp_add_raw(query->timeit, (const unsigned char *) "server", 6);
     qp_add_string(query->timeit, name);
     qp_add_raw(query->timeit, (const unsigned char *) "time", 4);
     qp_add_double(query->timeit,
             (double) (end.tv_sec - query->start.tv_sec) +
             (double) (end.tv_nsec - query->start.tv_nsec) / 1000000000.0f);
+    qp_add_raw(query->timeit, (const unsigned char *) "parse", 5);
+    qp_add_double(query->timeit, (double) query->parse_ns / 1000000000.0f);
 
     if (query->packer == NULL)
     {
@@ -5246,22 +5467,37 @@ static void async_drop_shards(uv_async_t * handle)
     query_drop_t * q_drop = (query_drop_t *) query->data;
     siridb_t * siridb = query->siridb;
 
+    /*
+     * The series are updated in a single pass for all shards, one slice for
+     * each call so the event loop is not blocked during the whole pass.
+     */
     if (q_drop->shards_list->len)
     {
-        siridb_shard_t * shard = (siridb_shard_t *) vec_pop(
-                q_drop->shards_list);
+        if (q_drop->drop == NULL)
+        {
+            q_drop->drop = siridb_shard_drop_new(q_drop->shards_list, siridb);
+        }
 
-        siridb_shard_drop(
-                shard,
-                siridb);
-        siridb_shard_decref(shard);
-    }
+        if (q_drop->drop != NULL && siridb_shard_drop_work(q_drop->drop))
+        {
+            uv_async_send(handle);
+            return;
+        }
 
-    if (q_drop->shards_list->len)
-    {
-        uv_async_send(handle);
+        if (q_drop->drop != NULL)
+        {
+            siridb_shard_drop_free(q_drop->drop);
+            q_drop->drop = NULL;
+        }
+
+        while (q_drop->shards_list->len)
+        {
+            siridb_shard_decref(
+                    (siridb_shard_t *) vec_pop(q_drop->shards_list));
+        }
     }
-    else if (IS_MASTER)
+
+    if (IS_MASTER)
     {
         siridb_query_forward(
                 handle,
@@ -5454,12 +5690,13 @@ static void async_no_points_aggregate(uv_async_t * handle)
     siridb_points_t * points;
     siridb_points_t * aggr_points;
     int required_shard = 0;
+    uint64_t start;
 
     for (;  q_select->vec_index < q_select->vec->len;
             ++q_select->vec_index)
     {
         const char * name;
-        size_t i;
+        size_t i, n_read;
 
         if (required_shard > MAX_BATCH_REQUIRE_SHARD)
         {
@@ -5480,6 +5717,8 @@ static void async_no_points_aggregate(uv_async_t * handle)
 
         siridb_aggr_t * aggr = q_select->alist->data[0];
 
+        start = hist_now();
+
         uv_mutex_lock(&siridb->series_mutex);
 
         switch (aggr->gid)
@@ -5505,6 +5744,10 @@ static void async_no_points_aggregate(uv_async_t * handle)
             MEM_ERR_RET
         }
 
+        q_select->read_ns += hist_now() - start;
+        start = hist_now();
+        n_read = points->len;
+
         for (i = 1; points->len && i < q_select->alist->len; i++)
         {
             aggr_points = siridb_aggregate_run(
@@ -5526,8 +5769,14 @@ static void async_no_points_aggregate(uv_async_t * handle)
             points = aggr_points;
         }
 
+        q_select->aggr_ns += hist_now() - start;
         q_select->n += points->len;
 
+        if (query->stat != NULL)
+        {
+            siridb_query_stat_read(query->stat, n_read, points->len);
+        }
+
         if (q_select->merge_as == NULL)
         {
             name = siridb_presuf_name(
@@ -5574,6 +5823,15 @@ static void async_no_points_aggregate(uv_async_t * handle)
     }
     else
     {
+        hist_observe(
+                &siri_metrics[SIRI_METRICS_SELECT_READ],
+                q_select->read_ns);
+        hist_observe(
+                &siri_metrics[SIRI_METRICS_SELECT_AGGREGATE],
+                q_select->aggr_ns);
+        q_select->read_ns = 0;
+        q_select->aggr_ns = 0;
+
         siridb_aggregate_list_free(q_select->alist);
         q_select->alist = NULL;
 
@@ -5585,6 +5843,284 @@ static void async_no_points_aggregate(uv_async_t * handle)
     }
 }
 
+/*
+ * Set points for a series with the first aggregate function applied, using
+ * the aggregate cache for the aligned part of the select window.
+ *
+ * Returns 0 when points are set, 1 when the cache cannot be used, in which
+ * case the points should be read and aggregated as usual, or -1 in case of
+ * an error. (err_msg is set)
+ */
+static int select_acache_points(
+        siridb_query_t * query,
+        siridb_series_t * series,
+        siridb_points_t ** points,
+        size_t * n_read)
+{
+    query_select_t * q_select = query->data;
+    siridb_t * siridb = query->siridb;
+    siridb_aggr_t * aggr;
+    siridb_points_t * cached, * head, * tail;
+    uint64_t a, b, ts_a, ts_b;
+    uint32_t generation;
+
+    if (    q_select->headtail != 0 ||
+            q_select->start_ts == NULL ||
+            q_select->end_ts == NULL ||
+            q_select->alist->len == 0 ||
+            series->tp == TP_STRING ||
+            (series->flags & SIRIDB_SERIES_IS_DROPPED))
+    {
+        return 1;
+    }
+
+    aggr = (siridb_aggr_t *) q_select->alist->data[0];
+
+    /* only closed windows are cached since others are likely to change */
+    if (    aggr->group_by == 0 ||
+            aggr->limit ||
+            siridb_acache_window(
+                    aggr,
+                    *q_select->start_ts,
+                    *q_select->end_ts,
+                    &a,
+                    &b) ||
+            b > siridb_time_now(siridb, query->start))
+    {
+        return 1;
+    }
+
+    generation = siridb_acache_generation(siridb->acache);
+    cached = siridb_acache_get(siridb->acache, series->id, aggr, a, b);
+
+    if (cached == NULL)
+    {
+        *points = select_aggregate_points(
+                series,
+                aggr,
+                q_select->start_ts,
+                q_select->end_ts,
+                n_read,
+                query->err_msg);
+        if (*points == NULL)
+        {
+            return -1;
+        }
+        (void) siridb_acache_put(
+                siridb->acache,
+                series->id,
+                aggr,
+                a,
+                b,
+                *points,
+                generation);
+        return 0;
+    }
+
+    /* only the head [start, a] and tail (b, end) must be read */
+    ts_a = a + 1;
+    ts_b = b + 1;
+
+    uv_mutex_lock(&siridb->series_mutex);
+
+    head = siridb_series_get_points(series, q_select->start_ts, &ts_a);
+    tail = siridb_series_get_points(series, &ts_b, q_select->end_ts);
+
+    uv_mutex_unlock(&siridb->series_mutex);
+
+    if (head == NULL || tail == NULL)
+    {
+        sprintf(query->err_msg, "Memory allocation error.");
+        *points = NULL;
+    }
+    else
+    {
+        *n_read = head->len + tail->len;
+
+        /* the aggregate sets err_msg in case of an error */
+        head = select_acache_aggregate(head, aggr, query->err_msg);
+        if (head == NULL)
+        {
+            siridb_points_free(tail);
+            tail = NULL;
+        }
+        else
+        {
+            tail = select_acache_aggregate(tail, aggr, query->err_msg);
+        }
+
+        *points = (tail == NULL) ? NULL : siridb_points_new(
+                head->len + cached->len + tail->len,
+                cached->tp);
+
+        if (*points != NULL)
+        {
+            memcpy(
+                (*points)->data,
+                head->data,
+                head->len * sizeof(siridb_point_t));
+            memcpy(
+                (*points)->data + head->len,
+                cached->data,
+                cached->len * sizeof(siridb_point_t));
+            memcpy(
+                (*points)->data + head->len + cached->len,
+                tail->data,
+                tail->len * sizeof(siridb_point_t));
+            (*points)->len = head->len + cached->len + tail->len;
+        }
+        else if (tail != NULL)
+        {
+            sprintf(query->err_msg, "Memory allocation error.");
+        }
+    }
+
+    if (head != NULL)
+    {
+        siridb_points_free(head);
+    }
+    if (tail != NULL)
+    {
+        siridb_points_free(tail);
+    }
+
+    return (*points == NULL) ? -1 : 0;
+}
+
+/*
+ * Apply an aggregate function on points. The source points are consumed.
+ * Returns NULL in case of an error or when points is NULL.
+ */
+static siridb_points_t * select_acache_aggregate(
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_points_t * aggr_points;
+
+    if (points == NULL || points->len == 0)
+    {
+        return points;
+    }
+
+    aggr_points = siridb_aggregate_run(points, aggr, err_msg);
+
+    if (aggr_points != points)
+    {
+        siridb_points_free(points);
+    }
+
+    return aggr_points;
+}
+
+/*
+ * Returns the points of a series in a range with an aggregate applied, or
+ * NULL in case of an error. (err_msg is set)
+ *
+ * Buckets from rollup tiers are used when the aggregate and window allow
+ * this. Otherwise, when possible, the points are fed chunk by chunk to an
+ * aggregate stream so at most one chunk and one group are in memory. In all
+ * other cases the points are read before the aggregate is applied.
+ */
+static siridb_points_t * select_aggregate_points(
+        siridb_series_t * series,
+        siridb_aggr_t * aggr,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        size_t * n_read,
+        char * err_msg)
+{
+    siridb_t * siridb = series->siridb;
+    siridb_rollup_select_t select;
+    siridb_aggr_stream_t stream;
+    siridb_points_t * points = NULL;
+    int rollup_rc = 1, rc = 1;
+
+    uv_mutex_lock(&siridb->series_mutex);
+
+    if (start_ts != NULL && end_ts != NULL)
+    {
+        rollup_rc = siridb_rollup_select_init(
+                &select,
+                siridb->rollup,
+                aggr,
+                series->tp,
+                *start_ts,
+                *end_ts,
+                err_msg);
+        if (rollup_rc == 0)
+        {
+            rollup_rc = siridb_series_rollup_points(
+                    series,
+                    start_ts,
+                    end_ts,
+                    &select);
+            if (rollup_rc)
+            {
+                siridb_rollup_select_destroy(&select);
+            }
+        }
+        rc = rollup_rc;
+    }
+
+    if (rc == 1 && series->tp != TP_STRING && siridb_aggregate_can_stream(aggr))
+    {
+        rc = siridb_aggregate_stream_init(&stream, aggr, series->tp, err_msg);
+        if (rc == 0)
+        {
+            rc = siridb_series_stream_points(
+                    series,
+                    start_ts,
+                    end_ts,
+                    &stream);
+            if (rc)
+            {
+                siridb_aggregate_stream_destroy(&stream);
+            }
+        }
+    }
+
+    if (rc == 1)
+    {
+        points = (series->tp == TP_STRING &&
+                aggr->gid == CLERI_GID_F_FILTER &&
+                aggr->ngram != NULL &&
+                siridb->ngram_index != NULL)
+                ? siridb_series_get_points_ngram(
+                        series,
+                        start_ts,
+                        end_ts,
+                        aggr->ngram)
+                : siridb_series_get_points(series, start_ts, end_ts);
+    }
+
+    uv_mutex_unlock(&siridb->series_mutex);
+
+    if (rollup_rc == 0)
+    {
+        *n_read = select.n;
+        return siridb_rollup_select_finish(&select);
+    }
+
+    if (rc == 0)
+    {
+        *n_read = stream.n;
+        return siridb_aggregate_stream_finish(&stream);
+    }
+
+    if (points == NULL)
+    {
+        if (rc == 1)
+        {
+            sprintf(err_msg, "Memory allocation error.");
+        }
+        return NULL;
+    }
+
+    *n_read = points->len;
+    return select_acache_aggregate(points, aggr, err_msg);
+}
+
 static void async_select_aggregate(uv_async_t * handle)
 {
     siridb_query_t * query = handle->data;
@@ -5594,6 +6130,9 @@ static void async_select_aggregate(uv_async_t * handle)
     siridb_series_t * series;
     siridb_points_t * points;
     siridb_points_t * aggr_points;
+    size_t aggr_offset = 0, n_read = 0;
+    uint64_t start = hist_now();
+    int rc;
 
     if (q_select->n > siridb->select_points_limit)
     {
@@ -5635,6 +6174,44 @@ static void async_select_aggregate(uv_async_t * handle)
                 siridb_points_copy(imap_get(q_select->points_map, series->id)):
                 imap_pop(q_select->points_map, series->id);
 
+    /* when the aggregate cache is used, the points are returned with the
+     * first aggregate function already applied */
+    if (    points == NULL &&
+            q_select->points_map == NULL &&
+            siridb->acache != NULL)
+    {
+        rc = select_acache_points(query, series, &points, &n_read);
+        if (rc < 0)
+        {
+            siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+            return;
+        }
+        aggr_offset = (rc == 0);
+    }
+
+    /* without a cache, the first aggregate is applied while reading */
+    if (    points == NULL &&
+            q_select->points_map == NULL &&
+            q_select->headtail == 0 &&
+            q_select->alist->len &&
+            !(series->flags & SIRIDB_SERIES_IS_DROPPED))
+    {
+        points = select_aggregate_points(
+                series,
+                (siridb_aggr_t *) q_select->alist->data[0],
+                q_select->start_ts,
+                q_select->end_ts,
+                &n_read,
+                query->err_msg);
+
+        if (points == NULL)
+        {
+            siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+            return;
+        }
+        aggr_offset = 1;
+    }
+
     if (points == NULL)
     {
         uv_mutex_lock(&siridb->series_mutex);
@@ -5668,12 +6245,21 @@ static void async_select_aggregate(uv_async_t * handle)
         }
     }
 
+    q_select->read_ns += hist_now() - start;
+
     if (points != NULL)
     {
         const char * name;
         size_t i;
 
-        for (i = 0; points->len && i < q_select->alist->len; i++)
+        if (n_read == 0)
+        {
+            n_read = points->len;
+        }
+
+        start = hist_now();
+
+        for (i = aggr_offset; points->len && i < q_select->alist->len; i++)
         {
             aggr_points = siridb_aggregate_run(
                     points,
@@ -5694,8 +6280,14 @@ static void async_select_aggregate(uv_async_t * handle)
             points = aggr_points;
         }
 
+        q_select->aggr_ns += hist_now() - start;
         q_select->n += points->len;
 
+        if (query->stat != NULL)
+        {
+            siridb_query_stat_read(query->stat, n_read, points->len);
+        }
+
         if (q_select->merge_as == NULL)
         {
             name = siridb_presuf_name(
@@ -5742,6 +6334,15 @@ static void async_select_aggregate(uv_async_t * handle)
     }
     else
     {
+        hist_observe(
+                &siri_metrics[SIRI_METRICS_SELECT_READ],
+                q_select->read_ns);
+        hist_observe(
+                &siri_metrics[SIRI_METRICS_SELECT_AGGREGATE],
+                q_select->aggr_ns);
+        q_select->read_ns = 0;
+        q_select->aggr_ns = 0;
+
         siridb_aggregate_list_free(q_select->alist);
         q_select->alist = NULL;
 
@@ -5785,11 +6386,15 @@ static void async_series_re(uv_async_t * handle)
                 0,                     /* OPTIONS                       */
                 q_wrapper->match_data,
                 0);                    /* length of sub_str_vec         */
-        if (    pcre_exec_ret < 0 ||
-                imap_add(q_wrapper->series_tmp, series->id, series))
+        if (pcre_exec_ret < 0)
         {
             siridb_series_decref(series);
         }
+        else if (LISTENER_operand_add(q_wrapper, series))
+        {
+            q_wrapper->vec_index++;
+            MEM_ERR_RET
+        }
     }
 
     if (async_more)
@@ -5810,14 +6415,10 @@ static void async_series_re(uv_async_t * handle)
         q_wrapper->vec = NULL;
         q_wrapper->vec_index = 0;
 
-        if (q_wrapper->update_cb != NULL)
+        if (LISTENER_operand_done(query->siridb, q_wrapper))
         {
-            (*q_wrapper->update_cb)(
-                    q_wrapper->series_map,
-                    q_wrapper->series_tmp,
-                    (imap_free_cb) &siridb__series_decref);
+            MEM_ERR_RET
         }
-        q_wrapper->series_tmp = NULL;
 
         SIRIPARSER_ASYNC_NEXT_NODE
     }
@@ -6197,7 +6798,7 @@ static void on_groups_response(vec_t * promises, uv_async_t * handle)
         sirinet_promise_decref(promise);
     }
 
-    query->nodes->cb(handle);
+    siridb_node_run(handle);
 }
 
 static void on_tags_response(vec_t * promises, uv_async_t * handle)
@@ -6254,7 +6855,7 @@ static void on_tags_response(vec_t * promises, uv_async_t * handle)
         sirinet_promise_decref(promise);
     }
 
-    query->nodes->cb(handle);
+    siridb_node_run(handle);
 }
 
 /*
@@ -6502,7 +7103,7 @@ static void on_select_response(vec_t * promises, uv_async_t * handle)
                 handle,
                 (query->nodes == NULL) ?
                         (uv_async_cb) siridb_send_query_result :
-                        (uv_async_cb) query->nodes->cb);
+                        siridb_node_run);
 
         siri_async_incref(handle);
         work->data = handle;
@@ -6646,6 +7247,7 @@ static void master_select_work(uv_work_t * work)
     siridb_query_t * query = handle->data;
     query_select_t * q_select = query->data;
     siridb_t * siridb = query->siridb;
+    uint64_t start = hist_now();
     siridb->selected_points += q_select->n;
     int rc = ct_items(
             q_select->result,
@@ -6655,6 +7257,8 @@ static void master_select_work(uv_work_t * work)
                     (ct_item_cb) &items_select_master_merge,
             handle);
 
+    siri_metrics_since(SIRI_METRICS_SELECT_PACK, start);
+
     /* Do not set an error message when rc==1 since in that case the message
      * is already set.
      */
@@ -6733,6 +7337,7 @@ static int items_select_master_merge(
     siridb_query_t * query = handle->data;
     query_select_t * q_select = query->data;
     siridb_points_t * points;
+    size_t i = 0;
 
     if (qp_add_raw(query->packer, (const unsigned char *) name, len))
     {
@@ -6757,12 +7362,17 @@ static int items_select_master_merge(
         break;
     }
 
+    if (points != NULL && siridb_aggregate_use_tdigest(q_select->mlist))
+    {
+        points = select_merge_tdigests(q_select, name, points, query->err_msg);
+        i = 1;  /* percentile() is finished */
+    }
+
     if (q_select->mlist != NULL && points != NULL)
     {
         siridb_points_t * aggr_points;
-        size_t i;
 
-        for (i = 0; points->len && i < q_select->mlist->len; i++)
+        for (; points->len && i < q_select->mlist->len; i++)
         {
             aggr_points = siridb_aggregate_run(
                     points,
@@ -6838,10 +7448,23 @@ static int items_select_other_merge(
 {
     size_t i;
     siridb_query_t * query = handle->data;
+    query_select_t * q_select = query->data;
     int rc = qp_add_raw_term(
                 query->packer, (const unsigned char *) name, len) ||
             qp_add_type(query->packer, QP_ARRAY_OPEN);
 
+    if (!rc && plist->len && siridb_aggregate_use_tdigest(q_select->mlist))
+    {
+        switch (select_pack_tdigests(q_select, plist, query->packer))
+        {
+        case 0:
+            return -qp_add_type(query->packer, QP_ARRAY_CLOSE);
+        case -1:
+            return -1;
+        }
+        /* string points are sent so the master returns the error */
+    }
+
     for (i = 0; !rc && i < plist->len; i++)
     {
         rc = siridb_points_raw_pack(
@@ -6889,7 +7512,7 @@ static void on_select_unpack_points(
                             points,
                             qp_points->via.raw,
                             qp_len->via.int64,
-                            NULL, NULL, 0);
+                            NULL, NULL, 0, NULL);
                 }
             }
             else
@@ -6937,6 +7560,15 @@ static void on_select_unpack_merged_points(
                 qp_is_int(qp_next(unpacker, qp_len)) &&
                 qp_is_raw(qp_next(unpacker, qp_points)))
         {
+            if (qp_tp->via.int64 == TDIGEST_RAW_TP)
+            {
+                select_unpack_tdigests(
+                        q_select,
+                        (const char *) qp_name->via.raw,
+                        qp_points);
+                qp_next(unpacker, NULL);  /* QP_ARRAY_CLOSE     */
+                continue;
+            }
 
             points = siridb_points_new(qp_len->via.int64, qp_tp->via.int64);
 
@@ -6957,7 +7589,7 @@ static void on_select_unpack_merged_points(
                                 points,
                                 qp_points->via.raw,
                                 qp_len->via.int64,
-                                NULL, NULL, 0);
+                                NULL, NULL, 0, NULL);
                     }
                 }
                 else
@@ -6981,6 +7613,137 @@ static void on_select_unpack_merged_points(
     }
 }
 
+/*
+ * Pack the t-digests of the points for percentile().
+ *
+ * Returns 0 if successful, -1 in case of an error or 1 if the points cannot
+ * be packed as t-digests. (string points)
+ */
+static int select_pack_tdigests(
+        query_select_t * q_select,
+        vec_t * plist,
+        qp_packer_t * packer)
+{
+    siridb_aggr_t * aggr = q_select->mlist->data[0];
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points;
+    vec_t * tdigests;
+    size_t i;
+    int rc = 0;
+
+    for (i = 0; i < plist->len; i++)
+    {
+        if (((siridb_points_t *) plist->data[i])->tp == TP_STRING)
+        {
+            return 1;
+        }
+    }
+
+    tdigests = vec_new(plist->len);
+    if (tdigests == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; !rc && i < plist->len; i++)
+    {
+        points = plist->data[i];
+        rc = points->len &&
+                siridb_aggregate_tdigests(&tdigests, points, aggr, err_msg);
+    }
+
+    rc = rc ||
+            siridb_aggregate_tdigests_reduce(tdigests, aggr, err_msg) ||
+            siridb_tdigest_pack(tdigests, packer);
+
+    vec_destroy(tdigests, (vec_destroy_cb) siridb_tdigest_free);
+
+    return -rc;
+}
+
+/*
+ * Add the t-digests from a pool to the t-digests for the given name.
+ */
+static void select_unpack_tdigests(
+        query_select_t * q_select,
+        const char * name,
+        qp_obj_t * qp_points)
+{
+    vec_t ** tdigests;
+    ssize_t n;
+
+    if (q_select->tdigests == NULL &&
+        (q_select->tdigests = ct_new()) == NULL)
+    {
+        log_critical("Cannot create t-digests for '%s'", name);
+        return;
+    }
+
+    tdigests = (vec_t **) ct_getaddr(q_select->tdigests, name);
+    if (tdigests == NULL)
+    {
+        vec_t * tlist = vec_new(VEC_DEFAULT_SIZE);
+        if (tlist == NULL || ct_add(q_select->tdigests, name, tlist))
+        {
+            log_critical("Cannot create t-digests for '%s'", name);
+            vec_free(tlist);
+            return;
+        }
+        tdigests = (vec_t **) ct_getaddr(q_select->tdigests, name);
+    }
+
+    n = siridb_tdigest_unpack(tdigests, qp_points->via.raw, qp_points->len);
+    if (n < 0)
+    {
+        log_error("Cannot unpack t-digests for '%s'", name);
+        return;
+    }
+
+    q_select->n += n;
+}
+
+/*
+ * Returns the percentiles for the merged points and the t-digests from the
+ * pools or NULL in case of an error. (err_msg is set) The given points are
+ * destroyed.
+ */
+static siridb_points_t * select_merge_tdigests(
+        query_select_t * q_select,
+        const char * name,
+        siridb_points_t * points,
+        char * err_msg)
+{
+    siridb_aggr_t * aggr = q_select->mlist->data[0];
+    vec_t ** tdigests = (q_select->tdigests == NULL) ?
+            NULL : (vec_t **) ct_getaddr(q_select->tdigests, name);
+    vec_t * tlist = NULL;
+    int rc;
+
+    if (tdigests == NULL)
+    {
+        tlist = vec_new(VEC_DEFAULT_SIZE);
+        if (tlist == NULL)
+        {
+            sprintf(err_msg, "Memory allocation error.");
+            siridb_points_free(points);
+            return NULL;
+        }
+        tdigests = &tlist;
+    }
+
+    rc = points->len &&
+            siridb_aggregate_tdigests(tdigests, points, aggr, err_msg);
+
+    siridb_points_free(points);
+
+    points = rc ?
+            NULL : siridb_aggregate_tdigests_points(*tdigests, aggr, err_msg);
+
+    vec_destroy(tlist, (vec_destroy_cb) siridb_tdigest_free);
+
+    return points;
+}
+
 static int values_list_groups(siridb_group_t * group, uv_async_t * handle)
 {
     siridb_query_t * query = handle->data;
@@ -6,17 +6,31 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define LOOKUP_P1 0x9E3779B185EBCA87ULL
+#define LOOKUP_P2 0xC2B2AE3D27D4EB4FULL
+#define LOOKUP_P3 0x165667B19E3779F9ULL
+#define LOOKUP_P4 0x85EBCA77C2B2AE63ULL
+#define LOOKUP_P5 0x27D4EB2F165667C5ULL
+
+#define LOOKUP_rotl(x__, r__) (((x__) << (r__)) | ((x__) >> (64 - (r__))))
+
+static const char * lookup_mode_names[SIRIDB_LOOKUP_MODE_END] = {
+        "sum",
+        "xxh64"
+};
+
+static inline uint16_t LOOKUP_sum(const char * sn, size_t len);
+static inline uint64_t LOOKUP_read64(const char * pt);
+static inline uint32_t LOOKUP_read32(const char * pt);
+static inline uint64_t LOOKUP_round(uint64_t acc, uint64_t input);
+static inline uint64_t LOOKUP_merge(uint64_t acc, uint64_t val);
+
 /*
  * Returns a pool id based on a terminated string.
  */
 uint16_t siridb_lookup_sn(siridb_lookup_t * lookup, const char * sn)
 {
-    uint32_t n = 0;
-    for (; *sn; sn++)
-    {
-        n += *sn;
-    }
-    return (*lookup)[n % SIRIDB_LOOKUP_SZ];
+    return siridb_lookup_sn_raw(lookup, sn, strlen(sn));
 }
 
 /*
@@ -27,12 +41,86 @@ uint16_t siridb_lookup_sn_raw(
         const char * sn,
         size_t len)
 {
-    uint32_t n = 0;
-    while (len--)
+    return lookup->pool[siridb_lookup_slot(lookup->mode, sn, len)];
+}
+
+/*
+ * Returns the lookup slot for a series name using the given mode.
+ */
+uint16_t siridb_lookup_slot(uint8_t mode, const char * sn, size_t len)
+{
+    return (mode == SIRIDB_LOOKUP_MODE_XXH64)
+            ? (uint16_t) (siridb_lookup_xxh64(sn, len) & (SIRIDB_LOOKUP_SZ - 1))
+            : LOOKUP_sum(sn, len);
+}
+
+/*
+ * Returns the 64 bit xxHash (seed 0) for a raw string. The result is equal
+ * on little and big endian machines.
+ */
+uint64_t siridb_lookup_xxh64(const char * sn, size_t len)
+{
+    const char * end = sn + len;
+    uint64_t h;
+
+    if (len >= 32)
     {
-        n += sn[len];
+        const char * limit = end - 32;
+        uint64_t v1 = LOOKUP_P1 + LOOKUP_P2;
+        uint64_t v2 = LOOKUP_P2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -LOOKUP_P1;
+
+        do
+        {
+            v1 = LOOKUP_round(v1, LOOKUP_read64(sn));
+            v2 = LOOKUP_round(v2, LOOKUP_read64(sn + 8));
+            v3 = LOOKUP_round(v3, LOOKUP_read64(sn + 16));
+            v4 = LOOKUP_round(v4, LOOKUP_read64(sn + 24));
+            sn += 32;
+        }
+        while (sn <= limit);
+
+        h = LOOKUP_rotl(v1, 1) + LOOKUP_rotl(v2, 7) +
+            LOOKUP_rotl(v3, 12) + LOOKUP_rotl(v4, 18);
+        h = LOOKUP_merge(h, v1);
+        h = LOOKUP_merge(h, v2);
+        h = LOOKUP_merge(h, v3);
+        h = LOOKUP_merge(h, v4);
     }
-    return (*lookup)[n % SIRIDB_LOOKUP_SZ];
+    else
+    {
+        h = LOOKUP_P5;
+    }
+
+    h += (uint64_t) len;
+
+    for (; sn + 8 <= end; sn += 8)
+    {
+        h ^= LOOKUP_round(0, LOOKUP_read64(sn));
+        h = LOOKUP_rotl(h, 27) * LOOKUP_P1 + LOOKUP_P4;
+    }
+
+    if (sn + 4 <= end)
+    {
+        h ^= (uint64_t) LOOKUP_read32(sn) * LOOKUP_P1;
+        h = LOOKUP_rotl(h, 23) * LOOKUP_P2 + LOOKUP_P3;
+        sn += 4;
+    }
+
+    for (; sn < end; sn++)
+    {
+        h ^= (uint64_t) ((unsigned char) *sn) * LOOKUP_P5;
+        h = LOOKUP_rotl(h, 11) * LOOKUP_P1;
+    }
+
+    h ^= h >> 33;
+    h *= LOOKUP_P2;
+    h ^= h >> 29;
+    h *= LOOKUP_P3;
+    h ^= h >> 32;
+
+    return h;
 }
 
 /*
@@ -40,7 +128,7 @@ uint16_t siridb_lookup_sn_raw(
  *
  * (Algorithm to create pools lookup array.)
  */
-siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools)
+siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools, uint8_t mode)
 {
     siridb_lookup_t * lookup = calloc(1, sizeof(siridb_lookup_t));
 
@@ -53,6 +141,8 @@ siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools)
         uint_fast16_t n, i, m;
         uint_fast16_t counters[num_pools - 1];
 
+        lookup->mode = mode;
+
         for (n = 1, m = 2; n < num_pools; n++, m++)
         {
             for (i = 0; i < n; i++)
@@ -62,9 +152,9 @@ siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools)
 
             for (i = 0; i < SIRIDB_LOOKUP_SZ; i++)
             {
-                if (++counters[ (*lookup)[i] ] % m == 0)
+                if (++counters[ lookup->pool[i] ] % m == 0)
                 {
-                    (*lookup)[i] = n;
+                    lookup->pool[i] = n;
                 }
             }
         }
@@ -80,4 +170,156 @@ void siridb_lookup_free(siridb_lookup_t * lookup)
     free(lookup);
 }
 
+/*
+ * Returns the name for a lookup mode.
+ */
+const char * siridb_lookup_mode_str(uint8_t mode)
+{
+    return (mode < SIRIDB_LOOKUP_MODE_END) ?
+            lookup_mode_names[mode] : "unknown";
+}
 
+/*
+ * Returns a lookup mode by name or -1 if the name is not a valid mode.
+ */
+int siridb_lookup_mode_by_name(const char * name, size_t len)
+{
+    int mode;
+    for (mode = 0; mode < SIRIDB_LOOKUP_MODE_END; mode++)
+    {
+        if (    strlen(lookup_mode_names[mode]) == len &&
+                strncmp(lookup_mode_names[mode], name, len) == 0)
+        {
+            return mode;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns a new balance statistics object for the given lookup, or NULL
+ * in case of an allocation error. (a SIGNAL is raised)
+ *
+ * Series names can be added to see how they are spread over the lookup slots
+ * and pools. The lookup must be created for 'num_pools' pools.
+ */
+siridb_lookup_stats_t * siridb_lookup_stats_new(
+        siridb_lookup_t * lookup,
+        uint_fast16_t num_pools)
+{
+    siridb_lookup_stats_t * stats = calloc(
+            1,
+            sizeof(siridb_lookup_stats_t) + num_pools * sizeof(size_t));
+    if (stats == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        stats->lookup = lookup;
+        stats->num_pools = num_pools;
+    }
+    return stats;
+}
+
+/*
+ * Add a series name to the statistics.
+ */
+void siridb_lookup_stats_add(
+        siridb_lookup_stats_t * stats,
+        const char * sn,
+        size_t len)
+{
+    uint16_t slot = siridb_lookup_slot(stats->lookup->mode, sn, len);
+    uint32_t n = ++stats->slots[slot];
+
+    stats->slots_used += (n == 1);
+    if (n > stats->slot_max)
+    {
+        stats->slot_max = n;
+    }
+    stats->pools[stats->lookup->pool[slot]]++;
+    stats->n++;
+}
+
+/*
+ * Returns how much the fullest pool exceeds a perfect balance, for example
+ * 0.4 when the fullest pool has 40% more series than the average pool.
+ */
+double siridb_lookup_stats_imbalance(siridb_lookup_stats_t * stats)
+{
+    size_t max = 0;
+    uint_fast16_t i;
+    double avg;
+
+    if (!stats->n)
+    {
+        return 0.0;
+    }
+
+    for (i = 0; i < stats->num_pools; i++)
+    {
+        if (stats->pools[i] > max)
+        {
+            max = stats->pools[i];
+        }
+    }
+
+    avg = (double) stats->n / stats->num_pools;
+    return (double) max / avg - 1.0;
+}
+
+/*
+ * Destroy statistics.
+ */
+void siridb_lookup_stats_free(siridb_lookup_stats_t * stats)
+{
+    free(stats);
+}
+
+/*
+ * Legacy lookup, the sum of all characters. (the char type is used for the
+ * sum so the result is equal to older versions of SiriDB)
+ */
+static inline uint16_t LOOKUP_sum(const char * sn, size_t len)
+{
+    uint32_t n = 0;
+    while (len--)
+    {
+        n += sn[len];
+    }
+    return n % SIRIDB_LOOKUP_SZ;
+}
+
+static inline uint64_t LOOKUP_read64(const char * pt)
+{
+    uint64_t v;
+    memcpy(&v, pt, sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t LOOKUP_read32(const char * pt)
+{
+    uint32_t v;
+    memcpy(&v, pt, sizeof(uint32_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t LOOKUP_round(uint64_t acc, uint64_t input)
+{
+    acc += input * LOOKUP_P2;
+    acc = LOOKUP_rotl(acc, 31);
+    return acc * LOOKUP_P1;
+}
+
+static inline uint64_t LOOKUP_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= LOOKUP_round(0, val);
+    return acc * LOOKUP_P1 + LOOKUP_P4;
+}
@@ -0,0 +1,401 @@
+/*
+ * ngram.c - Trigram bloom filters for chunks in log shards.
+ *
+ * Each trigram sets two bits in the filter of a chunk. The size of a filter
+ * is a power of 2 with at least four bits for each trigram in the chunk,
+ * which keeps the false positive rate below 5% as long as the filter is not
+ * limited by SIRIDB_NGRAM_MAX_BITS.
+ *
+ * Literal parts of a regular expression are only used when they must be
+ * part of every match. Everything between parentheses, character classes,
+ * escape sequences and optional characters is skipped, and an alternative
+ * outside parentheses disables the query.
+ */
+#include <ctype.h>
+#include <logger/logger.h>
+#include <siri/db/ngram.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NGRAM_BITS_PER_TRIGRAM 4
+
+static inline uint32_t NGRAM_hash(const char * s);
+static inline int NGRAM_has(siridb_ngram_t * ngram, uint32_t hash);
+static void NGRAM_add_run(
+        siridb_ngram_query_t * query,
+        const char * run,
+        size_t len);
+static siridb_ngram_query_t * NGRAM_query_done(siridb_ngram_query_t * query);
+static int NGRAM_free_cb(siridb_ngram_t * ngram, size_t * size);
+
+/*
+ * Returns a new filter for the points start to end, or NULL in case of a
+ * memory allocation error.
+ */
+siridb_ngram_t * siridb_ngram_new(
+        siridb_points_t * points,
+        size_t start,
+        size_t end)
+{
+    siridb_ngram_t * ngram;
+    size_t i, j, len, n = 0, nbits = SIRIDB_NGRAM_MIN_BITS;
+    const char * s;
+    uint32_t hash;
+
+    for (i = start; i < end; i++)
+    {
+        len = strlen(points->data[i].val.str);
+        n += (len > 2) ? len - 2 : 0;
+    }
+
+    while (nbits < n * NGRAM_BITS_PER_TRIGRAM && nbits < SIRIDB_NGRAM_MAX_BITS)
+    {
+        nbits <<= 1;
+    }
+
+    ngram = calloc(1, sizeof(siridb_ngram_t) + nbits / 8);
+    if (ngram == NULL)
+    {
+        return NULL;
+    }
+
+    ngram->len = end - start;
+    ngram->mask = nbits - 1;
+
+    for (i = start; i < end; i++)
+    {
+        s = points->data[i].val.str;
+        len = strlen(s);
+        for (j = 2; j < len; j++, s++)
+        {
+            hash = NGRAM_hash(s);
+            ngram->bits[(hash & ngram->mask) / 64] |=
+                    UINT64_C(1) << (hash & 63);
+            hash = (hash >> 16) | (hash << 16);
+            ngram->bits[(hash & ngram->mask) / 64] |=
+                    UINT64_C(1) << (hash & 63);
+        }
+    }
+
+    return ngram;
+}
+
+/*
+ * Returns a query for values which contain the given string, or NULL when
+ * the string is too short or in case of a memory allocation error.
+ */
+siridb_ngram_query_t * siridb_ngram_query_str(const char * str)
+{
+    size_t len = strlen(str);
+    siridb_ngram_query_t * query = malloc(
+            sizeof(siridb_ngram_query_t) + len * sizeof(uint32_t));
+    if (query == NULL)
+    {
+        return NULL;
+    }
+
+    query->n = 0;
+    NGRAM_add_run(query, str, len);
+
+    return NGRAM_query_done(query);
+}
+
+/*
+ * Returns a query for values which match the regular expression source
+ * (/pattern/ or /pattern/i), or NULL when no trigram must be part of a match
+ * or in case of a memory allocation error.
+ */
+siridb_ngram_query_t * siridb_ngram_query_regex(
+        const char * source,
+        size_t len)
+{
+    siridb_ngram_query_t * query;
+    const char * pt = source + 1;
+    const char * end = source + len;
+    char run[len];
+    size_t n = 0;
+    int depth = 0;
+
+    /* the pattern ends at the last slash, flags are ignored */
+    while (end > pt && *(end - 1) != '/')
+    {
+        end--;
+    }
+    end--;
+
+    query = malloc(sizeof(siridb_ngram_query_t) + len * sizeof(uint32_t));
+    if (query == NULL)
+    {
+        return NULL;
+    }
+    query->n = 0;
+
+    for (; pt < end; pt++)
+    {
+        switch (*pt)
+        {
+        case '|':
+            if (depth == 0)
+            {
+                free(query);
+                return NULL;
+            }
+            break;
+
+        case '(':
+            if (pt + 1 < end && pt[1] == '?')
+            {
+                const char * opt;
+                for (opt = pt + 2; opt < end && isalpha(*opt); opt++)
+                {
+                    if (*opt == 'x')
+                    {
+                        /* white space is ignored in extended mode */
+                        free(query);
+                        return NULL;
+                    }
+                }
+            }
+            NGRAM_add_run(query, run, n);
+            n = 0;
+            depth++;
+            break;
+
+        case ')':
+            depth--;
+            break;
+
+        case '[':
+            NGRAM_add_run(query, run, n);
+            n = 0;
+            pt++;
+            if (pt < end && *pt == '^')
+            {
+                pt++;
+            }
+            if (pt < end && *pt == ']')
+            {
+                pt++;
+            }
+            for (; pt < end && *pt != ']'; pt++)
+            {
+                if (*pt == '\\')
+                {
+                    pt++;
+                }
+            }
+            break;
+
+        case '{':
+            while (pt + 1 < end && *pt != '}')
+            {
+                pt++;
+            }
+            /* fall through */
+        case '*':
+        case '?':
+            /* the last character is optional */
+            NGRAM_add_run(query, run, n ? n - 1 : 0);
+            n = 0;
+            break;
+
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            NGRAM_add_run(query, run, n);
+            n = 0;
+            break;
+
+        case '\\':
+            if (++pt == end)
+            {
+                break;
+            }
+            if (isalnum(*pt))
+            {
+                /* escape sequence like \d, \x41 or \p{L} */
+                NGRAM_add_run(query, run, n);
+                n = 0;
+                while (pt + 1 < end && isalnum(pt[1]))
+                {
+                    pt++;
+                }
+                if (pt + 1 < end && pt[1] == '{')
+                {
+                    while (pt + 1 < end && *pt != '}')
+                    {
+                        pt++;
+                    }
+                }
+                break;
+            }
+            /* fall through */
+        default:
+            if (depth == 0)
+            {
+                run[n++] = *pt;
+            }
+        }
+    }
+
+    NGRAM_add_run(query, run, n);
+
+    return NGRAM_query_done(query);
+}
+
+/*
+ * Returns 0 when no value in the chunk can match the query, or 1 if a value
+ * might match.
+ */
+int siridb_ngram_match(
+        siridb_ngram_t * ngram,
+        siridb_ngram_query_t * query)
+{
+    size_t i;
+
+    for (i = 0; i < query->n; i++)
+    {
+        if (!NGRAM_has(ngram, query->hashes[i]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Returns a new index or NULL in case of a memory allocation error.
+ */
+siridb_ngram_index_t * siridb_ngram_index_new(size_t max_memory)
+{
+    siridb_ngram_index_t * index = malloc(sizeof(siridb_ngram_index_t));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+    index->memory = 0;
+    index->max_memory = max_memory;
+    return index;
+}
+
+/*
+ * Set the filter for a chunk position. The map is created when needed and
+ * an existing filter is replaced. The filter is destroyed when it does not
+ * fit within the memory limit of the index or in case of an error, which is
+ * not critical since chunks without a filter are read.
+ *
+ * The memory is updated atomically since shards might be destroyed by
+ * another thread.
+ */
+void siridb_ngram_set(
+        siridb_ngram_index_t * index,
+        imap_t ** ngrams,
+        uint64_t pos,
+        siridb_ngram_t * ngram)
+{
+    siridb_ngram_t * prev;
+    size_t size = siridb_ngram_size(ngram);
+
+    if (__atomic_add_fetch(&index->memory, size, __ATOMIC_RELAXED) >
+            index->max_memory)
+    {
+        __atomic_sub_fetch(&index->memory, size, __ATOMIC_RELAXED);
+        siridb_ngram_free(ngram);
+        return;
+    }
+
+    if (*ngrams == NULL && (*ngrams = imap_new()) == NULL)
+    {
+        log_error("Cannot create trigram map");
+        __atomic_sub_fetch(&index->memory, size, __ATOMIC_RELAXED);
+        siridb_ngram_free(ngram);
+        return;
+    }
+
+    prev = imap_pop(*ngrams, pos);
+    if (prev != NULL)
+    {
+        __atomic_sub_fetch(
+                &index->memory,
+                siridb_ngram_size(prev),
+                __ATOMIC_RELAXED);
+        siridb_ngram_free(prev);
+    }
+
+    if (imap_add(*ngrams, pos, ngram))
+    {
+        log_error("Cannot add trigram filter for position %" PRIu64, pos);
+        __atomic_sub_fetch(&index->memory, size, __ATOMIC_RELAXED);
+        siridb_ngram_free(ngram);
+    }
+}
+
+static int NGRAM_free_cb(siridb_ngram_t * ngram, size_t * size)
+{
+    *size += siridb_ngram_size(ngram);
+    siridb_ngram_free(ngram);
+    return 0;
+}
+
+/*
+ * Destroy a map with filters and release the memory from the index.
+ */
+void siridb_ngram_free_map(siridb_ngram_index_t * index, imap_t * ngrams)
+{
+    size_t size = 0;
+
+    (void) imap_walk(ngrams, (imap_cb) NGRAM_free_cb, &size);
+    imap_free(ngrams, NULL);
+
+    __atomic_sub_fetch(&index->memory, size, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t NGRAM_hash(const char * s)
+{
+    uint32_t x = (uint32_t) tolower((unsigned char) s[0]) << 16 |
+            (uint32_t) tolower((unsigned char) s[1]) << 8 |
+            (uint32_t) tolower((unsigned char) s[2]);
+
+    x ^= x >> 16;
+    x *= UINT32_C(0x7feb352d);
+    x ^= x >> 15;
+    x *= UINT32_C(0x846ca68b);
+    x ^= x >> 16;
+
+    return x;
+}
+
+static inline int NGRAM_has(siridb_ngram_t * ngram, uint32_t hash)
+{
+    if (!(ngram->bits[(hash & ngram->mask) / 64] &
+            (UINT64_C(1) << (hash & 63))))
+    {
+        return 0;
+    }
+    hash = (hash >> 16) | (hash << 16);
+    return (ngram->bits[(hash & ngram->mask) / 64] &
+            (UINT64_C(1) << (hash & 63))) != 0;
+}
+
+static void NGRAM_add_run(
+        siridb_ngram_query_t * query,
+        const char * run,
+        size_t len)
+{
+    size_t i;
+    for (i = 2; i < len; i++, run++)
+    {
+        query->hashes[query->n++] = NGRAM_hash(run);
+    }
+}
+
+static siridb_ngram_query_t * NGRAM_query_done(siridb_ngram_query_t * query)
+{
+    if (query->n == 0)
+    {
+        free(query);
+        return NULL;
+    }
+    return query;
+}
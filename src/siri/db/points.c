@@ -53,16 +53,17 @@ static void POINTS_zip_str(
         uint8_t * s,
         size_t n,
         uint8_t is_ascii);
+static void POINTS_zip_prime(uint8_t * src, size_t n);
 static int POINTS_set_cinfo_size(uint16_t * cinfo, size_t * size);
 inline static uint16_t POINTS_hash(uint32_t h);
 static void POINTS_destroy(siridb_points_t * points);
 
-static uint8_t * dictionary[DICT_SZ + 1];
-
-void siridb_points_init(void)
-{
-    memset(dictionary, 0, sizeof(dictionary));
-}
+/*
+ * Hash table with the last position of each 4 byte sequence, used by the
+ * string encoder. Each thread has its own table so strings can be compressed
+ * in parallel. Positions outside the current source are ignored.
+ */
+static __thread uint8_t * points__table[DICT_SZ + 1];
 
 /*
  * Returns NULL in case an error has occurred.
@@ -300,7 +301,8 @@ int siridb_points_raw_pack(siridb_points_t * points, qp_packer_t * packer)
     if (points->tp == TP_STRING)
     {
         uint16_t cinfo;
-        data = siridb_points_zip_string(points, 0, points->len, &cinfo, &size);
+        data = siridb_points_zip_string(
+                points, 0, points->len, &cinfo, &size, NULL);
     }
     else
     {
@@ -566,12 +568,17 @@ unsigned char * siridb_points_zip_int(
     return bits;
 }
 
+/*
+ * Compress string points. When a dictionary is given, the same dictionary
+ * must be used to unzip the points.
+ */
 unsigned char * siridb_points_zip_string(
         siridb_points_t * points,
         uint_fast32_t start,
         uint_fast32_t end,
         uint16_t * cinfo,
-        size_t * size)
+        size_t * size,
+        siridb_zdict_t * zdict)
 {
     uint_fast32_t n = end - start;
     if (n < POINTS_ZIP_THRESHOLD)
@@ -595,6 +602,7 @@ unsigned char * siridb_points_zip_string(
     uint8_t tinfo = 0;
     uint8_t shift = 0;
     uint8_t ibit;
+    size_t dsz = zdict == NULL ? 0 : zdict->len;
 
     sz = POINTS_strlen_check_ascii((point + 1)->val.str, &is_ascii);
     sizes[--m] = sz;
@@ -629,7 +637,8 @@ unsigned char * siridb_points_zip_string(
     /* calculate time-stamps size */
     sz = 13 + shift + tinfo*(n - 2);
 
-    src = malloc(sz_src);
+    /* the dictionary is placed in front of the strings */
+    src = malloc(dsz + sz_src);
     out = malloc(sz + sz_src + (is_ascii ? 0 : (n * 8)));
     if (src == NULL || out == NULL)
     {
@@ -637,7 +646,20 @@ unsigned char * siridb_points_zip_string(
     }
     pt = out;
     sout = out + sz;
-    spt = src;
+    spt = src + dsz;
+
+    if (dsz)
+    {
+        memcpy(src, zdict->data, dsz);
+        POINTS_zip_prime(src, dsz);
+
+        /* the first token must be a literal since the decoder reads the mode
+         * (ascii or not) from the first byte */
+        if (sizes[m] >= sizeof(uint32_t))
+        {
+            points__table[POINTS_hash(*((uint32_t *) point->val.raw))] = NULL;
+        }
+    }
 
     memcpy(pt, &ibit, sizeof(uint8_t));
     pt++;
@@ -1201,20 +1223,25 @@ int siridb_points_unzip_string_raw(
     return 0;
 }
 
+/*
+ * Unzip string points. The dictionary must be the one which is used to zip
+ * the points, or NULL if no dictionary was used.
+ */
 int siridb_points_unzip_string(
         siridb_points_t * points,
         uint8_t * bits,
         uint16_t len,
         uint64_t * start_ts,
         uint64_t * end_ts,
-        uint8_t has_overlap)
+        uint8_t has_overlap,
+        siridb_zdict_t * zdict)
 {
     uint64_t ts, tmp, mask;
     siridb_point_t * point = points->data + points->len;
     uint32_t src_sz;
     uint8_t * buf, * pt = bits;
     uint8_t j, tcount, tshift = *pt;
-    size_t i, offset;
+    size_t i, offset, dsz;
 
     tcount =  *pt & 0xf;
     tshift = *pt & 0xf0;
@@ -1258,14 +1285,21 @@ int siridb_points_unzip_string(
 
     n -= i;
 
-    buf = malloc(src_sz + n);
+    dsz = zdict == NULL ? 0 : zdict->len;
+    buf = malloc(dsz + src_sz + n);
     if (buf == NULL)
     {
         return -1;
     }
 
+    /* matches may refer to the dictionary in front of the strings */
+    if (dsz)
+    {
+        memcpy(buf, zdict->data, dsz);
+    }
+
     if (POINTS_unpack_string(
-            points->data + points->len, n, i, bits + offset, buf))
+            points->data + points->len, n, i, bits + offset, buf + dsz))
     {
         free(buf);
         return -1;
@@ -1683,8 +1717,13 @@ static void POINTS_zip_str(
     {
         uint32_t * inp = (uint32_t *) *pt;
         uint16_t idx = POINTS_hash(*inp);
-        match = dictionary[POINTS_hash(idx)];
-        dictionary[idx] = *pt;
+        /*
+         * The lookup used to be 'table[POINTS_hash(idx)]', which is the same
+         * slot since POINTS_hash() returns 'idx' for each index in the table.
+         * (the zipped bytes are unchanged, see test_zdict)
+         */
+        match = points__table[idx];
+        points__table[idx] = *pt;
         if (match >= src && match < *pt && *((uint32_t *) match) == *inp)
         {
             if (literal < *pt)
@@ -1716,6 +1755,19 @@ static void POINTS_zip_str(
     *pt = end;
 }
 
+/*
+ * Add the positions in a dictionary to the hash table so the strings which
+ * follow can refer to the dictionary.
+ */
+static void POINTS_zip_prime(uint8_t * src, size_t n)
+{
+    uint8_t * pt, * end = src + n;
+    for (pt = src; pt + sizeof(uint32_t) <= end; ++pt)
+    {
+        points__table[POINTS_hash(*((uint32_t *) pt))] = pt;
+    }
+}
+
 static int POINTS_set_cinfo_size(uint16_t * cinfo, size_t * size)
 {
     if (*size >= 0x8000)
@@ -5,6 +5,7 @@
 #include <llist/llist.h>
 #include <logger/logger.h>
 #include <siri/db/pools.h>
+#include <siri/db/series.h>
 #include <siri/db/server.h>
 #include <siri/net/promises.h>
 #include <siri/optimize.h>
@@ -14,6 +15,9 @@
 
 static int POOLS_max_pool(siridb_server_t * server, uint16_t * max_pool);
 static int POOLS_arrange(siridb_server_t * server, siridb_t * siridb);
+static int POOLS_balance_cb(
+        siridb_series_t * series,
+        siridb_lookup_stats_t * stats);
 
 /*
  * This function can raise an ALLOC signal.
@@ -62,7 +66,9 @@ void siridb_pools_init(siridb_t * siridb)
     siridb->pools->prev_lookup = NULL;
 
     /* generate pool lookup for series */
-    siridb->pools->lookup = siridb_lookup_new(siridb->pools->len);
+    siridb->pools->lookup = siridb_lookup_new(
+            siridb->pools->len,
+            siridb->lookup_mode);
     if (siridb->pools->lookup == NULL)
     {
         siridb_pools_free(siridb->pools);
@@ -86,17 +92,20 @@ void siridb_pools_free(siridb_pools_t * pools)
  * Append a new pool to pools and returns the new created pool object.
  *
  * Note: pools->prev_lookup is set to the previous lookup table and a new
- *       lookup is created and set to pools->lookup.
+ *       lookup is created and set to pools->lookup. The new lookup uses
+ *       'lookup_mode' which allows a migration to another lookup mode
+ *       while re-indexing.
  *
  * Returns NULL and raises a SIGNAL in case an error has occurred and pools
  * remains unchanged in this case.
  */
 siridb_pool_t * siridb_pools_append(
         siridb_pools_t * pools,
-        siridb_server_t * server)
+        siridb_server_t * server,
+        uint8_t lookup_mode)
 {
     siridb_pool_t * pool = NULL;
-    siridb_lookup_t * lookup = siridb_lookup_new(pools->len + 1);
+    siridb_lookup_t * lookup = siridb_lookup_new(pools->len + 1, lookup_mode);
     if (lookup != NULL)
     {
         pool = (siridb_pool_t *)
@@ -124,6 +133,69 @@ siridb_pool_t * siridb_pools_append(
 }
 
 
+/*
+ * Log how the series of 'this' server are spread over the lookup slots. When
+ * the legacy lookup is used, also log the balance the local series would get
+ * after migrating to the default lookup mode with one more pool.
+ *
+ * This function can raise an ALLOC signal.
+ */
+void siridb_pools_log_balance(siridb_t * siridb)
+{
+    siridb_lookup_stats_t * stats;
+    siridb_lookup_t * lookup;
+
+    stats = siridb_lookup_stats_new(siridb->pools->lookup, siridb->pools->len);
+    if (stats == NULL)
+    {
+        return;  /* signal is raised */
+    }
+
+    imap_walk(siridb->series_map, (imap_cb) POOLS_balance_cb, stats);
+
+    log_info(
+            "Lookup '%s' for database '%s': %zu series use %zu of %u slots "
+            "(max %zu series in one slot)",
+            siridb_lookup_mode_str(siridb->lookup_mode),
+            siridb->dbname,
+            stats->n,
+            stats->slots_used,
+            SIRIDB_LOOKUP_SZ,
+            stats->slot_max);
+
+    siridb_lookup_stats_free(stats);
+
+    if (    siridb->lookup_mode == SIRIDB_LOOKUP_MODE_DEFAULT ||
+            !siridb->series_map->len)
+    {
+        return;
+    }
+
+    lookup = siridb_lookup_new(
+            siridb->pools->len + 1,
+            SIRIDB_LOOKUP_MODE_DEFAULT);
+    if (lookup == NULL)
+    {
+        return;  /* signal is raised */
+    }
+
+    stats = siridb_lookup_stats_new(lookup, siridb->pools->len + 1);
+    if (stats != NULL)
+    {
+        imap_walk(siridb->series_map, (imap_cb) POOLS_balance_cb, stats);
+        log_info(
+                "Expanding database '%s' to %u pools using lookup '%s' "
+                "would balance the local series within %.1f%%",
+                siridb->dbname,
+                siridb->pools->len + 1,
+                siridb_lookup_mode_str(SIRIDB_LOOKUP_MODE_DEFAULT),
+                siridb_lookup_stats_imbalance(stats) * 100.0);
+        siridb_lookup_stats_free(stats);
+    }
+
+    siridb_lookup_free(lookup);
+}
+
 /*
  * Returns 1 (true) if at least one server in each pool is online, 0 (false)
  * if at least one pool has no server online. ('this' pool is NOT included)
@@ -360,3 +432,11 @@ static int POOLS_arrange(siridb_server_t * server, siridb_t * siridb)
     siridb_pool_add_server(pool, server);
     return 0;
 }
+
+static int POOLS_balance_cb(
+        siridb_series_t * series,
+        siridb_lookup_stats_t * stats)
+{
+    siridb_lookup_stats_add(stats, series->name, series->name_len);
+    return 0;
+}
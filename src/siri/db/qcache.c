@@ -0,0 +1,643 @@
+/*
+ * qcache.c - Bounded LRU cache for parsed queries.
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <logger/logger.h>
+#include <siri/db/qcache.h>
+#include <siri/err.h>
+#include <siri/grammar/gramp.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* placeholders for literals in the cache key */
+#define QCACHE_INT '\x01'
+#define QCACHE_TIME '\x02'
+#define QCACHE_SINGLEQ '\x03'
+#define QCACHE_DOUBLEQ '\x04'
+#define QCACHE_PLACEHOLDERS "\x01\x02\x03\x04"
+
+/* date strings start with a year, like '2023-10-01 12:00' */
+#define QCACHE_IS_DATE(s, e) ((e) - (s) > 5 && \
+    isdigit((unsigned char) (s)[0]) && isdigit((unsigned char) (s)[1]) && \
+    isdigit((unsigned char) (s)[2]) && isdigit((unsigned char) (s)[3]) && \
+    (s)[4] == '-')
+
+#define QCACHE_IS_WORD(c) \
+    (isalnum((unsigned char) (c)) || (c) == '_' || (c) == '.')
+
+static size_t QCACHE_scan(const char * q, char * key, siridb_qlit_t * lits);
+static int QCACHE_match(
+        siridb_qentry_t * qentry,
+        const char * q,
+        siridb_qlit_t * lits,
+        size_t nlits);
+static void QCACHE_bind(siridb_qentry_t * qentry, cleri_node_t * node);
+static void QCACHE_entry_free(siridb_qentry_t * qentry);
+static void QCACHE_unlink(siridb_qcache_t * qcache, siridb_qentry_t * qentry);
+static void QCACHE_drop(siridb_qcache_t * qcache, siridb_qentry_t * qentry);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_qcache_t * siridb_qcache_new(void)
+{
+    siridb_qcache_t * qcache = malloc(sizeof(siridb_qcache_t));
+    if (qcache == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    qcache->entries = ct_new();
+    if (qcache->entries == NULL)
+    {
+        ERR_ALLOC
+        free(qcache);
+        return NULL;
+    }
+
+    qcache->tz = -1;
+    qcache->precision = 0;
+    qcache->n = 0;
+    qcache->hits = 0;
+    qcache->misses = 0;
+    qcache->head = NULL;
+    qcache->tail = NULL;
+
+    return qcache;
+}
+
+/*
+ * Destroy the cache. Entries which are still in use will be destroyed when
+ * they are released.
+ */
+void siridb_qcache_free(siridb_qcache_t * qcache)
+{
+    siridb_qcache_clear(qcache);
+    ct_free(qcache->entries, NULL);
+    free(qcache);
+}
+
+/*
+ * Remove all entries from the cache.
+ */
+void siridb_qcache_clear(siridb_qcache_t * qcache)
+{
+    while (qcache->head != NULL)
+    {
+        QCACHE_drop(qcache, qcache->head);
+    }
+}
+
+/*
+ * Returns an entry for the given query or NULL when the query is not in the
+ * cache or the cached entry is in use by another query. The returned entry is
+ * marked as most recently used and must be released using
+ * siridb_qcache_release().
+ *
+ * All entries are dropped when the time-zone or precision has changed since
+ * the entries were cached.
+ */
+siridb_qentry_t * siridb_qcache_get(
+        siridb_qcache_t * qcache,
+        const char * q,
+        iso8601_tz_t tz,
+        uint8_t precision)
+{
+    siridb_qentry_t * qentry;
+    siridb_qlit_t lits[SIRIDB_QCACHE_MAX_QUERY];
+    char key[SIRIDB_QCACHE_MAX_QUERY + 1];
+    size_t i, nlits = 0;
+
+    if (qcache->tz != tz || qcache->precision != precision)
+    {
+        if (qcache->n)
+        {
+            log_debug(
+                    "Time-zone or precision has changed, "
+                    "dropping %" PRIu32 " cached queries",
+                    qcache->n);
+        }
+        siridb_qcache_clear(qcache);
+        qcache->tz = tz;
+        qcache->precision = precision;
+    }
+
+    if (siridb_qcache_is_cachable(q))
+    {
+        nlits = QCACHE_scan(q, key, lits);
+        qentry = ct_get(qcache->entries, key);
+    }
+    else
+    {
+        qentry = NULL;
+    }
+
+    /* entries with the same key differ in literals which are not bound */
+    while (qentry != NULL && (
+            qentry->in_use || !QCACHE_match(qentry, q, lits, nlits)))
+    {
+        qentry = qentry->same;
+    }
+
+    if (qentry == NULL)
+    {
+        qcache->misses++;
+        return NULL;
+    }
+
+    qcache->hits++;
+    qentry->in_use = 1;
+
+    /* the bound literals point to the query until the entry is released */
+    for (i = 0; i < nlits; i++)
+    {
+        if (qentry->lits[i].node != NULL)
+        {
+            qentry->lits[i].node->str = q + lits[i].pos;
+            qentry->lits[i].node->len = lits[i].len;
+        }
+    }
+
+    /* move to the front */
+    QCACHE_unlink(qcache, qentry);
+
+    qentry->next = qcache->head;
+    if (qcache->head != NULL)
+    {
+        qcache->head->prev = qentry;
+    }
+    qcache->head = qentry;
+    if (qcache->tail == NULL)
+    {
+        qcache->tail = qentry;
+    }
+
+    return qentry;
+}
+
+/*
+ * Add an entry to the cache. The least recently used entry is dropped when
+ * the cache is full. Literals which are part of the expressions are bound,
+ * other literals must be equal for a hit.
+ *
+ * Returns 0 if the entry is added or -1 if not. The entry remains owned by
+ * the caller when not added and will be destroyed when released. (no signal
+ * is raised since a failure is not critical)
+ */
+int siridb_qcache_put(siridb_qcache_t * qcache, siridb_qentry_t * qentry)
+{
+    siridb_qentry_t * other;
+    void ** data;
+    size_t i;
+
+    assert (qentry->in_use && !qentry->cached);
+
+    for (i = 0; i < qentry->exprs->len; i++)
+    {
+        QCACHE_bind(qentry, (cleri_node_t *) qentry->exprs->data[i]);
+    }
+
+    data = ct_getaddr(qcache->entries, qentry->key);
+    if (data == NULL || *data == NULL)
+    {
+        if (ct_add(qcache->entries, qentry->key, qentry) != CT_OK)
+        {
+            /* allocation failed */
+            return -1;
+        }
+    }
+    else
+    {
+        for (other = *data; other != NULL; other = other->same)
+        {
+            if (strcmp(other->q, qentry->q) == 0)
+            {
+                /* the query exists (in use by another query) */
+                return -1;
+            }
+        }
+        qentry->same = *data;
+        *data = qentry;
+    }
+
+    qentry->cached = 1;
+    qentry->prev = NULL;
+    qentry->next = qcache->head;
+    if (qcache->head != NULL)
+    {
+        qcache->head->prev = qentry;
+    }
+    qcache->head = qentry;
+    if (qcache->tail == NULL)
+    {
+        qcache->tail = qentry;
+    }
+
+    if (++qcache->n > SIRIDB_QCACHE_SIZE)
+    {
+        QCACHE_drop(qcache, qcache->tail);
+    }
+
+    return 0;
+}
+
+/*
+ * Release an entry. The entry will be destroyed if it is no longer cached.
+ */
+void siridb_qcache_release(siridb_qentry_t * qentry)
+{
+    siridb_qlit_t * lit = qentry->lits + qentry->nlits;
+
+    /* restore the bound literals since the query will be destroyed */
+    while (lit-- != qentry->lits)
+    {
+        if (lit->node != NULL)
+        {
+            lit->node->str = qentry->q + lit->pos;
+            lit->node->len = lit->len;
+        }
+    }
+
+    qentry->in_use = 0;
+    if (!qentry->cached)
+    {
+        QCACHE_entry_free(qentry);
+    }
+}
+
+/*
+ * Returns 1 when a query can be cached or 0 if not. Queries containing a
+ * password are not cached so we do not keep them in memory. Queries with a
+ * placeholder character are not cached since the key would be ambiguous.
+ */
+int siridb_qcache_is_cachable(const char * q)
+{
+    size_t len = strlen(q);
+    return (
+        len &&
+        len <= SIRIDB_QCACHE_MAX_QUERY &&
+        strstr(q, "password") == NULL &&
+        strpbrk(q, QCACHE_PLACEHOLDERS) == NULL);
+}
+
+/*
+ * Returns a new entry which is marked as in use and owns a copy of the given
+ * query. The parse result should be created on entry->q since the tree will
+ * point to this string.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_qentry_t * siridb_qentry_new(const char * q)
+{
+    siridb_qlit_t lits[SIRIDB_QCACHE_MAX_QUERY];
+    char key[SIRIDB_QCACHE_MAX_QUERY + 1];
+    size_t nlits;
+    siridb_qentry_t * qentry;
+
+    assert (siridb_qcache_is_cachable(q));
+
+    qentry = malloc(sizeof(siridb_qentry_t));
+    if (qentry == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    nlits = QCACHE_scan(q, key, lits);
+
+    qentry->q = strdup(q);
+    qentry->key = strdup(key);
+    qentry->lits = malloc(sizeof(siridb_qlit_t) * (nlits ? nlits : 1));
+    qentry->exprs = vec_new(VEC_DEFAULT_SIZE);
+
+    if (    qentry->q == NULL ||
+            qentry->key == NULL ||
+            qentry->lits == NULL ||
+            qentry->exprs == NULL)
+    {
+        ERR_ALLOC
+        free(qentry->q);
+        free(qentry->key);
+        free(qentry->lits);
+        free(qentry->exprs);
+        free(qentry);
+        return NULL;
+    }
+
+    memcpy(qentry->lits, lits, sizeof(siridb_qlit_t) * nlits);
+    qentry->nlits = nlits;
+    qentry->in_use = 1;
+    qentry->cached = 0;
+    qentry->n = 0;
+    qentry->pr = NULL;
+    qentry->nodes = NULL;
+    qentry->prev = NULL;
+    qentry->next = NULL;
+    qentry->same = NULL;
+
+    return qentry;
+}
+
+/*
+ * Store a copy of the walker output.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_qentry_set_nodes(siridb_qentry_t * qentry, siridb_nodes_t * nodes)
+{
+    siridb_nodes_t * nd;
+    siridb_qnode_t * qnode;
+    size_t n = 0;
+
+    for (nd = nodes; nd != NULL; nd = nd->next)
+    {
+        n++;
+    }
+
+    free(qentry->nodes);
+    qentry->n = 0;
+    qentry->nodes = NULL;
+
+    if (!n)
+    {
+        return 0;
+    }
+
+    qentry->nodes = malloc(sizeof(siridb_qnode_t) * n);
+    if (qentry->nodes == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    for (nd = nodes, qnode = qentry->nodes; nd != NULL; nd = nd->next, qnode++)
+    {
+        qnode->node = nd->node;
+        qnode->cb = nd->cb;
+    }
+
+    qentry->n = n;
+    return 0;
+}
+
+/*
+ * Returns a new node list based on the cached walker output. The list must
+ * be destroyed using siridb_nodes_free().
+ *
+ * In case of an error, NULL is returned and a SIGNAL is raised. Be aware
+ * that NULL is also returned when the query has no nodes at all.
+ */
+siridb_nodes_t * siridb_qentry_get_nodes(siridb_qentry_t * qentry)
+{
+    siridb_nodes_t * nodes = NULL;
+    siridb_nodes_t * nd;
+    siridb_qnode_t * qnode = qentry->nodes + qentry->n;
+
+    while (qnode-- != qentry->nodes)
+    {
+        nd = malloc(sizeof(siridb_nodes_t));
+        if (nd == NULL)
+        {
+            ERR_ALLOC
+            siridb_nodes_free(nodes);
+            return NULL;
+        }
+        nd->node = qnode->node;
+        nd->cb = qnode->cb;
+        nd->next = nodes;
+        nodes = nd;
+    }
+
+    return nodes;
+}
+
+static void QCACHE_entry_free(siridb_qentry_t * qentry)
+{
+    if (qentry->pr != NULL)
+    {
+        cleri_parse_free(qentry->pr);
+    }
+    vec_free(qentry->exprs);
+    free(qentry->nodes);
+    free(qentry->lits);
+    free(qentry->key);
+    free(qentry->q);
+    free(qentry);
+}
+
+/*
+ * Write the cache key for query `q` to `key` and the literals to `lits`.
+ * Literals are integers, time strings like `5m` and quoted date strings.
+ * Other quoted strings, like series names, are part of the key.
+ *
+ * Returns the number of literals.
+ */
+static size_t QCACHE_scan(const char * q, char * key, siridb_qlit_t * lits)
+{
+    const char * pt = q;
+    const char * end;
+    size_t nlits = 0;
+    char c;
+
+    while ((c = *pt))
+    {
+        end = pt + 1;
+
+        if (c == '\'' || c == '"' || c == '`')
+        {
+            /* quotes are escaped by doubling them */
+            while (*end && (*end != c || *(++end) == c))
+            {
+                end++;
+            }
+            if (c == '`' || !QCACHE_IS_DATE(pt + 1, end))
+            {
+                while (pt < end)
+                {
+                    *key++ = *pt++;
+                }
+                continue;
+            }
+            c = (c == '\'') ? QCACHE_SINGLEQ : QCACHE_DOUBLEQ;
+        }
+        else if (
+                isdigit((unsigned char) c) &&
+                (pt == q || !QCACHE_IS_WORD(pt[-1])))
+        {
+            while (isdigit((unsigned char) *end))
+            {
+                end++;
+            }
+            if (*end && strchr("smhdw", *end) != NULL)
+            {
+                end++;
+                c = QCACHE_TIME;
+            }
+            else
+            {
+                c = QCACHE_INT;
+            }
+            if (QCACHE_IS_WORD(*end))
+            {
+                /* part of a float, uuid or name */
+                while (pt < end)
+                {
+                    *key++ = *pt++;
+                }
+                continue;
+            }
+        }
+        else
+        {
+            *key++ = c;
+            pt++;
+            continue;
+        }
+
+        lits[nlits].pos = pt - q;
+        lits[nlits].len = end - pt;
+        lits[nlits].pad0 = 0;
+        lits[nlits].node = NULL;
+        nlits++;
+
+        *key++ = c;
+        pt = end;
+    }
+
+    *key = '\0';
+    return nlits;
+}
+
+/*
+ * Returns 1 when the literals of query `q` can be used with the entry or 0 if
+ * not. Literals which are not bound must be equal.
+ */
+static int QCACHE_match(
+        siridb_qentry_t * qentry,
+        const char * q,
+        siridb_qlit_t * lits,
+        size_t nlits)
+{
+    size_t i;
+
+    if (qentry->nlits != nlits)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < nlits; i++)
+    {
+        if (    qentry->lits[i].node == NULL && (
+                qentry->lits[i].len != lits[i].len ||
+                memcmp(
+                    qentry->q + qentry->lits[i].pos,
+                    q + lits[i].pos,
+                    lits[i].len)))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Bind the literals of an expression node to the entry literals which are
+ * at the same position. These are re-evaluated each time the entry is used.
+ */
+static void QCACHE_bind(siridb_qentry_t * qentry, cleri_node_t * node)
+{
+    size_t i;
+    cleri_children_t * current;
+
+    switch (node->cl_obj->tp)
+    {
+    case CLERI_TP_REGEX:
+    case CLERI_TP_CHOICE:
+        /* integer, time string or quoted date string */
+        for (i = 0; i < qentry->nlits; i++)
+        {
+            if (    qentry->q + qentry->lits[i].pos == node->str &&
+                    qentry->lits[i].len == node->len)
+            {
+                qentry->lits[i].node = node;
+                break;
+            }
+        }
+        return;
+
+    default:
+        current = node->children;
+        while (current != NULL && cleri_gn(current) != NULL)
+        {
+            QCACHE_bind(qentry, cleri_gn(current));
+            current = current->next;
+        }
+    }
+}
+
+static void QCACHE_unlink(siridb_qcache_t * qcache, siridb_qentry_t * qentry)
+{
+    if (qentry->prev != NULL)
+    {
+        qentry->prev->next = qentry->next;
+    }
+    else
+    {
+        qcache->head = qentry->next;
+    }
+
+    if (qentry->next != NULL)
+    {
+        qentry->next->prev = qentry->prev;
+    }
+    else
+    {
+        qcache->tail = qentry->prev;
+    }
+
+    qentry->prev = NULL;
+    qentry->next = NULL;
+}
+
+/*
+ * Remove an entry from the cache. The entry is destroyed unless it is in use,
+ * in which case it will be destroyed when released.
+ */
+static void QCACHE_drop(siridb_qcache_t * qcache, siridb_qentry_t * qentry)
+{
+    void ** data = ct_getaddr(qcache->entries, qentry->key);
+    siridb_qentry_t * other;
+
+    assert (data != NULL);
+
+    if (*data != qentry)
+    {
+        other = *data;
+        while (other->same != qentry)
+        {
+            other = other->same;
+        }
+        other->same = qentry->same;
+    }
+    else if (qentry->same != NULL)
+    {
+        *data = qentry->same;
+    }
+    else
+    {
+        (void) ct_pop(qcache->entries, qentry->key);
+    }
+
+    QCACHE_unlink(qcache, qentry);
+    qentry->same = NULL;
+    qentry->cached = 0;
+    qcache->n--;
+
+    if (!qentry->in_use)
+    {
+        QCACHE_entry_free(qentry);
+    }
+}
@@ -2,12 +2,14 @@
  * queries.c - Query helpers for listener.
  */
 #include <assert.h>
+#include <hist/hist.h>
 #include <logger/logger.h>
 #include <siri/db/aggregate.h>
 #include <siri/db/query.h>
 #include <siri/db/shard.h>
 #include <siri/db/queries.h>
 #include <siri/db/sset.h>
+#include <siri/db/tdigest.h>
 #include <stddef.h>
 #include <stdlib.h>
 
@@ -16,7 +18,7 @@
 #define QUERIES_NEW(q)              \
 q->flags = 0;                       \
 q->series_map = NULL;               \
-q->series_tmp = NULL;               \
+q->series_bits = NULL;              \
 q->sset_vec = NULL;                 \
 q->vec = NULL;                      \
 q->vec_index = 0;                   \
@@ -35,11 +37,9 @@ if (q->series_map != NULL)                                      \
             q->series_map,                                      \
             (imap_free_cb) &siridb__series_decref);             \
 }                                                               \
-if (q->series_tmp != NULL)                                      \
+if (q->series_bits != NULL)                                     \
 {                                                               \
-    imap_free(                                                  \
-            q->series_tmp,                                      \
-            (imap_free_cb) &siridb__series_decref);             \
+    rbits_free(q->series_bits);                                 \
 }                                                               \
 if (q->vec != NULL)                                             \
 {                                                               \
@@ -65,6 +65,7 @@ free(q);                                                        \
 siridb_query_free(handle);
 
 static void QUERIES_free_merge_result(vec_t * plist);
+static void QUERIES_free_tdigests(vec_t * tdigests);
 
 query_select_t * query_select_new(void)
 {
@@ -78,6 +79,7 @@ query_select_t * query_select_new(void)
 
     q_select->tp = QUERIES_SELECT;
     q_select->nselects = 1;  /* we have at least one select function  */
+    q_select->resolve_start = hist_now();
     q_select->result = ct_new();
 
     if (q_select->result == NULL)
@@ -140,6 +142,7 @@ query_drop_t * query_drop_new(void)
     q_drop->n = 0;
     q_drop->flags = 0;
     q_drop->shards_list = NULL;
+    q_drop->drop = NULL;
 
     return q_drop;
 }
@@ -203,6 +206,11 @@ void query_drop_free(uv_handle_t * handle)
 {
     query_drop_t * q_drop = ((siridb_query_t *) handle->data)->data;
 
+    if (q_drop->drop != NULL)
+    {
+        siridb_shard_drop_free(q_drop->drop);
+    }
+
     if (q_drop->shards_list != NULL)
     {
         siridb_shard_t * shard;
@@ -253,6 +261,11 @@ void query_select_free(uv_handle_t * handle)
         }
     }
 
+    if (q_select->tdigests != NULL)
+    {
+        ct_free(q_select->tdigests, (ct_free_cb) &QUERIES_free_tdigests);
+    }
+
     free(q_select->merge_as);
 
     if (q_select->alist != NULL)
@@ -286,3 +299,8 @@ static void QUERIES_free_merge_result(vec_t * plist)
     }
     free(plist);
 }
+
+static void QUERIES_free_tdigests(vec_t * tdigests)
+{
+    vec_destroy(tdigests, (vec_destroy_cb) siridb_tdigest_free);
+}
@@ -8,6 +8,7 @@
 #include <logger/logger.h>
 #include <siri/async.h>
 #include <siri/db/nodes.h>
+#include <siri/db/qcache.h>
 #include <siri/db/query.h>
 #include <siri/db/replicate.h>
 #include <siri/db/servers.h>
@@ -17,6 +18,7 @@
 #include <siri/db/queries.h>
 #include <siri/net/clserver.h>
 #include <siri/net/pkg.h>
+#include <siri/net/promise.h>
 #include <siri/net/clserver.h>
 #include <siri/siri.h>
 #include <siri/grammar/gramp.h>
@@ -38,6 +40,12 @@
 static void QUERY_send_invalid_error(uv_async_t * handle);
 static void QUERY_parse(uv_async_t * handle);
 static int QUERY_walk(
+#if SIRIDB_EXPR_ALLOC
+        siridb_query_t * query,
+#endif
+        cleri_node_t * node,
+        siridb_walker_t * walker);
+static int QUERY_expr(
 #if SIRIDB_EXPR_ALLOC
         siridb_query_t * query,
 #endif
@@ -57,6 +65,14 @@ static int QUERY_rebuild(
         size_t * size,
         const size_t max_size);
 static void QUERY_send_no_query(uv_async_t * handle);
+static int QUERY_from_cache(
+        siridb_query_t * query,
+        siridb_qentry_t * qentry,
+        siridb_walker_t * walker);
+static uint64_t QUERY_cpu_ns_since(struct timespec * start);
+static void QUERY_forward_cb(vec_t * promises, uv_async_t * handle);
+static void QUERY_log_slow(siridb_query_t * query);
+static void QUERY_stat_free(siridb_query_stat_t * stat);
 
 /*
  * This function can raise a SIGNAL.
@@ -136,7 +152,18 @@ void siridb_query_run(
     /* make sure all *other* pointers are set to NULL */
     query->data = NULL;
     query->pr = NULL;
+    query->qentry = NULL;
     query->nodes = NULL;
+    query->parse_ns = 0;
+    query->async_cb = NULL;
+    query->stat = NULL;
+
+    /* statistics for the slow query log, the log is not critical so an
+     * allocation error is ignored */
+    if ((flags & SIRIDB_QUERY_FLAG_MASTER) && siri.cfg->slow_query_threshold)
+    {
+        query->stat = calloc(1, sizeof(siridb_query_stat_t));
+    }
 
     if (Logger.level == LOGGER_DEBUG && strstr(query->q, "password") == NULL)
     {
@@ -157,6 +184,12 @@ void siridb_query_free(uv_handle_t * handle)
     siridb_query_t * query = (siridb_query_t *) handle->data;
     siridb_t * siridb = query->siridb;
 
+    if (query->stat != NULL)
+    {
+        QUERY_log_slow(query);
+        QUERY_stat_free(query->stat);
+    }
+
     /* decrement active tasks and siridb */
     siridb_tasks_dec(siridb->tasks);
     siridb_decref(siridb);
@@ -178,8 +211,12 @@ void siridb_query_free(uv_handle_t * handle)
     /* free node list */
     siridb_nodes_free(query->nodes);
 
-    /* free query result */
-    if (query->pr != NULL)
+    /* free query result, a cached parse result is owned by the entry */
+    if (query->qentry != NULL)
+    {
+        siridb_qcache_release(query->qentry);
+    }
+    else if (query->pr != NULL)
     {
         cleri_parse_free(query->pr);
     }
@@ -296,6 +333,13 @@ void siridb_query_forward(
 
     sirinet_pkg_t * pkg = sirinet_pkg_new(0, packer->len, 0, packer->buffer);
 
+    /* record the response time for each server in the query statistics */
+    if (query->stat != NULL)
+    {
+        query->stat->fwd_cb = cb;
+        cb = (sirinet_promises_cb) QUERY_forward_cb;
+    }
+
     /* increment reference since handle will be bound to a timer */
     siri_async_incref(handle);
 
@@ -388,6 +432,31 @@ void siridb_query_forward(
     qp_packer_free(packer);
 }
 
+/*
+ * Update the query statistics with the number of points read for a series
+ * and the number of points which are added to the result.
+ */
+void siridb_query_stat_read(
+        siridb_query_stat_t * stat,
+        size_t n_read,
+        size_t n_result)
+{
+    size_t mem = stat->mem + n_read * sizeof(siridb_point_t);
+
+    stat->points += n_read;
+    stat->series++;
+    stat->mem += n_result * sizeof(siridb_point_t);
+
+    if (mem < stat->mem)
+    {
+        mem = stat->mem;
+    }
+    if (mem > stat->mem_peak)
+    {
+        stat->mem_peak = mem;
+    }
+}
+
 /*
  * Unpack an error message from a package and copy the message
  * to query->err_msg.
@@ -587,44 +656,82 @@ static void QUERY_send_no_query(uv_async_t * handle)
 static void QUERY_parse(uv_async_t * handle)
 {
     int rc;
+    struct timespec parse_start;
     siridb_query_t * query = (siridb_query_t *) handle->data;
     siridb_t * siridb = query->siridb;
+    siridb_qentry_t * qentry;
+    int add_to_cache = 0;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &parse_start);
 
     siridb_walker_t * walker = siridb_walker_new(
             siridb,
             siridb_time_now(siridb, query->start),
             &query->flags);
 
-    if (    walker == NULL ||
-            (query->pr = cleri_parse_m(siri.grammar, query->q)) == NULL)
+    if (walker == NULL)
     {
-        if (walker != NULL)
-        {
-            siridb_nodes_free(siridb_walker_free(walker));
-        }
-        else
-        {
-            ERR_ALLOC
-        }
-        sprintf(query->err_msg,
-                "Memory allocation error or maximum recursion depth reached.");
+        sprintf(query->err_msg, "Memory allocation error.");
         siridb_query_send_error(handle, CPROTO_ERR_QUERY);
         return;
     }
 
-    if (!query->pr->is_valid)
+    qentry = siridb_qcache_get(
+            siridb->qcache,
+            query->q,
+            siridb->tz,
+            siridb->time->precision);
+
+    if (qentry != NULL)
     {
-        siridb_nodes_free(siridb_walker_free(walker));
-        QUERY_send_invalid_error(handle);
-        return;
+        rc = QUERY_from_cache(query, qentry, walker);
     }
+    else
+    {
+        /* the entry is not cached when the query is invalid, but we still
+         * use the entry to hold the parse result */
+        if (    siridb_qcache_is_cachable(query->q) &&
+                (qentry = siridb_qentry_new(query->q)) != NULL)
+        {
+            walker->exprs = &qentry->exprs;
+            add_to_cache = 1;
+        }
+
+        query->pr = cleri_parse_m(
+                siri.grammar,
+                qentry == NULL ? query->q : qentry->q);
+
+        if (qentry != NULL)
+        {
+            qentry->pr = query->pr;
+            query->qentry = qentry;
+        }
+
+        if (query->pr == NULL)
+        {
+            siridb_nodes_free(siridb_walker_free(walker));
+            sprintf(query->err_msg,
+                "Memory allocation error or maximum recursion depth reached.");
+            siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+            return;
+        }
 
-    if ((rc = QUERY_walk(
+        if (!query->pr->is_valid)
+        {
+            siridb_nodes_free(siridb_walker_free(walker));
+            QUERY_send_invalid_error(handle);
+            return;
+        }
+
+        rc = QUERY_walk(
 #if SIRIDB_EXPR_ALLOC
-            query,
+                query,
 #endif
-            cleri_gn(query->pr->tree->children),
-            walker)))
+                cleri_gn(query->pr->tree->children),
+                walker);
+    }
+
+    if (rc)
     {
         switch (rc)
         {
@@ -660,6 +767,16 @@ static void QUERY_parse(uv_async_t * handle)
     /* free the walker but keep the nodes list */
     query->nodes = siridb_walker_free(walker);
 
+    /* add the walker output to the cache, expressions are evaluated again
+     * each time the entry is used */
+    if (    add_to_cache &&
+            siridb_qentry_set_nodes(qentry, query->nodes) == 0)
+    {
+        (void) siridb_qcache_put(siridb->qcache, qentry);
+    }
+
+    query->parse_ns = QUERY_cpu_ns_since(&parse_start);
+
     if (query->nodes == NULL)
     {
         QUERY_send_no_query(handle);
@@ -667,12 +784,67 @@ static void QUERY_parse(uv_async_t * handle)
     }
 
     uv_async_t * forward = malloc(sizeof(uv_async_t));
-    uv_async_init(siri.loop, forward, (uv_async_cb) query->nodes->cb);
+    uv_async_init(siri.loop, forward, siridb_node_run);
     forward->data = handle->data;
     uv_async_send(forward);
     uv_close((uv_handle_t *) handle, (uv_close_cb) free);
 }
 
+/*
+ * Use a cached parse result. The nodes are restored from the cached walker
+ * output and only the expressions are evaluated.
+ *
+ * Returns 0 if successful or an EXPR_ error code.
+ */
+static int QUERY_from_cache(
+        siridb_query_t * query,
+        siridb_qentry_t * qentry,
+        siridb_walker_t * walker)
+{
+    int rc;
+    size_t i;
+
+    query->qentry = qentry;
+    query->pr = qentry->pr;
+
+    for (i = 0; i < qentry->exprs->len; i++)
+    {
+        if ((rc = QUERY_expr(
+#if SIRIDB_EXPR_ALLOC
+                query,
+#endif
+                (cleri_node_t *) qentry->exprs->data[i],
+                walker)))
+        {
+            return rc;
+        }
+    }
+
+    /* nodes are restored in the walker so siridb_walker_free() returns them,
+     * no append or insert is done on the walker after this */
+    if (qentry->n)
+    {
+        if ((walker->exit_nodes = siridb_qentry_get_nodes(qentry)) == NULL)
+        {
+            return EXPR_MEM_ALLOC_ERR;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the CPU time in nano seconds used by the current thread since the
+ * given start.
+ */
+static uint64_t QUERY_cpu_ns_since(struct timespec * start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    return  (uint64_t) (end.tv_sec - start->tv_sec) * 1000000000ULL +
+            end.tv_nsec - start->tv_nsec;
+}
+
 static int QUERY_to_packer(qp_packer_t * packer, siridb_query_t * query)
 {
     int rc;
@@ -744,6 +916,66 @@ static int QUERY_walk(
         }
     }
 
+    if (    gid == CLERI_GID_TIME_EXPR ||
+            gid == CLERI_GID_CALC_STMT ||
+            gid == CLERI_GID_INT_EXPR)
+    {
+        if (    walker->exprs != NULL &&
+                vec_append_safe(walker->exprs, node))
+        {
+            return EXPR_MEM_ALLOC_ERR;
+        }
+        return QUERY_expr(
+#if SIRIDB_EXPR_ALLOC
+                query,
+#endif
+                node,
+                walker);
+    }
+    else
+    {
+        current = node->children;
+        while (current != NULL && cleri_gn(current) != NULL)
+        {
+            /*
+             * We should not simple walk because THIS has no
+             * cl_obj->cl_obj and THIS is save to skip.
+             */
+            while (cleri_gn(current)->cl_obj->tp == CLERI_TP_THIS)
+            {
+                current = cleri_gn(current)->children;
+            }
+            if ((rc = QUERY_walk(
+#if SIRIDB_EXPR_ALLOC
+                    query,
+#endif
+                    cleri_gn(current),
+                    walker)))
+            {
+                return rc;
+            }
+            current = current->next;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Evaluate a time-, integer- or calc expression and store the result in the
+ * node data. This is done for each run of a query since the result might
+ * depend on the time the query is executed.
+ */
+static int QUERY_expr(
+#if SIRIDB_EXPR_ALLOC
+        siridb_query_t * query,
+#endif
+        cleri_node_t * node,
+        siridb_walker_t * walker)
+{
+    int rc;
+    uint32_t gid = node->cl_obj->gid;
+
     if (gid == CLERI_GID_TIME_EXPR || gid == CLERI_GID_CALC_STMT)
     {
         char buffer[EXPR_MAX_SIZE];
@@ -820,31 +1052,6 @@ static int QUERY_walk(
             return rc;
         }
     }
-    else
-    {
-        current = node->children;
-        while (current != NULL && cleri_gn(current) != NULL)
-        {
-            /*
-             * We should not simple walk because THIS has no
-             * cl_obj->cl_obj and THIS is save to skip.
-             */
-            while (cleri_gn(current)->cl_obj->tp == CLERI_TP_THIS)
-            {
-                current = cleri_gn(current)->children;
-            }
-            if ((rc = QUERY_walk(
-#if SIRIDB_EXPR_ALLOC
-                    query,
-#endif
-                    cleri_gn(current),
-                    walker)))
-            {
-                return rc;
-            }
-            current = current->next;
-        }
-    }
 
     return 0;
 }
@@ -1108,3 +1315,121 @@ static int QUERY_rebuild(
     }
     return 0;
 }
+
+static void QUERY_forward_cb(vec_t * promises, uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_query_stat_t * stat = query->stat;
+    siridb_query_rtt_t * rtt;
+    sirinet_promise_t * promise;
+    size_t i;
+
+    if (promises == NULL)
+    {
+        stat->fwd_cb(promises, handle);
+        return;
+    }
+
+    if (stat->rtt == NULL)
+    {
+        stat->rtt = vec_new(promises->len);
+    }
+
+    for (i = 0; stat->rtt != NULL && i < promises->len; i++)
+    {
+        promise = promises->data[i];
+        if (promise == NULL || promise->rtt == 0)
+        {
+            continue;
+        }
+
+        rtt = malloc(sizeof(siridb_query_rtt_t));
+        if (rtt == NULL)
+        {
+            continue;
+        }
+
+        rtt->server = strdup(promise->server->name);
+        rtt->ns = promise->rtt;
+
+        if (rtt->server == NULL || vec_append_safe(&stat->rtt, rtt))
+        {
+            free(rtt->server);
+            free(rtt);
+        }
+    }
+
+    stat->fwd_cb(promises, handle);
+}
+
+/*
+ * Write the query to the log when the query has taken longer than the slow
+ * query threshold. Queries containing a password are not logged.
+ */
+static void QUERY_log_slow(siridb_query_t * query)
+{
+    siridb_query_stat_t * stat = query->stat;
+    char servers[SIRIDB_MAX_SIZE_ERR_MSG] = "";
+    struct timespec end;
+    double ms;
+    size_t i, n = 0;
+    int rc;
+
+    clock_gettime(CLOCK_REALTIME, &end);
+
+    ms =    (end.tv_sec - query->start.tv_sec) * 1000.0 +
+            (end.tv_nsec - query->start.tv_nsec) / 1000000.0;
+
+    if (    ms < siri.cfg->slow_query_threshold ||
+            strstr(query->q, "password") != NULL)
+    {
+        return;
+    }
+
+    for (i = 0; stat->rtt != NULL && i < stat->rtt->len; i++)
+    {
+        siridb_query_rtt_t * rtt = stat->rtt->data[i];
+
+        rc = snprintf(
+                servers + n,
+                sizeof(servers) - n,
+                "%s%s: %.3f ms",
+                i ? ", " : "",
+                rtt->server,
+                rtt->ns / 1000000.0);
+
+        if (rc < 0 || (size_t) rc >= sizeof(servers) - n)
+        {
+            break;
+        }
+        n += rc;
+    }
+
+    log_warning(
+            "Slow query (%.3f ms, parse: %.3f ms, points: %" PRIu64
+            ", series: %" PRIu64 ", peak points memory: %zu bytes, "
+            "servers: [%s]): %s",
+            ms,
+            query->parse_ns / 1000000.0,
+            stat->points,
+            stat->series,
+            stat->mem_peak,
+            servers,
+            query->q);
+}
+
+static void QUERY_stat_free(siridb_query_stat_t * stat)
+{
+    if (stat->rtt != NULL)
+    {
+        size_t i;
+        for (i = 0; i < stat->rtt->len; i++)
+        {
+            siridb_query_rtt_t * rtt = stat->rtt->data[i];
+            free(rtt->server);
+            free(rtt);
+        }
+        vec_free(stat->rtt);
+    }
+    free(stat);
+}
@@ -30,6 +30,7 @@
 #include <siri/optimize.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #define REINDEX_SLEEP 100           /* 100 milliseconds * active tasks  */
@@ -37,20 +38,13 @@
 #define REINDEX_INITWAIT 20000      /* 20 seconds                       */
 #define REINDEX_TIMEOUT 300000      /* 5 minutes                        */
 
-#define NEXT_SERIES_ERR -1
-#define NEXT_SERIES_SET 0
-#define NEXT_SERIES_END 1
-
-static const long int SIZE2 = 2 * sizeof(uint32_t);
 static const size_t PCKSZ = sizeof(sirinet_pkg_t) + 5;
 
 static inline int REINDEX_fn(siridb_t * siridb, siridb_reindex_t * reindex);
 static int REINDEX_create_cb(siridb_series_t * series, FILE * fp);
 static int REINDEX_unlink(siridb_reindex_t * reindex);
-static int REINDEX_next_series_id(siridb_reindex_t * reindex);
 static void REINDEX_next(siridb_t * siridb);
 static void REINDEX_work(uv_timer_t * timer);
-static void REINDEX_commit_series(siridb_t * siridb);
 static void REINDEX_on_insert_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
@@ -59,6 +53,7 @@ static void REINDEX_on_tag_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
         int status);
+static int REINDEX_skip_cb(siridb_t * siridb, siridb_series_t * series);
 
 static char reindex_progress[30];
 
@@ -79,11 +74,11 @@ siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new)
     {
         reindex->fn = NULL;
         reindex->fp = NULL;
-        reindex->next_series_id = NULL;
-        reindex->pkg_points = NULL;
-        reindex->pkg_tags = NULL;
         reindex->timer = NULL;
         reindex->server = NULL;
+        reindex->pos = 0;
+        reindex->window = 1;
+        reindex->nbatches = 0;
         if (REINDEX_fn(siridb, reindex) < 0)
         {
             ERR_ALLOC
@@ -113,8 +108,9 @@ siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new)
                 }
                 else
                 {
-                    siridb->pools->prev_lookup =
-                            siridb_lookup_new(siridb->pools->len - 1);
+                    siridb->pools->prev_lookup = siridb_lookup_new(
+                            siridb->pools->len - 1,
+                            siridb->prev_lookup_mode);
                     if (siridb->pools->prev_lookup == NULL)
                     {
                         siridb_reindex_free(&reindex);  /* signal is raised */
@@ -131,49 +127,30 @@ siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new)
                     }
                     else if (reindex->size)
                     {
-                        reindex->next_series_id = malloc(sizeof(uint32_t));
-
-                        if (reindex->next_series_id == NULL)
+                        reindex->pos = reindex->size;
+                        reindex->timer = malloc(sizeof(uv_timer_t));
+                        if (reindex->timer == NULL)
                         {
                             ERR_ALLOC
                             siridb_reindex_free(&reindex);
                         }
-                        else if (
-                            fseeko(reindex->fp, -sizeof(uint32_t), SEEK_END) ||
-                            fread(  reindex->next_series_id,
-                                    sizeof(uint32_t),
-                                    1,
-                                    reindex->fp) != 1)
-                        {
-                            ERR_FILE
-                            siridb_reindex_free(&reindex);
-                        }
                         else
                         {
-                            reindex->timer = malloc(sizeof(uv_timer_t));
-                            if (reindex->timer == NULL)
+                            reindex->server = siridb->pools->pool[
+                                      siridb->pools->len -1].server[0];
+                            siridb->server->flags |= SERVER_FLAG_REINDEXING;
+                            reindex->timer->data = siridb;
+                            siri_optimize_pause();
+
+                            uv_timer_init(siri.loop, reindex->timer);
+                            if (create_new)
                             {
-                                ERR_ALLOC
-                                siridb_reindex_free(&reindex);
-                            }
-                            else
-                            {
-                                reindex->server = siridb->pools->pool[
-                                          siridb->pools->len -1].server[0];
-                                siridb->server->flags |= SERVER_FLAG_REINDEXING;
-                                reindex->timer->data = siridb;
-                                siri_optimize_pause();
-
-                                uv_timer_init(siri.loop, reindex->timer);
-                                if (create_new)
-                                {
-                                    /*
-                                     * Sending the flags is only needed when
-                                     * the re-index was just created. Otherwise
-                                     * the flags are send when we authenticate.
-                                     */
-                                    siridb_servers_send_flags(siridb->servers);
-                                }
+                                /*
+                                 * Sending the flags is only needed when
+                                 * the re-index was just created. Otherwise
+                                 * the flags are send when we authenticate.
+                                 */
+                                siridb_servers_send_flags(siridb->servers);
                             }
                         }
                     }
@@ -233,15 +210,18 @@ void siridb_reindex_close(siridb_reindex_t * reindex)
  */
 void siridb_reindex_free(siridb_reindex_t ** reindex)
 {
+    size_t i;
+
     assert ((*reindex)->timer == NULL);
     if ((*reindex)->fp != NULL && fclose((*reindex)->fp))
     {
         ERR_FILE
     }
     free((*reindex)->fn);
-    free((*reindex)->next_series_id);
-    free((*reindex)->pkg_points);
-    free((*reindex)->pkg_tags);
+    for (i = 0; i < (*reindex)->nbatches; i++)
+    {
+        siridb_sbatch_free((*reindex)->batches[i]);
+    }
     free(*reindex);
     *reindex = NULL;
 }
@@ -284,9 +264,22 @@ void siridb_reindex_status_update(siridb_t * siridb)
         siridb_lookup_free(siridb->pools->prev_lookup);
         siridb->pools->prev_lookup = NULL;
 
+        /* a migration to another lookup mode is finished as well */
+        if (siridb->prev_lookup_mode != siridb->lookup_mode)
+        {
+            siridb->prev_lookup_mode = siridb->lookup_mode;
+            if (siridb_save(siridb))
+            {
+                log_critical(
+                        "Cannot save database '%s' after re-indexing",
+                        siridb->dbname);
+            }
+        }
+
         REINDEX_unlink(siridb->reindex);
         siridb_reindex_free(&siridb->reindex);
         log_info("Finished re-indexing database '%s'", siridb->dbname);
+        siridb_pools_log_balance(siridb);
     }
 }
 
@@ -319,85 +312,110 @@ void siridb_reindex_start(uv_timer_t * timer)
 }
 
 /*
- * Type: uv_timer_cb
- *
- * This function sends a packed series to the new (pool) server.
+ * Returns 0 when the package is sent or -1 when a retry is scheduled or a
+ * signal is raised.
  */
-static void REINDEX_send(uv_timer_t * timer)
+static int REINDEX_send(siridb_sbatch_t * batch)
 {
-    siridb_t * siridb = (siridb_t *) timer->data;
-    assert (siridb->reindex->pkg_points != NULL);
+    siridb_reindex_t * reindex = batch->siridb->reindex;
+
+    assert (batch->pkg_points != NULL);
     /* actually 'available' is sufficient since the destination server has
      * never status 're-indexing' unless one day we support down-scaling.
      */
-    if (siridb_server_is_accessible(siridb->reindex->server))
-    {
-        siridb_server_send_pkg(
-                siridb->reindex->server,
-                siridb->reindex->pkg_points,
-                REINDEX_TIMEOUT,
-                (sirinet_promise_cb) REINDEX_on_insert_response,
-                siridb,
-                FLAG_KEEP_PKG);
-    }
-    else
+    if (!siridb_server_is_accessible(reindex->server))
     {
         log_info("Cannot send re-index package to '%s' "
                 "(try again in %d seconds)",
-                siridb->reindex->server->name,
+                reindex->server->name,
                 REINDEX_RETRY / 1000);
+        reindex->window = 1;
         uv_timer_start(
-                siridb->reindex->timer,
-                REINDEX_send,
+                reindex->timer,
+                REINDEX_work,
                 REINDEX_RETRY,
                 0);
+        return -1;
+    }
+
+    if (siridb_server_send_pkg(
+            reindex->server,
+            batch->pkg_points,
+            REINDEX_TIMEOUT,
+            (sirinet_promise_cb) REINDEX_on_insert_response,
+            batch,
+            FLAG_KEEP_PKG))
+    {
+        return -1;  /* signal is raised */
     }
+
+    batch->sent = 1;
+    return 0;
 }
 
 /*
- * Return values:
- *  NEXT_SERIES_SET: Successful set the next series id and removes the previous
- *                   series id
- *  NEXT_SERIES_END: End of the file is reached, re-indexing has finished.
- *  NEXT_SERIES_ERR: An error occurred and a SIGNAL is raised
+ * Returns a new batch with series from the end of the re-index file and
+ * moves reindex->pos to the start of the batch. Series which are already in
+ * this pool, or which are owned by the replica, are skipped.
+ *
+ * In case of an error NULL is returned and a SIGNAL is raised.
  */
-static int REINDEX_next_series_id(siridb_reindex_t * reindex)
+static siridb_sbatch_t * REINDEX_batch_new(siridb_t * siridb)
 {
-    /* free re-index package */
-    free(reindex->pkg_points);
-    free(reindex->pkg_tags);
-    reindex->pkg_points = NULL;
-    reindex->pkg_tags = NULL;
-
-    int rc;
-    reindex->size -= sizeof(uint32_t);
+    siridb_reindex_t * reindex = siridb->reindex;
+    siridb_sbatch_t * batch;
+    size_t i;
+
+    batch = siridb_sbatch_new(
+            siridb,
+            reindex->fp,
+            reindex->pos,
+            BPROTO_INSERT_TESTED_SERVER,
+            REINDEX_skip_cb);
+    if (batch == NULL)
+    {
+        return NULL;  /* signal is raised */
+    }
 
-    if (!reindex->size)
+    /*
+     * Prepare drop, increasing the reference counter is not needed since the
+     * series can only be decremented when dropped. since the series is not
+     * member of the siridb->series_map it will not be decremented there
+     * either.
+     */
+    for (i = 0; i < batch->len; i++)
     {
-        rc = NEXT_SERIES_END;
+        siridb_series_drop_prepare(siridb, batch->series[i]);
     }
-    else
+
+    reindex->pos = batch->pos;
+    return batch;
+}
+
+/*
+ * Remove committed batches in the order they are sent and truncate the
+ * re-index file.
+ *
+ * Returns 0 if successful or -1 in case of an error and a SIGNAL is raised.
+ */
+static int REINDEX_truncate(siridb_reindex_t * reindex)
+{
+    long int size = siridb_sbatch_shift(
+            reindex->batches,
+            &reindex->nbatches,
+            reindex->size);
+
+    if (size != reindex->size)
     {
-        if (fseeko(reindex->fp, -SIZE2, SEEK_END) ||
-            fread(  reindex->next_series_id,
-                    sizeof(uint32_t),
-                    1,
-                    reindex->fp) != 1)
+        if (ftruncate(reindex->fd, size))
         {
             ERR_FILE
-            log_critical("Reading next series id has failed");
-            return NEXT_SERIES_ERR;
+            log_critical("Truncating the re-index file has failed");
+            return -1;
         }
-        rc = NEXT_SERIES_SET;
-    }
-
-    if (ftruncate(reindex->fd, reindex->size))
-    {
-        ERR_FILE
-        log_critical("Reading next series id has failed");
-        return NEXT_SERIES_ERR;
+        reindex->size = size;
     }
-    return rc;
+    return 0;
 }
 
 /*
@@ -425,149 +443,131 @@ static void REINDEX_on_empty_tags_response(
 /*
  * This function can raise a SIGNAL
  */
-static void REINDEX_next(siridb_t * siridb)
+static void REINDEX_finish(siridb_t * siridb)
 {
-    switch (REINDEX_next_series_id(siridb->reindex))
-    {
-    case NEXT_SERIES_SET:
-        uv_timer_start(
-                siridb->reindex->timer,
-                REINDEX_work,
-                REINDEX_SLEEP * siridb->tasks.active,
-                0);
-        break;
+    sirinet_pkg_t * pkg;
 
-    case NEXT_SERIES_END:
+    /* send empty tags if required */
+    pkg = siridb_tags_empty(siridb->tags);
+    if (pkg)
     {
-        sirinet_pkg_t * pkg;
-
-        /* send empty tags if required */
-        pkg = siridb_tags_empty(siridb->tags);
-        if (pkg)
+        if (siridb_server_send_pkg(
+                siridb->reindex->server,
+                pkg,
+                REINDEX_TIMEOUT,
+                (sirinet_promise_cb) REINDEX_on_empty_tags_response,
+                NULL,
+                0))
         {
-            if (siridb_server_send_pkg(
-                    siridb->reindex->server,
-                    pkg,
-                    REINDEX_TIMEOUT,
-                    (sirinet_promise_cb) REINDEX_on_empty_tags_response,
-                    NULL,
-                    0))
-            {
-                free(pkg);
-            }
+            free(pkg);
         }
+    }
 
-        /* update and send the flags */
-        siridb->server->flags &= ~SERVER_FLAG_REINDEXING;
-        siridb_servers_send_flags(siridb->servers);
+    /* update and send the flags */
+    siridb->server->flags &= ~SERVER_FLAG_REINDEXING;
+    siridb_servers_send_flags(siridb->servers);
 
-        log_info("Re-indexing has successfully finished on '%s'",
-                siridb->server->name);
+    log_info("Re-indexing has successfully finished on '%s'",
+            siridb->server->name);
 
-        /* we can close the timer */
-        siridb_reindex_close(siridb->reindex);
+    /* we can close the timer */
+    siridb_reindex_close(siridb->reindex);
 
-        /* check if everyone is finished and if so destroy re-index */
-        siridb_reindex_status_update(siridb);
+    /* check if everyone is finished and if so destroy re-index */
+    siridb_reindex_status_update(siridb);
 
-        siri_optimize_continue();
-        break;
+    siri_optimize_continue();
+}
+
+/*
+ * Truncate the re-index file for committed batches and schedule the next
+ * batch when the window allows another batch in flight. The delay still
+ * depends on the number of active tasks so re-indexing gives way to queries
+ * and inserts.
+ *
+ * This function can raise a SIGNAL
+ */
+static void REINDEX_next(siridb_t * siridb)
+{
+    siridb_reindex_t * reindex = siridb->reindex;
+
+    if (REINDEX_truncate(reindex) || reindex->timer == NULL)
+    {
+        return;  /* signal is raised or re-index is closed */
     }
-    case NEXT_SERIES_ERR:
-        break; /* signal is raised */
+
+    if (!reindex->size)
+    {
+        REINDEX_finish(siridb);
+    }
+    else if (reindex->pos && reindex->nbatches < reindex->window)
+    {
+        uv_timer_start(
+                reindex->timer,
+                REINDEX_work,
+                REINDEX_SLEEP * siridb->tasks.active,
+                0);
     }
 }
 
+/*
+ * Type: uv_timer_cb
+ *
+ * Sends batches which could not be sent before and a new batch when the
+ * window allows.
+ */
 static void REINDEX_work(uv_timer_t * timer)
 {
     siridb_t * siridb = (siridb_t *) timer->data;
     siridb_reindex_t * reindex = siridb->reindex;
+    siridb_sbatch_t * batch;
+    size_t i;
 
     assert (SIRI_OPTIMZE_IS_PAUSED);
     assert (reindex != NULL);
-    assert (siridb->reindex->pkg_points == NULL);
-    assert (siridb->reindex->pkg_tags == NULL);
 
-    reindex->series = imap_get(siridb->series_map, *reindex->next_series_id);
-
-    if (    reindex->series == NULL ||
-            siridb_lookup_sn(
-                    siridb->pools->lookup,
-                    reindex->series->name) == siridb->server->pool ||
-            (siridb->replica != NULL &&
-             siridb_series_server_id(reindex->series) != siridb->server->id))
+    for (i = 0; i < reindex->nbatches; i++)
     {
-        REINDEX_next(siridb);
+        batch = reindex->batches[i];
+        if (!batch->done && !batch->sent && REINDEX_send(batch))
+        {
+            return;  /* retry is scheduled or signal is raised */
+        }
     }
-    else
-    {
-        /*
-         * lock is not needed since we are sure the optimize task is
-         * not running
-         */
-        assert (siridb_lookup_sn(
-                    siridb->pools->prev_lookup,
-                    reindex->series->name) == siridb->server->pool);
-        siridb_points_t * points = siridb_series_get_points(
-                reindex->series,
-                NULL,
-                NULL);
 
-        if (points != NULL)  /* signal is raised in case NULL */
+    if (reindex->pos && reindex->nbatches < reindex->window)
+    {
+        batch = REINDEX_batch_new(siridb);
+        if (batch == NULL)
         {
-            /* tag package may be NULL when no tag need to be
-             * synchronized */
-            reindex->pkg_tags = siridb_tags_series(reindex->series);
-
-            /*
-             * Prepare drop, increasing the reference counter is not needed
-             * since the series can only be decremented when dropped. since
-             * the series is not member of the siridb->series_map it will not
-             * be decremented there either.
-             */
-
-            siridb_series_drop_prepare(siridb, reindex->series);
-
-            qp_packer_t * packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
-            if (packer != NULL)
-            {
-                qp_add_type(packer, QP_MAP1);
+            return;  /* signal is raised */
+        }
 
-                /* add series name including terminator char */
-                qp_add_raw(
-                        packer,
-                        (const unsigned char *) reindex->series->name,
-                        reindex->series->name_len + 1);
+        reindex->batches[reindex->nbatches++] = batch;
 
-                if (siridb_points_pack(points, packer) == 0)
-                {
-                    reindex->pkg_points = sirinet_packer2pkg(
-                            packer,
-                            0,
-                            BPROTO_INSERT_TESTED_SERVER);
-
-                    uv_timer_start(
-                            reindex->timer,
-                            REINDEX_send,
-                            0,
-                            0);
-                }
-                else
-                {
-                    qp_packer_free(packer);  /* signal raised */
-                }
-            }
-            siridb_points_free(points);
+        if (batch->pkg_points == NULL)
+        {
+            batch->done = 1;  /* all series in the batch are skipped */
+        }
+        else if (REINDEX_send(batch))
+        {
+            return;  /* retry is scheduled or signal is raised */
         }
     }
+
+    REINDEX_next(siridb);
 }
 
 /*
- * Sends 'dropped series' to the replica and commit the drop.
+ * Sends 'dropped series' to the replica, sends the tags of the series and
+ * commit the drop.
  *
  * This function can raise an ALLOC error but file errors are only logged.
  */
-static void REINDEX_commit_series(siridb_t * siridb)
+static void REINDEX_commit_series(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        sirinet_pkg_t ** pkg_tags)
 {
     /*
      * Send the dropped series to the replica. The replica server might have
@@ -578,14 +578,14 @@ static void REINDEX_commit_series(siridb_t * siridb)
      */
     if (siridb->replica != NULL)
     {
-        size_t len = siridb->reindex->series->name_len + 1;
+        size_t len = series->name_len + 1;
         qp_packer_t * packer = sirinet_packer_new(PCKSZ + len);
         if (packer != NULL)
         {
             /* no need for testing, fits for sure */
             qp_add_raw(
                     packer,
-                    (const unsigned char *) siridb->reindex->series->name,
+                    (const unsigned char *) series->name,
                     len);
             sirinet_pkg_t * pkg = sirinet_packer2pkg(
                     packer,
@@ -596,22 +596,42 @@ static void REINDEX_commit_series(siridb_t * siridb)
         }
     }
 
-    if (siridb->reindex->pkg_tags)
+    if (*pkg_tags != NULL)
     {
-        siridb_server_send_pkg(
+        if (siridb_server_send_pkg(
                 siridb->reindex->server,
-                siridb->reindex->pkg_tags,
+                *pkg_tags,
                 REINDEX_TIMEOUT,
                 (sirinet_promise_cb) REINDEX_on_tag_response,
                 NULL,
-                FLAG_KEEP_PKG);
+                0))
+        {
+            free(*pkg_tags);
+        }
+        *pkg_tags = NULL;
     }
 
     /* commit the drop */
-    if (siridb_series_drop_commit(siridb, siridb->reindex->series) == 0)
+    (void) siridb_series_drop_commit(siridb, series);
+}
+
+/*
+ * Commit all series in a batch. The re-index file is truncated by
+ * REINDEX_next() once all batches which are sent before are committed too.
+ */
+static void REINDEX_commit_batch(siridb_sbatch_t * batch)
+{
+    size_t i;
+
+    for (i = 0; i < batch->len; i++)
     {
-        siridb_series_flush_dropped(siridb);
+        REINDEX_commit_series(
+                batch->siridb,
+                batch->series[i],
+                batch->pkg_tags + i);
     }
+    (void) siridb_series_flush_dropped(batch->siridb);
+    batch->done = 1;
 }
 
 /*
@@ -622,7 +642,8 @@ static void REINDEX_on_insert_response(
         sirinet_pkg_t * pkg,
         int status)
 {
-    siridb_t * siridb = (siridb_t *) promise->data;
+    siridb_sbatch_t * batch = (siridb_sbatch_t *) promise->data;
+    siridb_t * siridb = batch->siridb;
 
     switch ((sirinet_promise_status_t) status)
     {
@@ -630,11 +651,16 @@ static void REINDEX_on_insert_response(
         /*
          * Write to socket error, data is not send so we should not commit.
          */
-        uv_timer_start(
-                siridb->reindex->timer,
-                REINDEX_send,
-                REINDEX_RETRY,
-                0);
+        batch->sent = 0;
+        siridb->reindex->window = 1;
+        if (siridb->reindex->timer != NULL)
+        {
+            uv_timer_start(
+                    siridb->reindex->timer,
+                    REINDEX_work,
+                    REINDEX_RETRY,
+                    0);
+        }
         break;
     case PROMISE_TIMEOUT_ERROR:
         /*
@@ -653,7 +679,8 @@ static void REINDEX_on_insert_response(
          */
         log_error("Error occurred while sending series to the new server (%d)",
                 status);
-        REINDEX_commit_series(siridb);
+        siridb->reindex->window = 1;
+        REINDEX_commit_batch(batch);
         REINDEX_next(siridb);
         break;
     case PROMISE_SUCCESS:
@@ -663,7 +690,8 @@ static void REINDEX_on_insert_response(
                     "Error occurred while processing data on the new server: "
                     "(response type: %u)", pkg->tp);
         }
-        REINDEX_commit_series(siridb);
+        siridb_sbatch_adapt(&siridb->reindex->window, siridb, promise->rtt);
+        REINDEX_commit_batch(batch);
         REINDEX_next(siridb);
         break;
     default:
@@ -696,6 +724,34 @@ static void REINDEX_on_tag_response(
     sirinet_promise_decref(promise);
 }
 
+/*
+ * Typedef: siridb_sbatch_skip_cb
+ *
+ * Series which already belong to this pool are skipped, and when this
+ * server has a replica only the series owned by this server are sent.
+ */
+static int REINDEX_skip_cb(siridb_t * siridb, siridb_series_t * series)
+{
+    if (    siridb_lookup_sn(
+                    siridb->pools->lookup,
+                    series->name) == siridb->server->pool ||
+            (siridb->replica != NULL &&
+             siridb_series_server_id(series) != siridb->server->id))
+    {
+        return 1;
+    }
+
+    /*
+     * lock is not needed since we are sure the optimize task is
+     * not running
+     */
+    assert (siridb_lookup_sn(
+                siridb->pools->prev_lookup,
+                series->name) == siridb->server->pool);
+
+    return 0;
+}
+
 /*
  * Typedef: imap_cb
  *
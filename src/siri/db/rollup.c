@@ -0,0 +1,838 @@
+/*
+ * rollup.c - Downsampled rollup tiers for numeric series.
+ *
+ * A rollup file contains one record for each series which is summarized:
+ *
+ *      series_id (uint32), npoints (uint32), ntiers (uint32)
+ *      ntiers x [interval (uint64), len (uint64)]
+ *      ntiers x [len x bucket]
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <limits.h>
+#include <logger/logger.h>
+#include <siri/db/rollup.h>
+#include <siri/err.h>
+#include <siri/grammar/grammar.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xpath/xpath.h>
+
+#define ROLLUP_INIT_SZ 64
+
+#define ROLLUP_BUCKET_TS(ts__, interval__) \
+    (((ts__) + (interval__) - 1) / (interval__) * (interval__))
+
+static int ROLLUP_cmp(const void * a, const void * b);
+static int ROLLUP_add(
+        siridb_rollup_select_t * select,
+        siridb_rollup_bucket_t * bucket);
+static int ROLLUP_merge(
+        siridb_rollup_bucket_t * bucket,
+        siridb_rollup_bucket_t * other,
+        points_tp tp);
+static siridb_rollup_bucket_t * ROLLUP_buckets(
+        siridb_points_t * points,
+        uint64_t interval,
+        size_t * n);
+static int ROLLUP_point(
+        siridb_rollup_select_t * select,
+        siridb_point_t * point,
+        siridb_rollup_bucket_t * bucket);
+
+/*
+ * Returns the tiers from a comma separated list of intervals like "5m,1h",
+ * or NULL when the list is invalid or in case of a memory allocation error.
+ * Intervals are in seconds unless a suffix (s, m, h or d) is used and the
+ * factor converts seconds to the time precision of the database.
+ */
+siridb_rollup_t * siridb_rollup_new(const char * tiers, uint64_t factor)
+{
+    siridb_rollup_t * rollup;
+    uint64_t interval, mult;
+    const char * pt = tiers;
+    char * end;
+    size_t i;
+
+    rollup = malloc(sizeof(siridb_rollup_t));
+    if (rollup == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+    rollup->n = 0;
+
+    while (*pt)
+    {
+        for (; isspace((unsigned char) *pt) || *pt == ','; pt++);
+        if (!*pt)
+        {
+            break;
+        }
+
+        if (!isdigit((unsigned char) *pt))
+        {
+            goto invalid;
+        }
+
+        interval = strtoull(pt, &end, 10);
+        pt = end;
+
+        switch (*pt)
+        {
+        case 's': mult = 1; pt++; break;
+        case 'm': mult = 60; pt++; break;
+        case 'h': mult = 3600; pt++; break;
+        case 'd': mult = 86400; pt++; break;
+        default: mult = 1;
+        }
+
+        if (    interval == 0 ||
+                interval > UINT64_MAX / mult / factor ||
+                rollup->n == SIRIDB_ROLLUP_MAX_TIERS ||
+                (*pt && *pt != ',' && !isspace((unsigned char) *pt)))
+        {
+            goto invalid;
+        }
+
+        interval *= mult * factor;
+
+        /* keep the tiers in ascending order */
+        for (i = rollup->n; i && rollup->intervals[i - 1] > interval; i--)
+        {
+            rollup->intervals[i] = rollup->intervals[i - 1];
+        }
+
+        if (i && rollup->intervals[i - 1] == interval)
+        {
+            goto invalid;
+        }
+
+        rollup->intervals[i] = interval;
+        rollup->n++;
+    }
+
+    if (rollup->n)
+    {
+        return rollup;
+    }
+
+invalid:
+    free(rollup);
+    return NULL;
+}
+
+/*
+ * Summarize the points of a series in buckets for each tier and append a
+ * record to the rollup file of shard file name fn. The entry for the record
+ * is added to rollups, which is created if needed. This function is called
+ * from the optimize thread while the series_mutex is locked.
+ *
+ * Returns 0 if successful or -1 when the record is not written, which is
+ * not critical since the points can still be read. (an error is logged)
+ */
+int siridb_rollup_build(
+        siridb_rollup_t * rollup,
+        imap_t ** rollups,
+        const char * fn,
+        uint32_t series_id,
+        siridb_points_t * points)
+{
+    siridb_rollup_bucket_t * buckets[SIRIDB_ROLLUP_MAX_TIERS] = {NULL};
+    uint64_t lens[SIRIDB_ROLLUP_MAX_TIERS];
+    siridb_rollup_entry_t * entry = NULL;
+    uint32_t npoints = points->len;
+    uint32_t ntiers = rollup->n;
+    size_t i, n;
+    off_t pos;
+    FILE * fp;
+    int rc = -1;
+
+    siridb_rollup_file(rdb, fn);
+
+    assert (points->tp != TP_STRING);
+
+    for (i = 0; i < ntiers; i++)
+    {
+        buckets[i] = ROLLUP_buckets(points, rollup->intervals[i], &n);
+        if (buckets[i] == NULL)
+        {
+            /* overflow of an integer sum or an allocation error */
+            goto done;
+        }
+        lens[i] = n;
+    }
+
+    if (    (*rollups == NULL && (*rollups = imap_new()) == NULL) ||
+            (entry = malloc(sizeof(siridb_rollup_entry_t))) == NULL)
+    {
+        log_error("Cannot create rollup entry for shard: '%s'", fn);
+        goto done;
+    }
+
+    if ((fp = fopen(rdb, "a")) == NULL)
+    {
+        log_error("Cannot open rollup file for writing: '%s'", rdb);
+        goto done;
+    }
+
+    if (    fseeko(fp, 0, SEEK_END) ||
+            (pos = ftello(fp)) < 0 ||
+            fwrite(&series_id, sizeof(uint32_t), 1, fp) != 1 ||
+            fwrite(&npoints, sizeof(uint32_t), 1, fp) != 1 ||
+            fwrite(&ntiers, sizeof(uint32_t), 1, fp) != 1)
+    {
+        log_error("Cannot write to rollup file: '%s'", rdb);
+        fclose(fp);
+        goto done;
+    }
+
+    for (i = 0; i < ntiers; i++)
+    {
+        if (    fwrite(&rollup->intervals[i], sizeof(uint64_t), 1, fp) != 1 ||
+                fwrite(&lens[i], sizeof(uint64_t), 1, fp) != 1)
+        {
+            log_error("Cannot write to rollup file: '%s'", rdb);
+            fclose(fp);
+            goto done;
+        }
+    }
+
+    for (i = 0; i < ntiers; i++)
+    {
+        if (fwrite(
+                buckets[i],
+                sizeof(siridb_rollup_bucket_t),
+                lens[i],
+                fp) != lens[i])
+        {
+            log_error("Cannot write to rollup file: '%s'", rdb);
+            fclose(fp);
+            goto done;
+        }
+    }
+
+    if (fclose(fp))
+    {
+        log_error("Cannot close rollup file: '%s'", rdb);
+        goto done;
+    }
+
+    entry->npoints = npoints;
+    entry->pad0 = 0;
+    entry->pos = pos;
+
+    free(imap_pop(*rollups, series_id));
+
+    if (imap_add(*rollups, series_id, entry) == 0)
+    {
+        entry = NULL;
+        rc = 0;
+    }
+
+done:
+    for (i = 0; i < ntiers; i++)
+    {
+        free(buckets[i]);
+    }
+    free(entry);
+    return rc;
+}
+
+/*
+ * Read the positions of the records in the rollup file of shard file name fn
+ * and add the entries to rollups. A file which ends with an incomplete record
+ * is accepted, only the complete records are used.
+ *
+ * Returns 0 if successful or -1 in case of an error. (an error is logged)
+ */
+int siridb_rollup_load(imap_t ** rollups, const char * fn)
+{
+    siridb_rollup_entry_t * entry;
+    uint32_t series_id, npoints, ntiers, i;
+    uint64_t interval, len, size;
+    off_t pos, file_sz;
+    FILE * fp;
+    int rc = 0;
+
+    siridb_rollup_file(rdb, fn);
+
+    if (!xpath_file_exist(rdb))
+    {
+        return 0;
+    }
+
+    if ((fp = fopen(rdb, "r")) == NULL)
+    {
+        log_error("Cannot open rollup file for reading: '%s'", rdb);
+        return -1;
+    }
+
+    if (    fseeko(fp, 0, SEEK_END) ||
+            (file_sz = ftello(fp)) < 0 ||
+            fseeko(fp, 0, SEEK_SET))
+    {
+        log_error("Cannot read rollup file: '%s'", rdb);
+        fclose(fp);
+        return -1;
+    }
+
+    while ((pos = ftello(fp)) >= 0 && pos < file_sz)
+    {
+        if (    fread(&series_id, sizeof(uint32_t), 1, fp) != 1 ||
+                fread(&npoints, sizeof(uint32_t), 1, fp) != 1 ||
+                fread(&ntiers, sizeof(uint32_t), 1, fp) != 1 ||
+                ntiers > SIRIDB_ROLLUP_MAX_TIERS)
+        {
+            break;
+        }
+
+        for (size = 0, i = 0; i < ntiers; i++)
+        {
+            if (    fread(&interval, sizeof(uint64_t), 1, fp) != 1 ||
+                    fread(&len, sizeof(uint64_t), 1, fp) != 1)
+            {
+                break;
+            }
+            size += len * sizeof(siridb_rollup_bucket_t);
+        }
+
+        if (    i < ntiers ||
+                size > (uint64_t) (file_sz - ftello(fp)) ||
+                fseeko(fp, (off_t) size, SEEK_CUR))
+        {
+            break;
+        }
+
+        if (    (*rollups == NULL && (*rollups = imap_new()) == NULL) ||
+                (entry = malloc(sizeof(siridb_rollup_entry_t))) == NULL)
+        {
+            log_error("Cannot load rollup file: '%s'", rdb);
+            rc = -1;
+            break;
+        }
+
+        entry->npoints = npoints;
+        entry->pad0 = 0;
+        entry->pos = pos;
+
+        free(imap_pop(*rollups, series_id));
+
+        if (imap_add(*rollups, series_id, entry))
+        {
+            free(entry);
+        }
+    }
+
+    if (rc == 0 && pos < file_sz)
+    {
+        log_warning("Incomplete record found in rollup file: '%s'", rdb);
+    }
+
+    fclose(fp);
+    return rc;
+}
+
+/*
+ * Rename the rollup file of shard file name from_fn to the rollup file of
+ * shard file name to_fn. An existing rollup file for to_fn is removed, also
+ * when there is no rollup file to rename.
+ *
+ * Returns 0 if successful or -1 in case of an error. (an error is logged)
+ */
+int siridb_rollup_rename(const char * from_fn, const char * to_fn)
+{
+    siridb_rollup_file(from, from_fn);
+    siridb_rollup_file(to, to_fn);
+
+    siridb_rollup_remove(to_fn);
+
+    if (xpath_file_exist(from) && rename(from, to))
+    {
+        log_error("Cannot rename rollup file '%s'", from);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Remove the rollup file for a shard file name, if the file exists.
+ */
+void siridb_rollup_remove(const char * fn)
+{
+    siridb_rollup_file(rdb, fn);
+
+    if (xpath_file_exist(rdb) && unlink(rdb))
+    {
+        log_warning("Removing rollup file failed: %s", rdb);
+    }
+}
+
+/*
+ * Initialize a select which reads buckets from rollup files.
+ *
+ * Returns 0 if successful, -1 in case of a memory allocation error (err_msg
+ * is set) or 1 when no tier can be used for the aggregate and window.
+ */
+int siridb_rollup_select_init(
+        siridb_rollup_select_t * select,
+        siridb_rollup_t * rollup,
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        uint64_t start_ts,
+        uint64_t end_ts,
+        char * err_msg)
+{
+    uint64_t interval = 0;
+    size_t i;
+
+    if (    rollup == NULL ||
+            tp == TP_STRING ||
+            aggr->group_by == 0 ||
+            aggr->offset ||
+            aggr->limit ||
+            end_ts <= start_ts)
+    {
+        return 1;
+    }
+
+    switch (aggr->gid)
+    {
+    case CLERI_GID_F_COUNT:
+    case CLERI_GID_F_SUM:
+    case CLERI_GID_F_MIN:
+    case CLERI_GID_F_MAX:
+    case CLERI_GID_F_MEAN:
+        break;
+    default:
+        return 1;
+    }
+
+    /* use the coarsest tier which divides the group-by */
+    for (i = rollup->n; i--;)
+    {
+        if (aggr->group_by % rollup->intervals[i] == 0)
+        {
+            interval = rollup->intervals[i];
+            break;
+        }
+    }
+
+    if (interval == 0 || start_ts > UINT64_MAX - interval)
+    {
+        return 1;
+    }
+
+    select->a = ROLLUP_BUCKET_TS(start_ts, interval);
+    select->b = (end_ts - 1) / interval * interval;
+
+    if (select->b <= select->a)
+    {
+        return 1;
+    }
+
+    select->aggr = aggr;
+    select->tp = tp;
+    select->interval = interval;
+    select->len = 0;
+    select->size = ROLLUP_INIT_SZ;
+    select->n = 0;
+    select->err_msg = err_msg;
+    select->buckets = malloc(select->size * sizeof(siridb_rollup_bucket_t));
+
+    if (select->buckets == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Feed points to a select. Points are added to the bucket of the tier which
+ * is used and may be fed in any order.
+ *
+ * Returns 0 if successful, -1 in case of a memory allocation error (err_msg
+ * is set) or 1 when a bucket sum overflows, in which case the rollups
+ * cannot be used.
+ */
+int siridb_rollup_select_feed(
+        siridb_rollup_select_t * select,
+        siridb_points_t * points)
+{
+    siridb_rollup_bucket_t * last;
+    siridb_rollup_bucket_t bucket;
+    size_t i;
+    int rc;
+
+    select->n += points->len;
+
+    for (i = 0; i < points->len; i++)
+    {
+        last = select->len ? select->buckets + select->len - 1 : NULL;
+        rc = ROLLUP_point(select, points->data + i, &bucket);
+
+        if (rc == 0 && last != NULL && last->ts == bucket.ts)
+        {
+            rc = ROLLUP_merge(last, &bucket, select->tp);
+        }
+        else if (rc == 0)
+        {
+            rc = ROLLUP_add(select, &bucket);
+        }
+
+        if (rc)
+        {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Add the buckets of a series which are inside the window of the select,
+ * using a record in the rollup file of shard file name fn. The rollup file
+ * must be opened for reading by the caller so it can be used for all series
+ * in a shard. (the file name is only used for logging)
+ *
+ * Returns 0 if successful, 1 when the record does not contain the tier or -1
+ * in case of an error. (an error is logged) When not successful the select
+ * is still valid but the buckets are not added.
+ */
+int siridb_rollup_select_read(
+        siridb_rollup_select_t * select,
+        FILE * fp,
+        const char * fn,
+        siridb_rollup_entry_t * entry)
+{
+    siridb_rollup_bucket_t * buckets = NULL;
+    uint64_t interval, len, skip = 0, n = 0;
+    uint32_t series_id, npoints, ntiers, i;
+    int found = 0;
+    size_t offset = select->len;
+    int rc = -1;
+
+    if (    fseeko(fp, entry->pos, SEEK_SET) ||
+            fread(&series_id, sizeof(uint32_t), 1, fp) != 1 ||
+            fread(&npoints, sizeof(uint32_t), 1, fp) != 1 ||
+            fread(&ntiers, sizeof(uint32_t), 1, fp) != 1 ||
+            npoints != entry->npoints)
+    {
+        goto done;
+    }
+
+    for (i = 0; i < ntiers; i++)
+    {
+        if (    fread(&interval, sizeof(uint64_t), 1, fp) != 1 ||
+                fread(&len, sizeof(uint64_t), 1, fp) != 1)
+        {
+            goto done;
+        }
+        if (!found && interval == select->interval)
+        {
+            found = 1;
+            n = len;
+        }
+        else if (!found)
+        {
+            skip += len;
+        }
+    }
+
+    if (!found)
+    {
+        /* the record was written before this tier was configured */
+        return 1;
+    }
+
+    buckets = malloc((n ? n : 1) * sizeof(siridb_rollup_bucket_t));
+
+    if (    buckets == NULL ||
+            fseeko(
+                fp,
+                (off_t) (skip * sizeof(siridb_rollup_bucket_t)),
+                SEEK_CUR) ||
+            fread(buckets, sizeof(siridb_rollup_bucket_t), n, fp) != n)
+    {
+        goto done;
+    }
+
+    for (len = 0; len < n; len++)
+    {
+        if (buckets[len].ts > select->a && buckets[len].ts <= select->b)
+        {
+            if (ROLLUP_add(select, buckets + len))
+            {
+                select->len = offset;
+                goto done;
+            }
+        }
+    }
+
+    select->n += n;
+    rc = 0;
+
+done:
+    if (rc)
+    {
+        siridb_rollup_file(rdb, fn);
+        log_error("Cannot read rollup record from file: '%s'", rdb);
+    }
+    free(buckets);
+    return rc;
+}
+
+/*
+ * Returns the points with the aggregate applied to the buckets, or NULL in
+ * case of an error. (err_msg is set) The select is destroyed.
+ */
+siridb_points_t * siridb_rollup_select_finish(
+        siridb_rollup_select_t * select)
+{
+    siridb_aggr_t * aggr = select->aggr;
+    siridb_rollup_bucket_t * bucket, * end;
+    siridb_rollup_bucket_t group;
+    siridb_points_t * points;
+    siridb_point_t * point;
+    points_tp tp;
+    uint64_t group_ts, ts;
+    double sum;
+    int overflow;
+
+    tp = aggr->gid == CLERI_GID_F_COUNT ? TP_INT :
+         aggr->gid == CLERI_GID_F_MEAN ? TP_DOUBLE : select->tp;
+
+    points = siridb_points_new(select->len ? select->len : 1, tp);
+    if (points == NULL)
+    {
+        sprintf(select->err_msg, "Memory allocation error.");
+        siridb_rollup_select_destroy(select);
+        return NULL;
+    }
+
+    qsort(
+        select->buckets,
+        select->len,
+        sizeof(siridb_rollup_bucket_t),
+        ROLLUP_cmp);
+
+    bucket = select->buckets;
+    end = bucket + select->len;
+
+    while (bucket < end)
+    {
+        group = *bucket;
+        group_ts = (group.ts + aggr->group_by - 1) /
+                aggr->group_by * aggr->group_by;
+        overflow = 0;
+        sum = select->tp == TP_INT
+                ? (double) bucket->sum.int64
+                : bucket->sum.real;
+
+        for (bucket++; bucket < end; bucket++)
+        {
+            ts = (bucket->ts + aggr->group_by - 1) /
+                    aggr->group_by * aggr->group_by;
+            if (ts != group_ts)
+            {
+                break;
+            }
+            overflow |= ROLLUP_merge(&group, bucket, select->tp);
+            sum += select->tp == TP_INT
+                    ? (double) bucket->sum.int64
+                    : bucket->sum.real;
+        }
+
+        point = points->data + points->len;
+        point->ts = group_ts + aggr->offset;
+
+        switch (aggr->gid)
+        {
+        case CLERI_GID_F_COUNT:
+            point->val.int64 = (int64_t) group.count;
+            break;
+        case CLERI_GID_F_SUM:
+            if (overflow)
+            {
+                sprintf(select->err_msg,
+                        "Overflow detected while using sum().");
+                siridb_points_free(points);
+                siridb_rollup_select_destroy(select);
+                return NULL;
+            }
+            point->val = group.sum;
+            break;
+        case CLERI_GID_F_MIN:
+            point->val = group.min;
+            break;
+        case CLERI_GID_F_MAX:
+            point->val = group.max;
+            break;
+        case CLERI_GID_F_MEAN:
+            point->val.real = sum / group.count;
+            break;
+        default:
+            assert (0);
+        }
+
+        points->len++;
+    }
+
+    siridb_rollup_select_destroy(select);
+    return points;
+}
+
+/*
+ * Destroy a select without creating points.
+ */
+void siridb_rollup_select_destroy(siridb_rollup_select_t * select)
+{
+    free(select->buckets);
+    select->buckets = NULL;
+}
+
+static int ROLLUP_cmp(const void * a, const void * b)
+{
+    uint64_t ta = ((const siridb_rollup_bucket_t *) a)->ts;
+    uint64_t tb = ((const siridb_rollup_bucket_t *) b)->ts;
+    return (ta > tb) - (ta < tb);
+}
+
+/*
+ * Returns 0 if successful or -1 in case of a memory allocation error.
+ * (err_msg is set)
+ */
+static int ROLLUP_add(
+        siridb_rollup_select_t * select,
+        siridb_rollup_bucket_t * bucket)
+{
+    if (select->len == select->size)
+    {
+        size_t size = select->size * 2;
+        siridb_rollup_bucket_t * tmp = realloc(
+                select->buckets,
+                size * sizeof(siridb_rollup_bucket_t));
+        if (tmp == NULL)
+        {
+            sprintf(select->err_msg, "Memory allocation error.");
+            return -1;
+        }
+        select->buckets = tmp;
+        select->size = size;
+    }
+    select->buckets[select->len++] = *bucket;
+    return 0;
+}
+
+/*
+ * Merge other into bucket. Returns 0 if successful or 1 when the sum of an
+ * integer bucket overflows, in which case the sum of bucket is not valid.
+ */
+static int ROLLUP_merge(
+        siridb_rollup_bucket_t * bucket,
+        siridb_rollup_bucket_t * other,
+        points_tp tp)
+{
+    bucket->count += other->count;
+
+    if (tp == TP_INT)
+    {
+        if (other->min.int64 < bucket->min.int64)
+        {
+            bucket->min = other->min;
+        }
+        if (other->max.int64 > bucket->max.int64)
+        {
+            bucket->max = other->max;
+        }
+        return __builtin_add_overflow(
+                bucket->sum.int64,
+                other->sum.int64,
+                &bucket->sum.int64);
+    }
+
+    if (other->min.real < bucket->min.real)
+    {
+        bucket->min = other->min;
+    }
+    if (other->max.real > bucket->max.real)
+    {
+        bucket->max = other->max;
+    }
+    bucket->sum.real += other->sum.real;
+    return 0;
+}
+
+/*
+ * Returns the buckets for points which are ordered by time, or NULL in case
+ * of a memory allocation error or when a bucket or sum overflows.
+ */
+static siridb_rollup_bucket_t * ROLLUP_buckets(
+        siridb_points_t * points,
+        uint64_t interval,
+        size_t * n)
+{
+    siridb_rollup_bucket_t * buckets, * bucket = NULL;
+    siridb_rollup_bucket_t tmp;
+    siridb_point_t * point;
+    size_t i;
+
+    buckets = malloc(points->len * sizeof(siridb_rollup_bucket_t));
+    if (buckets == NULL)
+    {
+        log_error("Memory allocation error while creating rollups");
+        return NULL;
+    }
+
+    for (i = 0, *n = 0; i < points->len; i++)
+    {
+        point = points->data + i;
+        if (point->ts > UINT64_MAX - interval)
+        {
+            free(buckets);
+            return NULL;
+        }
+        tmp.ts = ROLLUP_BUCKET_TS(point->ts, interval);
+        tmp.count = 1;
+        tmp.sum = tmp.min = tmp.max = point->val;
+
+        if (bucket != NULL && bucket->ts == tmp.ts)
+        {
+            if (ROLLUP_merge(bucket, &tmp, points->tp))
+            {
+                free(buckets);
+                return NULL;
+            }
+        }
+        else
+        {
+            bucket = buckets + (*n)++;
+            *bucket = tmp;
+        }
+    }
+
+    return buckets;
+}
+
+/*
+ * Create a bucket for a single point.
+ *
+ * Returns 0 if successful or 1 when the point is outside the range of the
+ * tier which is used.
+ */
+static int ROLLUP_point(
+        siridb_rollup_select_t * select,
+        siridb_point_t * point,
+        siridb_rollup_bucket_t * bucket)
+{
+    if (point->ts > UINT64_MAX - select->interval)
+    {
+        return 1;
+    }
+    bucket->ts = ROLLUP_BUCKET_TS(point->ts, select->interval);
+    bucket->count = 1;
+    bucket->sum = bucket->min = bucket->max = point->val;
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * sbatch.c - Batches of series which are sent to another server.
+ */
+#include <logger/logger.h>
+#include <qpack/qpack.h>
+#include <siri/db/sbatch.h>
+#include <siri/db/tags.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Returns a new batch with series from the end of the file, before 'pos'.
+ * A batch contains at most SIRIDB_SBATCH_MAX_SERIES series and is closed
+ * when the package exceeds SIRIDB_SBATCH_MAX_PKG_SIZE. Series which do not
+ * exist or for which 'skip_cb' returns 1 are not added, and when no series
+ * are added the batch is returned without a package. The package uses
+ * protocol type 'tp'.
+ *
+ * The start of the batch in the file is set to batch->pos.
+ *
+ * In case of an error NULL is returned and a SIGNAL is raised.
+ */
+siridb_sbatch_t * siridb_sbatch_new(
+        siridb_t * siridb,
+        FILE * fp,
+        long int pos,
+        uint8_t tp,
+        siridb_sbatch_skip_cb skip_cb)
+{
+    siridb_sbatch_t * batch;
+    siridb_series_t * series;
+    siridb_points_t * points;
+    qp_packer_t * packer = NULL;
+    uint32_t ids[SIRIDB_SBATCH_MAX_SERIES];
+    size_t n = pos / sizeof(uint32_t);
+
+    if (n > SIRIDB_SBATCH_MAX_SERIES)
+    {
+        n = SIRIDB_SBATCH_MAX_SERIES;
+    }
+
+    batch = malloc(sizeof(siridb_sbatch_t));
+    if (batch == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    batch->siridb = siridb;
+    batch->pos = pos;
+    batch->len = 0;
+    batch->npoints = 0;
+    batch->sent = 0;
+    batch->done = 0;
+    batch->pkg_points = NULL;
+    batch->series = malloc(n * sizeof(siridb_series_t *));
+    batch->pkg_tags = calloc(n, sizeof(sirinet_pkg_t *));
+
+    if (batch->series == NULL || batch->pkg_tags == NULL)
+    {
+        ERR_ALLOC
+        siridb_sbatch_free(batch);
+        return NULL;
+    }
+
+    if (fseeko(fp, pos - n * sizeof(uint32_t), SEEK_SET) ||
+        fread(ids, sizeof(uint32_t), n, fp) != n)
+    {
+        ERR_FILE
+        log_critical("Reading next series id has failed");
+        siridb_sbatch_free(batch);
+        return NULL;
+    }
+
+    /* series are taken from the end of the file */
+    while (n && (packer == NULL || packer->len < SIRIDB_SBATCH_MAX_PKG_SIZE))
+    {
+        batch->pos -= sizeof(uint32_t);
+        series = imap_get(siridb->series_map, ids[--n]);
+
+        if (series == NULL || (skip_cb != NULL && skip_cb(siridb, series)))
+        {
+            continue;
+        }
+
+        if (packer == NULL)
+        {
+            packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+            if (packer == NULL)
+            {
+                siridb_sbatch_free(batch);
+                return NULL;  /* signal is raised */
+            }
+            qp_add_type(packer, QP_MAP_OPEN);
+        }
+
+        uv_mutex_lock(&siridb->series_mutex);
+
+        points = siridb_series_get_points(series, NULL, NULL);
+
+        uv_mutex_unlock(&siridb->series_mutex);
+
+        /* add series name including terminator char */
+        if (    points == NULL ||
+                qp_add_raw(
+                        packer,
+                        (const unsigned char *) series->name,
+                        series->name_len + 1) ||
+                siridb_points_pack(points, packer))
+        {
+            if (points != NULL)
+            {
+                siridb_points_free(points);
+            }
+            qp_packer_free(packer);
+            siridb_sbatch_free(batch);
+            return NULL;  /* signal is raised */
+        }
+
+        batch->npoints += points->len;
+        siridb_points_free(points);
+
+        /* tag package may be NULL when no tag need to be synchronized */
+        batch->pkg_tags[batch->len] = siridb_tags_series(series);
+        batch->series[batch->len++] = series;
+    }
+
+    if (packer != NULL)
+    {
+        batch->pkg_points = sirinet_packer2pkg(packer, 0, tp);
+    }
+
+    return batch;
+}
+
+/*
+ * Destroy a batch, including the tag packages which are not sent.
+ */
+void siridb_sbatch_free(siridb_sbatch_t * batch)
+{
+    size_t i;
+
+    if (batch->pkg_tags != NULL)
+    {
+        for (i = 0; i < batch->len; i++)
+        {
+            free(batch->pkg_tags[i]);
+        }
+    }
+    free(batch->pkg_tags);
+    free(batch->series);
+    free(batch->pkg_points);
+    free(batch);
+}
+
+/*
+ * Remove and destroy the batches which are done, in the order they are
+ * sent. A batch which is not done stops the shift.
+ *
+ * Returns the size to which the file can be truncated, which is 'size' when
+ * no batch is removed.
+ */
+long int siridb_sbatch_shift(
+        siridb_sbatch_t ** batches,
+        size_t * nbatches,
+        long int size)
+{
+    while (*nbatches && batches[0]->done)
+    {
+        size = batches[0]->pos;
+        siridb_sbatch_free(batches[0]);
+        memmove(batches,
+                batches + 1,
+                --(*nbatches) * sizeof(siridb_sbatch_t *));
+    }
+    return size;
+}
+
+/*
+ * Grow the window by one while this server has no active tasks and the
+ * other server responds fast. Otherwise the window is halved.
+ */
+void siridb_sbatch_adapt(size_t * window, siridb_t * siridb, uint64_t rtt)
+{
+    if (siridb->tasks.active || rtt > SIRIDB_SBATCH_SLOW_RTT)
+    {
+        *window = (*window > 1) ? *window / 2 : 1;
+    }
+    else if (*window < SIRIDB_SBATCH_MAX_WINDOW)
+    {
+        (*window)++;
+    }
+}
@@ -21,10 +21,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <logger/logger.h>
 #include <siri/db/buffer.h>
 #include <siri/db/db.h>
 #include <siri/db/misc.h>
+#include <siri/db/ngram.h>
 #include <siri/db/series.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
@@ -36,9 +40,50 @@
 #define SIRIDB_CORRUPT_FN "corrupt_series.dat"
 #define SIRIDB_DROPPED_FN ".dropped"
 #define SIRIDB_MAX_SERIES_ID_FN ".max_series_id"
+#define SIRIDB_SERIES_SNAP_FN "series.snap"
 #define SIRIDB_SERIES_SCHEMA 1
+#define SIRIDB_SERIES_SNAP_SCHEMA 2
 #define DROPPED_DUMMY 1
 
+#define SERIES_SNAP_MAGIC "SIRISNAP"
+#define SERIES_SNAP_FP_SZ 64    /* bytes of the series file to compare */
+
+#define SERIES_STREAM_SLICE 8192    /* points read while the mutex is locked */
+#define SERIES_SLICE_DONE 0
+#define SERIES_SLICE_READ 1
+#define SERIES_SLICE_UNORDERED 2
+
+/*
+ * Binary snapshot of the series file. The header is followed by n fixed width
+ * entries and an arena with the null terminated series names. Entries are
+ * sorted by name so the c-tree can be built at once. A snapshot covers the
+ * first dat_sz bytes of the series file; series which are appended to the
+ * series file later are read from the series file.
+ */
+typedef struct
+{
+    char magic[8];
+    uint32_t schema;
+    uint32_t n;
+    uint64_t arena_sz;
+    uint64_t dat_sz;
+    unsigned char fp[SERIES_SNAP_FP_SZ];    /* last bytes of the covered part */
+} series_snap_t;
+
+typedef struct
+{
+    uint64_t name_offset;
+    uint32_t id;
+    uint8_t tp;
+    uint8_t pad_[3];
+} series_snap_entry_t;
+
+typedef struct
+{
+    FILE * fp;
+    uint64_t offset;
+} series_snap_w_t;
+
 /*
  * Used for storing double and integers as string. this is not very important
  * if it will not store all characters generated so 64 is more than enough
@@ -48,6 +93,11 @@ static char str_type_buf[STR_TYPE_BUF_SZ];
 
 static int SERIES_save(siridb_t * siridb);
 static int SERIES_load(siridb_t * siridb, imap_t * dropped);
+static int SERIES_load_snap(
+        siridb_t * siridb,
+        imap_t * dropped,
+        size_t * offset);
+static void SERIES_save_snap(siridb_t * siridb);
 static int SERIES_read_dropped(siridb_t * siridb, imap_t * dropped);
 static int SERIES_open_new_dropped_file(siridb_t * siridb);
 static int SERIES_open_dropped_file(siridb_t * siridb);
@@ -60,6 +110,25 @@ static void SERIES_idx_sort(
         idx_t * idx,
         uint_fast32_t start,
         uint_fast32_t end);
+static int SERIES_mem_cb(siridb_series_t * series, siridb_series_mem_t * mem);
+static int SERIES_ptr_cmp(const void * a, const void * b);
+static siridb_points_t * SERIES_get_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_ngram_query_t *__restrict query);
+static inline siridb_ngram_t * SERIES_get_ngram(idx_t * idx);
+static int SERIES_stream_slice(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_points_t ** points,
+        size_t * size,
+        uint64_t * next_ts);
+static int SERIES_rollup_open(siridb_shard_t * shard);
+static int SERIES_rollup_feed(
+        siridb_rollup_select_t *__restrict select,
+        siridb_points_t * points);
 
 static siridb_series_t * SERIES_new(
         siridb_t * siridb,
@@ -138,6 +207,8 @@ int siridb_series_add_point(
     assert (series->buffer != NULL);
     int rc = 0;
 
+    siridb_acache_touch(siridb->acache, series->id, *ts, *ts);
+
     series->length++;
 
     /* add point in memory
@@ -193,6 +264,16 @@ int siridb_series_add_pcache(
         siridb_series_t *__restrict series,
         siridb_pcache_t *__restrict pcache)
 {
+    /* points in a pcache are sorted */
+    if (pcache->len)
+    {
+        siridb_acache_touch(
+                siridb->acache,
+                series->id,
+                pcache->data[0].ts,
+                pcache->data[pcache->len - 1].ts);
+    }
+
     if (pcache->len > siridb->buffer->len || series->buffer == NULL)
     {
         series->length += pcache->len;
@@ -355,7 +436,7 @@ void siridb__series_free(siridb_series_t *__restrict series)
 
     if (series->buffer != NULL)
     {
-        siridb_points_free(series->buffer);
+        siridb_buffer_points_free(series->siridb->buffer, series->buffer);
         if (series->flags & SIRIDB_SERIES_IS_DROPPED)
         {
             vec_append_safe(
@@ -365,7 +446,6 @@ void siridb__series_free(siridb_series_t *__restrict series)
     }
 
     free(series->idx);
-    free(series->name);
     free(series);
 }
 
@@ -520,6 +600,11 @@ int siridb_series_drop_commit(siridb_t * siridb, siridb_series_t * series)
         rc = -1;
     };
 
+    if (siridb->tags != NULL)
+    {
+        siridb_tags_add_dropped(siridb->tags, series->id);
+    }
+
     /* decrement reference to series */
     siridb_series_decref(series);
 
@@ -582,19 +667,25 @@ int siridb_series_flush_dropped(siridb_t * siridb)
 }
 
 /*
+ * Remove the index of all given shards from the series in a single pass.
+ * The shards must be sorted by address. (see siridb_shard_drop_vec())
+ *
  * Re-allocations in this function can fail but are not critical.
  *
- * Note that 'series' can be destroyed when series->length has reached zero.
+ * Returns 1 when the series is dropped because its length has reached zero
+ * or 0 if not. The caller should call siridb_series_flush_dropped() when a
+ * series is dropped.
  */
-void siridb_series_remove_shard(
+int siridb_series_remove_shards(
         siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
-        siridb_shard_t *__restrict shard)
+        vec_t *__restrict shards)
 {
     idx_t *__restrict idx;
+    siridb_shard_t * shard;
     uint_fast32_t i, offset;
-    uint64_t start = shard->id - series->mask;
-    uint64_t end = start + shard->duration;
+    uint64_t start, end;
+    int update_start = 0, update_end = 0;
 
     i = offset = 0;
 
@@ -602,8 +693,20 @@ void siridb_series_remove_shard(
             i < series->idx_len;
             i++, idx++)
     {
-        if (idx->shard == shard)
+        if (bsearch(
+                &idx->shard,
+                shards->data,
+                shards->len,
+                sizeof(void *),
+                SERIES_ptr_cmp) != NULL)
         {
+            shard = idx->shard;
+            start = shard->id - series->mask;
+            end = start + shard->duration;
+
+            update_start |= series->start >= start && series->start < end;
+            update_end |= series->end < end && series->end > start;
+
             siridb_shard_decref(shard);
             offset++;
             series->length -= idx->len;
@@ -614,42 +717,41 @@ void siridb_series_remove_shard(
         }
     }
 
-    if (offset)
+    if (!offset)
     {
-        if (!series->length)
-        {
-            series->idx_len = 0;
+        return 0;
+    }
 
-            if (siridb_series_drop(siridb, series))
-            {
-                siridb_series_flush_dropped(siridb);
-            }
-        }
-        else
-        {
-            series->idx_len -= offset;
-            idx = (idx_t *) realloc(
-                        series->idx,
-                        series->idx_len * sizeof(idx_t));
-            if (idx == NULL && series->idx_len)
-            {
-                log_error("Re-allocation failed while removing series from "
-                        "shard index");
-            }
-            else
-            {
-                series->idx = idx;
-            }
-            if (series->start >= start && series->start < end)
-            {
-                SERIES_update_start(series);
-            }
-            if (series->end < end && series->end > start)
-            {
-                SERIES_update_end(series);
-            }
-        }
+    if (!series->length)
+    {
+        series->idx_len = 0;
+        (void) siridb_series_drop(siridb, series);
+        return 1;
+    }
+
+    series->idx_len -= offset;
+    idx = (idx_t *) realloc(
+                series->idx,
+                series->idx_len * sizeof(idx_t));
+    if (idx == NULL && series->idx_len)
+    {
+        log_error("Re-allocation failed while removing series from "
+                "shard index");
+    }
+    else
+    {
+        series->idx = idx;
+    }
+    if (update_start)
+    {
+        SERIES_update_start(series);
+    }
+    if (update_end)
+    {
+        SERIES_update_end(series);
     }
+
+    return 0;
 }
 
 /*
@@ -907,11 +1009,36 @@ siridb_points_t * siridb_series_get_points(
         siridb_series_t *__restrict series,
         uint64_t *__restrict start_ts,
         uint64_t *__restrict end_ts)
+{
+    return SERIES_get_points(series, start_ts, end_ts, NULL);
+}
+
+/*
+ * Like siridb_series_get_points() but chunks of log shards without the
+ * trigrams of the query are skipped, so only points which might match the
+ * query are returned. Chunks without a filter, for example after a restart,
+ * are read and get a filter for the next query.
+ */
+siridb_points_t * siridb_series_get_points_ngram(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_ngram_query_t *__restrict query)
+{
+    return SERIES_get_points(series, start_ts, end_ts, query);
+}
+
+static siridb_points_t * SERIES_get_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_ngram_query_t *__restrict query)
 {
     idx_t *__restrict idx;
     siridb_points_t *__restrict points;
     siridb_point_t *__restrict point;
-    size_t len, size;
+    siridb_ngram_t * ngram;
+    size_t len, size, offset;
     uint32_t i;
     uint32_t indexes[series->idx_len];
     len = i = size = 0;
@@ -923,6 +1050,12 @@ siridb_points_t * siridb_series_get_points(
         if (    (start_ts == NULL || idx->end_ts >= *start_ts) &&
                 (end_ts == NULL || idx->start_ts < *end_ts))
         {
+            if (query != NULL &&
+                (ngram = SERIES_get_ngram(idx)) != NULL &&
+                !siridb_ngram_match(ngram, query))
+            {
+                continue;
+            }
             size += idx->len;
             indexes[len] = i;
             len++;
@@ -941,6 +1074,7 @@ siridb_points_t * siridb_series_get_points(
     for (i = 0; i < len; i++)
     {
         idx = series->idx + indexes[i];
+        offset = points->len;
         siridb_shard_get_points_callback(idx->shard->flags, series)(
                 points,
                 idx,
@@ -948,6 +1082,25 @@ siridb_points_t * siridb_series_get_points(
                 end_ts,
                 series->flags & SIRIDB_SERIES_HAS_OVERLAP);
         /* errors can be ignored here */
+
+        /* a filter can only be created when all points are appended */
+        if (    query != NULL &&
+                idx->shard->ngram_index != NULL &&
+                points->len - offset == idx->len &&
+                (~series->flags & SIRIDB_SERIES_HAS_OVERLAP) &&
+                !siridb_ngram_index_full(idx->shard->ngram_index) &&
+                SERIES_get_ngram(idx) == NULL &&
+                (ngram = siridb_ngram_new(
+                        points,
+                        offset,
+                        points->len)) != NULL)
+        {
+            siridb_ngram_set(
+                    idx->shard->ngram_index,
+                    &idx->shard->ngrams,
+                    idx->pos,
+                    ngram);
+        }
     }
 
     if (series->buffer != NULL)
@@ -988,135 +1141,510 @@ siridb_points_t * siridb_series_get_points(
 }
 
 /*
- * Can be used instead of the macro function when need as callback function.
+ * Read points chunk by chunk and feed them to an aggregate stream so the
+ * points are never read at once. This is only possible when the chunks do not
+ * overlap and the buffer has no points older than the selected chunks since
+ * the chunks must be fed in order of time.
+ *
+ * This function must be called while holding the series mutex. The mutex is
+ * released while the points are aggregated, so only a slice of at most
+ * SERIES_STREAM_SLICE points (or one chunk) is read each time the mutex is
+ * locked. Each slice starts after the last point which is fed, so changes to
+ * the chunks in between, for example by the optimize task, are no problem.
+ *
+ * Returns 0 if successful, 1 when the points cannot be fed in order and
+ * nothing is fed, or -1 in case of an error. (the stream error is set)
  */
-void siridb__series_decref(siridb_series_t * series)
+int siridb_series_stream_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_aggr_stream_t *__restrict stream)
 {
-    siridb_series_decref(series);
-}
+    uv_mutex_t * series_mutex = &series->siridb->series_mutex;
+    siridb_points_t * points = NULL;
+    uint64_t next_ts, * from_ts = start_ts;
+    size_t size = 0;
+    int rc, feed_rc, fed = 0;
+
+    while ((rc = SERIES_stream_slice(
+            series,
+            from_ts,
+            end_ts,
+            &points,
+            &size,
+            &next_ts)) != SERIES_SLICE_DONE)
+    {
+        if (rc == SERIES_SLICE_UNORDERED)
+        {
+            if (points != NULL)
+            {
+                siridb_points_free(points);
+            }
+            if (!fed)
+            {
+                return 1;
+            }
+            /* the order has changed while streaming, read the rest at once */
+            points = SERIES_get_points(series, from_ts, end_ts, NULL);
+        }
 
-siridb_points_t * siridb_series_get_first(
-        siridb_series_t * series, int * required_shard)
-{
-    siridb_points_t * buf = series->buffer;
-    siridb_points_t * points;
-    uint64_t start;
+        if (rc == -1 || points == NULL)
+        {
+            sprintf(stream->err_msg, "Memory allocation error.");
+            feed_rc = -1;
+            break;
+        }
 
-    if (buf != NULL &&
-        buf->len &&
-        buf->data->ts == series->start)
-    {
-        points = siridb_points_new(1, series->tp);
-        if (points == NULL)
+        uv_mutex_unlock(series_mutex);
+        feed_rc = siridb_aggregate_stream_feed(stream, points);
+        uv_mutex_lock(series_mutex);
+
+        if (feed_rc || rc == SERIES_SLICE_UNORDERED)
         {
-            return NULL;
+            break;
         }
 
-        /* string type does not have a buffer so we don't have to worry */
-        points->data->ts = buf->data->ts;
-        points->data->val = buf->data->val;
-        points->len = 1;
-        return points;
+        fed = 1;
+        from_ts = &next_ts;
     }
 
-    (*required_shard)++;
+    if (points != NULL)
+    {
+        siridb_points_free(points);
+    }
+    return rc == SERIES_SLICE_DONE ? 0 : feed_rc;
+}
 
-    /* if not in the buffer, then if must be in a shard */
-    assert (series->idx_len);
+/*
+ * Read the next slice of points for siridb_series_stream_points(). The slice
+ * contains the points of chunks in [start_ts, end_ts) and when no other chunks
+ * are left, the points of the buffer. Argument 'next_ts' is set to the start
+ * for the next slice.
+ *
+ * Returns SERIES_SLICE_READ when a slice is read, SERIES_SLICE_DONE when no
+ * points are left, SERIES_SLICE_UNORDERED when the points cannot be read in
+ * order or -1 in case of an allocation error.
+ */
+static int SERIES_stream_slice(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_points_t ** points,
+        size_t * size,
+        uint64_t * next_ts)
+{
+    idx_t *__restrict idx;
+    siridb_point_t *__restrict point = NULL;
+    size_t blen = 0, n = 0;
+    uint64_t last_ts = 0, slice_ts = 0;
+    uint32_t i, first = series->idx_len, last = 0;
+    int more = 0;
 
-    idx_t * first = series->idx;
+    if (series->flags & SIRIDB_SERIES_HAS_OVERLAP)
+    {
+        return SERIES_SLICE_UNORDERED;
+    }
 
-    points = siridb_points_new(first->len, series->tp);
-    if (points == NULL)
+    for (i = 0, idx = series->idx; i < series->idx_len; i++, idx++)
     {
-        return NULL;
+        if (    (start_ts == NULL || idx->end_ts >= *start_ts) &&
+                (end_ts == NULL || idx->start_ts < *end_ts))
+        {
+            if (first == series->idx_len)
+            {
+                first = i;
+            }
+            if (n < SERIES_STREAM_SLICE)
+            {
+                /* at least one chunk is part of the slice */
+                n += idx->len;
+                last = i + 1;
+                slice_ts = idx->end_ts;
+            }
+            else
+            {
+                more = 1;
+            }
+            last_ts = idx->end_ts;
+        }
     }
 
-    start = series->start + 1;
+    if (series->buffer != NULL)
+    {
+        /* crop the buffer like siridb_series_get_points() */
+        point = series->buffer->data;
+        blen = series->buffer->len;
 
-    siridb_shard_get_points_callback(first->shard->flags, series)(
-            points,
-            first,
-            NULL,
-            &start,
-            series->flags & SIRIDB_SERIES_HAS_OVERLAP);
+        if (start_ts != NULL)
+        {
+            for (; blen && point->ts < *start_ts; point++, blen--);
+        }
 
-    /* we must have at least one point, more points are possible when
-     * having multiple points at the same time-stamp. */
-    assert (points->len);
+        if (end_ts != NULL)
+        {
+            for (; blen && point[blen - 1].ts >= *end_ts; blen--);
+        }
 
-    while (points->len > 1)
-    {
-        --points->len;
-        if (points->tp == TP_STRING)
+        if (blen && last > first && point->ts <= last_ts)
         {
-            free((points->data + points->len)->val.str);
+            return SERIES_SLICE_UNORDERED;
+        }
+
+        if (more)
+        {
+            blen = 0;  /* the buffer is read with the last slice */
         }
     }
 
-    return points;
-}
+    if (last == 0 && blen == 0)
+    {
+        return SERIES_SLICE_DONE;
+    }
 
-siridb_points_t * siridb_series_get_last(
-        siridb_series_t * series, int * required_shard)
-{
-    siridb_points_t * buf = series->buffer;
-    siridb_points_t * points;
-    siridb_point_t * point;
-    idx_t * last;
+    n += blen;
+    if (n > *size)
+    {
+        if (*points != NULL)
+        {
+            siridb_points_free(*points);
+        }
+        *size = 0;
+        if ((*points = siridb_points_new(n, series->tp)) == NULL)
+        {
+            return -1;
+        }
+        *size = n;
+    }
 
-    if (buf != NULL &&
-        buf->len &&
-        (point = buf->data + (buf->len - 1))->ts == series->end)
+    (*points)->len = 0;
+    for (i = first; i < last; i++)
     {
-        points = siridb_points_new(1, series->tp);
-        if (points == NULL)
+        idx = series->idx + i;
+        if (    (start_ts != NULL && idx->end_ts < *start_ts) ||
+                (end_ts != NULL && idx->start_ts >= *end_ts))
         {
-            return NULL;
+            continue;
         }
+        siridb_shard_get_points_callback(idx->shard->flags, series)(
+                *points,
+                idx,
+                start_ts,
+                end_ts,
+                0);
+        /* errors can be ignored here */
+    }
 
-        /* string type does not have a buffer so we don't have to worry */
-        points->data->ts = point->ts;
-        points->data->val = point->val;
-        points->len = 1;
-        return points;
+    /* the buffer is copied since an aggregate might re-order the points */
+    if (blen)
+    {
+        memcpy((*points)->data + (*points)->len,
+               point,
+               blen * sizeof(siridb_point_t));
+        (*points)->len += blen;
+        slice_ts = point[blen - 1].ts;
     }
 
-    (*required_shard)++;
+    *next_ts = slice_ts + 1;
+    return SERIES_SLICE_READ;
+}
 
-    /* if not in the buffer, then if must be in a shard */
-    assert (series->idx_len);
+/*
+ * Feed the points of a series in a range to a rollup select. Inside the
+ * rollup window of the select, the buckets of a shard are read from the
+ * rollup file when the rollup record contains all points of the series in
+ * that shard. All other points are read and fed to the select.
+ *
+ * Returns 0 if successful, -1 in case of an error (err_msg is set) or 1 when
+ * rollups cannot be used for this series.
+ */
+int siridb_series_rollup_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_rollup_select_t *__restrict select)
+{
+    idx_t *__restrict idx;
+    siridb_points_t * points;
+    siridb_point_t *__restrict point = NULL;
+    siridb_shard_t * shards[series->idx_len];
+    siridb_rollup_entry_t * entries[series->idx_len];
+    uint32_t npoints[series->idx_len];
+    uint64_t a_ts = select->a + 1, b_ts = select->b + 1;
+    size_t blen = 0, size = 0;
+    uint32_t i, j, n = 0;
+    int rc;
 
-    /* if not in the buffer, then if must be in a shard */
-    last = series__last_idx(series);
-    points = siridb_points_new(last->len, series->tp);
-    if (points == NULL)
+    if (series->flags & SIRIDB_SERIES_HAS_OVERLAP)
     {
-        return NULL;
+        return 1;
     }
 
-    siridb_shard_get_points_callback(last->shard->flags, series)(
-            points,
-            last,
-            &last->end_ts,
-            NULL,
-            series->flags & SIRIDB_SERIES_HAS_OVERLAP);
-
-    /* we must have at least one point, more points are possible when
-     * having multiple points at the same time-stamp. */
-    assert (points->len);
+    /* shards with points of this series in the rollup window */
+    for (i = 0, idx = series->idx; i < series->idx_len; i++, idx++)
+    {
+        if (idx->end_ts < a_ts || idx->start_ts >= b_ts)
+        {
+            continue;
+        }
+        for (j = 0; j < n && shards[j] != idx->shard; j++);
+        if (j == n)
+        {
+            shards[n] = idx->shard;
+            entries[n] = (idx->shard->rollups == NULL)
+                    ? NULL
+                    : imap_get(idx->shard->rollups, series->id);
+            npoints[n] = 0;
+            n++;
+        }
+    }
 
-    while (points->len > 1)
+    /* a record is only valid when no points are added after the optimize */
+    for (i = 0, idx = series->idx; i < series->idx_len; i++, idx++)
     {
-        --points->len;
-        if (points->tp == TP_STRING)
+        for (j = 0; j < n && shards[j] != idx->shard; j++);
+        if (j < n)
         {
-            free((points->data + points->len)->val.str);
+            npoints[j] += idx->len;
         }
     }
 
-    return points;
-}
+    for (j = 0; j < n; j++)
+    {
+        if (entries[j] != NULL && (
+                entries[j]->npoints != npoints[j] ||
+                (shards[j]->flags & SIRIDB_SHARD_IS_REMOVED) ||
+                SERIES_rollup_open(shards[j]) ||
+                siridb_rollup_select_read(
+                        select,
+                        shards[j]->rollup_fp->fp,
+                        shards[j]->fn,
+                        entries[j])))
+        {
+            entries[j] = NULL;
+        }
+    }
+
+    /* the head [start, a] and tail (b, end) are always read */
+    rc = SERIES_rollup_feed(
+            select,
+            siridb_series_get_points(series, start_ts, &a_ts));
+    if (rc == 0)
+    {
+        rc = SERIES_rollup_feed(
+                select,
+                siridb_series_get_points(series, &b_ts, end_ts));
+    }
+    if (rc)
+    {
+        return rc;
+    }
+
+    /* read the chunks in the window which are not in a rollup */
+    for (i = 0, idx = series->idx; i < series->idx_len; i++, idx++)
+    {
+        if (idx->end_ts < a_ts || idx->start_ts >= b_ts)
+        {
+            continue;
+        }
+        for (j = 0; j < n && shards[j] != idx->shard; j++);
+        if (entries[j] == NULL && idx->len > size)
+        {
+            size = idx->len;
+        }
+    }
+
+    if (series->buffer != NULL)
+    {
+        point = series->buffer->data;
+        blen = series->buffer->len;
+
+        for (; blen && point->ts < a_ts; point++, blen--);
+        for (; blen && point[blen - 1].ts >= b_ts; blen--);
+
+        if (blen > size)
+        {
+            size = blen;
+        }
+    }
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    points = siridb_points_new(size, series->tp);
+    if (points == NULL)
+    {
+        sprintf(select->err_msg, "Memory allocation error.");
+        return -1;
+    }
+
+    for (i = 0, idx = series->idx; i < series->idx_len && !rc; i++, idx++)
+    {
+        if (idx->end_ts < a_ts || idx->start_ts >= b_ts)
+        {
+            continue;
+        }
+        for (j = 0; j < n && shards[j] != idx->shard; j++);
+        if (entries[j] != NULL)
+        {
+            continue;
+        }
+
+        points->len = 0;
+        siridb_shard_get_points_callback(idx->shard->flags, series)(
+                points,
+                idx,
+                &a_ts,
+                &b_ts,
+                0);
+        /* errors can be ignored here */
+
+        rc = siridb_rollup_select_feed(select, points);
+    }
+
+    if (blen && !rc)
+    {
+        memcpy(points->data, point, blen * sizeof(siridb_point_t));
+        points->len = blen;
+        rc = siridb_rollup_select_feed(select, points);
+    }
+
+    siridb_points_free(points);
+    return rc;
+}
+
+/*
+ * Can be used instead of the macro function when need as callback function.
+ */
+void siridb__series_decref(siridb_series_t * series)
+{
+    siridb_series_decref(series);
+}
+
+siridb_points_t * siridb_series_get_first(
+        siridb_series_t * series, int * required_shard)
+{
+    siridb_points_t * buf = series->buffer;
+    siridb_points_t * points;
+    uint64_t start;
+
+    if (buf != NULL &&
+        buf->len &&
+        buf->data->ts == series->start)
+    {
+        points = siridb_points_new(1, series->tp);
+        if (points == NULL)
+        {
+            return NULL;
+        }
+
+        /* string type does not have a buffer so we don't have to worry */
+        points->data->ts = buf->data->ts;
+        points->data->val = buf->data->val;
+        points->len = 1;
+        return points;
+    }
+
+    (*required_shard)++;
+
+    /* if not in the buffer, then if must be in a shard */
+    assert (series->idx_len);
+
+    idx_t * first = series->idx;
+
+    points = siridb_points_new(first->len, series->tp);
+    if (points == NULL)
+    {
+        return NULL;
+    }
+
+    start = series->start + 1;
+
+    siridb_shard_get_points_callback(first->shard->flags, series)(
+            points,
+            first,
+            NULL,
+            &start,
+            series->flags & SIRIDB_SERIES_HAS_OVERLAP);
+
+    /* we must have at least one point, more points are possible when
+     * having multiple points at the same time-stamp. */
+    assert (points->len);
+
+    while (points->len > 1)
+    {
+        --points->len;
+        if (points->tp == TP_STRING)
+        {
+            free((points->data + points->len)->val.str);
+        }
+    }
+
+    return points;
+}
+
+siridb_points_t * siridb_series_get_last(
+        siridb_series_t * series, int * required_shard)
+{
+    siridb_points_t * buf = series->buffer;
+    siridb_points_t * points;
+    siridb_point_t * point;
+    idx_t * last;
+
+    if (buf != NULL &&
+        buf->len &&
+        (point = buf->data + (buf->len - 1))->ts == series->end)
+    {
+        points = siridb_points_new(1, series->tp);
+        if (points == NULL)
+        {
+            return NULL;
+        }
+
+        /* string type does not have a buffer so we don't have to worry */
+        points->data->ts = point->ts;
+        points->data->val = point->val;
+        points->len = 1;
+        return points;
+    }
+
+    (*required_shard)++;
+
+    /* if not in the buffer, then if must be in a shard */
+    assert (series->idx_len);
+
+    /* if not in the buffer, then if must be in a shard */
+    last = series__last_idx(series);
+    points = siridb_points_new(last->len, series->tp);
+    if (points == NULL)
+    {
+        return NULL;
+    }
+
+    siridb_shard_get_points_callback(last->shard->flags, series)(
+            points,
+            last,
+            &last->end_ts,
+            NULL,
+            series->flags & SIRIDB_SERIES_HAS_OVERLAP);
+
+    /* we must have at least one point, more points are possible when
+     * having multiple points at the same time-stamp. */
+    assert (points->len);
+
+    while (points->len > 1)
+    {
+        --points->len;
+        if (points->tp == TP_STRING)
+        {
+            free((points->data + points->len)->val.str);
+        }
+    }
+
+    return points;
+}
 
 siridb_points_t * siridb_series_get_count(siridb_series_t * series)
 {
@@ -1210,6 +1738,29 @@ void siridb_series_ensure_type(siridb_series_t * series, qp_obj_t * qp_obj)
     assert (0);
 }
 
+/*
+ * Fill 'mem' with the number of bytes used in memory by all series.
+ *
+ * Main thread.
+ */
+void siridb_series_mem(siridb_t * siridb, siridb_series_mem_t * mem)
+{
+    imap_t * map = siridb->series_map;
+    ct_t * ct = siridb->series;
+
+    memset(mem, 0, sizeof(siridb_series_mem_t));
+
+    imap_walk(map, (imap_cb) SERIES_mem_cb, mem);
+
+    if (siridb->buffer->slab != NULL)
+    {
+        mem->buffers = slab_size(siridb->buffer->slab);
+    }
+
+    mem->lookup = slab_size(map->node_slab) + slab_size(map->nodes_slab) +
+            slab_size(ct->node_slab) + slab_size(ct->nodes_slab);
+}
+
 /*
  * Calculate the server id.
  * Returns 0 or 1, representing a server in a pool)
@@ -1367,6 +1918,26 @@ int siridb_series_optimize_shard(
         }
     }
 
+    /*
+     * Rollups are only created when all points of the series in the new
+     * shard are written by this optimize.
+     */
+    if (    rc == 0 &&
+            new_idx == 0 &&
+            size &&
+            points->len == size &&
+            siridb->rollup != NULL &&
+            series->tp != TP_STRING)
+    {
+        /* this is not critical, without rollups the points are read */
+        (void) siridb_rollup_build(
+                siridb->rollup,
+                &shard->rollups,
+                shard->fn,
+                series->id,
+                points);
+    }
+
     siridb_points_free(points);
 
     if (new_idx)
@@ -1519,6 +2090,17 @@ static void SERIES_update_overlap(siridb_series_t *__restrict series)
     series->flags &= ~SIRIDB_SERIES_HAS_OVERLAP;
 }
 
+/*
+ * Call-back used by siridb_series_mem().
+ */
+static int SERIES_mem_cb(siridb_series_t * series, siridb_series_mem_t * mem)
+{
+    mem->n++;
+    mem->headers += sizeof(siridb_series_t) + series->name_len + 1;
+    mem->idx += series->idx_len * sizeof(idx_t);
+    return 0;
+}
+
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  */
@@ -1530,62 +2112,54 @@ static siridb_series_t * SERIES_new(
         const char * name)
 {
     uint32_t n;
-    siridb_series_t * series = malloc(sizeof(siridb_series_t));
+    size_t name_len = strlen(name);
+    siridb_series_t * series = malloc(sizeof(siridb_series_t) + name_len + 1);
     if (series == NULL)
     {
         ERR_ALLOC
+        return NULL;
     }
-    else
+
+    /* we use the length a lot and we have room so store this info */
+    series->name_len = name_len;
+    memcpy(series->name, name, name_len + 1);
+    series->id = id;
+    series->tp = tp;
+    series->ref = 1;
+    series->length = 0;
+    series->start = -1;
+    series->end = 0;
+    series->buffer = NULL;
+    series->pool = pool;
+    series->flags = 0;
+    series->idx_len = 0;
+    series->idx = NULL;
+    series->siridb = siridb;
+
+    /* get sum series name to calculate series mask (for sharding) */
+    for (n = 0; *name; name++)
     {
-        series->name = strdup(name);
-        if (series->name == NULL)
-        {
-            ERR_ALLOC
-            free(series);
-            series = NULL;
-        }
-        else
-        {
-            /* we use the length a lot and we have room so store this info */
-            series->name_len = strlen(series->name);
-            series->id = id;
-            series->tp = tp;
-            series->ref = 1;
-            series->length = 0;
-            series->start = -1;
-            series->end = 0;
-            series->buffer = NULL;
-            series->pool = pool;
-            series->flags = 0;
-            series->idx_len = 0;
-            series->idx = NULL;
-            series->siridb = siridb;
-
-            /* get sum series name to calculate series mask (for sharding) */
-            for (n = 0; *name; name++)
-            {
-                n += *name;
-            }
+        n += *name;
+    }
 
-            series->mask = (tp == TP_STRING) ?
-                    (uint16_t) ((n / 11) % siridb->shard_mask_log) + 600 :
-                    (uint16_t) ((n / 11) % siridb->shard_mask_num);
+    series->mask = (tp == TP_STRING) ?
+            (uint16_t) ((n / 11) % siridb->shard_mask_log) + 600 :
+            (uint16_t) ((n / 11) % siridb->shard_mask_num);
 
-            if ((bool) ((n / 11) % 2))
-            {
-                series->flags |= SIRIDB_SERIES_IS_SERVER_ONE;
-            }
+    if ((bool) ((n / 11) % 2))
+    {
+        series->flags |= SIRIDB_SERIES_IS_SERVER_ONE;
+    }
 
-            /* make sure these two are exactly the same */
-            assert (siridb_series_server_id(series) ==
-                    siridb_series_server_id_by_name(series->name));
+    /* make sure these two are exactly the same */
+    assert (siridb_series_server_id(series) ==
+            siridb_series_server_id_by_name(series->name));
 
-            if (siridb->time->precision == SIRIDB_TIME_SECONDS)
-            {
-                series->flags |= SIRIDB_SERIES_IS_32BIT_TS;
-            }
-        }
+    if (siridb->time->precision == SIRIDB_TIME_SECONDS)
+    {
+        series->flags |= SIRIDB_SERIES_IS_32BIT_TS;
     }
+
     return series;
 }
 
@@ -1618,6 +2192,10 @@ static int SERIES_save(siridb_t * siridb)
 
     /* macro get series file name */
     siridb_misc_get_fn(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+    siridb_misc_get_fn(snap_fn, siridb->dbpath, SIRIDB_SERIES_SNAP_FN)
+
+    /* the snapshot no longer matches once the series file is rewritten */
+    (void) unlink(snap_fn);
 
     if ((fpacker = qp_open(fn, "w")) == NULL)
     {
@@ -1740,100 +2318,506 @@ static int SERIES_keep_corrupt_series(siridb_t * siridb)
     return rc;
 }
 
-static int SERIES_load(siridb_t * siridb, imap_t * dropped)
+/*
+ * Add a series which is read from the series file or snapshot. Series with a
+ * dropped id are skipped. When a series name is found more than once, the
+ * series with the highest id is kept and rewrite is set.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ * (a SIGNAL might be raised but -1 should be considered critical in any case)
+ */
+static int SERIES_load_entry(
+        siridb_t * siridb,
+        imap_t * dropped,
+        uint32_t series_id,
+        uint8_t series_tp,
+        const char * name,
+        int * rewrite)
 {
-    qp_unpacker_t * unpacker;
-    qp_obj_t qp_series_name;
-    qp_obj_t qp_series_id;
-    qp_obj_t qp_series_tp;
     siridb_series_t * series;
-    qp_types_t tp;
-    uint32_t series_id;
-    uint8_t series_tp;
-
-    /* we should not have any series at this moment */
-    assert(siridb->max_series_id == 0);
-
-    /* get series file name */
-    siridb_misc_get_fn(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+    int rc;
 
-    if (!xpath_file_exist(fn))
+    /* update max_series_id */
+    if (series_id > siridb->max_series_id)
     {
-        /* missing series file, create an empty file and return  */
-        return SERIES_save(siridb);
+        siridb->max_series_id = series_id;
     }
 
-    if ((unpacker = qp_unpacker_ff(fn)) == NULL)
+    if (imap_get(dropped, series_id) != NULL)
     {
-        return -1;
+        return 0;
     }
 
-    /* unpacker will be freed in case schema check fails */
-    siridb_misc_schema_check(SIRIDB_SERIES_SCHEMA)
+    series = SERIES_new(
+            siridb,
+            series_id,
+            series_tp,
+            siridb->server->pool,
+            name);
 
-    while (qp_next(unpacker, NULL) == QP_ARRAY3 &&
-            qp_next(unpacker, &qp_series_name) == QP_RAW &&
-            qp_next(unpacker, &qp_series_id) == QP_INT64 &&
-            qp_next(unpacker, &qp_series_tp) == QP_INT64)
+    if (series == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    /* add series to c-tree */
+    rc = ct_add(siridb->series, series->name, series);
+
+    if (rc == CT_EXISTS)
+    {
+        /* Duplicate series found */
+        siridb_series_t * other = ct_get(siridb->series, series->name);
+
+        log_error(
+                "Series '%s' with ID %"PRIu32" has a duplicate "
+                "ID %"PRIu32", "
+                "(SiriDB will keep the highest ID)",
+                series->name,
+                series->id,
+                other->id);
+
+        *rewrite = 1;
+
+        if (other->id >= series->id)
+        {
+            siridb__series_free(series);
+            return 0;
+        }
+
+        (void) ct_pop(siridb->series, series->name);
+        (void) imap_pop(siridb->series_map, other->id);
+
+        siridb__series_free(other);
+
+        rc = ct_add(siridb->series, series->name, series);
+    }
+
+    if (rc || imap_add(siridb->series_map, series->id, series))
+    {
+        log_critical("series cannot be added");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns a fingerprint of the series file which is used to check if a
+ * snapshot still matches; the last bytes up to dat_sz.
+ *
+ * Returns 0 if successful or -1 in case the bytes cannot be read.
+ */
+static int SERIES_snap_fp(FILE * fp, uint64_t dat_sz, unsigned char * buf)
+{
+    size_t sz = dat_sz < SERIES_SNAP_FP_SZ ? dat_sz : SERIES_SNAP_FP_SZ;
+
+    memset(buf, 0, SERIES_SNAP_FP_SZ);
+
+    return -(   fseeko(fp, (off_t) (dat_sz - sz), SEEK_SET) ||
+                (sz && fread(buf, sz, 1, fp) != 1));
+}
+
+/*
+ * Returns an unpacker for the part of the series file which is not covered
+ * by the snapshot, or NULL in case of an error. The unpacker should be freed
+ * with qp_unpacker_ff_free().
+ */
+static qp_unpacker_t * SERIES_unpacker_tail(
+        FILE * fp,
+        uint64_t offset,
+        uint64_t size)
+{
+    size_t n = size - offset;
+    qp_unpacker_t * unpacker = malloc(sizeof(qp_unpacker_t));
+
+    if (unpacker == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    /* allocate at least one byte so an empty tail is not an error */
+    unpacker->source = malloc(n ? n : 1);
+    if (unpacker->source == NULL)
+    {
+        ERR_ALLOC
+        free(unpacker);
+        return NULL;
+    }
+
+    if (fseeko(fp, (off_t) offset, SEEK_SET) ||
+        (n && fread(unpacker->source, n, 1, fp) != 1))
+    {
+        qp_unpacker_ff_free(unpacker);
+        return NULL;
+    }
+
+    unpacker->pt = unpacker->source;
+    unpacker->end = unpacker->source + n;
+
+    return unpacker;
+}
+
+/*
+ * Load the series from a snapshot when the snapshot matches the series file.
+ * The entries are read from a memory mapped file and are only added after all
+ * entries are checked, so a snapshot which cannot be used has no side effects.
+ * Offset is set to the part of the series file which is covered, or to 0 when
+ * the complete series file must be read.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ * (a SIGNAL might be raised but -1 should be considered critical in any case)
+ */
+static int SERIES_load_snap(
+        siridb_t * siridb,
+        imap_t * dropped,
+        size_t * offset)
+{
+    series_snap_t snap;
+    series_snap_entry_t * entries;
+    siridb_series_t * series;
+    unsigned char fp_buf[SERIES_SNAP_FP_SZ];
+    struct stat st, st_dat;
+    char * map, * arena;
+    const char ** keys;
+    void ** data;
+    FILE * fp, * fp_dat;
+    uint64_t i, n;
+    int valid, rc;
+
+    siridb_misc_get_fn(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+    siridb_misc_get_fn(snap_fn, siridb->dbpath, SIRIDB_SERIES_SNAP_FN)
+
+    *offset = 0;
+
+    if ((fp = fopen(snap_fn, "r")) == NULL)
+    {
+        log_info("No series snapshot found, read '%s'", fn);
+        return 0;
+    }
+
+    if ((fp_dat = fopen(fn, "r")) == NULL)
     {
-        series_id = (uint32_t) qp_series_id.via.int64;
+        fclose(fp);
+        return 0;
+    }
+
+    valid = (
+        fstat(fileno(fp), &st) == 0 &&
+        fstat(fileno(fp_dat), &st_dat) == 0 &&
+        fread(&snap, sizeof(series_snap_t), 1, fp) == 1 &&
+        memcmp(snap.magic, SERIES_SNAP_MAGIC, sizeof(snap.magic)) == 0 &&
+        snap.schema == SIRIDB_SERIES_SNAP_SCHEMA &&
+        snap.arena_sz <= (uint64_t) st.st_size &&
+        (uint64_t) st.st_size == sizeof(series_snap_t) +
+            (uint64_t) snap.n * sizeof(series_snap_entry_t) +
+            snap.arena_sz &&
+        snap.dat_sz <= (uint64_t) st_dat.st_size &&
+        SERIES_snap_fp(fp_dat, snap.dat_sz, fp_buf) == 0 &&
+        memcmp(snap.fp, fp_buf, SERIES_SNAP_FP_SZ) == 0);
 
-        /* update max_series_id */
-        if (series_id > siridb->max_series_id)
+    fclose(fp_dat);
+
+    if (!valid || snap.n == 0)
+    {
+        if (!valid)
         {
-            siridb->max_series_id = series_id;
+            log_warning(
+                    "Series snapshot '%s' does not match '%s', "
+                    "read the complete series file", snap_fn, fn);
         }
+        fclose(fp);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    fclose(fp);
+
+    if (map == MAP_FAILED)
+    {
+        log_warning("Cannot map '%s', read the complete series file", snap_fn);
+        return 0;
+    }
+
+    (void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    entries = (series_snap_entry_t *) (map + sizeof(series_snap_t));
+    arena = (char *) (entries + snap.n);
+
+    /* names are null terminated when the arena ends with a terminator */
+    valid = snap.arena_sz && arena[snap.arena_sz - 1] == '\0';
+    for (i = 0; valid && i < snap.n; i++)
+    {
+        valid = (
+            entries[i].name_offset < snap.arena_sz &&
+            arena[entries[i].name_offset] != '\0' && (
+                i == 0 || strcmp(
+                        arena + entries[i - 1].name_offset,
+                        arena + entries[i].name_offset) < 0));
+    }
+
+    if (!valid)
+    {
+        log_warning(
+                "Series snapshot '%s' is corrupt, "
+                "read the complete series file", snap_fn);
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    keys = malloc(sizeof(const char *) * snap.n);
+    data = malloc(sizeof(void *) * snap.n);
+
+    if (keys == NULL || data == NULL)
+    {
+        ERR_ALLOC
+        free(keys);
+        free(data);
+        munmap(map, st.st_size);
+        return -1;
+    }
 
-        if (imap_get(dropped, series_id) == NULL)
+    for (i = 0, n = 0; i < snap.n; i++)
+    {
+        if (entries[i].id > siridb->max_series_id)
         {
-            series_tp = (uint8_t) qp_series_tp.via.int64;
-            series = SERIES_new(
-                    siridb,
-                    series_id,
-                    series_tp,
-                    siridb->server->pool,
-                    (const char *) qp_series_name.via.raw);
+            siridb->max_series_id = entries[i].id;
+        }
 
-            if (series != NULL)
-            {
-                /* add series to c-tree */
-                int rc = ct_add(siridb->series, series->name, series);
+        if (imap_get(dropped, entries[i].id) != NULL)
+        {
+            continue;
+        }
 
-                if (rc == CT_EXISTS)
-                {
-                    /* Duplicate series found */
-                    siridb_series_t * other = ct_get(
-                            siridb->series,
-                            series->name);
-
-                    log_error(
-                            "Series '%s' with ID %"PRIu32" has a duplicate "
-                            "ID %"PRIu32", "
-                            "(SiriDB will keep the highest ID)",
-                            series->name,
-                            series->id,
-                            other->id);
-
-                    if (other->id >= series->id)
-                    {
-                        siridb__series_free(series);
-                        continue;
-                    }
-
-                    (void) ct_pop(siridb->series, series->name);
-                    (void) imap_pop(siridb->series_map, other->id);
-
-                    siridb__series_free(other);
-
-                    rc = ct_add(siridb->series, series->name, series);
-                }
+        series = SERIES_new(
+                siridb,
+                entries[i].id,
+                entries[i].tp,
+                siridb->server->pool,
+                arena + entries[i].name_offset);
 
-                if(rc || imap_add(siridb->series_map, series->id, series))
-                {
-                    log_critical("series cannot be added");
-                    return -1;
-                }
-            }
+        if (series == NULL)
+        {
+            break;  /* signal is raised */
+        }
+
+        if (imap_add(siridb->series_map, series->id, series))
+        {
+            log_critical("series cannot be added");
+            siridb__series_free(series);
+            break;
+        }
+
+        keys[n] = series->name;
+        data[n] = series;
+        n++;
+    }
+
+    /* names are sorted and unique so the c-tree is built at once */
+    if (i < snap.n)
+    {
+        rc = -1;
+    }
+    else if ((rc = ct_build(siridb->series, keys, data, n)) != CT_OK)
+    {
+        log_critical("series cannot be added");
+    }
+
+    free(keys);
+    free(data);
+    munmap(map, st.st_size);
+
+    if (rc)
+    {
+        return -1;
+    }
+
+    *offset = snap.dat_sz;
+    return 0;
+}
+
+/*
+ * Call-backs used by SERIES_save_snap().
+ */
+static int SERIES_snap_entry(siridb_series_t * series, series_snap_w_t * w)
+{
+    series_snap_entry_t entry = {
+        .name_offset = w->offset,
+        .id = series->id,
+        .tp = series->tp,
+    };
+    w->offset += series->name_len + 1;
+    return fwrite(&entry, sizeof(series_snap_entry_t), 1, w->fp) != 1;
+}
+
+static int SERIES_snap_name(siridb_series_t * series, FILE * fp)
+{
+    return fwrite(series->name, series->name_len + 1, 1, fp) != 1;
+}
+
+/*
+ * Write a snapshot for the current series file. The snapshot is written to a
+ * temporary file which replaces the previous snapshot. Errors are logged but
+ * are not critical since the series can always be read from the series file.
+ */
+static void SERIES_save_snap(siridb_t * siridb)
+{
+    series_snap_t snap;
+    series_snap_w_t w;
+    struct stat st;
+    FILE * fp;
+    int rc;
+
+    siridb_misc_get_fn(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+    siridb_misc_get_fn(snap_fn, siridb->dbpath, SIRIDB_SERIES_SNAP_FN)
+    siridb_misc_get_fn(fn_temp, siridb->dbpath, "__" SIRIDB_SERIES_SNAP_FN)
+
+    log_debug("Write series snapshot");
+
+    memset(&snap, 0, sizeof(series_snap_t));
+    memcpy(snap.magic, SERIES_SNAP_MAGIC, sizeof(snap.magic));
+    snap.schema = SIRIDB_SERIES_SNAP_SCHEMA;
+    snap.n = siridb->series->len;
+
+    if ((fp = fopen(fn, "r")) == NULL)
+    {
+        log_error("Cannot read '%s' for the series snapshot", fn);
+        return;
+    }
+
+    rc = fstat(fileno(fp), &st);
+    if (rc == 0)
+    {
+        snap.dat_sz = st.st_size;
+        rc = SERIES_snap_fp(fp, snap.dat_sz, snap.fp);
+    }
+
+    fclose(fp);
+
+    if (rc || (fp = fopen(fn_temp, "w")) == NULL)
+    {
+        log_error("Cannot write series snapshot '%s'", fn_temp);
+        return;
+    }
+
+    w.fp = fp;
+    w.offset = 0;
+
+    /* the header is written again when the arena size is known, entries are
+     * written in the order of the c-tree which is sorted by name */
+    rc = (  fwrite(&snap, sizeof(series_snap_t), 1, fp) != 1 ||
+            ct_values(
+                    siridb->series,
+                    (ct_val_cb) SERIES_snap_entry,
+                    &w) ||
+            ct_values(
+                    siridb->series,
+                    (ct_val_cb) SERIES_snap_name,
+                    fp));
+
+    snap.arena_sz = w.offset;
+
+    rc = (  rc ||
+            fseeko(fp, 0, SEEK_SET) ||
+            fwrite(&snap, sizeof(series_snap_t), 1, fp) != 1);
+
+    if (fclose(fp) || rc || rename(fn_temp, snap_fn))
+    {
+        log_error("Cannot write series snapshot '%s'", snap_fn);
+        (void) unlink(fn_temp);
+    }
+}
+
+/*
+ * Load the series. When a snapshot matches the series file, the series are
+ * read from the snapshot and only series which are appended later are read
+ * from the series file. Otherwise the complete series file is read. The
+ * series file and snapshot are only rewritten when the series file contains
+ * series which are dropped or when the snapshot cannot be used.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ * (a SIGNAL might be raised but -1 should be considered critical in any case)
+ */
+static int SERIES_load(siridb_t * siridb, imap_t * dropped)
+{
+    qp_unpacker_t * unpacker;
+    qp_obj_t qp_series_name;
+    qp_obj_t qp_series_id;
+    qp_obj_t qp_series_tp;
+    qp_types_t tp;
+    uint64_t start = hist_now();
+    size_t offset;
+    int rewrite = dropped->len > 0;
+
+    /* we should not have any series at this moment */
+    assert(siridb->max_series_id == 0);
+
+    /* get series file name */
+    siridb_misc_get_fn(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+
+    if (!xpath_file_exist(fn))
+    {
+        /* missing series file, create an empty file and return  */
+        if (SERIES_save(siridb))
+        {
+            return -1;
+        }
+        SERIES_save_snap(siridb);
+        return 0;
+    }
+
+    if (SERIES_load_snap(siridb, dropped, &offset))
+    {
+        return -1;
+    }
+
+    if (offset)
+    {
+        struct stat st;
+        FILE * fp = fopen(fn, "r");
+
+        unpacker = (fp == NULL || fstat(fileno(fp), &st)) ?
+                NULL : SERIES_unpacker_tail(fp, offset, st.st_size);
+
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+
+        if (unpacker == NULL)
+        {
+            log_critical("Cannot read '%s' from offset %zu", fn, offset);
+            return -1;
+        }
+    }
+    else
+    {
+        rewrite = 1;
+
+        if ((unpacker = qp_unpacker_ff(fn)) == NULL)
+        {
+            return -1;
+        }
+
+        /* unpacker will be freed in case schema check fails */
+        siridb_misc_schema_check(SIRIDB_SERIES_SCHEMA)
+    }
+
+    while (qp_next(unpacker, NULL) == QP_ARRAY3 &&
+            qp_next(unpacker, &qp_series_name) == QP_RAW &&
+            qp_next(unpacker, &qp_series_id) == QP_INT64 &&
+            qp_next(unpacker, &qp_series_tp) == QP_INT64)
+    {
+        if (SERIES_load_entry(
+                siridb,
+                dropped,
+                (uint32_t) qp_series_id.via.int64,
+                (uint8_t) qp_series_tp.via.int64,
+                (const char *) qp_series_name.via.raw,
+                &rewrite))
+        {
+            qp_unpacker_ff_free(unpacker);
+            return -1;
         }
     }
 
@@ -1842,10 +2826,10 @@ static int SERIES_load(siridb_t * siridb, imap_t * dropped)
 
     if (tp != QP_END)
     {
-        double start = (double) (unpacker->end - unpacker->source);
-        double pos = (double) (unpacker->pt - unpacker->source);
+        double size = (double) (offset + (unpacker->end - unpacker->source));
+        double pos = (double) (offset + (unpacker->pt - unpacker->source));
 
-        if (pos / start < 0.8)
+        if (pos / size < 0.8)
         {
             log_critical(
                     "Cannot read at least 80 percent of '%s', "
@@ -1861,22 +2845,38 @@ static int SERIES_load(siridb_t * siridb, imap_t * dropped)
                 "Create a backup and continue", fn);
 
         (void) SERIES_keep_corrupt_series(siridb);
+        rewrite = 1;
+    }
+
+    /* a large tail is read from the series file on each start */
+    if (!rewrite && (size_t) (unpacker->end - unpacker->source) > offset / 8)
+    {
+        SERIES_save_snap(siridb);
     }
 
     /* free unpacker */
     qp_unpacker_ff_free(unpacker);
 
     /*
-     * In case of a siri_err we should not         return -1;
-     * overwrite series because the
+     * In case of a siri_err we should not overwrite series because the
      * file then might be incomplete.
      */
-    if (siri_err || SERIES_save(siridb))
+    if (rewrite)
     {
-        log_critical("Cannot write series index to disk");
-        return -1;  /* signal is raised */
+        if (siri_err || SERIES_save(siridb))
+        {
+            log_critical("Cannot write series index to disk");
+            return -1;  /* signal is raised */
+        }
+        SERIES_save_snap(siridb);
     }
 
+    log_info(
+            "Loaded %zu series in %.3f seconds (%s)",
+            siridb->series_map->len,
+            (hist_now() - start) / 1e9,
+            offset ? "snapshot" : "series file");
+
     return siri_err;
 }
 
@@ -2046,4 +3046,65 @@ static void SERIES_update_end(siridb_series_t *__restrict series)
     }
 }
 
+static int SERIES_ptr_cmp(const void * a, const void * b)
+{
+    uintptr_t pa = (uintptr_t) *(void * const *) a;
+    uintptr_t pb = (uintptr_t) *(void * const *) b;
+    return (pa > pb) - (pa < pb);
+}
+
+/*
+ * Returns the trigram filter for a chunk or NULL if the chunk has no filter.
+ */
+static inline siridb_ngram_t * SERIES_get_ngram(idx_t * idx)
+{
+    siridb_ngram_t * ngram = (idx->shard->ngrams == NULL)
+            ? NULL
+            : imap_get(idx->shard->ngrams, idx->pos);
+    return (ngram != NULL && ngram->len == idx->len) ? ngram : NULL;
+}
+
+/*
+ * Open the rollup file of a shard, unless the file is already open. The file
+ * stays open for other series and queries until the file handler closes it
+ * or the rollup file of the shard is replaced.
+ *
+ * Returns 0 if successful or -1 in case of an error. (an error is logged)
+ */
+static int SERIES_rollup_open(siridb_shard_t * shard)
+{
+    if (shard->rollup_fp == NULL)
+    {
+        return -1;
+    }
+
+    if (shard->rollup_fp->fp == NULL)
+    {
+        siridb_rollup_file(rdb, shard->fn);
+
+        return siri_fopen(siri.fh, shard->rollup_fp, rdb, "r");
+    }
+
+    return 0;
+}
+
+/*
+ * Feed points to a rollup select, the points are consumed. (see
+ * siridb_rollup_select_feed() for the return values)
+ */
+static int SERIES_rollup_feed(
+        siridb_rollup_select_t *__restrict select,
+        siridb_points_t * points)
+{
+    int rc;
+
+    if (points == NULL)
+    {
+        sprintf(select->err_msg, "Memory allocation error.");
+        return -1;
+    }
 
+    rc = siridb_rollup_select_feed(select, points);
+    siridb_points_free(points);
+    return rc;
+}
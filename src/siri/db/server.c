@@ -93,18 +93,24 @@ siridb_server_t * siridb_server_new(
     server->buffer_path = NULL;
     server->buffer_size = 0;
     server->startup_time = 0;
+    server->rtt = NULL;
 
     /* we set the promises later because we don't need one for self */
     server->promises = NULL;
     server->client = NULL;
 
     /* sets address:port to name property */
-    if (SERVER_update_name(server))
+    if (SERVER_update_name(server) ||
+        posix_memalign((void **) &server->rtt, 64, sizeof(hist_t)))
     {
         ERR_ALLOC
         siridb__server_free(server);
         server = NULL;
     }
+    else
+    {
+        hist_init(server->rtt);
+    }
 
     return server;
 }
@@ -157,6 +163,8 @@ int siridb_server_send_pkg(
      */
     promise->server = server;
     promise->data = data;
+    promise->start = hist_now();
+    promise->rtt = 0;
 
     uv_write_t * req = malloc(sizeof(uv_write_t));
     if (req == NULL)
@@ -246,7 +254,8 @@ int siridb_server_send_pkg(
 
 /*
  * Register and return a new server from qpack data.
- * The qpack data should contain: [uuid, address, port, pool]
+ * The qpack data should contain: [uuid, address, port, pool, lookup_mode]
+ * where lookup_mode is optional.
  *
  * In case of an error NULL is returned.
  * (a SIGNAL might be raised in case of allocation errors)
@@ -264,6 +273,7 @@ siridb_server_t * siridb_server_register(
     qp_obj_t qp_address;
     qp_obj_t qp_port;
     qp_obj_t qp_pool;
+    qp_obj_t qp_lookup_mode;
 
     if (qp_is_array(qp_next(&unpacker, NULL)) &&
         qp_next(&unpacker, &qp_uuid) == QP_RAW &&
@@ -271,6 +281,21 @@ siridb_server_t * siridb_server_register(
         qp_next(&unpacker, &qp_port) == QP_INT64 &&
         qp_next(&unpacker, &qp_pool) == QP_INT64)
     {
+        /* older versions do not send a lookup mode */
+        if (qp_next(&unpacker, &qp_lookup_mode) != QP_INT64)
+        {
+            qp_lookup_mode.via.int64 = siridb->lookup_mode;
+        }
+        else if (
+                qp_lookup_mode.via.int64 < 0 ||
+                qp_lookup_mode.via.int64 >= SIRIDB_LOOKUP_MODE_END)
+        {
+            log_error(
+                    "Cannot register server, unknown lookup mode: %" PRId64,
+                    qp_lookup_mode.via.int64);
+            return NULL;
+        }
+
         server = siridb_server_new(
                 (const char *) qp_uuid.via.raw,
                 (const char *) qp_address.via.raw,
@@ -282,7 +307,10 @@ siridb_server_t * siridb_server_register(
         if (server != NULL)
         {
             if (    (server->promises = omap_create()) == NULL ||
-                    siridb_servers_register(siridb, server))
+                    siridb_servers_register(
+                            siridb,
+                            server,
+                            (uint8_t) qp_lookup_mode.via.int64))
             {
                 siridb__server_free(server);
                 server = NULL;
@@ -764,6 +792,8 @@ static void SERVER_on_data(sirinet_stream_t * client, sirinet_pkg_t * pkg)
         SERVER_upd_flag_queue_full(promise->server);
         uv_timer_stop(promise->timer);
         uv_close((uv_handle_t *) promise->timer, (uv_close_cb) free);
+        promise->rtt = hist_now() - promise->start;
+        hist_observe(server->rtt, promise->rtt);
         promise->cb(promise, pkg, PROMISE_SUCCESS);
     }
 }
@@ -945,6 +975,7 @@ void siridb__server_free(siridb_server_t * server)
     free(server->libuv);
     free(server->dbpath);
     free(server->buffer_path);
+    free(server->rtt);
     free(server);
 }
 
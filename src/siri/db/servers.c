@@ -203,10 +203,16 @@ ssize_t siridb_servers_get_file(char ** buffer, siridb_t * siridb)
 /*
  * Returns 0 and increments server->ref by one if successful.
  *
+ * When the server is registered for a new pool, 'lookup_mode' is used for the
+ * new pool lookup. (the mode is ignored for a replica server)
+ *
  * In case of an error -1 is returned. (and a SIGNAL might be raised if
  * this is a critical error)
  */
-int siridb_servers_register(siridb_t * siridb, siridb_server_t * server)
+int siridb_servers_register(
+        siridb_t * siridb,
+        siridb_server_t * server,
+        uint8_t lookup_mode)
 {
     siridb_pool_t * pool;
 
@@ -278,7 +284,7 @@ int siridb_servers_register(siridb_t * siridb, siridb_server_t * server)
                 server->name,
                 server->pool);
 
-        pool = siridb_pools_append(siridb->pools, server);
+        pool = siridb_pools_append(siridb->pools, server, lookup_mode);
         if (pool == NULL)
         {
             log_critical(
@@ -288,6 +294,24 @@ int siridb_servers_register(siridb_t * siridb, siridb_server_t * server)
             return -1;
         }
 
+        if (lookup_mode != siridb->lookup_mode)
+        {
+            log_info(
+                    "Migrate database '%s' from lookup '%s' to '%s'",
+                    siridb->dbname,
+                    siridb_lookup_mode_str(siridb->lookup_mode),
+                    siridb_lookup_mode_str(lookup_mode));
+        }
+
+        siridb->prev_lookup_mode = siridb->lookup_mode;
+        siridb->lookup_mode = lookup_mode;
+
+        if (siridb_save(siridb))
+        {
+            log_critical("Cannot save database '%s'", siridb->dbname);
+            return -1;
+        }
+
         /* this is a new server for a new pool */
         siridb->reindex = siridb_reindex_open(siridb, 1);
     }
@@ -9,6 +9,8 @@
 #include <imap/imap.h>
 #include <limits.h>
 #include <logger/logger.h>
+#include <siri/db/ngram.h>
+#include <siri/db/rollup.h>
 #include <siri/db/series.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
@@ -32,9 +34,25 @@
 /* shard schema (schemas below 20 are reserved for Python SiriDB) */
 #define SIRIDB_SHARD_SHEMA 21
 
+/* shard schema with a string dictionary after the header */
+#define SIRIDB_SHARD_SHEMA_ZDICT 22
+
 /* optimal points in a single shard */
 #define OPTIMAL_POINTS_PER_SHARD 2000
 
+/* series which are processed before the series mutex is released */
+#define SHARD_DROP_SLICE 8192
+
+/* chunks of each series which are used to train a string dictionary */
+#define SHARD_ZDICT_CHUNKS 2
+
+/* bit set with a bit for each possible series mask */
+#define SHARD_MASKS_SZ ((UINT16_MAX + 1) / 64)
+#define SHARD_MASK_SET(masks__, mask__) \
+    masks__[(mask__) / 64] |= UINT64_C(1) << ((mask__) % 64)
+#define SHARD_MASK_HAS(masks__, mask__) \
+    (masks__[(mask__) / 64] & (UINT64_C(1) << ((mask__) % 64)))
+
 /*
  * Header schema layout
  *
@@ -47,6 +65,10 @@
  * 20   (uint8_t)   TIME_PRECISION
  * 21   (uint8_t)   FLAGS
  *
+ * Schema 22 is followed by a dictionary for string compression:
+ * 22   (uint16_t)  ZDICT_LEN
+ * 24   (uint8_t)   ZDICT[ZDICT_LEN]
+ *
  */
 #define HEADER_SIZE 22
 #define HEADER_SCHEMA 0
@@ -90,6 +112,13 @@
 #define DEFAULT_MAX_CHUNK_SZ_NUM 1200
 #define DEFAULT_MAX_CHUNK_SZ_LOG 128
 
+typedef struct
+{
+    siridb_shard_t * shard;
+    siridb_points_t * points;
+    size_t size;
+} shard_sample_t;
+
 static const siridb_shard_flags_repr_t flags_map[SHARD_STATUS_SIZE] = {
         {.repr="indexed", .flag=SIRIDB_SHARD_HAS_INDEX},
         {.repr="overlap", .flag=SIRIDB_SHARD_HAS_OVERLAP},
@@ -132,6 +161,12 @@ static size_t SHARD_write_header(
         uint16_t * cinfo,
         FILE * fp);
 static int SHARD_remove(siridb_shard_t * shard);
+static int SHARD_ptr_cmp(const void * a, const void * b);
+static int SHARD_read_zdict(siridb_shard_t * shard, FILE * fp);
+static siridb_zdict_t * SHARD_train_zdict(
+        siridb_shard_t * shard,
+        siridb_t * siridb);
+static int SHARD_sample_cb(siridb_series_t * series, void * data);
 
 uint64_t siridb_shard_duration_from_interval(siridb_t * siridb, uint64_t interval)
 {
@@ -209,7 +244,7 @@ int siridb_shard_migrate(
     }
 
     schema = (uint8_t) header[HEADER_SCHEMA];
-    if (schema > SIRIDB_SHARD_SHEMA)
+    if (schema > SIRIDB_SHARD_SHEMA_ZDICT)
     {
         fclose(fp);
         log_critical(
@@ -286,6 +321,11 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id, uint64_t duration)
     shard->ref = 1;
     shard->len = HEADER_SIZE;
     shard->replacing = NULL;
+    shard->ngrams = NULL;
+    shard->ngram_index = siridb->ngram_index;
+    shard->zdict = NULL;
+    shard->rollups = NULL;
+    shard->rollup_fp = NULL;
     shard->duration = duration;
 
     if (SHARD_init_fn(siridb, shard) < 0)
@@ -330,7 +370,7 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id, uint64_t duration)
     }
 
     uint8_t schema = (uint8_t) header[HEADER_SCHEMA];
-    if (schema > SIRIDB_SHARD_SHEMA)
+    if (schema > SIRIDB_SHARD_SHEMA_ZDICT)
     {
         fclose(fp);
         log_critical(
@@ -347,6 +387,14 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id, uint64_t duration)
 
     siridb_timep_t time_precision = (uint8_t) header[HEADER_TIME_PRECISION];
 
+    if (schema == SIRIDB_SHARD_SHEMA_ZDICT && SHARD_read_zdict(shard, fp))
+    {
+        fclose(fp);
+        log_critical("Cannot read dictionary from shard: '%s'", shard->fn);
+        siridb_shard_decref(shard);
+        return -1;
+    }
+
     if (siridb->time->precision != time_precision)
     {
         fclose(fp);
@@ -402,6 +450,21 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id, uint64_t duration)
         return -1;
     }
 
+    if (    siridb->rollup != NULL &&
+            shard->tp == SIRIDB_SHARD_TP_NUMBER &&
+            (shard->rollup_fp = siri_fp_new()) == NULL)
+    {
+        siridb_shard_decref(shard);
+        return -1;  /* signal is raised */
+    }
+
+    /* rollups are not critical, without rollups the points are read */
+    if (    shard->rollup_fp != NULL &&
+            siridb_rollup_load(&shard->rollups, shard->fn))
+    {
+        log_error("Cannot load rollups for shard: '%s'", shard->fn);
+    }
+
     shards = imap_get(siridb->shards, id);
     if (shards == NULL)
     {
@@ -426,7 +489,8 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id, uint64_t duration)
 }
 
 /*
- * Create a new shard file and return a siridb_shard_t object.
+ * Create a new shard file and return a siridb_shard_t object. The shard
+ * takes ownership of the dictionary, which may be NULL.
  *
  * In case of an error the return value is NULL and a SIGNAL is raised.
  */
@@ -436,18 +500,21 @@ siridb_shard_t *  siridb_shard_create(
         uint64_t id,
         uint64_t duration,
         uint8_t tp,
-        siridb_shard_t * replacing)
+        siridb_shard_t * replacing,
+        siridb_zdict_t * zdict)
 {
     siridb_shard_t * shard = malloc(sizeof(siridb_shard_t));
     FILE * fp;
 
     if (shard == NULL)
     {
+        siridb_zdict_free(zdict);
         ERR_ALLOC
         return NULL;
     }
     if ((shard->fp = siri_fp_new()) == NULL)
     {
+        siridb_zdict_free(zdict);
         free(shard);
         return NULL;  /* signal is raised */
     }
@@ -455,7 +522,13 @@ siridb_shard_t *  siridb_shard_create(
     shard->ref = 1;
     shard->tp = tp;
     shard->replacing = replacing;
-    shard->len = shard->size = HEADER_SIZE;
+    shard->ngrams = NULL;
+    shard->ngram_index = siridb->ngram_index;
+    shard->zdict = zdict;
+    shard->rollups = NULL;
+    shard->rollup_fp = NULL;
+    shard->len = shard->size = (zdict == NULL) ?
+            HEADER_SIZE : HEADER_SIZE + sizeof(uint16_t) + zdict->len;
     shard->duration = duration;
     if (replacing == NULL)
     {
@@ -494,6 +567,20 @@ siridb_shard_t *  siridb_shard_create(
         return NULL;
     }
 
+    if (    siridb->rollup != NULL &&
+            tp == SIRIDB_SHARD_TP_NUMBER &&
+            (shard->rollup_fp = siri_fp_new()) == NULL)
+    {
+        siridb_shard_decref(shard);
+        return NULL;  /* signal is raised */
+    }
+
+    if (replacing != NULL)
+    {
+        /* records are appended while optimizing, remove an old file */
+        siridb_rollup_remove(shard->fn);
+    }
+
     shard->flags =
             siri.cfg->shard_compression ? SIRIDB_SHARD_IS_COMPRESSED : 0;
 
@@ -518,14 +605,21 @@ siridb_shard_t *  siridb_shard_create(
      * 19   (uint8_t)   TP
      * 20   (uint8_t)   TIME_PRECISION
      * 21   (uint8_t)   FLAGS
+     * 22   (uint16_t)  ZDICT_LEN           (schema 22 only)
+     * 24   (uint8_t)   ZDICT[ZDICT_LEN]    (schema 22 only)
      */
-    if (    fputc(SIRIDB_SHARD_SHEMA, fp) == EOF ||
+    if (    fputc(zdict == NULL
+                ? SIRIDB_SHARD_SHEMA
+                : SIRIDB_SHARD_SHEMA_ZDICT, fp) == EOF ||
             fwrite(&id, sizeof(uint64_t), 1, fp) != 1 ||
             fwrite(&duration, sizeof(uint64_t), 1, fp) != 1 ||
             fwrite(&shard->max_chunk_sz, sizeof(uint16_t), 1, fp) != 1 ||
             fputc(tp, fp) == EOF ||
             fputc(siridb->time->precision, fp) == EOF ||
-            fputc(shard->flags, fp) == EOF)
+            fputc(shard->flags, fp) == EOF ||
+            (zdict != NULL && (
+                fwrite(&zdict->len, sizeof(uint16_t), 1, fp) != 1 ||
+                fwrite(zdict->data, zdict->len, 1, fp) != 1)))
     {
         char buf[1024];
         log_critical("Cannot write to shard file: '%s' (%s)",
@@ -672,7 +766,8 @@ size_t siridb_shard_write_points(
 
     if (shard->flags & SIRIDB_SHARD_IS_COMPRESSED)
     {
-        cdata = siridb_points_zip(points, start, end, cinfo, &dsize);
+        cdata = siridb_points_zip(
+                points, start, end, cinfo, &dsize, shard->zdict);
         if (cdata == NULL)
         {
             ERR_ALLOC
@@ -781,6 +876,27 @@ size_t siridb_shard_write_points(
     free(cdata);
 
     shard->len = pos + dsize;
+
+    if (    series->tp == TP_STRING &&
+            shard->ngram_index != NULL &&
+            !siridb_ngram_index_full(shard->ngram_index))
+    {
+        siridb_ngram_t * ngram = siridb_ngram_new(points, start, end);
+        if (ngram == NULL)
+        {
+            log_error("Cannot create trigram filter for shard id %" PRIu64,
+                    shard->id);
+        }
+        else
+        {
+            siridb_ngram_set(
+                    shard->ngram_index,
+                    &shard->ngrams,
+                    pos,
+                    ngram);
+        }
+    }
+
     return pos;
 }
 
@@ -1058,6 +1174,23 @@ int siridb_shard_get_points_num_compressed(
     return 0;
 }
 
+/*
+ * Used for chunks of a removed shard. The shard file might be unlinked while
+ * the series index still refers to the shard, for example between the
+ * slices of a drop, so no points are read.
+ *
+ * Returns always 0.
+ */
+int siridb_shard_get_points_removed(
+        siridb_points_t * points __attribute__((unused)),
+        idx_t * idx __attribute__((unused)),
+        uint64_t * start_ts __attribute__((unused)),
+        uint64_t * end_ts __attribute__((unused)),
+        uint8_t has_overlap __attribute__((unused)))
+{
+    return 0;
+}
+
 int siridb_shard_get_points_log_compressed(
         siridb_points_t * points,
         idx_t * idx,
@@ -1123,7 +1256,8 @@ int siridb_shard_get_points_log_compressed(
             idx->len,
             start_ts,
             end_ts,
-            has_overlap && (idx->shard->flags & SIRIDB_SHARD_HAS_OVERLAP));
+            has_overlap && (idx->shard->flags & SIRIDB_SHARD_HAS_OVERLAP),
+            idx->shard->zdict);
 
     free(bits);
 
@@ -1373,8 +1507,15 @@ int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb)
     int rc = 0;
     siridb_shard_t * new_shard = NULL;
     siridb_series_t * series;
+    siridb_zdict_t * zdict = NULL;
     size_t i;
 
+    /* a new dictionary is trained each time a log shard is optimized */
+    if (shard->tp == SIRIDB_SHARD_TP_LOG && siri.cfg->shard_compression)
+    {
+        zdict = SHARD_train_zdict(shard, siridb);
+    }
+
     uv_mutex_lock(&siridb->shards_mutex);
 
     /* In case the shard is not removed, it must be the shard inside the imap
@@ -1392,7 +1533,8 @@ int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb)
             shard->id,
             shard->duration,
             shard->tp,
-            shard)) == NULL)
+            shard,
+            zdict)) == NULL)
         {
             /* signal is raised */
             log_critical(
@@ -1407,6 +1549,7 @@ int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb)
     }
     else
     {
+        siridb_zdict_free(zdict);
         log_warning(
                 "Skip optimizing shard id '%" PRIu64 "' "
                 "because the shard is probably dropped.",
@@ -1551,6 +1694,17 @@ int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb)
         }
         else
         {
+            /* rollups are not critical, without rollups points are read */
+            (void) siridb_rollup_rename(
+                    new_shard->fn,
+                    new_shard->replacing->fn);
+
+            /* the rollup file is opened again with the new file name */
+            if (new_shard->rollup_fp != NULL)
+            {
+                siri_fp_close(new_shard->rollup_fp);
+            }
+
             /* free the original allocated memory and set the new filename */
             free(new_shard->fn);
             new_shard->fn = new_shard->replacing->fn;
@@ -1592,112 +1746,249 @@ void siridb__shard_decref(siridb_shard_t * shard)
     siridb_shard_decref(shard);
 }
 
+/*
+ * Drop a shard. (see siridb_shard_drop_vec())
+ */
 void siridb_shard_drop(siridb_shard_t * shard, siridb_t * siridb)
 {
-    siridb_series_t * series;
-    siridb_shard_t * pop_shard = NULL;
-    omap_t * shards;
-    int optimizing = 0;
+    vec_t * shards = vec_new(1);
+    if (shards == NULL)
+    {
+        ERR_ALLOC
+        return;
+    }
+    vec_append(shards, shard);
+    siridb_shard_drop_vec(shards, siridb);
+    vec_free(shards);
+}
+
+/*
+ * Drop a list of shards and remove them from the series index with a single
+ * pass over the series. The series are processed in slices of
+ * SHARD_DROP_SLICE and this thread sleeps between the slices, like the
+ * optimize task does, so inserts and queries get a chance to run.
+ *
+ * The caller must hold a reference to each shard in the list.
+ */
+void siridb_shard_drop_vec(vec_t * shards, siridb_t * siridb)
+{
+    siridb_shard_drop_t * drop = siridb_shard_drop_new(shards, siridb);
+    if (drop == NULL)
+    {
+        return;
+    }
+
+    while (siridb_shard_drop_work(drop))
+    {
+        usleep( 50000 * siridb->tasks.active + 100 );
+    }
+
+    siridb_shard_drop_free(drop);
+}
+
+/*
+ * Unlinks the shards and prepares the pass over the series. The pass itself
+ * is done by calling siridb_shard_drop_work() until it returns 0. Use this
+ * from the event loop so each slice can run in its own loop iteration.
+ *
+ * The caller must hold a reference to each shard in the list until
+ * siridb_shard_drop_free() is called since the shards are compared by
+ * address.
+ *
+ * Returns NULL and raises a signal in case of an allocation error.
+ */
+siridb_shard_drop_t * siridb_shard_drop_new(vec_t * shards, siridb_t * siridb)
+{
+    siridb_shard_t * shard, * pop_shard;
+    siridb_shard_drop_t * drop;
+    omap_t * omap;
+    size_t i;
+
+    drop = malloc(sizeof(siridb_shard_drop_t));
+    if (drop == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    drop->siridb = siridb;
+    drop->pos = 0;
+    drop->dropped = 0;
+    drop->series = NULL;
+    drop->popped = vec_new(shards->len);
+    drop->remove = vec_new(shards->len * 2);
+    drop->masks = calloc(SHARD_MASKS_SZ, sizeof(uint64_t));
+    if (drop->popped == NULL || drop->remove == NULL || drop->masks == NULL)
+    {
+        ERR_ALLOC
+        free(drop->popped);
+        free(drop->remove);
+        free(drop->masks);
+        free(drop);
+        return NULL;
+    }
 
     uv_mutex_lock(&siridb->series_mutex);
     uv_mutex_lock(&siridb->shards_mutex);
 
-    shards = imap_get(siridb->shards, shard->id);
-    if (shards)
+    for (i = 0; i < shards->len; i++)
     {
-        pop_shard = omap_rm(shards, shard->duration);
-        if (shards->n == 0)
+        shard = (siridb_shard_t *) shards->data[i];
+        pop_shard = NULL;
+
+        omap = imap_get(siridb->shards, shard->id);
+        if (omap)
         {
-            free(imap_pop(siridb->shards, shard->id));
+            pop_shard = omap_rm(omap, shard->duration);
+            if (omap->n == 0)
+            {
+                free(imap_pop(siridb->shards, shard->id));
+            }
+        }
+
+        if (pop_shard == NULL || (pop_shard->flags & SIRIDB_SHARD_IS_REMOVED))
+        {
+            log_warning(
+                    "Shard id '%" PRIu64 "' is already dropped", shard->id);
+            if (pop_shard != NULL)
+            {
+                siridb_shard_decref(pop_shard);
+            }
+            continue;
         }
-    }
 
-    /*
-     * When optimizing, 'pop_shard' is always the new shard and 'shard'
-     * will be set to the old one.
-     */
-    if (pop_shard != NULL && (~pop_shard->flags & SIRIDB_SHARD_IS_REMOVED))
-    {
         pop_shard->flags |= SIRIDB_SHARD_IS_REMOVED;
         SHARD_remove(pop_shard);
+        vec_append(drop->popped, pop_shard);
 
-        if (shard != pop_shard)
+        /*
+         * When optimizing, 'pop_shard' is always the new shard and 'shard'
+         * will be set to the old one. The index for both the old and the new
+         * shard must be removed.
+         */
+        if (shard == pop_shard && shard->replacing != NULL)
         {
-            optimizing = 1;
+            shard = shard->replacing;
         }
-        else if (shard->replacing != NULL)
+        vec_append(drop->remove, pop_shard);
+        if (shard != pop_shard)
         {
-            optimizing = 1;
-            shard = shard->replacing;
+            /* chunks of both shards are skipped until they are removed */
+            shard->flags |= SIRIDB_SHARD_IS_REMOVED;
+            vec_append(drop->remove, shard);
         }
+
+        SHARD_MASK_SET(drop->masks, shard->id % shard->duration);
     }
-    else
+
+    if (drop->popped->len && siridb->acache != NULL)
     {
-        log_warning("Shard id '%" PRIu64 "' is already dropped", shard->id);
+        siridb_acache_expire(siridb->acache);
     }
 
     uv_mutex_unlock(&siridb->shards_mutex);
 
     /*
-     * We need a series mutex here since we depend on the series index
-     * and we create a copy since series might be removed when the length
-     * of series is zero after removing the shard
+     * Series are referenced since series are dropped when the length of
+     * series is zero after removing the shards, and the series mutex is
+     * released between the slices.
      */
-
-    /*
-     * Create a copy since series might be removed and when optimizing we need
-     * to remove indexes for both the old and new shard. Since a series might
-     * be dropped by the first call to remove shard, we need an extra reference
-     * for each series.
-     */
-    if (optimizing)
+    if (drop->remove->len)
     {
-        vec_t * vec = imap_2vec_ref(siridb->series_map);
-        size_t i;
-
-        if (vec == NULL)
+        drop->series = imap_2vec_ref(siridb->series_map);
+        if (drop->series == NULL)
         {
             ERR_ALLOC
         }
-        else for (i = 0; i < vec->len; i++)
+        else
         {
-            series = (siridb_series_t *) vec->data[i];
-            if (shard->id % shard->duration == series->mask)
-            {
-                siridb_series_remove_shard(siridb, series, shard);
-                siridb_series_remove_shard(siridb, series, pop_shard);
-            }
-            siridb_series_decref(series);
+            qsort(  drop->remove->data,
+                    drop->remove->len,
+                    sizeof(void *),
+                    SHARD_ptr_cmp);
         }
+    }
+
+    uv_mutex_unlock(&siridb->series_mutex);
+
+    return drop;
+}
+
+/*
+ * Removes the shards from the next SHARD_DROP_SLICE series. The series mutex
+ * is only held while processing the slice.
+ *
+ * Returns 1 when more series are left or 0 when the pass is finished.
+ */
+int siridb_shard_drop_work(siridb_shard_drop_t * drop)
+{
+    siridb_t * siridb = drop->siridb;
+    siridb_series_t * series;
+    size_t end;
 
-        vec_free(vec);
+    if (drop->series == NULL)
+    {
+        return 0;
     }
-    else
+
+    end = drop->pos + SHARD_DROP_SLICE;
+    if (end > drop->series->len)
     {
-        vec_t * vec = imap_2vec(siridb->series_map);
-        size_t i;
+        end = drop->series->len;
+    }
 
-        if (vec == NULL)
-        {
-            ERR_ALLOC
-        }
-        else for (i = 0; i < vec->len; i++)
+    uv_mutex_lock(&siridb->series_mutex);
+
+    for (; drop->pos < end; drop->pos++)
+    {
+        series = (siridb_series_t *) drop->series->data[drop->pos];
+        if ((~series->flags & SIRIDB_SERIES_IS_DROPPED) &&
+            SHARD_MASK_HAS(drop->masks, series->mask))
         {
-            series = (siridb_series_t *) vec->data[i];
-            if (shard->id % shard->duration == series->mask)
-            {
-                siridb_series_remove_shard(siridb, series, shard);
-            }
+            drop->dropped |= siridb_series_remove_shards(
+                    siridb,
+                    series,
+                    drop->remove);
         }
-        vec_free(vec);
+        siridb_series_decref(series);
+    }
+
+    uv_mutex_unlock(&siridb->series_mutex);
+
+    return drop->pos < drop->series->len;
+}
+
+/*
+ * Finishes the pass over the series in case siridb_shard_drop_work() was not
+ * called until it returned 0, flushes the dropped series and releases the
+ * dropped shards.
+ */
+void siridb_shard_drop_free(siridb_shard_drop_t * drop)
+{
+    siridb_t * siridb = drop->siridb;
+    size_t i;
+
+    while (siridb_shard_drop_work(drop));
+
+    uv_mutex_lock(&siridb->series_mutex);
+
+    if (drop->dropped)
+    {
+        (void) siridb_series_flush_dropped(siridb);
     }
 
-    if (pop_shard != NULL)
+    for (i = 0; i < drop->popped->len; i++)
     {
-        siridb_shard_decref(pop_shard);
+        siridb_shard_decref((siridb_shard_t *) drop->popped->data[i]);
     }
 
     uv_mutex_unlock(&siridb->series_mutex);
+
+    vec_free(drop->series);
+    vec_free(drop->popped);
+    vec_free(drop->remove);
+    free(drop->masks);
+    free(drop);
 }
 
 /*
@@ -1721,8 +2012,24 @@ void siridb__shard_free(siridb_shard_t * shard)
 
     siri_fp_decref(shard->fp);
 
+    if (shard->rollup_fp != NULL)
+    {
+        siri_fp_decref(shard->rollup_fp);
+    }
+
     uv_mutex_unlock(&siri.fh->lock_);
 
+    if (shard->ngrams != NULL)
+    {
+        siridb_ngram_free_map(shard->ngram_index, shard->ngrams);
+    }
+
+    if (shard->rollups != NULL)
+    {
+        imap_free(shard->rollups, free);
+    }
+
+    siridb_zdict_free(shard->zdict);
     free(shard->fn);
     free(shard);
 }
@@ -1761,6 +2068,16 @@ static int SHARD_remove(siridb_shard_t * shard)
 
     siri_fp_close(shard->fp);
 
+    if (shard->rollup_fp != NULL)
+    {
+        siri_fp_close(shard->rollup_fp);
+    }
+
+    if (shard->fn != NULL)
+    {
+        siridb_rollup_remove(shard->fn);
+    }
+
     rc += unlink(shard->fn);
 
     if (rc == 0)
@@ -2150,3 +2467,154 @@ static int SHARD_grow(siridb_shard_t * shard)
 
     return 0;
 }
+
+/*
+ * Read the dictionary which follows the header and update the used size.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int SHARD_read_zdict(siridb_shard_t * shard, FILE * fp)
+{
+    uint16_t len;
+
+    if (fread(&len, sizeof(uint16_t), 1, fp) != 1)
+    {
+        return -1;
+    }
+
+    shard->zdict = siridb_zdict_new(len);
+    if (shard->zdict == NULL || fread(shard->zdict->data, len, 1, fp) != 1)
+    {
+        return -1;
+    }
+
+    shard->len += sizeof(uint16_t) + len;
+    return 0;
+}
+
+/*
+ * Returns a dictionary trained from the first chunks of each string series
+ * in the shard, or NULL when no dictionary can be created. (not critical,
+ * the new shard is created without a dictionary)
+ *
+ * Like the optimize loop, the series mutex is locked for each series and
+ * this thread sleeps after reading a series so inserts are not blocked.
+ */
+static siridb_zdict_t * SHARD_train_zdict(
+        siridb_shard_t * shard,
+        siridb_t * siridb)
+{
+    siridb_zdict_t * zdict;
+    siridb_series_t * series;
+    vec_t * vec;
+    size_t i;
+    shard_sample_t sample = {
+            .shard=shard,
+            .points=siridb_points_new(DEFAULT_MAX_CHUNK_SZ_LOG, TP_STRING),
+            .size=0,
+    };
+
+    if (sample.points == NULL)
+    {
+        return NULL;
+    }
+
+    uv_mutex_lock(&siridb->series_mutex);
+
+    vec = imap_2vec_ref(siridb->series_map);
+
+    uv_mutex_unlock(&siridb->series_mutex);
+
+    if (vec == NULL)
+    {
+        siridb_points_free(sample.points);
+        return NULL;
+    }
+
+    for (i = 0; i < vec->len; i++)
+    {
+        series = vec->data[i];
+
+        if (    sample.size < SIRIDB_ZDICT_SAMPLE_SZ &&
+                series->tp == TP_STRING &&
+                shard->id % shard->duration == series->mask)
+        {
+            uv_mutex_lock(&siridb->series_mutex);
+
+            (void) SHARD_sample_cb(series, &sample);
+
+            uv_mutex_unlock(&siridb->series_mutex);
+
+            usleep( 50000 * siridb->tasks.active + 100 );
+        }
+
+        siridb_series_decref(series);
+    }
+
+    vec_free(vec);
+
+    zdict = siridb_zdict_train(sample.points);
+    siridb_points_free(sample.points);
+
+    if (zdict != NULL)
+    {
+        log_debug(
+                "Use a dictionary of %u bytes for shard id %" PRIu64,
+                zdict->len, shard->id);
+    }
+
+    return zdict;
+}
+
+static int SHARD_sample_cb(siridb_series_t * series, void * data)
+{
+    shard_sample_t * sample = data;
+    siridb_shard_t * shard = sample->shard;
+    siridb_points_t * points = sample->points;
+    siridb_shard_get_points_cb get_points_cb;
+    idx_t * idx = series->idx;
+    size_t i, n, start;
+    uint32_t j;
+
+    if (    sample->size >= SIRIDB_ZDICT_SAMPLE_SZ ||
+            series->tp != TP_STRING ||
+            shard->id % shard->duration != series->mask ||
+            (series->flags & SIRIDB_SERIES_IS_DROPPED))
+    {
+        return 0;
+    }
+
+    get_points_cb = siridb_shard_get_points_callback(shard->flags, series);
+
+    for (j = 0, n = 0; j < series->idx_len && n < SHARD_ZDICT_CHUNKS; ++j)
+    {
+        if (idx[j].shard != shard)
+        {
+            continue;
+        }
+
+        start = points->len;
+        if (siridb_points_resize(points, start + idx[j].len) ||
+            get_points_cb(points, idx + j, NULL, NULL, 0))
+        {
+            /* an error is logged, the sample is used as far as it is read */
+            sample->size = SIRIDB_ZDICT_SAMPLE_SZ;
+            return 0;
+        }
+
+        for (i = start; i < points->len; ++i)
+        {
+            sample->size += strlen(points->data[i].val.str) + 1;
+        }
+        ++n;
+    }
+
+    return 0;
+}
+
+static int SHARD_ptr_cmp(const void * a, const void * b)
+{
+    uintptr_t pa = (uintptr_t) *(void * const *) a;
+    uintptr_t pb = (uintptr_t) *(void * const *) b;
+    return (pa > pb) - (pa < pb);
+}
@@ -15,6 +15,7 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <logger/logger.h>
+#include <siri/db/rollup.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
 #include <siri/db/series.inline.h>
@@ -91,7 +92,7 @@ static bool SHARDS_read_id_and_duration(
 }
 
 /*
- * Returns true if fn is a temp shard or index filename, false if not.
+ * Returns true if fn is a temp shard, index or rollup filename, false if not.
  */
 static bool SHARDS_is_temp_fn(char * fn)
 {
@@ -108,6 +109,10 @@ static bool SHARDS_is_temp_fn(char * fn)
                 fn[n-3] == 'i' &&
                 fn[n-2] == 'd' &&
                 fn[n-1] == 'x'
+            ) || (
+                fn[n-3] == 'r' &&
+                fn[n-2] == 'd' &&
+                fn[n-1] == 'b'
     )));
 }
 
@@ -127,6 +132,8 @@ static bool SHARDS_remove_shard_file(const char * path, const char * fn)
         return false;
     }
 
+    siridb_rollup_remove(shard_path);
+
     log_warning("Shard file '%s' removed", fn);
     return true;
 }
@@ -339,6 +346,7 @@ int siridb_shards_add_points(
                     shard_id,
                     duration,
                     is_num ? SIRIDB_SHARD_TP_NUMBER : SIRIDB_SHARD_TP_LOG,
+                    NULL,
                     NULL);
             if (shard == NULL)
             {
@@ -37,7 +37,7 @@ siridb_tag_t * siridb_tag_new(siridb_tags_t * tags, uint64_t id)
         tag->id = id;
         tag->name = NULL;
         tag->tags = tags;
-        tag->series = imap_new();
+        tag->series = rbits_new();
     }
     return tag;
 }
@@ -130,11 +130,7 @@ siridb_tag_t * siridb_tag_load(siridb_t * siridb, const char * _fn)
                     qp_series_id.via.int64,
                     tag->name);
         }
-        else if (imap_add(tag->series, series_id, series) == 0)
-        {
-            siridb_series_incref(series);
-        }
-        else
+        else if (rbits_add(tag->series, (uint32_t) series_id) < 0)
         {
             log_error(
                     "Cannot add series '%s' to tag '%s'",
@@ -158,9 +154,9 @@ fail0:
 
 
 
-static int tag__save_cb(siridb_series_t * series, qp_fpacker_t * fpacker)
+static int tag__save_cb(uint32_t series_id, qp_fpacker_t * fpacker)
 {
-    return qp_fadd_int64(fpacker, (int64_t) series->id);
+    return qp_fadd_int64(fpacker, (int64_t) series_id);
 }
 
 /*
@@ -192,7 +188,7 @@ int siridb_tag_save(siridb_tag_t * tag)
         goto fail1;
     }
 
-    rc = imap_walk(tag->series, (imap_cb) tag__save_cb, fpacker);
+    rc = rbits_walk(tag->series, (rbits_cb) tag__save_cb, fpacker);
 
 fail1:
     rc = qp_close(fpacker) || rc;
@@ -344,10 +340,7 @@ void siridb__tag_free(siridb_tag_t * tag)
 
     free(tag->name);
 
-    if (tag->series != NULL)
-    {
-        imap_free(tag->series, (imap_free_cb) siridb__series_decref);
-    }
+    rbits_free(tag->series);
 
     free(tag);
 }
@@ -21,9 +21,7 @@
 #include <siri/siri.h>
 
 static int TAGS_load(siridb_t * siridb);
-static int TAGS_dropped_series(
-        siridb_tag_t * tag,
-        void * data __attribute__((unused)));
+static int TAGS_dropped_series(siridb_tag_t * tag, siridb_tags_t * tags);
 static int TAGS_nseries(
         siridb_tag_t * tag,
         void * data __attribute__((unused)));
@@ -43,6 +41,7 @@ int siridb_tags_init(siridb_t * siridb)
     siridb->tags->ref = 1;
     siridb->tags->next_id = 0;
     siridb->tags->tags = ct_new();
+    siridb->tags->dropped = rbits_new();
 
     uv_mutex_init(&siridb->tags->mutex);
 
@@ -52,6 +51,7 @@ int siridb_tags_init(siridb_t * siridb)
             siridb->dbpath,
             SIRIDB_TAGS_PATH) < 0 ||
             siridb->tags->tags == NULL ||
+            siridb->tags->dropped == NULL ||
             TAGS_load(siridb))
     {
         siridb__tags_free(siridb->tags);
@@ -133,6 +133,26 @@ siridb_tag_t * siridb_tags_add(siridb_tags_t * tags, const char * name)
 }
 
 
+/*
+ * Main thread.
+ *
+ * Remember a dropped series id so it can be removed from all tags by the
+ * "Group" thread. Failure is logged but not critical since dropped series
+ * are ignored when tags are resolved to series.
+ */
+void siridb_tags_add_dropped(siridb_tags_t * tags, uint32_t series_id)
+{
+    uv_mutex_lock(&tags->mutex);
+
+    if (rbits_add(tags->dropped, series_id) < 0)
+    {
+        log_error("Cannot mark series id %" PRIu32 " as dropped for tags",
+                series_id);
+    }
+
+    uv_mutex_unlock(&tags->mutex);
+}
+
 /*
  * This function is called from the "Group" thread.
  */
@@ -142,6 +162,8 @@ void siridb_tags_dropped_series(siridb_tags_t * tags)
 
     ct_values(tags->tags, (ct_val_cb) TAGS_dropped_series, tags);
 
+    rbits_clear(tags->dropped);
+
     tags->flags &= ~TAGS_FLAG_DROPPED_SERIES;
 
     uv_mutex_unlock(&tags->mutex);
@@ -188,7 +210,7 @@ static int TAGS_pkg(siridb_tag_t * tag, qp_packer_t * packer)
     int rc = 0;
     rc += qp_add_type(packer, QP_ARRAY2);
     rc += qp_add_string_term(packer, tag->name);
-    rc += qp_add_int64(packer, tag->series->len);
+    rc += qp_add_int64(packer, (int64_t) tag->series->len);
     return rc;
 }
 
@@ -222,7 +244,7 @@ sirinet_pkg_t * siridb_tags_pkg(siridb_tags_t * tags, uint16_t pid)
 typedef struct
 {
     qp_packer_t * packer;
-    uint64_t id;
+    uint32_t id;
 } TAGS_series_t;
 
 /*
@@ -230,7 +252,7 @@ typedef struct
  */
 static int TAGS_series_pkg(siridb_tag_t * tag, TAGS_series_t * w)
 {
-    return imap_get(tag->series, w->id)
+    return rbits_has(tag->series, w->id)
             ? qp_add_string(w->packer, tag->name) == 0
             : 0;
 }
@@ -316,32 +338,18 @@ static int TAGS_nseries(
 /*
  * This function is called from the "Group" thread.
  */
-static int TAGS_dropped_series(
-        siridb_tag_t * tag,
-        void * data __attribute__((unused)))
+static int TAGS_dropped_series(siridb_tag_t * tag, siridb_tags_t * tags)
 {
-    vec_t * tag_series = imap_vec_pop(tag->series);
-    siridb_series_t * series;
+    size_t n = tag->series->len;
 
-    if (tag_series != NULL)
-    {
-        size_t i;
-        for (i = 0; i < tag_series->len; i++)
-        {
-            series = (siridb_series_t *) tag_series->data[i];
-            if ((series->flags & SIRIDB_SERIES_IS_DROPPED) &&
-                imap_pop(tag->series, series->id))
-            {
-                siridb_series_decref(series);
-                siridb_tags_set_require_save(tag->tags, tag);
-            }
-        }
+    (void) rbits_difference(tag->series, tags->dropped);
 
-        vec_free(tag_series);
+    if (tag->series->len != n)
+    {
+        siridb_tags_set_require_save(tags, tag);
+        usleep(10000);  // 10ms
     }
 
-    usleep(10000);  // 10ms
-
     return 0;
 }
 
@@ -432,6 +440,7 @@ void siridb__tags_free(siridb_tags_t * tags)
     uv_mutex_unlock(&tags->mutex);
     uv_mutex_destroy(&tags->mutex);
 
+    rbits_free(tags->dropped);
     free(tags->path);
     free(tags);
 }
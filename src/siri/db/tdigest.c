@@ -0,0 +1,370 @@
+/*
+ * tdigest.c - Mergeable t-digest sketch for approximate percentiles.
+ *
+ * Centroids are merged with the k1 scale function, k(q) = delta / (2 * pi) *
+ * asin(2 * q - 1), where a centroid may not span more than one unit of k.
+ * Digests are packed in host byte order, like raw points.
+ */
+#include <assert.h>
+#include <logger/logger.h>
+#include <math.h>
+#include <siri/db/tdigest.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ts, n, min, max and len are packed, followed by the centroids */
+#define TDIGEST_RAW_HEADER_SZ offsetof(siridb_tdigest_t, size)
+
+static siridb_tdigest_t * TDIGEST_new(uint64_t ts, uint32_t size);
+static void TDIGEST_add(siridb_tdigest_t * tdigest, double val);
+static void TDIGEST_compress(siridb_tdigest_t * tdigest);
+static siridb_tdigest_t * TDIGEST_shrink(siridb_tdigest_t * tdigest);
+static double TDIGEST_k(double q);
+static int TDIGEST_cmp(const void * a, const void * b);
+
+/*
+ * Returns a digest for the given integer or float points, or NULL in case of
+ * a memory allocation error. NaN values are skipped.
+ */
+siridb_tdigest_t * siridb_tdigest_from_points(
+        siridb_points_t * points,
+        uint64_t ts)
+{
+    siridb_tdigest_t * tdigest;
+    size_t i;
+
+    assert (points->tp != TP_STRING);
+
+    tdigest = TDIGEST_new(
+            ts,
+            (points->len < TDIGEST_BUF_SZ) ? points->len : TDIGEST_BUF_SZ);
+    if (tdigest == NULL)
+    {
+        return NULL;
+    }
+
+    if (points->tp == TP_INT)
+    {
+        for (i = 0; i < points->len; i++)
+        {
+            TDIGEST_add(tdigest, (double) points->data[i].val.int64);
+        }
+    }
+    else
+    {
+        for (i = 0; i < points->len; i++)
+        {
+            TDIGEST_add(tdigest, points->data[i].val.real);
+        }
+    }
+
+    TDIGEST_compress(tdigest);
+
+    return TDIGEST_shrink(tdigest);
+}
+
+/*
+ * Returns a new digest with the values of both digests, or NULL in case of
+ * a memory allocation error. The digests itself are not changed.
+ */
+siridb_tdigest_t * siridb_tdigest_merge(
+        siridb_tdigest_t * a,
+        siridb_tdigest_t * b)
+{
+    siridb_tdigest_t * tdigest = TDIGEST_new(
+            (a->ts > b->ts) ? a->ts : b->ts,
+            a->len + b->len);
+    if (tdigest == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(tdigest->c, a->c, a->len * sizeof(siridb_tdigest_c_t));
+    memcpy(tdigest->c + a->len, b->c, b->len * sizeof(siridb_tdigest_c_t));
+
+    tdigest->len = a->len + b->len;
+    tdigest->n = a->n + b->n;
+    tdigest->min = (a->min < b->min) ? a->min : b->min;
+    tdigest->max = (a->max > b->max) ? a->max : b->max;
+
+    TDIGEST_compress(tdigest);
+
+    return TDIGEST_shrink(tdigest);
+}
+
+/*
+ * Returns the value at quantile q (0.0 - 1.0), interpolated between the
+ * centers of the centroids, or NaN if the digest has no values.
+ */
+double siridb_tdigest_quantile(siridb_tdigest_t * tdigest, double q)
+{
+    double rank, center, cum = 0.0, prev_center = 0.0;
+    double prev_mean = tdigest->min;
+    uint32_t i;
+
+    if (!tdigest->len)
+    {
+        return NAN;
+    }
+
+    rank = q * (tdigest->n - 1.0);
+
+    for (i = 0; i < tdigest->len; i++)
+    {
+        center = cum + (tdigest->c[i].weight - 1.0) / 2.0;
+
+        if (rank <= center)
+        {
+            return (center > prev_center) ?
+                    prev_mean + (tdigest->c[i].mean - prev_mean) *
+                    (rank - prev_center) / (center - prev_center) :
+                    tdigest->c[i].mean;
+        }
+
+        cum += tdigest->c[i].weight;
+        prev_center = center;
+        prev_mean = tdigest->c[i].mean;
+    }
+
+    /* between the last centroid and the maximum value */
+    center = tdigest->n - 1.0;
+
+    return (center > prev_center) ?
+            prev_mean + (tdigest->max - prev_mean) *
+            (rank - prev_center) / (center - prev_center) :
+            tdigest->max;
+}
+
+/*
+ * Pack a list of digests like raw points, with TDIGEST_RAW_TP as type and
+ * the number of digests as length.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siridb_tdigest_pack(vec_t * tdigests, qp_packer_t * packer)
+{
+    siridb_tdigest_t * tdigest;
+    unsigned char * data, * pt;
+    size_t i, size = 0;
+    int rc;
+
+    for (i = 0; i < tdigests->len; i++)
+    {
+        tdigest = tdigests->data[i];
+        size += TDIGEST_RAW_HEADER_SZ +
+                tdigest->len * sizeof(siridb_tdigest_c_t);
+    }
+
+    data = pt = malloc(size);
+    if (data == NULL && size)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < tdigests->len; i++)
+    {
+        tdigest = tdigests->data[i];
+        memcpy(pt, tdigest, TDIGEST_RAW_HEADER_SZ);
+        pt += TDIGEST_RAW_HEADER_SZ;
+        memcpy(pt, tdigest->c, tdigest->len * sizeof(siridb_tdigest_c_t));
+        pt += tdigest->len * sizeof(siridb_tdigest_c_t);
+    }
+
+    rc = -(qp_add_type(packer, QP_ARRAY_OPEN) ||
+            qp_add_int64(packer, (int64_t) TDIGEST_RAW_TP) ||
+            qp_add_int64(packer, (int64_t) tdigests->len) ||
+            qp_add_raw(packer, data, size) ||
+            qp_add_type(packer, QP_ARRAY_CLOSE));
+
+    free(data);
+
+    return rc;
+}
+
+/*
+ * Append the digests from packed data to a list.
+ *
+ * Returns the number of digests which are appended or -1 in case of an
+ * error. (invalid data or a memory allocation error)
+ */
+ssize_t siridb_tdigest_unpack(
+        vec_t ** tdigests,
+        const unsigned char * data,
+        size_t size)
+{
+    const unsigned char * end = data + size;
+    siridb_tdigest_t * tdigest;
+    uint32_t len;
+    ssize_t n = 0;
+
+    while (data < end)
+    {
+        if ((size_t) (end - data) < TDIGEST_RAW_HEADER_SZ)
+        {
+            return -1;
+        }
+
+        memcpy(&len,
+                data + offsetof(siridb_tdigest_t, len),
+                sizeof(uint32_t));
+
+        if ((size_t) (end - data) - TDIGEST_RAW_HEADER_SZ <
+                (size_t) len * sizeof(siridb_tdigest_c_t))
+        {
+            return -1;
+        }
+
+        tdigest = TDIGEST_new(0, len);
+        if (tdigest == NULL)
+        {
+            return -1;
+        }
+
+        memcpy(tdigest, data, TDIGEST_RAW_HEADER_SZ);
+        data += TDIGEST_RAW_HEADER_SZ;
+        memcpy(tdigest->c, data, len * sizeof(siridb_tdigest_c_t));
+        data += len * sizeof(siridb_tdigest_c_t);
+
+        if (vec_append_safe(tdigests, tdigest))
+        {
+            siridb_tdigest_free(tdigest);
+            return -1;
+        }
+        n++;
+    }
+
+    return n;
+}
+
+static siridb_tdigest_t * TDIGEST_new(uint64_t ts, uint32_t size)
+{
+    siridb_tdigest_t * tdigest = malloc(
+            sizeof(siridb_tdigest_t) + size * sizeof(siridb_tdigest_c_t));
+    if (tdigest == NULL)
+    {
+        return NULL;
+    }
+
+    tdigest->ts = ts;
+    tdigest->n = 0.0;
+    tdigest->min = INFINITY;
+    tdigest->max = -INFINITY;
+    tdigest->len = 0;
+    tdigest->size = size;
+
+    return tdigest;
+}
+
+/*
+ * Add a value as a centroid. The digest is compressed when the buffer is
+ * full so the size must be larger than TDIGEST_DELTA + 1.
+ */
+static void TDIGEST_add(siridb_tdigest_t * tdigest, double val)
+{
+    if (isnan(val))
+    {
+        return;
+    }
+
+    if (tdigest->len == tdigest->size)
+    {
+        TDIGEST_compress(tdigest);
+        assert (tdigest->len < tdigest->size);
+    }
+
+    tdigest->c[tdigest->len].mean = val;
+    tdigest->c[tdigest->len].weight = 1.0;
+    tdigest->len++;
+    tdigest->n += 1.0;
+
+    if (val < tdigest->min)
+    {
+        tdigest->min = val;
+    }
+    if (val > tdigest->max)
+    {
+        tdigest->max = val;
+    }
+}
+
+/*
+ * Sort the centroids and merge them when there are more than TDIGEST_DELTA
+ * centroids, so small digests keep the exact values.
+ */
+static void TDIGEST_compress(siridb_tdigest_t * tdigest)
+{
+    siridb_tdigest_c_t * c, * next;
+    double weight, w = 0.0, k_lo;
+    uint32_t i, j = 0;
+
+    qsort(tdigest->c, tdigest->len, sizeof(siridb_tdigest_c_t), TDIGEST_cmp);
+
+    if (tdigest->len <= TDIGEST_DELTA)
+    {
+        return;
+    }
+
+    k_lo = TDIGEST_k(0.0);
+
+    for (i = 1; i < tdigest->len; i++)
+    {
+        c = tdigest->c + j;
+        next = tdigest->c + i;
+        weight = c->weight + next->weight;
+
+        if (TDIGEST_k((w + weight) / tdigest->n) - k_lo <= 1.0)
+        {
+            c->mean += (next->mean - c->mean) * next->weight / weight;
+            c->weight = weight;
+        }
+        else
+        {
+            w += c->weight;
+            k_lo = TDIGEST_k(w / tdigest->n);
+            tdigest->c[++j] = *next;
+        }
+    }
+
+    tdigest->len = j + 1;
+}
+
+static siridb_tdigest_t * TDIGEST_shrink(siridb_tdigest_t * tdigest)
+{
+    siridb_tdigest_t * tmp;
+
+    if (tdigest->len == tdigest->size)
+    {
+        return tdigest;
+    }
+
+    tmp = realloc(
+            tdigest,
+            sizeof(siridb_tdigest_t) +
+            tdigest->len * sizeof(siridb_tdigest_c_t));
+    if (tmp == NULL)
+    {
+        /* not critical */
+        log_error("Re-allocation t-digest failed.");
+        return tdigest;
+    }
+
+    tmp->size = tmp->len;
+    return tmp;
+}
+
+static double TDIGEST_k(double q)
+{
+    if (q >= 1.0)
+    {
+        q = 1.0;
+    }
+    return TDIGEST_DELTA / (2.0 * M_PI) * asin(2.0 * q - 1.0);
+}
+
+static int TDIGEST_cmp(const void * a, const void * b)
+{
+    double ma = ((const siridb_tdigest_c_t *) a)->mean;
+    double mb = ((const siridb_tdigest_c_t *) b)->mean;
+    return (ma > mb) - (ma < mb);
+}
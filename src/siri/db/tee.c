@@ -9,10 +9,13 @@
 #include <siri/siri.h>
 #include <siri/net/tcp.h>
 #include <logger/logger.h>
+#include <stdint.h>
+#include <string.h>
 
 #define TEE__BUF_SZ 512
+#define TEE__MAX_BUFS 256       /* packages in one write request */
 static char tee__buf[TEE__BUF_SZ];
-static char tee__address[SIRI_CFG_MAX_LEN_ADDRESS+7];
+static char tee__address[SIRI_CFG_MAX_LEN_ADDRESS+96];
 
 
 static void tee__alloc_buffer(
@@ -24,15 +27,146 @@ static void tee__alloc_buffer(
     buf->len = TEE__BUF_SZ;
 }
 
+typedef struct
+{
+    uv_write_t req;                 /* must be on top */
+    siridb_tee_t * tee;
+    size_t n;
+    size_t size;
+    sirinet_spkg_t * spkgs[];
+} tee__req_t;
+
+static void tee__flush(siridb_tee_t * tee);
+
+static inline size_t tee__size(sirinet_spkg_t * spkg)
+{
+    return sizeof(sirinet_pkg_t) + spkg->pkg->len;
+}
+
+/*
+ * Drop queued packages which are not written yet, oldest first, until at
+ * least 'size' bytes are released or the queue is empty.
+ */
+static void tee__drop(siridb_tee_t * tee, size_t size)
+{
+    sirinet_spkg_t * spkg;
+    size_t released = 0, n = 0;
+
+    while (n < tee->queue->len && released < size)
+    {
+        spkg = tee->queue->data[n++];
+        released += tee__size(spkg);
+        sirinet_spkg_decref(spkg);
+    }
+
+    tee->queued -= released;
+    tee->dropped += n;
+    tee->queue->len -= n;
+    memmove(tee->queue->data,
+            tee->queue->data + n,
+            tee->queue->len * sizeof(void *));
+}
+
+/*
+ * Put the packages of a failed write request back in front of the queue,
+ * so they are written when a new connection is made. Which of the packages
+ * have reached the tee is unknown, so a package might be written twice.
+ */
+static void tee__requeue(siridb_tee_t * tee, tee__req_t * wreq)
+{
+    size_t i, len = tee->queue->len;
+
+    for (i = 0; i < wreq->n; i++)
+    {
+        if (vec_append_safe(&tee->queue, NULL))
+        {
+            log_error("Failed to queue the packages of a failed tee write");
+            tee->queue->len = len;
+            for (i = 0; i < wreq->n; i++)
+            {
+                sirinet_spkg_decref(wreq->spkgs[i]);
+            }
+            tee->queued -= wreq->size;
+            tee->dropped += wreq->n;
+            return;
+        }
+    }
+
+    memmove(tee->queue->data + wreq->n,
+            tee->queue->data,
+            len * sizeof(void *));
+    memcpy(tee->queue->data, wreq->spkgs, wreq->n * sizeof(void *));
+}
+
+/*
+ * The connection 'tcp' is closed after a write error, queued packages are
+ * kept and written when a new connection is made.
+ */
+static void tee__write_failed(
+        siridb_tee_t * tee,
+        tee__req_t * wreq,
+        uv_tcp_t * tcp)
+{
+    if (tcp != NULL && tcp == tee->tcp)
+    {
+        if (!uv_is_closing((uv_handle_t *) tcp))
+        {
+            uv_close((uv_handle_t *) tcp, (uv_close_cb) free);
+        }
+        tee->tcp = NULL;
+    }
+
+    tee__requeue(tee, wreq);
+    free(wreq);
+
+    /* the connection might be replaced while the request was pending */
+    if (tee->tcp && tee->queue->len)
+    {
+        tee__flush(tee);
+    }
+}
+
 static void tee__write_cb(uv_write_t * req, int status)
 {
-    sirinet_pkg_t * pkg = req->data;
+    tee__req_t * wreq = (tee__req_t *) req;
+    siridb_tee_t * tee = wreq->tee;
+    size_t i;
+
+    if (tee == NULL)
+    {
+        /* the tee is destroyed while this request was pending */
+        for (i = 0; i < wreq->n; i++)
+        {
+            sirinet_spkg_decref(wreq->spkgs[i]);
+        }
+        free(wreq);
+        return;
+    }
+
+    tee->writing = 0;
+    tee->req = NULL;
+
     if (status)
     {
         log_error("Socket (tee) write error: %s", uv_strerror(status));
+        tee__write_failed(tee, wreq, (uv_tcp_t *) req->handle);
+        return;
+    }
+
+    tee->written += wreq->n;
+
+    for (i = 0; i < wreq->n; i++)
+    {
+        sirinet_spkg_decref(wreq->spkgs[i]);
+    }
+
+    tee->queued -= wreq->size;
+    free(wreq);
+
+    if (tee->tcp && tee->queue->len)
+    {
+        tee__flush(tee);
     }
-    free(pkg);
-    free(req);
 }
 
 static void tee__on_data(
@@ -58,6 +192,7 @@ static void tee__on_data(
 
         log_info("Disconnected from tee `%s`", tee->address);
 
+        /* queued packages are written when a new connection is made */
         uv_close((uv_handle_t *) tcp, (uv_close_cb) free);
         tee->tcp = NULL;
         return;
@@ -69,35 +204,68 @@ static void tee__on_data(
             tee->port);
 }
 
-static void tee__do_write(siridb_tee_t * tee, sirinet_pkg_t * pkg)
+/*
+ * Write the queued packages, at most TEE__MAX_BUFS, with a single request.
+ * Packages which are queued while this request is pending are written
+ * together when the request is finished.
+ */
+static void tee__flush(siridb_tee_t * tee)
 {
-    uv_write_t * req;
-    uv_buf_t buf;
-
-    pkg = sirinet_pkg_dup(pkg);
-    if (!pkg)
+    size_t i, n = tee->queue->len < TEE__MAX_BUFS
+            ? tee->queue->len
+            : TEE__MAX_BUFS;
+    tee__req_t * wreq = malloc(sizeof(tee__req_t) + n * sizeof(void *));
+    sirinet_spkg_t * spkg;
+    uv_buf_t bufs[n];
+
+    if (wreq == NULL)
     {
-        log_error("Failed to create duplicate for tee");
+        log_error("Cannot write to tee");
+        tee__drop(tee, SIZE_MAX);
         return;
     }
 
-    req = malloc(sizeof(uv_write_t));
-    buf = uv_buf_init((char *) pkg, sizeof(sirinet_pkg_t) + pkg->len);
+    wreq->tee = tee;
+    wreq->n = n;
+    wreq->size = 0;
 
-    if (req)
+    for (i = 0; i < n; i++)
     {
-        int rc;
-        req->data = pkg;
-        rc = uv_write(req, (uv_stream_t *) tee->tcp, &buf, 1, tee__write_cb);
-        if (rc == 0)
-        {
-            return;  /* success */
-        }
-        free(req);
+        spkg = tee->queue->data[i];
+        wreq->spkgs[i] = spkg;
+        bufs[i] = uv_buf_init((char *) spkg->pkg, tee__size(spkg));
+        wreq->size += bufs[i].len;
+    }
+
+    tee->queue->len -= n;
+    memmove(tee->queue->data,
+            tee->queue->data + n,
+            tee->queue->len * sizeof(void *));
+
+    if (uv_write(
+            &wreq->req,
+            (uv_stream_t *) tee->tcp,
+            bufs,
+            n,
+            tee__write_cb))
+    {
+        log_error("Cannot write to tee");
+        tee__write_failed(tee, wreq, tee->tcp);
+        return;
     }
-    free(pkg);
-    log_error("Cannot write to tee");
-    return;
+
+    tee->writing = wreq->size;
+    tee->req = &wreq->req;
+}
+
+/*
+ * Queued packages cannot be written without a connection and are dropped.
+ * (the lock which is set while connecting is released)
+ */
+static void tee__connect_failed(siridb_tee_t * tee)
+{
+    tee__drop(tee, SIZE_MAX);
+    uv_mutex_unlock(&tee->lock_);
 }
 
 static void tee__on_connect(uv_connect_t * req, int status)
@@ -124,7 +292,13 @@ static void tee__on_connect(uv_connect_t * req, int status)
         tee->tcp = tcp;
         log_info(
                 "Connection created to tee: '%s:%u'", tee->address, tee->port);
-        goto done;
+        if (tee->queue->len && !tee->writing)
+        {
+            tee__flush(tee);
+        }
+        free(req);
+        uv_mutex_unlock(&tee->lock_);
+        return;
     }
 
     /* failed */
@@ -137,9 +311,8 @@ static void tee__on_connect(uv_connect_t * req, int status)
 
 fail:
     uv_close((uv_handle_t *) tcp, (uv_close_cb) free);
-done:
     free(req);
-    uv_mutex_unlock(&tee->lock_);
+    tee__connect_failed(tee);
 }
 
 void tee__make_connection(siridb_tee_t * tee, const struct sockaddr * dest)
@@ -151,7 +324,7 @@ void tee__make_connection(siridb_tee_t * tee, const struct sockaddr * dest)
         tee->err_code = SIRIDB_TEE_E_ALLOC;
         free(req);
         free(tcp);
-        uv_mutex_unlock(&tee->lock_);
+        tee__connect_failed(tee);
         return;
     }
     tcp->data = tee;
@@ -175,7 +348,7 @@ static void tee__on_resolved(
         log_error("Cannot resolve ip address for tee '%s' (error: %s)",
                 tee->address,
                 uv_err_name(status));
-        uv_mutex_unlock(&tee->lock_);
+        tee__connect_failed(tee);
         goto final;
     }
 
@@ -272,7 +445,7 @@ void tee__connect(siridb_tee_t * tee)
     /* Try DNS */
     if (tee__resolve_dns(tee, dns_req_family_map(siri.cfg->ip_support)))
     {
-        uv_mutex_unlock(&tee->lock_);
+        tee__connect_failed(tee);
     }
 }
 
@@ -287,6 +460,19 @@ siridb_tee_t * siridb_tee_new(void)
     tee->tcp = NULL;
     tee->flags = SIRIDB_TEE_FLAG;
     tee->err_code = 0;
+    tee->policy = SIRIDB_TEE_DROP_NEW;
+    tee->writing = 0;
+    tee->req = NULL;
+    tee->max_queue = SIRIDB_TEE_DEFAULT_MAX_QUEUE;
+    tee->queued = 0;
+    tee->written = 0;
+    tee->dropped = 0;
+    tee->queue = vec_new(VEC_DEFAULT_SIZE);
+    if (tee->queue == NULL)
+    {
+        free(tee);
+        return NULL;
+    }
     uv_mutex_init(&tee->lock_);
     return tee;
 }
@@ -299,6 +485,7 @@ void siridb_tee_close(siridb_tee_t * tee)
         uv_close((uv_handle_t *) tee->tcp, (uv_close_cb) free);
         tee->tcp = NULL;
     }
+    tee__drop(tee, SIZE_MAX);
     uv_mutex_unlock(&tee->lock_);
 }
 
@@ -307,7 +494,14 @@ void siridb_tee_free(siridb_tee_t * tee)
     /* must be closed before free can be used */
     assert (tee->tcp == NULL);
 
+    if (tee->req != NULL)
+    {
+        /* the pending write is cancelled, its call-back runs after free */
+        ((tee__req_t *) tee->req)->tee = NULL;
+    }
+
     uv_mutex_destroy(&tee->lock_);
+    vec_destroy(tee->queue, (vec_destroy_cb) sirinet_spkg_decref);
     free(tee->address);
     free(tee);
 }
@@ -326,30 +520,71 @@ const char * siridb_tee_str(siridb_tee_t * tee)
     }
     if (tee->address)
     {
-        (void) sprintf(tee__address, "%s:%u", tee->address, tee->port);
+        (void) snprintf(
+                tee__address,
+                sizeof(tee__address),
+                "%s:%u (queued: %zu bytes, written: %" PRIu64
+                ", dropped: %" PRIu64 ")",
+                tee->address,
+                tee->port,
+                tee->queued,
+                tee->written,
+                tee->dropped);
         return tee__address;
     }
     return "disabled";
 }
 
-void siridb_tee_write(siridb_tee_t * tee, sirinet_pkg_t * pkg)
+/*
+ * Queue a package for the tee. The package is not copied, so when a shared
+ * package is returned the tee holds a reference to 'pkg' and the caller must
+ * release 'pkg' using sirinet_spkg_decref() on the result instead of free().
+ *
+ * Returns NULL when the package is not queued, for example when the queue
+ * is full. Without a connection the package is queued while connecting.
+ */
+sirinet_spkg_t * siridb_tee_write(siridb_tee_t * tee, sirinet_pkg_t * pkg)
 {
+    sirinet_spkg_t * spkg;
+    size_t size = sizeof(sirinet_pkg_t) + pkg->len;
+
     assert (tee->address);
-    if (tee->tcp)
-    {
-        tee__do_write(tee, pkg);
-    }
-    else
+    if (!tee->tcp && uv_mutex_trylock(&tee->lock_) == 0)
     {
+        /* the package is queued and written once connected */
         log_debug("No tee connection (yet)...");
+        tee__connect(tee);
+    }
 
-        if (uv_mutex_trylock(&tee->lock_))
+    if (tee->max_queue && tee->queued + size > tee->max_queue)
+    {
+        /* packages in a pending write request cannot be dropped */
+        if (    tee->policy != SIRIDB_TEE_DROP_OLD ||
+                tee->writing + size > tee->max_queue)
         {
-            return;
+            tee->dropped++;
+            return NULL;
         }
+        tee__drop(tee, tee->queued + size - tee->max_queue);
+    }
 
-        tee__connect(tee);
+    spkg = sirinet_spkg_new(pkg);
+    if (spkg == NULL || vec_append_safe(&tee->queue, spkg))
+    {
+        log_error("Failed to queue a package for tee");
+        free(spkg);
+        tee->dropped++;
+        return NULL;
+    }
+
+    sirinet_spkg_incref(spkg);  /* reference for the caller */
+    tee->queued += size;
+
+    if (tee->tcp && !tee->writing)
+    {
+        tee__flush(tee);
     }
+    return spkg;
 }
 
 int siridb_tee_set_address_port(
@@ -370,6 +605,7 @@ int siridb_tee_set_address_port(
         uv_close((uv_handle_t *) tee->tcp, (uv_close_cb) free);
         tee->tcp = NULL;
     }
+    tee__drop(tee, SIZE_MAX);
 
     uv_mutex_unlock(&tee->lock_);
 
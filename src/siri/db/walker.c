@@ -25,6 +25,7 @@ siridb_walker_t * siridb_walker_new(
         walker->start = NULL;
         walker->enter_nodes = NULL;
         walker->exit_nodes = NULL;
+        walker->exprs = NULL;
     }
     return walker;
 }
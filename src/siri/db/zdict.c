@@ -0,0 +1,197 @@
+/*
+ * zdict.c - Trained dictionaries for string compression in log shards.
+ *
+ * The sample is split in epochs, one for each segment which fits in the
+ * dictionary. From each epoch the segment with the most frequent substrings
+ * of ZDICT_K bytes is selected, after which the substrings of that segment
+ * no longer count so the next epochs select other content. Segments with
+ * the highest score are placed at the end of the dictionary since these are
+ * closest to the data and therefore have the smallest offsets.
+ */
+#include <siri/db/zdict.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZDICT_K 6
+#define ZDICT_SEG_SZ 64
+#define ZDICT_MAX_SEGS (SIRIDB_ZDICT_MAX_SZ / ZDICT_SEG_SZ)
+#define ZDICT_HASH_BITS 18
+
+/* a sample needs at least a few segments to find redundancy */
+#define ZDICT_MIN_SAMPLE_SZ (ZDICT_SEG_SZ * 4)
+
+/* number of substrings in a segment */
+#define ZDICT_SEG_K (ZDICT_SEG_SZ - ZDICT_K + 1)
+
+typedef struct
+{
+    size_t pos;
+    uint64_t score;
+} zdict_seg_t;
+
+static inline uint32_t ZDICT_hash(const uint8_t * pt);
+static inline uint32_t ZDICT_weight(uint32_t count);
+static int ZDICT_seg_cmp(const void * a, const void * b);
+
+/*
+ * Returns a new dictionary with room for len bytes, or NULL in case of a
+ * memory allocation error.
+ */
+siridb_zdict_t * siridb_zdict_new(uint16_t len)
+{
+    siridb_zdict_t * zdict = malloc(sizeof(siridb_zdict_t) + len);
+    if (zdict == NULL)
+    {
+        return NULL;
+    }
+    zdict->len = len;
+    return zdict;
+}
+
+/*
+ * Returns a dictionary trained from the given string points, or NULL when
+ * the sample is too small or has no redundancy, or in case of a memory
+ * allocation error. At most SIRIDB_ZDICT_SAMPLE_SZ bytes are used.
+ */
+siridb_zdict_t * siridb_zdict_train(siridb_points_t * points)
+{
+    siridb_zdict_t * zdict = NULL;
+    zdict_seg_t segs[ZDICT_MAX_SEGS];
+    uint8_t * sample, * pt;
+    uint32_t * hashes = NULL;
+    uint32_t * counts = NULL;
+    uint64_t score;
+    size_t i, j, len, last, start, epoch_sz, nsegs = 0, n = 0;
+    zdict_seg_t best;
+
+    sample = malloc(SIRIDB_ZDICT_SAMPLE_SZ);
+    if (sample == NULL)
+    {
+        return NULL;
+    }
+
+    /* the terminators are included since these are compressed as well */
+    for (i = 0; i < points->len && n < SIRIDB_ZDICT_SAMPLE_SZ; i++)
+    {
+        len = strlen(points->data[i].val.str) + 1;
+        if (len > SIRIDB_ZDICT_SAMPLE_SZ - n)
+        {
+            len = SIRIDB_ZDICT_SAMPLE_SZ - n;
+        }
+        memcpy(sample + n, points->data[i].val.str, len);
+        n += len;
+    }
+
+    if (n < ZDICT_MIN_SAMPLE_SZ)
+    {
+        goto done;
+    }
+
+    /* the table is large enough so collisions are rare for a full sample */
+    hashes = malloc((n - ZDICT_K + 1) * sizeof(uint32_t));
+    counts = calloc(1 << ZDICT_HASH_BITS, sizeof(uint32_t));
+    if (hashes == NULL || counts == NULL)
+    {
+        goto done;
+    }
+
+    for (i = 0; i < n - ZDICT_K + 1; i++)
+    {
+        hashes[i] = ZDICT_hash(sample + i);
+        counts[hashes[i]]++;
+    }
+
+    epoch_sz = n / ZDICT_MAX_SEGS;
+    if (epoch_sz < ZDICT_SEG_SZ)
+    {
+        epoch_sz = ZDICT_SEG_SZ;
+    }
+
+    for (   start = 0;
+            start + ZDICT_SEG_SZ <= n && nsegs < ZDICT_MAX_SEGS;
+            start += epoch_sz)
+    {
+        /* last possible position for a segment in this epoch */
+        last = (start + epoch_sz < n) ? start + epoch_sz : n;
+        last = (last - start > ZDICT_SEG_SZ) ? last - ZDICT_SEG_SZ : start;
+
+        for (score = 0, j = start; j < start + ZDICT_SEG_K; j++)
+        {
+            score += ZDICT_weight(counts[hashes[j]]);
+        }
+
+        best.pos = start;
+        best.score = score;
+
+        for (i = start + 1; i <= last; i++)
+        {
+            score -= ZDICT_weight(counts[hashes[i - 1]]);
+            score += ZDICT_weight(counts[hashes[i + ZDICT_SEG_K - 1]]);
+            if (score > best.score)
+            {
+                best.pos = i;
+                best.score = score;
+            }
+        }
+
+        /* on average each substring must be found at least twice */
+        if (best.score < ZDICT_SEG_K)
+        {
+            continue;
+        }
+
+        for (j = best.pos; j < best.pos + ZDICT_SEG_K; j++)
+        {
+            counts[hashes[j]] = 0;
+        }
+
+        segs[nsegs++] = best;
+    }
+
+    if (!nsegs)
+    {
+        goto done;
+    }
+
+    qsort(segs, nsegs, sizeof(zdict_seg_t), ZDICT_seg_cmp);
+
+    zdict = siridb_zdict_new(nsegs * ZDICT_SEG_SZ);
+    if (zdict == NULL)
+    {
+        goto done;
+    }
+
+    for (i = 0, pt = zdict->data; i < nsegs; i++, pt += ZDICT_SEG_SZ)
+    {
+        memcpy(pt, sample + segs[i].pos, ZDICT_SEG_SZ);
+    }
+
+done:
+    free(sample);
+    free(hashes);
+    free(counts);
+    return zdict;
+}
+
+static inline uint32_t ZDICT_hash(const uint8_t * pt)
+{
+    uint64_t x = 0;
+    memcpy(&x, pt, ZDICT_K);
+    return (uint32_t) ((x * UINT64_C(0x9e3779b97f4a7c15)) >>
+            (64 - ZDICT_HASH_BITS));
+}
+
+/*
+ * Substrings which are found only once in the sample are not useful.
+ */
+static inline uint32_t ZDICT_weight(uint32_t count)
+{
+    return count > 1 ? count - 1 : 0;
+}
+
+static int ZDICT_seg_cmp(const void * a, const void * b)
+{
+    uint64_t sa = ((const zdict_seg_t *) a)->score;
+    uint64_t sb = ((const zdict_seg_t *) b)->score;
+    return (sa > sb) - (sa < sb);
+}
@@ -167,6 +167,10 @@ void siri_evars_parse(siri_t * siri)
             "SIRIDB_OPTIMIZING_INTERVAL",
             &siri->cfg->optimize_interval,
             0, 2419200);
+    evars__u32_mm(
+            "SIRIDB_SLOW_QUERY_THRESHOLD",
+            &siri->cfg->slow_query_threshold,
+            0, 3600000);
     evars__ip_support(
             "SIRIDB_IP_SUPPORT",
             &siri->cfg->ip_support);
@@ -106,3 +106,18 @@ int siri_fopen(
 }
 
 
+
+/*
+ * Returns the number of open files in the file handler.
+ */
+uint16_t siri_fh_count(siri_fh_t * fh)
+{
+    uint16_t i, n = 0;
+    uv_mutex_lock(&fh->lock_);
+    for (i = 0; i < fh->size; i++)
+    {
+        n += (fh->fpointers[i] != NULL && fh->fpointers[i]->fp != NULL);
+    }
+    uv_mutex_unlock(&fh->lock_);
+    return n;
+}
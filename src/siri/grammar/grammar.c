@@ -129,6 +129,7 @@ cleri_grammar_t * compile_siri_grammar_grammar(void)
     cleri_t * k_open_files = cleri_keyword(CLERI_GID_K_OPEN_FILES, "open_files", CLERI_CASE_SENSITIVE);
     cleri_t * k_or = cleri_keyword(CLERI_GID_K_OR, "or", CLERI_CASE_SENSITIVE);
     cleri_t * k_password = cleri_keyword(CLERI_GID_K_PASSWORD, "password", CLERI_CASE_SENSITIVE);
+    cleri_t * k_percentile = cleri_keyword(CLERI_GID_K_PERCENTILE, "percentile", CLERI_CASE_SENSITIVE);
     cleri_t * k_points = cleri_keyword(CLERI_GID_K_POINTS, "points", CLERI_CASE_SENSITIVE);
     cleri_t * k_pool = cleri_keyword(CLERI_GID_K_POOL, "pool", CLERI_CASE_SENSITIVE);
     cleri_t * k_pools = cleri_keyword(CLERI_GID_K_POOLS, "pools", CLERI_CASE_SENSITIVE);
@@ -1035,6 +1036,20 @@ cleri_grammar_t * compile_siri_grammar_grammar(void)
         cleri_optional(CLERI_NONE, time_expr),
         cleri_token(CLERI_NONE, ")")
     );
+    cleri_t * f_percentile = cleri_sequence(
+        CLERI_GID_F_PERCENTILE,
+        5,
+        k_percentile,
+        cleri_token(CLERI_NONE, "("),
+        r_float,
+        cleri_optional(CLERI_NONE, cleri_sequence(
+            CLERI_NONE,
+            2,
+            cleri_token(CLERI_NONE, ","),
+            time_expr
+        )),
+        cleri_token(CLERI_NONE, ")")
+    );
     cleri_t * f_first = cleri_sequence(
         CLERI_GID_F_FIRST,
         4,
@@ -1123,7 +1138,7 @@ cleri_grammar_t * compile_siri_grammar_grammar(void)
     cleri_t * aggregate_functions = cleri_list(CLERI_GID_AGGREGATE_FUNCTIONS, cleri_choice(
         CLERI_NONE,
         CLERI_FIRST_MATCH,
-        22,
+        23,
         f_all,
         f_offset,
         f_limit,
@@ -1132,6 +1147,7 @@ cleri_grammar_t * compile_siri_grammar_grammar(void)
         f_median,
         f_median_low,
         f_median_high,
+        f_percentile,
         f_min,
         f_max,
         f_count,
@@ -2,6 +2,7 @@
  * health.c
  */
 #include <siri/health.h>
+#include <siri/metrics.h>
 #include <siri/siri.h>
 #include <siri/net/tcp.h>
 #include <logger/logger.h>
@@ -55,6 +56,12 @@
     "\r\n" \
     "BACKUP MODE\n"
 
+#define METRICS_HEADER \
+    "HTTP/1.1 200 OK\r\n" \
+    "Content-Type: text/plain; version=0.0.4\r\n" \
+    "Content-Length: %zu\r\n" \
+    "\r\n"
+
 /* static response buffers */
 static uv_buf_t health__uv_ok_buf;
 static uv_buf_t health__uv_nok_buf;
@@ -70,6 +77,7 @@ static http_parser_settings health__settings;
 static void health__close_cb(uv_handle_t * handle)
 {
     siri_health_request_t * web_request = handle->data;
+    free(web_request->metrics.base);
     free(web_request);
 }
 
@@ -209,6 +217,40 @@ static uv_buf_t * health__get_ready_response(void)
     return &health__uv_nok_buf;
 }
 
+static uv_buf_t * health__get_metrics_response(
+        siri_health_request_t * web_request)
+{
+    size_t size, header_sz;
+    char * body, * data;
+
+    if (web_request->metrics.base != NULL)
+    {
+        /* the buffer is in use until the request is closed */
+        return &web_request->metrics;
+    }
+
+    body = siri_metrics_text(&size);
+    if (body == NULL)
+    {
+        return &health__uv_nok_buf;
+    }
+
+    header_sz = snprintf(NULL, 0, METRICS_HEADER, size);
+    data = malloc(header_sz + size + 1);
+    if (data == NULL)
+    {
+        free(body);
+        return &health__uv_nok_buf;
+    }
+
+    sprintf(data, METRICS_HEADER, size);
+    memcpy(data + header_sz, body, size);
+    free(body);
+
+    web_request->metrics = uv_buf_init(data, header_sz + size);
+    return &web_request->metrics;
+}
+
 static int health__url_cb(http_parser * parser, const char * at, size_t length)
 {
     siri_health_request_t * web_request = parser->data;
@@ -228,6 +270,10 @@ static int health__url_cb(http_parser * parser, const char * at, size_t length)
         : (length == 8 && memcmp(at, "/healthy", 8) == 0)
         ? &health__uv_ok_buf
 
+        /* metrics response */
+        : (length == 8 && memcmp(at, "/metrics", 8) == 0)
+        ? health__get_metrics_response(web_request)
+
         /* everything else */
         : &health__uv_nfound_buf;
 
@@ -251,6 +297,14 @@ static int health__message_complete_cb(http_parser * parser)
     else if (!web_request->response)
         web_request->response = &health__uv_nfound_buf;
 
+    /* only one response is written since the request is closed when the
+     * response is written */
+    if (web_request->is_written)
+        return 0;
+
+    web_request->is_written = true;
+    (void) uv_read_stop(&web_request->uvstream);
+
     (void) uv_write(
             &web_request->req,
             &web_request->uvstream,
@@ -284,6 +338,9 @@ static void health__connection_cb(uv_stream_t * server, int status)
 
     web_request->flags = SIRIDB_HEALTH_FLAG;
     web_request->is_closed = false;
+    web_request->is_written = false;
+    web_request->response = NULL;
+    web_request->metrics.base = NULL;
     web_request->uvstream.data = web_request;
     web_request->parser.data = web_request;
 
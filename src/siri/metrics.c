@@ -0,0 +1,345 @@
+/*
+ * metrics.c - Run-time metrics exported in the Prometheus text format.
+ *
+ * Histograms are recorded by the threads doing the work and are read without
+ * locks. Other values are read when the metrics are requested, this is done
+ * by the main thread so no locks are required for the database list.
+ */
+#include <siri/metrics.h>
+#include <siri/db/fifo.h>
+#include <siri/db/server.h>
+#include <siri/file/handler.h>
+#include <siri/siri.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define METRICS_INIT_SZ 8192
+
+typedef struct
+{
+    char * data;
+    size_t len;
+    size_t size;
+} metrics_buf_t;
+
+typedef struct
+{
+    const char * name;
+    const char * labels;
+    const char * help;      /* written once per name, NULL if repeated */
+} metrics_hist_def_t;
+
+typedef enum
+{
+    METRICS_DB_RECEIVED,
+    METRICS_DB_SELECTED,
+    METRICS_DB_SERIES,
+    METRICS_DB_IDLE,
+    METRICS_DB_FIFO,
+    METRICS_DB_QCACHE_HITS,
+    METRICS_DB_QCACHE_MISSES,
+    METRICS_DB_ACACHE_HITS,
+    METRICS_DB_ACACHE_MISSES,
+    METRICS_DB_ACACHE_BYTES,
+    METRICS_DB_NGRAM_BYTES,
+    METRICS_DB_END
+} metrics_db_tp;
+
+typedef struct
+{
+    const char * name;
+    const char * type;
+    const char * help;
+} metrics_db_def_t;
+
+hist_t siri_metrics[SIRI_METRICS_END];
+
+static const metrics_hist_def_t metrics__hist_defs[SIRI_METRICS_END] = {
+    {"siridb_insert_apply_seconds", "",
+        "Time to apply inserted points to local series."},
+    {"siridb_select_seconds", "stage=\"resolve\"",
+        "Time spent in select query stages."},
+    {"siridb_select_seconds", "stage=\"read\"", NULL},
+    {"siridb_select_seconds", "stage=\"aggregate\"", NULL},
+    {"siridb_select_seconds", "stage=\"pack\"", NULL},
+    {"siridb_optimize_shard_seconds", "",
+        "Time to optimize a single shard."},
+    {"siridb_buffer_flush_seconds", "",
+        "Time to flush the buffer file to disk."},
+};
+
+/* per database families, in the order of metrics_db_tp */
+static const metrics_db_def_t metrics__db_defs[METRICS_DB_END] = {
+    {"siridb_received_points_total", "counter", "Received points."},
+    {"siridb_selected_points_total", "counter", "Selected points."},
+    {"siridb_series", "gauge", "Number of series."},
+    {"siridb_idle_percentage", "gauge", "Idle time since start-up."},
+    {"siridb_fifo_files", "gauge", "Replication fifo files."},
+    {"siridb_query_cache_hits_total", "counter",
+        "Parsed query cache hits."},
+    {"siridb_query_cache_misses_total", "counter",
+        "Parsed query cache misses."},
+    {"siridb_aggregate_cache_hits_total", "counter",
+        "Aggregate cache hits."},
+    {"siridb_aggregate_cache_misses_total", "counter",
+        "Aggregate cache misses."},
+    {"siridb_aggregate_cache_bytes", "gauge",
+        "Memory used by the aggregate cache."},
+    {"siridb_ngram_bytes", "gauge",
+        "Memory used by trigram filters."},
+};
+
+static int METRICS_printf(metrics_buf_t * buf, const char * fmt, ...)
+    __attribute__((format (printf, 2, 3)));
+static int METRICS_hist(
+        metrics_buf_t * buf,
+        const char * name,
+        const char * labels,
+        hist_t * hist);
+static int METRICS_database(
+        metrics_buf_t * buf,
+        const metrics_db_def_t * def,
+        siridb_t * siridb);
+static int METRICS_promises(metrics_buf_t * buf, siridb_t * siridb);
+
+/*
+ * Returns the metrics as text or NULL in case of an allocation error. The
+ * size is set to the length of the text and the result must be freed.
+ */
+char * siri_metrics_text(size_t * size)
+{
+    metrics_buf_t buf;
+    llist_node_t * node;
+    int i, rc = 0;
+
+    buf.len = 0;
+    buf.size = METRICS_INIT_SZ;
+    buf.data = malloc(buf.size);
+    if (buf.data == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < SIRI_METRICS_END && !rc; i++)
+    {
+        const metrics_hist_def_t * def = metrics__hist_defs + i;
+        if (def->help != NULL)
+        {
+            rc = METRICS_printf(
+                    &buf,
+                    "# HELP %s %s\n# TYPE %s histogram\n",
+                    def->name,
+                    def->help,
+                    def->name);
+        }
+        rc = rc || METRICS_hist(&buf, def->name, def->labels, siri_metrics + i);
+    }
+
+    rc = rc || METRICS_printf(
+            &buf,
+            "# HELP siridb_open_files Open shard files.\n"
+            "# TYPE siridb_open_files gauge\n"
+            "siridb_open_files %u\n"
+            "# HELP siridb_max_open_files Maximum open shard files.\n"
+            "# TYPE siridb_max_open_files gauge\n"
+            "siridb_max_open_files %u\n",
+            siri_fh_count(siri.fh),
+            siri.fh->size);
+
+    /* each family is written once, followed by the samples for all
+     * databases */
+    for (i = 0; i < METRICS_DB_END && !rc; i++)
+    {
+        const metrics_db_def_t * def = metrics__db_defs + i;
+        rc = METRICS_printf(
+                &buf,
+                "# HELP %s %s\n# TYPE %s %s\n",
+                def->name,
+                def->help,
+                def->name,
+                def->type);
+
+        for (node = siri.siridb_list->first;
+             node != NULL && !rc;
+             node = node->next)
+        {
+            rc = METRICS_database(&buf, def, (siridb_t *) node->data);
+        }
+    }
+
+    rc = rc || METRICS_printf(
+            &buf,
+            "# HELP siridb_promise_seconds Round-trip time for requests "
+            "to other servers.\n"
+            "# TYPE siridb_promise_seconds histogram\n");
+
+    for (node = siri.siridb_list->first; node != NULL && !rc; node = node->next)
+    {
+        rc = METRICS_promises(&buf, (siridb_t *) node->data);
+    }
+
+    if (rc)
+    {
+        free(buf.data);
+        return NULL;
+    }
+
+    *size = buf.len;
+    return buf.data;
+}
+
+static int METRICS_database(
+        metrics_buf_t * buf,
+        const metrics_db_def_t * def,
+        siridb_t * siridb)
+{
+    uint64_t value;
+    siridb_acache_t * acache = siridb->acache;
+
+    switch ((metrics_db_tp) (def - metrics__db_defs))
+    {
+    case METRICS_DB_RECEIVED:
+        value = siridb->received_points;
+        break;
+    case METRICS_DB_SELECTED:
+        value = siridb->selected_points;
+        break;
+    case METRICS_DB_SERIES:
+        value = siridb->series_map->len;
+        break;
+    case METRICS_DB_IDLE:
+        value = (uint64_t) siridb_get_idle_percentage(siridb);
+        break;
+    case METRICS_DB_FIFO:
+        value = siridb_fifo_size(siridb->fifo);
+        break;
+    case METRICS_DB_QCACHE_HITS:
+        value = siridb->qcache->hits;
+        break;
+    case METRICS_DB_QCACHE_MISSES:
+        value = siridb->qcache->misses;
+        break;
+    case METRICS_DB_ACACHE_HITS:
+        if (acache == NULL)
+            return 0;
+        value = acache->hits;
+        break;
+    case METRICS_DB_ACACHE_MISSES:
+        if (acache == NULL)
+            return 0;
+        value = acache->misses;
+        break;
+    case METRICS_DB_ACACHE_BYTES:
+        if (acache == NULL)
+            return 0;
+        value = acache->size;
+        break;
+    case METRICS_DB_NGRAM_BYTES:
+        if (siridb->ngram_index == NULL)
+            return 0;
+        value = __atomic_load_n(
+                &siridb->ngram_index->memory,
+                __ATOMIC_RELAXED);
+        break;
+    default:
+        return 0;
+    }
+
+    return METRICS_printf(
+            buf,
+            "%s{database=\"%s\"} %" PRIu64 "\n",
+            def->name,
+            siridb->dbname,
+            value);
+}
+
+static int METRICS_promises(metrics_buf_t * buf, siridb_t * siridb)
+{
+    llist_node_t * node;
+    siridb_server_t * server;
+    char labels[SIRIDB_MAX_DBNAME_LEN + 128];
+    int rc = 0;
+
+    for (node = siridb->servers->first; node != NULL && !rc; node = node->next)
+    {
+        server = (siridb_server_t *) node->data;
+        if (server == siridb->server)
+        {
+            continue;
+        }
+        snprintf(labels, sizeof(labels),
+                "database=\"%s\",server=\"%s\"",
+                siridb->dbname,
+                server->name);
+        rc = METRICS_hist(buf, "siridb_promise_seconds", labels, server->rtt);
+    }
+    return rc;
+}
+
+static int METRICS_hist(
+        metrics_buf_t * buf,
+        const char * name,
+        const char * labels,
+        hist_t * hist)
+{
+    hist_snapshot_t snapshot;
+    uint64_t cumulative = 0;
+    const char * sep = *labels ? "," : "";
+    const char * lopen = *labels ? "{" : "";
+    const char * lclose = *labels ? "}" : "";
+    int b, rc = 0;
+
+    hist_snapshot(hist, &snapshot);
+
+    for (b = 0; b < HIST_BUCKETS - 1 && !rc; b++)
+    {
+        cumulative += snapshot.buckets[b];
+        rc = METRICS_printf(
+                buf,
+                "%s_bucket{%s%sle=\"%g\"} %" PRIu64 "\n",
+                name, labels, sep, hist_bound(b), cumulative);
+    }
+
+    return rc || METRICS_printf(
+            buf,
+            "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n"
+            "%s_sum%s%s%s %.9f\n"
+            "%s_count%s%s%s %" PRIu64 "\n",
+            name, labels, sep, snapshot.count,
+            name, lopen, labels, lclose, snapshot.sum / 1e9,
+            name, lopen, labels, lclose, snapshot.count);
+}
+
+static int METRICS_printf(metrics_buf_t * buf, const char * fmt, ...)
+{
+    va_list args;
+    int n;
+
+    while (1)
+    {
+        va_start(args, fmt);
+        n = vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, args);
+        va_end(args);
+
+        if (n < 0)
+        {
+            return -1;
+        }
+
+        if ((size_t) n < buf->size - buf->len)
+        {
+            buf->len += n;
+            return 0;
+        }
+
+        size_t size = buf->size * 2 + n;
+        char * tmp = realloc(buf->data, size);
+        if (tmp == NULL)
+        {
+            return -1;
+        }
+        buf->data = tmp;
+        buf->size = size;
+    }
+}
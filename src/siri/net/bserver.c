@@ -876,9 +876,12 @@ static void on_series_tags(sirinet_stream_t * client, sirinet_pkg_t * pkg)
                                 qp_tag_name.len);
                     }
 
-                    if (tag && imap_add(tag->series, series->id, series) == 0)
+                    if (tag && rbits_add(tag->series, series->id) < 0)
                     {
-                        siridb_series_incref(series);
+                        log_error(
+                                "Cannot add series '%s' to tag '%s'",
+                                series->name,
+                                tag->name);
                     }
 
                     siridb_tags_set_require_save(siridb->tags, tag);
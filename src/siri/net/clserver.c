@@ -568,7 +568,8 @@ static void on_insert(sirinet_stream_t * client, sirinet_pkg_t * pkg)
         ssize_t rc = siridb_insert_assign_pools(
                 siridb,
                 &unpacker,
-                insert->packer);
+                insert->packer,
+                insert->ibatch);
 
         switch ((siridb_insert_err_t) rc)
         {
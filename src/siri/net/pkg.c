@@ -241,6 +241,35 @@ sirinet_pkg_t * sirinet_pkg_dup(sirinet_pkg_t * pkg)
     return dup;
 }
 
+/*
+ * Returns a shared package with one reference which takes ownership of
+ * 'pkg', or NULL in case of an allocation error. (in this case 'pkg' is
+ * still owned by the caller)
+ */
+sirinet_spkg_t * sirinet_spkg_new(sirinet_pkg_t * pkg)
+{
+    sirinet_spkg_t * spkg = malloc(sizeof(sirinet_spkg_t));
+    if (spkg != NULL)
+    {
+        spkg->ref = 1;
+        spkg->pkg = pkg;
+    }
+    return spkg;
+}
+
+/*
+ * Destroy the shared package and the package when this is the last
+ * reference.
+ */
+void sirinet_spkg_decref(sirinet_spkg_t * spkg)
+{
+    if (!--spkg->ref)
+    {
+        free(spkg->pkg);
+        free(spkg);
+    }
+}
+
 static void PKG_write_cb(uv_write_t * req, int status)
 {
     if (status)
@@ -3,6 +3,7 @@
  */
 #include <assert.h>
 #include <logger/logger.h>
+#include <siri/api.h>
 #include <siri/service/client.h>
 #include <siri/err.h>
 #include <siri/net/protocol.h>
@@ -250,6 +251,8 @@ void sirinet__stream_free(uv_stream_t * uvclient)
     switch ((sirinet_stream_tp_t) client->tp)
     {
     case STREAM_API_CLIENT:
+        siri_api_free((siri_api_request_t *) client);
+        /* fall through */
     case STREAM_PIPE_CLIENT:
     case STREAM_TCP_CLIENT:  /* listens to client connections  */
         log_debug("Client connection lost");
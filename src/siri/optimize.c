@@ -13,6 +13,7 @@
 #include <logger/logger.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
+#include <siri/metrics.h>
 #include <siri/optimize.h>
 #include <siri/siri.h>
 #include <vec/vec.h>
@@ -27,6 +28,10 @@ static siri_optimize_t optimize = {
 
 static void OPTIMIZE_work(uv_work_t * work);
 static void OPTIMIZE_cleanup(vec_t * slsiridb);
+static void OPTIMIZE_drop_expired(
+        siridb_t * siridb,
+        vec_t * slshards,
+        uint64_t * expi);
 static void OPTIMIZE_work_finish(uv_work_t * work, int status);
 static void OPTIMIZE_cb(uv_timer_t * handle);
 
@@ -264,6 +269,8 @@ static void OPTIMIZE_work(uv_work_t * work  __attribute__((unused)))
     uint8_t c = siri.cfg->shard_compression;
     size_t i;
     uint64_t expi[2];
+    uint64_t start;
+    int rc;
 
     log_info("Start optimize task");
 
@@ -321,19 +328,13 @@ static void OPTIMIZE_work(uv_work_t * work  __attribute__((unused)))
 
         sleep(1);
 
+        OPTIMIZE_drop_expired(siridb, slshards, expi);
+
         for (j = 0; j < slshards->len; j++)
         {
             shard = (siridb_shard_t *) slshards->data[j];
 
-            if ((shard->id - shard->id % shard->duration) + shard->duration < expi[shard->tp])
-            {
-                log_info(
-                        "Shard id %" PRIu64 " (%" PRIu8 ") is expired "
-                        "and will be dropped",
-                        shard->id, shard->flags);
-                siridb_shard_drop(shard, siridb);
-            }
-            else if (!siri_err &&
+            if (!siri_err &&
                 optimize.status != SIRI_OPTIMIZE_CANCELLED &&
                 ((shard->flags & SIRIDB_SHARD_NEED_OPTIMIZE) ||
                     ((!(shard->flags & SIRIDB_SHARD_IS_COMPRESSED)) == c)) &&
@@ -341,7 +342,10 @@ static void OPTIMIZE_work(uv_work_t * work  __attribute__((unused)))
             {
                 log_info("Start optimizing shard id %" PRIu64 " (%" PRIu8 ")",
                         shard->id, shard->flags);
-                if (siridb_shard_optimize(shard, siridb) == 0)
+                start = hist_now();
+                rc = siridb_shard_optimize(shard, siridb);
+                siri_metrics_since(SIRI_METRICS_OPTIMIZE_SHARD, start);
+                if (rc == 0)
                 {
                     log_info("Finished optimizing shard id %" PRIu64,
                             shard->id);
@@ -390,6 +394,49 @@ static void OPTIMIZE_work(uv_work_t * work  __attribute__((unused)))
     OPTIMIZE_cleanup(slsiridb);
 }
 
+/*
+ * Drop all expired shards at once so the series are updated in a single
+ * pass. The shards in the list are flagged as removed afterwards.
+ */
+static void OPTIMIZE_drop_expired(
+        siridb_t * siridb,
+        vec_t * slshards,
+        uint64_t * expi)
+{
+    siridb_shard_t * shard;
+    vec_t * expired = vec_new(slshards->len);
+    size_t i;
+
+    if (expired == NULL)
+    {
+        ERR_ALLOC
+        return;
+    }
+
+    for (i = 0; i < slshards->len; i++)
+    {
+        shard = (siridb_shard_t *) slshards->data[i];
+
+        if ((shard->id - shard->id % shard->duration) + shard->duration <
+                expi[shard->tp])
+        {
+            log_info(
+                    "Shard id %" PRIu64 " (%" PRIu8 ") is expired "
+                    "and will be dropped",
+                    shard->id, shard->flags);
+            vec_append(expired, shard);
+        }
+    }
+
+    if (expired->len)
+    {
+        siridb_shard_drop_vec(expired, siridb);
+        log_info("Dropped %zu expired shard(s)", expired->len);
+    }
+
+    vec_free(expired);
+}
+
 static void OPTIMIZE_cleanup(vec_t * slsiridb)
 {
     if (slsiridb != NULL)
@@ -0,0 +1,228 @@
+/*
+ * prof.c - Sampling profiler which counts CPU time per query stage.
+ *
+ * The signal handler only uses atomic operations on a static table so it is
+ * async signal safe. Stages are identified by the address of their name
+ * which must be a string literal. A stage is claimed in the table by the
+ * first sample and is never removed while the profiler is running.
+ */
+#include <logger/logger.h>
+#include <signal.h>
+#include <siri/prof.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define PROF_OTHER "other"
+
+typedef struct
+{
+    const char * stage;
+    uint64_t n;
+} prof_slot_t;
+
+__thread const char * siri_prof_stage = NULL;
+
+static prof_slot_t prof__slots[SIRI_PROF_STAGES];
+static uint64_t prof__samples;
+static uint64_t prof__dropped;
+static uint32_t prof__hz;
+static int prof__installed;
+
+static void PROF_handler(int signum);
+static int PROF_cmp(const void * a, const void * b);
+
+/*
+ * Start the sampler at the given rate in samples per second of CPU time.
+ * When the sampler is already running, the rate is changed and the samples
+ * are kept.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siri_prof_start(uint32_t hz)
+{
+    struct itimerval timer;
+    long usec;
+
+    if (hz == 0 || hz > SIRI_PROF_HZ_MAX)
+    {
+        return -1;
+    }
+
+    if (!prof__installed)
+    {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(struct sigaction));
+        sa.sa_handler = PROF_handler;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+
+        /* the handler stays installed so a pending signal is harmless */
+        if (sigaction(SIGPROF, &sa, NULL))
+        {
+            log_error("Cannot install the SIGPROF handler");
+            return -1;
+        }
+        prof__installed = 1;
+    }
+
+    if (!prof__hz)
+    {
+        size_t i;
+        for (i = 0; i < SIRI_PROF_STAGES; i++)
+        {
+            __atomic_store_n(&prof__slots[i].n, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&prof__slots[i].stage, NULL, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&prof__samples, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&prof__dropped, 0, __ATOMIC_RELAXED);
+    }
+
+    usec = 1000000 / hz;
+    timer.it_interval.tv_sec = usec / 1000000;
+    timer.it_interval.tv_usec = usec % 1000000;
+    timer.it_value = timer.it_interval;
+
+    if (setitimer(ITIMER_PROF, &timer, NULL))
+    {
+        log_error("Cannot start the profiling timer");
+        return -1;
+    }
+
+    prof__hz = hz;
+    log_info("Sampling profiler started at %u Hz", hz);
+    return 0;
+}
+
+/*
+ * Stop the sampler. The samples are kept until the sampler starts again.
+ */
+void siri_prof_stop(void)
+{
+    struct itimerval timer;
+
+    if (!prof__hz)
+    {
+        return;
+    }
+
+    memset(&timer, 0, sizeof(struct itimerval));
+    (void) setitimer(ITIMER_PROF, &timer, NULL);
+
+    prof__hz = 0;
+    log_info("Sampling profiler stopped");
+}
+
+/*
+ * Add the sampler state and the samples per stage, ordered by the number of
+ * samples, as key/value pairs to an open map.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siri_prof_to_packer(qp_packer_t * packer)
+{
+    prof_slot_t * slots = malloc(sizeof(prof__slots));
+    size_t i, n = 0;
+    int rc;
+
+    if (slots == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < SIRI_PROF_STAGES; i++)
+    {
+        slots[n].stage = __atomic_load_n(
+                &prof__slots[i].stage,
+                __ATOMIC_RELAXED);
+        slots[n].n = __atomic_load_n(&prof__slots[i].n, __ATOMIC_RELAXED);
+        if (slots[n].stage != NULL && slots[n].n)
+        {
+            n++;
+        }
+    }
+
+    qsort(slots, n, sizeof(prof_slot_t), PROF_cmp);
+
+    rc = (  qp_add_string(packer, "sampler") ||
+            (prof__hz ? qp_add_true(packer) : qp_add_false(packer)) ||
+            qp_add_string(packer, "hz") ||
+            qp_add_int64(packer, prof__hz) ||
+            qp_add_string(packer, "samples") ||
+            qp_add_int64(packer, (int64_t) __atomic_load_n(
+                    &prof__samples,
+                    __ATOMIC_RELAXED)) ||
+            qp_add_string(packer, "dropped") ||
+            qp_add_int64(packer, (int64_t) __atomic_load_n(
+                    &prof__dropped,
+                    __ATOMIC_RELAXED)) ||
+            qp_add_string(packer, "stages") ||
+            qp_add_type(packer, QP_ARRAY_OPEN));
+
+    for (i = 0; !rc && i < n; i++)
+    {
+        rc = (  qp_add_type(packer, QP_ARRAY2) ||
+                qp_add_string(packer, slots[i].stage) ||
+                qp_add_int64(packer, (int64_t) slots[i].n));
+    }
+
+    free(slots);
+
+    return -(rc || qp_add_type(packer, QP_ARRAY_CLOSE));
+}
+
+static void PROF_handler(int signum __attribute__((unused)))
+{
+    const char * stage = siri_prof_stage;
+    const char * expected;
+    prof_slot_t * slot;
+    size_t i, n;
+
+    if (stage == NULL)
+    {
+        stage = PROF_OTHER;
+    }
+
+    __atomic_add_fetch(&prof__samples, 1, __ATOMIC_RELAXED);
+
+    i = ((uintptr_t) stage >> 3) % SIRI_PROF_STAGES;
+    for (n = 0; n < SIRI_PROF_STAGES; n++, i = (i + 1) % SIRI_PROF_STAGES)
+    {
+        slot = &prof__slots[i];
+        expected = __atomic_load_n(&slot->stage, __ATOMIC_RELAXED);
+
+        if (expected == NULL && !__atomic_compare_exchange_n(
+                &slot->stage,
+                &expected,
+                stage,
+                false,
+                __ATOMIC_RELAXED,
+                __ATOMIC_RELAXED))
+        {
+            /* another thread has claimed the slot, expected is updated */
+            if (expected != stage)
+            {
+                continue;
+            }
+        }
+        else if (expected != NULL && expected != stage)
+        {
+            continue;
+        }
+
+        __atomic_add_fetch(&slot->n, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_add_fetch(&prof__dropped, 1, __ATOMIC_RELAXED);
+}
+
+static int PROF_cmp(const void * a, const void * b)
+{
+    uint64_t na = ((const prof_slot_t *) a)->n;
+    uint64_t nb = ((const prof_slot_t *) b)->n;
+    return (na < nb) - (na > nb);
+}
@@ -86,6 +86,7 @@ int siri_service_client_request(
         uint16_t pid,
         uint16_t port,
         int pool,
+        int lookup_mode,
         uuid_t * uuid,
         qp_obj_t * host,
         qp_obj_t * username,
@@ -136,6 +137,7 @@ int siri_service_client_request(
     adm_client->request = CLIENT_REQUEST_INIT;
     adm_client->flags = 0;
     adm_client->pool = pool;
+    adm_client->lookup_mode = lookup_mode;
     memcpy(&adm_client->uuid, uuid, 16);
 
 
@@ -635,7 +637,9 @@ static void CLIENT_on_file_database(
         qp_exp_log,
         qp_exp_num,
         qp_tee_address,
-        qp_tee_port;
+        qp_tee_port,
+        qp_lookup_mode,
+        qp_prev_lookup_mode;
     siridb_t * siridb;
     int rc;
     /* 13 = strlen("database.dat")+1  */
@@ -711,6 +715,31 @@ static void CLIENT_on_file_database(
         qp_tee_port.via.int64 = SIRIDB_TEE_DEFAULT_TCP_PORT;
     }
 
+    if (qp_schema.via.int64 >= 8)
+    {
+        if (qp_next(&unpacker, &qp_lookup_mode) != QP_INT64 ||
+            qp_lookup_mode.via.int64 < 0 ||
+            qp_lookup_mode.via.int64 >= SIRIDB_LOOKUP_MODE_END)
+        {
+            CLIENT_err(adm_client, "invalid database file received");
+            return;
+        }
+    }
+    else
+    {
+        qp_lookup_mode.via.int64 = SIRIDB_LOOKUP_MODE_SUM;
+    }
+
+    /*
+     * A new pool can migrate the database to another lookup mode, the mode
+     * of the existing database is used for the previous lookup.
+     */
+    qp_prev_lookup_mode.via.int64 = qp_lookup_mode.via.int64;
+    if (adm_client->pool == -1 && adm_client->lookup_mode != -1)
+    {
+        qp_lookup_mode.via.int64 = adm_client->lookup_mode;
+    }
+
     if ((fpacker = qp_open(fn, "w")) == NULL)
     {
         CLIENT_err(adm_client, "cannot write or create file: %s", fn);
@@ -738,6 +767,8 @@ static void CLIENT_on_file_database(
                             qp_tee_address.len)
                     : qp_fadd_type(fpacker, QP_NULL)) ||
             qp_fadd_int64(fpacker, qp_tee_port.via.int64) ||
+            qp_fadd_int64(fpacker, qp_lookup_mode.via.int64) ||
+            qp_fadd_int64(fpacker, qp_prev_lookup_mode.via.int64) ||
             qp_fadd_type(fpacker, QP_ARRAY_CLOSE) ||
             qp_close(fpacker));
 
@@ -774,11 +805,12 @@ static void CLIENT_on_file_database(
 
     adm_client->request = CLIENT_REQUEST_REGISTER_SERVER;
 
-    if (qp_add_type(packer, QP_ARRAY4) ||
+    if (qp_add_type(packer, QP_ARRAY5) ||
         qp_add_raw(packer, (const unsigned char *) &adm_client->uuid, 16) ||
         qp_add_string(packer, siri.cfg->server_address) ||
         qp_add_int64(packer, (int64_t) siri.cfg->listen_backend_port) ||
-        qp_add_int64(packer, (int64_t) adm_client->pool))
+        qp_add_int64(packer, (int64_t) adm_client->pool) ||
+        qp_add_int64(packer, (int64_t) siridb->lookup_mode))
     {
         qp_packer_free(packer);
         CLIENT_err(adm_client, "memory allocation error");
@@ -7,6 +7,7 @@
 #include <logger/logger.h>
 #include <pcre2.h>
 #include <siri/db/buffer.h>
+#include <siri/db/lookup.h>
 #include <siri/db/reindex.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
@@ -14,6 +15,7 @@
 #include <siri/service/account.h>
 #include <siri/service/client.h>
 #include <siri/service/request.h>
+#include <siri/prof.h>
 #include <siri/siri.h>
 #include <siri/version.h>
 #include <stdbool.h>
@@ -42,7 +44,31 @@
 "# Buffer size in bytes. This size must be a multiple of 512 with a maximum\n" \
 "# of 1048576 bytes. Be careful using large values since SiriDB will require\n" \
 "# memory based on this value. A value between 1024 and 32768 is recommended.\n" \
-"# size = 1024\n"
+"# size = 1024\n" \
+"\n" \
+"[rollup]\n" \
+"# Comma separated intervals (s, m, h or d) for which the optimize task keeps\n" \
+"# count, sum, min and max buckets of numeric series. Aggregates with a\n" \
+"# group-by which is a multiple of an interval read these buckets instead of\n" \
+"# the points. Changing the tiers requires a restart.\n" \
+"# tiers = 5m,1h\n" \
+"\n" \
+"[tee]\n" \
+"# Maximum number of bytes which are queued for the tee (0 for no limit).\n" \
+"# max_queue = 67108864\n" \
+"\n" \
+"# Packages which do not fit in the queue are dropped. With drop_old the\n" \
+"# oldest queued packages are dropped instead to make room for new ones.\n" \
+"# policy = drop_new\n" \
+"\n" \
+"[ngram]\n" \
+"# Set to 1 to keep trigram filters for chunks of string series in memory.\n" \
+"# A select with filter() skips chunks which cannot match the filter.\n" \
+"# enabled = 0\n" \
+"\n" \
+"# Maximum number of bytes used by the filters. No new filters are created\n" \
+"# when this limit is reached.\n" \
+"# max_memory = 67108864\n"
 
 #define CHECK_DBNAME_AND_CREATE_PATH                                        \
     pcre_exec_ret = pcre2_match(                                            \
@@ -168,8 +194,16 @@ static cproto_server_t SERVICE_on_get_databases(
         qp_unpacker_t * qp_unpacker,
         qp_packer_t ** packaddr,
         char * err_msg);
+static cproto_server_t SERVICE_on_set_profiler(
+        qp_unpacker_t * qp_unpacker,
+        char * err_msg);
+static cproto_server_t SERVICE_on_get_profiler(
+        qp_unpacker_t * qp_unpacker,
+        qp_packer_t ** packaddr,
+        char * err_msg);
 static int8_t SERVICE_time_precision(qp_obj_t * qp_time_precision);
 static int64_t SERVICE_duration(qp_obj_t * qp_duration, uint8_t time_precision);
+static int SERVICE_lookup_mode(qp_obj_t * qp_lookup_mode, char * err_msg);
 static int SERVICE_list_databases(siridb_t * siridb, qp_packer_t * packer);
 static int SERVICE_find_database(siridb_t * siridb, qp_obj_t * dbname);
 static int SERVICE_list_accounts(
@@ -270,12 +304,16 @@ cproto_server_t siri_service_request(
                 err_msg);
     case SERVICE_DROP_DATABASE:
         return SERVICE_on_drop_database(qp_unpacker, err_msg);
+    case SERVICE_SET_PROFILER:
+        return SERVICE_on_set_profiler(qp_unpacker, err_msg);
     case SERVICE_GET_VERSION:
         return SERVICE_on_get_version(qp_unpacker, packaddr, err_msg);
     case SERVICE_GET_ACCOUNTS:
         return SERVICE_on_get_accounts(qp_unpacker, packaddr, err_msg);
     case SERVICE_GET_DATABASES:
         return SERVICE_on_get_databases(qp_unpacker, packaddr, err_msg);
+    case SERVICE_GET_PROFILER:
+        return SERVICE_on_get_profiler(qp_unpacker, packaddr, err_msg);
     default:
         return CPROTO_ERR_SERVICE_INVALID_REQUEST;
     }
@@ -553,10 +591,12 @@ static cproto_server_t SERVICE_on_new_database(
         qp_time_precision,
         qp_buffer_size,
         qp_duration_num,
-        qp_duration_log;
+        qp_duration_log,
+        qp_lookup_mode;
     size_t dbpath_len;
     int pcre_exec_ret;
     int rc;
+    int lookup_mode;
     struct stat st;
     int8_t time_precision;
     int64_t buffer_size, duration_num, duration_log;
@@ -578,6 +618,7 @@ static cproto_server_t SERVICE_on_new_database(
     qp_buffer_size.tp = QP_HOOK;
     qp_duration_num.tp = QP_HOOK;
     qp_duration_log.tp = QP_HOOK;
+    qp_lookup_mode.tp = QP_HOOK;
 
     if (!qp_is_map(qp_next(qp_unpacker, NULL)))
     {
@@ -626,6 +667,14 @@ static cproto_server_t SERVICE_on_new_database(
         {
             continue;
         }
+        if (    strncmp(
+                    (const char *) qp_key.via.raw,
+                    "lookup_mode",
+                    qp_key.len) == 0 &&
+                qp_next(qp_unpacker, &qp_lookup_mode) == QP_RAW)
+        {
+            continue;
+        }
         return CPROTO_ERR_SERVICE_INVALID_REQUEST;
     }
 
@@ -692,6 +741,14 @@ static cproto_server_t SERVICE_on_new_database(
         return CPROTO_ERR_SERVICE;
     }
 
+    lookup_mode = (qp_lookup_mode.tp == QP_HOOK) ?
+            SIRIDB_LOOKUP_MODE_DEFAULT :
+            SERVICE_lookup_mode(&qp_lookup_mode, err_msg);
+    if (lookup_mode == -1)
+    {
+        return CPROTO_ERR_SERVICE;
+    }
+
     CHECK_DBNAME_AND_CREATE_PATH
 
     sprintf(dbfn, "%s%s", dbpath, DB_DAT_FN);
@@ -725,6 +782,8 @@ static cproto_server_t SERVICE_on_new_database(
         qp_fadd_int64(fp, 0) ||
         qp_fadd_type(fp, QP_NULL) ||
         qp_fadd_int64(fp, SIRIDB_TEE_DEFAULT_TCP_PORT) ||
+        qp_fadd_int64(fp, lookup_mode) ||
+        qp_fadd_int64(fp, lookup_mode) ||
         qp_fadd_type(fp, QP_ARRAY_CLOSE))
     {
         rc = -1;
@@ -777,10 +836,12 @@ static cproto_server_t SERVICE_on_new_replica_or_pool(
         qp_host,
         qp_port,
         qp_username,
-        qp_password;
+        qp_password,
+        qp_lookup_mode;
     size_t dbpath_len;
     int pcre_exec_ret;
     int rc;
+    int lookup_mode;
     struct stat st;
     uint16_t port;
     uuid_t uuid;
@@ -801,6 +862,7 @@ static cproto_server_t SERVICE_on_new_replica_or_pool(
     qp_port.tp = QP_HOOK;
     qp_username.tp = QP_HOOK;
     qp_password.tp = QP_HOOK;
+    qp_lookup_mode.tp = QP_HOOK;
 
     if (!qp_is_map(qp_next(qp_unpacker, &qp_key)))
     {
@@ -851,6 +913,14 @@ static cproto_server_t SERVICE_on_new_replica_or_pool(
         {
             continue;
         }
+        if (    strncmp(
+                    (const char *) qp_key.via.raw,
+                    "lookup_mode",
+                    qp_key.len) == 0 &&
+                qp_next(qp_unpacker, &qp_lookup_mode) == QP_RAW)
+        {
+            continue;
+        }
 
         return CPROTO_ERR_SERVICE_INVALID_REQUEST;
     }
@@ -863,11 +933,21 @@ static cproto_server_t SERVICE_on_new_replica_or_pool(
         qp_host.tp == QP_HOOK ||
         qp_port.tp == QP_HOOK ||
         qp_username.tp == QP_HOOK ||
-        qp_password.tp == QP_HOOK)
+        qp_password.tp == QP_HOOK ||
+        /* the lookup mode can only change when a new pool is added */
+        (req == SERVICE_NEW_REPLICA && qp_lookup_mode.tp != QP_HOOK))
     {
         return CPROTO_ERR_SERVICE_INVALID_REQUEST;
     }
 
+    /* -1 = keep the lookup mode of the existing database */
+    lookup_mode = (qp_lookup_mode.tp == QP_HOOK) ?
+            -1 : SERVICE_lookup_mode(&qp_lookup_mode, err_msg);
+    if (qp_lookup_mode.tp != QP_HOOK && lookup_mode == -1)
+    {
+        return CPROTO_ERR_SERVICE;
+    }
+
     if (qp_port.via.int64 < 1 || qp_port.via.int64 > 65535)
     {
         sprintf(err_msg,
@@ -903,6 +983,7 @@ static cproto_server_t SERVICE_on_new_replica_or_pool(
             port,
             /* -1 = new pool  */
             (req == SERVICE_NEW_POOL) ? -1 : qp_pool.via.int64,
+            lookup_mode,
             &uuid,
             &qp_host,
             &qp_username,
@@ -998,6 +1079,132 @@ static cproto_server_t SERVICE_on_get_databases(
     return CPROTO_ERR_SERVICE;
 }
 
+/*
+ * Change the slow query threshold and start or stop the sampling profiler.
+ * All keys are optional:
+ *
+ *  {"slow_query_threshold": <ms>, "sampler": <bool>, "hz": <rate>}
+ *
+ * Returns CPROTO_ACK_SERVICE when successful.
+ * In case of an error CPROTO_ERR_SERVICE can be returned in which case err_msg
+ * is set, or CPROTO_ERR_SERVICE_INVALID_REQUEST is returned.
+ */
+static cproto_server_t SERVICE_on_set_profiler(
+        qp_unpacker_t * qp_unpacker,
+        char * err_msg)
+{
+    qp_obj_t qp_key, qp_threshold, qp_sampler, qp_hz;
+    qp_types_t tp;
+
+    qp_threshold.tp = QP_HOOK;
+    qp_sampler.tp = QP_HOOK;
+    qp_hz.tp = QP_HOOK;
+
+    if (!qp_is_map(qp_next(qp_unpacker, NULL)))
+    {
+        return CPROTO_ERR_SERVICE_INVALID_REQUEST;
+    }
+
+    while (qp_next(qp_unpacker, &qp_key) == QP_RAW)
+    {
+        if (    strncmp(
+                    (const char *) qp_key.via.raw,
+                    "slow_query_threshold",
+                    qp_key.len) == 0 &&
+                qp_next(qp_unpacker, &qp_threshold) == QP_INT64)
+        {
+            continue;
+        }
+        if (    strncmp(
+                    (const char *) qp_key.via.raw,
+                    "sampler",
+                    qp_key.len) == 0 &&
+                ((tp = qp_next(qp_unpacker, &qp_sampler)) == QP_TRUE ||
+                  tp == QP_FALSE))
+        {
+            continue;
+        }
+        if (    strncmp(
+                    (const char *) qp_key.via.raw,
+                    "hz",
+                    qp_key.len) == 0 &&
+                qp_next(qp_unpacker, &qp_hz) == QP_INT64)
+        {
+            continue;
+        }
+        return CPROTO_ERR_SERVICE_INVALID_REQUEST;
+    }
+
+    if (    qp_threshold.tp != QP_HOOK &&
+            (qp_threshold.via.int64 < 0 || qp_threshold.via.int64 > 3600000))
+    {
+        sprintf(err_msg,
+                "slow_query_threshold must be a value between 0 and 3600000");
+        return CPROTO_ERR_SERVICE;
+    }
+
+    if (    qp_hz.tp != QP_HOOK &&
+            (qp_hz.via.int64 < 1 || qp_hz.via.int64 > SIRI_PROF_HZ_MAX))
+    {
+        sprintf(err_msg,
+                "hz must be a value between 1 and %d", SIRI_PROF_HZ_MAX);
+        return CPROTO_ERR_SERVICE;
+    }
+
+    if (qp_threshold.tp != QP_HOOK)
+    {
+        siri.cfg->slow_query_threshold = (uint32_t) qp_threshold.via.int64;
+        log_info(
+                "Slow query threshold is set to %u milliseconds",
+                siri.cfg->slow_query_threshold);
+    }
+
+    if (qp_sampler.tp == QP_FALSE)
+    {
+        siri_prof_stop();
+    }
+    else if (   (qp_sampler.tp == QP_TRUE || qp_hz.tp != QP_HOOK) &&
+                siri_prof_start((qp_hz.tp == QP_HOOK)
+                    ? SIRI_PROF_HZ_DEFAULT
+                    : (uint32_t) qp_hz.via.int64))
+    {
+        sprintf(err_msg, "cannot start the sampling profiler");
+        return CPROTO_ERR_SERVICE;
+    }
+
+    return CPROTO_ACK_SERVICE;
+}
+
+/*
+ * Returns CPROTO_ACK_SERVICE_DATA when successful.
+ * In case of an error CPROTO_ERR_SERVICE will be returned and err_msg is set
+ */
+static cproto_server_t SERVICE_on_get_profiler(
+        qp_unpacker_t * qp_unpacker __attribute__((unused)),
+        qp_packer_t ** packaddr,
+        char * err_msg)
+{
+    qp_packer_t * packer = sirinet_packer_new(1024);
+
+    if (packer != NULL)
+    {
+        if (!qp_add_type(packer, QP_MAP_OPEN) &&
+            !qp_add_string(packer, "slow_query_threshold") &&
+            !qp_add_int64(packer, siri.cfg->slow_query_threshold) &&
+            !siri_prof_to_packer(packer) &&
+            !qp_add_type(packer, QP_MAP_CLOSE))
+        {
+            *packaddr = packer;
+            return CPROTO_ACK_SERVICE_DATA;
+        }
+
+        /* error, free packer */
+        qp_packer_free(packer);
+    }
+    sprintf(err_msg, "memory allocation error");
+    return CPROTO_ERR_SERVICE;
+}
+
 void siri_service_request_rollback(const char * dbpath)
 {
     size_t dbpath_len = strlen(dbpath);
@@ -1112,3 +1319,22 @@ static void SERVICE_on_drop_database_cb(
         }
     }
 }
+
+/*
+ * Returns the lookup mode or -1 and sets err_msg in case of an invalid mode.
+ */
+static int SERVICE_lookup_mode(qp_obj_t * qp_lookup_mode, char * err_msg)
+{
+    int mode = siridb_lookup_mode_by_name(
+            (const char *) qp_lookup_mode->via.raw,
+            qp_lookup_mode->len);
+    if (mode == -1)
+    {
+        snprintf(err_msg,
+                SIRI_MAX_SIZE_ERR_MSG,
+                "invalid lookup mode: '%.*s' (expecting 'sum' or 'xxh64')",
+                (int) qp_lookup_mode->len,
+                qp_lookup_mode->via.raw);
+    }
+    return mode;
+}
@@ -0,0 +1,206 @@
+/*
+ * slab.c - Slab allocator for fixed size items.
+ */
+#include <slab/slab.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int SLAB_grow(slab_t * slab);
+
+/*
+ * Returns NULL in case an error has occurred.
+ */
+slab_t * slab_new(size_t item_sz)
+{
+    slab_t * slab = (slab_t *) malloc(sizeof(slab_t));
+    if (slab == NULL)
+    {
+        return NULL;
+    }
+
+    /* released items are used to store the free list */
+    if (item_sz < sizeof(void *))
+    {
+        item_sz = sizeof(void *);
+    }
+
+    /* keep items aligned */
+    slab->item_sz = (item_sz + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    slab->len = 0;
+    slab->pos = 0;
+    slab->nchunks = 0;
+    slab->chunk = NULL;
+    slab->free_list = NULL;
+
+    return slab;
+}
+
+/*
+ * Destroy the slab and all items at once. Parsing NULL is allowed.
+ */
+void slab_free(slab_t * slab)
+{
+    if (slab != NULL)
+    {
+        slab_chunk_t * chunk = slab->chunk;
+        while (chunk != NULL)
+        {
+            slab_chunk_t * next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(slab);
+    }
+}
+
+/*
+ * Returns an uninitialized item or NULL in case of an error.
+ */
+void * slab_alloc(slab_t * slab)
+{
+    void * item;
+
+    if (slab->free_list != NULL)
+    {
+        item = slab->free_list;
+        slab->free_list = *((void **) item);
+    }
+    else
+    {
+        if ((slab->chunk == NULL || slab->pos == slab->chunk->n) &&
+            SLAB_grow(slab))
+        {
+            return NULL;
+        }
+        item = slab->chunk->data + slab->pos * slab->item_sz;
+        slab->pos++;
+    }
+
+    slab->len++;
+    return item;
+}
+
+/*
+ * Returns a zero initialized item or NULL in case of an error.
+ */
+void * slab_calloc(slab_t * slab)
+{
+    void * item = slab_alloc(slab);
+    if (item != NULL)
+    {
+        memset(item, 0, slab->item_sz);
+    }
+    return item;
+}
+
+/*
+ * Release an item so it can be re-used. Parsing NULL is allowed.
+ */
+void slab_release(slab_t * slab, void * item)
+{
+    if (item != NULL)
+    {
+        *((void **) item) = slab->free_list;
+        slab->free_list = item;
+        slab->len--;
+    }
+}
+
+/*
+ * Move all items from 'slab' to 'dest' and destroy 'slab'. Both slabs must
+ * have the same item size. Items allocated from 'slab' are owned by 'dest'
+ * when this function returns.
+ */
+void slab_merge(slab_t * dest, slab_t * slab)
+{
+    slab_chunk_t * chunk = slab->chunk;
+
+    if (chunk != NULL)
+    {
+        /* make unused items in the current chunk available */
+        for (; slab->pos < chunk->n; slab->pos++)
+        {
+            void * item = chunk->data + slab->pos * slab->item_sz;
+            *((void **) item) = slab->free_list;
+            slab->free_list = item;
+        }
+
+        while (chunk->next != NULL)
+        {
+            chunk = chunk->next;
+        }
+
+        if (dest->chunk == NULL)
+        {
+            /* the current chunk is full so the next alloc creates a chunk */
+            dest->chunk = slab->chunk;
+            dest->pos = slab->chunk->n;
+        }
+        else
+        {
+            /* keep the current chunk of 'dest' on top */
+            chunk->next = dest->chunk->next;
+            dest->chunk->next = slab->chunk;
+        }
+
+        if (slab->free_list != NULL)
+        {
+            void ** item = (void **) slab->free_list;
+            while (*item != NULL)
+            {
+                item = (void **) *item;
+            }
+            *item = dest->free_list;
+            dest->free_list = slab->free_list;
+        }
+
+        dest->len += slab->len;
+        dest->nchunks += slab->nchunks;
+    }
+
+    free(slab);
+}
+
+/*
+ * Returns the number of bytes allocated by the slab.
+ */
+size_t slab_size(slab_t * slab)
+{
+    size_t size = sizeof(slab_t);
+    slab_chunk_t * chunk;
+    for (chunk = slab->chunk; chunk != NULL; chunk = chunk->next)
+    {
+        size += sizeof(slab_chunk_t) + chunk->n * slab->item_sz;
+    }
+    return size;
+}
+
+/*
+ * Add a new chunk. Each chunk is twice the size of the previous one until
+ * SLAB_CHUNK_MAX is reached.
+ */
+static int SLAB_grow(slab_t * slab)
+{
+    slab_chunk_t * chunk;
+    size_t n = SLAB_CHUNK_MIN << (slab->nchunks < 16 ? slab->nchunks : 16);
+    size_t max = SLAB_CHUNK_MAX / slab->item_sz;
+
+    if (n > max)
+    {
+        n = max > SLAB_CHUNK_MIN ? max : SLAB_CHUNK_MIN;
+    }
+
+    chunk = (slab_chunk_t *) malloc(sizeof(slab_chunk_t) + n * slab->item_sz);
+    if (chunk == NULL)
+    {
+        return -1;
+    }
+
+    chunk->n = n;
+    chunk->next = slab->chunk;
+    slab->chunk = chunk;
+    slab->pos = 0;
+    slab->nchunks++;
+
+    return 0;
+}
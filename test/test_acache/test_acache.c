@@ -0,0 +1,287 @@
+#include "../test.h"
+#include <siri/db/acache.h>
+#include <siri/db/aggregate.h>
+#include <siri/db/points.h>
+
+#define SIRIDB_MAX_SIZE_ERR_MSG 1024
+
+static char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+
+static siridb_points_t * get_points(
+        siridb_points_t * source,
+        uint64_t start_ts,
+        uint64_t end_ts)
+{
+    siridb_points_t * points = siridb_points_new(source->len, source->tp);
+    size_t i;
+    for (i = 0; i < source->len; i++)
+    {
+        siridb_point_t * point = source->data + i;
+        if (point->ts >= start_ts && point->ts < end_ts)
+        {
+            siridb_points_add_point(points, &point->ts, &point->val);
+        }
+    }
+    return points;
+}
+
+static siridb_points_t * aggregate(
+        siridb_points_t * points,
+        siridb_aggr_t * aggr)
+{
+    siridb_points_t * aggrp;
+    if (!points->len)
+    {
+        return points;
+    }
+    aggrp = siridb_aggregate_run(points, aggr, err_msg);
+    _assert (aggrp != NULL && aggrp != points);
+    siridb_points_free(points);
+    return aggrp;
+}
+
+static int equal(siridb_points_t * a, siridb_points_t * b)
+{
+    size_t i;
+    if (a->len != b->len)
+    {
+        return 0;
+    }
+    for (i = 0; i < a->len; i++)
+    {
+        if (    a->data[i].ts != b->data[i].ts ||
+                a->data[i].val.int64 != b->data[i].val.int64)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static siridb_points_t * prepare_points(void)
+{
+    siridb_points_t * points = siridb_points_new(400, TP_INT);
+    uint64_t ts;
+    qp_via_t val;
+    unsigned int i;
+
+    for (i = 0; i < 400; i++)
+    {
+        ts = 1000 + i * 3 + (i % 5);
+        val.int64 = (i * 7919) % 101;
+        siridb_points_add_point(points, &ts, &val);
+    }
+
+    return points;
+}
+
+static siridb_aggr_t * new_aggr(uint32_t gid, uint64_t group_by)
+{
+    static siridb_aggr_t aggr;
+    aggr.gid = gid;
+    aggr.group_by = group_by;
+    aggr.limit = 0;
+    aggr.offset = 0;
+    aggr.timespan = 1.0;
+    aggr.percentile = 0.0;
+    return &aggr;
+}
+
+static int test_window(void)
+{
+    test_start("acache (window)");
+
+    uint64_t a, b;
+    siridb_aggr_t * aggr = new_aggr(CLERI_GID_F_SUM, 10);
+
+    _assert (siridb_acache_window(aggr, 15, 45, &a, &b) == 0);
+    _assert (a == 20 && b == 40);
+    _assert (siridb_acache_window(aggr, 20, 41, &a, &b) == 0);
+    _assert (a == 20 && b == 40);
+    _assert (siridb_acache_window(aggr, 20, 40, &a, &b) == 0);
+    _assert (a == 20 && b == 30);
+    _assert (siridb_acache_window(aggr, 15, 30, &a, &b) == -1);
+    _assert (siridb_acache_window(aggr, 30, 30, &a, &b) == -1);
+
+    aggr->offset = 5;
+    _assert (siridb_acache_window(aggr, 15, 45, &a, &b) == -1);
+
+    return test_end();
+}
+
+static int test_split(void)
+{
+    test_start("acache (split)");
+
+    siridb_init_aggregates();
+
+    uint32_t gids[4] = {
+            CLERI_GID_F_SUM,
+            CLERI_GID_F_COUNT,
+            CLERI_GID_F_MAX,
+            CLERI_GID_F_FIRST};
+    uint64_t windows[4][2] = {
+            {1003, 2003},
+            {1010, 1990},
+            {1001, 2201},
+            {1500, 1751}};
+    siridb_points_t * source = prepare_points();
+    siridb_acache_t * acache = siridb_acache_new(1024 * 1024);
+    size_t g, w;
+
+    for (g = 0; g < 4; g++)
+    {
+        for (w = 0; w < 4; w++)
+        {
+            uint64_t a, b, start = windows[w][0], end = windows[w][1];
+            siridb_aggr_t * aggr = new_aggr(gids[g], 7 + w * 11);
+            siridb_points_t * full, * head, * tail, * cached, * split;
+
+            _assert (siridb_acache_window(aggr, start, end, &a, &b) == 0);
+            _assert (siridb_acache_get(acache, 1, aggr, a, b) == NULL);
+
+            full = aggregate(get_points(source, start, end), aggr);
+            _assert (siridb_acache_put(acache, 1, aggr, a, b, full, 0) == 0);
+
+            cached = siridb_acache_get(acache, 1, aggr, a, b);
+            _assert (cached != NULL);
+
+            head = aggregate(get_points(source, start, a + 1), aggr);
+            tail = aggregate(get_points(source, b + 1, end), aggr);
+
+            split = siridb_points_new(
+                    head->len + cached->len + tail->len,
+                    full->tp);
+            memcpy(split->data, head->data,
+                    head->len * sizeof(siridb_point_t));
+            memcpy(split->data + head->len, cached->data,
+                    cached->len * sizeof(siridb_point_t));
+            memcpy(split->data + head->len + cached->len, tail->data,
+                    tail->len * sizeof(siridb_point_t));
+            split->len = head->len + cached->len + tail->len;
+
+            _assert (equal(full, split));
+
+            siridb_points_free(full);
+            siridb_points_free(head);
+            siridb_points_free(tail);
+            siridb_points_free(split);
+        }
+    }
+
+    _assert (acache->hits == 16);
+    _assert (acache->misses == 16);
+
+    siridb_acache_free(acache);
+    siridb_points_free(source);
+
+    return test_end();
+}
+
+static int test_invalidate(void)
+{
+    test_start("acache (invalidate)");
+
+    siridb_points_t * points = siridb_points_new(1, TP_INT);
+    siridb_aggr_t * aggr = new_aggr(CLERI_GID_F_SUM, 10);
+    siridb_acache_t * acache = siridb_acache_new(1024 * 1024);
+
+    _assert (siridb_acache_put(acache, 1, aggr, 20, 40, points, 0) == 0);
+    _assert (siridb_acache_put(acache, 1, aggr, 40, 60, points, 0) == 0);
+    _assert (siridb_acache_put(acache, 2, aggr, 20, 40, points, 0) == 0);
+    _assert (siridb_acache_put(acache, 2, aggr, 20, 40, points, 0) == -1);
+
+    /* points outside the windows */
+    siridb_acache_touch(acache, 1, 10, 20);
+    siridb_acache_touch(acache, 1, 61, 70);
+    siridb_acache_touch(acache, 3, 30, 30);
+    _assert (siridb_acache_get(acache, 1, aggr, 20, 40) != NULL);
+    _assert (siridb_acache_get(acache, 1, aggr, 40, 60) != NULL);
+
+    /* a point at the end of the first window */
+    siridb_acache_touch(acache, 1, 40, 40);
+    _assert (siridb_acache_get(acache, 1, aggr, 20, 40) == NULL);
+    _assert (siridb_acache_get(acache, 1, aggr, 40, 60) != NULL);
+    _assert (siridb_acache_get(acache, 2, aggr, 20, 40) != NULL);
+
+    /* another aggregate is another entry */
+    aggr->gid = CLERI_GID_F_MAX;
+    _assert (siridb_acache_get(acache, 1, aggr, 40, 60) == NULL);
+    aggr->gid = CLERI_GID_F_SUM;
+    aggr->percentile = 99.0;
+    _assert (siridb_acache_get(acache, 1, aggr, 40, 60) == NULL);
+    aggr->percentile = 0.0;
+
+    /* a dropped shard expires all entries */
+    siridb_acache_expire(acache);
+    _assert (siridb_acache_get(acache, 1, aggr, 40, 60) == NULL);
+    _assert (siridb_acache_get(acache, 2, aggr, 20, 40) == NULL);
+    _assert (acache->series->len == 0);
+    _assert (acache->size == 0);
+
+    /* points read before a shard was dropped */
+    _assert (siridb_acache_put(acache, 1, aggr, 20, 40, points, 0) == 0);
+    _assert (siridb_acache_get(acache, 1, aggr, 20, 40) == NULL);
+    _assert (siridb_acache_put(acache, 1, aggr, 20, 40, points,
+            siridb_acache_generation(acache)) == 0);
+    _assert (siridb_acache_get(acache, 1, aggr, 20, 40) != NULL);
+
+    siridb_acache_free(acache);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+static int test_budget(void)
+{
+    test_start("acache (budget)");
+
+    siridb_points_t * points = siridb_points_new(100, TP_INT);
+    siridb_aggr_t * aggr = new_aggr(CLERI_GID_F_SUM, 10);
+    siridb_acache_t * acache;
+    size_t entry_size;
+    uint64_t ts;
+    qp_via_t val;
+    uint32_t id;
+
+    for (ts = 1; ts <= 100; ts++)
+    {
+        val.int64 = ts;
+        siridb_points_add_point(points, &ts, &val);
+    }
+
+    entry_size =
+            sizeof(siridb_acache_entry_t) +
+            sizeof(siridb_points_t) +
+            sizeof(siridb_point_t) * 100;
+    acache = siridb_acache_new(entry_size * 3);
+
+    for (id = 1; id <= 4; id++)
+    {
+        _assert (siridb_acache_put(acache, id, aggr, 0, 100, points, 0) == 0);
+    }
+
+    _assert (acache->size == entry_size * 3);
+    _assert (siridb_acache_get(acache, 1, aggr, 0, 100) == NULL);
+    _assert (siridb_acache_get(acache, 2, aggr, 0, 100) != NULL);
+
+    /* 2 is now most recently used, so 3 will be dropped */
+    _assert (siridb_acache_put(acache, 5, aggr, 0, 100, points, 0) == 0);
+    _assert (siridb_acache_get(acache, 3, aggr, 0, 100) == NULL);
+    _assert (siridb_acache_get(acache, 2, aggr, 0, 100)->len == 100);
+
+    siridb_acache_free(acache);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_window() ||
+        test_split() ||
+        test_invalidate() ||
+        test_budget()
+    );
+}
@@ -2,6 +2,7 @@
 #include "../test.h"
 #include <siri/db/points.h>
 #include <siri/db/aggregate.h>
+#include <siri/db/tdigest.h>
 
 
 #define SIRIDB_MAX_SIZE_ERR_MSG 1024
@@ -10,6 +11,12 @@ static siridb_aggr_t aggr;
 static char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
 
 
+static int cmp_double(const void * a, const void * b)
+{
+    double da = *((const double *) a), db = *((const double *) b);
+    return (da > db) - (da < db);
+}
+
 static siridb_points_t * prepare_points(void)
 {
     siridb_points_t * points = siridb_points_new(10, TP_INT);
@@ -368,6 +375,229 @@ static int test_variance(void)
     return test_end();
 }
 
+static int test_percentile(void)
+{
+    test_start("aggr (percentile)");
+
+    siridb_points_t * aggrp, * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_PERCENTILE;
+    aggr.group_by = 7;
+    aggr.limit = 0;
+    aggr.offset = 0;
+    aggr.percentile = 50.0;
+
+    /* small groups are exact and equal to median */
+    aggrp = siridb_aggregate_run(points, &aggr, err_msg);
+
+    _assert (aggrp != NULL);
+    _assert (aggrp->len == 4);
+    _assert (aggrp->tp == TP_DOUBLE);
+    _assert (aggrp->data->ts == 7 && aggrp->data->val.real == 1.0);
+    _assert ((aggrp->data + 1)->ts == 14 &&
+            (aggrp->data + 1)->val.real == 3.5);
+
+    siridb_points_free(aggrp);
+
+    aggr.percentile = 90.0;
+    aggrp = siridb_aggregate_run(points, &aggr, err_msg);
+
+    _assert (aggrp != NULL);
+    _assert (aggrp->len == 4);
+    _assert (fabs(aggrp->data->val.real - 2.6) < 1e-9);
+    _assert (fabs((aggrp->data + 1)->val.real - 6.8) < 1e-9);
+
+    siridb_points_free(aggrp);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+static int test_percentile_merge(void)
+{
+    test_start("aggr (percentile merge)");
+
+    const size_t n = 100000, npools = 4;
+    const double qs[5] = {0.01, 0.25, 0.5, 0.95, 0.99};
+    siridb_points_t * aggrp, * points[npools];
+    siridb_tdigest_t * tdigest;
+    vec_t * tdigests = vec_new(npools);
+    double * sorted = malloc(n * sizeof(double));
+    uint64_t seed = 42;
+    qp_packer_t * packer;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_tp, qp_len, qp_raw;
+    size_t i, j, rank;
+    qp_via_t val;
+
+    siridb_init_aggregates();
+
+    for (i = 0; i < npools; i++)
+    {
+        points[i] = siridb_points_new(n / npools, TP_DOUBLE);
+    }
+
+    /* skewed values spread over the pools, like series on pools */
+    for (i = 0; i < n; i++)
+    {
+        uint64_t ts = i / npools;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        val.real = exp((double) (seed >> 11) / (double) (1ULL << 53) * 8.0);
+        sorted[i] = val.real;
+        siridb_points_add_point(points[i % npools], &ts, &val);
+    }
+
+    qsort(sorted, n, sizeof(double), cmp_double);
+
+    aggr.gid = CLERI_GID_F_PERCENTILE;
+    aggr.group_by = 0;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    /* each pool packs its digest and the master unpacks */
+    for (i = 0; i < npools; i++)
+    {
+        vec_t * local = vec_new(1);
+
+        _assert (siridb_aggregate_tdigests(
+                &local, points[i], &aggr, err_msg) == 0);
+        _assert (local->len == 1);
+        tdigest = local->data[0];
+        _assert (tdigest->len <= TDIGEST_DELTA + 1);
+
+        packer = qp_packer_new(1024);
+        _assert (siridb_tdigest_pack(local, packer) == 0);
+
+        qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+        _assert (qp_is_array(qp_next(&unpacker, NULL)));
+        _assert (qp_is_int(qp_next(&unpacker, &qp_tp)));
+        _assert (qp_tp.via.int64 == TDIGEST_RAW_TP);
+        _assert (qp_is_int(qp_next(&unpacker, &qp_len)));
+        _assert (qp_is_raw(qp_next(&unpacker, &qp_raw)));
+        _assert (siridb_tdigest_unpack(
+                &tdigests, qp_raw.via.raw, qp_raw.len) == 1);
+
+        qp_packer_free(packer);
+        vec_destroy(local, (vec_destroy_cb) siridb_tdigest_free);
+    }
+
+    for (j = 0; j < 5; j++)
+    {
+        aggr.percentile = qs[j] * 100.0;
+
+        _assert (siridb_aggregate_tdigests_reduce(
+                tdigests, &aggr, err_msg) == 0);
+        _assert (tdigests->len == 1);
+        tdigest = tdigests->data[0];
+        _assert (tdigest->n == (double) n);
+        _assert (tdigest->ts == n / npools - 1);
+        _assert (tdigest->len <= TDIGEST_DELTA + 1);
+
+        /* rank error within the documented bound */
+        val.real = siridb_tdigest_quantile(tdigest, qs[j]);
+        for (rank = 0; rank < n && sorted[rank] <= val.real; rank++);
+        _assert (fabs((double) rank / n - qs[j]) <=
+                M_PI * sqrt(qs[j] * (1.0 - qs[j])) / TDIGEST_DELTA + 1e-3);
+    }
+
+    /* the merge result is the same as for the merged points */
+    aggr.percentile = 50.0;
+    aggrp = siridb_aggregate_tdigests_points(tdigests, &aggr, err_msg);
+    _assert (aggrp != NULL && aggrp->len == 1);
+    _assert (aggrp->data->val.real ==
+            siridb_tdigest_quantile(tdigests->data[0], 0.5));
+    siridb_points_free(aggrp);
+
+    vec_destroy(tdigests, (vec_destroy_cb) siridb_tdigest_free);
+    for (i = 0; i < npools; i++)
+    {
+        siridb_points_free(points[i]);
+    }
+    free(sorted);
+
+    return test_end();
+}
+
+static int test_stream(void)
+{
+    test_start("aggr (stream)");
+
+    uint32_t gids[] = {
+        CLERI_GID_F_COUNT,
+        CLERI_GID_F_MAX,
+        CLERI_GID_F_MEAN,
+        CLERI_GID_F_MEDIAN,
+        CLERI_GID_F_SUM,
+        CLERI_GID_F_LAST,
+    };
+    uint64_t group_by[] = {1, 4, 6, 100};
+    size_t chunk_sz[] = {1, 3, 10};
+    siridb_aggr_stream_t stream;
+    siridb_points_t chunk;
+    siridb_points_t * aggrp, * streamp, * points = prepare_points();
+    size_t g, b, c, i;
+
+    chunk.tp = points->tp;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    for (g = 0; g < sizeof(gids) / sizeof(uint32_t); g++)
+    {
+        aggr.gid = gids[g];
+        for (b = 0; b < sizeof(group_by) / sizeof(uint64_t); b++)
+        {
+            aggr.group_by = group_by[b];
+            _assert (siridb_aggregate_can_stream(&aggr));
+
+            aggrp = siridb_aggregate_run(points, &aggr, err_msg);
+            _assert (aggrp != NULL);
+
+            /* the result does not depend on how points are split in chunks */
+            for (c = 0; c < sizeof(chunk_sz) / sizeof(size_t); c++)
+            {
+                _assert (siridb_aggregate_stream_init(
+                        &stream,
+                        &aggr,
+                        points->tp,
+                        err_msg) == 0);
+
+                for (i = 0; i < points->len; i += chunk_sz[c])
+                {
+                    chunk.data = points->data + i;
+                    chunk.len = (i + chunk_sz[c] > points->len) ?
+                            points->len - i : chunk_sz[c];
+                    _assert (siridb_aggregate_stream_feed(
+                            &stream,
+                            &chunk) == 0);
+                }
+
+                _assert (stream.n == points->len);
+                streamp = siridb_aggregate_stream_finish(&stream);
+
+                _assert (streamp != NULL);
+                _assert (streamp->tp == aggrp->tp);
+                _assert (streamp->len == aggrp->len);
+                _assert (memcmp(
+                        streamp->data,
+                        aggrp->data,
+                        aggrp->len * sizeof(siridb_point_t)) == 0);
+
+                siridb_points_free(streamp);
+            }
+
+            siridb_points_free(aggrp);
+        }
+    }
+
+    /* a limit needs all points */
+    aggr.limit = 3;
+    _assert (!siridb_aggregate_can_stream(&aggr));
+
+    siridb_points_free(points);
+
+    return test_end();
+}
+
 int main()
 {
     return (
@@ -384,6 +614,9 @@ int main()
         test_stddev() ||
         test_sum() ||
         test_variance() ||
+        test_percentile() ||
+        test_percentile_merge() ||
+        test_stream() ||
         0
     );
 }
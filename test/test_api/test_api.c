@@ -0,0 +1,250 @@
+#include "../test.h"
+#include <llist/llist.h>
+#include <logger/logger.h>
+#include <siri/api.h>
+#include <siri/cfg/cfg.h>
+#include <siri/net/tcp.h>
+#include <siri/siri.h>
+#include <uv.h>
+
+#define TEST_API_PORT 19020
+#define TEST_API_CHUNK 7        /* bytes per write for split requests */
+#define TEST_RESP_SZ 4096
+
+/*
+ * A client on the same loop as the HTTP API. The requests are written and
+ * all data is read until the server closes the connection, so each test
+ * must end with a request which closes the connection.
+ */
+typedef struct
+{
+    uv_tcp_t tcp;
+    uv_connect_t connect;
+    const char * request;
+    size_t chunk;
+    size_t len;
+    int done;
+    char resp[TEST_RESP_SZ];
+} api_client_t;
+
+static void api_alloc_cb(
+        uv_handle_t * handle,
+        size_t sugsz __attribute__((unused)),
+        uv_buf_t * buf)
+{
+    api_client_t * client = handle->data;
+    buf->base = client->resp + client->len;
+    buf->len = TEST_RESP_SZ - 1 - client->len;
+}
+
+static void api_close_cb(uv_handle_t * handle)
+{
+    api_client_t * client = handle->data;
+    client->done = 1;
+}
+
+static void api_read_cb(
+        uv_stream_t * stream,
+        ssize_t n,
+        const uv_buf_t * buf __attribute__((unused)))
+{
+    api_client_t * client = stream->data;
+
+    if (n < 0)
+    {
+        uv_close((uv_handle_t *) stream, api_close_cb);
+        return;
+    }
+    client->len += (size_t) n;
+    client->resp[client->len] = '\0';
+}
+
+static void api_write_cb(uv_write_t * req, int status __attribute__((unused)))
+{
+    free(req);
+}
+
+static void api_connect_cb(uv_connect_t * req, int status)
+{
+    api_client_t * client = req->data;
+    size_t n, len = strlen(client->request);
+    const char * pt;
+    uv_write_t * w;
+    uv_buf_t buf;
+
+    if (status)
+    {
+        uv_close((uv_handle_t *) &client->tcp, api_close_cb);
+        return;
+    }
+
+    for (pt = client->request; len; pt += n, len -= n)
+    {
+        n = len < client->chunk ? len : client->chunk;
+        w = malloc(sizeof(uv_write_t));
+        buf = uv_buf_init((char *) pt, n);
+        (void) uv_write(w, (uv_stream_t *) &client->tcp, &buf, 1,
+                api_write_cb);
+    }
+    (void) uv_read_start((uv_stream_t *) &client->tcp, api_alloc_cb,
+            api_read_cb);
+}
+
+static const char * api_request(
+        api_client_t * client,
+        const char * request,
+        size_t chunk)
+{
+    struct sockaddr_in addr;
+
+    memset(client, 0, sizeof(api_client_t));
+    client->request = request;
+    client->chunk = chunk;
+    client->tcp.data = client;
+    client->connect.data = client;
+
+    (void) uv_ip4_addr("127.0.0.1", TEST_API_PORT, &addr);
+    (void) uv_tcp_init(siri.loop, &client->tcp);
+    (void) uv_tcp_connect(
+            &client->connect,
+            &client->tcp,
+            (const struct sockaddr *) &addr,
+            api_connect_cb);
+
+    while (!client->done)
+    {
+        (void) uv_run(siri.loop, UV_RUN_ONCE);
+    }
+
+    /* let the server close the connection */
+    (void) uv_run(siri.loop, UV_RUN_NOWAIT);
+
+    return client->resp;
+}
+
+#define RESP_404 \
+    "HTTP/1.1 404 Not Found\r\n" \
+    "Content-Type: text/plain\r\n" \
+    "Content-Length: 11\r\n"
+#define RESP_405 \
+    "HTTP/1.1 405 Method Not Allowed\r\n" \
+    "Content-Type: text/plain\r\n" \
+    "Content-Length: 20\r\n"
+#define RESP_401 \
+    "HTTP/1.1 401 Unauthorized\r\n" \
+    "Content-Type: text/plain\r\n" \
+    "Content-Length: 14\r\n"
+#define BODY_404 "\r\nNOT FOUND\r\n"
+#define BODY_405 "\r\nMETHOD NOT ALLOWED\r\n"
+#define BODY_401 "\r\nUNAUTHORIZED\r\n"
+#define CONN_CLOSE "Connection: close\r\n"
+
+static const char * pipelined =
+        "GET /unknown HTTP/1.1\r\n"
+        "Host: localhost\r\n\r\n"
+        "GET /query/dbtest HTTP/1.1\r\n"
+        "Host: localhost\r\n\r\n"
+        "POST /query/dbtest HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Content-Length: 4\r\n\r\n"
+        "test"
+        "POST /get-version HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Content-Length: 0\r\n\r\n"
+        "GET /get-version HTTP/1.1\r\n"
+        "Host: localhost\r\n\r\n"
+        "GET /unknown HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Connection: close\r\n\r\n"
+        "GET /get-version HTTP/1.1\r\n"
+        "Host: localhost\r\n\r\n";
+
+static const char * pipelined_resp =
+        RESP_404 BODY_404
+        RESP_405 BODY_405
+        RESP_404 BODY_404
+        RESP_405 BODY_405
+        RESP_401 BODY_401
+        RESP_404 CONN_CLOSE BODY_404;
+
+static int test_pipelined(api_client_t * client)
+{
+    test_start("api (pipelined)");
+
+    /* all requests in one read, the last request is ignored */
+    _assert (strcmp(
+            api_request(client, pipelined, strlen(pipelined)),
+            pipelined_resp) == 0);
+
+    /* requests split over multiple reads */
+    _assert (strcmp(
+            api_request(client, pipelined, TEST_API_CHUNK),
+            pipelined_resp) == 0);
+
+    return test_end();
+}
+
+static int test_connection_close(api_client_t * client)
+{
+    test_start("api (connection close)");
+
+    _assert (strcmp(api_request(client,
+            "GET /unknown HTTP/1.1\r\n"
+            "Connection: close\r\n\r\n"
+            "GET /unknown HTTP/1.1\r\n\r\n", 1024),
+            RESP_404 CONN_CLOSE BODY_404) == 0);
+
+    /* HTTP/1.0 closes unless keep-alive is asked for */
+    _assert (strcmp(api_request(client,
+            "GET /unknown HTTP/1.0\r\n\r\n"
+            "GET /unknown HTTP/1.0\r\n\r\n", 1024),
+            RESP_404 CONN_CLOSE BODY_404) == 0);
+
+    _assert (strcmp(api_request(client,
+            "GET /unknown HTTP/1.0\r\n"
+            "Connection: keep-alive\r\n\r\n"
+            "GET /get-version HTTP/1.0\r\n\r\n", 1024),
+            RESP_404 BODY_404
+            RESP_401 CONN_CLOSE BODY_401) == 0);
+
+    /* invalid data after a request closes the connection */
+    _assert (strcmp(api_request(client,
+            "GET /unknown HTTP/1.1\r\n\r\n"
+            "NOT HTTP\r\n\r\n", 1024),
+            RESP_404 BODY_404) == 0);
+
+    return test_end();
+}
+
+int main()
+{
+    int rc;
+    static uv_loop_t loop;  /* the API server is never closed */
+    siri_cfg_t cfg;
+    api_client_t * client = malloc(sizeof(api_client_t));
+
+    logger_init(stderr, LOGGER_CRITICAL);
+
+    memset(&cfg, 0, sizeof(siri_cfg_t));
+    cfg.http_api_port = TEST_API_PORT;
+    cfg.ip_support = IP_SUPPORT_IPV4ONLY;
+
+    (void) uv_loop_init(&loop);
+    siri.loop = &loop;
+    siri.cfg = &cfg;
+    siri.siridb_list = llist_new();
+
+    rc = (
+        siri_api_init() ||
+        test_pipelined(client) ||
+        test_connection_close(client) ||
+        0
+    );
+
+    free(client);
+    llist_free_cb(siri.siridb_list, NULL, NULL);
+    siri.siridb_list = NULL;
+    siri.cfg = NULL;
+    siri.loop = NULL;
+    return rc;
+}
@@ -1,6 +1,11 @@
 #include "../test.h"
 #include <ctree/ctree.h>
 
+static int cmp_str(const void * a, const void * b)
+{
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
 static const unsigned int num_entries = 14;
 static char * entries[] = {
     "Zero",
@@ -91,5 +96,39 @@ int main()
 
     ct_free(ctree, NULL);
 
+    /* test build from sorted keys */
+    {
+        unsigned int i;
+        const char * keys[num_entries + 1];
+
+        memcpy(keys, entries, sizeof(char *) * num_entries);
+        keys[num_entries] = "entry";
+        qsort(keys, num_entries + 1, sizeof(char *), cmp_str);
+
+        ctree = ct_new();
+        _assert (ct_build(ctree, keys, (void **) keys, num_entries + 1) == 0);
+        _assert (ctree->len == num_entries + 1);
+
+        for (i = 0; i <= num_entries; i++)
+        {
+            _assert (ct_get(ctree, keys[i]) == keys[i]);
+            _assert (ct_add(ctree, keys[i], NULL) == CT_EXISTS);
+        }
+        _assert (ct_get(ctree, "entr") == NULL);
+        _assert (ct_get(ctree, "entry 1") == NULL);
+
+        /* the tree can be changed like any other tree */
+        _assert (ct_add(ctree, "entry 1", entries[0]) == 0);
+        _assert (strcmp(ct_pop(ctree, "entry"), "entry") == 0);
+        for (i = 0; i < num_entries; i++)
+        {
+            _assert (ct_pop(ctree, entries[i]) == entries[i]);
+        }
+        _assert (ct_pop(ctree, "entry 1") == entries[0]);
+        _assert (ctree->len == 0);
+
+        ct_free(ctree, NULL);
+    }
+
     return test_end();
 }
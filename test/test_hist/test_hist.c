@@ -0,0 +1,110 @@
+#include "../test.h"
+#include <hist/hist.h>
+#include <uv.h>
+
+#define TEST_HIST_THREADS 8
+#define TEST_HIST_N 100000
+
+static hist_t hist;
+
+static void test_hist_worker(void * arg __attribute__((unused)))
+{
+    uint64_t i;
+    for (i = 0; i < TEST_HIST_N; i++)
+    {
+        hist_observe(&hist, 2000);
+    }
+}
+
+static int test_hist_buckets(void)
+{
+    test_start("hist (buckets)");
+
+    hist_snapshot_t snapshot;
+
+    hist_init(&hist);
+
+    hist_observe(&hist, 0);                 /* bucket 0 */
+    hist_observe(&hist, 1000);              /* bucket 0 */
+    hist_observe(&hist, 1001);              /* bucket 1 */
+    hist_observe(&hist, 4000);              /* bucket 1 */
+    hist_observe(&hist, 4001);              /* bucket 2 */
+    hist_observe(&hist, 1000000);           /* 1ms, bucket 5 (1.024ms) */
+    hist_observe(&hist, 60000000000ULL);    /* one minute, last bucket */
+
+    hist_snapshot(&hist, &snapshot);
+
+    _assert (snapshot.count == 7);
+    _assert (snapshot.buckets[0] == 2);
+    _assert (snapshot.buckets[1] == 2);
+    _assert (snapshot.buckets[2] == 1);
+    _assert (snapshot.buckets[5] == 1);
+    _assert (snapshot.buckets[HIST_BUCKETS - 1] == 1);
+    _assert (snapshot.sum == 0 + 1000 + 1001 + 4000 + 4001 + 1000000 +
+                             60000000000ULL);
+
+    _assert (hist_bound(0) == 1e-6);
+    _assert (hist_bound(1) == 4e-6);
+    _assert (hist_bound(HIST_BUCKETS - 2) > 16.0);
+    _assert (hist_bound(HIST_BUCKETS - 1) == 0.0);
+
+    return test_end();
+}
+
+static int test_hist_threads(void)
+{
+    test_start("hist (threads)");
+
+    uv_thread_t threads[TEST_HIST_THREADS];
+    hist_snapshot_t snapshot;
+    int i;
+
+    hist_init(&hist);
+
+    for (i = 0; i < TEST_HIST_THREADS; i++)
+    {
+        _assert (uv_thread_create(threads + i, test_hist_worker, NULL) == 0);
+    }
+
+    for (i = 0; i < TEST_HIST_THREADS; i++)
+    {
+        uv_thread_join(threads + i);
+    }
+
+    hist_snapshot(&hist, &snapshot);
+
+    _assert (snapshot.count == TEST_HIST_THREADS * TEST_HIST_N);
+    _assert (snapshot.buckets[1] == TEST_HIST_THREADS * TEST_HIST_N);
+    _assert (snapshot.sum == 2000ULL * TEST_HIST_THREADS * TEST_HIST_N);
+
+    return test_end();
+}
+
+static int test_hist_now(void)
+{
+    test_start("hist (now)");
+
+    uint64_t a = hist_now();
+    uint64_t b = hist_now();
+
+    _assert (b >= a);
+
+    hist_init(&hist);
+    hist_since(&hist, a);
+
+    hist_snapshot_t snapshot;
+    hist_snapshot(&hist, &snapshot);
+    _assert (snapshot.count == 1);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_hist_buckets() ||
+        test_hist_threads() ||
+        test_hist_now() ||
+        0
+    );
+}
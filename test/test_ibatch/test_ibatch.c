@@ -0,0 +1,135 @@
+#include "../test.h"
+#include <siri/db/ibatch.h>
+#include <siri/err.h>
+
+
+static int test_ibatch_points(void)
+{
+    test_start("ibatch (points)");
+
+    siridb_ibatch_t * ibatch = siridb_ibatch_new();
+    siridb_ibatch_series_t * a, * b;
+    siridb_pcache_t * pcache = NULL;
+    qp_obj_t qp_val;
+    int64_t i;
+
+    a = siridb_ibatch_add_series(ibatch, "series-a", 8, 1);
+    _assert (a != NULL);
+
+    qp_val.tp = QP_INT64;
+    for (i = 0; i < 2000; i++)
+    {
+        /* add points in reverse order, the batch must sort them */
+        qp_val.via.int64 = i;
+        _assert (siridb_ibatch_add_point(ibatch, a, 2000 - i, &qp_val) == 0);
+    }
+
+    b = siridb_ibatch_add_series(ibatch, "series-b", 8, 42);
+    _assert (b != NULL);
+
+    qp_val.tp = QP_DOUBLE;
+    qp_val.via.real = 0.5;
+    _assert (siridb_ibatch_add_point(ibatch, b, 10, &qp_val) == 0);
+
+    /* series 'a' may have moved because of re-allocation */
+    a = ibatch->series;
+
+    _assert (ibatch->len == 2);
+    _assert (ibatch->flags == 0);
+    _assert (strcmp(siridb_ibatch_name(ibatch, a), "series-a") == 0);
+    _assert (strcmp(siridb_ibatch_name(ibatch, b), "series-b") == 0);
+    _assert (a->tp == TP_INT && a->len == 2000);
+    _assert (b->tp == TP_DOUBLE && b->len == 1 && b->pos == 42);
+
+    _assert (siridb_ibatch_pcache(ibatch, a, &pcache) == 0);
+    _assert (pcache->len == 2000);
+    for (i = 0; i < 2000; i++)
+    {
+        _assert (pcache->data[i].ts == (uint64_t) i + 1);
+        _assert (pcache->data[i].val.int64 == 1999 - i);
+    }
+
+    _assert (siridb_ibatch_pcache(ibatch, b, &pcache) == 0);
+    _assert (pcache->len == 1 && pcache->tp == TP_DOUBLE);
+    _assert (pcache->data->val.real == 0.5);
+
+    siridb_pcache_free(pcache);
+    siridb_ibatch_free(ibatch);
+
+    return test_end();
+}
+
+static int test_ibatch_strings(void)
+{
+    test_start("ibatch (strings)");
+
+    siridb_ibatch_t * ibatch = siridb_ibatch_new();
+    siridb_ibatch_series_t * a;
+    qp_obj_t qp_val;
+
+    a = siridb_ibatch_add_series(ibatch, "log", 3, 0);
+
+    qp_val.tp = QP_RAW;
+    qp_val.via.raw = (unsigned char *) "some text";
+    qp_val.len = 4;
+    _assert (siridb_ibatch_add_point(ibatch, a, 2, &qp_val) == 0);
+    _assert (siridb_ibatch_add_point(ibatch, a, 1, &qp_val) == 0);
+    _assert (a->tp == TP_STRING && a->len == 2);
+    _assert (strcmp(ibatch->points[a->offset].val.str, "some") == 0);
+
+    /* another type for the same series makes the batch invalid */
+    qp_val.tp = QP_INT64;
+    qp_val.via.int64 = 5;
+    _assert (siridb_ibatch_add_point(ibatch, a, 3, &qp_val) == 0);
+    _assert (ibatch->flags & IBATCH_FLAG_INVALID);
+    _assert (a->len == 2);
+
+    /* strings which are not processed are destroyed with the batch */
+    siridb_ibatch_free(ibatch);
+
+    return test_end();
+}
+
+static int test_ibatch_small(void)
+{
+    test_start("ibatch (small series)");
+
+    siridb_ibatch_t * ibatch = siridb_ibatch_new();
+    siridb_ibatch_series_t * bseries;
+    char name[16];
+    qp_obj_t qp_val;
+    int i;
+
+    qp_val.tp = QP_INT64;
+    qp_val.via.int64 = 1;
+
+    /* many series with a single point are not collected */
+    for (i = 0; i < 100; i++)
+    {
+        sprintf(name, "s%d", i);
+        bseries = siridb_ibatch_add_series(ibatch, name, strlen(name), 0);
+        if (bseries == NULL)
+        {
+            break;
+        }
+        _assert (siridb_ibatch_add_point(ibatch, bseries, 1, &qp_val) == 0);
+    }
+
+    _assert (i == 64);
+    _assert (ibatch->flags & IBATCH_FLAG_INVALID);
+    _assert (siri_err == 0);
+
+    siridb_ibatch_free(ibatch);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_ibatch_points() ||
+        test_ibatch_strings() ||
+        test_ibatch_small() ||
+        0
+    );
+}
@@ -0,0 +1,263 @@
+#include "../test.h"
+#include <llist/llist.h>
+#include <siri/db/ijson.h>
+#include <siri/db/lookup.h>
+#include <siri/db/pools.h>
+#include <siri/db/server.h>
+#include <siri/db/time.h>
+
+
+static void test_ijson_db_init(siridb_t * siridb)
+{
+    memset(siridb, 0, sizeof(siridb_t));
+    siridb->server = calloc(1, sizeof(siridb_server_t));
+    siridb->servers = llist_new();
+    siridb->time = siridb_time_new(SIRIDB_TIME_SECONDS);
+    siridb->pools = calloc(1, sizeof(siridb_pools_t));
+    siridb->pools->len = 1;
+    siridb->pools->lookup = siridb_lookup_new(1, SIRIDB_LOOKUP_MODE_DEFAULT);
+}
+
+static void test_ijson_db_free(siridb_t * siridb)
+{
+    siridb_lookup_free(siridb->pools->lookup);
+    free(siridb->pools);
+    free(siridb->time);
+    llist_free_cb(siridb->servers, NULL, NULL);
+    free(siridb->server);
+}
+
+/*
+ * Parse the data in chunks of 'chunk_sz' bytes, like the data is received
+ * in multiple reads.
+ */
+static siridb_ijson_t * test_ijson_parse(
+        siridb_t * siridb,
+        const char * data,
+        size_t chunk_sz,
+        ssize_t * rc)
+{
+    siridb_ijson_t * ijson = siridb_ijson_new(siridb, NULL);
+    size_t n, len = strlen(data);
+
+    for (; len; data += n, len -= n)
+    {
+        n = len < chunk_sz ? len : chunk_sz;
+        (void) siridb_ijson_parse(ijson, data, n);
+    }
+
+    *rc = siridb_ijson_complete(ijson);
+    return ijson;
+}
+
+/*
+ * Returns the result of parsing the data in one piece, which must be the
+ * same for each other chunk size.
+ */
+static ssize_t test_ijson_result(siridb_t * siridb, const char * data)
+{
+    siridb_ijson_t * ijson;
+    size_t chunk_sz, len = strlen(data);
+    ssize_t rc, result = 0;
+    uint8_t flags = 0;
+
+    for (chunk_sz = len; chunk_sz; chunk_sz /= 2)
+    {
+        ijson = test_ijson_parse(siridb, data, chunk_sz, &rc);
+        if (chunk_sz == len)
+        {
+            result = rc;
+            flags = ijson->flags;
+        }
+        _assert (rc == result);
+        _assert (ijson->flags == flags);
+        siridb_ijson_free(ijson);
+    }
+
+    return (flags & IJSON_FLAG_INVALID) ? -1 : result;
+}
+
+static int test_ijson_nested(void)
+{
+    test_start("ijson (nested)");
+
+    siridb_t siridb;
+    siridb_ijson_t * ijson;
+    siridb_ibatch_t * ibatch;
+    ssize_t rc;
+
+    test_ijson_db_init(&siridb);
+
+    /* map format */
+    ijson = test_ijson_parse(
+            &siridb,
+            "{\"a\": [[1, 10], [2, 20]], \"b\": [[3, \"x\"]]}",
+            5,
+            &rc);
+    ibatch = ijson->insert->ibatch;
+    _assert (rc == 3);
+    _assert (ijson->flags == 0);
+    _assert (ibatch->len == 2 && ibatch->flags == 0);
+    _assert (strcmp(siridb_ibatch_name(ibatch, ibatch->series), "a") == 0);
+    _assert (ibatch->series[0].len == 2);
+    _assert (ibatch->series[0].tp == TP_INT);
+    _assert (ibatch->series[1].tp == TP_STRING);
+    _assert (strcmp(ibatch->points[2].val.str, "x") == 0);
+    siridb_ijson_free(ijson);
+
+    /* array format, points may be read before the name */
+    ijson = test_ijson_parse(
+            &siridb,
+            "[{\"points\": [[1, 1], [2, 2]], \"name\": \"a\"},"
+            " {\"name\": \"b\", \"points\": [[3, 3]]}]",
+            3,
+            &rc);
+    ibatch = ijson->insert->ibatch;
+    _assert (rc == 3);
+    _assert (ijson->flags & IJSON_FLAG_ARRAY);
+    _assert (ibatch->flags & IBATCH_FLAG_INVALID);
+    _assert (ibatch->len == 1);  /* an invalid batch stops collecting */
+    siridb_ijson_free(ijson);
+
+    /* the result does not depend on how the data is received */
+    _assert (test_ijson_result(
+            &siridb,
+            "{\"a\": [[1, 1]], \"b\": [[1, 1], [2, 2]]}") == 3);
+    _assert (test_ijson_result(
+            &siridb,
+            "[{\"name\": \"a\", \"points\": [[1, 1.0], [2, -1]]}]") == 2);
+    _assert (test_ijson_result(&siridb, "{}") == 0);
+    _assert (test_ijson_result(&siridb, "[]") == 0);
+
+    test_ijson_db_free(&siridb);
+
+    return test_end();
+}
+
+static int test_ijson_escapes(void)
+{
+    test_start("ijson (escapes)");
+
+    siridb_t siridb;
+    siridb_ijson_t * ijson;
+    siridb_ibatch_t * ibatch;
+    ssize_t rc;
+
+    test_ijson_db_init(&siridb);
+
+    ijson = test_ijson_parse(
+            &siridb,
+            "{\"q\\\"uo\\\\te\\u00e9\\n\": [[1, \"tab\\tand\\/slash\"]]}",
+            1,
+            &rc);
+    ibatch = ijson->insert->ibatch;
+    _assert (rc == 1);
+    _assert (ibatch->len == 1);
+    _assert (strcmp(
+            siridb_ibatch_name(ibatch, ibatch->series),
+            "q\"uo\\te\xc3\xa9\n") == 0);
+    _assert (strcmp(ibatch->points->val.str, "tab\tand/slash") == 0);
+    siridb_ijson_free(ijson);
+
+    /* keys are compared after the escapes are decoded */
+    _assert (test_ijson_result(
+            &siridb,
+            "[{\"n\\u0061me\": \"a\", \"points\": [[1, 1]]}]") == 1);
+
+    test_ijson_db_free(&siridb);
+
+    return test_end();
+}
+
+static int test_ijson_truncated(void)
+{
+    test_start("ijson (truncated)");
+
+    siridb_t siridb;
+    siridb_ijson_t * ijson;
+    ssize_t rc;
+    const char * data =
+            "[{\"name\": \"a\", \"points\": [[1, 1], [2, 2.5]]}]";
+    char buf[64];
+    size_t n, len = strlen(data);
+
+    test_ijson_db_init(&siridb);
+
+    /* each truncated part of a valid document is invalid or incomplete */
+    for (n = 1; n < len; n++)
+    {
+        memcpy(buf, data, n);
+        buf[n] = '\0';
+        _assert (test_ijson_result(&siridb, buf) < 0);
+    }
+
+    _assert (test_ijson_result(&siridb, data) == 2);
+
+    ijson = test_ijson_parse(&siridb, "", 1, &rc);
+    _assert ((ijson->flags & IJSON_FLAG_INVALID) || rc < 0);
+    siridb_ijson_free(ijson);
+
+    test_ijson_db_free(&siridb);
+
+    return test_end();
+}
+
+static int test_ijson_malformed(void)
+{
+    test_start("ijson (malformed)");
+
+    siridb_t siridb;
+
+    test_ijson_db_init(&siridb);
+
+    /* invalid JSON */
+    _assert (test_ijson_result(&siridb, "{\"a\" [[1, 1]]}") == -1);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[1, 1]]]") == -1);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[1, 1],]}") == -1);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[1 1]]}") == -1);
+    _assert (test_ijson_result(&siridb, "{\"a\\x\": [[1, 1]]}") == -1);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[1, 1]]} {}") == -1);
+
+    /* valid JSON but not a valid insert */
+    _assert (test_ijson_result(&siridb, "5") ==
+            ERR_EXPECTING_MAP_OR_ARRAY);
+    _assert (test_ijson_result(&siridb, "\"a\"") ==
+            ERR_EXPECTING_MAP_OR_ARRAY);
+    _assert (test_ijson_result(&siridb, "{\"a\": 1}") ==
+            ERR_EXPECTING_ARRAY);
+    _assert (test_ijson_result(&siridb, "{\"a\": []}") ==
+            ERR_EXPECTING_AT_LEAST_ONE_POINT);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[1.5, 1]]}") ==
+            ERR_EXPECTING_INTEGER_TS);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[-1, 1]]}") ==
+            ERR_TIMESTAMP_OUT_OF_RANGE);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[1, null]]}") ==
+            ERR_UNSUPPORTED_VALUE);
+    _assert (test_ijson_result(&siridb, "{\"a\": [[1, true]]}") ==
+            ERR_UNSUPPORTED_VALUE);
+    _assert (test_ijson_result(&siridb, "{\"\": [[1, 1]]}") ==
+            ERR_EXPECTING_SERIES_NAME);
+    _assert (test_ijson_result(&siridb, "[{\"name\": \"a\"}]") ==
+            ERR_EXPECTING_NAME_AND_POINTS);
+    _assert (test_ijson_result(&siridb, "[{\"points\": [[1, 1]]}]") ==
+            ERR_EXPECTING_NAME_AND_POINTS);
+    _assert (test_ijson_result(&siridb, "[{\"name\": \"a\", \"x\": 1}]") ==
+            ERR_EXPECTING_NAME_AND_POINTS);
+    _assert (test_ijson_result(&siridb, "[[1, 1]]") ==
+            ERR_EXPECTING_SERIES_NAME);
+
+    test_ijson_db_free(&siridb);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_ijson_nested() ||
+        test_ijson_escapes() ||
+        test_ijson_truncated() ||
+        test_ijson_malformed() ||
+        0
+    );
+}
@@ -0,0 +1,195 @@
+#include "../test.h"
+#include <siri/db/itext.h>
+
+#define MAX_POINTS 16
+
+typedef struct
+{
+    size_t n;
+    char name[MAX_POINTS][64];
+    int64_t ts[MAX_POINTS];
+    qp_obj_t val[MAX_POINTS];
+} points_t;
+
+static siridb_itext_t itext;
+
+static int collect(
+        siridb_itext_t * itext,
+        int64_t ts,
+        qp_obj_t * qp_val,
+        points_t * points)
+{
+    if (points->n == MAX_POINTS)
+    {
+        return ERR_MEM_ALLOC;
+    }
+    snprintf(points->name[points->n], 64, "%.63s", itext->name);
+    points->ts[points->n] = ts;
+    points->val[points->n] = *qp_val;
+    points->n++;
+    return 0;
+}
+
+static int parse(int fmt, const char * text, points_t * points)
+{
+    static char data[1024];
+    size_t n = strlen(text);
+
+    memcpy(data, text, n);
+    points->n = 0;
+    itext.now = 42;
+
+    return siridb_itext_parse(
+            &itext,
+            fmt,
+            data,
+            n,
+            (siridb_itext_cb) collect,
+            points);
+}
+
+static int test_itext_line(void)
+{
+    test_start("itext (line protocol)");
+
+    points_t points;
+
+    _assert (parse(
+        ITEXT_FMT_LINE,
+        "# comment\n"
+        "cpu,host=a usage=0.5,count=3i,up=t 1000\r\n"
+        "\n"
+        "my\\ log msg=\"say \\\"hi\\\"\",n=7u",
+        &points) == 0);
+
+    _assert (points.n == 5);
+
+    _assert (strcmp(points.name[0], "cpu,host=a usage") == 0);
+    _assert (points.ts[0] == 1000);
+    _assert (points.val[0].tp == QP_DOUBLE && points.val[0].via.real == 0.5);
+
+    _assert (strcmp(points.name[1], "cpu,host=a count") == 0);
+    _assert (points.val[1].tp == QP_INT64 && points.val[1].via.int64 == 3);
+
+    _assert (strcmp(points.name[2], "cpu,host=a up") == 0);
+    _assert (points.val[2].tp == QP_INT64 && points.val[2].via.int64 == 1);
+
+    /* the time-stamp is omitted so 'now' is used */
+    _assert (strcmp(points.name[3], "my log msg") == 0);
+    _assert (points.ts[3] == 42);
+    _assert (points.val[3].tp == QP_RAW);
+    _assert (points.val[3].len == 8);
+    _assert (memcmp(points.val[3].via.raw, "say \"hi\"", 8) == 0);
+
+    _assert (points.val[4].tp == QP_INT64 && points.val[4].via.int64 == 7);
+
+    _assert (parse(ITEXT_FMT_LINE, "cpu 5", &points) == ERR_INVALID_TEXT_LINE);
+    _assert (itext.line == 1);
+    _assert (parse(ITEXT_FMT_LINE, "\ncpu v=x", &points) ==
+            ERR_UNSUPPORTED_VALUE);
+    _assert (itext.line == 2);
+    _assert (parse(ITEXT_FMT_LINE, "cpu v=1 1.5", &points) ==
+            ERR_EXPECTING_INTEGER_TS);
+    _assert (parse(ITEXT_FMT_LINE, "cpu v=\"open", &points) ==
+            ERR_INVALID_TEXT_LINE);
+    _assert (parse(ITEXT_FMT_LINE, "cpu v=-1u", &points) ==
+            ERR_UNSUPPORTED_VALUE);
+
+    return test_end();
+}
+
+static int test_itext_escapes(void)
+{
+    test_start("itext (escapes)");
+
+    points_t points;
+
+    _assert (parse(
+        ITEXT_FMT_LINE,
+        "cpu\\ load,host=a\\,b,k\\=1=x\\ y v\\,1=1,a\\\\b=2,c\\d=3 5",
+        &points) == 0);
+
+    _assert (points.n == 3);
+    _assert (strcmp(points.name[0], "cpu load,host=a,b,k=1=x y v,1") == 0);
+    _assert (strcmp(points.name[1], "cpu load,host=a,b,k=1=x y a\\b") == 0);
+    _assert (points.ts[0] == 5);
+
+    /* other characters after a backslash are not escaped */
+    _assert (strcmp(points.name[2], "cpu load,host=a,b,k=1=x y c\\d") == 0);
+
+    return test_end();
+}
+
+static int test_itext_csv(void)
+{
+    test_start("itext (csv)");
+
+    points_t points;
+
+    _assert (parse(
+        ITEXT_FMT_CSV,
+        "a,1,5\n"
+        "\"b,\"\"x\"\"\",2,1.5\n"
+        "c,3,\"text\"\n"
+        "d,4,word\n",
+        &points) == 0);
+
+    _assert (points.n == 4);
+    _assert (strcmp(points.name[0], "a") == 0);
+    _assert (points.ts[0] == 1);
+    _assert (points.val[0].tp == QP_INT64 && points.val[0].via.int64 == 5);
+    _assert (strcmp(points.name[1], "b,\"x\"") == 0);
+    _assert (points.val[1].tp == QP_DOUBLE && points.val[1].via.real == 1.5);
+    _assert (points.val[2].tp == QP_RAW && points.val[2].len == 4);
+    _assert (memcmp(points.val[2].via.raw, "text", 4) == 0);
+    _assert (points.val[3].tp == QP_RAW && points.val[3].len == 4);
+
+    _assert (parse(ITEXT_FMT_CSV, "a,1", &points) == ERR_INVALID_TEXT_LINE);
+    _assert (parse(ITEXT_FMT_CSV, "a,x,1", &points) ==
+            ERR_EXPECTING_INTEGER_TS);
+    _assert (parse(ITEXT_FMT_CSV, ",1,1", &points) == 0);
+    _assert (points.n == 0);
+
+    return test_end();
+}
+
+static int test_itext_table(void)
+{
+    test_start("itext (csv table)");
+
+    points_t points;
+
+    _assert (parse(
+        ITEXT_FMT_CSV,
+        ",a,\"b\"\"\",c\n"
+        "10,1,,3\n"
+        "20,,2.5\n",
+        &points) == 0);
+
+    _assert (points.n == 3);
+    _assert (strcmp(points.name[0], "a") == 0);
+    _assert (points.ts[0] == 10);
+    _assert (strcmp(points.name[1], "c") == 0);
+    _assert (points.val[1].via.int64 == 3);
+    _assert (strcmp(points.name[2], "b\"") == 0);
+    _assert (points.ts[2] == 20);
+    _assert (points.val[2].tp == QP_DOUBLE && points.val[2].via.real == 2.5);
+
+    /* more values than series */
+    _assert (parse(ITEXT_FMT_CSV, ",a\n1,2,3", &points) ==
+            ERR_INVALID_TEXT_LINE);
+    _assert (itext.line == 2);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_itext_line() ||
+        test_itext_escapes() ||
+        test_itext_csv() ||
+        test_itext_table() ||
+        0
+    );
+}
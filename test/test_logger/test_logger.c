@@ -0,0 +1,169 @@
+#include "../test.h"
+#include <logger/logger.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_LOGGER_THREADS 4
+#define TEST_LOGGER_LINES 100
+
+static size_t test_logger_read(FILE * f, char * buf, size_t sz)
+{
+    size_t n;
+    fflush(f);
+    rewind(f);
+    n = fread(buf, 1, sz - 1, f);
+    buf[n] = '\0';
+    return n;
+}
+
+static size_t test_logger_count(const char * buf, const char * s)
+{
+    size_t n = 0;
+    while ((buf = strstr(buf, s)) != NULL)
+    {
+        n++;
+        buf++;
+    }
+    return n;
+}
+
+static void * test_logger_work(void * arg)
+{
+    long id = (long) arg;
+    int i;
+    for (i = 0; i < TEST_LOGGER_LINES; i++)
+    {
+        log_warning("thread %ld line %d", id, i);
+    }
+    return NULL;
+}
+
+static int test_logger_sync(void)
+{
+    test_start("logger (sync)");
+
+    char buf[4096];
+    FILE * f = tmpfile();
+
+    logger_init(f, LOGGER_INFO);
+
+    log_debug("not written");
+    log_info("written %d", 42);
+    log_error("written %s", "too");
+
+    test_logger_read(f, buf, sizeof(buf));
+
+    _assert (strstr(buf, "not written") == NULL);
+    _assert (strncmp(buf, "[I ", 3) == 0);
+    _assert (strstr(buf, "] written 42\n[E ") != NULL);
+    _assert (strstr(buf, "] written too\n") != NULL);
+    _assert (test_logger_count(buf, "\n") == 2);
+
+    fclose(f);
+
+    return test_end();
+}
+
+static int test_logger_async(void)
+{
+    test_start("logger (async)");
+
+    static char buf[TEST_LOGGER_THREADS * TEST_LOGGER_LINES * 64];
+    char line[64];
+    pthread_t threads[TEST_LOGGER_THREADS];
+    FILE * f = tmpfile();
+    long i;
+    int j;
+
+    logger_init(f, LOGGER_INFO);
+    _assert (logger_start() == 0);
+    _assert (logger_start() == 0);
+
+    for (i = 0; i < TEST_LOGGER_THREADS; i++)
+    {
+        _assert (pthread_create(
+                &threads[i],
+                NULL,
+                test_logger_work,
+                (void *) i) == 0);
+    }
+    for (i = 0; i < TEST_LOGGER_THREADS; i++)
+    {
+        _assert (pthread_join(threads[i], NULL) == 0);
+    }
+
+    logger_stop();
+    logger_stop();
+
+    test_logger_read(f, buf, sizeof(buf));
+
+    /* the ring buffer can hold all lines so none are dropped */
+    _assert (test_logger_count(buf, "\n") ==
+            TEST_LOGGER_THREADS * TEST_LOGGER_LINES);
+
+    for (i = 0; i < TEST_LOGGER_THREADS; i++)
+    {
+        for (j = 0; j < TEST_LOGGER_LINES; j++)
+        {
+            sprintf(line, "] thread %ld line %d\n", i, j);
+            _assert (test_logger_count(buf, line) == 1);
+        }
+    }
+
+    fclose(f);
+
+    return test_end();
+}
+
+static int test_logger_repeated(void)
+{
+    test_start("logger (repeated)");
+
+    char buf[4096];
+    char msg[LOGGER_LINE_SZ + 100];
+    FILE * f = tmpfile();
+    int i;
+
+    logger_init(f, LOGGER_INFO);
+    _assert (logger_start() == 0);
+
+    for (i = 0; i < 100; i++)
+    {
+        log_info("same message");
+    }
+    log_info("other message");
+
+    memset(msg, 'x', sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = '\0';
+    log_info("%s", msg);
+
+    logger_stop();
+
+    test_logger_read(f, buf, sizeof(buf));
+
+    _assert (test_logger_count(buf, "same message") == 2);
+    _assert (strstr(buf, "] same message\n[I ") != NULL);
+    _assert (strstr(
+            buf,
+            "] last message repeated 99 times: same message\n[I ") != NULL);
+    _assert (strstr(buf, "] other message\n[I ") != NULL);
+
+    /* long messages are truncated */
+    _assert (strstr(buf, "xxx...\n") != NULL);
+    _assert (test_logger_count(buf, "\n") == 4);
+
+    fclose(f);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_logger_sync() ||
+        test_logger_async() ||
+        test_logger_repeated() ||
+        0
+    );
+}
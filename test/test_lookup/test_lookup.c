@@ -44,18 +44,18 @@ int main()
             lower = ideal - (percentage_unequal * ideal);
             upper = ideal + (percentage_unequal * ideal);
             init_counters();
-            lookup = siridb_lookup_new(num_pools);
+            lookup = siridb_lookup_new(num_pools, SIRIDB_LOOKUP_MODE_SUM);
             _assert (lookup);
             for (n = 0; n < SIRIDB_LOOKUP_SZ; ++n)
             {
                 /* check for SIRIDB_SERIES_IS_SERVER_ONE flag */
                 if ((bool) ((n / 11) % 2))
                 {
-                    countersa[(*lookup)[n]]++;
+                    countersa[lookup->pool[n]]++;
                 }
                 else
                 {
-                    countersb[(*lookup)[n]]++;
+                    countersb[lookup->pool[n]]++;
                 }
             }
             for (p = 0; p < num_pools; ++p)
@@ -67,14 +67,69 @@ int main()
         }
     }
 
-    lookup = siridb_lookup_new(4);
+    lookup = siridb_lookup_new(4, SIRIDB_LOOKUP_MODE_SUM);
     _assert (lookup);
 
     for (i = 0; i < 30; i++)
     {
-        _assert( match[i] == (*lookup)[i] );
+        _assert( match[i] == lookup->pool[i] );
     }
 
+    /* the legacy mode must keep assigning series to the same pool */
+    _assert (siridb_lookup_sn(lookup, "series-001") == lookup->pool[841]);
+    _assert (siridb_lookup_sn_raw(lookup, "series-001", 10) ==
+             siridb_lookup_sn(lookup, "series-001"));
+
     free(lookup);
+
+    /* xxHash64 reference values (seed 0) */
+    _assert (siridb_lookup_xxh64("", 0) == 0xEF46DB3751D8E999ULL);
+    _assert (siridb_lookup_xxh64("a", 1) == 0xD24EC4F1A98C6E5BULL);
+    _assert (siridb_lookup_xxh64("abc", 3) == 0x44BC2CF5AD770999ULL);
+    _assert (siridb_lookup_xxh64(
+            "Nobody inspects the spammish repetition", 39) ==
+                    0xFBCEA83C8A378BF1ULL);
+
+    /* modes by name */
+    _assert (siridb_lookup_mode_by_name("sum", 3) == SIRIDB_LOOKUP_MODE_SUM);
+    _assert (siridb_lookup_mode_by_name("xxh64", 5) ==
+             SIRIDB_LOOKUP_MODE_XXH64);
+    _assert (siridb_lookup_mode_by_name("xxh", 3) == -1);
+    _assert (strcmp(siridb_lookup_mode_str(SIRIDB_LOOKUP_MODE_XXH64),
+             "xxh64") == 0);
+
+    /* sequential host names are unbalanced with the legacy mode */
+    {
+        char sn[32];
+        int len;
+        siridb_lookup_t * lookup_xxh;
+        siridb_lookup_stats_t * stats_sum, * stats_xxh;
+
+        lookup = siridb_lookup_new(8, SIRIDB_LOOKUP_MODE_SUM);
+        lookup_xxh = siridb_lookup_new(8, SIRIDB_LOOKUP_MODE_XXH64);
+        stats_sum = siridb_lookup_stats_new(lookup, 8);
+        stats_xxh = siridb_lookup_stats_new(lookup_xxh, 8);
+        _assert (lookup && lookup_xxh && stats_sum && stats_xxh);
+
+        for (i = 0; i < 10000; i++)
+        {
+            len = sprintf(sn, "host-%04u.cpu.user", i);
+            siridb_lookup_stats_add(stats_sum, sn, len);
+            siridb_lookup_stats_add(stats_xxh, sn, len);
+            _assert (siridb_lookup_sn(lookup_xxh, sn) ==
+                     lookup_xxh->pool[siridb_lookup_xxh64(sn, len) % 8192]);
+        }
+
+        _assert (stats_sum->n == 10000 && stats_xxh->n == 10000);
+        _assert (stats_sum->slots_used < 100);
+        _assert (stats_xxh->slots_used > 5000);
+        _assert (siridb_lookup_stats_imbalance(stats_sum) > 0.3);
+        _assert (siridb_lookup_stats_imbalance(stats_xxh) < 0.1);
+
+        siridb_lookup_stats_free(stats_sum);
+        siridb_lookup_stats_free(stats_xxh);
+        free(lookup);
+        free(lookup_xxh);
+    }
     return test_end();
 }
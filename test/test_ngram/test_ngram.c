@@ -0,0 +1,277 @@
+#include "../test.h"
+#include <pcre2.h>
+#include <siri/db/ngram.h>
+
+static const char * test_ngram_logs[] = {
+        "GET /index.html 200",
+        "POST /api/login 401 Unauthorized",
+        "Connection reset by peer",
+        "",
+        "ok",
+};
+
+static void test_ngram_points_free(siridb_points_t * points)
+{
+    free(points->data);
+    free(points);
+}
+
+static siridb_points_t * test_ngram_points(void)
+{
+    size_t i, n = sizeof(test_ngram_logs) / sizeof(char *);
+    siridb_points_t * points = malloc(sizeof(siridb_points_t));
+
+    points->data = malloc(n * sizeof(siridb_point_t));
+    points->len = n;
+    points->tp = TP_STRING;
+    for (i = 0; i < n; i++)
+    {
+        points->data[i].ts = i;
+        points->data[i].val.str = (char *) test_ngram_logs[i];
+    }
+    return points;
+}
+
+/*
+ * Returns 1 when the regular expression source matches a value in the same
+ * way as siridb_re_compile(), or 0 if not.
+ */
+static int test_ngram_re_match(const char * source, const char * val)
+{
+    size_t len = strlen(source);
+    char pattern[len + 1];
+    pcre2_code * re;
+    pcre2_match_data * md;
+    int options = 0, errnum, rc;
+    PCRE2_SIZE erroffset;
+
+    memcpy(pattern, source, len);
+    pattern[0] = '^';
+    if (pattern[len - 1] == 'i')
+    {
+        options = PCRE2_CASELESS;
+        len--;
+    }
+    pattern[len - 1] = '$';
+    pattern[len] = '\0';
+
+    re = pcre2_compile(
+            (PCRE2_SPTR8) pattern,
+            PCRE2_ZERO_TERMINATED,
+            options,
+            &errnum,
+            &erroffset,
+            NULL);
+    md = pcre2_match_data_create_from_pattern(re, NULL);
+    rc = pcre2_match(re, (PCRE2_SPTR8) val, strlen(val), 0, 0, md, NULL);
+    pcre2_match_data_free(md);
+    pcre2_code_free(re);
+
+    return rc >= 0;
+}
+
+static int test_ngram_str(void)
+{
+    test_start("ngram (str)");
+
+    siridb_points_t * points = test_ngram_points();
+    siridb_ngram_t * ngram = siridb_ngram_new(points, 0, points->len);
+    siridb_ngram_t * empty = siridb_ngram_new(points, 3, points->len);
+    siridb_ngram_query_t * query;
+
+    _assert (ngram != NULL && ngram->len == points->len);
+    _assert (ngram->mask + 1 == SIRIDB_NGRAM_MIN_BITS);
+
+    /* strings with less than three characters cannot be used */
+    _assert (siridb_ngram_query_str("") == NULL);
+    _assert (siridb_ngram_query_str("ok") == NULL);
+
+    query = siridb_ngram_query_str("Unauthorized");
+    _assert (query != NULL && query->n == 10);
+    _assert (siridb_ngram_match(ngram, query) == 1);
+    _assert (siridb_ngram_match(empty, query) == 0);
+    siridb_ngram_query_free(query);
+
+    /* trigrams are case insensitive */
+    query = siridb_ngram_query_str("connection RESET");
+    _assert (siridb_ngram_match(ngram, query) == 1);
+    siridb_ngram_query_free(query);
+
+    query = siridb_ngram_query_str("timeout");
+    _assert (siridb_ngram_match(ngram, query) == 0);
+    siridb_ngram_query_free(query);
+
+    siridb_ngram_free(ngram);
+    siridb_ngram_free(empty);
+    test_ngram_points_free(points);
+
+    return test_end();
+}
+
+static int test_ngram_regex(void)
+{
+    test_start("ngram (regex)");
+
+    siridb_points_t * points = test_ngram_points();
+    siridb_ngram_t * ngram = siridb_ngram_new(points, 0, points->len);
+    siridb_ngram_query_t * query;
+    const char * no_query[] = {
+            "/GET|POST/",
+            "/.*/",
+            "/a.b.c/",
+            "/[abc]+\\d+/",
+            "/(?x)G E T/",
+            "/ab?/",
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(no_query) / sizeof(char *); i++)
+    {
+        _assert (siridb_ngram_query_regex(
+                no_query[i],
+                strlen(no_query[i])) == NULL);
+    }
+
+    /* literals in groups, classes and escapes are skipped */
+    query = siridb_ngram_query_regex("/(GET|POST) .*html.*/", 21);
+    _assert (query != NULL && query->n == 2);
+    _assert (siridb_ngram_match(ngram, query) == 1);
+    siridb_ngram_query_free(query);
+
+    /* optional characters are not required */
+    query = siridb_ngram_query_regex("/.*peers?/i", 11);
+    _assert (query != NULL && query->n == 2);
+    _assert (siridb_ngram_match(ngram, query) == 1);
+    siridb_ngram_query_free(query);
+
+    query = siridb_ngram_query_regex("/.*\\d{3} Timeout/", 17);
+    _assert (query != NULL);
+    _assert (siridb_ngram_match(ngram, query) == 0);
+    siridb_ngram_query_free(query);
+
+    siridb_ngram_free(ngram);
+    test_ngram_points_free(points);
+
+    return test_end();
+}
+
+static int test_ngram_no_false_negatives(void)
+{
+    test_start("ngram (no false negatives)");
+
+    const char * sources[] = {
+            "/.*index\\.html.*/",
+            "/.*INDEX.HTML.*/i",
+            "/.*api/login (\\d+) Unauth.*/",
+            "/Conn[a-z]+ion reset by pe+r/",
+            "/.*re{1}set.*/",
+            "/.*\\x41pi.*/i",
+            "/POST /api/lo(g|x)in \\d+ Unauthorized/",
+            "/.*(?i)peer/",
+            "/\\QGET\\E /index.*/",
+    };
+    siridb_points_t * points = test_ngram_points();
+    siridb_ngram_t * ngram;
+    siridb_ngram_query_t * query;
+    size_t i, j, n = 0;
+
+    for (i = 0; i < sizeof(sources) / sizeof(char *); i++)
+    {
+        query = siridb_ngram_query_regex(sources[i], strlen(sources[i]));
+        for (j = 0; j < points->len; j++)
+        {
+            if (!test_ngram_re_match(sources[i], points->data[j].val.str))
+            {
+                continue;
+            }
+            n++;
+            ngram = siridb_ngram_new(points, j, j + 1);
+            _assert (query == NULL || siridb_ngram_match(ngram, query));
+            siridb_ngram_free(ngram);
+        }
+        siridb_ngram_query_free(query);
+    }
+
+    /* each expression matches one value */
+    _assert (n == sizeof(sources) / sizeof(char *));
+
+    test_ngram_points_free(points);
+
+    return test_end();
+}
+
+static int test_ngram_set(void)
+{
+    test_start("ngram (set)");
+
+    siridb_points_t * points = test_ngram_points();
+    siridb_ngram_index_t * index = siridb_ngram_index_new(1 << 20);
+    imap_t * ngrams = NULL;
+    siridb_ngram_t * ngram;
+
+    ngram = siridb_ngram_new(points, 0, 1);
+    siridb_ngram_set(index, &ngrams, 4096, ngram);
+    _assert (ngrams != NULL && ngrams->len == 1);
+    _assert (index->memory == siridb_ngram_size(ngram));
+
+    /* an existing filter is replaced */
+    ngram = siridb_ngram_new(points, 0, 2);
+    siridb_ngram_set(index, &ngrams, 4096, ngram);
+    _assert (ngrams->len == 1);
+    _assert (imap_get(ngrams, 4096) == ngram);
+    _assert (index->memory == siridb_ngram_size(ngram));
+
+    siridb_ngram_set(index, &ngrams, 8192, siridb_ngram_new(points, 1, 2));
+    _assert (ngrams->len == 2);
+
+    siridb_ngram_free_map(index, ngrams);
+    _assert (index->memory == 0);
+
+    siridb_ngram_index_free(index);
+    test_ngram_points_free(points);
+
+    return test_end();
+}
+
+static int test_ngram_max_memory(void)
+{
+    test_start("ngram (max_memory)");
+
+    siridb_points_t * points = test_ngram_points();
+    siridb_ngram_t * ngram = siridb_ngram_new(points, 0, 1);
+    size_t size = siridb_ngram_size(ngram);
+    siridb_ngram_index_t * index = siridb_ngram_index_new(size * 2);
+    imap_t * ngrams = NULL;
+
+    siridb_ngram_set(index, &ngrams, 1, ngram);
+    _assert (!siridb_ngram_index_full(index));
+    siridb_ngram_set(index, &ngrams, 2, siridb_ngram_new(points, 0, 1));
+    _assert (siridb_ngram_index_full(index));
+
+    /* a filter which does not fit is not added */
+    siridb_ngram_set(index, &ngrams, 3, siridb_ngram_new(points, 0, 1));
+    _assert (ngrams->len == 2);
+    _assert (imap_get(ngrams, 3) == NULL);
+    _assert (index->memory == size * 2);
+
+    siridb_ngram_free_map(index, ngrams);
+    _assert (index->memory == 0);
+    _assert (!siridb_ngram_index_full(index));
+
+    siridb_ngram_index_free(index);
+    test_ngram_points_free(points);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_ngram_str() ||
+        test_ngram_regex() ||
+        test_ngram_no_false_negatives() ||
+        test_ngram_set() ||
+        test_ngram_max_memory() ||
+        0
+    );
+}
@@ -0,0 +1,89 @@
+#include "../test.h"
+#include <siri/prof.h>
+#include <string.h>
+#include <time.h>
+
+#define TEST_PROF_STAGE "test_prof_busy"
+
+static volatile uint64_t test_prof_sink;
+
+static void test_prof_busy(clock_t ticks)
+{
+    clock_t end = clock() + ticks;
+    while (clock() < end)
+    {
+        test_prof_sink++;
+    }
+}
+
+static int test_prof_sampler(void)
+{
+    test_start("prof (sampler)");
+
+    qp_packer_t * packer = qp_packer_new(1024);
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_key, qp_val;
+    const char * stage = TEST_PROF_STAGE;
+    const char * prev;
+    int64_t samples = 0, stage_samples = 0;
+
+    _assert (siri_prof_start(0) == -1);
+    _assert (siri_prof_start(SIRI_PROF_HZ_MAX + 1) == -1);
+    _assert (siri_prof_start(1000) == 0);
+
+    prev = siri_prof_tag(stage);
+    _assert (prev == NULL);
+    test_prof_busy(CLOCKS_PER_SEC / 2);
+    _assert (siri_prof_tag(prev) == stage);
+
+    siri_prof_stop();
+
+    _assert (qp_add_type(packer, QP_MAP_OPEN) == 0);
+    _assert (siri_prof_to_packer(packer) == 0);
+    _assert (qp_add_type(packer, QP_MAP_CLOSE) == 0);
+
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+    _assert (qp_is_map(qp_next(&unpacker, NULL)));
+
+    while (qp_is_raw(qp_next(&unpacker, &qp_key)))
+    {
+        if (strncmp((char *) qp_key.via.raw, "samples", qp_key.len) == 0)
+        {
+            _assert (qp_is_int(qp_next(&unpacker, &qp_val)));
+            samples = qp_val.via.int64;
+        }
+        else if (strncmp((char *) qp_key.via.raw, "stages", qp_key.len) == 0)
+        {
+            _assert (qp_is_array(qp_next(&unpacker, NULL)));
+            /* stages are ordered by the number of samples */
+            _assert (qp_is_array(qp_next(&unpacker, NULL)));
+            _assert (qp_is_raw(qp_next(&unpacker, &qp_val)));
+            _assert (strncmp(
+                    (char *) qp_val.via.raw,
+                    TEST_PROF_STAGE,
+                    qp_val.len) == 0);
+            _assert (qp_is_int(qp_next(&unpacker, &qp_val)));
+            stage_samples = qp_val.via.int64;
+            while (qp_next(&unpacker, NULL) != QP_ARRAY_CLOSE);
+        }
+        else
+        {
+            qp_next(&unpacker, NULL);
+        }
+    }
+
+    _assert (stage_samples > 0);
+    _assert (samples >= stage_samples);
+
+    qp_packer_free(packer);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_prof_sampler() ||
+        0
+    );
+}
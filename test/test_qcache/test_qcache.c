@@ -0,0 +1,175 @@
+#include "../test.h"
+#include <siri/db/qcache.h>
+#include <siri/grammar/grammar.h>
+#include <siri/grammar/gramp.h>
+
+static cleri_grammar_t * grammar;
+
+static siridb_qentry_t * new_entry(siridb_qcache_t * qcache, const char * q)
+{
+    siridb_qentry_t * qentry = siridb_qentry_new(q);
+    _assert (qentry);
+    qentry->pr = cleri_parse_m(grammar, qentry->q);
+    _assert (qentry->pr && qentry->pr->is_valid);
+    _assert (siridb_qcache_put(qcache, qentry) == 0);
+    siridb_qcache_release(qentry);
+    return qentry;
+}
+
+/* collect the expressions like the query walker does */
+static void add_exprs(siridb_qentry_t * qentry, cleri_node_t * node)
+{
+    cleri_children_t * current;
+
+    if (    node->cl_obj->gid == CLERI_GID_TIME_EXPR ||
+            node->cl_obj->gid == CLERI_GID_INT_EXPR)
+    {
+        _assert (vec_append_safe(&qentry->exprs, node) == 0);
+        return;
+    }
+
+    for (current = node->children;
+         current != NULL && cleri_gn(current) != NULL;
+         current = current->next)
+    {
+        add_exprs(qentry, cleri_gn(current));
+    }
+}
+
+static siridb_qentry_t * new_expr_entry(
+        siridb_qcache_t * qcache,
+        const char * q)
+{
+    siridb_qentry_t * qentry = siridb_qentry_new(q);
+    _assert (qentry);
+    qentry->pr = cleri_parse_m(grammar, qentry->q);
+    _assert (qentry->pr && qentry->pr->is_valid);
+    add_exprs(qentry, qentry->pr->tree);
+    _assert (siridb_qcache_put(qcache, qentry) == 0);
+    siridb_qcache_release(qentry);
+    return qentry;
+}
+
+int main()
+{
+    test_start("qcache");
+
+    char q[64];
+    int i;
+    siridb_qentry_t * qentry, * other;
+    siridb_qcache_t * qcache = siridb_qcache_new();
+    grammar = compile_siri_grammar_grammar();
+
+    _assert (siridb_qcache_get(qcache, "list series", 0, 0) == NULL);
+    _assert (qcache->misses == 1);
+
+    qentry = new_entry(qcache, "list series");
+    _assert (qcache->n == 1);
+    _assert (siridb_qcache_get(qcache, "list series", 0, 0) == qentry);
+    _assert (qentry->in_use);
+    _assert (qcache->hits == 1);
+
+    /* entry is in use, a second query must parse the query itself */
+    _assert (siridb_qcache_get(qcache, "list series", 0, 0) == NULL);
+    other = siridb_qentry_new("list series");
+    _assert (siridb_qcache_put(qcache, other) == -1);
+    siridb_qcache_release(other);
+    siridb_qcache_release(qentry);
+
+    /* most recently used is on top */
+    new_entry(qcache, "select * from *");
+    _assert (siridb_qcache_get(qcache, "list series", 0, 0) == qentry);
+    _assert (qcache->head == qentry);
+    siridb_qcache_release(qentry);
+
+    /* walker output */
+    {
+        siridb_nodes_t n2 = {NULL, NULL, NULL};
+        siridb_nodes_t n1 = {qentry->pr->tree, NULL, &n2};
+        siridb_nodes_t * nodes;
+
+        _assert (siridb_qentry_set_nodes(qentry, &n1) == 0);
+        _assert (qentry->n == 2);
+        nodes = siridb_qentry_get_nodes(qentry);
+        _assert (nodes && nodes->node == qentry->pr->tree);
+        _assert (nodes->next && nodes->next->next == NULL);
+        siridb_nodes_free(nodes);
+    }
+
+    /* a time-zone change drops all entries, also those in use */
+    _assert (siridb_qcache_get(qcache, "list series", 0, 0) == qentry);
+    _assert (siridb_qcache_get(qcache, "list series", 1, 0) == NULL);
+    _assert (qcache->n == 0);
+    _assert (!qentry->cached);
+    siridb_qcache_release(qentry);
+
+    /* precision change */
+    new_entry(qcache, "list series");
+    _assert (siridb_qcache_get(qcache, "list series", 1, 2) == NULL);
+    _assert (qcache->n == 0);
+
+    /* least recently used entries are dropped */
+    for (i = 0; i <= SIRIDB_QCACHE_SIZE; i++)
+    {
+        sprintf(q, "select * from 'series-%d'", i);
+        new_entry(qcache, q);
+    }
+    _assert (qcache->n == SIRIDB_QCACHE_SIZE);
+    _assert (siridb_qcache_get(qcache, "select * from 'series-0'", 1, 2) == NULL);
+    qentry = siridb_qcache_get(qcache, "select * from 'series-1'", 1, 2);
+    _assert (qentry);
+    siridb_qcache_release(qentry);
+
+    /* time literals are bound to the query on a hit */
+    {
+        const char * q1 = "select * from 'a' between 1700000000s and 5";
+        const char * q2 = "select * from 'a' between 1700000060s and 5";
+        cleri_node_t * node;
+
+        qentry = new_expr_entry(qcache, q1);
+        _assert (qentry->exprs->len == 2);
+        _assert (qentry->nlits == 2);
+        node = qentry->lits[0].node;
+        _assert (node && qentry->lits[1].node);
+
+        _assert (siridb_qcache_get(qcache, q2, 1, 2) == qentry);
+        _assert (node->str == q2 + 26 && node->len == 11);
+        siridb_qcache_release(qentry);
+        _assert (node->str == qentry->q + 26);
+
+        /* names are part of the key, a time string is not an integer */
+        _assert (siridb_qcache_get(
+                qcache, "select * from 'b' between 1s and 5", 1, 2) == NULL);
+        _assert (siridb_qcache_get(
+                qcache, "select * from 'a' between 1 and 5", 1, 2) == NULL);
+    }
+
+    /* other literals must be equal, entries with the same key are chained */
+    {
+        const char * q1 = "select filter(> 10) from 'a' between 1s and 2s";
+        const char * q2 = "select filter(> 20) from 'a' between 1s and 2s";
+        siridb_qentry_t * e1 = new_expr_entry(qcache, q1);
+        siridb_qentry_t * e2 = new_expr_entry(qcache, q2);
+
+        _assert (e1->lits[0].node == NULL && e1->lits[1].node);
+        _assert (e2->same == e1);
+        _assert (siridb_qcache_get(qcache, q1, 1, 2) == e1);
+        _assert (siridb_qcache_get(qcache, q2, 1, 2) == e2);
+        siridb_qcache_release(e1);
+        siridb_qcache_release(e2);
+        _assert (siridb_qcache_get(
+                qcache,
+                "select filter(> 30) from 'a' between 3s and 4s",
+                1, 2) == NULL);
+    }
+
+    _assert (siridb_qcache_is_cachable("list series"));
+    _assert (!siridb_qcache_is_cachable(""));
+    _assert (!siridb_qcache_is_cachable("alter user 'x' set password 'y'"));
+    _assert (!siridb_qcache_is_cachable("list series '\x01'"));
+
+    siridb_qcache_free(qcache);
+    cleri_grammar_free(grammar);
+
+    return test_end();
+}
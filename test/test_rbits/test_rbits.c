@@ -0,0 +1,173 @@
+#include "../test.h"
+#include <inttypes.h>
+#include <rbits/rbits.h>
+
+#define TEST_RBITS_MAX (3 * 65536)
+
+static unsigned char ref_a[TEST_RBITS_MAX];
+static unsigned char ref_b[TEST_RBITS_MAX];
+
+static unsigned int test__rbits_seed = 1;
+
+static uint32_t test__rbits_rand(void)
+{
+    test__rbits_seed = test__rbits_seed * 1103515245 + 12345;
+    return (test__rbits_seed / 65536) % 32768;
+}
+
+static int test__rbits_sum_cb(uint32_t id, void * args)
+{
+    *((uint64_t *) args) += id;
+    return 1;
+}
+
+/*
+ * Fill a bitmap and reference with a sparse range in the first container,
+ * a dense range in the second and a mix in the third.
+ */
+static void test__rbits_fill(rbits_t * rbits, unsigned char * ref, int offset)
+{
+    uint32_t i;
+    memset(ref, 0, TEST_RBITS_MAX);
+
+    for (i = 0; i < 500; i++)
+    {
+        uint32_t id = (test__rbits_rand() * 2 + offset) % 65536;
+        ref[id] = 1;
+        rbits_add(rbits, id);
+    }
+    for (i = 65536 + offset; i < 2 * 65536; i += 2)
+    {
+        ref[i] = 1;
+        rbits_add(rbits, i);
+    }
+    for (i = 0; i < 20000; i++)
+    {
+        uint32_t id = 2 * 65536 + test__rbits_rand() * 2;
+        ref[id] = 1;
+        rbits_add(rbits, id);
+    }
+}
+
+static int test__rbits_check(rbits_t * rbits, unsigned char * ref)
+{
+    uint32_t i;
+    size_t n = 0;
+    uint64_t sum = 0, rsum = 0;
+
+    for (i = 0; i < TEST_RBITS_MAX; i++)
+    {
+        if (rbits_has(rbits, i) != ref[i])
+        {
+            return 0;
+        }
+        if (ref[i])
+        {
+            n++;
+            rsum += i;
+        }
+    }
+
+    return (
+        rbits->len == n &&
+        rbits_walk(rbits, test__rbits_sum_cb, &sum) == (int) n &&
+        sum == rsum);
+}
+
+static int test_rbits_add_has_remove(void)
+{
+    test_start("rbits (add, has, remove)");
+
+    rbits_t * rbits = rbits_new();
+    uint32_t i;
+
+    _assert (rbits->len == 0);
+    _assert (rbits_add(rbits, 11) == 1);
+    _assert (rbits_add(rbits, 11) == 0);
+    _assert (rbits_add(rbits, 4294967295) == 1);
+    _assert (rbits_has(rbits, 11));
+    _assert (rbits_has(rbits, 4294967295));
+    _assert (!rbits_has(rbits, 12));
+    _assert (rbits->len == 2);
+    _assert (rbits->n == 2);
+
+    /* force a conversion to a bitset and back */
+    for (i = 0; i < 10000; i++)
+    {
+        _assert (rbits_add(rbits, 70000 + i) == 1);
+    }
+    _assert (rbits->containers[1].tp == RBITS_TP_BITSET);
+    for (i = 0; i < 10000; i++)
+    {
+        _assert (rbits_remove(rbits, 70000 + i) == 1);
+    }
+    _assert (rbits->n == 2);
+    _assert (rbits->len == 2);
+
+    _assert (rbits_remove(rbits, 11) == 1);
+    _assert (rbits_remove(rbits, 11) == 0);
+    _assert (rbits_remove(rbits, 4294967295) == 1);
+    _assert (rbits->len == 0);
+    _assert (rbits->n == 0);
+
+    rbits_free(rbits);
+
+    return test_end();
+}
+
+static int test_rbits_set_operations(void)
+{
+    test_start("rbits (set operations)");
+
+    int tp;
+    uint32_t i;
+
+    for (tp = 0; tp < 4; tp++)
+    {
+        rbits_t * a = rbits_new();
+        rbits_t * b = rbits_new();
+
+        test__rbits_fill(a, ref_a, 0);
+        test__rbits_fill(b, ref_b, tp & 1);
+
+        _assert (test__rbits_check(a, ref_a));
+        _assert (test__rbits_check(b, ref_b));
+
+        switch (tp)
+        {
+        case 0:
+            _assert (rbits_union(a, b) == 0);
+            for (i = 0; i < TEST_RBITS_MAX; i++) ref_a[i] |= ref_b[i];
+            break;
+        case 1:
+            _assert (rbits_intersection(a, b) == 0);
+            for (i = 0; i < TEST_RBITS_MAX; i++) ref_a[i] &= ref_b[i];
+            break;
+        case 2:
+            _assert (rbits_difference(a, b) == 0);
+            for (i = 0; i < TEST_RBITS_MAX; i++) ref_a[i] &= !ref_b[i];
+            break;
+        case 3:
+            _assert (rbits_symmetric_difference(a, b) == 0);
+            for (i = 0; i < TEST_RBITS_MAX; i++) ref_a[i] ^= ref_b[i];
+            break;
+        }
+
+        _assert (test__rbits_check(a, ref_a));
+        _assert (test__rbits_check(b, ref_b));
+
+        rbits_free(a);
+        rbits_free(b);
+    }
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_rbits_add_has_remove() ||
+        test_rbits_set_operations() ||
+        0
+    );
+}
@@ -0,0 +1,354 @@
+#include <math.h>
+#include <unistd.h>
+#include "../test.h"
+#include <siri/db/aggregate.h>
+#include <siri/db/rollup.h>
+
+#define SIRIDB_MAX_SIZE_ERR_MSG 1024
+#define TEST_ROLLUP_FN "/tmp/test_rollup_0000.sdb"
+#define TEST_ROLLUP_RDB "/tmp/test_rollup_0000.rdb"
+#define TEST_ROLLUP_RDB "/tmp/test_rollup_0000.rdb"
+
+static char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+
+static siridb_points_t * test_rollup_points(points_tp tp, size_t n)
+{
+    siridb_points_t * points = siridb_points_new(n, tp);
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        points->data[i].ts = 1 + i * 7;
+        if (tp == TP_INT)
+        {
+            points->data[i].val.int64 = (int64_t) (i * 37 % 101) - 50;
+        }
+        else
+        {
+            points->data[i].val.real = (double) (i * 37 % 101) / 8.0 - 6.0;
+        }
+    }
+    points->len = n;
+    return points;
+}
+
+/*
+ * Returns the points in [start, end) with the aggregate applied.
+ */
+static siridb_points_t * test_rollup_raw(
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        uint64_t start,
+        uint64_t end)
+{
+    siridb_points_t * tmp = siridb_points_new(points->len, points->tp);
+    siridb_points_t * result;
+    size_t i;
+
+    for (i = 0; i < points->len; i++)
+    {
+        if (points->data[i].ts >= start && points->data[i].ts < end)
+        {
+            tmp->data[tmp->len++] = points->data[i];
+        }
+    }
+    result = siridb_aggregate_run(tmp, aggr, err_msg);
+    if (result != tmp)
+    {
+        siridb_points_free(tmp);
+    }
+    return result;
+}
+
+/*
+ * Returns the points in [start, end) with the aggregate applied, using the
+ * rollup record for the buckets in the window and feeding the rest.
+ */
+static siridb_points_t * test_rollup_query(
+        siridb_rollup_t * rollup,
+        siridb_rollup_entry_t * entry,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        uint64_t start,
+        uint64_t end)
+{
+    siridb_rollup_select_t select;
+    siridb_points_t * tmp;
+    size_t i;
+    FILE * fp;
+
+    if (siridb_rollup_select_init(
+            &select,
+            rollup,
+            aggr,
+            points->tp,
+            start,
+            end,
+            err_msg))
+    {
+        return NULL;
+    }
+
+    fp = fopen(TEST_ROLLUP_RDB, "r");
+    if (fp == NULL || siridb_rollup_select_read(
+            &select, fp, TEST_ROLLUP_FN, entry))
+    {
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        siridb_rollup_select_destroy(&select);
+        return NULL;
+    }
+    fclose(fp);
+
+    tmp = siridb_points_new(points->len, points->tp);
+    for (i = 0; i < points->len; i++)
+    {
+        if (points->data[i].ts >= start && points->data[i].ts < end && (
+                points->data[i].ts <= select.a ||
+                points->data[i].ts > select.b))
+        {
+            tmp->data[tmp->len++] = points->data[i];
+        }
+    }
+
+    if (siridb_rollup_select_feed(&select, tmp))
+    {
+        siridb_rollup_select_destroy(&select);
+        siridb_points_free(tmp);
+        return NULL;
+    }
+    siridb_points_free(tmp);
+
+    return siridb_rollup_select_finish(&select);
+}
+
+static int test_rollup_equal(siridb_points_t * a, siridb_points_t * b)
+{
+    size_t i;
+
+    if (a == NULL || b == NULL || a->len != b->len || a->tp != b->tp)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < a->len; i++)
+    {
+        if (a->data[i].ts != b->data[i].ts)
+        {
+            return 0;
+        }
+        if (a->tp == TP_INT && a->data[i].val.int64 != b->data[i].val.int64)
+        {
+            return 0;
+        }
+        /* the order of additions for a double sum is different */
+        if (a->tp == TP_DOUBLE &&
+            fabs(a->data[i].val.real - b->data[i].val.real) > 1e-9)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int test_rollup_tiers(void)
+{
+    test_start("rollup (tiers)");
+
+    siridb_rollup_t * rollup;
+    const char * invalid[] = {
+            "",
+            " , ",
+            "5x",
+            "0m",
+            "m",
+            "5m,300",
+            "1s,2s,3s,4s,5s",
+    };
+    size_t i;
+
+    rollup = siridb_rollup_new("5m, 1h", 1);
+    _assert (rollup != NULL && rollup->n == 2);
+    _assert (rollup->intervals[0] == 300 && rollup->intervals[1] == 3600);
+    siridb_rollup_free(rollup);
+
+    /* tiers are sorted and converted to the time precision */
+    rollup = siridb_rollup_new("1d,1h,90", 1000);
+    _assert (rollup != NULL && rollup->n == 3);
+    _assert (rollup->intervals[0] == 90000);
+    _assert (rollup->intervals[1] == 3600000);
+    _assert (rollup->intervals[2] == 86400000);
+    siridb_rollup_free(rollup);
+
+    for (i = 0; i < sizeof(invalid) / sizeof(char *); i++)
+    {
+        _assert (siridb_rollup_new(invalid[i], 1) == NULL);
+    }
+
+    return test_end();
+}
+
+static int test_rollup_file(void)
+{
+    test_start("rollup (file)");
+
+    siridb_rollup_t * rollup = siridb_rollup_new("5m,1h", 1);
+    siridb_points_t * points = test_rollup_points(TP_INT, 5000);
+    siridb_rollup_entry_t * a, * b;
+    imap_t * rollups = NULL;
+    imap_t * loaded = NULL;
+    FILE * fp;
+
+    siridb_rollup_remove(TEST_ROLLUP_FN);
+
+    _assert (siridb_rollup_build(
+            rollup, &rollups, TEST_ROLLUP_FN, 1, points) == 0);
+    _assert (siridb_rollup_build(
+            rollup, &rollups, TEST_ROLLUP_FN, 2, points) == 0);
+
+    _assert (siridb_rollup_load(&loaded, TEST_ROLLUP_FN) == 0);
+    _assert (loaded != NULL && loaded->len == 2);
+
+    a = imap_get(rollups, 2);
+    b = imap_get(loaded, 2);
+    _assert (a != NULL && b != NULL);
+    _assert (a->pos == b->pos && a->pos > 0);
+    _assert (a->npoints == 5000 && b->npoints == 5000);
+    imap_free(loaded, free);
+    loaded = NULL;
+
+    /* an incomplete record at the end is ignored */
+    fp = fopen(TEST_ROLLUP_RDB, "a");
+    _assert (fp != NULL && fwrite("\1\0\0\0\1", 5, 1, fp) == 1);
+    fclose(fp);
+
+    _assert (siridb_rollup_load(&loaded, TEST_ROLLUP_FN) == 0);
+    _assert (loaded != NULL && loaded->len == 2);
+    imap_free(loaded, free);
+    imap_free(rollups, free);
+
+    siridb_rollup_remove(TEST_ROLLUP_FN);
+    _assert (access(TEST_ROLLUP_RDB, F_OK) != 0);
+
+    siridb_rollup_free(rollup);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+static int test_rollup_select_tp(points_tp tp)
+{
+    siridb_rollup_t * rollup = siridb_rollup_new("5m,1h", 1);
+    siridb_points_t * points = test_rollup_points(tp, 5000);
+    siridb_points_t * raw, * rpoints;
+    siridb_rollup_entry_t * entry;
+    imap_t * rollups = NULL;
+    siridb_aggr_t aggr;
+    uint32_t gids[] = {
+            CLERI_GID_F_COUNT,
+            CLERI_GID_F_SUM,
+            CLERI_GID_F_MIN,
+            CLERI_GID_F_MAX,
+            CLERI_GID_F_MEAN,
+    };
+    uint64_t group_by[] = {300, 900, 3600, 7200};
+    size_t i, j;
+
+    siridb_rollup_remove(TEST_ROLLUP_FN);
+    _assert (siridb_rollup_build(
+            rollup, &rollups, TEST_ROLLUP_FN, 1, points) == 0);
+    entry = imap_get(rollups, 1);
+
+    memset(&aggr, 0, sizeof(siridb_aggr_t));
+
+    for (i = 0; i < sizeof(gids) / sizeof(uint32_t); i++)
+    {
+        for (j = 0; j < sizeof(group_by) / sizeof(uint64_t); j++)
+        {
+            aggr.gid = gids[i];
+            aggr.group_by = group_by[j];
+
+            raw = test_rollup_raw(points, &aggr, 1234, 30001);
+            rpoints = test_rollup_query(
+                    rollup, entry, points, &aggr, 1234, 30001);
+            _assert (test_rollup_equal(raw, rpoints));
+            siridb_points_free(raw);
+            siridb_points_free(rpoints);
+        }
+    }
+
+    /* a group-by which is not a multiple of a tier cannot be used */
+    aggr.gid = CLERI_GID_F_MEAN;
+    aggr.group_by = 450;
+    _assert (test_rollup_query(
+            rollup, entry, points, &aggr, 1234, 30001) == NULL);
+
+    /* groups are not aligned to the buckets when an offset is used */
+    aggr.group_by = 3600;
+    aggr.offset = 60;
+    _assert (test_rollup_query(
+            rollup, entry, points, &aggr, 1234, 30001) == NULL);
+    aggr.offset = 0;
+
+    /* other aggregates cannot be used */
+    aggr.gid = CLERI_GID_F_MEDIAN;
+    aggr.group_by = 3600;
+    _assert (test_rollup_query(
+            rollup, entry, points, &aggr, 1234, 30001) == NULL);
+
+    imap_free(rollups, free);
+    siridb_rollup_remove(TEST_ROLLUP_FN);
+    siridb_rollup_free(rollup);
+    siridb_points_free(points);
+
+    return 0;
+}
+
+static int test_rollup_select(void)
+{
+    test_start("rollup (select)");
+
+    siridb_init_aggregates();
+
+    _assert (test_rollup_select_tp(TP_INT) == 0);
+    _assert (test_rollup_select_tp(TP_DOUBLE) == 0);
+
+    return test_end();
+}
+
+static int test_rollup_overflow(void)
+{
+    test_start("rollup (overflow)");
+
+    siridb_rollup_t * rollup = siridb_rollup_new("5m", 1);
+    siridb_points_t * points = test_rollup_points(TP_INT, 4);
+    imap_t * rollups = NULL;
+
+    /* a bucket with an integer sum which overflows is not written */
+    points->data[0].val.int64 = INT64_MAX;
+    points->data[1].val.int64 = 1;
+
+    siridb_rollup_remove(TEST_ROLLUP_FN);
+    _assert (siridb_rollup_build(
+            rollup, &rollups, TEST_ROLLUP_FN, 1, points) == -1);
+    _assert (rollups == NULL);
+    _assert (access(TEST_ROLLUP_RDB, F_OK) != 0);
+
+    siridb_rollup_free(rollup);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_rollup_tiers() ||
+        test_rollup_file() ||
+        test_rollup_select() ||
+        test_rollup_overflow() ||
+        0
+    );
+}
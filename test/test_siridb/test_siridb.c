@@ -1,7 +1,18 @@
 #include "../test.h"
 #include <locale.h>
+#include <omap/omap.h>
+#include <siri/cfg/cfg.h>
+#include <siri/db/buffer.h>
 #include <siri/db/series.h>
+#include <siri/db/server.h>
 #include <siri/db/shard.h>
+#include <siri/db/time.h>
+#include <siri/file/handler.h>
+#include <siri/siri.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_BUFFER_SZ 512
 
 
 static int test_series_ensure_type(void)
@@ -113,10 +124,557 @@ static int test_series_ensure_type(void)
     return test_end();
 };
 
+/*
+ * Write a buffer slot for a series with a number of points.
+ */
+static void test_buffer_slot(
+        FILE * fp,
+        uint32_t series_id,
+        uint64_t n)
+{
+    char slot[TEST_BUFFER_SZ];
+    uint64_t i, ts, val;
+
+    memset(slot, 0xff, TEST_BUFFER_SZ);
+    memset(slot, 0, sizeof(uint32_t));
+    memcpy(slot + 4, &series_id, sizeof(uint32_t));
+
+    for (i = 0; i < n; i++)
+    {
+        ts = 1000 + i;
+        val = i * 10;
+        memcpy(slot + 8 + i * 16, &ts, sizeof(uint64_t));
+        memcpy(slot + 16 + i * 16, &val, sizeof(uint64_t));
+    }
+    fwrite(slot, TEST_BUFFER_SZ, 1, fp);
+}
+
+static int test_buffer_load(void)
+{
+    test_start("siridb (buffer_load)");
+
+    char path[] = "/tmp/siridb-test-buffer-XXXXXX";
+    char fn[sizeof(path) + 16];
+    char zeros[TEST_BUFFER_SZ] = {0};
+    siri_cfg_t cfg = {0};
+    siridb_t siridb;
+    siridb_series_t * series[2];
+    FILE * fp;
+    size_t i;
+
+    siri.cfg = &cfg;
+    _assert (mkdtemp(path) != NULL);
+    snprintf(fn, sizeof(fn), "%s/buffer.dat", path);
+
+    /* used in place, series 3 is dropped and one slot is never used */
+    {
+        memset(&siridb, 0, sizeof(siridb_t));
+        siridb.series_map = imap_new();
+        siridb.buffer = siridb_buffer_new();
+        siridb_buffer_set_path(siridb.buffer, path);
+        siridb.buffer->size = TEST_BUFFER_SZ;
+
+        for (i = 0; i < 2; i++)
+        {
+            series[i] = calloc(1, sizeof(siridb_series_t));
+            series[i]->id = i + 1;
+            series[i]->tp = TP_INT;
+            imap_add(siridb.series_map, series[i]->id, series[i]);
+        }
+
+        _assert ((fp = fopen(fn, "w")) != NULL);
+        test_buffer_slot(fp, 1, 2);
+        fwrite(zeros, TEST_BUFFER_SZ, 1, fp);
+        test_buffer_slot(fp, 3, 5);
+        test_buffer_slot(fp, 2, 0);
+        fclose(fp);
+
+        _assert (siridb_buffer_load(&siridb) == 0);
+
+        _assert (series[0]->bf_offset == 0);
+        _assert (series[0]->buffer->len == 2);
+        _assert (series[0]->length == 2);
+        _assert (series[0]->buffer->data[1].ts == 1001);
+        _assert (series[0]->buffer->data[1].val.int64 == 10);
+        _assert (series[1]->bf_offset == 3 * TEST_BUFFER_SZ);
+        _assert (series[1]->buffer->len == 0);
+        _assert (siridb.buffer->empty->len == 2);
+        _assert ((size_t) siridb.buffer->empty->data[0] == TEST_BUFFER_SZ);
+        _assert ((size_t) siridb.buffer->empty->data[1] == 2 * TEST_BUFFER_SZ);
+
+        /* the file is not rewritten */
+        _assert ((fp = fopen(fn, "r")) != NULL);
+        _assert (fseek(fp, 0, SEEK_END) == 0);
+        _assert (ftell(fp) == 4 * TEST_BUFFER_SZ);
+        fclose(fp);
+
+        for (i = 0; i < 2; i++)
+        {
+            siridb_buffer_points_free(siridb.buffer, series[i]->buffer);
+        }
+        siridb_buffer_free(siridb.buffer);
+        imap_free(siridb.series_map, free);
+    }
+
+    /* compacted since more than half of the slots are empty */
+    {
+        memset(&siridb, 0, sizeof(siridb_t));
+        siridb.series_map = imap_new();
+        siridb.buffer = siridb_buffer_new();
+        siridb_buffer_set_path(siridb.buffer, path);
+        siridb.buffer->size = TEST_BUFFER_SZ;
+
+        series[0] = calloc(1, sizeof(siridb_series_t));
+        series[0]->id = 1;
+        series[0]->tp = TP_INT;
+        imap_add(siridb.series_map, series[0]->id, series[0]);
+
+        _assert ((fp = fopen(fn, "w")) != NULL);
+        for (i = 0; i < 100; i++)
+        {
+            fwrite(zeros, TEST_BUFFER_SZ, 1, fp);
+        }
+        test_buffer_slot(fp, 1, 3);
+        fclose(fp);
+
+        _assert (siridb_buffer_load(&siridb) == 0);
+
+        _assert (series[0]->bf_offset == 0);
+        _assert (series[0]->buffer->len == 3);
+        _assert (siridb.buffer->empty->len == 0);
+
+        _assert ((fp = fopen(fn, "r")) != NULL);
+        _assert (fseek(fp, 0, SEEK_END) == 0);
+        _assert (ftell(fp) == TEST_BUFFER_SZ);
+        fclose(fp);
+
+        siridb_buffer_points_free(siridb.buffer, series[0]->buffer);
+        siridb_buffer_free(siridb.buffer);
+        imap_free(siridb.series_map, free);
+    }
+
+    _assert (unlink(fn) == 0);
+    _assert (rmdir(path) == 0);
+    siri.cfg = NULL;
+
+    return test_end();
+}
+
+static int test_series_stream_points(void)
+{
+    test_start("siridb (series_stream_points)");
+
+    char err_msg[128];
+    siridb_aggr_t aggr = {0};
+    siridb_aggr_stream_t stream;
+    siridb_series_t * series = calloc(1, sizeof(siridb_series_t));
+    siridb_points_t * points;
+    siridb_t siridb;
+    uint64_t start_ts = 2, end_ts = 9;
+    uint64_t ts;
+    qp_via_t val;
+
+    siridb_init_aggregates();
+
+    /* the series mutex is released while the points are aggregated */
+    memset(&siridb, 0, sizeof(siridb_t));
+    uv_mutex_init(&siridb.series_mutex);
+    uv_mutex_lock(&siridb.series_mutex);
+
+    series->siridb = &siridb;
+    series->tp = TP_INT;
+    series->buffer = siridb_points_new(10, TP_INT);
+    for (ts = 1; ts <= 10; ts++)
+    {
+        val.int64 = (int64_t) ts * 10;
+        siridb_points_add_point(series->buffer, &ts, &val);
+    }
+
+    aggr.gid = CLERI_GID_F_SUM;
+    aggr.group_by = 4;
+
+    /* the buffer is cropped to [2, 9) */
+    _assert (siridb_aggregate_stream_init(
+            &stream,
+            &aggr,
+            TP_INT,
+            err_msg) == 0);
+    _assert (siridb_series_stream_points(
+            series,
+            &start_ts,
+            &end_ts,
+            &stream) == 0);
+    _assert (stream.n == 7);
+
+    points = siridb_aggregate_stream_finish(&stream);
+    _assert (points != NULL && points->len == 2);
+    _assert (points->data[0].ts == 4 && points->data[0].val.int64 == 90);
+    _assert (points->data[1].ts == 8 && points->data[1].val.int64 == 260);
+
+    /* the buffer is not changed */
+    _assert (series->buffer->len == 10);
+    _assert (series->buffer->data[1].val.int64 == 20);
+
+    /* overlapping chunks cannot be read in order */
+    series->flags |= SIRIDB_SERIES_HAS_OVERLAP;
+    _assert (siridb_aggregate_stream_init(
+            &stream,
+            &aggr,
+            TP_INT,
+            err_msg) == 0);
+    _assert (siridb_series_stream_points(
+            series,
+            NULL,
+            NULL,
+            &stream) == 1);
+    _assert (stream.n == 0);
+    siridb_aggregate_stream_destroy(&stream);
+
+    /* the mutex is still locked */
+    _assert (uv_mutex_trylock(&siridb.series_mutex) != 0);
+    uv_mutex_unlock(&siridb.series_mutex);
+    uv_mutex_destroy(&siridb.series_mutex);
+
+    siridb_points_free(points);
+    siridb_points_free(series->buffer);
+    free(series);
+
+    return test_end();
+}
+
+static int test_series_remove_shards(void)
+{
+    test_start("siridb (series_remove_shards)");
+
+    siridb_shard_t shards[4];
+    siridb_series_t * series = calloc(1, sizeof(siridb_series_t));
+    vec_t * remove = vec_new(2);
+    siridb_t siridb;
+    size_t i;
+
+    memset(&siridb, 0, sizeof(siridb_t));
+    memset(shards, 0, sizeof(shards));
+
+    series->tp = TP_INT;
+    series->mask = 5;
+    series->idx_len = 5;
+    series->idx = calloc(series->idx_len, sizeof(idx_t));
+
+    /* shards [0, 100), [100, 200), [200, 300) and [300, 400) */
+    for (i = 0; i < 4; i++)
+    {
+        shards[i].ref = 3;
+        shards[i].duration = 100;
+        shards[i].id = i * 100 + series->mask;
+    }
+
+    /* the second shard has two chunks */
+    series->idx[0] = (idx_t) {.shard=&shards[0], .len=10, .start_ts=10};
+    series->idx[1] = (idx_t) {.shard=&shards[1], .len=10, .start_ts=110};
+    series->idx[2] = (idx_t) {.shard=&shards[1], .len=10, .start_ts=150};
+    series->idx[3] = (idx_t) {.shard=&shards[2], .len=10, .start_ts=210};
+    series->idx[4] = (idx_t) {.shard=&shards[3], .len=10, .start_ts=310};
+    for (i = 0; i < series->idx_len; i++)
+    {
+        series->idx[i].end_ts = series->idx[i].start_ts + 20;
+    }
+    series->length = 50;
+    series->start = 10;
+    series->end = 330;
+
+    /* the list of shards must be sorted by address */
+    vec_append(remove, &shards[0]);
+    vec_append(remove, &shards[1]);
+
+    _assert (siridb_series_remove_shards(&siridb, series, remove) == 0);
+    _assert (series->idx_len == 2);
+    _assert (series->length == 20);
+    _assert (series->idx[0].shard == &shards[2]);
+    _assert (series->idx[1].shard == &shards[3]);
+    _assert (series->start == 210);
+    _assert (series->end == 330);
+
+    /* a reference is released for each chunk */
+    _assert (shards[0].ref == 2);
+    _assert (shards[1].ref == 1);
+    _assert (shards[2].ref == 3);
+
+    /* nothing is removed the second time */
+    _assert (siridb_series_remove_shards(&siridb, series, remove) == 0);
+    _assert (series->idx_len == 2);
+
+    vec_free(remove);
+    free(series->idx);
+    free(series);
+
+    return test_end();
+}
+
+static int test_shard_drop_slices(void)
+{
+    test_start("siridb (shard_drop_slices)");
+
+    char path[] = "/tmp/siridb-test-drop-XXXXXX";
+    char fn[sizeof(path) + 16];
+    char buf[256];
+    siridb_shard_drop_t * drop;
+    siridb_series_t * series;
+    siridb_shard_t * shard = calloc(1, sizeof(siridb_shard_t));
+    siridb_points_t * points;
+    omap_t * omap = omap_create();
+    vec_t * shards = vec_new(1);
+    FILE * log = tmpfile();
+    siridb_t siridb;
+    uint64_t ts;
+    qp_via_t val;
+    uint32_t id;
+
+    /* nothing may be logged while reading between the slices */
+    logger_init(log, LOGGER_WARNING);
+    siri.fh = siri_fh_new(8);
+
+    memset(&siridb, 0, sizeof(siridb_t));
+    uv_mutex_init(&siridb.series_mutex);
+    uv_mutex_init(&siridb.shards_mutex);
+    siridb.series_map = imap_new();
+    siridb.shards = imap_new();
+
+    _assert (mkdtemp(path) != NULL);
+    snprintf(fn, sizeof(fn), "%s/5.sdb", path);
+    fclose(fopen(fn, "w"));
+
+    shard->ref = 3;
+    shard->id = 5;
+    shard->duration = 100;
+    shard->tp = SIRIDB_SHARD_TP_NUMBER;
+    shard->fp = siri_fp_new();
+    shard->fn = strdup(fn);
+    omap_add(omap, shard->duration, shard);
+    imap_add(siridb.shards, shard->id, omap);
+
+    /* more series than a single slice */
+    for (id = 1; id <= 10000; id++)
+    {
+        series = calloc(1, sizeof(siridb_series_t));
+        series->ref = 1;
+        series->id = id;
+        series->tp = TP_INT;
+        imap_add(siridb.series_map, id, series);
+    }
+
+    vec_append(shards, shard);
+    drop = siridb_shard_drop_new(shards, &siridb);
+    _assert (drop != NULL);
+    _assert (shard->flags & SIRIDB_SHARD_IS_REMOVED);
+    _assert (access(fn, F_OK) != 0);
+
+    /* the last series in the pass has two chunks in the shard */
+    series = drop->series->data[drop->series->len - 1];
+    series->mask = 5;
+    series->idx_len = 2;
+    series->idx = calloc(series->idx_len, sizeof(idx_t));
+    series->idx[0] = (idx_t) {.shard=shard, .len=10, .start_ts=10};
+    series->idx[1] = (idx_t) {.shard=shard, .len=10, .start_ts=50};
+    series->idx[0].end_ts = 40;
+    series->idx[1].end_ts = 80;
+    series->buffer = siridb_points_new(2, TP_INT);
+    for (ts = 110; ts < 112; ts++)
+    {
+        val.int64 = (int64_t) ts;
+        siridb_points_add_point(series->buffer, &ts, &val);
+    }
+    series->length = 22;
+    series->start = 10;
+    series->end = 111;
+
+    /* the first slice does not reach the series */
+    _assert (siridb_shard_drop_work(drop) == 1);
+    _assert (series->idx_len == 2);
+
+    /* a select between the slices skips the chunks of the removed shard */
+    uv_mutex_lock(&siridb.series_mutex);
+    points = siridb_series_get_points(series, NULL, NULL);
+    uv_mutex_unlock(&siridb.series_mutex);
+
+    _assert (points != NULL && points->len == 2);
+    _assert (points->data[0].ts == 110);
+    _assert (shard->fp->fp == NULL);
+    siridb_points_free(points);
+
+    _assert (siridb_shard_drop_work(drop) == 0);
+    _assert (series->idx_len == 0);
+    _assert (series->length == 2);
+    _assert (series->start == 110);
+    _assert (shard->ref == 1);
+
+    siridb_shard_drop_free(drop);
+
+    fflush(log);
+    rewind(log);
+    _assert (fgets(buf, sizeof(buf), log) == NULL);
+
+    siridb_points_free(series->buffer);
+    free(series->idx);
+    series->buffer = NULL;
+    imap_free(siridb.series_map, free);
+    imap_free(siridb.shards, NULL);
+    vec_free(shards);
+    siri_fh_free(siri.fh);
+    siri.fh = NULL;
+    uv_mutex_destroy(&siridb.series_mutex);
+    uv_mutex_destroy(&siridb.shards_mutex);
+    _assert (rmdir(path) == 0);
+    logger_init(stderr, LOGGER_CRITICAL);
+    fclose(log);
+
+    return test_end();
+}
+
+static void test_series_file(
+        const char * fn,
+        const char * mode,
+        const char ** names,
+        uint32_t first_id,
+        size_t n)
+{
+    FILE * fp = qp_open(fn, mode);
+    size_t i;
+
+    if (*mode == 'w')
+    {
+        qp_fadd_type(fp, QP_ARRAY_OPEN);
+        qp_fadd_int64(fp, 1);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        qp_fadd_type(fp, QP_ARRAY3);
+        qp_fadd_raw(fp, (const unsigned char *) names[i], strlen(names[i]) + 1);
+        qp_fadd_int64(fp, first_id + i);
+        qp_fadd_int64(fp, TP_INT);
+    }
+
+    qp_close(fp);
+}
+
+static void test_series_db_init(siridb_t * siridb, char * dbpath)
+{
+    memset(siridb, 0, sizeof(siridb_t));
+    siridb->dbpath = dbpath;
+    siridb->server = calloc(1, sizeof(siridb_server_t));
+    siridb->time = siridb_time_new(SIRIDB_TIME_MILLISECONDS);
+    siridb->series = ct_new();
+    siridb->series_map = imap_new();
+    siridb->shard_mask_num = 8;
+    siridb->shard_mask_log = 1;
+}
+
+static void test_series_db_free(siridb_t * siridb)
+{
+    fclose(siridb->dropped_fp);
+    qp_close(siridb->store);
+    ct_free(siridb->series, NULL);
+    imap_free(siridb->series_map, free);
+    free(siridb->time);
+    free(siridb->server);
+}
+
+static int64_t test_file_mtime(const char * fn)
+{
+    struct stat st;
+    return stat(fn, &st) ?
+            -1 : (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static int test_series_load(void)
+{
+    test_start("siridb (series_load)");
+
+    const char * names[] = {"cpu", "mem", "disk", "net"};
+    char path[] = "/tmp/siridb-test-series-XXXXXX";
+    char dbpath[sizeof(path) + 1];
+    char fn[sizeof(path) + 16];
+    char snap_fn[sizeof(path) + 16];
+    siridb_series_t * series;
+    siridb_t siridb;
+    int64_t mtime;
+
+    /* an unused snapshot is logged as a warning */
+    logger_init(stderr, LOGGER_CRITICAL);
+    _assert (mkdtemp(path) != NULL);
+    snprintf(dbpath, sizeof(dbpath), "%s/", path);
+    snprintf(fn, sizeof(fn), "%s/series.dat", path);
+    snprintf(snap_fn, sizeof(snap_fn), "%s/series.snap", path);
+
+    /* the series file is converted on the first start */
+    {
+        test_series_file(fn, "w", names, 1, 3);
+        test_series_db_init(&siridb, dbpath);
+
+        _assert (siridb_series_load(&siridb) == 0);
+        _assert (siridb.series_map->len == 3);
+        _assert (siridb.max_series_id == 3);
+        _assert (access(snap_fn, F_OK) == 0);
+
+        test_series_db_free(&siridb);
+    }
+
+    /* series appended after the snapshot are read from the series file */
+    {
+        test_series_file(fn, "a", names + 3, 4, 1);
+        mtime = test_file_mtime(fn);
+        test_series_db_init(&siridb, dbpath);
+
+        _assert (siridb_series_load(&siridb) == 0);
+        _assert (siridb.series_map->len == 4);
+        _assert (siridb.max_series_id == 4);
+        series = ct_get(siridb.series, "disk");
+        _assert (series != NULL && series->id == 3);
+        series = ct_get(siridb.series, "net");
+        _assert (series != NULL && series->id == 4);
+        _assert (series->name_len == 3);
+
+        /* the series file is not rewritten */
+        _assert (test_file_mtime(fn) == mtime);
+
+        test_series_db_free(&siridb);
+    }
+
+    /* a snapshot which does not match the series file is not used */
+    {
+        test_series_file(fn, "w", names + 2, 10, 2);
+        test_series_file(fn, "a", names, 12, 2);
+        test_series_db_init(&siridb, dbpath);
+
+        _assert (siridb_series_load(&siridb) == 0);
+        _assert (siridb.series_map->len == 4);
+        _assert (siridb.max_series_id == 13);
+        series = ct_get(siridb.series, "cpu");
+        _assert (series != NULL && series->id == 12);
+
+        test_series_db_free(&siridb);
+    }
+
+    _assert (unlink(fn) == 0);
+    _assert (unlink(snap_fn) == 0);
+    snprintf(fn, sizeof(fn), "%s/.dropped", path);
+    _assert (unlink(fn) == 0);
+    snprintf(fn, sizeof(fn), "%s/.max_series_id", path);
+    _assert (unlink(fn) == 0);
+    _assert (rmdir(path) == 0);
+
+    return test_end();
+}
+
 int main()
 {
     return (
         test_series_ensure_type() ||
+        test_buffer_load() ||
+        test_series_load() ||
+        test_series_stream_points() ||
+        test_series_remove_shards() ||
+        test_shard_drop_slices() ||
         0
     );
 };
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "../test.h"
+#include <inttypes.h>
+#include <slab/slab.h>
+
+#define TEST_SLAB_N 10000
+
+static int test_slab_alloc_release(void)
+{
+    test_start("slab (alloc, release)");
+
+    slab_t * slab = slab_new(3);
+    uint64_t * items[TEST_SLAB_N];
+    size_t i;
+
+    /* item size is at least a pointer size */
+    _assert (slab->item_sz == sizeof(void *));
+
+    for (i = 0; i < TEST_SLAB_N; i++)
+    {
+        items[i] = (uint64_t *) slab_alloc(slab);
+        _assert (items[i] != NULL);
+        *items[i] = i;
+    }
+    _assert (slab->len == TEST_SLAB_N);
+
+    for (i = 0; i < TEST_SLAB_N; i++)
+    {
+        _assert (*items[i] == i);
+    }
+
+    for (i = 0; i < TEST_SLAB_N; i += 2)
+    {
+        slab_release(slab, items[i]);
+    }
+    _assert (slab->len == TEST_SLAB_N / 2);
+
+    /* released items must be re-used before new chunks are created */
+    size_t nchunks = slab->nchunks;
+    for (i = 0; i < TEST_SLAB_N; i += 2)
+    {
+        items[i] = (uint64_t *) slab_calloc(slab);
+        _assert (items[i] != NULL && *items[i] == 0);
+    }
+    _assert (slab->nchunks == nchunks);
+    _assert (slab->len == TEST_SLAB_N);
+
+    for (i = 1; i < TEST_SLAB_N; i += 2)
+    {
+        _assert (*items[i] == i);
+    }
+
+    slab_release(slab, NULL);
+    _assert (slab->len == TEST_SLAB_N);
+
+    slab_free(slab);
+    slab_free(NULL);
+
+    return test_end();
+}
+
+static int test_slab_merge(void)
+{
+    test_start("slab (merge)");
+
+    slab_t * a = slab_new(sizeof(uint64_t));
+    slab_t * b = slab_new(sizeof(uint64_t));
+    slab_t * c = slab_new(sizeof(uint64_t));
+    uint64_t * items[TEST_SLAB_N];
+    size_t i;
+
+    for (i = 0; i < TEST_SLAB_N; i++)
+    {
+        items[i] = (uint64_t *) slab_alloc((i & 1) ? b : a);
+        *items[i] = i;
+    }
+    slab_release(b, items[1]);
+
+    slab_merge(a, b);
+    _assert (a->len == TEST_SLAB_N - 1);
+
+    /* items allocated from 'b' can be released to 'a' */
+    slab_release(a, items[3]);
+    _assert (a->len == TEST_SLAB_N - 2);
+
+    for (i = 4; i < TEST_SLAB_N; i++)
+    {
+        _assert (*items[i] == i);
+    }
+
+    /* merging an empty slab */
+    slab_merge(a, c);
+    _assert (a->len == TEST_SLAB_N - 2);
+
+    _assert (slab_size(a) > (TEST_SLAB_N - 2) * sizeof(uint64_t));
+
+    slab_free(a);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_slab_alloc_release() ||
+        test_slab_merge() ||
+        0
+    );
+}
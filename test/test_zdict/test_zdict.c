@@ -0,0 +1,247 @@
+#include "../test.h"
+#include <siri/db/zdict.h>
+
+static const char * test_zdict_levels[] = {"INFO", "DEBUG", "WARNING"};
+static const char * test_zdict_paths[] = {
+        "/api/v1/series",
+        "/api/v1/query",
+        "/api/v1/insert",
+        "/health",
+};
+
+static uint32_t test_zdict_seed = 42;
+
+static uint32_t test_zdict_rand(void)
+{
+    test_zdict_seed = test_zdict_seed * 1103515245 + 12345;
+    return test_zdict_seed >> 8;
+}
+
+static siridb_points_t * test_zdict_logs(size_t n, const char * extra)
+{
+    siridb_points_t * points = siridb_points_new(n, TP_STRING);
+    char buf[256];
+    uint32_t r;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        r = test_zdict_rand();
+        snprintf(buf, sizeof(buf),
+                "2026-10-18 12:%02u:%02u %s [worker-%u] GET %s/%u "
+                "completed in %u ms%s",
+                r % 60, (r >> 6) % 60,
+                test_zdict_levels[r % 3],
+                (r >> 12) % 8,
+                test_zdict_paths[(r >> 15) % 4],
+                r % 100000,
+                (r >> 3) % 1000,
+                extra);
+        points->data[i].ts = 1000 + i * 10;
+        points->data[i].val.str = strdup(buf);
+    }
+    points->len = n;
+    return points;
+}
+
+static siridb_points_t * test_zdict_random(size_t n)
+{
+    siridb_points_t * points = siridb_points_new(n, TP_STRING);
+    char buf[48];
+    size_t i, j;
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < sizeof(buf) - 1; j++)
+        {
+            buf[j] = 33 + test_zdict_rand() % 94;
+        }
+        buf[j] = '\0';
+        points->data[i].ts = i;
+        points->data[i].val.str = strdup(buf);
+    }
+    points->len = n;
+    return points;
+}
+
+/*
+ * Returns the zipped size, or 0 when the points are not equal after unzip.
+ */
+static size_t test_zdict_roundtrip(
+        siridb_points_t * points,
+        siridb_zdict_t * zdict)
+{
+    siridb_points_t * dest = siridb_points_new(points->len, TP_STRING);
+    unsigned char * bits;
+    uint16_t cinfo;
+    size_t i, size;
+
+    bits = siridb_points_zip_string(
+            points, 0, points->len, &cinfo, &size, zdict);
+    if (bits == NULL || siridb_points_unzip_string(
+            dest, bits, points->len, NULL, NULL, 0, zdict))
+    {
+        size = 0;
+    }
+
+    for (i = 0; size && i < points->len; i++)
+    {
+        if (dest->data[i].ts != points->data[i].ts ||
+            strcmp(dest->data[i].val.str, points->data[i].val.str))
+        {
+            size = 0;
+        }
+    }
+
+    free(bits);
+    siridb_points_free(dest);
+    return size;
+}
+
+static int test_zdict_train(void)
+{
+    test_start("zdict (train)");
+
+    siridb_points_t * points = test_zdict_logs(2000, "");
+    siridb_zdict_t * zdict = siridb_zdict_train(points);
+
+    _assert (zdict != NULL);
+    _assert (zdict->len > 0 && zdict->len <= SIRIDB_ZDICT_MAX_SZ);
+    _assert (zdict->len % 64 == 0);
+    siridb_zdict_free(zdict);
+    siridb_points_free(points);
+
+    /* a sample which is too small */
+    points = test_zdict_logs(2, "");
+    _assert (siridb_zdict_train(points) == NULL);
+    siridb_points_free(points);
+
+    /* a sample without redundancy */
+    points = test_zdict_random(3000);
+    _assert (siridb_zdict_train(points) == NULL);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+static int test_zdict_zip(void)
+{
+    test_start("zdict (zip)");
+
+    siridb_points_t * sample = test_zdict_logs(2000, "");
+    siridb_points_t * ascii = test_zdict_logs(64, "");
+    siridb_points_t * utf8 = test_zdict_logs(64, " (caf\xc3\xa9)");
+    siridb_zdict_t * zdict = siridb_zdict_train(sample);
+    size_t plain, dict;
+
+    _assert (zdict != NULL);
+
+    plain = test_zdict_roundtrip(ascii, NULL);
+    dict = test_zdict_roundtrip(ascii, zdict);
+    _assert (plain && dict && dict < plain);
+
+    plain = test_zdict_roundtrip(utf8, NULL);
+    dict = test_zdict_roundtrip(utf8, zdict);
+    _assert (plain && dict && dict < plain);
+
+    siridb_zdict_free(zdict);
+    siridb_points_free(sample);
+    siridb_points_free(ascii);
+    siridb_points_free(utf8);
+
+    return test_end();
+}
+
+static int test_zdict_short(void)
+{
+    test_start("zdict (short)");
+
+    /* a dictionary shorter than the hashed sequences is valid */
+    siridb_points_t * points = test_zdict_logs(8, "");
+    siridb_zdict_t * zdict = siridb_zdict_new(3);
+
+    memcpy(zdict->data, "GET", 3);
+    _assert (test_zdict_roundtrip(points, zdict));
+
+    siridb_zdict_free(zdict);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+/*
+ * Zipped by the encoder before the hash table was made thread local, which
+ * looked up 'dictionary[POINTS_hash(idx)]'. Since POINTS_hash() returns
+ * 'idx' for each index in the table, the current encoder must produce the
+ * same bytes.
+ */
+static const char * test_zdict_compat_strs[] = {
+        "GET /api/v1/series 200",
+        "GET /api/v1/query 200",
+        "GET /api/v1/series 404",
+        "POST /api/v1/insert 200",
+        "GET /api/v1/series 200",
+        "caf\xc3\xa9 GET /api/v1/series",
+};
+
+static unsigned char test_zdict_compat_bits[] = {
+        0x10, 0x8c, 0x00, 0x00, 0x00, 0xe8, 0x03, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x0a, 0x97, 0x47, 0x45, 0x54, 0x20, 0x2f, 0x61, 0x70,
+        0x69, 0x2f, 0x76, 0x31, 0x2f, 0x73, 0x65, 0x72, 0x69, 0x65, 0x73,
+        0x20, 0x32, 0x30, 0x30, 0x00, 0x17, 0x0c, 0x85, 0x71, 0x75, 0x65,
+        0x72, 0x79, 0x16, 0x05, 0x16, 0x0c, 0x2d, 0x07, 0x84, 0x34, 0x30,
+        0x34, 0x00, 0x83, 0x50, 0x4f, 0x53, 0x45, 0x01, 0x0a, 0x86, 0x69,
+        0x6e, 0x73, 0x65, 0x72, 0x74, 0x2f, 0x05, 0x2f, 0x13, 0x84, 0x32,
+        0x30, 0x30, 0x00, 0x86, 0x63, 0x61, 0x66, 0xc3, 0xa9, 0x20, 0x1d,
+        0x12, 0x81, 0x00,
+};
+
+static int test_zdict_compat(void)
+{
+    test_start("zdict (compat)");
+
+    size_t i, size, n = sizeof(test_zdict_compat_strs) / sizeof(char *);
+    siridb_points_t * points = siridb_points_new(n, TP_STRING);
+    siridb_points_t * dest = siridb_points_new(n, TP_STRING);
+    unsigned char * bits;
+    uint16_t cinfo;
+
+    for (i = 0; i < n; i++)
+    {
+        points->data[i].ts = 1000 + i * 10;
+        points->data[i].val.str = strdup(test_zdict_compat_strs[i]);
+    }
+    points->len = n;
+
+    _assert (siridb_points_unzip_string(
+            dest, test_zdict_compat_bits, n, NULL, NULL, 0, NULL) == 0);
+    _assert (dest->len == n);
+    for (i = 0; i < n; i++)
+    {
+        _assert (dest->data[i].ts == points->data[i].ts);
+        _assert (strcmp(dest->data[i].val.str, points->data[i].val.str) == 0);
+    }
+
+    bits = siridb_points_zip_string(points, 0, n, &cinfo, &size, NULL);
+    _assert (bits != NULL);
+    _assert (size == sizeof(test_zdict_compat_bits));
+    _assert (memcmp(bits, test_zdict_compat_bits, size) == 0);
+    _assert (test_zdict_roundtrip(points, NULL) == size);
+
+    free(bits);
+    siridb_points_free(dest);
+    siridb_points_free(points);
+
+    return test_end();
+}
+
+int main()
+{
+    return (
+        test_zdict_train() ||
+        test_zdict_zip() ||
+        test_zdict_short() ||
+        test_zdict_compat() ||
+        0
+    );
+}